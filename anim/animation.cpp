@@ -0,0 +1,352 @@
+//
+// Clip compression, sampling, pose blending and the palette. See
+// animation.h.
+//
+
+#include "animation.h"
+#include <memory/memory_tracker.h>
+#include <math.h>
+#include <string.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+void anim_pose_init (AnimPose* p, int bones) {
+    MemoryScope scope (MEMORY_ANIMATION);
+    int n = anim_padded (bones);
+    p->bones = bones;
+    for (int c = 0; c < 4; c++) {
+        p->rotation[c].assign (n, c == 0 ? 1.0f : 0.0f);
+    }
+    for (int c = 0; c < 3; c++) {
+        p->translation[c].assign (n, 0.0f);
+    }
+}
+
+versor anim_pose_rotation (const AnimPose& p, int bone) {
+    return versor (p.rotation[0][bone], p.rotation[1][bone], p.rotation[2][bone], p.rotation[3][bone]);
+}
+
+vec3 anim_pose_translation (const AnimPose& p, int bone) {
+    return vec3 (p.translation[0][bone], p.translation[1][bone], p.translation[2][bone]);
+}
+
+void anim_pose_set (AnimPose* p, int bone, const versor& rotation, const vec3& translation) {
+    for (int c = 0; c < 4; c++) {
+        p->rotation[c][bone] = rotation.q[c];
+    }
+    for (int c = 0; c < 3; c++) {
+        p->translation[c][bone] = translation.v[c];
+    }
+}
+
+/*--------------------------------COMPRESSION---------------------------------*/
+void anim_clip_build (AnimClip* clip, const AnimRawClip& raw) {
+    MemoryScope scope (MEMORY_ANIMATION);
+    int bones = raw.bones;
+    clip->rate = raw.rate;
+    clip->frames = raw.frames;
+    clip->bones = bones;
+    clip->duration = raw.frames > 1 ? (float)(raw.frames - 1) / raw.rate : 0.0f;
+    anim_pose_init (&clip->constant, bones);
+    for (int b = 0; b < bones; b++) {
+        anim_pose_set (&clip->constant, b, raw.rotations[b], raw.translations[b]);
+    }
+
+    // each key in the hemisphere of the one before, so lerping between
+    // neighbours never goes the long way round
+    std::vector<versor> rotations (raw.rotations);
+    for (int f = 1; f < raw.frames; f++) {
+        for (int b = 0; b < bones; b++) {
+            versor& q = rotations[(size_t)f * bones + b];
+            if (dot (q, rotations[(size_t)(f - 1) * bones + b]) < 0.0f) {
+                q = q * -1.0f;
+            }
+        }
+    }
+
+    clip->rotation_bones.clear ();
+    clip->translation_bones.clear ();
+    for (int b = 0; b < bones; b++) {
+        bool rotates = false, translates = false;
+        for (int f = 1; f < raw.frames; f++) {
+            size_t k = (size_t)f * bones + b;
+            rotates |= 1.0f - fabsf (dot (raw.rotations[k], raw.rotations[b])) > ANIM_CONSTANT_ROTATION;
+            translates |= length (raw.translations[k] - raw.translations[b]) > ANIM_CONSTANT_TRANSLATION;
+        }
+        if (rotates) {
+            clip->rotation_bones.push_back (b);
+        }
+        if (translates) {
+            clip->translation_bones.push_back (b);
+        }
+    }
+
+    int rs = anim_padded ((int)clip->rotation_bones.size ());
+    clip->rotation_stride = rs;
+    clip->rotation_keys.assign ((size_t)raw.frames * 4 * rs, 0);
+    for (int f = 0; f < raw.frames; f++) {
+        int16_t* keys = &clip->rotation_keys[(size_t)f * 4 * rs];
+        for (int k = 0; k < rs; k++) {
+            if (k >= (int)clip->rotation_bones.size ()) {
+                keys[k] = 32767; // identity in the padding
+                continue;
+            }
+            const versor& q = rotations[(size_t)f * bones + clip->rotation_bones[k]];
+            for (int c = 0; c < 4; c++) {
+                float v = q.q[c] < -1.0f ? -1.0f : q.q[c] > 1.0f ? 1.0f : q.q[c];
+                keys[c * rs + k] = (int16_t)lroundf (v * 32767.0f);
+            }
+        }
+    }
+
+    int ts = anim_padded ((int)clip->translation_bones.size ());
+    clip->translation_stride = ts;
+    clip->translation_keys.assign ((size_t)raw.frames * 3 * ts, 0);
+    clip->translation_min.assign (3 * ts, 0.0f);
+    clip->translation_scale.assign (3 * ts, 0.0f);
+    for (int k = 0; k < (int)clip->translation_bones.size (); k++) {
+        int b = clip->translation_bones[k];
+        for (int c = 0; c < 3; c++) {
+            float lo = 1e30f, hi = -1e30f;
+            for (int f = 0; f < raw.frames; f++) {
+                float v = raw.translations[(size_t)f * bones + b].v[c];
+                lo = v < lo ? v : lo;
+                hi = v > hi ? v : hi;
+            }
+            float scale = (hi - lo) / 65535.0f;
+            clip->translation_min[c * ts + k] = lo;
+            clip->translation_scale[c * ts + k] = scale;
+            for (int f = 0; f < raw.frames; f++) {
+                float v = raw.translations[(size_t)f * bones + b].v[c];
+                long u = scale > 0.0f ? lroundf ((v - lo) / scale) : 0;
+                clip->translation_keys[(size_t)f * 3 * ts + c * ts + k] = (uint16_t)(u > 65535 ? 65535 : u);
+            }
+        }
+    }
+}
+
+size_t anim_raw_clip_bytes (const AnimRawClip& raw) {
+    return raw.rotations.size () * sizeof (versor) + raw.translations.size () * sizeof (vec3);
+}
+
+size_t anim_clip_bytes (const AnimClip& clip) {
+    size_t constant = (size_t)anim_padded (clip.bones) * 7 * sizeof (float);
+    return constant + clip.rotation_keys.size () * sizeof (int16_t) +
+           clip.translation_keys.size () * sizeof (uint16_t) +
+           (clip.translation_min.size () + clip.translation_scale.size ()) * sizeof (float) +
+           (clip.rotation_bones.size () + clip.translation_bones.size ()) * sizeof (int);
+}
+
+/*----------------------------------SAMPLING----------------------------------*/
+static void pose_copy (AnimPose* out, const AnimPose& p) {
+    if (out->bones != p.bones) {
+        anim_pose_init (out, p.bones);
+    }
+    size_t bytes = (size_t)anim_padded (p.bones) * sizeof (float);
+    for (int c = 0; c < 4; c++) {
+        memcpy (out->rotation[c].data (), p.rotation[c].data (), bytes);
+    }
+    for (int c = 0; c < 3; c++) {
+        memcpy (out->translation[c].data (), p.translation[c].data (), bytes);
+    }
+}
+
+void anim_clip_sample (const AnimClip& clip, float time, AnimPose* out) {
+    pose_copy (out, clip.constant);
+    if (clip.frames < 2) {
+        return;
+    }
+    float t = fmodf (time, clip.duration);
+    t = t < 0.0f ? t + clip.duration : t;
+    float x = t * clip.rate;
+    int f0 = (int)x;
+    f0 = f0 > clip.frames - 2 ? clip.frames - 2 : f0;
+    float frac = x - (float)f0;
+
+    // rotations: lerp the raw snorm keys, the normalise takes the scale out
+    int rs = clip.rotation_stride;
+    int rotating = (int)clip.rotation_bones.size ();
+    const int16_t* ka = clip.rotation_keys.data () + (size_t)f0 * 4 * rs;
+    const int16_t* kb = ka + 4 * rs;
+    for (int k = 0; k < rotating; k += 4) {
+        float q[4][4];
+#if defined(__SSE2__)
+        const __m128 ft = _mm_set1_ps (frac);
+        __m128 c[4];
+        __m128 len2 = _mm_setzero_ps ();
+        for (int i = 0; i < 4; i++) {
+            __m128i a = _mm_loadl_epi64 ((const __m128i*)(ka + i * rs + k));
+            __m128i b = _mm_loadl_epi64 ((const __m128i*)(kb + i * rs + k));
+            __m128 fa = _mm_cvtepi32_ps (_mm_srai_epi32 (_mm_unpacklo_epi16 (a, a), 16));
+            __m128 fb = _mm_cvtepi32_ps (_mm_srai_epi32 (_mm_unpacklo_epi16 (b, b), 16));
+            c[i] = _mm_add_ps (fa, _mm_mul_ps (_mm_sub_ps (fb, fa), ft));
+            len2 = _mm_add_ps (len2, _mm_mul_ps (c[i], c[i]));
+        }
+        __m128 inv = _mm_div_ps (_mm_set1_ps (1.0f), _mm_sqrt_ps (len2));
+        for (int i = 0; i < 4; i++) {
+            _mm_storeu_ps (q[i], _mm_mul_ps (c[i], inv));
+        }
+#else
+        for (int lane = 0; lane < 4; lane++) {
+            float len2 = 0.0f;
+            for (int i = 0; i < 4; i++) {
+                float a = ka[i * rs + k + lane], b = kb[i * rs + k + lane];
+                q[i][lane] = a + (b - a) * frac;
+                len2 += q[i][lane] * q[i][lane];
+            }
+            float inv = 1.0f / sqrtf (len2);
+            for (int i = 0; i < 4; i++) {
+                q[i][lane] *= inv;
+            }
+        }
+#endif
+        for (int lane = 0; lane < 4 && k + lane < rotating; lane++) {
+            int bone = clip.rotation_bones[k + lane];
+            for (int i = 0; i < 4; i++) {
+                out->rotation[i][bone] = q[i][lane];
+            }
+        }
+    }
+
+    // translations: lerp the unorm keys, then min + key * scale
+    int ts = clip.translation_stride;
+    int moving = (int)clip.translation_bones.size ();
+    const uint16_t* ta = clip.translation_keys.data () + (size_t)f0 * 3 * ts;
+    const uint16_t* tb = ta + 3 * ts;
+    for (int k = 0; k < moving; k += 4) {
+        float v[3][4];
+        for (int i = 0; i < 3; i++) {
+            const float* lo = clip.translation_min.data () + i * ts + k;
+            const float* scale = clip.translation_scale.data () + i * ts + k;
+#if defined(__SSE2__)
+            const __m128i zero = _mm_setzero_si128 ();
+            __m128i a = _mm_loadl_epi64 ((const __m128i*)(ta + i * ts + k));
+            __m128i b = _mm_loadl_epi64 ((const __m128i*)(tb + i * ts + k));
+            __m128 fa = _mm_cvtepi32_ps (_mm_unpacklo_epi16 (a, zero));
+            __m128 fb = _mm_cvtepi32_ps (_mm_unpacklo_epi16 (b, zero));
+            __m128 key = _mm_add_ps (fa, _mm_mul_ps (_mm_sub_ps (fb, fa), _mm_set1_ps (frac)));
+            _mm_storeu_ps (v[i], _mm_add_ps (_mm_loadu_ps (lo), _mm_mul_ps (key, _mm_loadu_ps (scale))));
+#else
+            for (int lane = 0; lane < 4; lane++) {
+                float a = ta[i * ts + k + lane], b = tb[i * ts + k + lane];
+                v[i][lane] = lo[lane] + (a + (b - a) * frac) * scale[lane];
+            }
+#endif
+        }
+        for (int lane = 0; lane < 4 && k + lane < moving; lane++) {
+            int bone = clip.translation_bones[k + lane];
+            for (int i = 0; i < 3; i++) {
+                out->translation[i][bone] = v[i][lane];
+            }
+        }
+    }
+}
+
+/*----------------------------------BLENDING----------------------------------*/
+void anim_pose_blend (AnimPose* out, const AnimPose& a, const AnimPose& b, float t) {
+    if (out->bones != a.bones) {
+        anim_pose_init (out, a.bones);
+    }
+    int n = anim_padded (a.bones);
+    int k = 0;
+#if defined(__SSE2__)
+    const __m128 ft = _mm_set1_ps (t);
+    const __m128 sign_bit = _mm_set1_ps (-0.0f);
+    for (; k < n; k += 4) {
+        __m128 qa[4], qb[4];
+        __m128 d = _mm_setzero_ps ();
+        for (int i = 0; i < 4; i++) {
+            qa[i] = _mm_loadu_ps (&a.rotation[i][k]);
+            qb[i] = _mm_loadu_ps (&b.rotation[i][k]);
+            d = _mm_add_ps (d, _mm_mul_ps (qa[i], qb[i]));
+        }
+        // b's sign flipped where the dot is negative, the short way round
+        __m128 flip = _mm_and_ps (_mm_cmplt_ps (d, _mm_setzero_ps ()), sign_bit);
+        __m128 len2 = _mm_setzero_ps ();
+        for (int i = 0; i < 4; i++) {
+            __m128 bi = _mm_xor_ps (qb[i], flip);
+            qa[i] = _mm_add_ps (qa[i], _mm_mul_ps (_mm_sub_ps (bi, qa[i]), ft));
+            len2 = _mm_add_ps (len2, _mm_mul_ps (qa[i], qa[i]));
+        }
+        __m128 inv = _mm_div_ps (_mm_set1_ps (1.0f), _mm_sqrt_ps (len2));
+        for (int i = 0; i < 4; i++) {
+            _mm_storeu_ps (&out->rotation[i][k], _mm_mul_ps (qa[i], inv));
+        }
+        for (int i = 0; i < 3; i++) {
+            __m128 va = _mm_loadu_ps (&a.translation[i][k]);
+            __m128 vb = _mm_loadu_ps (&b.translation[i][k]);
+            _mm_storeu_ps (&out->translation[i][k], _mm_add_ps (va, _mm_mul_ps (_mm_sub_ps (vb, va), ft)));
+        }
+    }
+#endif
+    for (; k < n; k++) {
+        float d = 0.0f;
+        for (int i = 0; i < 4; i++) {
+            d += a.rotation[i][k] * b.rotation[i][k];
+        }
+        float s = d < 0.0f ? -1.0f : 1.0f;
+        float q[4], len2 = 0.0f;
+        for (int i = 0; i < 4; i++) {
+            q[i] = a.rotation[i][k] + (b.rotation[i][k] * s - a.rotation[i][k]) * t;
+            len2 += q[i] * q[i];
+        }
+        float inv = 1.0f / sqrtf (len2);
+        for (int i = 0; i < 4; i++) {
+            out->rotation[i][k] = q[i] * inv;
+        }
+        for (int i = 0; i < 3; i++) {
+            out->translation[i][k] = a.translation[i][k] + (b.translation[i][k] - a.translation[i][k]) * t;
+        }
+    }
+}
+
+void anim_pose_blend_slerp (AnimPose* out, const AnimPose& a, const AnimPose& b, float t) {
+    if (out->bones != a.bones) {
+        anim_pose_init (out, a.bones);
+    }
+    for (int k = 0; k < a.bones; k++) {
+        versor q = slerp (anim_pose_rotation (a, k), anim_pose_rotation (b, k), t);
+        vec3 ta = anim_pose_translation (a, k);
+        anim_pose_set (out, k, q, ta + (anim_pose_translation (b, k) - ta) * t);
+    }
+}
+
+/*----------------------------------PALETTE-----------------------------------*/
+/* out = a * b. out may be a or b */
+static inline void mat4_mul_to (const mat4& a, const mat4& b, mat4* out) {
+#if defined(__SSE2__)
+    __m128 a0 = _mm_loadu_ps (a.m), a1 = _mm_loadu_ps (a.m + 4);
+    __m128 a2 = _mm_loadu_ps (a.m + 8), a3 = _mm_loadu_ps (a.m + 12);
+    __m128 r[4];
+    for (int j = 0; j < 4; j++) {
+        const float* c = b.m + j * 4;
+        r[j] = _mm_add_ps (_mm_add_ps (_mm_mul_ps (a0, _mm_set1_ps (c[0])), _mm_mul_ps (a1, _mm_set1_ps (c[1]))),
+                           _mm_add_ps (_mm_mul_ps (a2, _mm_set1_ps (c[2])), _mm_mul_ps (a3, _mm_set1_ps (c[3]))));
+    }
+    for (int j = 0; j < 4; j++) {
+        _mm_storeu_ps (out->m + j * 4, r[j]);
+    }
+#else
+    *out = a * b;
+#endif
+}
+
+void anim_build_palette (const Skeleton& skeleton, const AnimPose& pose, mat4* model, mat4* palette) {
+    int bones = (int)skeleton.parent.size ();
+    for (int i = 0; i < bones; i++) {
+        mat4 local = quat_to_mat4 (anim_pose_rotation (pose, i));
+        local.m[12] = pose.translation[0][i];
+        local.m[13] = pose.translation[1][i];
+        local.m[14] = pose.translation[2][i];
+        int p = skeleton.parent[i];
+        if (p < 0) {
+            model[i] = local;
+        } else {
+            mat4_mul_to (model[p], local, &model[i]);
+        }
+    }
+    for (int i = 0; i < bones; i++) {
+        mat4_mul_to (model[i], skeleton.inverse_bind[i], &palette[i]);
+    }
+}
@@ -0,0 +1,111 @@
+//
+// Skeletal animation: compressed clips, poses, blending and the skinning
+// palette.
+//
+// A skeleton is a list of bones, parents before children, each with the
+// inverse of its bind pose in model space. A pose is every bone's local
+// rotation and translation relative to its parent, kept as structure of
+// arrays (one float array per quaternion or vector component, a lane per
+// bone, padded to a multiple of 4) so that blending runs four bones at a
+// time with SSE.
+//
+// A clip is sampled at a fixed rate, so finding the keys for a time is one
+// multiply. It is compressed when built from raw keys:
+//  - a track (one bone's rotation or translation) that never changes is
+//    dropped and its value kept once in the clip's constant pose
+//  - rotations are 4 x 16 bit snorm, made to lie in the same hemisphere as
+//    the key before so that neighbouring keys interpolate the short way
+//  - translations are 3 x 16 bit unorm over the track's own range
+// Keys are stored frame by frame, structure of arrays across the animated
+// tracks, so sampling reads two short runs of memory and decodes four
+// tracks at a time. A typical walk cycle comes out at about a quarter of
+// its raw size.
+//
+// Sampling and blending use nlerp (lerp, then normalise). Between keys a
+// few frames apart, and between two poses of one skeleton, the angles are
+// small and nlerp's error against slerp is far below the key precision.
+// anim_pose_blend_slerp is there for wide angle blends.
+//
+// The palette is built in two passes over the bones: model = parent's model
+// * local, then palette = model * inverse bind. Each is a plain mat4, so the
+// palette can go straight into a uniform buffer for GPU skinning, or to
+// anim_skin (anim/skinning.h) on the CPU.
+//
+
+#ifndef FPS_STYLE_ROOM_ANIMATION_H
+#define FPS_STYLE_ROOM_ANIMATION_H
+
+#include <stdint.h>
+#include <vector>
+#include <utils/maths_funcs.h>
+
+#define ANIM_MAX_BONES 256
+
+struct Skeleton {
+    std::vector<int> parent;     // -1 for the root, otherwise a lower index
+    std::vector<mat4> inverse_bind;
+};
+
+/* local bone transforms, a lane per bone. arrays hold anim_padded (bones) */
+struct AnimPose {
+    int bones;
+    std::vector<float> rotation[4];    // w x y z
+    std::vector<float> translation[3];
+};
+
+/* keys as authored, [frame * bones + bone] */
+struct AnimRawClip {
+    float rate;                  // frames a second
+    int frames;
+    int bones;
+    std::vector<versor> rotations;
+    std::vector<vec3> translations;
+};
+
+struct AnimClip {
+    float rate;
+    int frames;
+    int bones;
+    float duration;              // (frames - 1) / rate
+    AnimPose constant;           // every bone at frame 0, covers the dropped tracks
+    std::vector<int> rotation_bones;    // animated rotation tracks
+    std::vector<int> translation_bones; // animated translation tracks
+    int rotation_stride;         // animated rotation tracks, padded to 4
+    int translation_stride;
+    std::vector<int16_t> rotation_keys;     // per frame w[stride] x[...] y[...] z[...]
+    std::vector<uint16_t> translation_keys; // per frame x[stride] y[...] z[...]
+    std::vector<float> translation_min;     // x[stride] y[...] z[...]
+    std::vector<float> translation_scale;   // range / 65535, same layout
+};
+
+inline int anim_padded (int bones) {
+    return (bones + 3) & ~3;
+}
+
+/* every bone at identity */
+void anim_pose_init (AnimPose* p, int bones);
+
+/* tracks that move less than this are constant: rotation as 1 - |dot| with
+the first key, translation in units */
+#define ANIM_CONSTANT_ROTATION 1e-7f
+#define ANIM_CONSTANT_TRANSLATION 1e-5f
+void anim_clip_build (AnimClip* clip, const AnimRawClip& raw);
+/* bytes of key data, raw and compressed */
+size_t anim_raw_clip_bytes (const AnimRawClip& raw);
+size_t anim_clip_bytes (const AnimClip& clip);
+
+/* the pose at time seconds, looping */
+void anim_clip_sample (const AnimClip& clip, float time, AnimPose* out);
+/* out = a + (b - a) * t, per bone. out may be a or b */
+void anim_pose_blend (AnimPose* out, const AnimPose& a, const AnimPose& b, float t);
+/* the same with slerp for the rotations. slower */
+void anim_pose_blend_slerp (AnimPose* out, const AnimPose& a, const AnimPose& b, float t);
+versor anim_pose_rotation (const AnimPose& p, int bone);
+vec3 anim_pose_translation (const AnimPose& p, int bone);
+void anim_pose_set (AnimPose* p, int bone, const versor& rotation, const vec3& translation);
+
+/* model space bone transforms, then palette = model * inverse bind. both
+arrays hold a matrix per bone */
+void anim_build_palette (const Skeleton& skeleton, const AnimPose& pose, mat4* model, mat4* palette);
+
+#endif //FPS_STYLE_ROOM_ANIMATION_H
@@ -0,0 +1,89 @@
+//
+// SSE linear blend skinning and the crowd update. See skinning.h.
+//
+
+#include "skinning.h"
+#include <memory/memory_tracker.h>
+#include <jobs/job_system.h>
+#include <chrono>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+void anim_skin (const SkinMesh& mesh, const mat4* palette, int first, int count, float* out) {
+    MemoryScope scope (MEMORY_ANIMATION);
+    const SkinVertex* v = mesh.vertices.data () + first;
+    for (int i = 0; i < count; i++, v++, out += ANIM_SKIN_STRIDE) {
+#if defined(__SSE2__)
+        // the weighted sum of the bones' matrices, a column at a time
+        __m128 c0 = _mm_setzero_ps (), c1 = _mm_setzero_ps ();
+        __m128 c2 = _mm_setzero_ps (), c3 = _mm_setzero_ps ();
+        for (int j = 0; j < ANIM_SKIN_INFLUENCES && v->weights[j] > 0.0f; j++) {
+            const float* m = palette[v->bones[j]].m;
+            __m128 w = _mm_set1_ps (v->weights[j]);
+            c0 = _mm_add_ps (c0, _mm_mul_ps (_mm_loadu_ps (m), w));
+            c1 = _mm_add_ps (c1, _mm_mul_ps (_mm_loadu_ps (m + 4), w));
+            c2 = _mm_add_ps (c2, _mm_mul_ps (_mm_loadu_ps (m + 8), w));
+            c3 = _mm_add_ps (c3, _mm_mul_ps (_mm_loadu_ps (m + 12), w));
+        }
+        __m128 p = _mm_add_ps (_mm_add_ps (_mm_mul_ps (c0, _mm_set1_ps (v->position[0])),
+                                           _mm_mul_ps (c1, _mm_set1_ps (v->position[1]))),
+                               _mm_add_ps (_mm_mul_ps (c2, _mm_set1_ps (v->position[2])), c3));
+        __m128 n = _mm_add_ps (_mm_add_ps (_mm_mul_ps (c0, _mm_set1_ps (v->normal[0])),
+                                           _mm_mul_ps (c1, _mm_set1_ps (v->normal[1]))),
+                               _mm_mul_ps (c2, _mm_set1_ps (v->normal[2])));
+        // three lanes each, the fourth would run into the next vertex
+        _mm_storel_pi ((__m64*)out, p);
+        _mm_store_ss (out + 2, _mm_movehl_ps (p, p));
+        _mm_storel_pi ((__m64*)(out + 3), n);
+        _mm_store_ss (out + 5, _mm_movehl_ps (n, n));
+#else
+        float m[16] = {0.0f};
+        for (int j = 0; j < ANIM_SKIN_INFLUENCES && v->weights[j] > 0.0f; j++) {
+            const float* b = palette[v->bones[j]].m;
+            for (int e = 0; e < 16; e++) {
+                m[e] += b[e] * v->weights[j];
+            }
+        }
+        for (int r = 0; r < 3; r++) {
+            out[r] = m[r] * v->position[0] + m[4 + r] * v->position[1] + m[8 + r] * v->position[2] + m[12 + r];
+            out[3 + r] = m[r] * v->normal[0] + m[4 + r] * v->normal[1] + m[8 + r] * v->normal[2];
+        }
+#endif
+    }
+}
+
+void anim_character_init (AnimCharacter* c, const Skeleton& skeleton, const SkinMesh& mesh) {
+    MemoryScope scope (MEMORY_ANIMATION);
+    int bones = (int)skeleton.parent.size ();
+    for (int i = 0; i < 2; i++) {
+        anim_pose_init (&c->sampled[i], bones);
+    }
+    anim_pose_init (&c->pose, bones);
+    c->model.resize (bones);
+    c->palette.resize (bones);
+    c->vertices.resize (mesh.vertices.size () * ANIM_SKIN_STRIDE);
+}
+
+void anim_update (const Skeleton& skeleton, const SkinMesh& mesh, AnimCharacter* characters, int count,
+                  AnimStats* stats) {
+    MemoryScope scope (MEMORY_ANIMATION);
+    auto t0 = std::chrono::steady_clock::now ();
+    parallel_for_each (count, 1, [&] (int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            AnimCharacter& c = characters[i];
+            anim_clip_sample (*c.clip[0], c.time[0], &c.sampled[0]);
+            if (c.weight > 0.0f) {
+                anim_clip_sample (*c.clip[1], c.time[1], &c.sampled[1]);
+                anim_pose_blend (&c.pose, c.sampled[0], c.sampled[1], c.weight);
+            }
+            const AnimPose& pose = c.weight > 0.0f ? c.pose : c.sampled[0];
+            anim_build_palette (skeleton, pose, c.model.data (), c.palette.data ());
+            anim_skin (mesh, c.palette.data (), 0, (int)mesh.vertices.size (), c.vertices.data ());
+        }
+    });
+    stats->characters = (unsigned int)count;
+    stats->bones = (unsigned int)(count * skeleton.parent.size ());
+    stats->vertices = (unsigned int)(count * mesh.vertices.size ());
+    stats->ms = std::chrono::duration<double, std::milli> (std::chrono::steady_clock::now () - t0).count ();
+}
@@ -0,0 +1,71 @@
+//
+// Linear blend skinning on the CPU, and the per frame update of many
+// animated characters.
+//
+// Each vertex has up to four bones and weights. Its skinning matrix is the
+// weighted sum of those bones' palette matrices (anim/animation.h), applied
+// to the bind pose position and normal. With SSE the sum runs a matrix
+// column at a time, so a vertex is 4 multiply-adds per bone and no
+// shuffles. Normals go through the same matrix, not its inverse transpose:
+// right for bones that only rotate and translate, which is all a clip
+// holds. They come out unnormalised, for the shader to normalise.
+//
+// Output is ANIM_SKIN_STRIDE floats per vertex, position then normal, ready
+// for a vertex buffer.
+//
+// anim_update runs a whole crowd: each character samples two clips, blends
+// them, builds its palette and skins its mesh, one character per job.
+// Characters share nothing but the read only skeleton, mesh and clips.
+//
+
+#ifndef FPS_STYLE_ROOM_SKINNING_H
+#define FPS_STYLE_ROOM_SKINNING_H
+
+#include <stdint.h>
+#include <vector>
+#include <anim/animation.h>
+
+#define ANIM_SKIN_STRIDE 6
+#define ANIM_SKIN_INFLUENCES 4
+
+struct SkinVertex {
+    float position[3];           // bind pose, model space
+    float normal[3];
+    uint8_t bones[ANIM_SKIN_INFLUENCES];
+    float weights[ANIM_SKIN_INFLUENCES]; // heaviest first, sum to 1, unused 0
+};
+
+struct SkinMesh {
+    std::vector<SkinVertex> vertices;
+    std::vector<unsigned int> indices;
+};
+
+/* skins vertices [first, first + count) into out, which gets
+ANIM_SKIN_STRIDE floats for each */
+void anim_skin (const SkinMesh& mesh, const mat4* palette, int first, int count, float* out);
+
+struct AnimCharacter {
+    const AnimClip* clip[2];
+    float time[2];               // seconds into each clip
+    float weight;                // of clip[1]
+    AnimPose sampled[2];
+    AnimPose pose;
+    std::vector<mat4> model;
+    std::vector<mat4> palette;
+    std::vector<float> vertices; // skinned, ANIM_SKIN_STRIDE floats each
+};
+
+struct AnimStats {
+    unsigned int characters;
+    unsigned int bones;          // palette matrices built
+    unsigned int vertices;       // skinned
+    double ms;
+};
+
+/* sizes the character's buffers for skeleton and mesh */
+void anim_character_init (AnimCharacter* c, const Skeleton& skeleton, const SkinMesh& mesh);
+/* the palette and skinned vertices of every character, one job each */
+void anim_update (const Skeleton& skeleton, const SkinMesh& mesh, AnimCharacter* characters, int count,
+                  AnimStats* stats);
+
+#endif //FPS_STYLE_ROOM_SKINNING_H
@@ -0,0 +1,348 @@
+//
+// Skeletal animation for a crowd: clip sampling, pose blending, palettes and
+// skinning, stage by stage against straightforward versions, then the whole
+// update on the job system.
+//
+// Every character shares one 60 bone skeleton: a root with a spine and head
+// chain, two arms and two legs. The mesh is a tube of rings along each bone,
+// each vertex weighted to its bone, the parent and the grandparent. Two 1 s
+// clips at 30 Hz, a walk and a run, swing most joints on sine waves and
+// bob the root. About a third of the joints hold still, so their tracks get
+// dropped as constant. Each character plays both clips at its own phase and
+// blends them with its own weight.
+//
+// The baselines:
+//  - sampling: slerp between the raw keys, AoS versor and vec3
+//  - blending: anim_pose_blend_slerp, slerp per bone
+//  - skinning: the weighted matrix sum and transform in scalar floats
+//
+// Checks: compressed sampling within 0.1 degrees and 1e-3 units of the raw
+// keys; SIMD skinning within 1e-4 of the scalar version.
+//
+// usage: bench_animation [characters] [seed]
+//
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <anim/skinning.h>
+#include <jobs/job_system.h>
+#include "bench_common.h"
+
+static const int REPS = 5;
+static const int BONES = 60;
+static const int RINGS = 4;              // per bone
+static const int RING_VERTICES = 12;
+
+static unsigned int rng_state;
+
+static float frand () {
+    rng_state = rng_state * 1664525u + 1013904223u;
+    return (float)(rng_state >> 8) / 16777216.0f;
+}
+
+/* root, then chains: spine and head 11, arms 12 each off the top of the
+spine, legs 12 each off the root */
+static void build_skeleton (Skeleton* s, std::vector<vec3>* offsets) {
+    const int lengths[5] = {11, 12, 12, 12, 12};
+    const vec3 dirs[5] = {vec3 (0.0f, 1.0f, 0.0f), vec3 (1.0f, 0.2f, 0.0f), vec3 (-1.0f, 0.2f, 0.0f),
+                          vec3 (0.3f, -1.0f, 0.0f), vec3 (-0.3f, -1.0f, 0.0f)};
+    s->parent.assign (1, -1);
+    offsets->assign (1, vec3 (0.0f, 1.0f, 0.0f));
+    int spine_top = 0;
+    for (int c = 0; c < 5; c++) {
+        for (int k = 0; k < lengths[c]; k++) {
+            int parent = k > 0 ? (int)s->parent.size () - 1 : (c == 1 || c == 2) ? spine_top : 0;
+            s->parent.push_back (parent);
+            offsets->push_back (normalise (dirs[c]) * 0.06f);
+            if (c == 0 && k == 5) {
+                spine_top = (int)s->parent.size () - 1;
+            }
+        }
+    }
+    std::vector<mat4> model (BONES);
+    s->inverse_bind.resize (BONES);
+    for (int i = 0; i < BONES; i++) {
+        mat4 local = translate (identity_mat4 (), (*offsets)[i]);
+        model[i] = s->parent[i] < 0 ? local : model[s->parent[i]] * local;
+        s->inverse_bind[i] = inverse (model[i]);
+    }
+}
+
+/* a tube of rings from each bone's parent joint to its own */
+static void build_mesh (const Skeleton& s, SkinMesh* mesh) {
+    std::vector<vec3> joint (BONES);
+    for (int i = 0; i < BONES; i++) {
+        mat4 bind = inverse (s.inverse_bind[i]);
+        joint[i] = vec3 (bind.m[12], bind.m[13], bind.m[14]);
+    }
+    for (int i = 1; i < BONES; i++) {
+        int p = s.parent[i];
+        int g = s.parent[p] >= 0 ? s.parent[p] : p;
+        vec3 axis = normalise (joint[i] - joint[p]);
+        vec3 other = fabsf (axis.v[1]) < 0.9f ? vec3 (0.0f, 1.0f, 0.0f) : vec3 (1.0f, 0.0f, 0.0f);
+        vec3 side = normalise (cross (axis, other));
+        vec3 up = cross (side, axis);
+        unsigned int base = (unsigned int)mesh->vertices.size ();
+        for (int r = 0; r < RINGS; r++) {
+            float t = (float)r / RINGS;
+            vec3 centre = joint[p] + (joint[i] - joint[p]) * t;
+            for (int k = 0; k < RING_VERTICES; k++) {
+                float a = 6.2831853f * k / RING_VERTICES;
+                vec3 n = side * cosf (a) + up * sinf (a);
+                vec3 pos = centre + n * 0.02f;
+                SkinVertex v;
+                for (int c = 0; c < 3; c++) {
+                    v.position[c] = pos.v[c];
+                    v.normal[c] = n.v[c];
+                }
+                v.bones[0] = (uint8_t)i;
+                v.bones[1] = (uint8_t)p;
+                v.bones[2] = (uint8_t)g;
+                v.bones[3] = 0;
+                v.weights[0] = 0.5f + 0.4f * t;
+                v.weights[1] = 0.4f - 0.4f * t;
+                v.weights[2] = 0.1f;
+                v.weights[3] = 0.0f;
+                mesh->vertices.push_back (v);
+            }
+        }
+        for (int r = 0; r + 1 < RINGS; r++) {
+            for (int k = 0; k < RING_VERTICES; k++) {
+                unsigned int a = base + r * RING_VERTICES + k;
+                unsigned int b = base + r * RING_VERTICES + (k + 1) % RING_VERTICES;
+                unsigned int indices[6] = {a, b, a + RING_VERTICES, b, b + RING_VERTICES, a + RING_VERTICES};
+                mesh->indices.insert (mesh->indices.end (), indices, indices + 6);
+            }
+        }
+    }
+}
+
+/* joints swing on sines about their own axes, a few hold still */
+static void build_clip (const std::vector<vec3>& offsets, float speed, AnimRawClip* raw) {
+    raw->rate = 30.0f;
+    raw->frames = 31;
+    raw->bones = BONES;
+    raw->rotations.resize ((size_t)raw->frames * BONES);
+    raw->translations.resize ((size_t)raw->frames * BONES);
+    std::vector<vec3> axis (BONES);
+    std::vector<float> amplitude (BONES), phase (BONES);
+    for (int b = 0; b < BONES; b++) {
+        axis[b] = normalise (vec3 (frand () - 0.5f, frand () - 0.5f, frand () - 0.5f));
+        amplitude[b] = frand () < 0.3f ? 0.0f : (10.0f + 30.0f * frand ()) * speed;
+        phase[b] = frand () * 6.2831853f;
+    }
+    for (int f = 0; f < raw->frames; f++) {
+        float s = 6.2831853f * f / (raw->frames - 1);
+        for (int b = 0; b < BONES; b++) {
+            size_t k = (size_t)f * BONES + b;
+            raw->rotations[k] = quat_from_axis_deg (amplitude[b] * sinf (s + phase[b]), axis[b].v[0], axis[b].v[1],
+                                                    axis[b].v[2]);
+            raw->translations[k] = offsets[b];
+        }
+        raw->translations[(size_t)f * BONES].v[1] += 0.03f * speed * sinf (2.0f * s);
+    }
+}
+
+/* the baseline sampler: slerp between raw keys */
+static void sample_raw (const AnimRawClip& raw, float time, AnimPose* out) {
+    float duration = (raw.frames - 1) / raw.rate;
+    float t = fmodf (time, duration);
+    t = t < 0.0f ? t + duration : t;
+    float x = t * raw.rate;
+    int f0 = (int)x;
+    f0 = f0 > raw.frames - 2 ? raw.frames - 2 : f0;
+    float frac = x - (float)f0;
+    for (int b = 0; b < raw.bones; b++) {
+        size_t a = (size_t)f0 * raw.bones + b, c = a + raw.bones;
+        vec3 ta = raw.translations[a];
+        anim_pose_set (out, b, slerp (raw.rotations[a], raw.rotations[c], frac),
+                       ta + (raw.translations[c] - ta) * frac);
+    }
+}
+
+/* the baseline skinning, scalar */
+static void skin_scalar (const SkinMesh& mesh, const mat4* palette, float* out) {
+    for (size_t i = 0; i < mesh.vertices.size (); i++, out += ANIM_SKIN_STRIDE) {
+        const SkinVertex& v = mesh.vertices[i];
+        float m[16] = {0.0f};
+        for (int j = 0; j < ANIM_SKIN_INFLUENCES; j++) {
+            for (int e = 0; e < 16; e++) {
+                m[e] += palette[v.bones[j]].m[e] * v.weights[j];
+            }
+        }
+        for (int r = 0; r < 3; r++) {
+            out[r] = m[r] * v.position[0] + m[4 + r] * v.position[1] + m[8 + r] * v.position[2] + m[12 + r];
+            out[3 + r] = m[r] * v.normal[0] + m[4 + r] * v.normal[1] + m[8 + r] * v.normal[2];
+        }
+    }
+}
+
+/* degrees between two rotations. acos of the dot has no precision left
+near 1, so this takes the angle from the chord between the unit versors */
+static float angle_between (const versor& a, const versor& b) {
+    double na = 0.0, nb = 0.0, d = 0.0;
+    for (int i = 0; i < 4; i++) {
+        na += (double)a.q[i] * a.q[i];
+        nb += (double)b.q[i] * b.q[i];
+        d += (double)a.q[i] * b.q[i];
+    }
+    double s = d < 0.0 ? -1.0 : 1.0;
+    double minus = 0.0, plus = 0.0;
+    for (int i = 0; i < 4; i++) {
+        double x = a.q[i] / sqrt (na), y = s * b.q[i] / sqrt (nb);
+        minus += (x - y) * (x - y);
+        plus += (x + y) * (x + y);
+    }
+    return (float)(4.0 * atan2 (sqrt (minus), sqrt (plus)) * 57.29577951308232);
+}
+
+int main (int argc, char** argv) {
+    int count = argc > 1 ? atoi (argv[1]) : 128;
+    rng_state = argc > 2 ? (unsigned int)strtoul (argv[2], NULL, 10) : 1;
+    job_system_init (0);
+
+    Skeleton skeleton;
+    std::vector<vec3> offsets;
+    build_skeleton (&skeleton, &offsets);
+    SkinMesh mesh;
+    build_mesh (skeleton, &mesh);
+    AnimRawClip raw[2];
+    AnimClip clips[2];
+    for (int i = 0; i < 2; i++) {
+        build_clip (offsets, i == 0 ? 1.0f : 1.6f, &raw[i]);
+        anim_clip_build (&clips[i], raw[i]);
+    }
+    std::vector<AnimCharacter> crowd (count);
+    for (int i = 0; i < count; i++) {
+        AnimCharacter& c = crowd[i];
+        anim_character_init (&c, skeleton, mesh);
+        c.clip[0] = &clips[0];
+        c.clip[1] = &clips[1];
+        c.time[0] = frand () * 10.0f;
+        c.time[1] = frand () * 10.0f;
+        c.weight = 0.05f + 0.9f * frand ();
+    }
+    int nv = (int)mesh.vertices.size ();
+    printf ("%d characters, %d bones, %d vertices each, %d worker(s)\n", count, BONES, nv,
+            job_system_worker_count ());
+    printf ("clips: %zu raw bytes -> %zu compressed, %zu of %d rotation and %zu of %d translation tracks animated\n",
+            anim_raw_clip_bytes (raw[0]) + anim_raw_clip_bytes (raw[1]),
+            anim_clip_bytes (clips[0]) + anim_clip_bytes (clips[1]),
+            clips[0].rotation_bones.size () + clips[1].rotation_bones.size (), 2 * BONES,
+            clips[0].translation_bones.size () + clips[1].translation_bones.size (), 2 * BONES);
+
+    int failures = 0;
+    // accuracy of the compressed clips against the raw keys, then timing
+    float worst_angle = 0.0f, worst_move = 0.0f;
+    AnimPose ref;
+    anim_pose_init (&ref, BONES);
+    for (int i = 0; i < count; i++) {
+        for (int k = 0; k < 2; k++) {
+            anim_clip_sample (clips[k], crowd[i].time[k], &crowd[i].sampled[k]);
+            sample_raw (raw[k], crowd[i].time[k], &ref);
+            for (int b = 0; b < BONES; b++) {
+                float a = angle_between (anim_pose_rotation (crowd[i].sampled[k], b), anim_pose_rotation (ref, b));
+                float m = length (anim_pose_translation (crowd[i].sampled[k], b) - anim_pose_translation (ref, b));
+                worst_angle = a > worst_angle ? a : worst_angle;
+                worst_move = m > worst_move ? m : worst_move;
+            }
+        }
+    }
+    double sample_ms = bench_best_ms (REPS, [&] {
+        for (int i = 0; i < count; i++) {
+            for (int k = 0; k < 2; k++) {
+                anim_clip_sample (clips[k], crowd[i].time[k], &crowd[i].sampled[k]);
+            }
+        }
+    });
+    double sample_raw_ms = bench_best_ms (REPS, [&] {
+        for (int i = 0; i < count; i++) {
+            for (int k = 0; k < 2; k++) {
+                sample_raw (raw[k], crowd[i].time[k], &ref);
+                bench_keep (ref.rotation[0][0]);
+            }
+        }
+    });
+
+    // nlerp against slerp
+    float blend_angle = 0.0f;
+    for (int i = 0; i < count; i++) {
+        anim_pose_blend_slerp (&ref, crowd[i].sampled[0], crowd[i].sampled[1], crowd[i].weight);
+        anim_pose_blend (&crowd[i].pose, crowd[i].sampled[0], crowd[i].sampled[1], crowd[i].weight);
+        for (int b = 0; b < BONES; b++) {
+            float a = angle_between (anim_pose_rotation (crowd[i].pose, b), anim_pose_rotation (ref, b));
+            blend_angle = a > blend_angle ? a : blend_angle;
+        }
+    }
+    double blend_ms = bench_best_ms (REPS, [&] {
+        for (int i = 0; i < count; i++) {
+            anim_pose_blend (&crowd[i].pose, crowd[i].sampled[0], crowd[i].sampled[1], crowd[i].weight);
+        }
+    });
+    double slerp_ms = bench_best_ms (REPS, [&] {
+        for (int i = 0; i < count; i++) {
+            anim_pose_blend_slerp (&ref, crowd[i].sampled[0], crowd[i].sampled[1], crowd[i].weight);
+            bench_keep (ref.rotation[0][0]);
+        }
+    });
+
+    double palette_ms = bench_best_ms (REPS, [&] {
+        for (int i = 0; i < count; i++) {
+            anim_build_palette (skeleton, crowd[i].pose, crowd[i].model.data (), crowd[i].palette.data ());
+        }
+    });
+
+    std::vector<float> scalar (nv * ANIM_SKIN_STRIDE);
+    float skin_error = 0.0f;
+    for (int i = 0; i < count; i++) {
+        anim_skin (mesh, crowd[i].palette.data (), 0, nv, crowd[i].vertices.data ());
+        skin_scalar (mesh, crowd[i].palette.data (), scalar.data ());
+        for (int k = 0; k < nv * ANIM_SKIN_STRIDE; k++) {
+            float e = fabsf (scalar[k] - crowd[i].vertices[k]);
+            skin_error = e > skin_error ? e : skin_error;
+        }
+    }
+    double skin_ms = bench_best_ms (REPS, [&] {
+        for (int i = 0; i < count; i++) {
+            anim_skin (mesh, crowd[i].palette.data (), 0, nv, crowd[i].vertices.data ());
+        }
+    });
+    double skin_scalar_ms = bench_best_ms (REPS, [&] {
+        for (int i = 0; i < count; i++) {
+            skin_scalar (mesh, crowd[i].palette.data (), scalar.data ());
+            bench_keep (scalar[0]);
+        }
+    });
+
+    AnimStats stats;
+    double update_ms = bench_best_ms (REPS, [&] {
+        anim_update (skeleton, mesh, crowd.data (), count, &stats);
+    });
+
+    printf ("stage       this(ms)  baseline(ms)  speedup   per character(us)\n");
+    printf ("sample x2   %8.3f  %12.3f  %6.1fx   %17.2f\n", sample_ms, sample_raw_ms, sample_raw_ms / sample_ms,
+            sample_ms * 1000.0 / count);
+    printf ("blend       %8.3f  %12.3f  %6.1fx   %17.2f\n", blend_ms, slerp_ms, slerp_ms / blend_ms,
+            blend_ms * 1000.0 / count);
+    printf ("palette     %8.3f  %12s  %7s   %17.2f\n", palette_ms, "", "", palette_ms * 1000.0 / count);
+    printf ("skin        %8.3f  %12.3f  %6.1fx   %17.2f\n", skin_ms, skin_scalar_ms, skin_scalar_ms / skin_ms,
+            skin_ms * 1000.0 / count);
+    printf ("anim_update %8.3f  %12s  %7s   %17.2f   (%u palettes, %u vertices)\n", update_ms, "", "",
+            update_ms * 1000.0 / count, stats.bones, stats.vertices);
+    printf ("error: sampling %.4f deg %.6f units, nlerp vs slerp blend %.4f deg, skinning %.2e\n", worst_angle,
+            worst_move, blend_angle, skin_error);
+
+    if (worst_angle > 0.1f || worst_move > 1e-3f) {
+        printf ("ERROR: compressed sampling is %.4f degrees and %.6f units off the raw keys\n", worst_angle,
+                worst_move);
+        failures++;
+    }
+    if (skin_error > 1e-4f) {
+        printf ("ERROR: SIMD skinning is %.2e off the scalar version\n", skin_error);
+        failures++;
+    }
+    job_system_shutdown ();
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,73 @@
+//
+// Per-event camera update: the old rebuild-from-Euler-angles path against the
+// incremental CameraOrientation path. Both use the inline maths, so the gap is
+// the algorithm, not call overhead.
+//
+// usage: bench_camera [events]
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <utils/maths_funcs.h>
+#include <camera/camera_orientation.h>
+#include "bench_common.h"
+
+static const int REPS = 7;
+
+static float delta_yaw (int i) {
+    return 0.1f * (float)((i * 7) % 11 - 5);
+}
+
+static float delta_pitch (int i) {
+    return 0.1f * (float)((i * 5) % 7 - 3);
+}
+
+/* what cursor_position_callback + calculateViewMatrix used to do */
+static mat4 update_rebuild (int events, const float* pos) {
+    float yaw = 0.0f, pitch = 0.0f;
+    mat4 view = identity_mat4 ();
+    for (int i = 0; i < events; i++) {
+        yaw += delta_yaw (i);
+        pitch += delta_pitch (i);
+        mat4 rpitch = quat_to_mat4 (quat_from_axis_deg (pitch, 1.0f, 0.0f, 0.0f));
+        mat4 ryaw = quat_to_mat4 (quat_from_axis_deg (yaw, 0.0f, 1.0f, 0.0f));
+        mat4 t = translate (identity_mat4 (), vec3 (-pos[0], -pos[1], -pos[2]));
+        view = rpitch * ryaw * t;
+        bench_keep (view);
+    }
+    return view;
+}
+
+static mat4 update_incremental (int events, const float* pos) {
+    CameraOrientation o;
+    camera_orientation_init (&o, 0.0f, 0.0f);
+    mat4 view;
+    for (int i = 0; i < events; i++) {
+        camera_orientation_rotate (&o, delta_yaw (i), delta_pitch (i));
+        camera_orientation_view (&o, pos, &view);
+        bench_keep (view);
+    }
+    return view;
+}
+
+int main (int argc, char** argv) {
+    int events = argc > 1 ? atoi (argv[1]) : 1000000;
+    const float pos[3] = {1.5f, 0.25f, -3.0f};
+
+    mat4 a, b;
+    double rebuild_ms = bench_best_ms (REPS, [&] { a = update_rebuild (events, pos); });
+    double incremental_ms = bench_best_ms (REPS, [&] { b = update_incremental (events, pos); });
+
+    float max_err = 0.0f;
+    for (int i = 0; i < 16; i++) {
+        max_err = fmaxf (max_err, fabsf (a.m[i] - b.m[i]));
+    }
+
+    printf ("camera update, %d events (rotate + view matrix per event)\n", events);
+    printf ("  rebuild:     %8.3f ms  %6.2f ns/event\n", rebuild_ms, rebuild_ms * 1e6 / events);
+    printf ("  incremental: %8.3f ms  %6.2f ns/event  (x%.2f)  %d flops + 1 sqrt + 1 div\n",
+            incremental_ms, incremental_ms * 1e6 / events, rebuild_ms / incremental_ms,
+            CAMERA_ROTATE_FLOPS + CAMERA_VIEW_FLOPS);
+    printf ("  max |rebuild - incremental| after %d events: %g\n", events, (double)max_err);
+    return 0;
+}
@@ -0,0 +1,38 @@
+//
+// Small timing helpers shared by the benchmark executables.
+//
+
+#ifndef FPS_STYLE_ROOM_BENCH_COMMON_H
+#define FPS_STYLE_ROOM_BENCH_COMMON_H
+
+#include <chrono>
+#include <stdio.h>
+
+static inline double bench_now_ms () {
+    using namespace std::chrono;
+    return duration<double, std::milli> (steady_clock::now ().time_since_epoch ()).count ();
+}
+
+/* runs fn() "reps" times and returns the fastest run in milliseconds. the
+fastest run is the one least disturbed by the rest of the machine */
+template <typename Fn>
+static double bench_best_ms (int reps, Fn fn) {
+    double best = 1e30;
+    for (int i = 0; i < reps; i++) {
+        double t0 = bench_now_ms ();
+        fn ();
+        double t = bench_now_ms () - t0;
+        if (t < best) {
+            best = t;
+        }
+    }
+    return best;
+}
+
+/* keeps the optimiser from throwing away a result we never look at */
+template <typename T>
+static inline void bench_keep (const T& value) {
+    asm volatile ("" : : "g" (&value) : "memory");
+}
+
+#endif //FPS_STYLE_ROOM_BENCH_COMMON_H
@@ -0,0 +1,80 @@
+//
+// CPU side of multi-draw indirect: building the command and draw data arrays
+// for 1k, 10k and 100k objects spread over 64 meshes, with everything
+// visible and with a culling mask that keeps every other object. GL then
+// takes the result in one call where it used to take one call per object.
+// Commands are checked against a plain serial loop.
+//
+// usage: bench_draw_batch
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <utils/maths_funcs.h>
+#include <jobs/job_system.h>
+#include <render/draw_batch.h>
+#include "bench_common.h"
+
+static const int REPS = 5;
+static const int MESHES = 64;
+
+int main () {
+    job_system_init (0);
+    DrawBatch batch;
+    draw_batch_init (&batch);
+    for (int k = 0; k < MESHES; k++) {
+        // boxes of assorted sizes, enough to give every mesh its own range
+        Mesh m;
+        for (int c = 0; c < 8; c++) {
+            m.positions.push_back (vec3 ((c & 1) ? 1.0f + k : -1.0f, (c & 2) ? 1.0f : -1.0f, (c & 4) ? 1.0f : -1.0f));
+        }
+        unsigned int faces[36] = {0, 1, 3, 0, 3, 2, 4, 6, 7, 4, 7, 5, 0, 4, 5, 0, 5, 1,
+                                  2, 3, 7, 2, 7, 6, 0, 2, 6, 0, 6, 4, 1, 5, 7, 1, 7, 3};
+        m.indices.assign (faces, faces + 36);
+        draw_batch_add_mesh (&batch, m);
+    }
+    printf ("%d meshes, %zu vertices, %zu indices, %d worker(s)\n", MESHES, batch.vertices.size (),
+            batch.indices.size (), job_system_worker_count ());
+    printf ("objects   visible   build(ms)   ns/object   GL calls before -> after\n");
+
+    const int sizes[3] = {1000, 10000, 100000};
+    int failures = 0;
+    for (int si = 0; si < 3; si++) {
+        int n = sizes[si];
+        std::vector<unsigned int> mesh_of (n);
+        std::vector<mat4> worlds (n);
+        std::vector<unsigned char> half (n);
+        for (int i = 0; i < n; i++) {
+            mesh_of[i] = (unsigned int)(i * 7) % MESHES;
+            worlds[i] = translate (identity_mat4 (), vec3 ((float)(i % 100), 0.0f, (float)(i / 100)));
+            half[i] = (unsigned char)(i & 1);
+        }
+        for (int pass = 0; pass < 2; pass++) {
+            const unsigned char* visible = pass ? &half[0] : NULL;
+            double ms = bench_best_ms (REPS, [&] { draw_batch_build (&batch, &mesh_of[0], &worlds[0], visible, n); });
+            // the serial answer: objects in order, skipping the culled ones
+            unsigned int out = 0;
+            for (int i = 0; i < n; i++) {
+                if (visible && !visible[i]) {
+                    continue;
+                }
+                const DrawElementsIndirectCommand& c = batch.commands[out];
+                const DrawBatchMesh& m = batch.meshes[mesh_of[i]];
+                failures += c.first_index != m.first_index || c.count != m.index_count ||
+                            c.base_vertex != (int)m.base_vertex || c.base_instance != out ||
+                            memcmp (batch.draws[out].model, worlds[i].m, sizeof (worlds[i].m)) != 0;
+                out++;
+            }
+            failures += out != batch.stats.draws;
+            printf ("%7d   %7u   %9.3f   %9.1f   %7u -> 1\n", n, batch.stats.draws, ms, ms * 1e6 / n,
+                    batch.stats.draws);
+        }
+    }
+    job_system_shutdown ();
+    if (failures) {
+        printf ("ERROR: %d commands differ from the serial build\n", failures);
+        return 1;
+    }
+    return 0;
+}
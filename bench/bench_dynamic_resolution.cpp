@@ -0,0 +1,112 @@
+//
+// Dynamic resolution controller against a simulated GPU.
+//
+// The GPU's frame time is a fixed part plus a part that grows with the
+// pixel count times the scene's load, with a few percent of noise. Timings
+// come back DYNAMIC_RESOLUTION_GL_QUERIES - 2 frames late, like the timer
+// query ring's. The load script is a light stretch, a ramp to a scene that
+// is 2.5x over budget at full size, a hold, a sudden spike and back down.
+// For each stretch it prints the frames over the refresh interval with the
+// controller and at a fixed full scale, the mean scale and how often the
+// render size changed.
+//
+// Checks: the controller keeps at least 95% of heavy frames inside the
+// interval, where min_scale can get there at all, and comes back to full
+// scale once the load drops.
+//
+// usage: bench_dynamic_resolution [refresh_hz] [seed]
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <render/dynamic_resolution.h>
+
+static unsigned int rng_state;
+
+static float frand (float lo, float hi) {
+    rng_state = rng_state * 1664525u + 1013904223u;
+    return lo + (hi - lo) * (float)(rng_state >> 8) / 16777216.0f;
+}
+
+struct Stretch {
+    const char* name;
+    int frames;
+    float load_from, load_to;    // full size GPU ms over the fixed part, as a
+                                 // fraction of the refresh interval
+};
+
+static const Stretch script[] = {
+        {"light", 300, 0.4f, 0.4f},
+        {"ramp", 300, 0.4f, 2.5f},
+        {"heavy", 600, 2.5f, 2.5f},
+        {"spike", 60, 3.5f, 3.5f},
+        {"heavy", 300, 2.5f, 2.5f},
+        {"light", 600, 0.4f, 0.4f},
+};
+
+static const int gpu_lag = 2;
+static const float fixed_ms = 1.0f;
+
+int main (int argc, char** argv) {
+    int hz = argc > 1 ? atoi (argv[1]) : 60;
+    rng_state = argc > 2 ? (unsigned int)strtoul (argv[2], NULL, 10) : 1u;
+    const int width = 1920, height = 1080;
+    DynamicResolutionParams params = dynamic_resolution_default_params (hz);
+    DynamicResolution d;
+    dynamic_resolution_init (&d, params, width, height);
+
+    float pending[gpu_lag];
+    for (int i = 0; i < gpu_lag; i++) {
+        pending[i] = -1.0f;
+    }
+    printf ("%d Hz, %.2f ms interval, %dx%d, GPU timings %d frames late\n", hz, params.target_ms, width, height,
+            gpu_lag);
+    printf ("stretch   frames   over(scaled)   over(full)   mean scale   min scale   size changes\n");
+    int failures = 0;
+    int frame = 0;
+    float last_scale = 0.0f;
+    int heavy_frames = 0, heavy_over = 0;
+    for (size_t s = 0; s < sizeof (script) / sizeof (script[0]); s++) {
+        const Stretch& st = script[s];
+        int over = 0, over_full = 0;
+        double scale_sum = 0.0;
+        float min_scale = 1.0f;
+        unsigned int changes = d.stats.changes;
+        for (int f = 0; f < st.frames; f++, frame++) {
+            dynamic_resolution_update (&d, pending[gpu_lag - 1], gpu_lag, params.target_ms * 0.3f);
+            float t = st.frames > 1 ? (float)f / (float)(st.frames - 1) : 0.0f;
+            float load = st.load_from + (st.load_to - st.load_from) * t;
+            float area = (float)d.render_width * (float)d.render_height / ((float)width * (float)height);
+            float noise = frand (0.97f, 1.03f);
+            float gpu = (fixed_ms + load * params.target_ms * area) * noise;
+            float gpu_full = (fixed_ms + load * params.target_ms) * noise;
+            for (int i = gpu_lag - 1; i > 0; i--) {
+                pending[i] = pending[i - 1];
+            }
+            pending[0] = gpu;
+
+            over += gpu > params.target_ms;
+            over_full += gpu_full > params.target_ms;
+            scale_sum += d.scale;
+            min_scale = d.scale < min_scale ? d.scale : min_scale;
+        }
+        printf ("%-7s   %6d   %12d   %10d   %10.3f   %9.3f   %12u\n", st.name, st.frames, over, over_full,
+                scale_sum / st.frames, min_scale, d.stats.changes - changes);
+        // only stretches the minimum scale can bring inside the goal count
+        float floor_ms = fixed_ms + st.load_from * params.target_ms * params.min_scale * params.min_scale;
+        if (st.load_from == st.load_to && st.load_from > 1.0f && floor_ms < params.target_ms * params.headroom) {
+            heavy_frames += st.frames;
+            heavy_over += over;
+        }
+        last_scale = d.scale;
+    }
+    if (heavy_over * 20 > heavy_frames) {
+        printf ("ERROR: %d of %d heavy frames went over the interval\n", heavy_over, heavy_frames);
+        failures++;
+    }
+    if (last_scale < params.max_scale) {
+        printf ("ERROR: the scale didn't come back up, ended at %.3f\n", last_scale);
+        failures++;
+    }
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,365 @@
+//
+// Regression benchmark for CI: a scripted fly-through of a synthetic room
+// with a frame time budget.
+//
+// The room is generated from a seed, so every run sees the same scene:
+// `props` boxes on the floor of a square hall, one in 16 spinning, `lights`
+// point lights (the first 16 with cube shadows), and a grid of partition
+// walls with doorways that act as occluders. The camera follows a closed
+// Catmull-Rom spline through eight points in the hall. Its orientation at
+// each point looks towards the next one, and it is slerped between them.
+// That is the CameraOrientation main.cpp's Camera uses, set directly.
+//
+// There is no GL context. A frame is the CPU side of main.cpp's loop plus
+// what the engine modules add, each timed as a stage:
+//  camera   spline position, slerped orientation, view matrix
+//  scene    spin the dynamic props, scene_update
+//  cull     frustum test, then the software occlusion buffer
+//  batch    multi-draw command build for the visible props
+//  lights   clustered light binning
+//  shadows  shadow cache planning, spinning props as dynamic casters
+//
+// The report is JSON on stdout (or in json_path): the configuration, frame
+// time mean and percentiles, and mean / p99 / max for every stage. The exit
+// code is 1 if the frame time p99 is over budget_ms (0 turns the check off),
+// so a CI job only has to run it.
+//
+// usage: bench_flythrough [props] [lights] [frames] [budget_ms] [json_path] [seed]
+//
+
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <utils/maths_funcs.h>
+#include <camera/camera_orientation.h>
+#include <culling/frustum.h>
+#include <culling/occlusion.h>
+#include <jobs/job_system.h>
+#include <scene/scene_store.h>
+#include <render/draw_batch.h>
+#include <render/light_clusters.h>
+#include <render/shadow_cache.h>
+#include "bench_common.h"
+
+static const int WARMUP_FRAMES = 10;
+static const int PATH_POINTS = 8;
+static const int SHADOWED_LIGHTS = 16;
+
+enum {
+    STAGE_CAMERA,
+    STAGE_SCENE,
+    STAGE_CULL,
+    STAGE_BATCH,
+    STAGE_LIGHTS,
+    STAGE_SHADOWS,
+    STAGE_COUNT
+};
+
+static const char* stage_names[STAGE_COUNT] = {"camera", "scene", "cull", "batch", "lights", "shadows"};
+
+static unsigned int rng_state;
+
+static float frand (float lo, float hi) {
+    rng_state = rng_state * 1664525u + 1013904223u;
+    return lo + (hi - lo) * (float)(rng_state >> 8) / 16777216.0f;
+}
+
+/* axis aligned box from -half to +half */
+static void box_mesh (const vec3& half, Mesh* out) {
+    out->positions.clear ();
+    out->indices.clear ();
+    for (int i = 0; i < 8; i++) {
+        out->positions.push_back (vec3 (i & 1 ? half.v[0] : -half.v[0], i & 2 ? half.v[1] : -half.v[1],
+                                        i & 4 ? half.v[2] : -half.v[2]));
+    }
+    static const unsigned int faces[36] = {0, 2, 1, 1, 2, 3, 4, 5, 6, 5, 7, 6, 0, 1, 4, 1, 5, 4,
+                                           2, 6, 3, 3, 6, 7, 0, 4, 2, 2, 4, 6, 1, 3, 5, 3, 7, 5};
+    out->indices.assign (faces, faces + 36);
+}
+
+struct Room {
+    float half_size;
+    SceneStore scene;
+    std::vector<Entity> props;
+    std::vector<unsigned int> mesh_of;
+    std::vector<unsigned char> spinning;
+    Mesh prop_meshes[4];
+    Mesh wall_mesh;                  // unit cube, scaled per wall
+    std::vector<Occluder> walls;
+    std::vector<PointLight> lights;
+    std::vector<ShadowLight> shadow_lights;
+    vec3 path[PATH_POINTS];
+    versor path_rotation[PATH_POINTS];
+};
+
+static void build_room (Room* room, int props, int lights) {
+    // about 4 square units of floor per prop
+    float half = fmaxf (10.0f, sqrtf ((float)props * 4.0f) * 0.5f);
+    room->half_size = half;
+    for (int m = 0; m < 4; m++) {
+        box_mesh (vec3 (0.2f + 0.15f * m, 0.3f + 0.2f * m, 0.2f + 0.1f * m), &room->prop_meshes[m]);
+    }
+    box_mesh (vec3 (0.5f, 0.5f, 0.5f), &room->wall_mesh);
+
+    scene_init (&room->scene);
+    for (int i = 0; i < props; i++) {
+        unsigned int m = (unsigned int)(frand (0.0f, 4.0f)) & 3u;
+        vec3 p (frand (-half, half), 0.5f, frand (-half, half));
+        versor q = quat_from_axis_deg (frand (0.0f, 360.0f), 0.0f, 1.0f, 0.0f);
+        room->props.push_back (scene_create (&room->scene, ENTITY_NONE, p, q, vec3 (1.0f, 1.0f, 1.0f),
+                                             mesh_bounds (room->prop_meshes[m])));
+        room->mesh_of.push_back (m);
+        room->spinning.push_back (i % 16 == 0);
+    }
+
+    // partition walls every 20 units in both directions, with a doorway in
+    // the middle of each span
+    for (float c = -half + 20.0f; c < half; c += 20.0f) {
+        for (float s = -half; s < half; s += 20.0f) {
+            float span = fminf (20.0f, half - s);
+            for (int piece = 0; piece < 2; piece++) {
+                float len = span * 0.5f - 1.0f;
+                if (len <= 0.0f) {
+                    continue;
+                }
+                float centre = s + (piece ? span - len * 0.5f : len * 0.5f);
+                for (int axis = 0; axis < 2; axis++) {
+                    vec3 size = axis ? vec3 (0.2f, 3.0f, len) : vec3 (len, 3.0f, 0.2f);
+                    vec3 at = axis ? vec3 (c, 1.5f, centre) : vec3 (centre, 1.5f, c);
+                    Occluder o;
+                    o.positions = &room->wall_mesh.positions[0];
+                    o.indices = &room->wall_mesh.indices[0];
+                    o.index_count = (unsigned int)room->wall_mesh.indices.size ();
+                    o.model = translate (scale (identity_mat4 (), size), at);
+                    o.world_bounds = aabb_transform (mesh_bounds (room->wall_mesh), o.model);
+                    room->walls.push_back (o);
+                }
+            }
+        }
+    }
+
+    for (int i = 0; i < lights; i++) {
+        PointLight l = {};
+        l.position = vec3 (frand (-half, half), frand (2.0f, 2.8f), frand (-half, half));
+        l.radius = frand (4.0f, 8.0f);
+        l.colour = vec3 (frand (0.5f, 1.0f), frand (0.5f, 1.0f), frand (0.5f, 1.0f));
+        l.intensity = 1.0f;
+        if (i < SHADOWED_LIGHTS) {
+            ShadowLight s = {};
+            s.type = SHADOW_POINT;
+            s.position = l.position;
+            s.radius = l.radius;
+            s.resolution = 256;
+            l.shadow_first = i * SHADOW_FACES;
+            l.shadow_count = SHADOW_FACES;
+            room->shadow_lights.push_back (s);
+        }
+        room->lights.push_back (l);
+    }
+
+    // a loop around the hall at eye height, each point looking at the next
+    for (int i = 0; i < PATH_POINTS; i++) {
+        float a = 6.2831853f * (float)i / PATH_POINTS;
+        float r = half * frand (0.4f, 0.8f);
+        room->path[i] = vec3 (r * cosf (a), 1.7f, r * sinf (a));
+    }
+    for (int i = 0; i < PATH_POINTS; i++) {
+        vec3 d = normalise (room->path[(i + 1) % PATH_POINTS] - room->path[i]);
+        CameraOrientation o;
+        // forward is (sin yaw cos pitch, -sin pitch, -cos yaw cos pitch)
+        camera_orientation_init (&o, atan2f (d.v[0], -d.v[2]) / MATHS_DEG_TO_RAD, -asinf (d.v[1]) / MATHS_DEG_TO_RAD);
+        room->path_rotation[i] = o.rotation;
+    }
+}
+
+/* closed Catmull-Rom spline through room->path, t in [0, 1) */
+static vec3 path_position (const Room& room, float t) {
+    float f = t * PATH_POINTS;
+    int i = (int)f;
+    float u = f - (float)i;
+    const vec3& p0 = room.path[(i + PATH_POINTS - 1) % PATH_POINTS];
+    const vec3& p1 = room.path[i % PATH_POINTS];
+    const vec3& p2 = room.path[(i + 1) % PATH_POINTS];
+    const vec3& p3 = room.path[(i + 2) % PATH_POINTS];
+    float u2 = u * u, u3 = u2 * u;
+    return (p1 * 2.0f + (p2 - p0) * u + (p0 * 2.0f - p1 * 5.0f + p2 * 4.0f - p3) * u2 +
+            (p1 * 3.0f - p0 - p2 * 3.0f + p3) * u3) * 0.5f;
+}
+
+static versor path_rotation (const Room& room, float t) {
+    float f = t * PATH_POINTS;
+    int i = (int)f;
+    return slerp (room.path_rotation[i % PATH_POINTS], room.path_rotation[(i + 1) % PATH_POINTS], f - (float)i);
+}
+
+static double percentile (std::vector<double> v, double p) {
+    if (v.empty ()) {
+        return 0.0;
+    }
+    std::sort (v.begin (), v.end ());
+    size_t rank = (size_t)ceil (p * (double)v.size ());
+    return v[rank > 0 ? rank - 1 : 0];
+}
+
+static double mean (const std::vector<double>& v) {
+    double sum = 0.0;
+    for (size_t i = 0; i < v.size (); i++) {
+        sum += v[i];
+    }
+    return v.empty () ? 0.0 : sum / (double)v.size ();
+}
+
+int main (int argc, char** argv) {
+    int props = argc > 1 ? atoi (argv[1]) : 5000;
+    int lights = argc > 2 ? atoi (argv[2]) : 256;
+    int frames = argc > 3 ? atoi (argv[3]) : 600;
+    double budget_ms = argc > 4 ? atof (argv[4]) : 0.0;
+    const char* json_path = argc > 5 ? argv[5] : NULL;
+    rng_state = argc > 6 ? (unsigned int)strtoul (argv[6], NULL, 10) : 12345u;
+    if (props < 1 || lights < 0 || frames < 1) {
+        fprintf (stderr, "usage: %s [props] [lights] [frames] [budget_ms] [json_path] [seed]\n", argv[0]);
+        return 2;
+    }
+    unsigned int seed = rng_state;
+
+    job_system_init (0);
+    Room room;
+    build_room (&room, props, lights);
+    scene_update (&room.scene);
+
+    // main ()'s projection, with the far plane pushed out to the hall
+    float far_plane = room.half_size * 3.0f;
+    mat4 proj = perspective (67.0f, 16.0f / 9.0f, 0.1f, far_plane);
+    DrawBatch batch;
+    draw_batch_init (&batch);
+    for (int m = 0; m < 4; m++) {
+        draw_batch_add_mesh (&batch, room.prop_meshes[m]);
+    }
+    LightClusters clusters;
+    light_clusters_init (&clusters, 16, 9, 24, proj, 0.1f, far_plane);
+    ShadowCache shadows;
+    shadow_cache_init (&shadows, 4096);
+    OcclusionBuffer occlusion;
+    occlusion_init (&occlusion, 256, 128, 0);
+
+    int count = (int)room.props.size ();
+    std::vector<unsigned char> visible (count);
+    std::vector<int> in_frustum;
+    std::vector<Aabb> test_boxes;
+    std::vector<unsigned char> test_visible;
+    std::vector<mat4> worlds (count);
+    std::vector<Aabb> dynamic_bounds;
+    std::vector<double> frame_ms, stage_ms[STAGE_COUNT];
+    double visible_sum = 0.0;
+    CameraOrientation orientation;
+    camera_orientation_init (&orientation, 0.0f, 0.0f);
+    mat4 view;
+
+    for (int frame = 0; frame < WARMUP_FRAMES + frames; frame++) {
+        float t = (float)(frame % frames) / (float)frames;
+        double stage_start[STAGE_COUNT + 1];
+        double t0 = bench_now_ms ();
+
+        stage_start[STAGE_CAMERA] = t0;
+        vec3 eye = path_position (room, t);
+        orientation.rotation = path_rotation (room, t);
+        camera_orientation_view (&orientation, eye.v, &view);
+        mat4 view_proj = proj * view;
+
+        stage_start[STAGE_SCENE] = bench_now_ms ();
+        versor spin = quat_from_axis_deg (2.0f * (float)frame, 0.0f, 1.0f, 0.0f);
+        for (int i = 0; i < count; i += 16) {
+            scene_set_orientation (&room.scene, room.props[i], spin);
+        }
+        scene_update (&room.scene);
+
+        stage_start[STAGE_CULL] = bench_now_ms ();
+        Frustum frustum = frustum_from_matrix (view_proj);
+        in_frustum.clear ();
+        test_boxes.clear ();
+        for (int i = 0; i < count; i++) {
+            const Aabb& b = scene_world_bounds (room.scene, room.props[i]);
+            visible[i] = 0;
+            if (frustum_test_aabb (frustum, b)) {
+                in_frustum.push_back (i);
+                test_boxes.push_back (b);
+            }
+        }
+        occlusion_begin_frame (&occlusion, view_proj, eye, 1.0);
+        occlusion_rasterize (&occlusion, room.walls.empty () ? NULL : &room.walls[0], (int)room.walls.size ());
+        test_visible.resize (test_boxes.size ());
+        int seen = test_boxes.empty () ? 0 : occlusion_cull (&occlusion, &test_boxes[0], (int)test_boxes.size (),
+                                                             &test_visible[0]);
+        for (size_t k = 0; k < in_frustum.size (); k++) {
+            visible[in_frustum[k]] = test_visible[k];
+        }
+
+        stage_start[STAGE_BATCH] = bench_now_ms ();
+        for (int i = 0; i < count; i++) {
+            worlds[i] = scene_world (room.scene, room.props[i]);
+        }
+        draw_batch_build (&batch, &room.mesh_of[0], &worlds[0], &visible[0], count);
+
+        stage_start[STAGE_LIGHTS] = bench_now_ms ();
+        light_clusters_build (&clusters, room.lights.empty () ? NULL : &room.lights[0], (int)room.lights.size (),
+                              view);
+
+        stage_start[STAGE_SHADOWS] = bench_now_ms ();
+        dynamic_bounds.clear ();
+        for (int i = 0; i < count; i += 16) {
+            dynamic_bounds.push_back (scene_world_bounds (room.scene, room.props[i]));
+        }
+        shadow_cache_update (&shadows, room.shadow_lights.empty () ? NULL : &room.shadow_lights[0],
+                             (int)room.shadow_lights.size (), &dynamic_bounds[0], (int)dynamic_bounds.size ());
+
+        stage_start[STAGE_COUNT] = bench_now_ms ();
+        if (frame < WARMUP_FRAMES) {
+            continue;
+        }
+        frame_ms.push_back (stage_start[STAGE_COUNT] - t0);
+        for (int s = 0; s < STAGE_COUNT; s++) {
+            stage_ms[s].push_back (stage_start[s + 1] - stage_start[s]);
+        }
+        visible_sum += seen;
+    }
+    job_system_shutdown ();
+
+    double p99 = percentile (frame_ms, 0.99);
+    bool pass = budget_ms <= 0.0 || p99 <= budget_ms;
+    FILE* out = stdout;
+    if (json_path) {
+        out = fopen (json_path, "w");
+        if (!out) {
+            fprintf (stderr, "ERROR: could not open %s\n", json_path);
+            return 2;
+        }
+    }
+    fprintf (out, "{\n");
+    fprintf (out, "  \"config\": {\"props\": %d, \"lights\": %d, \"frames\": %d, \"warmup\": %d, \"seed\": %u, "
+                  "\"workers\": %d, \"budget_ms\": %.3f},\n",
+             props, lights, frames, WARMUP_FRAMES, seed, job_system_worker_count (), budget_ms);
+    fprintf (out, "  \"frame_ms\": {\"mean\": %.4f, \"p50\": %.4f, \"p90\": %.4f, \"p95\": %.4f, \"p99\": %.4f, "
+                  "\"max\": %.4f},\n",
+             mean (frame_ms), percentile (frame_ms, 0.5), percentile (frame_ms, 0.9), percentile (frame_ms, 0.95), p99,
+             percentile (frame_ms, 1.0));
+    fprintf (out, "  \"stages_ms\": {\n");
+    for (int s = 0; s < STAGE_COUNT; s++) {
+        fprintf (out, "    \"%s\": {\"mean\": %.4f, \"p99\": %.4f, \"max\": %.4f}%s\n", stage_names[s], mean (stage_ms[s]),
+                 percentile (stage_ms[s], 0.99), percentile (stage_ms[s], 1.0), s + 1 < STAGE_COUNT ? "," : "");
+    }
+    fprintf (out, "  },\n");
+    fprintf (out, "  \"visible_props_mean\": %.1f,\n", visible_sum / frames);
+    fprintf (out, "  \"walls\": %d,\n", (int)room.walls.size ());
+    fprintf (out, "  \"pass\": %s\n", pass ? "true" : "false");
+    fprintf (out, "}\n");
+    if (json_path) {
+        fclose (out);
+    }
+    if (!pass) {
+        fprintf (stderr, "ERROR: frame time p99 %.3f ms is over the %.3f ms budget\n", p99, budget_ms);
+        return 1;
+    }
+    return 0;
+}
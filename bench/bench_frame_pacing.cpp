@@ -0,0 +1,151 @@
+//
+// Input to display latency under vsync, on a simulated clock.
+//
+// A 60 Hz display, a 1 kHz mouse and a frame loop whose CPU work is split
+// into a part that doesn't depend on the camera and a part that does (the
+// cluster build, the UBO write and the draws), then the GPU's share. Three
+// loops are compared:
+//
+//   classic      events are polled at the end of the frame, so they reach
+//                the next frame, which starts right after the swap
+//   late latch   events are polled and the view rebuilt just before the
+//                camera dependent work
+//   late + wait  late latch, and FramePacer starts the frame as late before
+//                the vblank as its measured work allows
+//
+// The simulation drives the real FramePacer and InputLatency, with the
+// simulated times passed in. Event to display is the time from the mouse
+// moving to the vblank that shows the frame using it, event to submit is
+// what InputLatency reports (the part the frame loop controls).
+//
+// One frame in fifty has a hitch the pacer can't see coming. Started late,
+// that frame misses its vblank, which is the price of the wait: its mean
+// drops but its p99 and missed count show the hitches.
+//
+// usage: bench_frame_pacing [frames] [margin_ms] [seed]
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <algorithm>
+#include <vector>
+#include <render/frame_pacing.h>
+
+static unsigned int rng_state;
+
+static double frand (double lo, double hi) {
+    rng_state = rng_state * 1664525u + 1013904223u;
+    return lo + (hi - lo) * (double)(rng_state >> 8) / 16777216.0;
+}
+
+enum LoopMode { LOOP_CLASSIC, LOOP_LATE_LATCH, LOOP_LATE_WAIT, LOOP_MODES };
+static const char* mode_names[LOOP_MODES] = {"classic", "late latch", "late + wait"};
+
+struct LoopResult {
+    double display_mean, display_p99;
+    InputLatencyStats submit;
+    unsigned int missed;
+    double fps;
+};
+
+static const double refresh_ms = 1000.0 / 60.0;
+
+/* the first vblank at or after t */
+static double next_vblank (double t) {
+    return ceil (t / refresh_ms - 1e-9) * refresh_ms;
+}
+
+static LoopResult run (LoopMode mode, int frames, double margin_ms, unsigned int seed) {
+    rng_state = seed;
+    FramePacer pacer;
+    frame_pacer_init (&pacer, 60, margin_ms);
+    InputLatency latency;
+    input_latency_init (&latency);
+
+    double next_event = frand (0.0, 1.0);
+    std::vector<double> events;
+    std::vector<float> display;
+    double start = 0.0, shown = 0.0, previous_submit = 0.0;
+    unsigned int missed = 0;
+    for (int f = 0; f < frames; f++) {
+        if (mode == LOOP_LATE_WAIT) {
+            start = frame_pacer_wake_ms (pacer, start);
+        }
+        frame_pacer_begin (&pacer, start);
+
+        // a hitch in the camera independent part now and then
+        double independent = frand (2.0, 5.0) + (frand (0.0, 1.0) < 0.02 ? 6.0 : 0.0);
+        double dependent = frand (0.5, 1.0);
+        double gpu = frand (1.0, 2.0);
+        double submit = start + independent + dependent;
+        // classic polls after the previous frame's draws, so that is what
+        // this frame's camera has seen. late latch polls just before its own
+        double latch = mode == LOOP_CLASSIC ? previous_submit : start + independent;
+
+        // the mouse reports every millisecond, give or take
+        while (next_event <= latch) {
+            events.push_back (next_event);
+            input_latency_event (&latency, next_event);
+            next_event += frand (0.8, 1.2);
+        }
+        input_latency_submit (&latency, submit);
+
+        double vblank = next_vblank (submit + gpu);
+        if (f > 0 && vblank - shown > 1.5 * refresh_ms) {
+            missed++;
+        }
+        shown = vblank;
+        for (size_t i = 0; i < events.size (); i++) {
+            display.push_back ((float)(shown - events[i]));
+        }
+        events.clear ();
+        // the swap blocks until the frame is on screen
+        frame_pacer_swapped (&pacer, submit, shown);
+        previous_submit = submit;
+        start = shown;
+    }
+
+    LoopResult r;
+    std::sort (display.begin (), display.end ());
+    double sum = 0.0;
+    for (size_t i = 0; i < display.size (); i++) {
+        sum += display[i];
+    }
+    r.display_mean = display.empty () ? 0.0 : sum / display.size ();
+    r.display_p99 = display.empty () ? 0.0 : display[std::min (display.size () - 1, display.size () * 99 / 100)];
+    input_latency_stats (latency, &r.submit);
+    r.missed = missed;
+    r.fps = frames * 1000.0 / shown;
+    return r;
+}
+
+int main (int argc, char** argv) {
+    int frames = argc > 1 ? atoi (argv[1]) : 3600;
+    double margin_ms = argc > 2 ? atof (argv[2]) : 3.0;
+    unsigned int seed = argc > 3 ? (unsigned int)strtoul (argv[3], NULL, 10) : 1u;
+
+    printf ("%d frames at 60 Hz, 1 kHz mouse, pacer margin %.1f ms\n", frames, margin_ms);
+    printf ("mode          display mean(ms)   display p99(ms)   submit mean(ms)   submit p99(ms)   missed    fps\n");
+    LoopResult r[LOOP_MODES];
+    for (int m = 0; m < LOOP_MODES; m++) {
+        r[m] = run ((LoopMode)m, frames, margin_ms, seed);
+        printf ("%-11s   %16.2f   %15.2f   %15.2f   %14.2f   %6u   %4.1f\n", mode_names[m], r[m].display_mean,
+                r[m].display_p99, r[m].submit.mean_ms, r[m].submit.p99_ms, r[m].missed, r[m].fps);
+    }
+
+    int failures = 0;
+    if (!(r[LOOP_LATE_LATCH].display_mean < r[LOOP_CLASSIC].display_mean)) {
+        printf ("ERROR: late latch didn't cut latency\n");
+        failures++;
+    }
+    if (!(r[LOOP_LATE_WAIT].display_mean < r[LOOP_LATE_LATCH].display_mean)) {
+        printf ("ERROR: the pre-vsync wait didn't cut latency\n");
+        failures++;
+    }
+    if (r[LOOP_LATE_WAIT].fps < r[LOOP_CLASSIC].fps * 0.95) {
+        printf ("ERROR: the pre-vsync wait drops frames, raise the margin\n");
+        failures++;
+    }
+    return failures ? 1 : 0;
+}
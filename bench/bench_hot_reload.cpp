@@ -0,0 +1,318 @@
+//
+// Scene hot reload: what one edit to a big scene file costs the frame.
+//
+// A generated scene, meshes of random triangles in a few materials and many
+// objects instancing them, is written as a scene file and loaded. Then one
+// edit at a time is saved, re-read and applied with live_scene_apply:
+// moving an object, recolouring a material, reshaping a mesh, growing one,
+// adding and removing an object, and saving without changes. Each is
+// compared with the baseline, a full reload: a new scene store and draw
+// batch built from the description and every vertex and index uploaded
+// again. Upload bytes are what draw_batch_gl_sync would send.
+//
+// Checks: each edit changes exactly what it should and no more; small edits
+// upload under 1% of the full arrays; after undoing every edit the live
+// scene draws the same as a fresh build; the file watch reports a save.
+//
+// usage: bench_hot_reload [objects] [meshes] [dir]
+//
+
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+#include <jobs/job_system.h>
+#include <scene/file_watch.h>
+#include <scene/live_scene.h>
+#include "bench_common.h"
+
+static const int REPS = 5;
+static const int MATERIALS = 8;
+
+static unsigned int rng_state = 1;
+
+static float frand () {
+    rng_state = rng_state * 1664525u + 1013904223u;
+    return (float)(rng_state >> 8) / 16777216.0f;
+}
+
+struct GenMesh {
+    int material;
+    std::vector<float> tris;     // nine floats a triangle
+};
+
+struct GenObject {
+    int mesh;
+    float position[3];
+    float yaw;
+};
+
+struct GenScene {
+    float colours[MATERIALS][3];
+    std::vector<GenMesh> meshes;
+    std::vector<GenObject> objects;
+};
+
+static void random_triangles (std::vector<float>* tris, int count) {
+    for (int t = 0; t < count; t++) {
+        float c[3] = {frand () * 2.0f - 1.0f, frand () * 2.0f - 1.0f, frand () * 2.0f - 1.0f};
+        for (int k = 0; k < 9; k++) {
+            tris->push_back (c[k % 3] + (frand () - 0.5f) * 0.2f);
+        }
+    }
+}
+
+static bool write_scene (const char* path, const GenScene& g) {
+    FILE* f = fopen (path, "w");
+    if (!f) {
+        printf ("ERROR: could not write %s\n", path);
+        return false;
+    }
+    for (int m = 0; m < MATERIALS; m++) {
+        fprintf (f, "material m%d %g %g %g\n", m, g.colours[m][0], g.colours[m][1], g.colours[m][2]);
+    }
+    for (size_t m = 0; m < g.meshes.size (); m++) {
+        fprintf (f, "mesh mesh%zu m%d\n", m, g.meshes[m].material);
+        const std::vector<float>& t = g.meshes[m].tris;
+        for (size_t i = 0; i < t.size (); i += 9) {
+            fprintf (f, "tri %g %g %g %g %g %g %g %g %g\n", t[i], t[i + 1], t[i + 2], t[i + 3], t[i + 4], t[i + 5],
+                     t[i + 6], t[i + 7], t[i + 8]);
+        }
+    }
+    for (size_t o = 0; o < g.objects.size (); o++) {
+        const GenObject& ob = g.objects[o];
+        fprintf (f, "object obj%zu mesh%d %g %g %g %g 0 0\n", o, ob.mesh, ob.position[0], ob.position[1],
+                 ob.position[2], ob.yaw);
+    }
+    fclose (f);
+    return true;
+}
+
+struct Live {
+    SceneStore scene;
+    DrawBatch batch;
+    LiveScene level;
+    size_t synced_vertices, synced_indices;
+};
+
+static void live_init (Live* l) {
+    scene_init (&l->scene);
+    draw_batch_init (&l->batch);
+    live_scene_init (&l->level);
+    l->synced_vertices = l->synced_indices = 0;
+}
+
+/* what draw_batch_gl_sync would send, then marks it sent */
+static size_t live_sync (Live* l) {
+    size_t bytes = draw_batch_pending_bytes (l->batch, l->synced_vertices, l->synced_indices);
+    l->batch.rewritten.clear ();
+    l->synced_vertices = l->batch.vertices.size ();
+    l->synced_indices = l->batch.indices.size ();
+    return bytes;
+}
+
+/* objects that draw differently in a and b */
+static int count_differences (Live* a, Live* b) {
+    scene_update (&a->scene);
+    scene_update (&b->scene);
+    const LiveScene& la = a->level;
+    const LiveScene& lb = b->level;
+    if (la.entity.size () != lb.entity.size () || a->scene.entity.size () != b->scene.entity.size ()) {
+        return -1;
+    }
+    int differ = 0;
+    for (size_t i = 0; i < la.entity.size (); i++) {
+        const DrawBatchMesh& ma = a->batch.meshes[la.mesh_of[i]];
+        const DrawBatchMesh& mb = b->batch.meshes[lb.mesh_of[i]];
+        bool same = ma.vertex_count == mb.vertex_count && ma.index_count == mb.index_count &&
+                    memcmp (ma.albedo, mb.albedo, 3 * sizeof (float)) == 0 &&
+                    memcmp (&a->batch.vertices[ma.base_vertex], &b->batch.vertices[mb.base_vertex],
+                            ma.vertex_count * sizeof (PackedVertex)) == 0 &&
+                    memcmp (&a->batch.indices[ma.first_index], &b->batch.indices[mb.first_index],
+                            ma.index_count * sizeof (unsigned int)) == 0 &&
+                    memcmp (scene_world (a->scene, la.entity[i]).m, scene_world (b->scene, lb.entity[i]).m,
+                            sizeof (mat4)) == 0;
+        differ += !same;
+    }
+    return differ;
+}
+
+enum Edit { EDIT_NONE, EDIT_MOVE, EDIT_RECOLOUR, EDIT_RESHAPE, EDIT_GROW, EDIT_ADD, EDIT_REMOVE, EDITS };
+
+static const char* edit_names[EDITS] = {"save unchanged", "move an object", "recolour a material",
+                                        "reshape a mesh", "grow a mesh", "add an object", "remove an object"};
+
+int main (int argc, char** argv) {
+    int object_count = argc > 1 ? atoi (argv[1]) : 5000;
+    int mesh_count = argc > 2 ? atoi (argv[2]) : 200;
+    const char* dir = argc > 3 ? argv[3] : "/tmp";
+    if (object_count < 2 || mesh_count < 8) {
+        printf ("ERROR: need at least 2 objects and 8 meshes\n");
+        return 1;
+    }
+    char path[SCENE_PATH_MAX];
+    snprintf (path, sizeof (path), "%s/bench_hot_reload.scene", dir);
+    job_system_init (0);
+
+    GenScene base;
+    for (int m = 0; m < MATERIALS; m++) {
+        for (int c = 0; c < 3; c++) {
+            base.colours[m][c] = frand ();
+        }
+    }
+    base.meshes.resize (mesh_count);
+    for (int m = 0; m < mesh_count; m++) {
+        base.meshes[m].material = m % MATERIALS;
+        random_triangles (&base.meshes[m].tris, 100 + (int)(frand () * 300.0f));
+    }
+    base.objects.resize (object_count);
+    for (int o = 0; o < object_count; o++) {
+        GenObject& ob = base.objects[o];
+        ob.mesh = (int)(frand () * mesh_count) % mesh_count;
+        for (int c = 0; c < 3; c++) {
+            ob.position[c] = frand () * 200.0f - 100.0f;
+        }
+        ob.yaw = frand () * 360.0f;
+    }
+    if (!write_scene (path, base)) {
+        return 1;
+    }
+
+    SceneDesc base_desc;
+    double parse_ms = bench_best_ms (REPS, [&] () { scene_file_load (path, &base_desc); });
+    if (!scene_file_load (path, &base_desc)) {
+        return 1;
+    }
+    size_t triangles = 0;
+    for (size_t m = 0; m < base_desc.meshes.size (); m++) {
+        triangles += base_desc.meshes[m].mesh.indices.size () / 3;
+    }
+
+    // baseline: everything rebuilt and uploaded
+    double full_ms = 1e30;
+    size_t full_bytes = 0;
+    for (int r = 0; r < REPS; r++) {
+        Live fresh;
+        live_init (&fresh);
+        SceneDesc copy = base_desc;
+        double t0 = bench_now_ms ();
+        live_scene_apply (&fresh.level, &copy, &fresh.scene, &fresh.batch);
+        scene_update (&fresh.scene);
+        full_ms = std::min (full_ms, bench_now_ms () - t0);
+        full_bytes = live_sync (&fresh);
+    }
+
+    Live live;
+    live_init (&live);
+    SceneDesc desc = base_desc;
+    live_scene_apply (&live.level, &desc, &live.scene, &live.batch);
+    scene_update (&live.scene);
+    live_sync (&live);
+
+    printf ("%d objects, %d meshes, %zu triangles, %d worker(s)\n", object_count, mesh_count, triangles,
+            job_system_worker_count ());
+    printf ("parse %.2f ms; full reload %.3f ms and %zu bytes uploaded\n\n", parse_ms, full_ms, full_bytes);
+    printf ("edit                 apply(ms)   bytes    of full   stats\n");
+
+    int failures = 0;
+    for (int e = 0; e < EDITS; e++) {
+        GenScene g = base;
+        int target_mesh = 5, users = 0, recoloured = 0;
+        for (int o = 0; o < object_count; o++) {
+            users += base.objects[o].mesh == target_mesh;
+        }
+        for (int m = 0; m < mesh_count; m++) {
+            recoloured += base.meshes[m].material == 3;
+        }
+        switch (e) {
+            case EDIT_MOVE: g.objects[17].position[0] += 1.0f; break;
+            case EDIT_RECOLOUR: g.colours[3][0] = 1.0f - g.colours[3][0]; break;
+            case EDIT_RESHAPE:
+                for (size_t i = 0; i < g.meshes[target_mesh].tris.size (); i++) {
+                    g.meshes[target_mesh].tris[i] += 0.01f;
+                }
+                break;
+            case EDIT_GROW: random_triangles (&g.meshes[target_mesh].tris, 50); break;
+            case EDIT_ADD: g.objects.push_back (g.objects[3]); break;
+            case EDIT_REMOVE: g.objects.pop_back (); break;
+            default: break;
+        }
+        SceneDesc edited;
+        if (!write_scene (path, g) || !scene_file_load (path, &edited)) {
+            return 1;
+        }
+        live_scene_apply (&live.level, &edited, &live.scene, &live.batch);
+        LiveSceneStats st = live.level.stats;
+        size_t bytes = live_sync (&live);
+        // edited now holds the base, so each apply flips between the two
+        double ms = bench_best_ms (REPS, [&] () {
+            live_scene_apply (&live.level, &edited, &live.scene, &live.batch);
+            live_scene_apply (&live.level, &edited, &live.scene, &live.batch);
+        }) * 0.5;
+        live_scene_apply (&live.level, &edited, &live.scene, &live.batch);
+        live_sync (&live);
+
+        printf ("%-20s %9.3f  %7zu  %7.3f%%   meshes +%u ~%u -%u colour %u, objects +%u ~%u -%u\n", edit_names[e], ms,
+                bytes, 100.0 * bytes / full_bytes, st.meshes_added, st.meshes_changed, st.meshes_removed,
+                st.meshes_recoloured, st.objects_added, st.objects_moved, st.objects_removed);
+        unsigned int expected[7] = {0, 0, 0, 0, 0, 0, 0};
+        switch (e) {
+            case EDIT_MOVE: expected[5] = 1; break;
+            case EDIT_RECOLOUR: expected[3] = (unsigned int)recoloured; break;
+            case EDIT_RESHAPE:
+            case EDIT_GROW: expected[1] = 1; expected[5] = (unsigned int)users; break;
+            case EDIT_ADD: expected[4] = 1; break;
+            case EDIT_REMOVE: expected[6] = 1; break;
+            default: break;
+        }
+        unsigned int got[7] = {st.meshes_added, st.meshes_changed, st.meshes_removed, st.meshes_recoloured,
+                               st.objects_added, st.objects_moved, st.objects_removed};
+        if (memcmp (expected, got, sizeof (got)) != 0) {
+            printf ("ERROR: %s changed more or less than it should\n", edit_names[e]);
+            failures++;
+        }
+        if (bytes * 100 > full_bytes) {
+            printf ("ERROR: %s uploaded %zu bytes of %zu\n", edit_names[e], bytes, full_bytes);
+            failures++;
+        }
+    }
+
+    // undone every edit: the same as a fresh build of the base
+    Live fresh;
+    live_init (&fresh);
+    SceneDesc copy = base_desc;
+    live_scene_apply (&fresh.level, &copy, &fresh.scene, &fresh.batch);
+    int differ = count_differences (&live, &fresh);
+    printf ("\nafter undoing the edits: %d of %d objects draw differently from a fresh build, %u unused vertices\n",
+            differ, object_count, live.batch.stats.unused_vertices);
+    if (differ != 0) {
+        printf ("ERROR: the live scene drifted from the file\n");
+        failures++;
+    }
+
+    // the watch sees a save, after it settles
+    FileWatch watch;
+    bool inotify = file_watch_init (&watch);
+    file_watch_set (&watch, base_desc.files.data (), (int)base_desc.files.size (), bench_now_ms ());
+    bool early = file_watch_poll (&watch, bench_now_ms ());
+    write_scene (path, base);
+    double saved = bench_now_ms ();
+    double seen = -1.0;
+    while (bench_now_ms () - saved < 2000.0 && seen < 0.0) {
+        std::this_thread::sleep_for (std::chrono::milliseconds (2));
+        if (file_watch_poll (&watch, bench_now_ms ())) {
+            seen = bench_now_ms () - saved;
+        }
+    }
+    file_watch_destroy (&watch);
+    printf ("file watch (%s): save reported %.1f ms after it closed\n", inotify ? "inotify" : "polling", seen);
+    if (early || seen < 0.0) {
+        printf ("ERROR: the watch %s\n", early ? "reported a change before the save" : "missed the save");
+        failures++;
+    }
+    remove (path);
+    job_system_shutdown ();
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,243 @@
+//
+// Scaling of the job system on the per-frame work that now runs on it: the
+// batch transform from bench_maths, occluder rasterization, the Hi-Z box
+// tests and LOD selection. Each workload runs with 1, 2, 4 ... up to the
+// requested number of workers and prints the speed-up over one worker.
+//
+// Checks: the visible count doesn't change with the worker count; a job
+// stolen by another worker still finishes against its own counter while its
+// owner queues more jobs than the job ring holds.
+//
+// usage: bench_jobs [max_workers]   (default: one per hardware thread)
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <utils/maths_funcs.h>
+#include <jobs/job_system.h>
+#include <culling/occlusion.h>
+#include <lod/lod_select.h>
+#include "bench_common.h"
+
+static const int REPS = 7;
+
+struct Workloads {
+    // batch transform
+    std::vector<mat4> models;
+    std::vector<vec4> points;
+    std::vector<vec4> out;
+    mat4 view_proj;
+    // occlusion
+    Mesh box;
+    std::vector<Occluder> occluders;
+    std::vector<Aabb> boxes;
+    std::vector<unsigned char> visible;
+    vec3 camera_pos;
+    // lod
+    LodMesh lod_mesh;
+    std::vector<LodInstance> instances;
+};
+
+static void make_box (Mesh* m) {
+    for (int i = 0; i < 8; i++) {
+        m->positions.push_back (vec3 ((i & 1) ? 0.5f : -0.5f, (i & 2) ? 0.5f : -0.5f, (i & 4) ? 0.5f : -0.5f));
+    }
+    const unsigned int faces[36] = {0, 2, 1, 1, 2, 3, 4, 5, 6, 5, 7, 6, 0, 1, 4, 1, 5, 4,
+                                    2, 6, 3, 3, 6, 7, 0, 4, 2, 2, 4, 6, 1, 3, 5, 3, 7, 5};
+    m->indices.assign (faces, faces + 36);
+}
+
+static void setup (Workloads* w) {
+    const int model_count = 1024;
+    w->models.resize (model_count);
+    w->points.resize (model_count * 256);
+    w->out.resize (w->points.size ());
+    for (int i = 0; i < model_count; i++) {
+        w->models[i] = translate (rotate_y_deg (identity_mat4 (), (float)i), vec3 ((float)i, 0.0f, -(float)i));
+    }
+    for (size_t i = 0; i < w->points.size (); i++) {
+        w->points[i] = vec4 ((float)(i % 7), (float)(i % 13), (float)(i % 5), 1.0f);
+    }
+    w->camera_pos = vec3 (0.0f, 1.5f, 0.0f);
+    w->view_proj = perspective (67.0f, 16.0f / 9.0f, 0.1f, 200.0f) *
+                   look_at (w->camera_pos, vec3 (0.0f, 1.5f, -10.0f), vec3 (0.0f, 1.0f, 0.0f));
+
+    // rows of wall slabs with narrow gaps in front of the camera, and a
+    // field of small boxes behind and between them
+    make_box (&w->box);
+    for (int i = 0; i < 256; i++) {
+        float z = -4.0f - (float)(i / 8) * 3.0f;
+        float x = (float)(i % 8) * 3.0f - 10.5f;
+        mat4 model = translate (scale (identity_mat4 (), vec3 (2.5f, 3.0f, 0.3f)), vec3 (x, 1.5f, z));
+        Occluder o;
+        o.positions = &w->box.positions[0];
+        o.indices = &w->box.indices[0];
+        o.index_count = (unsigned int)w->box.indices.size ();
+        o.model = model;
+        o.world_bounds = aabb_transform (mesh_bounds (w->box), model);
+        w->occluders.push_back (o);
+    }
+    for (int i = 0; i < 100000; i++) {
+        vec3 c ((float)(i % 100) * 0.5f - 25.0f, (float)(i % 7) * 0.4f, -2.0f - (float)(i / 100) * 0.1f);
+        Aabb b;
+        b.min = c - vec3 (0.2f, 0.2f, 0.2f);
+        b.max = c + vec3 (0.2f, 0.2f, 0.2f);
+        w->boxes.push_back (b);
+    }
+    w->visible.resize (w->boxes.size ());
+
+    // selection only reads the level table, so a fake four level mesh will do
+    memset (w->lod_mesh.levels, 0, sizeof (w->lod_mesh.levels));
+    w->lod_mesh.level_count = 4;
+    for (int l = 0; l < 4; l++) {
+        w->lod_mesh.levels[l].index_count = 3u * (20000u >> l);
+        w->lod_mesh.levels[l].error = 0.002f * (float)(1 << l);
+    }
+    w->lod_mesh.bounds.center = vec3 (0.0f, 0.0f, 0.0f);
+    w->lod_mesh.bounds.radius = 1.0f;
+    for (int i = 0; i < 100000; i++) {
+        LodInstance inst;
+        inst.mesh = &w->lod_mesh;
+        inst.world_center = vec3 ((float)(i % 300) - 150.0f, 0.0f, -(float)(i / 300));
+        inst.world_scale = 1.0f;
+        inst.current_level = 0;
+        w->instances.push_back (inst);
+    }
+}
+
+static float batch_transform (Workloads* w) {
+    size_t per_model = w->points.size () / w->models.size ();
+    parallel_for_each ((int)w->models.size (), 16, [w, per_model] (int begin, int end) {
+        for (int mi = begin; mi < end; mi++) {
+            const mat4 mvp = w->view_proj * w->models[mi];
+            for (size_t i = mi * per_model; i < (mi + 1) * per_model; i++) {
+                w->out[i] = mvp * w->points[i];
+            }
+        }
+    });
+    return w->out[w->out.size () / 2].v[0];
+}
+
+struct Result {
+    double transform_ms;
+    double raster_ms;
+    double cull_ms;
+    double lod_ms;
+    int visible;
+};
+
+struct HeldJob {
+    std::atomic<bool> started;
+    std::atomic<bool> release;
+};
+
+static void hold (void* data) {
+    HeldJob* h = (HeldJob*)data;
+    h->started.store (true);
+    while (!h->release.load ()) {
+        std::this_thread::yield ();
+    }
+}
+
+static void nothing (void*) {
+}
+
+/* one job held on worker 1 while the main thread allocates past the job
+ring (8192 a worker) and wraps onto its slot. true if both counters end at
+zero */
+static bool held_job_survives_wrap () {
+    job_system_init (2);
+    HeldJob h;
+    h.started.store (false);
+    h.release.store (false);
+    JobCounter held, churn;
+    job_run (hold, &h, &held);
+    // don't run jobs here, so the only way it starts is being stolen
+    while (!h.started.load ()) {
+        std::this_thread::yield ();
+    }
+    for (int i = 0; i < 20000; i++) {
+        job_run (nothing, NULL, &churn);
+        if (i % 1000 == 999) {
+            job_wait (&churn);
+        }
+    }
+    job_wait (&churn);
+    h.release.store (true);
+    // a wrong counter would leave held above zero for good, so don't job_wait
+    double t0 = bench_now_ms ();
+    while (held.value.load () != 0 && bench_now_ms () - t0 < 2000.0) {
+        std::this_thread::yield ();
+    }
+    int held_left = held.value.load (), churn_left = churn.value.load ();
+    printf ("held job across 20000 allocations: counters %d and %d\n", held_left, churn_left);
+    job_system_shutdown ();
+    return held_left == 0 && churn_left == 0;
+}
+
+static Result run (Workloads* w, int workers) {
+    job_system_init (workers);
+    Result r;
+    float keep = 0.0f;
+    r.transform_ms = bench_best_ms (REPS, [&] { keep += batch_transform (w); });
+    bench_keep (keep);
+
+    OcclusionBuffer ob;
+    occlusion_init (&ob, 512, 256, 0);
+    r.raster_ms = bench_best_ms (REPS, [&] {
+        occlusion_begin_frame (&ob, w->view_proj, w->camera_pos, 1e9);
+        occlusion_rasterize (&ob, &w->occluders[0], (int)w->occluders.size ());
+    });
+    r.visible = 0;
+    r.cull_ms = bench_best_ms (REPS, [&] {
+        r.visible = occlusion_cull (&ob, &w->boxes[0], (int)w->boxes.size (), &w->visible[0]);
+    });
+
+    LodSelectParams p = lod_params_from_perspective (67.0f, 1080, 1.0f);
+    LodFrameStats stats;
+    r.lod_ms = bench_best_ms (REPS, [&] {
+        lod_select_all (&w->instances[0], (int)w->instances.size (), w->camera_pos, p, &stats);
+    });
+    bench_keep (stats);
+    job_system_shutdown ();
+    return r;
+}
+
+int main (int argc, char** argv) {
+    int max_workers = argc > 1 ? atoi (argv[1]) : (int)std::thread::hardware_concurrency ();
+    if (max_workers < 1) {
+        max_workers = 1;
+    }
+    Workloads w;
+    setup (&w);
+    printf ("hardware threads: %u\n", std::thread::hardware_concurrency ());
+    printf ("workers  transform(ms)     raster(ms)       cull(ms)        lod(ms)    visible\n");
+    std::vector<int> counts;
+    for (int n = 1; n < max_workers; n *= 2) {
+        counts.push_back (n);
+    }
+    counts.push_back (max_workers);
+    Result base = {};
+    for (size_t i = 0; i < counts.size (); i++) {
+        Result r = run (&w, counts[i]);
+        if (i == 0) {
+            base = r;
+        }
+        printf ("%7d  %7.3f x%4.2f  %7.3f x%4.2f  %7.3f x%4.2f  %7.3f x%4.2f  %9d\n", counts[i],
+                r.transform_ms, base.transform_ms / r.transform_ms, r.raster_ms, base.raster_ms / r.raster_ms,
+                r.cull_ms, base.cull_ms / r.cull_ms, r.lod_ms, base.lod_ms / r.lod_ms, r.visible);
+        if (r.visible != base.visible) {
+            printf ("ERROR: visible count changed with %d workers\n", counts[i]);
+            return 1;
+        }
+    }
+    if (!held_job_survives_wrap ()) {
+        printf ("ERROR: a stolen job decremented another job's counter\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,107 @@
+//
+// Clustered light binning on the CPU for 1k, 4k and 16k point lights spread
+// through a 100 x 10 x 100 hall, on main ()'s projection with a 16 x 9 x 24
+// grid. The lists are checked for lights that don't touch their cluster and
+// for lights missing where a point of their sphere lands.
+//
+// usage: bench_light_clusters
+//
+
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+#include <vector>
+#include <utils/maths_funcs.h>
+#include <jobs/job_system.h>
+#include <render/light_clusters.h>
+#include "bench_common.h"
+
+static const int REPS = 5;
+
+static unsigned int rng_state = 12345u;
+
+static float frand (float lo, float hi) {
+    rng_state = rng_state * 1664525u + 1013904223u;
+    return lo + (hi - lo) * (float)(rng_state >> 8) / 16777216.0f;
+}
+
+/* two checks per cluster. every light in its list must touch the cluster's
+box (nothing extra), and any point inside a light's sphere must find that
+light in the list of the cluster the point falls in, as a fragment there
+would (nothing missing). a full cluster is allowed to miss lights */
+static int check (const LightClusters& c, const mat4& proj) {
+    int failures = 0;
+    int n = light_cluster_count (c);
+    for (int k = 0; k < n; k++) {
+        unsigned int offset = c.cluster_ranges[k * 2], count = c.cluster_ranges[k * 2 + 1];
+        for (unsigned int j = 0; j < count; j++) {
+            const float* s = c.lights[c.light_indices[offset + j]].position_radius;
+            float dx = fmaxf (fmaxf (c.min_x[k] - s[0], s[0] - c.max_x[k]), 0.0f);
+            float dy = fmaxf (fmaxf (c.min_y[k] - s[1], s[1] - c.max_y[k]), 0.0f);
+            float dz = fmaxf (fmaxf (c.min_z[k] - s[2], s[2] - c.max_z[k]), 0.0f);
+            failures += dx * dx + dy * dy + dz * dz > s[3] * s[3] * 1.0001f;
+        }
+    }
+    for (size_t i = 0; i < c.lights.size (); i++) {
+        const float* s = c.lights[i].position_radius;
+        for (int sample = 0; sample < 32; sample++) {
+            vec3 d (frand (-1.0f, 1.0f), frand (-1.0f, 1.0f), frand (-1.0f, 1.0f));
+            if (length2 (d) > 1.0f) {
+                continue;
+            }
+            vec3 p = vec3 (s[0], s[1], s[2]) + d * (s[3] * 0.999f);
+            float depth = -p.v[2];
+            vec4 clip = proj * vec4 (p, 1.0f);
+            float nx = clip.v[0] / clip.v[3], ny = clip.v[1] / clip.v[3];
+            if (depth < c.near_plane || depth > c.far_plane || fabsf (nx) >= 1.0f || fabsf (ny) >= 1.0f) {
+                continue;
+            }
+            int tx = (int)((nx + 1.0f) * 0.5f * c.tiles_x), ty = (int)((ny + 1.0f) * 0.5f * c.tiles_y);
+            int slice = std::min (c.slices - 1, (int)(logf (depth / c.near_plane) * c.slice_scale));
+            int k = (slice * c.tiles_y + ty) * c.tiles_x + tx;
+            unsigned int offset = c.cluster_ranges[k * 2], count = c.cluster_ranges[k * 2 + 1];
+            bool found = count == LIGHT_CLUSTER_MAX_LIGHTS;
+            for (unsigned int j = 0; !found && j < count; j++) {
+                found = c.light_indices[offset + j] == i;
+            }
+            failures += !found;
+        }
+    }
+    return failures;
+}
+
+int main () {
+    job_system_init (0);
+    // main ()'s camera: 67 degree fov, 16:9, near 0.1, far 100
+    float near = 0.1f, far = 100.0f;
+    mat4 proj = perspective (67.0f, 16.0f / 9.0f, near, far);
+    mat4 view = look_at (vec3 (0.0f, 5.0f, -50.0f), vec3 (0.0f, 3.0f, 0.0f), vec3 (0.0f, 1.0f, 0.0f));
+    LightClusters c;
+    light_clusters_init (&c, 16, 9, 24, proj, near, far);
+    printf ("%d clusters, up to %d lights each, %d worker(s)\n", light_cluster_count (c), LIGHT_CLUSTER_MAX_LIGHTS,
+            job_system_worker_count ());
+    printf ("lights   in view   build(ms)   ns/light   refs/cluster   max   dropped\n");
+
+    const int sizes[3] = {1000, 4000, 16000};
+    int failures = 0;
+    for (int si = 0; si < 3; si++) {
+        std::vector<PointLight> lights (sizes[si]);
+        for (size_t i = 0; i < lights.size (); i++) {
+            lights[i].position = vec3 (frand (-50.0f, 50.0f), frand (0.0f, 10.0f), frand (-50.0f, 50.0f));
+            lights[i].radius = frand (1.0f, 4.0f);
+            lights[i].colour = vec3 (frand (0.2f, 1.0f), frand (0.2f, 1.0f), frand (0.2f, 1.0f));
+            lights[i].intensity = 1.0f;
+        }
+        int n = (int)lights.size ();
+        double ms = bench_best_ms (REPS, [&] { light_clusters_build (&c, &lights[0], n, view); });
+        failures += check (c, proj);
+        printf ("%6d   %7u   %9.3f   %8.1f   %12.2f   %3u   %7u\n", n, c.stats.lights_visible, ms, ms * 1e6 / n,
+                (double)c.stats.references / light_cluster_count (c), c.stats.max_per_cluster, c.stats.dropped);
+    }
+    job_system_shutdown ();
+    if (failures) {
+        printf ("ERROR: %d cluster lists are wrong\n", failures);
+        return 1;
+    }
+    return 0;
+}
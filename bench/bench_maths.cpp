@@ -0,0 +1,141 @@
+//
+// Compares the header-only maths (maths_inline.h) against an out-of-line copy
+// of the old maths_funcs.cpp on the two workloads that call it the most: the
+// per-event camera update from main.cpp and a batch of model transforms.
+//
+// usage: bench_maths [iterations]
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <utils/maths_funcs.h>
+#include "bench_common.h"
+#include "legacy_maths.h"
+
+static const int REPS = 7;
+
+/* the camera update exactly as main.cpp did it before maths_inline.h: two
+versors from the accumulated angles, both to mat4, then Rpitch * Ryaw * T */
+static float camera_update_legacy (int events) {
+    float yaw = 0.0f, pitch = 0.0f;
+    float qp[4], qy[4];
+    legacy_mat4 rp, ry, view;
+    float pos[3] = {0.0f, 0.0f, 0.5f};
+    float acc = 0.0f;
+    for (int i = 0; i < events; i++) {
+        yaw += 0.1f;
+        pitch += ((i & 1) ? 0.05f : -0.05f);
+        legacy_create_versor (qp, pitch, 1.0f, 0.0f, 0.0f);
+        legacy_create_versor (qy, yaw, 0.0f, 1.0f, 0.0f);
+        legacy_quat_to_mat4 (rp.m, qp);
+        legacy_quat_to_mat4 (ry.m, qy);
+        legacy_mat4 t = legacy_translate (legacy_identity_mat4 (), legacy_vec3 (-pos[0], -pos[1], -pos[2]));
+        view = rp * ry * t;
+        legacy_vec3 left = legacy_cross (legacy_vec3 (view.m[2], view.m[6], view.m[10]),
+                                         legacy_vec3 (view.m[1], view.m[5], view.m[9]));
+        pos[0] += left.v[0] * 1e-4f;
+        pos[2] += left.v[2] * 1e-4f;
+        acc += legacy_dot (left, left) + view.m[14];
+    }
+    return acc;
+}
+
+static float camera_update_inline (int events) {
+    float yaw = 0.0f, pitch = 0.0f;
+    vec3 pos (0.0f, 0.0f, 0.5f);
+    float acc = 0.0f;
+    for (int i = 0; i < events; i++) {
+        yaw += 0.1f;
+        pitch += ((i & 1) ? 0.05f : -0.05f);
+        mat4 rp = quat_to_mat4 (quat_from_axis_deg (pitch, 1.0f, 0.0f, 0.0f));
+        mat4 ry = quat_to_mat4 (quat_from_axis_deg (yaw, 0.0f, 1.0f, 0.0f));
+        mat4 view = rp * ry * translate (identity_mat4 (), -pos);
+        vec3 left = cross (vec3 (view.m[2], view.m[6], view.m[10]),
+                           vec3 (view.m[1], view.m[5], view.m[9]));
+        pos.v[0] += left.v[0] * 1e-4f;
+        pos.v[2] += left.v[2] * 1e-4f;
+        acc += dot (left, left) + view.m[14];
+    }
+    return acc;
+}
+
+/* model-view-projection for every model, then push each model's vertices
+through its matrix */
+static float batch_transform_legacy (const std::vector<legacy_mat4>& models, legacy_mat4 view_proj,
+                                     const std::vector<legacy_vec4>& points, std::vector<legacy_vec4>& out) {
+    size_t per_model = points.size () / models.size ();
+    for (size_t mi = 0; mi < models.size (); mi++) {
+        legacy_mat4 mvp = view_proj * models[mi];
+        for (size_t i = mi * per_model; i < (mi + 1) * per_model; i++) {
+            out[i] = mvp * points[i];
+        }
+    }
+    return out[out.size () / 2].v[0];
+}
+
+static float batch_transform_inline (const std::vector<mat4>& models, const mat4& view_proj,
+                                     const std::vector<vec4>& points, std::vector<vec4>& out) {
+    size_t per_model = points.size () / models.size ();
+    for (size_t mi = 0; mi < models.size (); mi++) {
+        const mat4 mvp = view_proj * models[mi];
+        for (size_t i = mi * per_model; i < (mi + 1) * per_model; i++) {
+            out[i] = mvp * points[i];
+        }
+    }
+    return out[out.size () / 2].v[0];
+}
+
+int main (int argc, char** argv) {
+    int events = argc > 1 ? atoi (argv[1]) : 1000000;
+
+    /* camera update */
+    float r0 = 0.0f, r1 = 0.0f;
+    double legacy_ms = bench_best_ms (REPS, [&] { r0 = camera_update_legacy (events); });
+    double inline_ms = bench_best_ms (REPS, [&] { r1 = camera_update_inline (events); });
+    bench_keep (r0);
+    bench_keep (r1);
+    printf ("camera update, %d events\n", events);
+    printf ("  out-of-line: %8.3f ms  %6.1f ns/event\n", legacy_ms, legacy_ms * 1e6 / events);
+    printf ("  inline:      %8.3f ms  %6.1f ns/event  (x%.2f)\n", inline_ms, inline_ms * 1e6 / events,
+            legacy_ms / inline_ms);
+    printf ("  checksum difference %g\n", (double)(r0 - r1));
+
+    /* batch transform */
+    const int model_count = 1024;
+    const int point_count = model_count * 256;
+    std::vector<legacy_mat4> legacy_models (model_count);
+    std::vector<mat4> models (model_count);
+    std::vector<legacy_vec4> legacy_points (point_count), legacy_out (point_count);
+    std::vector<vec4> points (point_count), out (point_count);
+    for (int i = 0; i < model_count; i++) {
+        models[i] = translate (rotate_y_deg (identity_mat4 (), (float)i), vec3 ((float)i, 0.0f, -(float)i));
+        for (int k = 0; k < 16; k++) {
+            legacy_models[i].m[k] = models[i].m[k];
+        }
+    }
+    for (int i = 0; i < point_count; i++) {
+        points[i] = vec4 ((float)(i % 7), (float)(i % 13), (float)(i % 5), 1.0f);
+        legacy_points[i] = legacy_vec4 (points[i].v[0], points[i].v[1], points[i].v[2], 1.0f);
+    }
+    mat4 view_proj = perspective (67.0f, 16.0f / 9.0f, 0.1f, 100.0f) *
+                     look_at (vec3 (0.0f, 2.0f, 5.0f), vec3 (0.0f, 0.0f, 0.0f), vec3 (0.0f, 1.0f, 0.0f));
+    legacy_mat4 legacy_view_proj;
+    for (int k = 0; k < 16; k++) {
+        legacy_view_proj.m[k] = view_proj.m[k];
+    }
+    legacy_ms = bench_best_ms (REPS, [&] {
+        r0 = batch_transform_legacy (legacy_models, legacy_view_proj, legacy_points, legacy_out);
+    });
+    inline_ms = bench_best_ms (REPS, [&] {
+        r1 = batch_transform_inline (models, view_proj, points, out);
+    });
+    bench_keep (r0);
+    bench_keep (r1);
+    printf ("batch transform, %d models x %d points\n", model_count, point_count / model_count);
+    printf ("  out-of-line: %8.3f ms  %6.2f ns/point\n", legacy_ms, legacy_ms * 1e6 / point_count);
+    printf ("  inline:      %8.3f ms  %6.2f ns/point  (x%.2f)\n", inline_ms, inline_ms * 1e6 / point_count,
+            legacy_ms / inline_ms);
+    printf ("  checksum difference %g\n", (double)(r0 - r1));
+    return 0;
+}
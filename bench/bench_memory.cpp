@@ -0,0 +1,243 @@
+//
+// Memory tracking: what counting every allocation costs, and whether the
+// counts are right.
+//
+// Random sized new[] and delete[] pairs, first on one thread and then from
+// every worker under one tag, are timed against malloc and free, the
+// baseline: operator new with its header and counters against none. Then a
+// scene store is built under its tag and updated frame after frame with
+// memory_frame_end between, as the game does.
+//
+// Checks: a scope charges exactly the bytes and blocks allocated in it and
+// gives them back on delete, peak included; parallel_for bodies are charged
+// to the tag of the caller; the frame counts match the allocations made in
+// the frame; a budget set below use reports over, and clearing it does not;
+// the scene's steady state frames allocate nothing.
+//
+// usage: bench_memory [pairs] [workers]
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <jobs/job_system.h>
+#include <memory/memory_tracker.h>
+#include <scene/scene_store.h>
+#include "bench_common.h"
+
+static const int REPS = 5;
+static const int LIVE = 64;      // blocks kept live at once, as a container churn would
+
+static unsigned int rng_state = 1;
+
+static unsigned int urand () {
+    rng_state = rng_state * 1664525u + 1013904223u;
+    return rng_state >> 8;
+}
+
+/* pairs allocations of 16 to 512 bytes, LIVE of them live at a time */
+static void churn_new (const unsigned int* sizes, int pairs) {
+    char* live[LIVE] = {};
+    for (int i = 0; i < pairs; i++) {
+        char*& slot = live[i & (LIVE - 1)];
+        delete[] slot;
+        slot = new char[sizes[i]];
+        slot[0] = (char)i;
+    }
+    for (int i = 0; i < LIVE; i++) {
+        delete[] live[i];
+    }
+}
+
+static void churn_malloc (const unsigned int* sizes, int pairs) {
+    char* live[LIVE] = {};
+    for (int i = 0; i < pairs; i++) {
+        char*& slot = live[i & (LIVE - 1)];
+        free (slot);
+        slot = (char*)malloc (sizes[i]);
+        slot[0] = (char)i;
+    }
+    for (int i = 0; i < LIVE; i++) {
+        free (live[i]);
+    }
+}
+
+static MemoryTagStats stats_of (MemoryTag tag) {
+    MemoryTagStats s;
+    memory_stats (tag, &s);
+    return s;
+}
+
+int main (int argc, char** argv) {
+    int pairs = argc > 1 ? atoi (argv[1]) : 1000000;
+    job_system_init (argc > 2 ? atoi (argv[2]) : 0);
+    if (pairs < LIVE) {
+        printf ("ERROR: need at least %d pairs\n", LIVE);
+        return 1;
+    }
+    int failures = 0;
+
+    std::vector<unsigned int> sizes (pairs);
+    for (int i = 0; i < pairs; i++) {
+        sizes[i] = 16 + urand () % 497;
+    }
+    const unsigned int* size_data = sizes.data ();
+    int workers = job_system_worker_count ();
+    const int chunks = workers * 4;
+    int chunk_pairs = pairs / chunks;
+
+    double malloc_ms = bench_best_ms (REPS, [&] { churn_malloc (size_data, pairs); });
+    double new_ms = bench_best_ms (REPS, [&] { churn_new (size_data, pairs); });
+    double malloc_mt_ms = bench_best_ms (REPS, [&] {
+        parallel_for_each (chunks, 1, [&] (int first, int last) {
+            for (int c = first; c < last; c++) {
+                churn_malloc (size_data + c * chunk_pairs, chunk_pairs);
+            }
+        });
+    });
+    double new_mt_ms;
+    {
+        MemoryScope scope (MEMORY_NET);
+        new_mt_ms = bench_best_ms (REPS, [&] {
+            parallel_for_each (chunks, 1, [&] (int first, int last) {
+                for (int c = first; c < last; c++) {
+                    churn_new (size_data + c * chunk_pairs, chunk_pairs);
+                }
+            });
+        });
+    }
+    double mt_pairs = (double)chunks * chunk_pairs;
+    printf ("%d pairs, %d to %d bytes, %d live, %d worker(s)\n", pairs, 16, 512, LIVE, workers);
+    printf ("                   malloc/free(ns)   new/delete(ns)   overhead\n");
+    printf ("one thread         %15.1f  %15.1f   %7.2fx\n", malloc_ms * 1e6 / pairs, new_ms * 1e6 / pairs,
+            new_ms / malloc_ms);
+    printf ("all workers        %15.1f  %15.1f   %7.2fx\n\n", malloc_mt_ms * 1e6 / mt_pairs,
+            new_mt_ms * 1e6 / mt_pairs, new_mt_ms / malloc_mt_ms);
+
+    // a scope charges what it allocates, and delete gives it back
+    MemoryTagStats before = stats_of (MEMORY_NAV);
+    std::vector<int>* held;
+    {
+        MemoryScope scope (MEMORY_NAV);
+        held = new std::vector<int> ();
+        held->reserve (1000);
+    }
+    MemoryTagStats during = stats_of (MEMORY_NAV);
+    delete held;
+    MemoryTagStats after = stats_of (MEMORY_NAV);
+    int64_t expected = (int64_t)sizeof (std::vector<int>) + 1000 * (int64_t)sizeof (int);
+    printf ("scope: %lld bytes in %lld blocks charged, %lld left after delete, peak %lld\n",
+            (long long)(during.bytes - before.bytes), (long long)(during.blocks - before.blocks),
+            (long long)(after.bytes - before.bytes), (long long)after.peak);
+    if (during.bytes - before.bytes != expected || during.blocks - before.blocks != 2 || after.bytes != before.bytes ||
+        after.blocks != before.blocks || after.peak < before.bytes + expected) {
+        printf ("ERROR: the scope was charged %lld bytes, expected %lld\n", (long long)(during.bytes - before.bytes),
+                (long long)expected);
+        failures++;
+    }
+
+    // jobs run under the tag of the thread that queued them
+    const int TASKS = 4096;
+    uint64_t lod_before = stats_of (MEMORY_LOD).allocations;
+    {
+        MemoryScope scope (MEMORY_LOD);
+        parallel_for_each (TASKS, 16, [] (int first, int last) {
+            for (int i = first; i < last; i++) {
+                int* p = new int (i);
+                bench_keep (p);
+                delete p;
+            }
+        });
+    }
+    uint64_t lod_allocations = stats_of (MEMORY_LOD).allocations - lod_before;
+    printf ("parallel_for under lod: %llu of %d allocations charged to lod\n", (unsigned long long)lod_allocations,
+            TASKS);
+    if (lod_allocations != (uint64_t)TASKS) {
+        printf ("ERROR: jobs lost their caller's tag\n");
+        failures++;
+    }
+
+    // the frame counts are the allocations between two frame ends
+    memory_frame_end ();
+    {
+        MemoryScope scope (MEMORY_ANIMATION);
+        for (int i = 0; i < 100; i++) {
+            int* p = new int (i);
+            bench_keep (p);
+            delete p;
+        }
+    }
+    memory_frame_end ();
+    MemoryTagStats frame = stats_of (MEMORY_ANIMATION);
+    memory_frame_end ();
+    MemoryTagStats quiet = stats_of (MEMORY_ANIMATION);
+    printf ("frames: %llu then %llu allocations, most in one frame %llu\n",
+            (unsigned long long)frame.frame_allocations, (unsigned long long)quiet.frame_allocations,
+            (unsigned long long)quiet.frame_peak);
+    if (frame.frame_allocations != 100 || quiet.frame_allocations != 0 || quiet.frame_peak != 100) {
+        printf ("ERROR: the frame counts are wrong\n");
+        failures++;
+    }
+
+    // a budget below use is over at the next frame end, and not once cleared
+    std::vector<char>* big;
+    {
+        MemoryScope scope (MEMORY_TEXTURES);
+        big = new std::vector<char> (2 << 20);
+    }
+    memory_set_budget (MEMORY_TEXTURES, 1 << 20, 0);
+    memory_frame_end ();
+    bool over = stats_of (MEMORY_TEXTURES).over;
+    memory_set_budget (MEMORY_TEXTURES, 0, 0);
+    memory_frame_end ();
+    bool cleared = !stats_of (MEMORY_TEXTURES).over;
+    delete big;
+    printf ("budget: 2 MB against 1 MB %s, %s once cleared\n", over ? "over" : "not over",
+            cleared ? "not over" : "still over");
+    if (!over || !cleared) {
+        printf ("ERROR: the budget check is wrong\n");
+        failures++;
+    }
+
+    // a scene store: built, then updated a frame at a time
+    Aabb unit;
+    unit.min = vec3 (-0.5f, -0.5f, -0.5f);
+    unit.max = vec3 (0.5f, 0.5f, 0.5f);
+    versor spin = quat_from_axis_deg (10.0f, 0.0f, 1.0f, 0.0f);
+    vec3 one (1.0f, 1.0f, 1.0f);
+    SceneStore* s = new SceneStore ();
+    scene_init (s);
+    std::vector<Entity> roots;
+    for (int r = 0; r < 2000; r++) {
+        Entity root = scene_create (s, ENTITY_NONE, vec3 ((float)(r % 40), 0.0f, (float)(r / 40)), spin, one, unit);
+        roots.push_back (root);
+        for (int c = 0; c < 4; c++) {
+            scene_create (s, root, vec3 ((float)c, 1.0f, 0.0f), spin, one, unit);
+        }
+    }
+    uint64_t frame_total = 0;
+    const int FRAMES = 60;
+    for (int f = 0; f < FRAMES; f++) {
+        for (size_t r = 0; r < roots.size (); r += 7) {
+            scene_set_position (s, roots[r], vec3 ((float)f, 0.0f, (float)r));
+        }
+        scene_update (s);
+        uint64_t n = memory_frame_end ();
+        if (f >= 2) {
+            frame_total += n;
+        }
+    }
+    MemoryTagStats scene = stats_of (MEMORY_SCENE);
+    printf ("scene: 10000 entities, %.1f KB in %lld blocks (peak %.1f KB), %llu allocations in %d steady frames\n\n",
+            scene.bytes / 1024.0, (long long)scene.blocks, scene.peak / 1024.0, (unsigned long long)frame_total,
+            FRAMES - 2);
+    if (frame_total != 0) {
+        printf ("ERROR: steady state frames allocate\n");
+        failures++;
+    }
+    memory_print_stats (stdout);
+    delete s;
+
+    job_system_shutdown ();
+    return failures ? 1 : 0;
+}
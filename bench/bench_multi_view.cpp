@@ -0,0 +1,146 @@
+//
+// Culling and command building for several views at once, shared, against
+// running the single view path once per view.
+//
+// The level is room_generate's default, every prop instance and every
+// room's architecture an object. Views are 1, 2, 4, 8 and 16 cameras in two
+// layouts: huddled, all standing in the middle room looking different ways
+// (split screen players, or cubemap style captures), and scattered, each in
+// a random room (security cameras). The naive path tests every object
+// against each view and runs draw_batch_build on the result, so every view
+// writes its own copy of the draw data.
+//
+// Reported per case: objects seen, shared draw data against the naive
+// copies, frustum tests, and the time for both paths, total and per view.
+//
+// Checks: each view's commands draw the same meshes with the same model
+// matrices, in the same order, as its naive build.
+//
+// usage: bench_multi_view [seed]
+//
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <jobs/job_system.h>
+#include <render/multi_view.h>
+#include <scene/room_generator.h>
+#include "bench_common.h"
+
+static const int REPS = 5;
+
+static unsigned int rng_state;
+
+static float frand () {
+    rng_state = rng_state * 1664525u + 1013904223u;
+    return (float)(rng_state >> 8) / 16777216.0f;
+}
+
+/* the naive build for one view, checked against the view's slice */
+static int check_view (const MultiView& mv, int v, const DrawBatch& naive) {
+    if (naive.commands.size () != mv.counts[v]) {
+        printf ("ERROR: view %d has %u commands, the naive build %zu\n", v, mv.counts[v], naive.commands.size ());
+        return 1;
+    }
+    for (size_t k = 0; k < naive.commands.size (); k++) {
+        const DrawElementsIndirectCommand& a = mv.commands[mv.first[v] + k];
+        const DrawElementsIndirectCommand& b = naive.commands[k];
+        const DrawData& da = mv.draws[a.base_instance];
+        const DrawData& db = naive.draws[b.base_instance];
+        if (a.count != b.count || a.first_index != b.first_index || a.base_vertex != b.base_vertex ||
+            memcmp (&da, &db, sizeof (da)) != 0) {
+            printf ("ERROR: view %d command %zu differs from the naive build\n", v, k);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int main (int argc, char** argv) {
+    uint32_t seed = argc > 1 ? (uint32_t)strtoul (argv[1], NULL, 10) : 1;
+    job_system_init (0);
+
+    RoomGenParams params = room_gen_default_params (seed);
+    GeneratedLevel level;
+    room_generate (params, &level);
+    DrawBatch batch;
+    draw_batch_init (&batch);
+    for (size_t m = 0; m < level.meshes.size (); m++) {
+        draw_batch_add_mesh (&batch, level.meshes[m]);
+    }
+    std::vector<unsigned int> mesh_of;
+    std::vector<mat4> worlds;
+    std::vector<Aabb> bounds;
+    for (size_t i = 0; i < level.instances.size (); i++) {
+        mesh_of.push_back (level.instances[i].mesh);
+        worlds.push_back (level.instances[i].world);
+        bounds.push_back (level.instances[i].world_bounds);
+    }
+    for (unsigned int m = level.library_meshes; m < (unsigned int)level.meshes.size (); m++) {
+        mesh_of.push_back (m);
+        worlds.push_back (identity_mat4 ());
+        bounds.push_back (mesh_bounds (level.meshes[m]));
+    }
+    int count = (int)mesh_of.size ();
+    float pitch = params.room_size + params.corridor_length;
+    printf ("%d objects over %d x %d rooms, %d worker(s)\n", count, params.rooms_x, params.rooms_z,
+            job_system_worker_count ());
+    printf ("layout     views   seen   shared  naive copies   tests  naive tests   shared(ms)  naive(ms)  "
+            "per view: shared  naive\n");
+
+    MultiView mv;
+    multi_view_init (&mv);
+    DrawBatch naive = batch;
+    std::vector<unsigned char> visible (count);
+    int failures = 0;
+    const int view_counts[5] = {1, 2, 4, 8, 16};
+    for (int layout = 0; layout < 2; layout++) {
+        for (int vc = 0; vc < 5; vc++) {
+            int views = view_counts[vc];
+            rng_state = seed * 7919u + (unsigned int)(layout * 16 + views);
+            multi_view_clear (&mv);
+            for (int v = 0; v < views; v++) {
+                int rx = layout == 0 ? params.rooms_x / 2 : (int)(frand () * params.rooms_x);
+                int rz = layout == 0 ? params.rooms_z / 2 : (int)(frand () * params.rooms_z);
+                vec3 eye (rx * pitch, params.wall_height * 0.6f, rz * pitch);
+                float yaw = layout == 0 ? 6.2831853f * v / views : frand () * 6.2831853f;
+                vec3 target = eye + vec3 (sinf (yaw), -0.1f, cosf (yaw));
+                multi_view_add (&mv, render_view_look_at (eye, target, vec3 (0.0f, 1.0f, 0.0f), 67.0f, 16.0f / 9.0f,
+                                                          0.1f, 200.0f, 0, 0, 1920, 1080));
+            }
+
+            double shared_ms = bench_best_ms (REPS, [&] {
+                multi_view_build (&mv, batch, &mesh_of[0], &worlds[0], &bounds[0], count);
+            });
+            unsigned long long naive_copies = 0;
+            double naive_ms = bench_best_ms (REPS, [&] {
+                naive_copies = 0;
+                for (int v = 0; v < views; v++) {
+                    parallel_for_each (count, 1024, [&] (int begin, int end) {
+                        for (int i = begin; i < end; i++) {
+                            visible[i] = frustum_test_aabb (mv.frusta[v], bounds[i]);
+                        }
+                    });
+                    naive_copies += draw_batch_build (&naive, &mesh_of[0], &worlds[0], &visible[0], count);
+                }
+            });
+            // once more per view for the check, outside the timing
+            unsigned long long seen = 0;
+            for (int v = 0; v < views && !failures; v++) {
+                for (int i = 0; i < count; i++) {
+                    visible[i] = frustum_test_aabb (mv.frusta[v], bounds[i]);
+                }
+                draw_batch_build (&naive, &mesh_of[0], &worlds[0], &visible[0], count);
+                failures += check_view (mv, v, naive);
+                seen += mv.counts[v];
+            }
+            printf ("%-9s  %5d  %5llu  %7u  %12llu  %6llu  %11llu   %10.3f  %9.3f   %15.3f  %5.3f\n",
+                    layout == 0 ? "huddled" : "scattered", views, seen, mv.stats.shared_draws, naive_copies,
+                    mv.stats.tests, mv.stats.naive_tests, shared_ms, naive_ms, shared_ms / views, naive_ms / views);
+        }
+    }
+    job_system_shutdown ();
+    return failures ? 1 : 0;
+}
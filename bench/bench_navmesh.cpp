@@ -0,0 +1,311 @@
+//
+// Navmesh build and path query throughput on a generated level.
+//
+// The level is room_generate's, fewer props and coarser ones by default so
+// the build is quick. Agents stand at random points on the largest island,
+// weighted by area. Three ways of answering their queries:
+//  - naive: one query at a time, A* with a std::priority_queue and hash maps
+//    for the costs and closed set, allocated for every query, no cache
+//  - batched: nav_query_batch with the cache off, random goals
+//  - cached: nav_query_batch with the cache on and agents heading for a few
+//    shared points of interest, timed after a warm up batch
+//
+// Checks: batched A* finds paths as short as the naive one; every path runs
+// from its start to its goal and stays on its corridor; cached paths are the
+// ones an uncached search gives; nothing on one island fails.
+//
+// usage: bench_navmesh [agents] [seed] [props_per_room]
+//
+
+#include <math.h>
+#include <queue>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <jobs/job_system.h>
+#include <nav/path_query.h>
+#include <scene/room_generator.h>
+#include "bench_common.h"
+
+static const int REPS = 3;
+static const int NAIVE_QUERIES = 500;
+static const int POINTS_OF_INTEREST = 32;
+
+static unsigned int rng_state;
+
+static float frand () {
+    rng_state = rng_state * 1664525u + 1013904223u;
+    return (float)(rng_state >> 8) / 16777216.0f;
+}
+
+/* a random point on the island, polygons weighted by area */
+static vec3 random_point (const NavMesh& m, const std::vector<int>& polys, const std::vector<float>& area_sum) {
+    float a = frand () * area_sum.back ();
+    size_t lo = 0, hi = area_sum.size () - 1;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (area_sum[mid] < a) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    const NavPoly& p = m.polys[polys[lo]];
+    return vec3 (p.min[0] + (p.max[0] - p.min[0]) * frand (), p.y, p.min[1] + (p.max[1] - p.min[1]) * frand ());
+}
+
+static float edge_cost (const NavMesh& m, int p, const NavLink& link) {
+    vec3 mid = nav_link_mid (link);
+    return length (mid - nav_poly_center (m.polys[p])) + length (nav_poly_center (m.polys[link.poly]) - mid);
+}
+
+/* the search cost of a corridor, cheapest link between each pair */
+static float corridor_cost (const NavMesh& m, const std::vector<int>& corridor) {
+    float cost = 0.0f;
+    for (size_t i = 0; i + 1 < corridor.size (); i++) {
+        const NavPoly& p = m.polys[corridor[i]];
+        float best = 1e30f;
+        for (int l = p.first_link; l < p.first_link + p.link_count; l++) {
+            if (m.links[l].poly == corridor[i + 1]) {
+                best = fminf (best, edge_cost (m, corridor[i], m.links[l]));
+            }
+        }
+        cost += best;
+    }
+    return cost;
+}
+
+/* A* the way it is usually first written */
+static bool naive_search (const NavMesh& m, int start, int goal, std::vector<int>* corridor) {
+    typedef std::pair<float, int> Entry;
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry> > open;
+    std::unordered_map<int, float> cost;
+    std::unordered_map<int, int> parent;
+    std::unordered_set<int> closed;
+    vec3 target = nav_poly_center (m.polys[goal]);
+    cost[start] = 0.0f;
+    parent[start] = NAV_NO_POLY;
+    open.push (Entry (length (target - nav_poly_center (m.polys[start])), start));
+    corridor->clear ();
+    while (!open.empty ()) {
+        int p = open.top ().second;
+        open.pop ();
+        if (closed.count (p)) {
+            continue;
+        }
+        closed.insert (p);
+        if (p == goal) {
+            for (int c = goal; c != NAV_NO_POLY; c = parent[c]) {
+                corridor->insert (corridor->begin (), c);
+            }
+            return true;
+        }
+        const NavPoly& poly = m.polys[p];
+        for (int l = poly.first_link; l < poly.first_link + poly.link_count; l++) {
+            int q = m.links[l].poly;
+            float c = cost[p] + edge_cost (m, p, m.links[l]);
+            auto it = cost.find (q);
+            if (closed.count (q) || (it != cost.end () && c >= it->second)) {
+                continue;
+            }
+            cost[q] = c;
+            parent[q] = p;
+            open.push (Entry (c + length (target - nav_poly_center (m.polys[q])), q));
+        }
+    }
+    return false;
+}
+
+static bool same_point_xz (const vec3& a, const vec3& b) {
+    return fabsf (a.v[0] - b.v[0]) < 1e-4f && fabsf (a.v[2] - b.v[2]) < 1e-4f;
+}
+
+static bool on_poly (const NavPoly& p, const vec3& x) {
+    const float e = 1e-3f;
+    return x.v[0] >= p.min[0] - e && x.v[0] <= p.max[0] + e && x.v[2] >= p.min[1] - e && x.v[2] <= p.max[1] + e;
+}
+
+/* every point along the path is on some polygon of the corridor */
+static bool path_on_corridor (const NavMesh& m, const std::vector<int>& corridor, const std::vector<vec3>& path) {
+    for (size_t i = 0; i + 1 < path.size (); i++) {
+        vec3 d = path[i + 1] - path[i];
+        int steps = 1 + (int)(length (d) / 0.05f);
+        for (int s = 0; s <= steps; s++) {
+            vec3 x = path[i] + d * ((float)s / steps);
+            bool inside = false;
+            for (size_t c = 0; c < corridor.size () && !inside; c++) {
+                inside = on_poly (m.polys[corridor[c]], x);
+            }
+            if (!inside) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+int main (int argc, char** argv) {
+    int agents = argc > 1 ? atoi (argv[1]) : 4096;
+    uint32_t seed = argc > 2 ? (uint32_t)strtoul (argv[2], NULL, 10) : 1;
+    rng_state = seed;
+    job_system_init (0);
+
+    RoomGenParams params = room_gen_default_params (seed);
+    params.props_per_room = argc > 3 ? atoi (argv[3]) : 20;
+    params.detail = 2;
+    GeneratedLevel level;
+    room_generate (params, &level);
+    Mesh flat;
+    room_generator_flatten (level, &flat);
+
+    NavMesh mesh;
+    double build_ms = bench_best_ms (1, [&] {
+        navmesh_build (navmesh_default_params (), &flat, NULL, 1, &mesh);
+    });
+    const NavBuildStats& bs = mesh.stats;
+    printf ("%llu triangles (%llu walkable), %d x %d columns, %d worker(s)\n", (unsigned long long)bs.triangles,
+            (unsigned long long)bs.walkable_triangles, mesh.width, mesh.depth, job_system_worker_count ());
+    printf ("build %.1f ms: voxelize %.1f, floors %.1f, polygons %.1f\n", build_ms, bs.voxelize_ms, bs.floors_ms,
+            bs.polys_ms);
+    printf ("%llu spans, %u floors (%u eroded), %u polygons, %u links, %u islands\n", (unsigned long long)bs.spans,
+            bs.floors, bs.eroded, bs.polys, bs.links, bs.islands);
+
+    // the largest island is where the agents walk
+    std::vector<float> island_area (bs.islands, 0.0f);
+    for (size_t p = 0; p < mesh.polys.size (); p++) {
+        const NavPoly& poly = mesh.polys[p];
+        island_area[poly.island] += (poly.max[0] - poly.min[0]) * (poly.max[1] - poly.min[1]);
+    }
+    int main_island = 0;
+    for (int i = 1; i < (int)bs.islands; i++) {
+        main_island = island_area[i] > island_area[main_island] ? i : main_island;
+    }
+    std::vector<int> island_polys;
+    std::vector<float> area_sum;
+    for (size_t p = 0; p < mesh.polys.size (); p++) {
+        const NavPoly& poly = mesh.polys[p];
+        if (poly.island == main_island) {
+            island_polys.push_back ((int)p);
+            float a = (poly.max[0] - poly.min[0]) * (poly.max[1] - poly.min[1]);
+            area_sum.push_back ((area_sum.empty () ? 0.0f : area_sum.back ()) + a);
+        }
+    }
+    if (island_polys.empty ()) {
+        printf ("ERROR: the navmesh is empty\n");
+        return 1;
+    }
+    printf ("largest island: %zu polygons, %.0f square units\n", island_polys.size (), area_sum.back ());
+
+    std::vector<NavPathRequest> random (agents), shared (agents);
+    std::vector<vec3> interest (POINTS_OF_INTEREST);
+    for (int i = 0; i < POINTS_OF_INTEREST; i++) {
+        interest[i] = random_point (mesh, island_polys, area_sum);
+    }
+    for (int i = 0; i < agents; i++) {
+        random[i].start = shared[i].start = random_point (mesh, island_polys, area_sum);
+        random[i].goal = random_point (mesh, island_polys, area_sum);
+        shared[i].goal = interest[(int)(frand () * POINTS_OF_INTEREST) % POINTS_OF_INTEREST];
+    }
+
+    int failures = 0;
+    std::vector<NavPath> paths (agents), cached (agents);
+
+    // naive, on a prefix of the random queries
+    int naive_count = agents < NAIVE_QUERIES ? agents : NAIVE_QUERIES;
+    std::vector<std::vector<int> > naive_corridors (naive_count);
+    std::vector<vec3> pulled;
+    double naive_ms = bench_best_ms (1, [&] {
+        for (int i = 0; i < naive_count; i++) {
+            vec3 a, b;
+            int pa = navmesh_find_poly (mesh, random[i].start, &a);
+            int pb = navmesh_find_poly (mesh, random[i].goal, &b);
+            if (pa != NAV_NO_POLY && pb != NAV_NO_POLY && naive_search (mesh, pa, pb, &naive_corridors[i])) {
+                nav_string_pull (mesh, naive_corridors[i].data (), (int)naive_corridors[i].size (), a, b, &pulled);
+            }
+        }
+    });
+
+    NavQueryService uncached;
+    nav_query_init (&uncached, &mesh, 0);
+    double batch_ms = bench_best_ms (REPS, [&] {
+        nav_query_batch (&uncached, random.data (), agents, paths.data ());
+    });
+    NavQueryStats batch_stats = uncached.stats;
+
+    NavQueryService service;
+    nav_query_init (&service, &mesh, 1 << 16);
+    nav_query_batch (&service, shared.data (), agents, cached.data ());
+    // the same agents ask again, having moved a little
+    for (int i = 0; i < agents; i++) {
+        shared[i].start = shared[i].start + vec3 (frand () - 0.5f, 0.0f, frand () - 0.5f) * 0.2f;
+    }
+    double cached_ms = bench_best_ms (REPS, [&] {
+        nav_query_batch (&service, shared.data (), agents, cached.data ());
+    });
+    NavQueryStats cached_stats = service.stats;
+
+    printf ("queries            count   time(ms)   queries/s   searches  cache hits  expanded/search\n");
+    printf ("naive              %5d  %9.2f  %10.0f  %9d  %10s  %15s\n", naive_count, naive_ms,
+            naive_count * 1000.0 / naive_ms, naive_count, "", "");
+    printf ("batched            %5d  %9.2f  %10.0f  %9u  %10u  %15.1f\n", agents, batch_ms, agents * 1000.0 / batch_ms,
+            batch_stats.searches, batch_stats.cache_hits,
+            batch_stats.searches ? (double)batch_stats.expanded / batch_stats.searches : 0.0);
+    printf ("cached, %2d goals   %5d  %9.2f  %10.0f  %9u  %10u  %15.1f\n", POINTS_OF_INTEREST, agents, cached_ms,
+            agents * 1000.0 / cached_ms, cached_stats.searches, cached_stats.cache_hits,
+            cached_stats.searches ? (double)cached_stats.expanded / cached_stats.searches : 0.0);
+
+    // the pooled search is as good as the naive one, and its paths stay on
+    // their corridors
+    NavSearch search;
+    std::vector<int> corridor;
+    int worse = 0, off_corridor = 0, bad_ends = 0;
+    unsigned int expanded;
+    for (int i = 0; i < agents; i++) {
+        vec3 a, b;
+        int pa = navmesh_find_poly (mesh, random[i].start, &a);
+        int pb = navmesh_find_poly (mesh, random[i].goal, &b);
+        if (!nav_search (mesh, &search, pa, pb, &corridor, &expanded)) {
+            continue;
+        }
+        if (i < naive_count && corridor_cost (mesh, corridor) > corridor_cost (mesh, naive_corridors[i]) * 1.0001f + 1e-4f) {
+            worse++;
+        }
+        const std::vector<vec3>& p = paths[i].points;
+        if (p.empty () || !same_point_xz (p.front (), a) || !same_point_xz (p.back (), b)) {
+            bad_ends++;
+        } else if (!path_on_corridor (mesh, corridor, p)) {
+            off_corridor++;
+        }
+    }
+    if (batch_stats.failed || cached_stats.failed) {
+        printf ("ERROR: %u and %u queries on one island failed\n", batch_stats.failed, cached_stats.failed);
+        failures++;
+    }
+    if (worse) {
+        printf ("ERROR: %d corridors cost more than the naive search's\n", worse);
+        failures++;
+    }
+    if (bad_ends || off_corridor) {
+        printf ("ERROR: %d paths miss their ends, %d leave their corridor\n", bad_ends, off_corridor);
+        failures++;
+    }
+
+    // what the cache served is what a search gives
+    nav_query_batch (&uncached, shared.data (), agents, paths.data ());
+    int mismatched = 0;
+    for (int i = 0; i < agents; i++) {
+        bool same = paths[i].points.size () == cached[i].points.size ();
+        for (size_t k = 0; same && k < paths[i].points.size (); k++) {
+            same = length2 (paths[i].points[k] - cached[i].points[k]) == 0.0f;
+        }
+        mismatched += !same;
+    }
+    if (mismatched) {
+        printf ("ERROR: %d cached paths differ from a fresh search\n", mismatched);
+        failures++;
+    }
+    job_system_shutdown ();
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,200 @@
+//
+// A million particles: the SoA update, the back to front sort and the
+// instance gather, against straightforward versions.
+//
+// Eight blended emitters of 128k particles each are filled by bursts, all
+// long lived so the timed updates kill nothing and every rep works on the
+// same count. The baselines:
+//  - update: an array of particle structs, integrated one at a time, dead
+//    ones swap removed in the same loop
+//  - sort: std::sort of the indices on float distance
+//
+// Checks: every sorted emitter is back to front to within its quantization
+// step; after a long update with mixed lives the counts add up and no
+// particle left alive is past its life.
+//
+// usage: bench_particles [particles] [seed]
+//
+
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <render/particles.h>
+#include <jobs/job_system.h>
+#include "bench_common.h"
+
+static const int REPS = 5;
+static const int EMITTERS = 8;
+static const float DT = 1.0f / 60.0f;
+
+static unsigned int rng_state;
+
+static float frand () {
+    rng_state = rng_state * 1664525u + 1013904223u;
+    return (float)(rng_state >> 8) / 16777216.0f;
+}
+
+static ParticleEmitterParams dust_params (float life) {
+    ParticleEmitterParams p = {};
+    p.position = vec3 (frand () * 20.0f - 10.0f, frand () * 4.0f, frand () * 20.0f - 10.0f);
+    p.spread = 2.0f;
+    p.velocity = vec3 (0.0f, 0.5f, 0.0f);
+    p.velocity_jitter = 1.0f;
+    p.gravity = vec3 (0.0f, -0.5f, 0.0f);
+    p.drag = 0.2f;
+    p.life = life;
+    p.size = 0.02f;
+    p.colour[0] = p.colour[1] = p.colour[2] = p.colour[3] = 1.0f;
+    return p;
+}
+
+struct AosParticle {
+    vec3 pos;
+    vec3 vel;
+    float age;
+    float age_rate;
+};
+
+/* the same integration as particles_update, a particle at a time */
+static void update_aos (std::vector<AosParticle>* ps, const ParticleEmitterParams& p, float dt) {
+    float damp = 1.0f - p.drag * dt;
+    damp = damp < 0.0f ? 0.0f : damp;
+    for (size_t i = 0; i < ps->size ();) {
+        AosParticle& q = (*ps)[i];
+        q.vel = (q.vel + p.gravity * dt) * damp;
+        q.pos = q.pos + q.vel * dt;
+        q.age += q.age_rate * dt;
+        if (q.age >= 1.0f) {
+            q = ps->back ();
+            ps->pop_back ();
+        } else {
+            i++;
+        }
+    }
+}
+
+static float distance_to (const ParticleEmitter& e, int i, const vec3& eye) {
+    float dx = e.pos[0][i] - eye.v[0], dy = e.pos[1][i] - eye.v[1], dz = e.pos[2][i] - eye.v[2];
+    return sqrtf (dx * dx + dy * dy + dz * dz);
+}
+
+int main (int argc, char** argv) {
+    int total = argc > 1 ? atoi (argv[1]) : 1 << 20;
+    rng_state = argc > 2 ? (unsigned int)strtoul (argv[2], NULL, 10) : 1;
+    job_system_init (0);
+    int per_emitter = total / EMITTERS;
+
+    ParticleSystem s;
+    particles_init (&s);
+    std::vector<std::vector<AosParticle> > aos (EMITTERS);
+    for (int k = 0; k < EMITTERS; k++) {
+        particles_add_emitter (&s, dust_params (60.0f), per_emitter, (uint32_t)(k + 1));
+        particles_burst (&s, k, per_emitter);
+        // the baseline starts from the same particles
+        const ParticleEmitter& e = s.emitters[k];
+        aos[k].resize (e.count);
+        for (int i = 0; i < e.count; i++) {
+            aos[k][i].pos = vec3 (e.pos[0][i], e.pos[1][i], e.pos[2][i]);
+            aos[k][i].vel = vec3 (e.vel[0][i], e.vel[1][i], e.vel[2][i]);
+            aos[k][i].age = e.age[i];
+            aos[k][i].age_rate = e.age_rate[i];
+        }
+    }
+    unsigned int alive = particles_alive (s);
+    printf ("%u particles in %d emitters, %d worker(s)\n", alive, EMITTERS, job_system_worker_count ());
+
+    int failures = 0;
+    double update_ms = bench_best_ms (REPS, [&] {
+        particles_update (&s, DT);
+    });
+    double update_aos_ms = bench_best_ms (REPS, [&] {
+        for (int k = 0; k < EMITTERS; k++) {
+            update_aos (&aos[k], s.emitters[k].params, DT);
+        }
+    });
+
+    vec3 eye (0.5f, 1.7f, 12.0f);
+    double sort_ms = bench_best_ms (REPS, [&] {
+        particles_sort (&s, eye);
+    });
+    std::vector<float> distance (per_emitter);
+    std::vector<uint32_t> order (per_emitter);
+    double sort_std_ms = bench_best_ms (REPS, [&] {
+        for (int k = 0; k < EMITTERS; k++) {
+            const ParticleEmitter& e = s.emitters[k];
+            for (int i = 0; i < e.count; i++) {
+                distance[i] = distance_to (e, i, eye);
+                order[i] = (uint32_t)i;
+            }
+            std::sort (order.begin (), order.begin () + e.count,
+                       [&] (uint32_t a, uint32_t b) { return distance[a] > distance[b]; });
+            bench_keep (order[0]);
+        }
+    });
+
+    std::vector<ParticleInstance> instances (per_emitter);
+    double write_ms = bench_best_ms (REPS, [&] {
+        for (int k = 0; k < EMITTERS; k++) {
+            particles_write_instances (s.emitters[k], instances.data ());
+            bench_keep (instances[0].age);
+        }
+    });
+
+    // back to front, to within a quantization step of the emitter's range
+    int out_of_order = 0;
+    for (int k = 0; k < EMITTERS; k++) {
+        const ParticleEmitter& e = s.emitters[k];
+        float far = 0.0f;
+        for (int i = 0; i < e.count; i++) {
+            far = fmaxf (far, distance_to (e, i, eye));
+        }
+        float step = far / 65535.0f * 1.01f + 1e-6f;
+        for (int i = 1; i < e.count; i++) {
+            if (distance_to (e, e.order[i], eye) > distance_to (e, e.order[i - 1], eye) + step) {
+                out_of_order++;
+            }
+        }
+    }
+
+    printf ("stage            this(ms)  baseline(ms)  speedup   per particle(ns)\n");
+    printf ("update           %8.3f  %12.3f  %6.1fx   %16.2f\n", update_ms, update_aos_ms,
+            update_aos_ms / update_ms, update_ms * 1e6 / alive);
+    printf ("sort             %8.3f  %12.3f  %6.1fx   %16.2f\n", sort_ms, sort_std_ms, sort_std_ms / sort_ms,
+            sort_ms * 1e6 / alive);
+    printf ("write instances  %8.3f  %12s  %7s   %16.2f\n", write_ms, "", "", write_ms * 1e6 / alive);
+    if (out_of_order) {
+        printf ("ERROR: %d particles drawn in front of one nearer the camera\n", out_of_order);
+        failures++;
+    }
+
+    // kills: lives between 0.5 and 1 s, so a 0.75 s step kills about half
+    ParticleSystem d;
+    particles_init (&d);
+    for (int k = 0; k < EMITTERS; k++) {
+        particles_add_emitter (&d, dust_params (1.0f), per_emitter, (uint32_t)(k + 100));
+        particles_burst (&d, k, per_emitter);
+    }
+    unsigned int before = particles_alive (d);
+    particles_update (&d, 0.75f);
+    unsigned int after = particles_alive (d);
+    int stale = 0;
+    for (int k = 0; k < EMITTERS; k++) {
+        const ParticleEmitter& e = d.emitters[k];
+        for (int i = 0; i < e.count; i++) {
+            stale += e.age[i] >= 1.0f;
+        }
+    }
+    printf ("kills: %u -> %u alive, %u killed\n", before, after, d.stats.killed);
+    if (before - d.stats.killed != after || d.stats.alive != after) {
+        printf ("ERROR: %u alive less %u killed is not the %u left\n", before, d.stats.killed, after);
+        failures++;
+    }
+    if (stale) {
+        printf ("ERROR: %d dead particles left alive\n", stale);
+        failures++;
+    }
+    job_system_shutdown ();
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,184 @@
+//
+// Ray casting throughput against a field of spheres on a floor, about 200k
+// triangles. Coherent rays are a 256 x 256 image shot through the camera,
+// incoherent rays start at random points and go in random directions. Both
+// sets run as single closest-hit rays, any-hit rays, packets and a packet
+// batch on the job system. Packets must agree with single rays, and a sample
+// of single rays must agree with a brute-force scalar test of every triangle.
+//
+// usage: bench_raycast [spheres per side]
+//
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <utils/maths_funcs.h>
+#include <jobs/job_system.h>
+#include <scene/raycast.h>
+#include "bench_common.h"
+
+static const int REPS = 3;
+static const int IMAGE = 256;
+static const int BRUTE_SAMPLES = 200;
+
+static unsigned int rng_state = 12345u;
+
+static float frand (float lo, float hi) {
+    rng_state = rng_state * 1664525u + 1013904223u;
+    return lo + (hi - lo) * (float)(rng_state >> 8) / 16777216.0f;
+}
+
+static void make_sphere (int rings, int segments, Mesh* out) {
+    out->positions.clear ();
+    out->indices.clear ();
+    for (int r = 0; r <= rings; r++) {
+        float phi = (float)r / rings * 3.14159265f;
+        for (int s = 0; s <= segments; s++) {
+            float theta = (float)s / segments * 6.2831853f;
+            out->positions.push_back (vec3 (sinf (phi) * cosf (theta), cosf (phi), sinf (phi) * sinf (theta)));
+        }
+    }
+    for (int r = 0; r < rings; r++) {
+        for (int s = 0; s < segments; s++) {
+            unsigned int a = r * (segments + 1) + s, b = a + segments + 1;
+            unsigned int quad[6] = {a, b, a + 1, a + 1, b, b + 1};
+            out->indices.insert (out->indices.end (), quad, quad + 6);
+        }
+    }
+}
+
+/* plain one-triangle-at-a-time Moller-Trumbore over everything */
+static float brute_closest (const std::vector<vec3>& tris, const Ray& ray, unsigned int* triangle) {
+    float best = ray.t_max;
+    *triangle = RAY_NO_HIT;
+    for (size_t i = 0; i < tris.size (); i += 3) {
+        vec3 e1 = tris[i + 1] - tris[i], e2 = tris[i + 2] - tris[i];
+        vec3 p = cross (ray.dir, e2);
+        float det = dot (e1, p);
+        if (fabsf (det) < 1e-12f) {
+            continue;
+        }
+        float inv = 1.0f / det;
+        vec3 tv = ray.origin - tris[i];
+        float u = dot (tv, p) * inv;
+        vec3 q = cross (tv, e1);
+        float v = dot (ray.dir, q) * inv;
+        float t = dot (e2, q) * inv;
+        if (u >= 0.0f && v >= 0.0f && u + v <= 1.0f && t > 1e-5f && t < best) {
+            best = t;
+            *triangle = (unsigned int)(i / 3);
+        }
+    }
+    return best;
+}
+
+static void run_set (const char* name, const RayBvh& bvh, const std::vector<Ray>& rays,
+                     const std::vector<vec3>& tris, int* failures) {
+    int n = (int)rays.size ();
+    std::vector<RayHit> single (n), packet (n), batch (n);
+    int hit_count = 0;
+    double closest_ms = bench_best_ms (REPS, [&] {
+        hit_count = 0;
+        for (int i = 0; i < n; i++) {
+            hit_count += raycast_closest (bvh, rays[i], &single[i]);
+        }
+    });
+    int any_count = 0;
+    double any_ms = bench_best_ms (REPS, [&] {
+        any_count = 0;
+        for (int i = 0; i < n; i++) {
+            any_count += raycast_any (bvh, rays[i]);
+        }
+    });
+    double packet_ms = bench_best_ms (REPS, [&] {
+        for (int i = 0; i < n; i += RAY_PACKET_MAX) {
+            raycast_packet (bvh, &rays[i], std::min (RAY_PACKET_MAX, n - i), &packet[i]);
+        }
+    });
+    double batch_ms = bench_best_ms (REPS, [&] { raycast_batch (bvh, &rays[0], n, &batch[0], RAY_PACKET_MAX); });
+
+    for (int i = 0; i < n; i++) {
+        *failures += packet[i].triangle != single[i].triangle || batch[i].triangle != single[i].triangle;
+    }
+    *failures += any_count != hit_count;
+    for (int k = 0; k < BRUTE_SAMPLES; k++) {
+        int i = (int)((long long)k * n / BRUTE_SAMPLES);
+        unsigned int tri;
+        float t = brute_closest (tris, rays[i], &tri);
+        // a ray grazing a shared edge may pick either triangle at the same t
+        if ((tri == RAY_NO_HIT) != (single[i].triangle == RAY_NO_HIT) ||
+            (tri != RAY_NO_HIT && fabsf (t - single[i].t) > 1e-4f * (1.0f + t))) {
+            (*failures)++;
+        }
+    }
+    printf ("%-11s %7d rays, %5.1f%% hit   closest %6.2f   any %6.2f   packet %6.2f   batch %6.2f  Mrays/s\n",
+            name, n, 100.0 * hit_count / n, n / closest_ms * 1e-3, n / any_ms * 1e-3, n / packet_ms * 1e-3,
+            n / batch_ms * 1e-3);
+}
+
+int main (int argc, char** argv) {
+    int side = argc > 1 ? atoi (argv[1]) : 14;
+    job_system_init (0);
+
+    // a side x side field of spheres, 1024 triangles each, on a floor
+    Mesh sphere, floor_mesh;
+    make_sphere (16, 32, &sphere);
+    float floor_xyz[18] = {-100, 0, -100, -100, 0, 100, 100, 0, 100, -100, 0, -100, 100, 0, 100, 100, 0, -100};
+    mesh_from_triangle_soup (floor_xyz, 6, &floor_mesh);
+    std::vector<Mesh> meshes (1, floor_mesh);
+    std::vector<mat4> transforms (1, identity_mat4 ());
+    float spacing = 180.0f / side;
+    for (int x = 0; x < side; x++) {
+        for (int z = 0; z < side; z++) {
+            float r = frand (0.3f, 0.45f) * spacing;
+            vec3 at (-90.0f + (x + 0.5f) * spacing, r, -90.0f + (z + 0.5f) * spacing);
+            meshes.push_back (sphere);
+            transforms.push_back (translate (scale (identity_mat4 (), vec3 (r, r, r)), at));
+        }
+    }
+
+    RayBvh bvh;
+    ray_bvh_build (&bvh, &meshes[0], &transforms[0], (int)meshes.size ());
+    printf ("%u triangles, %d-wide packs, %zu nodes, depth %u, build %.1f ms, %d worker(s)\n", bvh.triangle_count,
+            RAY_SIMD_WIDTH, bvh.nodes.size (), bvh.depth, bvh.build_ms, job_system_worker_count ());
+
+    // world space copy in build order for the brute-force check
+    std::vector<vec3> tris;
+    for (size_t m = 0; m < meshes.size (); m++) {
+        for (size_t i = 0; i < meshes[m].indices.size (); i++) {
+            vec4 w = transforms[m] * vec4 (meshes[m].positions[meshes[m].indices[i]], 1.0f);
+            tris.push_back (vec3 (w.v[0], w.v[1], w.v[2]));
+        }
+    }
+
+    mat4 view = look_at (vec3 (-95.0f, 25.0f, -95.0f), vec3 (0.0f, 0.0f, 0.0f), vec3 (0.0f, 1.0f, 0.0f));
+    mat4 proj = perspective (67.0f, 1.0f, 0.1f, 400.0f);
+    std::vector<Ray> primary;
+    // pixels in 8 x 8 tiles so each packet covers a square of the image
+    for (int ty = 0; ty < IMAGE; ty += 8) {
+        for (int tx = 0; tx < IMAGE; tx += 8) {
+            for (int y = ty; y < ty + 8; y++) {
+                for (int x = tx; x < tx + 8; x++) {
+                    primary.push_back (ray_from_screen (view, proj, x + 0.5f, y + 0.5f, IMAGE, IMAGE));
+                }
+            }
+        }
+    }
+    std::vector<Ray> random_rays (primary.size ());
+    for (size_t i = 0; i < random_rays.size (); i++) {
+        random_rays[i].origin = vec3 (frand (-90.0f, 90.0f), frand (0.5f, 20.0f), frand (-90.0f, 90.0f));
+        random_rays[i].dir = normalise (vec3 (frand (-1.0f, 1.0f), frand (-1.0f, 1.0f), frand (-1.0f, 1.0f)));
+        random_rays[i].t_max = 400.0f;
+    }
+
+    int failures = 0;
+    run_set ("coherent", bvh, primary, tris, &failures);
+    run_set ("incoherent", bvh, random_rays, tris, &failures);
+    job_system_shutdown ();
+    if (failures) {
+        printf ("ERROR: %d rays disagree between traversals or with the brute-force test\n", failures);
+        return 1;
+    }
+    return 0;
+}
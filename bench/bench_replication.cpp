@@ -0,0 +1,231 @@
+//
+// Client/server replication over loopback UDP with simulated loss.
+//
+// One server and `clients` bot clients run in this process, each on its own
+// socket, on a virtual clock at the server's 60 Hz tick, so the run is the
+// same every time whatever the machine. Bots hold random movement keys for
+// a while and turn as they go. After `seconds` of that every bot lets go for
+// two seconds so everything comes to rest.
+//
+// Each client count runs once on a clean network and once with `loss` of
+// the packets dropped both ways, `latency_ms` each way and a few ms of
+// jitter. Reported: snapshot bytes, whole and delta compressed, how many
+// baselines the server encoded a tick, server and client CPU per tick,
+// inputs the server never got, corrections, and how far the interpolated
+// remote players were from the server's own positions at the same tick.
+//
+// Checks: on the clean network prediction never needs correcting; with loss
+// every client still ends up exactly where the server has it; delta
+// snapshots are smaller than whole ones.
+//
+// usage: bench_replication [clients] [loss] [latency_ms] [seconds] [seed]
+//
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <camera/camera_orientation.h>
+#include <net/replication.h>
+
+static unsigned int rng_state;
+
+static float frand () {
+    rng_state = rng_state * 1664525u + 1013904223u;
+    return (float)(rng_state >> 8) / 16777216.0f;
+}
+
+struct Bot {
+    CameraOrientation look;
+    PlayerInput input;
+    int hold;                    // ticks left on the current keys
+    float turn;                  // degrees a tick
+};
+
+static void bot_think (Bot* b, bool idle) {
+    if (idle) {
+        b->input.keys = 0;
+    } else if (--b->hold <= 0) {
+        static const unsigned int keys[5] = {0, PLAYER_KEY_W, PLAYER_KEY_S, PLAYER_KEY_A, PLAYER_KEY_D};
+        static const int angles[5] = {0, 0, 180, -90, 90};
+        int k = (int)(frand () * 5.0f) % 5;
+        b->input.keys = keys[k];
+        b->input.move_angle = k ? angles[k] : b->input.move_angle;
+        b->hold = 20 + (int)(frand () * 60.0f);
+        b->turn = (frand () - 0.5f) * 4.0f;
+    }
+    if (!idle) {
+        camera_orientation_rotate (&b->look, b->turn, 0.0f);
+    }
+    b->input.orientation = b->look.rotation;
+}
+
+struct RunResult {
+    double full_bytes;           // mean whole encoding
+    double snapshot_bytes;       // mean sent
+    double encodings;
+    double server_ms, server_max_ms;
+    double client_ms;
+    unsigned int skipped;
+    unsigned int corrections;
+    float max_correction;
+    double interp_error, interp_max;
+    unsigned int held;
+    unsigned int over_mtu;
+    int mismatched;              // clients not where the server has them at rest
+    unsigned int snapshots;
+};
+
+/* the server's position for id at a fractional tick, from its history */
+static bool server_position_at (const NetServer& s, int id, double tick, vec3* out) {
+    uint32_t a = (uint32_t)floor (tick);
+    const NetSnapshot* sa = net_server_snapshot (s, a);
+    const NetSnapshot* sb = net_server_snapshot (s, a + 1);
+    const NetPlayer* pa = sa ? net_snapshot_find (*sa, (uint8_t)id) : NULL;
+    const NetPlayer* pb = sb ? net_snapshot_find (*sb, (uint8_t)id) : NULL;
+    if (!pa || !pb) {
+        return false;
+    }
+    float t = (float)(tick - a);
+    vec3 va = net_player_position (*pa), vb = net_player_position (*pb);
+    *out = va + (vb - va) * t;
+    return true;
+}
+
+static bool run (int count, const NetConditions& conditions, float seconds, uint32_t seed, RunResult* r) {
+    NetParams params = net_default_params ();
+    params.conditions = conditions;
+    NetServer server;
+    if (!net_server_init (&server, params, 0, seed)) {
+        return false;
+    }
+    std::vector<NetClient> clients (count);
+    std::vector<Bot> bots (count);
+    rng_state = seed;
+    for (int i = 0; i < count; i++) {
+        if (!net_client_init (&clients[i], params, server.socket.port, seed * 977u + (uint32_t)i)) {
+            return false;
+        }
+        camera_orientation_init (&bots[i].look, frand () * 360.0f, 0.0f);
+        bots[i].input.keys = 0;
+        bots[i].input.move_angle = 0;
+        bots[i].hold = 0;
+        bots[i].turn = 0.0f;
+    }
+
+    double tick_ms = 1000.0 / params.tick_rate;
+    int active = (int)(seconds * params.tick_rate);
+    int total = active + 2 * params.tick_rate;
+    double client_ms = 0.0, server_max = 0.0, interp_sum = 0.0, interp_max = 0.0;
+    unsigned long long interp_samples = 0, bytes = 0, full = 0, snapshots = 0, encodings = 0, snapshot_ticks = 0;
+    for (int t = 0; t < total; t++) {
+        double now = t * tick_ms;
+        for (int i = 0; i < count; i++) {
+            bot_think (&bots[i], t >= active);
+            net_client_update (&clients[i], bots[i].input, now);
+            client_ms += clients[i].stats.update_ms;
+        }
+        net_server_tick (&server, now);
+        server_max = server.stats.tick_ms > server_max ? server.stats.tick_ms : server_max;
+        if (server.stats.last_snapshots) {
+            bytes += server.stats.last_bytes;
+            full += server.stats.full_bytes;
+            snapshots += server.stats.last_snapshots;
+            encodings += server.stats.encodings;
+            snapshot_ticks++;
+        }
+        // a few remote players per client against the server's truth
+        for (int i = 0; i < count && t > params.tick_rate; i += 4) {
+            double render = net_client_render_tick (clients[i], now);
+            for (int k = 1; k <= 3; k++) {
+                int id = (clients[i].id + k * 7) % count;
+                vec3 seen, truth;
+                versor rotation;
+                if (net_client_remote (clients[i], id, &seen, &rotation) &&
+                    server_position_at (server, id, render, &truth)) {
+                    double e = length (seen - truth);
+                    interp_sum += e;
+                    interp_max = e > interp_max ? e : interp_max;
+                    interp_samples++;
+                }
+            }
+        }
+    }
+
+    r->full_bytes = snapshot_ticks ? (double)full / snapshot_ticks : 0.0;
+    r->snapshot_bytes = snapshots ? (double)bytes / snapshots : 0.0;
+    r->encodings = snapshot_ticks ? (double)encodings / snapshot_ticks : 0.0;
+    r->server_ms = server.stats.total_tick_ms / server.stats.ticks;
+    r->server_max_ms = server_max;
+    r->client_ms = client_ms / ((double)total * count);
+    r->skipped = server.stats.inputs_skipped;
+    r->over_mtu = server.stats.over_mtu;
+    r->snapshots = server.stats.snapshots;
+    r->corrections = 0;
+    r->max_correction = 0.0f;
+    r->held = 0;
+    r->mismatched = 0;
+    for (int i = 0; i < count; i++) {
+        const NetClient& c = clients[i];
+        r->corrections += c.stats.corrections;
+        r->max_correction = c.stats.max_correction > r->max_correction ? c.stats.max_correction : r->max_correction;
+        r->held += c.stats.held;
+        if (c.id < 0 || !net_player_equal (c.predicted, server.clients[c.id].player)) {
+            r->mismatched++;
+        }
+        net_client_destroy (&clients[i]);
+    }
+    r->interp_error = interp_samples ? interp_sum / interp_samples : 0.0;
+    r->interp_max = interp_max;
+    net_server_destroy (&server);
+    return true;
+}
+
+int main (int argc, char** argv) {
+    int count = argc > 1 ? atoi (argv[1]) : 64;
+    float loss = argc > 2 ? (float)atof (argv[2]) : 0.05f;
+    float latency = argc > 3 ? (float)atof (argv[3]) : 30.0f;
+    float seconds = argc > 4 ? (float)atof (argv[4]) : 10.0f;
+    uint32_t seed = argc > 5 ? (uint32_t)strtoul (argv[5], NULL, 10) : 1;
+
+    printf ("%d and %d clients, 60 Hz ticks, 30 Hz snapshots, %.0f s of bots then 2 s at rest\n", count, count * 2,
+            seconds);
+    printf ("clients  network         whole(B)  delta(B)  bases  server(ms) max(ms)  client(us)  lost in  "
+            "corrections (max)  interp err (max)  held  >MTU\n");
+    int failures = 0;
+    for (int size = 0; size < 2; size++) {
+        int n = count << size;
+        for (int lossy = 0; lossy < 2; lossy++) {
+            NetConditions conditions = {0.0f, 0.0f, 0.0f};
+            if (lossy) {
+                conditions.loss = loss;
+                conditions.latency_ms = latency;
+                conditions.jitter_ms = 5.0f;
+            }
+            RunResult r;
+            if (!run (n, conditions, seconds, seed, &r)) {
+                printf ("ERROR: could not open the sockets\n");
+                return 1;
+            }
+            char network[32];
+            snprintf (network, sizeof (network), lossy ? "%.0f%% %.0fms" : "clean", loss * 100.0f, latency);
+            printf ("%7d  %-13s  %9.0f  %8.0f  %5.1f  %10.3f %7.3f  %10.2f  %7u  %11u (%.3f)  %10.4f (%.3f)  %4u  %4u\n",
+                    n, network, r.full_bytes, r.snapshot_bytes, r.encodings, r.server_ms, r.server_max_ms,
+                    r.client_ms * 1000.0, r.skipped, r.corrections, r.max_correction, r.interp_error, r.interp_max,
+                    r.held, r.over_mtu);
+            if (!lossy && (r.corrections || r.skipped)) {
+                printf ("ERROR: %u corrections and %u lost inputs on a clean network\n", r.corrections, r.skipped);
+                failures++;
+            }
+            if (r.mismatched) {
+                printf ("ERROR: %d clients at rest away from the server's position\n", r.mismatched);
+                failures++;
+            }
+            if (r.snapshot_bytes >= r.full_bytes) {
+                printf ("ERROR: delta snapshots are no smaller than whole ones\n");
+                failures++;
+            }
+        }
+    }
+    return failures ? 1 : 0;
+}
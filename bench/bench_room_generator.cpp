@@ -0,0 +1,110 @@
+//
+// Procedural level generation: time and size at the default parameters and
+// at 4x the rooms, run on 1, 2, 4 and all hardware threads. Every run of the
+// same parameters must hash the same whatever the worker count.
+//
+// Also checked: every prop mesh is closed with outward faces (positive signed
+// volume), and every room can be reached from room 0 through the portals.
+//
+// usage: bench_room_generator [seed]
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+#include <vector>
+#include <utils/maths_funcs.h>
+#include <jobs/job_system.h>
+#include <scene/room_generator.h>
+#include "bench_common.h"
+
+static float signed_volume (const Mesh& m) {
+    float v = 0.0f;
+    for (size_t i = 0; i + 2 < m.indices.size (); i += 3) {
+        v += dot (m.positions[m.indices[i]], cross (m.positions[m.indices[i + 1]], m.positions[m.indices[i + 2]]));
+    }
+    return v / 6.0f;
+}
+
+static int check (const GeneratedLevel& level) {
+    int failures = 0;
+    for (unsigned int i = 0; i < level.library_meshes; i++) {
+        if (signed_volume (level.meshes[i]) <= 0.0f) {
+            printf ("ERROR: prop mesh %u is inside out\n", i);
+            failures++;
+        }
+    }
+    const PortalWorld& w = level.portals;
+    std::vector<unsigned char> seen (w.cells.size (), 0);
+    std::vector<int> stack (1, 0);
+    seen[0] = 1;
+    while (!stack.empty ()) {
+        int c = stack.back ();
+        stack.pop_back ();
+        for (size_t k = 0; k < w.cells[c].portals.size (); k++) {
+            const Portal& p = w.portals[w.cells[c].portals[k]];
+            int other = p.cells[0] == c ? p.cells[1] : p.cells[0];
+            if (!seen[other]) {
+                seen[other] = 1;
+                stack.push_back (other);
+            }
+        }
+    }
+    for (size_t c = 0; c < seen.size (); c++) {
+        failures += !seen[c];
+    }
+    return failures;
+}
+
+int main (int argc, char** argv) {
+    uint32_t seed = argc > 1 ? (uint32_t)strtoul (argv[1], NULL, 10) : 1u;
+    int hardware = (int)std::thread::hardware_concurrency ();
+    std::vector<int> workers;
+    for (int n = 1; n <= 4; n *= 2) {
+        workers.push_back (n);
+    }
+    if (hardware > 4) {
+        workers.push_back (hardware);
+    }
+
+    int failures = 0;
+    for (int size = 0; size < 2; size++) {
+        RoomGenParams p = room_gen_default_params (seed);
+        p.rooms_x *= size + 1;
+        p.rooms_z *= size + 1;
+        printf ("%d x %d rooms, %d props each, detail %d\n", p.rooms_x, p.rooms_z, p.props_per_room, p.detail);
+        printf ("workers   generate(ms)   flatten(ms)   unique tris   scene tris   Mtris/s   hash\n");
+        uint64_t first_hash = 0;
+        for (size_t wi = 0; wi < workers.size (); wi++) {
+            job_system_init (workers[wi]);
+            GeneratedLevel level;
+            room_generate (p, &level);
+            Mesh flat;
+            double flatten_ms = bench_best_ms (1, [&] { room_generator_flatten (level, &flat); });
+            job_system_shutdown ();
+
+            uint64_t hash = room_generator_hash (level);
+            if (wi == 0) {
+                first_hash = hash;
+                failures += check (level);
+                if (mesh_triangle_count (flat) != level.stats.scene_triangles) {
+                    printf ("ERROR: flattened %u triangles, expected %llu\n", mesh_triangle_count (flat),
+                            (unsigned long long)level.stats.scene_triangles);
+                    failures++;
+                }
+            } else if (hash != first_hash) {
+                printf ("ERROR: %d workers generated a different level\n", workers[wi]);
+                failures++;
+            }
+            printf ("%7d   %12.1f   %11.1f   %11llu   %10llu   %7.1f   %016llx\n", workers[wi], level.stats.ms,
+                    flatten_ms, (unsigned long long)level.stats.unique_triangles,
+                    (unsigned long long)level.stats.scene_triangles,
+                    (double)level.stats.unique_triangles / (level.stats.ms * 1e3), (unsigned long long)hash);
+        }
+    }
+    if (failures) {
+        printf ("ERROR: %d level checks failed\n", failures);
+        return 1;
+    }
+    return 0;
+}
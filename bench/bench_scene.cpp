@@ -0,0 +1,171 @@
+//
+// Transform propagation in the scene store on a 100k+ entity hierarchy
+// (1000 roots, 10 children each, 9 grandchildren under every child):
+// everything moving, 1% of the roots moving, 1% of the leaves moving and
+// the cost of a re-sort after a reparent. For reference it also runs the
+// recursive update an array of structs with child pointers would do.
+//
+// usage: bench_scene [workers]   (default: one per hardware thread)
+//
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <utils/maths_funcs.h>
+#include <jobs/job_system.h>
+#include <scene/scene_store.h>
+#include "bench_common.h"
+
+static const int REPS = 7;
+static const int ROOTS = 1000;
+static const int CHILDREN = 10;
+static const int GRANDCHILDREN = 9;
+
+/* the one-struct-per-object layout the store replaces */
+struct Node {
+    vec3 position;
+    versor orientation;
+    vec3 scale;
+    Aabb bounds;
+    mat4 world;
+    Aabb world_bounds;
+    std::vector<Node*> children;
+};
+
+static void node_update (Node* n, const mat4& parent_world) {
+    n->world = parent_world * scene_local_matrix (n->position, n->orientation, n->scale);
+    n->world_bounds = aabb_transform (n->bounds, n->world);
+    for (size_t i = 0; i < n->children.size (); i++) {
+        node_update (n->children[i], n->world);
+    }
+}
+
+int main (int argc, char** argv) {
+    job_system_init (argc > 1 ? atoi (argv[1]) : 0);
+
+    Aabb unit;
+    unit.min = vec3 (-0.5f, -0.5f, -0.5f);
+    unit.max = vec3 (0.5f, 0.5f, 0.5f);
+    versor spin = quat_from_axis_deg (10.0f, 0.0f, 1.0f, 0.0f);
+    vec3 one (1.0f, 1.0f, 1.0f);
+
+    SceneStore s;
+    scene_init (&s);
+    std::vector<Node> nodes;
+    nodes.reserve (ROOTS * (1 + CHILDREN * (1 + GRANDCHILDREN)));
+    std::vector<Node*> node_roots;
+    std::vector<Entity> roots, leaves;
+    for (int r = 0; r < ROOTS; r++) {
+        vec3 p ((float)(r % 40) * 5.0f, 0.0f, (float)(r / 40) * 5.0f);
+        Entity root = scene_create (&s, ENTITY_NONE, p, spin, one, unit);
+        roots.push_back (root);
+        nodes.push_back (Node ());
+        Node* nroot = &nodes.back ();
+        nroot->position = p;
+        nroot->orientation = spin;
+        nroot->scale = one;
+        nroot->bounds = unit;
+        node_roots.push_back (nroot);
+        for (int c = 0; c < CHILDREN; c++) {
+            vec3 cp ((float)c * 0.3f, 1.0f, 0.0f);
+            Entity child = scene_create (&s, root, cp, spin, vec3 (0.5f, 0.5f, 0.5f), unit);
+            nodes.push_back (Node ());
+            Node* nchild = &nodes.back ();
+            nchild->position = cp;
+            nchild->orientation = spin;
+            nchild->scale = vec3 (0.5f, 0.5f, 0.5f);
+            nchild->bounds = unit;
+            nroot->children.push_back (nchild);
+            for (int g = 0; g < GRANDCHILDREN; g++) {
+                vec3 gp (0.0f, (float)g * 0.2f, 0.5f);
+                leaves.push_back (scene_create (&s, child, gp, spin, one, unit));
+                nodes.push_back (Node ());
+                Node* ng = &nodes.back ();
+                ng->position = gp;
+                ng->orientation = spin;
+                ng->scale = one;
+                ng->bounds = unit;
+                nchild->children.push_back (ng);
+            }
+        }
+    }
+    double first_ms = bench_best_ms (1, [&] { scene_update (&s); });
+    printf ("%u entities, %u levels, %d workers, first update (with sort) %.3f ms\n", s.stats.entities,
+            s.stats.levels, job_system_worker_count (), first_ms);
+
+    // everything moving: every root dirty drags the whole tree along
+    float t = 0.0f;
+    double all_ms = bench_best_ms (REPS, [&] {
+        t += 0.01f;
+        for (size_t i = 0; i < roots.size (); i++) {
+            scene_set_orientation (&s, roots[i], quat_from_axis_rad (t, 0.0f, 1.0f, 0.0f));
+        }
+        scene_update (&s);
+    });
+    unsigned int all_updated = s.stats.updated;
+    double aos_ms = bench_best_ms (REPS, [&] {
+        for (size_t i = 0; i < node_roots.size (); i++) {
+            node_roots[i]->orientation = quat_from_axis_rad (t, 0.0f, 1.0f, 0.0f);
+            node_update (node_roots[i], identity_mat4 ());
+        }
+    });
+
+    // check the two layouts agree
+    float max_err = 0.0f;
+    for (size_t i = 0; i < roots.size (); i++) {
+        const mat4& a = scene_world (s, roots[i]);
+        const mat4& b = node_roots[i]->world;
+        for (int k = 0; k < 16; k++) {
+            max_err = fmaxf (max_err, fabsf (a.m[k] - b.m[k]));
+        }
+    }
+    for (size_t i = 0; i < leaves.size (); i += 97) {
+        size_t r = i / (CHILDREN * GRANDCHILDREN), c = (i / GRANDCHILDREN) % CHILDREN, g = i % GRANDCHILDREN;
+        const mat4& a = scene_world (s, leaves[i]);
+        const mat4& b = node_roots[r]->children[c]->children[g]->world;
+        for (int k = 0; k < 16; k++) {
+            max_err = fmaxf (max_err, fabsf (a.m[k] - b.m[k]));
+        }
+    }
+
+    // 1% of the roots (and so 1% of everything) moving
+    double some_roots_ms = bench_best_ms (REPS, [&] {
+        t += 0.01f;
+        for (size_t i = 0; i < roots.size (); i += 100) {
+            scene_set_position (&s, roots[i], vec3 (t, 0.0f, (float)i));
+        }
+        scene_update (&s);
+    });
+    unsigned int some_roots_updated = s.stats.updated;
+
+    // 1% of the leaves moving
+    double some_leaves_ms = bench_best_ms (REPS, [&] {
+        t += 0.01f;
+        for (size_t i = 0; i < leaves.size (); i += 100) {
+            scene_set_position (&s, leaves[i], vec3 (0.0f, t, 0.5f));
+        }
+        scene_update (&s);
+    });
+    unsigned int some_leaves_updated = s.stats.updated;
+
+    double idle_ms = bench_best_ms (REPS, [&] { scene_update (&s); });
+
+    // one reparent forces a full re-sort on the next update
+    int flip = 0;
+    double reparent_ms = bench_best_ms (REPS, [&] {
+        scene_set_parent (&s, leaves[0], roots[1 + (flip++ & 1)]);
+        scene_update (&s);
+    });
+
+    printf ("all moving:       %8.3f ms  %6u updated  %6.1f ns/entity\n", all_ms, all_updated,
+            all_ms * 1e6 / all_updated);
+    printf ("  array of structs with child pointers: %8.3f ms  (x%.2f)\n", aos_ms, aos_ms / all_ms);
+    printf ("  max difference %g\n", (double)max_err);
+    printf ("1%% of roots:      %8.3f ms  %6u updated\n", some_roots_ms, some_roots_updated);
+    printf ("1%% of leaves:     %8.3f ms  %6u updated\n", some_leaves_ms, some_leaves_updated);
+    printf ("nothing moving:   %8.3f ms\n", idle_ms);
+    printf ("reparent + sort:  %8.3f ms  (%u sorts)\n", reparent_ms, s.stats.reorders);
+    job_system_shutdown ();
+    return max_err < 1e-3f ? 0 : 1;
+}
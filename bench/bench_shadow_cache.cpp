@@ -0,0 +1,150 @@
+//
+// Shadow cache planning over 120 frames of a hall with 48 point lights and
+// 16 spot lights in a 4096 atlas. One light moves for frames 30-59, eight
+// dynamic boxes walk through the hall from frame 60 on, and a static door
+// changes at frame 90. Prints the views redrawn per frame around each event.
+//
+// Checks along the way: no two tiles overlap and all stay inside the atlas,
+// a still frame redraws nothing, and removing every light frees the whole
+// atlas again.
+//
+// usage: bench_shadow_cache
+//
+
+#include <math.h>
+#include <stdio.h>
+#include <vector>
+#include <utils/maths_funcs.h>
+#include <render/shadow_cache.h>
+#include "bench_common.h"
+
+static const int FRAMES = 120;
+
+static unsigned int rng_state = 12345u;
+
+static float frand (float lo, float hi) {
+    rng_state = rng_state * 1664525u + 1013904223u;
+    return lo + (hi - lo) * (float)(rng_state >> 8) / 16777216.0f;
+}
+
+static int check_tiles (const ShadowCache& cache) {
+    int failures = 0;
+    const std::vector<ShadowView>& v = cache.views;
+    for (size_t i = 0; i < v.size (); i++) {
+        if (v[i].size == 0) {
+            continue;
+        }
+        failures += v[i].x < 0 || v[i].y < 0 || v[i].x + v[i].size > cache.atlas.size ||
+                    v[i].y + v[i].size > cache.atlas.size;
+        for (size_t j = i + 1; j < v.size (); j++) {
+            if (v[j].size > 0 && v[i].x < v[j].x + v[j].size && v[j].x < v[i].x + v[i].size &&
+                v[i].y < v[j].y + v[j].size && v[j].y < v[i].y + v[i].size) {
+                failures++;
+            }
+        }
+    }
+    return failures;
+}
+
+static void print_frame (int frame, const ShadowCacheStats& st) {
+    printf ("%5d   %5u   %6u   %7u   %6u   %6u   %9.3f\n", frame, st.views, st.static_rendered, st.dynamic_rendered,
+            st.copies, st.cached, st.ms);
+}
+
+int main () {
+    std::vector<ShadowLight> lights (64);
+    for (size_t i = 0; i < lights.size (); i++) {
+        ShadowLight& l = lights[i];
+        l.position = vec3 (frand (-50.0f, 50.0f), frand (2.0f, 8.0f), frand (-50.0f, 50.0f));
+        l.radius = frand (6.0f, 12.0f);
+        if (i < 48) {
+            l.type = SHADOW_POINT;
+            l.resolution = i < 8 ? 512 : 256;
+            l.direction = vec3 (0.0f, -1.0f, 0.0f);
+            l.angle_deg = 0.0f;
+        } else {
+            l.type = SHADOW_SPOT;
+            l.resolution = 512;
+            l.direction = vec3 (frand (-0.5f, 0.5f), -1.0f, frand (-0.5f, 0.5f));
+            l.angle_deg = frand (30.0f, 70.0f);
+        }
+    }
+    int count = (int)lights.size ();
+
+    ShadowCache cache;
+    shadow_cache_init (&cache, 4096);
+    std::vector<Aabb> boxes (8);
+    int failures = 0;
+    unsigned int total_static = 0, total_dynamic = 0, total_views = 0;
+    double total_ms = 0.0;
+
+    printf ("%d lights, %d x %d atlas\n", count, cache.atlas.size, cache.atlas.size);
+    printf ("frame   views   static   dynamic   copies   cached   plan(ms)\n");
+    for (int frame = 0; frame < FRAMES; frame++) {
+        if (frame >= 30 && frame < 60) {
+            lights[0].position.v[0] += 0.1f;
+        }
+        int box_count = 0;
+        if (frame >= 60) {
+            box_count = (int)boxes.size ();
+            for (int b = 0; b < box_count; b++) {
+                float x = -50.0f + (float)((frame - 60) * 2 + b * 12 % 100);
+                vec3 c (x, 1.0f, -40.0f + b * 10.0f);
+                boxes[b].min = c - vec3 (0.5f, 1.0f, 0.5f);
+                boxes[b].max = c + vec3 (0.5f, 1.0f, 0.5f);
+            }
+        }
+        if (frame == 90) {
+            Aabb door = {vec3 (-2.0f, 0.0f, -0.2f), vec3 (2.0f, 3.0f, 0.2f)};
+            shadow_cache_invalidate_static (&cache, door);
+        }
+        shadow_cache_update (&cache, &lights[0], count, box_count ? &boxes[0] : NULL, box_count);
+        const ShadowCacheStats& st = cache.stats;
+        if (frame == 0) {
+            failures += check_tiles (cache);
+            printf ("(%u texels allocated, %u lights downsized)\n", st.atlas_used, st.downsized);
+        }
+        if (frame > 0 && frame < 30 && cache.passes.size () != 0) {
+            printf ("ERROR: still frame %d redrew %u views\n", frame, (unsigned int)cache.passes.size ());
+            failures++;
+        }
+        if (frame <= 2 || (frame >= 29 && frame <= 31) || (frame >= 59 && frame <= 61) || (frame >= 89 && frame <= 91)) {
+            print_frame (frame, st);
+        }
+        if (frame > 0) {
+            total_static += st.static_rendered;
+            total_dynamic += st.dynamic_rendered;
+            total_views += st.views;
+            total_ms += st.ms;
+        }
+    }
+    failures += check_tiles (cache);
+    printf ("frames 1-%d: %.2f static + %.2f dynamic redraws per frame out of %u views, plan %.3f ms\n", FRAMES - 1,
+            (double)total_static / (FRAMES - 1), (double)total_dynamic / (FRAMES - 1), total_views / (FRAMES - 1),
+            total_ms / (FRAMES - 1));
+
+    // more than fits at full size: lights should shrink, not go without
+    std::vector<ShadowLight> crowd (64, lights[0]);
+    for (size_t i = 0; i < crowd.size (); i++) {
+        crowd[i].resolution = 1024;
+        crowd[i].position.v[0] = (float)i;
+    }
+    shadow_cache_update (&cache, &crowd[0], (int)crowd.size (), NULL, 0);
+    failures += check_tiles (cache);
+    printf ("64 point lights at 1024: %u views, %u lights downsized\n", cache.stats.views, cache.stats.downsized);
+    if (cache.stats.views != 64 * 6) {
+        printf ("ERROR: some lights got no tiles\n");
+        failures++;
+    }
+
+    shadow_cache_update (&cache, NULL, 0, NULL, 0);
+    for (size_t i = 0; i < cache.atlas.state.size (); i++) {
+        failures += cache.atlas.state[i] != 0; // 0 is free
+    }
+
+    if (failures) {
+        printf ("ERROR: %d shadow cache checks failed\n", failures);
+        return 1;
+    }
+    return 0;
+}
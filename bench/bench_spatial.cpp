@@ -0,0 +1,190 @@
+//
+// Spatial hash queries against a brute-force scan over every object at 1k,
+// 10k and 100k objects scattered through a 200 x 20 x 200 level. Each size
+// runs the same random radius, box and 8-nearest queries both ways and checks
+// that the answers agree, then times a tick where every object moves a bit.
+//
+// usage: bench_spatial [queries]
+//
+
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <utils/maths_funcs.h>
+#include <jobs/job_system.h>
+#include <scene/spatial_hash.h>
+#include "bench_common.h"
+
+static const int REPS = 5;
+static const float CELL_SIZE = 4.0f;
+static const float QUERY_RADIUS = 6.0f;
+static const int NEAREST_K = 8;
+
+static unsigned int rng_state = 12345u;
+
+static float frand (float lo, float hi) {
+    rng_state = rng_state * 1664525u + 1013904223u;
+    return lo + (hi - lo) * (float)(rng_state >> 8) / 16777216.0f;
+}
+
+static Aabb random_box () {
+    vec3 c (frand (-100.0f, 100.0f), frand (0.0f, 20.0f), frand (-100.0f, 100.0f));
+    vec3 e (frand (0.1f, 1.5f), frand (0.1f, 1.5f), frand (0.1f, 1.5f));
+    Aabb b;
+    b.min = c - e;
+    b.max = c + e;
+    return b;
+}
+
+static int brute_radius (const std::vector<Aabb>& boxes, const vec3& c, float r, std::vector<unsigned int>* out) {
+    out->clear ();
+    for (size_t i = 0; i < boxes.size (); i++) {
+        float d2 = 0.0f;
+        for (int a = 0; a < 3; a++) {
+            float d = fmaxf (fmaxf (boxes[i].min.v[a] - c.v[a], c.v[a] - boxes[i].max.v[a]), 0.0f);
+            d2 += d * d;
+        }
+        if (d2 <= r * r) {
+            out->push_back ((unsigned int)i);
+        }
+    }
+    return (int)out->size ();
+}
+
+static int brute_aabb (const std::vector<Aabb>& boxes, const Aabb& q, std::vector<unsigned int>* out) {
+    out->clear ();
+    for (size_t i = 0; i < boxes.size (); i++) {
+        if (aabb_overlap (boxes[i], q)) {
+            out->push_back ((unsigned int)i);
+        }
+    }
+    return (int)out->size ();
+}
+
+static int brute_nearest (const std::vector<Aabb>& boxes, const vec3& c, int k, std::vector<float>* dist) {
+    std::vector<float> d2 (boxes.size ());
+    for (size_t i = 0; i < boxes.size (); i++) {
+        d2[i] = get_squared_dist (aabb_center (boxes[i]), c);
+    }
+    k = std::min (k, (int)d2.size ());
+    std::partial_sort (d2.begin (), d2.begin () + k, d2.end ());
+    dist->clear ();
+    for (int i = 0; i < k; i++) {
+        dist->push_back (sqrtf (d2[i]));
+    }
+    return k;
+}
+
+int main (int argc, char** argv) {
+    int queries = argc > 1 ? atoi (argv[1]) : 1000;
+    job_system_init (0);
+    const int sizes[3] = {1000, 10000, 100000};
+    std::vector<vec3> centers;
+    std::vector<Aabb> query_boxes;
+    for (int i = 0; i < queries; i++) {
+        centers.push_back (vec3 (frand (-100.0f, 100.0f), frand (0.0f, 20.0f), frand (-100.0f, 100.0f)));
+        Aabb q;
+        q.min = centers.back () - vec3 (3.0f, 3.0f, 3.0f);
+        q.max = centers.back () + vec3 (3.0f, 3.0f, 3.0f);
+        query_boxes.push_back (q);
+    }
+    printf ("%d queries per test, cell %.1f, radius %.1f, k %d\n", queries, CELL_SIZE, QUERY_RADIUS, NEAREST_K);
+    printf ("objects  query      grid(us)   brute(us)   speed-up   hits/query\n");
+    int failures = 0;
+    for (int si = 0; si < 3; si++) {
+        int n = sizes[si];
+        std::vector<Aabb> boxes;
+        for (int i = 0; i < n; i++) {
+            boxes.push_back (random_box ());
+        }
+        SpatialHash h;
+        spatial_hash_init (&h, CELL_SIZE);
+        double build_ms = bench_best_ms (REPS, [&] { spatial_hash_build (&h, &boxes[0], n); });
+
+        std::vector<unsigned int> a, b;
+        std::vector<float> da, db;
+        long long hits = 0;
+        // answers must match before the timings mean anything
+        for (int q = 0; q < queries; q++) {
+            spatial_hash_query_radius (h, centers[q], QUERY_RADIUS, &a);
+            brute_radius (boxes, centers[q], QUERY_RADIUS, &b);
+            std::sort (a.begin (), a.end ());
+            failures += a != b;
+            spatial_hash_query_aabb (h, query_boxes[q], &a);
+            brute_aabb (boxes, query_boxes[q], &b);
+            std::sort (a.begin (), a.end ());
+            failures += a != b;
+            spatial_hash_query_nearest (h, centers[q], NEAREST_K, &a, &da);
+            brute_nearest (boxes, centers[q], NEAREST_K, &db);
+            for (size_t i = 0; i < da.size () && i < db.size (); i++) {
+                failures += fabsf (da[i] - db[i]) > 1e-4f;
+            }
+            failures += da.size () != db.size ();
+        }
+
+        double grid_ms = bench_best_ms (REPS, [&] {
+            hits = 0;
+            for (int q = 0; q < queries; q++) {
+                hits += spatial_hash_query_radius (h, centers[q], QUERY_RADIUS, &a);
+            }
+        });
+        double brute_ms = bench_best_ms (REPS, [&] {
+            for (int q = 0; q < queries; q++) {
+                brute_radius (boxes, centers[q], QUERY_RADIUS, &b);
+            }
+        });
+        printf ("%7d  radius    %9.3f  %10.3f   x%7.1f   %9.1f\n", n, grid_ms * 1e3 / queries,
+                brute_ms * 1e3 / queries, brute_ms / grid_ms, (double)hits / queries);
+
+        grid_ms = bench_best_ms (REPS, [&] {
+            hits = 0;
+            for (int q = 0; q < queries; q++) {
+                hits += spatial_hash_query_aabb (h, query_boxes[q], &a);
+            }
+        });
+        brute_ms = bench_best_ms (REPS, [&] {
+            for (int q = 0; q < queries; q++) {
+                brute_aabb (boxes, query_boxes[q], &b);
+            }
+        });
+        printf ("%7d  aabb      %9.3f  %10.3f   x%7.1f   %9.1f\n", n, grid_ms * 1e3 / queries,
+                brute_ms * 1e3 / queries, brute_ms / grid_ms, (double)hits / queries);
+
+        grid_ms = bench_best_ms (REPS, [&] {
+            for (int q = 0; q < queries; q++) {
+                spatial_hash_query_nearest (h, centers[q], NEAREST_K, &a, &da);
+            }
+        });
+        brute_ms = bench_best_ms (REPS, [&] {
+            for (int q = 0; q < queries; q++) {
+                brute_nearest (boxes, centers[q], NEAREST_K, &db);
+            }
+        });
+        printf ("%7d  nearest   %9.3f  %10.3f   x%7.1f   %9d\n", n, grid_ms * 1e3 / queries,
+                brute_ms * 1e3 / queries, brute_ms / grid_ms, NEAREST_K);
+
+        // one tick: everything drifts a little, some objects cross cells
+        std::vector<Aabb> moved (boxes);
+        float step = 0.0f;
+        double update_ms = bench_best_ms (REPS, [&] {
+            step += 0.05f;
+            for (int i = 0; i < n; i++) {
+                vec3 d (step * ((i & 1) ? 1.0f : -1.0f), 0.0f, 0.0f);
+                moved[i].min = boxes[i].min + d;
+                moved[i].max = boxes[i].max + d;
+            }
+            spatial_hash_update (&h, &moved[0], n);
+        });
+        unsigned int crossed = h.stats.moved;
+        double still_ms = bench_best_ms (REPS, [&] { spatial_hash_update (&h, &moved[0], n); });
+        printf ("%7d  build %.3f ms, tick %.3f ms (%u changed cell), tick with no cell changes %.3f ms, "
+                "%u cells\n", n, build_ms, update_ms, crossed, still_ms, h.stats.cells);
+    }
+    job_system_shutdown ();
+    if (failures) {
+        printf ("ERROR: %d queries disagree with the brute-force scan\n", failures);
+        return 1;
+    }
+    return 0;
+}
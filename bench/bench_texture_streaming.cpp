@@ -0,0 +1,191 @@
+//
+// Texture streaming under a budget, against loading everything up front.
+//
+// Writes `textures` BC1 test textures to a temporary directory and lines
+// them up along both walls of a corridor, one 4 unit panel each. The camera
+// flies down the corridor and back, then stops. Each frame every panel in
+// front of the camera asks for the level texture_mip_for_distance gives it.
+//
+// Reported: startup time and memory for everything up front and for the
+// streamer's mip tails, then for the flight the peak resident memory
+// against the budget, loads, evictions, bandwidth, and how many panels were
+// short of their level on an average frame.
+//
+// Checks: resident plus in flight never goes over the budget, every change
+// moves a texture's top by one level, and once the camera has stopped every
+// panel ends up with its level, if the budget holds all of them.
+//
+// usage: bench_texture_streaming [textures] [size] [budget_mb] [threads]
+//
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include <textures/texture_streamer.h>
+#include "bench_common.h"
+
+static unsigned int rng_state;
+
+static unsigned int urand () {
+    rng_state = rng_state * 1664525u + 1013904223u;
+    return rng_state >> 8;
+}
+
+/* value noise in a checker, different for every seed */
+static void make_texture (int size, unsigned int seed, std::vector<unsigned char>* rgba) {
+    rng_state = seed;
+    unsigned char tint[3] = {(unsigned char)(urand () & 255), (unsigned char)(urand () & 255),
+                             (unsigned char)(urand () & 255)};
+    int check = size / (4 << (seed % 3));
+    rgba->resize ((size_t)size * size * 4);
+    for (int y = 0; y < size; y++) {
+        for (int x = 0; x < size; x++) {
+            unsigned char* p = &(*rgba)[((size_t)y * size + x) * 4];
+            int base = (((x / check) ^ (y / check)) & 1) ? 160 : 80;
+            int n = (int)(urand () & 31) - 16;
+            for (int c = 0; c < 3; c++) {
+                int v = (base + n) * tint[c] / 255 + 32;
+                p[c] = (unsigned char)(v > 255 ? 255 : v);
+            }
+            p[3] = 255;
+        }
+    }
+}
+
+int main (int argc, char** argv) {
+    int count = argc > 1 ? atoi (argv[1]) : 48;
+    int size = argc > 2 ? atoi (argv[2]) : 1024;
+    size_t budget = (size_t)((argc > 3 ? atof (argv[3]) : 12.0) * 1024.0 * 1024.0);
+    int threads = argc > 4 ? atoi (argv[4]) : 2;
+
+    char dir[] = "/tmp/bench_textures_XXXXXX";
+    if (!mkdtemp (dir)) {
+        printf ("ERROR: could not make a temporary directory\n");
+        return 1;
+    }
+    std::vector<std::string> paths;
+    std::vector<unsigned char> rgba;
+    std::vector<TextureLevelData> levels;
+    double encode_ms = 0.0;
+    for (int i = 0; i < count; i++) {
+        char path[256];
+        snprintf (path, sizeof (path), "%s/texture_%03d.rtex", dir, i);
+        paths.push_back (path);
+        make_texture (size, (unsigned int)i + 1, &rgba);
+        double t0 = bench_now_ms ();
+        texture_encode_bc1 (rgba.data (), size, size, &levels);
+        encode_ms += bench_now_ms () - t0;
+        texture_file_write (path, TEXTURE_BC1, size, size, levels);
+    }
+    printf ("%d textures of %dx%d BC1, encoded in %.1f ms, budget %.1f MB, %d reader threads\n", count, size, size,
+            encode_ms, budget / (1024.0 * 1024.0), threads);
+
+    // everything up front: every level of every texture read in
+    size_t all_bytes = 0;
+    double upfront_ms = bench_best_ms (1, [&] {
+        std::vector<unsigned char> copy;
+        for (int i = 0; i < count; i++) {
+            TextureFile f;
+            texture_file_open (paths[i].c_str (), &f);
+            for (uint32_t l = 0; l < f.header->levels; l++) {
+                const unsigned char* src = texture_file_level (f, l);
+                copy.assign (src, src + f.levels[l].bytes);
+                all_bytes += copy.size ();
+            }
+            texture_file_close (&f);
+        }
+    });
+
+    TextureStreamer s;
+    texture_streamer_init (&s, budget, threads, 0);
+    double startup_ms = bench_best_ms (1, [&] {
+        for (int i = 0; i < count; i++) {
+            texture_streamer_add (&s, paths[i].c_str ());
+        }
+    });
+    printf ("up front:  %8.1f ms, %8.2f MB resident\n", upfront_ms, all_bytes / (1024.0 * 1024.0));
+    printf ("streamed:  %8.1f ms, %8.2f MB resident (mip tails)\n", startup_ms,
+            s.stats.resident_bytes / (1024.0 * 1024.0));
+
+    // panels 4 units wide down both walls, 3 units either side of the path
+    const float spacing = 4.0f, panel = 4.0f;
+    const float focal_px = 540.0f / tanf (33.5f * 3.14159265f / 180.0f);
+    float length = spacing * (float)((count + 1) / 2);
+    const int fly_frames = 600, hold_frames = 300;
+    std::vector<int> tops (count);
+    for (int i = 0; i < count; i++) {
+        tops[i] = s.textures[i].top;
+    }
+
+    int failures = 0;
+    size_t peak = 0;
+    double short_sum = 0.0;
+    double t0 = bench_now_ms ();
+    for (int frame = 0; frame < fly_frames + hold_frames; frame++) {
+        // down the corridor, back, then stand in the middle looking down it
+        float t = frame < fly_frames ? (float)frame / (fly_frames / 2) : 1.5f;
+        float z = t < 1.0f ? t * length : t < 2.0f ? (2.0f - t) * length : 0.5f * length;
+        float dir = frame < fly_frames / 2 || frame >= fly_frames ? 1.0f : -1.0f;
+        for (int i = 0; i < count; i++) {
+            float pz = spacing * (float)(i / 2) + spacing * 0.5f;
+            float ahead = (pz - z) * dir;
+            if (ahead < -panel) {
+                continue;
+            }
+            float dist = sqrtf (ahead * ahead + 9.0f);
+            texture_streamer_request (&s, i, texture_mip_for_distance (size, panel, dist, focal_px));
+        }
+        texture_streamer_update (&s);
+
+        for (size_t c = 0; c < s.changes.size (); c++) {
+            const TextureChange& ch = s.changes[c];
+            if (ch.top != tops[ch.texture] + (ch.level >= 0 ? -1 : 1) && ch.top != tops[ch.texture]) {
+                printf ("ERROR: texture %d jumped from level %d to %d\n", ch.texture, tops[ch.texture], ch.top);
+                failures++;
+            }
+            tops[ch.texture] = ch.top;
+        }
+        size_t used = s.stats.resident_bytes + s.stats.in_flight_bytes;
+        peak = used > peak ? used : peak;
+        if (used > budget) {
+            printf ("ERROR: frame %d holds %zu bytes, over the budget\n", frame, used);
+            failures++;
+        }
+        if (frame < fly_frames) {
+            short_sum += s.stats.short_textures;
+        }
+        // a frame's worth of time for the readers
+        std::this_thread::sleep_for (std::chrono::milliseconds (2));
+    }
+    double wall_ms = bench_now_ms () - t0;
+    printf ("flight:    %d frames, peak %.2f MB of %.2f MB, %u loads, %u evictions, %.1f MB streamed, %.1f MB/s\n",
+            fly_frames + hold_frames, peak / (1024.0 * 1024.0), budget / (1024.0 * 1024.0), s.stats.loads,
+            s.stats.evictions, s.stats.streamed_bytes / (1024.0 * 1024.0),
+            s.stats.streamed_bytes / (wall_ms * 1000.0));
+    printf ("           %.1f panels short of their level on an average moving frame, %u at rest\n",
+            short_sum / fly_frames, s.stats.short_textures);
+    // at rest the requests only go unmet if they can't all fit
+    size_t demand = 0;
+    for (int i = 0; i < count; i++) {
+        const StreamedTexture& t = s.textures[i];
+        for (uint32_t l = (uint32_t)t.wanted; l < t.file.header->levels; l++) {
+            demand += (size_t)t.file.levels[l].bytes;
+        }
+    }
+    if (s.stats.short_textures && demand <= budget) {
+        printf ("ERROR: %u textures never reached their level\n", s.stats.short_textures);
+        failures++;
+    }
+
+    texture_streamer_destroy (&s);
+    for (size_t i = 0; i < paths.size (); i++) {
+        unlink (paths[i].c_str ());
+    }
+    rmdir (dir);
+    return failures ? 1 : 0;
+}
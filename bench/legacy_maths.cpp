@@ -0,0 +1,165 @@
+//
+// See legacy_maths.h. Bodies are copied from the old maths_funcs.cpp and
+// quat_funcs.cpp.
+//
+
+#include "legacy_maths.h"
+#include <math.h>
+
+#define LEGACY_ONE_DEG_IN_RAD (2.0 * M_PI) / 360.0
+
+legacy_vec3::legacy_vec3 () {}
+
+legacy_vec3::legacy_vec3 (float x, float y, float z) {
+    v[0] = x;
+    v[1] = y;
+    v[2] = z;
+}
+
+legacy_vec3 legacy_vec3::operator+ (const legacy_vec3& rhs) {
+    legacy_vec3 vc;
+    vc.v[0] = v[0] + rhs.v[0];
+    vc.v[1] = v[1] + rhs.v[1];
+    vc.v[2] = v[2] + rhs.v[2];
+    return vc;
+}
+
+legacy_vec3 legacy_vec3::operator* (float rhs) {
+    legacy_vec3 vc;
+    vc.v[0] = v[0] * rhs;
+    vc.v[1] = v[1] * rhs;
+    vc.v[2] = v[2] * rhs;
+    return vc;
+}
+
+legacy_vec4::legacy_vec4 () {}
+
+legacy_vec4::legacy_vec4 (float x, float y, float z, float w) {
+    v[0] = x;
+    v[1] = y;
+    v[2] = z;
+    v[3] = w;
+}
+
+legacy_mat4::legacy_mat4 () {}
+
+legacy_mat4::legacy_mat4 (float a, float b, float c, float d,
+                          float e, float f, float g, float h,
+                          float i, float j, float k, float l,
+                          float mm, float n, float o, float p) {
+    m[0] = a;
+    m[1] = b;
+    m[2] = c;
+    m[3] = d;
+    m[4] = e;
+    m[5] = f;
+    m[6] = g;
+    m[7] = h;
+    m[8] = i;
+    m[9] = j;
+    m[10] = k;
+    m[11] = l;
+    m[12] = mm;
+    m[13] = n;
+    m[14] = o;
+    m[15] = p;
+}
+
+legacy_vec4 legacy_mat4::operator* (const legacy_vec4& rhs) {
+    float x = m[0] * rhs.v[0] + m[4] * rhs.v[1] + m[8] * rhs.v[2] + m[12] * rhs.v[3];
+    float y = m[1] * rhs.v[0] + m[5] * rhs.v[1] + m[9] * rhs.v[2] + m[13] * rhs.v[3];
+    float z = m[2] * rhs.v[0] + m[6] * rhs.v[1] + m[10] * rhs.v[2] + m[14] * rhs.v[3];
+    float w = m[3] * rhs.v[0] + m[7] * rhs.v[1] + m[11] * rhs.v[2] + m[15] * rhs.v[3];
+    return legacy_vec4 (x, y, z, w);
+}
+
+legacy_mat4 legacy_mat4::operator* (const legacy_mat4& rhs) {
+    legacy_mat4 r = legacy_zero_mat4 ();
+    int r_index = 0;
+    for (int col = 0; col < 4; col++) {
+        for (int row = 0; row < 4; row++) {
+            float sum = 0.0f;
+            for (int i = 0; i < 4; i++) {
+                sum += rhs.m[i + col * 4] * m[row + i * 4];
+            }
+            r.m[r_index] = sum;
+            r_index++;
+        }
+    }
+    return r;
+}
+
+legacy_mat4& legacy_mat4::operator= (const legacy_mat4& rhs) {
+    for (int i = 0; i < 16; i++) {
+        m[i] = rhs.m[i];
+    }
+    return *this;
+}
+
+float legacy_dot (const legacy_vec3& a, const legacy_vec3& b) {
+    return a.v[0] * b.v[0] + a.v[1] * b.v[1] + a.v[2] * b.v[2];
+}
+
+legacy_vec3 legacy_cross (const legacy_vec3& a, const legacy_vec3& b) {
+    float x = a.v[1] * b.v[2] - a.v[2] * b.v[1];
+    float y = a.v[2] * b.v[0] - a.v[0] * b.v[2];
+    float z = a.v[0] * b.v[1] - a.v[1] * b.v[0];
+    return legacy_vec3 (x, y, z);
+}
+
+legacy_mat4 legacy_zero_mat4 () {
+    return legacy_mat4 (
+            0.0f, 0.0f, 0.0f, 0.0f,
+            0.0f, 0.0f, 0.0f, 0.0f,
+            0.0f, 0.0f, 0.0f, 0.0f,
+            0.0f, 0.0f, 0.0f, 0.0f
+    );
+}
+
+legacy_mat4 legacy_identity_mat4 () {
+    return legacy_mat4 (
+            1.0f, 0.0f, 0.0f, 0.0f,
+            0.0f, 1.0f, 0.0f, 0.0f,
+            0.0f, 0.0f, 1.0f, 0.0f,
+            0.0f, 0.0f, 0.0f, 1.0f
+    );
+}
+
+legacy_mat4 legacy_translate (const legacy_mat4& m, const legacy_vec3& v) {
+    legacy_mat4 m_t = legacy_identity_mat4 ();
+    m_t.m[12] = v.v[0];
+    m_t.m[13] = v.v[1];
+    m_t.m[14] = v.v[2];
+    return m_t * m;
+}
+
+void legacy_create_versor (float* q, float a, float x, float y, float z) {
+    float rad = LEGACY_ONE_DEG_IN_RAD * a;
+    q[0] = cosf (rad / 2.0f);
+    q[1] = sinf (rad / 2.0f) * x;
+    q[2] = sinf (rad / 2.0f) * y;
+    q[3] = sinf (rad / 2.0f) * z;
+}
+
+void legacy_quat_to_mat4 (float* m, float* q) {
+    float w = q[0];
+    float x = q[1];
+    float y = q[2];
+    float z = q[3];
+    m[0] = 1.0f - 2.0f * y * y - 2.0f * z * z;
+    m[1] = 2.0f * x * y + 2.0f * w * z;
+    m[2] = 2.0f * x * z - 2.0f * w * y;
+    m[3] = 0.0f;
+    m[4] = 2.0f * x * y - 2.0f * w * z;
+    m[5] = 1.0f - 2.0f * x * x - 2.0f * z * z;
+    m[6] = 2.0f * y * z + 2.0f * w * x;
+    m[7] = 0.0f;
+    m[8] = 2.0f * x * z + 2.0f * w * y;
+    m[9] = 2.0f * y * z - 2.0f * w * x;
+    m[10] = 1.0f - 2.0f * x * x - 2.0f * y * y;
+    m[11] = 0.0f;
+    m[12] = 0.0f;
+    m[13] = 0.0f;
+    m[14] = 0.0f;
+    m[15] = 1.0f;
+}
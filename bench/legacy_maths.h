@@ -0,0 +1,44 @@
+//
+// Out-of-line copy of the pre-maths_inline.h vec3/mat4/versor code. Lives in
+// its own translation unit so, without LTO, every operator is a real call,
+// which is what the old maths_funcs.cpp cost us. Only used by bench_maths.
+//
+
+#ifndef FPS_STYLE_ROOM_LEGACY_MATHS_H
+#define FPS_STYLE_ROOM_LEGACY_MATHS_H
+
+struct legacy_vec3 {
+    legacy_vec3 ();
+    legacy_vec3 (float x, float y, float z);
+    legacy_vec3 operator+ (const legacy_vec3& rhs);
+    legacy_vec3 operator* (float rhs);
+    float v[3];
+};
+
+struct legacy_vec4 {
+    legacy_vec4 ();
+    legacy_vec4 (float x, float y, float z, float w);
+    float v[4];
+};
+
+struct legacy_mat4 {
+    legacy_mat4 ();
+    legacy_mat4 (float a, float b, float c, float d,
+                 float e, float f, float g, float h,
+                 float i, float j, float k, float l,
+                 float mm, float n, float o, float p);
+    legacy_vec4 operator* (const legacy_vec4& rhs);
+    legacy_mat4 operator* (const legacy_mat4& rhs);
+    legacy_mat4& operator= (const legacy_mat4& rhs);
+    float m[16];
+};
+
+float legacy_dot (const legacy_vec3& a, const legacy_vec3& b);
+legacy_vec3 legacy_cross (const legacy_vec3& a, const legacy_vec3& b);
+legacy_mat4 legacy_zero_mat4 ();
+legacy_mat4 legacy_identity_mat4 ();
+legacy_mat4 legacy_translate (const legacy_mat4& m, const legacy_vec3& v);
+void legacy_create_versor (float* q, float a, float x, float y, float z);
+void legacy_quat_to_mat4 (float* m, float* q);
+
+#endif //FPS_STYLE_ROOM_LEGACY_MATHS_H
@@ -0,0 +1,146 @@
+//
+// Camera orientation kept as one combined rotation.
+//
+// The view rotation is V = Rx(pitch) * Ry(yaw), the same thing main.cpp used
+// to get from Rpitch * Ryaw. Instead of rebuilding both versors from the
+// accumulated angles on every mouse event, a look delta is folded into the
+// stored versor:
+//
+//     V' = Rx(pitch + dp) * Ry(yaw + dy) = Rx(dp) * V * Ry(dy)
+//
+// so that the update is two sparse quaternion products and a renormalise. The
+// view matrix is then written directly as [ V | -V * pos ] with no generic
+// 4x4 products and no translate (identity_mat4 (), ...).
+//
+// Cost of one update, counted from the code below (mul + add, sqrt and div
+// counted separately):
+//
+//     camera_orientation_rotate    6 flops                      (angle bookkeeping)
+//                                  24 flops                     (2 half-angle sincos)
+//                                  24 flops                     (2 sparse products)
+//                                  11 flops + 1 sqrt + 1 div    (renormalise)
+//     camera_orientation_view      24 flops                     (versor -> 3x3)
+//                                  18 flops                     (-V * pos)
+//
+// 107 flops, 1 sqrt and 1 div in total, against about 400 flops and 8 libm trig
+// calls for the old create_versor / quat_to_mat4 / Rpitch * Ryaw * T path. The
+// sincos series is used for deltas under 11 degrees, larger ones go to libm.
+// bench_camera measures both paths.
+//
+
+#ifndef FPS_STYLE_ROOM_CAMERA_ORIENTATION_H
+#define FPS_STYLE_ROOM_CAMERA_ORIENTATION_H
+
+#include <utils/maths_funcs.h>
+
+static const int CAMERA_ROTATE_FLOPS = 65;
+static const int CAMERA_VIEW_FLOPS = 42;
+
+/* sin and cos of a half angle. mouse deltas are a few degrees at most, where a
+short series is exact to float precision and much cheaper than libm */
+inline void camera_half_angle_sincos (float h, float* s, float* c) {
+    if (fabsf (h) < 0.1f) {
+        float h2 = h * h;
+        *s = h * (1.0f - h2 * (1.0f / 6.0f) * (1.0f - h2 * (1.0f / 20.0f)));
+        *c = 1.0f - h2 * 0.5f * (1.0f - h2 * (1.0f / 12.0f));
+        return;
+    }
+    *s = sinf (h);
+    *c = cosf (h);
+}
+
+struct CameraOrientation {
+    versor rotation; // world -> view rotation, Rx(pitch) * Ry(yaw)
+    float yaw;       // accumulated angles in degrees, for anyone who needs them
+    float pitch;
+};
+
+/* start from absolute angles. this is the only place that builds the rotation
+from scratch */
+inline void camera_orientation_init (CameraOrientation* o, float yaw_deg, float pitch_deg) {
+    o->yaw = yaw_deg;
+    o->pitch = pitch_deg;
+    o->rotation = quat_from_axis_deg (pitch_deg, 1.0f, 0.0f, 0.0f).mul_raw (
+            quat_from_axis_deg (yaw_deg, 0.0f, 1.0f, 0.0f));
+}
+
+/* apply a mouse look delta in degrees. yaw turns about the world y axis, pitch
+about the camera's own x axis */
+inline void camera_orientation_rotate (CameraOrientation* o, float dyaw_deg, float dpitch_deg) {
+    o->yaw += dyaw_deg;
+    o->pitch += dpitch_deg;
+
+    float hy = 0.5f * dyaw_deg * MATHS_DEG_TO_RAD;
+    float hp = 0.5f * dpitch_deg * MATHS_DEG_TO_RAD;
+    float cy, sy, cp, sp;
+    camera_half_angle_sincos (hy, &sy, &cy);
+    camera_half_angle_sincos (hp, &sp, &cp);
+
+    float w = o->rotation.q[0];
+    float x = o->rotation.q[1];
+    float y = o->rotation.q[2];
+    float z = o->rotation.q[3];
+
+    // q * (cy, 0, sy, 0)
+    float w1 = w * cy - y * sy;
+    float x1 = x * cy - z * sy;
+    float y1 = w * sy + y * cy;
+    float z1 = x * sy + z * cy;
+
+    // (cp, sp, 0, 0) * q
+    w = cp * w1 - sp * x1;
+    x = cp * x1 + sp * w1;
+    y = cp * y1 - sp * z1;
+    z = cp * z1 + sp * y1;
+
+    // renormalise every time so rounding never accumulates
+    float inv = 1.0f / sqrtf (w * w + x * x + y * y + z * z);
+    o->rotation = versor (w * inv, x * inv, y * inv, z * inv);
+}
+
+/* writes the view matrix for a camera at pos: rotation rows plus -V * pos */
+inline void camera_orientation_view (const CameraOrientation* o, const float* pos, mat4* view) {
+    float w = o->rotation.q[0];
+    float x = o->rotation.q[1];
+    float y = o->rotation.q[2];
+    float z = o->rotation.q[3];
+    float x2 = x + x, y2 = y + y, z2 = z + z;
+    float xx = x * x2, yy = y * y2, zz = z * z2;
+    float xy = x * y2, xz = x * z2, yz = y * z2;
+    float wx = w * x2, wy = w * y2, wz = w * z2;
+
+    // V in column order, same layout quat_to_mat4 produces
+    float r0 = 1.0f - (yy + zz), r1 = xy + wz, r2 = xz - wy;
+    float r4 = xy - wz, r5 = 1.0f - (xx + zz), r6 = yz + wx;
+    float r8 = xz + wy, r9 = yz - wx, r10 = 1.0f - (xx + yy);
+
+    float* m = view->m;
+    m[0] = r0;
+    m[1] = r1;
+    m[2] = r2;
+    m[3] = 0.0f;
+    m[4] = r4;
+    m[5] = r5;
+    m[6] = r6;
+    m[7] = 0.0f;
+    m[8] = r8;
+    m[9] = r9;
+    m[10] = r10;
+    m[11] = 0.0f;
+    m[12] = -(r0 * pos[0] + r4 * pos[1] + r8 * pos[2]);
+    m[13] = -(r1 * pos[0] + r5 * pos[1] + r9 * pos[2]);
+    m[14] = -(r2 * pos[0] + r6 * pos[1] + r10 * pos[2]);
+    m[15] = 1.0f;
+}
+
+/* the direction the camera looks along, in world space (row 2 of V, negated) */
+inline vec3 camera_orientation_forward (const mat4& view) {
+    return vec3 (-view.m[2], -view.m[6], -view.m[10]);
+}
+
+/* the camera's up direction in world space (row 1 of V) */
+inline vec3 camera_orientation_up (const mat4& view) {
+    return vec3 (view.m[1], view.m[5], view.m[9]);
+}
+
+#endif //FPS_STYLE_ROOM_CAMERA_ORIENTATION_H
@@ -0,0 +1,58 @@
+//
+// See player_movement.h.
+//
+
+#include "player_movement.h"
+#include <camera/camera_orientation.h>
+
+bool player_movement_step (PlayerState* p, const PlayerInput& input) {
+    if (input.keys) {
+        p->pushing = 1;
+    }
+
+    if (p->pushing) {
+        const double max_velocity = 0.1 * (p->pushing > 0);
+        const double acceleration = p->pushing > 0 ? 0.2 : 0.1;
+
+        CameraOrientation o;
+        o.rotation = input.orientation;
+        float origin[3] = {0.0f, 0.0f, 0.0f};
+        mat4 view;
+        camera_orientation_view (&o, origin, &view);
+
+        // velocity points backwards, position subtracts it below
+        vec3 back = -camera_orientation_forward (view);
+        if (input.move_angle == 90 || input.move_angle == -90) {
+            vec3 left = cross (back, camera_orientation_up (view));
+            float side = input.move_angle == 90 ? 1.0f : -1.0f;
+            p->velocity.v[0] = (float)(p->velocity.v[0] * (1 - acceleration) +
+                                       left.v[0] * side * (acceleration * max_velocity));
+            p->velocity.v[2] = (float)(p->velocity.v[2] * (1 - acceleration) +
+                                       left.v[2] * side * (acceleration * max_velocity));
+        } else {
+            float ahead = input.move_angle == 180 ? -1.0f : 1.0f;
+            p->velocity.v[0] = (float)(p->velocity.v[0] * (1 - acceleration) +
+                                       back.v[0] * ahead * (acceleration * max_velocity));
+            p->velocity.v[2] = (float)(p->velocity.v[2] * (1 - acceleration) +
+                                       back.v[2] * ahead * (acceleration * max_velocity));
+        }
+        p->moving = true;
+    }
+
+    bool stopped = false;
+    if (p->moving) {
+        p->pos.v[0] += -p->velocity.v[0] * 0.02f;
+        p->pos.v[2] += -p->velocity.v[2] * 0.02f;
+
+        if (dot (p->velocity, p->velocity) < 1e-9) {
+            p->velocity = vec3 (0.0f, 0.0f, 0.0f);
+            p->pushing = 0;
+            p->moving = false;
+            stopped = true;
+        }
+    }
+    if (p->pushing) {
+        p->pushing = -1;
+    }
+    return stopped;
+}
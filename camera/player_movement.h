@@ -0,0 +1,45 @@
+//
+// Player movement, one step at a time, with nothing but the inputs.
+//
+// This is main.cpp's old updateMovement with the GL and the globals taken
+// out, so the game, a server and a predicting client all run the very same
+// code. A step takes the keys held, the direction of the last one pressed
+// and the look rotation, and moves the player on the xz plane:
+//  - any movement key held pushes: the velocity eases towards 0.1 along the
+//    move direction, 0.2 of the way each step
+//  - the step after a push coasts: the velocity decays by 0.1 each step
+//  - position moves by 0.02 of the velocity, and once the velocity is below
+//    1e-9 squared the player stops
+// The step is in steps, not seconds. The game takes one a frame, the server
+// one per client input.
+//
+
+#ifndef FPS_STYLE_ROOM_PLAYER_MOVEMENT_H
+#define FPS_STYLE_ROOM_PLAYER_MOVEMENT_H
+
+#include <utils/maths_funcs.h>
+
+enum PlayerKey {
+    PLAYER_KEY_W = 1,
+    PLAYER_KEY_S = 2,
+    PLAYER_KEY_A = 4,
+    PLAYER_KEY_D = 8
+};
+
+struct PlayerInput {
+    unsigned int keys;           // PlayerKey bits held
+    int move_angle;              // of the last key pressed: 0 W, 180 S, -90 A, 90 D
+    versor orientation;          // world -> view, CameraOrientation::rotation
+};
+
+struct PlayerState {
+    vec3 pos;
+    vec3 velocity;               // points backwards, pos subtracts it
+    int pushing;                 // 1 accelerating, -1 coasting, 0 idle
+    bool moving;                 // velocity != 0
+};
+
+/* one step. true if the player came to a stop in it */
+bool player_movement_step (PlayerState* p, const PlayerInput& input);
+
+#endif //FPS_STYLE_ROOM_PLAYER_MOVEMENT_H
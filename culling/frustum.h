@@ -0,0 +1,119 @@
+//
+// Plane sets for visibility tests. A Frustum is just a list of planes facing
+// inwards, so the same tests work for the camera frustum (6 planes) and for the
+// narrowed frusta the portal system builds through doorways.
+//
+
+#ifndef FPS_STYLE_ROOM_FRUSTUM_H
+#define FPS_STYLE_ROOM_FRUSTUM_H
+
+#include <geometry/mesh.h>
+
+#define FRUSTUM_MAX_PLANES 24
+
+/* n . p + d >= 0 on the inside */
+struct Plane {
+    vec3 n;
+    float d;
+};
+
+struct Frustum {
+    Plane planes[FRUSTUM_MAX_PLANES];
+    int count;
+};
+
+inline float plane_distance (const Plane& p, const vec3& point) {
+    return dot (p.n, point) + p.d;
+}
+
+inline Plane plane_from_points (const vec3& a, const vec3& b, const vec3& c) {
+    Plane p;
+    p.n = normalise (cross (b - a, c - a));
+    p.d = -dot (p.n, a);
+    return p;
+}
+
+/* the six clip planes of a view-projection matrix (Gribb & Hartmann), in
+world space, normalised. order: left right bottom top near far */
+inline Frustum frustum_from_matrix (const mat4& vp) {
+    Frustum f;
+    f.count = 6;
+    const float* m = vp.m;
+    for (int i = 0; i < 3; i++) {
+        // row 3 +- row i
+        for (int s = 0; s < 2; s++) {
+            float sign = s == 0 ? 1.0f : -1.0f;
+            Plane& p = f.planes[i * 2 + s];
+            p.n = vec3 (m[3] + sign * m[i], m[7] + sign * m[4 + i], m[11] + sign * m[8 + i]);
+            p.d = m[15] + sign * m[12 + i];
+            float inv = 1.0f / length (p.n);
+            p.n *= inv;
+            p.d *= inv;
+        }
+    }
+    return f;
+}
+
+/* false only if the box is entirely outside one plane */
+inline bool frustum_test_aabb (const Frustum& f, const Aabb& b) {
+    for (int i = 0; i < f.count; i++) {
+        const Plane& p = f.planes[i];
+        // the corner furthest along the plane normal
+        vec3 c (p.n.v[0] >= 0.0f ? b.max.v[0] : b.min.v[0],
+                p.n.v[1] >= 0.0f ? b.max.v[1] : b.min.v[1],
+                p.n.v[2] >= 0.0f ? b.max.v[2] : b.min.v[2]);
+        if (plane_distance (p, c) < 0.0f) {
+            return false;
+        }
+    }
+    return true;
+}
+
+enum FrustumSide {
+    FRUSTUM_OUTSIDE,
+    FRUSTUM_CROSSING,
+    FRUSTUM_INSIDE
+};
+
+/* frustum_test_aabb that also tells a box entirely inside every plane from
+one crossing some. a box inside needs none of its contents tested */
+inline FrustumSide frustum_classify_aabb (const Frustum& f, const Aabb& b) {
+    FrustumSide side = FRUSTUM_INSIDE;
+    for (int i = 0; i < f.count; i++) {
+        const Plane& p = f.planes[i];
+        vec3 far_corner (p.n.v[0] >= 0.0f ? b.max.v[0] : b.min.v[0],
+                         p.n.v[1] >= 0.0f ? b.max.v[1] : b.min.v[1],
+                         p.n.v[2] >= 0.0f ? b.max.v[2] : b.min.v[2]);
+        if (plane_distance (p, far_corner) < 0.0f) {
+            return FRUSTUM_OUTSIDE;
+        }
+        vec3 near_corner (p.n.v[0] >= 0.0f ? b.min.v[0] : b.max.v[0],
+                          p.n.v[1] >= 0.0f ? b.min.v[1] : b.max.v[1],
+                          p.n.v[2] >= 0.0f ? b.min.v[2] : b.max.v[2]);
+        if (plane_distance (p, near_corner) < 0.0f) {
+            side = FRUSTUM_CROSSING;
+        }
+    }
+    return side;
+}
+
+inline bool frustum_test_sphere (const Frustum& f, const vec3& center, float radius) {
+    for (int i = 0; i < f.count; i++) {
+        if (plane_distance (f.planes[i], center) < -radius) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* eye position of a rigid view matrix: -R^T * t */
+inline vec3 view_matrix_eye (const mat4& view) {
+    const float* m = view.m;
+    return vec3 (
+            -(m[0] * m[12] + m[1] * m[13] + m[2] * m[14]),
+            -(m[4] * m[12] + m[5] * m[13] + m[6] * m[14]),
+            -(m[8] * m[12] + m[9] * m[13] + m[10] * m[14])
+    );
+}
+
+#endif //FPS_STYLE_ROOM_FRUSTUM_H
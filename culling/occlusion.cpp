@@ -0,0 +1,323 @@
+//
+// Software Hi-Z occlusion culling. See occlusion.h.
+//
+
+#include "occlusion.h"
+#include <memory/memory_tracker.h>
+#include <jobs/job_system.h>
+#include <algorithm>
+#include <chrono>
+#include <string.h>
+#include <stdio.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// triangles with a vertex this close to the eye plane are skipped rather than
+// clipped. dropping part of an occluder can only make culling more
+// conservative, never wrong
+static const float OCCLUSION_NEAR_W = 1e-3f;
+// occluders are set up and rasterized this many at a time between budget checks
+static const int OCCLUSION_BATCH = 16;
+
+static double now_ms () {
+    using namespace std::chrono;
+    return duration<double, std::milli> (steady_clock::now ().time_since_epoch ()).count ();
+}
+
+void occlusion_init (OcclusionBuffer* ob, int width, int height, int threads) {
+    MemoryScope scope (MEMORY_RENDER);
+    ob->width = width;
+    ob->height = height;
+    ob->threads = threads > 0 ? threads : job_system_worker_count ();
+    ob->mip_count = 0;
+    int w = width, h = height;
+    while (ob->mip_count < OCCLUSION_MAX_MIPS) {
+        ob->mip_width[ob->mip_count] = w;
+        ob->mip_height[ob->mip_count] = h;
+        ob->mips[ob->mip_count].assign ((size_t)w * h, 1.0f);
+        ob->mip_count++;
+        if (w == 1 && h == 1) {
+            break;
+        }
+        w = w > 1 ? w / 2 : 1;
+        h = h > 1 ? h / 2 : 1;
+    }
+    memset (&ob->stats, 0, sizeof (ob->stats));
+}
+
+void occlusion_begin_frame (OcclusionBuffer* ob, const mat4& view_proj, const vec3& camera_pos, double budget_ms) {
+    ob->view_proj = view_proj;
+    ob->camera_pos = camera_pos;
+    ob->budget_ms = budget_ms;
+    ob->frame_start_ms = now_ms ();
+    std::fill (ob->mips[0].begin (), ob->mips[0].end (), 1.0f);
+    memset (&ob->stats, 0, sizeof (ob->stats));
+}
+
+/*-------------------------------TRIANGLE SETUP-------------------------------*/
+static void setup_occluder (OcclusionBuffer* ob, const Occluder& occ) {
+    mat4 mvp = ob->view_proj * occ.model;
+    float half_w = 0.5f * (float)ob->width;
+    float half_h = 0.5f * (float)ob->height;
+    for (unsigned int i = 0; i + 2 < occ.index_count; i += 3) {
+        float sx[3], sy[3], sz[3];
+        bool behind = false;
+        for (int k = 0; k < 3; k++) {
+            vec4 c = mvp * vec4 (occ.positions[occ.indices[i + k]], 1.0f);
+            if (c.v[3] < OCCLUSION_NEAR_W) {
+                behind = true;
+                break;
+            }
+            float inv_w = 1.0f / c.v[3];
+            sx[k] = (c.v[0] * inv_w + 1.0f) * half_w;
+            sy[k] = (c.v[1] * inv_w + 1.0f) * half_h;
+            sz[k] = c.v[2] * inv_w * 0.5f + 0.5f;
+        }
+        if (behind) {
+            continue;
+        }
+        // counter-clockwise triangles face the camera
+        float area = (sx[1] - sx[0]) * (sy[2] - sy[0]) - (sx[2] - sx[0]) * (sy[1] - sy[0]);
+        if (area <= 0.0f) {
+            continue;
+        }
+        OcclusionTri t;
+        // pixel centres are at +0.5, the bounds cover every centre inside
+        t.min_x = std::max (0, (int)floorf (std::min (sx[0], std::min (sx[1], sx[2])) - 0.5f));
+        t.max_x = std::min (ob->width - 1, (int)ceilf (std::max (sx[0], std::max (sx[1], sx[2])) - 0.5f));
+        t.min_y = std::max (0, (int)floorf (std::min (sy[0], std::min (sy[1], sy[2])) - 0.5f));
+        t.max_y = std::min (ob->height - 1, (int)ceilf (std::max (sy[0], std::max (sy[1], sy[2])) - 0.5f));
+        if (t.min_x > t.max_x || t.min_y > t.max_y) {
+            continue;
+        }
+        float inv_area = 1.0f / area;
+        float dz1 = sz[1] - sz[0], dz2 = sz[2] - sz[0];
+        t.dzdx = (dz1 * (sy[2] - sy[0]) - dz2 * (sy[1] - sy[0])) * inv_area;
+        t.dzdy = (dz2 * (sx[1] - sx[0]) - dz1 * (sx[2] - sx[0])) * inv_area;
+        t.z0 = sz[0] - t.dzdx * sx[0] - t.dzdy * sy[0];
+        for (int k = 0; k < 3; k++) {
+            t.x[k] = sx[k];
+            t.y[k] = sy[k];
+        }
+        ob->setup.push_back (t);
+    }
+}
+
+/*--------------------------------RASTERIZATION-------------------------------*/
+/* edge function a * x + b * y + c, positive inside a ccw triangle */
+struct Edge {
+    float a, b, c;
+};
+
+static Edge make_edge (float x0, float y0, float x1, float y1) {
+    Edge e;
+    e.a = y0 - y1;
+    e.b = x1 - x0;
+    e.c = x0 * y1 - y0 * x1;
+    return e;
+}
+
+static void raster_band (OcclusionBuffer* ob, int band_min_y, int band_max_y) {
+    float* depth = ob->mips[0].data ();
+    const int width = ob->width;
+    for (size_t ti = 0; ti < ob->setup.size (); ti++) {
+        const OcclusionTri& t = ob->setup[ti];
+        int y0 = std::max (t.min_y, band_min_y);
+        int y1 = std::min (t.max_y, band_max_y);
+        if (y0 > y1) {
+            continue;
+        }
+        Edge e[3] = {
+                make_edge (t.x[1], t.y[1], t.x[2], t.y[2]),
+                make_edge (t.x[2], t.y[2], t.x[0], t.y[0]),
+                make_edge (t.x[0], t.y[0], t.x[1], t.y[1])
+        };
+        // start on a multiple of 4 so rows are written with aligned quads
+        int x0 = t.min_x & ~3;
+#if defined(__SSE2__)
+        const __m128 lane = _mm_setr_ps (0.5f, 1.5f, 2.5f, 3.5f);
+        const __m128 zero = _mm_setzero_ps ();
+        __m128 ea[3], eb[3], ec[3];
+        for (int k = 0; k < 3; k++) {
+            ea[k] = _mm_set1_ps (e[k].a);
+            eb[k] = _mm_set1_ps (e[k].b);
+            ec[k] = _mm_set1_ps (e[k].c);
+        }
+        const __m128 dzdx = _mm_set1_ps (t.dzdx);
+        const __m128 dzdy = _mm_set1_ps (t.dzdy);
+        const __m128 z0 = _mm_set1_ps (t.z0);
+        for (int y = y0; y <= y1; y++) {
+            __m128 py = _mm_set1_ps ((float)y + 0.5f);
+            float* row = depth + (size_t)y * width;
+            for (int x = x0; x <= t.max_x; x += 4) {
+                __m128 px = _mm_add_ps (_mm_set1_ps ((float)x), lane);
+                __m128 inside = _mm_cmpge_ps (_mm_add_ps (_mm_add_ps (_mm_mul_ps (ea[0], px), _mm_mul_ps (eb[0], py)), ec[0]), zero);
+                inside = _mm_and_ps (inside, _mm_cmpge_ps (_mm_add_ps (_mm_add_ps (_mm_mul_ps (ea[1], px), _mm_mul_ps (eb[1], py)), ec[1]), zero));
+                inside = _mm_and_ps (inside, _mm_cmpge_ps (_mm_add_ps (_mm_add_ps (_mm_mul_ps (ea[2], px), _mm_mul_ps (eb[2], py)), ec[2]), zero));
+                if (_mm_movemask_ps (inside) == 0) {
+                    continue;
+                }
+                __m128 z = _mm_add_ps (z0, _mm_add_ps (_mm_mul_ps (dzdx, px), _mm_mul_ps (dzdy, py)));
+                __m128 old = _mm_loadu_ps (row + x);
+                __m128 nearest = _mm_min_ps (old, z);
+                _mm_storeu_ps (row + x, _mm_or_ps (_mm_and_ps (inside, nearest), _mm_andnot_ps (inside, old)));
+            }
+        }
+#else
+        for (int y = y0; y <= y1; y++) {
+            float py = (float)y + 0.5f;
+            float* row = depth + (size_t)y * width;
+            for (int x = x0; x <= t.max_x && x < width; x++) {
+                float px = (float)x + 0.5f;
+                if (e[0].a * px + e[0].b * py + e[0].c < 0.0f ||
+                    e[1].a * px + e[1].b * py + e[1].c < 0.0f ||
+                    e[2].a * px + e[2].b * py + e[2].c < 0.0f) {
+                    continue;
+                }
+                float z = t.z0 + t.dzdx * px + t.dzdy * py;
+                row[x] = std::min (row[x], z);
+            }
+        }
+#endif
+    }
+}
+
+static void raster_batch (OcclusionBuffer* ob) {
+    if (ob->setup.empty ()) {
+        return;
+    }
+    // bands on the job system. every band walks the whole batch but only
+    // writes its own rows, so there is nothing to lock
+    int bands = std::min (ob->threads, ob->height);
+    int rows = (ob->height + bands - 1) / bands;
+    parallel_for_each (bands, 1, [ob, rows] (int begin, int end) {
+        for (int b = begin; b < end; b++) {
+            int min_y = b * rows;
+            int max_y = std::min (ob->height - 1, min_y + rows - 1);
+            if (min_y <= max_y) {
+                raster_band (ob, min_y, max_y);
+            }
+        }
+    });
+    ob->stats.triangles_rasterized += (unsigned int)ob->setup.size ();
+    ob->setup.clear ();
+}
+
+static void build_hiz (OcclusionBuffer* ob) {
+    for (int level = 1; level < ob->mip_count; level++) {
+        const std::vector<float>& src = ob->mips[level - 1];
+        std::vector<float>& dst = ob->mips[level];
+        int sw = ob->mip_width[level - 1], sh = ob->mip_height[level - 1];
+        int dw = ob->mip_width[level], dh = ob->mip_height[level];
+        for (int y = 0; y < dh; y++) {
+            int sy0 = std::min (y * 2, sh - 1), sy1 = std::min (y * 2 + 1, sh - 1);
+            for (int x = 0; x < dw; x++) {
+                int sx0 = std::min (x * 2, sw - 1), sx1 = std::min (x * 2 + 1, sw - 1);
+                float a = std::max (src[(size_t)sy0 * sw + sx0], src[(size_t)sy0 * sw + sx1]);
+                float b = std::max (src[(size_t)sy1 * sw + sx0], src[(size_t)sy1 * sw + sx1]);
+                dst[(size_t)y * dw + x] = std::max (a, b);
+            }
+        }
+    }
+}
+
+void occlusion_rasterize (OcclusionBuffer* ob, const Occluder* occluders, int count) {
+    double t0 = now_ms ();
+    ob->stats.occluders_submitted += count;
+
+    // largest on screen first: world radius over distance, squared
+    std::vector<std::pair<float, int> > order ((size_t)count);
+    for (int i = 0; i < count; i++) {
+        vec3 c = aabb_center (occluders[i].world_bounds);
+        float r2 = length2 (aabb_extent (occluders[i].world_bounds));
+        float d2 = std::max (get_squared_dist (c, ob->camera_pos), 1e-4f);
+        order[i] = std::make_pair (-r2 / d2, i);
+    }
+    std::sort (order.begin (), order.end ());
+
+    double slowest_batch = 0.0;
+    for (int first = 0; first < count; first += OCCLUSION_BATCH) {
+        double batch_start = now_ms ();
+        // would the next batch, if it is as slow as the slowest so far, overrun?
+        if (batch_start + slowest_batch - ob->frame_start_ms > ob->budget_ms) {
+            ob->stats.budget_exhausted = true;
+            break;
+        }
+        int last = std::min (count, first + OCCLUSION_BATCH);
+        for (int i = first; i < last; i++) {
+            setup_occluder (ob, occluders[order[i].second]);
+        }
+        raster_batch (ob);
+        ob->stats.occluders_rasterized += last - first;
+        slowest_batch = std::max (slowest_batch, now_ms () - batch_start);
+    }
+    build_hiz (ob);
+    ob->stats.raster_ms += now_ms () - t0;
+}
+
+/*----------------------------------TESTING-----------------------------------*/
+bool occlusion_test_aabb (const OcclusionBuffer* ob, const Aabb& box) {
+    float min_x = 1e30f, min_y = 1e30f, max_x = -1e30f, max_y = -1e30f;
+    float min_z = 1e30f;
+    for (int i = 0; i < 8; i++) {
+        vec4 p ((i & 1) ? box.max.v[0] : box.min.v[0],
+                (i & 2) ? box.max.v[1] : box.min.v[1],
+                (i & 4) ? box.max.v[2] : box.min.v[2], 1.0f);
+        vec4 c = ob->view_proj * p;
+        if (c.v[3] < OCCLUSION_NEAR_W) {
+            return true; // crosses the eye plane, can't be behind anything
+        }
+        float inv_w = 1.0f / c.v[3];
+        float x = c.v[0] * inv_w, y = c.v[1] * inv_w, z = c.v[2] * inv_w * 0.5f + 0.5f;
+        min_x = std::min (min_x, x);
+        max_x = std::max (max_x, x);
+        min_y = std::min (min_y, y);
+        max_y = std::max (max_y, y);
+        min_z = std::min (min_z, z);
+    }
+    if (max_x < -1.0f || min_x > 1.0f || max_y < -1.0f || min_y > 1.0f) {
+        return true; // off screen, that's frustum culling's call, not ours
+    }
+    // rectangle in level 0 texels
+    int x0 = std::max (0, (int)((min_x * 0.5f + 0.5f) * ob->width));
+    int x1 = std::min (ob->width - 1, (int)((max_x * 0.5f + 0.5f) * ob->width));
+    int y0 = std::max (0, (int)((min_y * 0.5f + 0.5f) * ob->height));
+    int y1 = std::min (ob->height - 1, (int)((max_y * 0.5f + 0.5f) * ob->height));
+    // go up the chain until the rectangle is at most 2 texels across
+    int level = 0;
+    while (level + 1 < ob->mip_count && ((x1 - x0) > 1 || (y1 - y0) > 1)) {
+        x0 >>= 1;
+        x1 >>= 1;
+        y0 >>= 1;
+        y1 >>= 1;
+        level++;
+    }
+    const std::vector<float>& mip = ob->mips[level];
+    int w = ob->mip_width[level];
+    for (int y = y0; y <= y1; y++) {
+        for (int x = x0; x <= x1; x++) {
+            if (min_z <= mip[(size_t)y * w + x]) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+int occlusion_cull (OcclusionBuffer* ob, const Aabb* boxes, int count, unsigned char* visible) {
+    double t0 = now_ms ();
+    std::atomic<int> visible_count (0);
+    parallel_for_each (count, 256, [ob, boxes, visible, &visible_count] (int begin, int end) {
+        int n = 0;
+        for (int i = begin; i < end; i++) {
+            visible[i] = occlusion_test_aabb (ob, boxes[i]) ? 1 : 0;
+            n += visible[i];
+        }
+        visible_count += n;
+    });
+    ob->stats.objects_tested += count;
+    ob->stats.objects_culled += count - visible_count.load ();
+    ob->stats.test_ms += now_ms () - t0;
+    return visible_count.load ();
+}
@@ -0,0 +1,91 @@
+//
+// Software occlusion culling against a hierarchical depth buffer.
+//
+// Each frame a handful of big occluders (walls, floors, pillars) are
+// rasterized on the CPU into a small depth buffer, nearest depth wins, four
+// pixels at a time with SSE and in horizontal bands on the job system. A Hi-Z
+// chain is then built where every texel holds the FARTHEST depth of the 2x2
+// texels under it. An object is hidden if its nearest depth is behind the Hi-Z
+// value of every texel its screen rectangle touches, at the mip level where
+// that rectangle is about 2x2 texels.
+//
+// Occluders are rasterized biggest on screen first, in batches, and the pass
+// stops starting new batches once the frame's time budget is spent. Running
+// out of budget only means fewer occluders, so culling stays conservative.
+//
+// Depth is window space z in [0, 1] (z_ndc * 0.5 + 0.5), the same convention
+// as the GL depth buffer main.cpp draws into.
+//
+
+#ifndef FPS_STYLE_ROOM_OCCLUSION_H
+#define FPS_STYLE_ROOM_OCCLUSION_H
+
+#include <vector>
+#include <geometry/mesh.h>
+
+#define OCCLUSION_MAX_MIPS 12
+
+/* an occluder mesh. positions are object space, model takes them to world */
+struct Occluder {
+    const vec3* positions;
+    const unsigned int* indices;
+    unsigned int index_count;
+    mat4 model;
+    Aabb world_bounds;
+};
+
+struct OcclusionStats {
+    unsigned int occluders_submitted;
+    unsigned int occluders_rasterized;
+    unsigned int triangles_rasterized;
+    unsigned int objects_tested;
+    unsigned int objects_culled;
+    double raster_ms;   // setup + rasterization + hi-z build
+    double test_ms;
+    bool budget_exhausted;
+};
+
+/* screen space triangle ready for the band rasterizers */
+struct OcclusionTri {
+    float x[3];
+    float y[3];
+    float z0, dzdx, dzdy; // depth plane, z(x, y) = z0 + dzdx * x + dzdy * y
+    int min_x, max_x, min_y, max_y;
+};
+
+struct OcclusionBuffer {
+    int width;
+    int height;
+    int mip_count;
+    int threads;
+    int mip_width[OCCLUSION_MAX_MIPS];
+    int mip_height[OCCLUSION_MAX_MIPS];
+    std::vector<float> mips[OCCLUSION_MAX_MIPS]; // mips[0] is the depth buffer itself
+    std::vector<OcclusionTri> setup;             // current batch
+    mat4 view_proj;
+    vec3 camera_pos;
+    double budget_ms;
+    double frame_start_ms;
+    OcclusionStats stats;
+};
+
+/* width and height must be powers of two, 256 x 128 is plenty. threads is
+the number of horizontal bands rasterized in parallel on the job system, 0
+for one per worker */
+void occlusion_init (OcclusionBuffer* ob, int width, int height, int threads);
+
+/* clears the buffer and starts the frame's time budget */
+void occlusion_begin_frame (OcclusionBuffer* ob, const mat4& view_proj, const vec3& camera_pos, double budget_ms);
+
+/* rasterizes as many occluders as fit in the budget, largest on screen first,
+then builds the Hi-Z chain */
+void occlusion_rasterize (OcclusionBuffer* ob, const Occluder* occluders, int count);
+
+/* true if the world space box may be visible */
+bool occlusion_test_aabb (const OcclusionBuffer* ob, const Aabb& box);
+
+/* tests every box, writes 1/0 into visible and returns how many are visible.
+counts go into ob->stats */
+int occlusion_cull (OcclusionBuffer* ob, const Aabb* boxes, int count, unsigned char* visible);
+
+#endif //FPS_STYLE_ROOM_OCCLUSION_H
@@ -0,0 +1,222 @@
+//
+// Recursive portal clipping. See portals.h.
+//
+
+#include "portals.h"
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+
+// clipping a polygon against up to FRUSTUM_MAX_PLANES planes adds at most one
+// vertex per plane
+#define CLIP_MAX_VERTICES (PORTAL_MAX_VERTICES + FRUSTUM_MAX_PLANES)
+// the eye this close to a portal plane means we are standing in the doorway
+static const float PORTAL_EYE_EPSILON = 1e-3f;
+
+int portal_world_add_cell (PortalWorld* world, const Aabb& bounds) {
+    Cell c;
+    c.bounds = bounds;
+    world->cells.push_back (c);
+    return (int)world->cells.size () - 1;
+}
+
+int portal_world_add_portal (PortalWorld* world, int cell_a, int cell_b, const vec3* vertices, int vertex_count) {
+    if (vertex_count < 3 || vertex_count > PORTAL_MAX_VERTICES) {
+        fprintf (stderr, "ERROR: portal needs 3 to %d vertices, got %d\n", PORTAL_MAX_VERTICES, vertex_count);
+        return -1;
+    }
+    Portal p;
+    memcpy (p.vertices, vertices, sizeof (vec3) * vertex_count);
+    p.vertex_count = vertex_count;
+    p.cells[0] = cell_a;
+    p.cells[1] = cell_b;
+    world->portals.push_back (p);
+    int index = (int)world->portals.size () - 1;
+    world->cells[cell_a].portals.push_back (index);
+    world->cells[cell_b].portals.push_back (index);
+    return index;
+}
+
+int portal_world_find_cell (const PortalWorld& world, const vec3& p) {
+    for (size_t i = 0; i < world.cells.size (); i++) {
+        const Aabb& b = world.cells[i].bounds;
+        if (p.v[0] >= b.min.v[0] && p.v[0] <= b.max.v[0] &&
+            p.v[1] >= b.min.v[1] && p.v[1] <= b.max.v[1] &&
+            p.v[2] >= b.min.v[2] && p.v[2] <= b.max.v[2]) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+/* Sutherland-Hodgman against every plane of f. returns the vertex count left */
+static int clip_polygon (const Frustum& f, const vec3* in, int in_count, vec3* out) {
+    vec3 buf[2][CLIP_MAX_VERTICES];
+    int count = in_count;
+    memcpy (buf[0], in, sizeof (vec3) * in_count);
+    int cur = 0;
+    for (int pi = 0; pi < f.count && count >= 3; pi++) {
+        const Plane& plane = f.planes[pi];
+        const vec3* src = buf[cur];
+        vec3* dst = buf[cur ^ 1];
+        int n = 0;
+        for (int i = 0; i < count; i++) {
+            const vec3& a = src[i];
+            const vec3& b = src[(i + 1) % count];
+            float da = plane_distance (plane, a);
+            float db = plane_distance (plane, b);
+            if (da >= 0.0f) {
+                dst[n++] = a;
+            }
+            if ((da >= 0.0f) != (db >= 0.0f) && n < CLIP_MAX_VERTICES) {
+                dst[n++] = a + (b - a) * (da / (da - db));
+            }
+        }
+        count = n;
+        cur ^= 1;
+    }
+    if (count >= 3) {
+        memcpy (out, buf[cur], sizeof (vec3) * count);
+    }
+    return count;
+}
+
+struct Traversal {
+    const PortalWorld* world;
+    PortalVisibility* out;
+    vec3 eye;
+    Plane far_plane;
+    std::vector<unsigned char> portal_on_path;
+};
+
+static void visit (Traversal* t, int cell, const Frustum& frustum, unsigned int depth) {
+    PortalVisibility* out = t->out;
+    out->stats.cells_visited++;
+    if (depth > out->stats.max_depth) {
+        out->stats.max_depth = depth;
+    }
+    if (!out->cell_visible[cell]) {
+        out->cell_visible[cell] = 1;
+        out->visible_cells.push_back (cell);
+    }
+    out->frusta.push_back (frustum);
+    out->cell_frusta[cell].push_back ((int)out->frusta.size () - 1);
+    if (depth >= PORTAL_MAX_DEPTH) {
+        return;
+    }
+
+    const Cell& c = t->world->cells[cell];
+    for (size_t i = 0; i < c.portals.size (); i++) {
+        int pi = c.portals[i];
+        if (t->portal_on_path[pi]) {
+            continue; // don't walk back out through a door we came in by
+        }
+        const Portal& portal = t->world->portals[pi];
+        int next = portal.cells[0] == cell ? portal.cells[1] : portal.cells[0];
+        out->stats.portals_tested++;
+
+        // portal plane facing away from the eye, i.e. into the next cell
+        Plane pp = plane_from_points (portal.vertices[0], portal.vertices[1], portal.vertices[2]);
+        float eye_dist = plane_distance (pp, t->eye);
+        if (eye_dist > 0.0f) {
+            pp.n = -pp.n;
+            pp.d = -pp.d;
+            eye_dist = -eye_dist;
+        }
+
+        Frustum narrowed;
+        if (eye_dist > -PORTAL_EYE_EPSILON) {
+            // standing in the doorway: the portal can't narrow anything
+            if (!frustum_test_aabb (frustum, t->world->cells[next].bounds)) {
+                continue;
+            }
+            narrowed = frustum;
+        } else {
+            vec3 clipped[CLIP_MAX_VERTICES];
+            int n = clip_polygon (frustum, portal.vertices, portal.vertex_count, clipped);
+            if (n < 3) {
+                continue;
+            }
+            if (n + 2 > FRUSTUM_MAX_PLANES) {
+                narrowed = frustum; // too many edges to keep, fall back to the wider frustum
+            } else {
+                vec3 centroid (0.0f, 0.0f, 0.0f);
+                for (int k = 0; k < n; k++) {
+                    centroid += clipped[k];
+                }
+                centroid = centroid * (1.0f / (float)n);
+                narrowed.count = 0;
+                for (int k = 0; k < n; k++) {
+                    const vec3& a = clipped[k];
+                    const vec3& b = clipped[(k + 1) % n];
+                    if (length2 (b - a) < 1e-12f) {
+                        continue;
+                    }
+                    Plane side = plane_from_points (t->eye, a, b);
+                    if (plane_distance (side, centroid) < 0.0f) {
+                        side.n = -side.n;
+                        side.d = -side.d;
+                    }
+                    narrowed.planes[narrowed.count++] = side;
+                }
+                narrowed.planes[narrowed.count++] = pp;
+                narrowed.planes[narrowed.count++] = t->far_plane;
+            }
+        }
+        out->stats.portals_passed++;
+        t->portal_on_path[pi] = 1;
+        visit (t, next, narrowed, depth + 1);
+        t->portal_on_path[pi] = 0;
+    }
+}
+
+void portal_visibility (const PortalWorld& world, const mat4& view, const mat4& proj, PortalVisibility* out) {
+    auto t0 = std::chrono::steady_clock::now ();
+    memset (&out->stats, 0, sizeof (out->stats));
+    out->visible_cells.clear ();
+    out->frusta.clear ();
+    out->cell_visible.assign (world.cells.size (), 0);
+    out->cell_frusta.resize (world.cells.size ());
+    for (size_t i = 0; i < out->cell_frusta.size (); i++) {
+        out->cell_frusta[i].clear ();
+    }
+
+    Traversal t;
+    t.world = &world;
+    t.out = out;
+    t.eye = view_matrix_eye (view);
+    Frustum camera = frustum_from_matrix (proj * view);
+    t.far_plane = camera.planes[5];
+    t.portal_on_path.assign (world.portals.size (), 0);
+
+    int start = portal_world_find_cell (world, t.eye);
+    if (start >= 0) {
+        visit (&t, start, camera, 0);
+    } else {
+        // outside every room (free camera): nothing to narrow with, everything
+        // the camera frustum touches is visible
+        for (size_t i = 0; i < world.cells.size (); i++) {
+            if (frustum_test_aabb (camera, world.cells[i].bounds)) {
+                out->cell_visible[i] = 1;
+                out->visible_cells.push_back ((int)i);
+                out->frusta.push_back (camera);
+                out->cell_frusta[i].push_back ((int)out->frusta.size () - 1);
+            }
+        }
+    }
+    out->stats.cells_visible = (unsigned int)out->visible_cells.size ();
+    out->stats.ms = std::chrono::duration<double, std::milli> (std::chrono::steady_clock::now () - t0).count ();
+}
+
+bool portal_cell_test_aabb (const PortalVisibility& vis, int cell, const Aabb& box) {
+    if (!vis.cell_visible[cell]) {
+        return false;
+    }
+    const std::vector<int>& list = vis.cell_frusta[cell];
+    for (size_t i = 0; i < list.size (); i++) {
+        if (frustum_test_aabb (vis.frusta[list[i]], box)) {
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,69 @@
+//
+// Cell and portal visibility for room based levels.
+//
+// Rooms are cells (an AABB each), doorways are convex portal polygons joining
+// two cells. Starting in the camera's cell with the camera frustum, every
+// portal of the cell is clipped against the current frustum. If anything is
+// left, the cell behind it is visible through a narrower frustum made of
+// planes through the eye and each edge of the clipped polygon, plus the
+// portal plane as the new near plane. Recursion continues from there. A cell
+// reached along several paths keeps every frustum it was seen through, so
+// objects in it can be tested against the union.
+//
+
+#ifndef FPS_STYLE_ROOM_PORTALS_H
+#define FPS_STYLE_ROOM_PORTALS_H
+
+#include <vector>
+#include <culling/frustum.h>
+
+#define PORTAL_MAX_VERTICES 8
+#define PORTAL_MAX_DEPTH 32
+
+struct Portal {
+    vec3 vertices[PORTAL_MAX_VERTICES]; // convex, any winding
+    int vertex_count;
+    int cells[2];
+};
+
+struct Cell {
+    Aabb bounds;
+    std::vector<int> portals;
+};
+
+struct PortalWorld {
+    std::vector<Cell> cells;
+    std::vector<Portal> portals;
+};
+
+struct PortalStats {
+    unsigned int cells_visited;    // visits, a cell seen through two doors counts twice
+    unsigned int cells_visible;    // distinct cells
+    unsigned int portals_tested;
+    unsigned int portals_passed;   // portals with something left after clipping
+    unsigned int max_depth;
+    double ms;
+};
+
+struct PortalVisibility {
+    std::vector<int> visible_cells;                  // distinct, in discovery order
+    std::vector<unsigned char> cell_visible;         // per cell, 0 or 1
+    std::vector<Frustum> frusta;                     // every frustum a cell was seen through
+    std::vector<std::vector<int> > cell_frusta;      // per cell, indices into frusta
+    PortalStats stats;
+};
+
+int portal_world_add_cell (PortalWorld* world, const Aabb& bounds);
+/* returns the portal index, or -1 if the polygon is too big */
+int portal_world_add_portal (PortalWorld* world, int cell_a, int cell_b, const vec3* vertices, int vertex_count);
+/* the cell containing p, or -1. overlapping cells: the first one wins */
+int portal_world_find_cell (const PortalWorld& world, const vec3& p);
+
+/* runs the traversal from the camera described by view and proj. a camera
+outside every cell sees every cell its frustum touches */
+void portal_visibility (const PortalWorld& world, const mat4& view, const mat4& proj, PortalVisibility* out);
+
+/* true if box is inside any frustum the cell was seen through */
+bool portal_cell_test_aabb (const PortalVisibility& vis, int cell, const Aabb& box);
+
+#endif //FPS_STYLE_ROOM_PORTALS_H
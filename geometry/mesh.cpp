@@ -0,0 +1,126 @@
+//
+// Bounds, vertex normals, triangle soup conversion and the .obj reader. See
+// mesh.h.
+//
+
+#include "mesh.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+Aabb mesh_bounds (const Mesh& mesh) {
+    Aabb b = aabb_empty ();
+    for (size_t i = 0; i < mesh.positions.size (); i++) {
+        aabb_grow (&b, mesh.positions[i]);
+    }
+    return b;
+}
+
+/* centre of the box and the furthest vertex from it. not minimal, but cheap
+and stable, which is what LOD selection wants */
+Sphere mesh_bounding_sphere (const Mesh& mesh) {
+    Sphere s;
+    s.center = aabb_center (mesh_bounds (mesh));
+    float r2 = 0.0f;
+    for (size_t i = 0; i < mesh.positions.size (); i++) {
+        r2 = fmaxf (r2, get_squared_dist (s.center, mesh.positions[i]));
+    }
+    s.radius = sqrtf (r2);
+    return s;
+}
+
+unsigned int mesh_triangle_count (const Mesh& mesh) {
+    return (unsigned int)(mesh.indices.size () / 3);
+}
+
+void mesh_vertex_normals (const Mesh& mesh, std::vector<vec3>* out) {
+    out->assign (mesh.positions.size (), vec3 (0.0f, 0.0f, 0.0f));
+    for (size_t i = 0; i + 2 < mesh.indices.size (); i += 3) {
+        const vec3& a = mesh.positions[mesh.indices[i]];
+        // the unnormalised cross product is twice the area, which is the weight
+        vec3 n = cross (mesh.positions[mesh.indices[i + 1]] - a, mesh.positions[mesh.indices[i + 2]] - a);
+        for (int k = 0; k < 3; k++) {
+            (*out)[mesh.indices[i + k]] += n;
+        }
+    }
+    for (size_t i = 0; i < out->size (); i++) {
+        float len2 = length2 ((*out)[i]);
+        (*out)[i] = len2 > 0.0f ? (*out)[i] * (1.0f / sqrtf (len2)) : vec3 (0.0f, 1.0f, 0.0f);
+    }
+}
+
+void mesh_from_triangle_soup (const float* xyz, unsigned int vertex_count, Mesh* out) {
+    out->positions.resize (vertex_count);
+    out->indices.resize (vertex_count - vertex_count % 3);
+    for (unsigned int i = 0; i < vertex_count; i++) {
+        out->positions[i] = vec3 (xyz[i * 3], xyz[i * 3 + 1], xyz[i * 3 + 2]);
+    }
+    for (unsigned int i = 0; i < out->indices.size (); i++) {
+        out->indices[i] = i;
+    }
+}
+
+bool mesh_load_obj (const char* path, Mesh* out) {
+    FILE* f = fopen (path, "r");
+    if (!f) {
+        fprintf (stderr, "ERROR: could not open %s\n", path);
+        return false;
+    }
+    out->positions.clear ();
+    out->indices.clear ();
+    char line[1024];
+    while (fgets (line, sizeof (line), f)) {
+        if (line[0] == 'v' && line[1] == ' ') {
+            vec3 p;
+            if (sscanf (line + 2, "%f %f %f", &p.v[0], &p.v[1], &p.v[2]) == 3) {
+                out->positions.push_back (p);
+            }
+        } else if (line[0] == 'f' && line[1] == ' ') {
+            // "f a b c ...", each corner may be a/b/c. fan out polygons
+            unsigned int corner[64];
+            int count = 0;
+            char* tok = strtok (line + 2, " \t\r\n");
+            while (tok && count < 64) {
+                long idx = strtol (tok, NULL, 10);
+                if (idx < 0) {
+                    idx = (long)out->positions.size () + idx + 1;
+                }
+                if (idx <= 0 || idx > (long)out->positions.size ()) {
+                    fprintf (stderr, "ERROR: bad face index in %s\n", path);
+                    fclose (f);
+                    return false;
+                }
+                corner[count++] = (unsigned int)(idx - 1);
+                tok = strtok (NULL, " \t\r\n");
+            }
+            for (int i = 2; i < count; i++) {
+                out->indices.push_back (corner[0]);
+                out->indices.push_back (corner[i - 1]);
+                out->indices.push_back (corner[i]);
+            }
+        }
+    }
+    fclose (f);
+    return true;
+}
+
+bool mesh_save_obj (const char* path, const Mesh& mesh) {
+    FILE* f = fopen (path, "w");
+    if (!f) {
+        fprintf (stderr, "ERROR: could not open %s for writing\n", path);
+        return false;
+    }
+    for (size_t i = 0; i < mesh.positions.size (); i++) {
+        const vec3& p = mesh.positions[i];
+        fprintf (f, "v %.9g %.9g %.9g\n", p.v[0], p.v[1], p.v[2]);
+    }
+    for (size_t i = 0; i + 2 < mesh.indices.size (); i += 3) {
+        fprintf (f, "f %u %u %u\n", mesh.indices[i] + 1, mesh.indices[i + 1] + 1, mesh.indices[i + 2] + 1);
+    }
+    bool ok = !ferror (f);
+    fclose (f);
+    if (!ok) {
+        fprintf (stderr, "ERROR: could not write %s\n", path);
+    }
+    return ok;
+}
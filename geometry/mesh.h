@@ -0,0 +1,89 @@
+//
+// Plain indexed triangle mesh and bounding volumes shared by the geometry
+// processing code (LOD, culling, picking, navmesh).
+//
+
+#ifndef FPS_STYLE_ROOM_MESH_H
+#define FPS_STYLE_ROOM_MESH_H
+
+#include <vector>
+#include <utils/maths_funcs.h>
+
+struct Aabb {
+    vec3 min;
+    vec3 max;
+};
+
+struct Sphere {
+    vec3 center;
+    float radius;
+};
+
+/* positions plus a triangle list. indices are always a multiple of 3 */
+struct Mesh {
+    std::vector<vec3> positions;
+    std::vector<unsigned int> indices;
+};
+
+inline Aabb aabb_empty () {
+    Aabb b;
+    b.min = vec3 (1e30f, 1e30f, 1e30f);
+    b.max = vec3 (-1e30f, -1e30f, -1e30f);
+    return b;
+}
+
+inline void aabb_grow (Aabb* b, const vec3& p) {
+    for (int i = 0; i < 3; i++) {
+        b->min.v[i] = fminf (b->min.v[i], p.v[i]);
+        b->max.v[i] = fmaxf (b->max.v[i], p.v[i]);
+    }
+}
+
+inline void aabb_merge (Aabb* b, const Aabb& other) {
+    aabb_grow (b, other.min);
+    aabb_grow (b, other.max);
+}
+
+inline vec3 aabb_center (const Aabb& b) {
+    return (b.min + b.max) * 0.5f;
+}
+
+inline vec3 aabb_extent (const Aabb& b) {
+    return (b.max - b.min) * 0.5f;
+}
+
+inline bool aabb_overlap (const Aabb& a, const Aabb& b) {
+    return a.min.v[0] <= b.max.v[0] && a.max.v[0] >= b.min.v[0] &&
+           a.min.v[1] <= b.max.v[1] && a.max.v[1] >= b.min.v[1] &&
+           a.min.v[2] <= b.max.v[2] && a.max.v[2] >= b.min.v[2];
+}
+
+/* bounds of the 8 corners of b after an affine transform */
+inline Aabb aabb_transform (const Aabb& b, const mat4& m) {
+    // Arvo's method: each output axis is the sum of the min/max of each column
+    Aabb r;
+    for (int i = 0; i < 3; i++) {
+        r.min.v[i] = r.max.v[i] = m.m[12 + i];
+        for (int j = 0; j < 3; j++) {
+            float e = m.m[j * 4 + i] * b.min.v[j];
+            float f = m.m[j * 4 + i] * b.max.v[j];
+            r.min.v[i] += fminf (e, f);
+            r.max.v[i] += fmaxf (e, f);
+        }
+    }
+    return r;
+}
+
+Aabb mesh_bounds (const Mesh& mesh);
+Sphere mesh_bounding_sphere (const Mesh& mesh);
+unsigned int mesh_triangle_count (const Mesh& mesh);
+/* smooth per-vertex normals, the area weighted sum of the adjacent faces */
+void mesh_vertex_normals (const Mesh& mesh, std::vector<vec3>* out);
+/* build a mesh from an unindexed xyz float array like main.cpp's points[] */
+void mesh_from_triangle_soup (const float* xyz, unsigned int vertex_count, Mesh* out);
+/* minimal wavefront .obj reader: "v" and "f" lines, polygons are fanned */
+bool mesh_load_obj (const char* path, Mesh* out);
+/* writes "v" and "f" lines, what mesh_load_obj reads back */
+bool mesh_save_obj (const char* path, const Mesh& mesh);
+
+#endif //FPS_STYLE_ROOM_MESH_H
@@ -0,0 +1,364 @@
+//
+// Chase-Lev work-stealing deques and the worker loop. See job_system.h.
+//
+// The deque follows "Correct and Efficient Work-Stealing for Weak Memory
+// Models" (Le, Pop, Cohen, Zappa Nardelli 2013), with a fixed size ring
+// instead of a growable one. A full deque runs the job inline instead.
+//
+
+#include "job_system.h"
+#include <memory/memory_tracker.h>
+#include <condition_variable>
+#include <thread>
+#include <stdio.h>
+
+#define JOB_DEQUE_SIZE 4096 // power of two
+// jobs in flight per worker before the ring wraps. a job is in flight from
+// job_alloc until it is popped or stolen: it runs from a copy, because a long
+// job may outlive its slot. so only the deque holds slots, and twice the
+// deque is room enough. parked continuations live in their counter instead,
+// see JobContinuation
+#define JOB_POOL_SIZE 8192
+
+static_assert (JOB_POOL_SIZE >= 2 * JOB_DEQUE_SIZE, "a job ring must outlast its deque");
+
+struct Job {
+    JobFunc fn;
+    void* data;
+    JobCounter* counter;
+    MemoryTag tag;               // the queuing thread's, for what the job allocates
+};
+
+struct JobDeque {
+    std::atomic<long long> top;
+    std::atomic<long long> bottom;
+    std::atomic<Job*> ring[JOB_DEQUE_SIZE];
+};
+
+struct Worker {
+    JobDeque deque;
+    Job pool[JOB_POOL_SIZE];
+    unsigned int pool_next;
+    unsigned int rng;
+    std::thread thread;
+};
+
+static Worker* workers = NULL;
+static int worker_count = 0;
+static std::atomic<bool> running (false);
+static std::mutex sleep_lock;
+static std::condition_variable wake;
+static std::atomic<int> sleepers (0);
+static thread_local int this_worker = -1;
+
+/*-----------------------------------DEQUE------------------------------------*/
+static void deque_init (JobDeque* d) {
+    d->top.store (0);
+    d->bottom.store (0);
+    for (int i = 0; i < JOB_DEQUE_SIZE; i++) {
+        d->ring[i].store (NULL, std::memory_order_relaxed);
+    }
+}
+
+/* owner only */
+static bool deque_push (JobDeque* d, Job* job) {
+    long long b = d->bottom.load (std::memory_order_relaxed);
+    long long t = d->top.load (std::memory_order_acquire);
+    if (b - t >= JOB_DEQUE_SIZE) {
+        return false;
+    }
+    d->ring[b & (JOB_DEQUE_SIZE - 1)].store (job, std::memory_order_relaxed);
+    // release publishes the job's fields to whoever steals it
+    d->bottom.store (b + 1, std::memory_order_release);
+    return true;
+}
+
+/* owner only */
+static Job* deque_pop (JobDeque* d) {
+    long long b = d->bottom.load (std::memory_order_relaxed) - 1;
+    d->bottom.store (b, std::memory_order_relaxed);
+    std::atomic_thread_fence (std::memory_order_seq_cst);
+    long long t = d->top.load (std::memory_order_relaxed);
+    if (t > b) {
+        d->bottom.store (b + 1, std::memory_order_relaxed);
+        return NULL;
+    }
+    Job* job = d->ring[b & (JOB_DEQUE_SIZE - 1)].load (std::memory_order_relaxed);
+    if (t == b) {
+        // last one: race the thieves for it
+        if (!d->top.compare_exchange_strong (t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            job = NULL;
+        }
+        d->bottom.store (b + 1, std::memory_order_relaxed);
+    }
+    return job;
+}
+
+/* any thread */
+static Job* deque_steal (JobDeque* d) {
+    long long t = d->top.load (std::memory_order_acquire);
+    std::atomic_thread_fence (std::memory_order_seq_cst);
+    long long b = d->bottom.load (std::memory_order_acquire);
+    if (t >= b) {
+        return NULL;
+    }
+    Job* job = d->ring[t & (JOB_DEQUE_SIZE - 1)].load (std::memory_order_relaxed);
+    if (!d->top.compare_exchange_strong (t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+        return NULL;
+    }
+    return job;
+}
+
+/*-----------------------------------JOBS-------------------------------------*/
+static Job* job_alloc (JobFunc fn, void* data, JobCounter* counter) {
+    Worker* w = &workers[this_worker];
+    Job* job = &w->pool[w->pool_next++ & (JOB_POOL_SIZE - 1)];
+    job->fn = fn;
+    job->data = data;
+    job->counter = counter;
+    job->tag = memory_current_tag ();
+    return job;
+}
+
+static void job_submit (Job* job);
+
+/* by value: the slot it came from may be reused while fn runs */
+static void job_execute (Job job) {
+    {
+        MemoryScope scope (job.tag);
+        job.fn (job.data);
+    }
+    JobCounter* counter = job.counter;
+    if (!counter) {
+        return;
+    }
+    // decrement under the lock: job_wait takes it once after seeing zero, so
+    // the waiter can't free the counter while we are still inside it
+    std::vector<JobContinuation> ready;
+    {
+        std::lock_guard<std::mutex> guard (counter->continuation_lock);
+        if (counter->value.fetch_sub (1, std::memory_order_acq_rel) == 1) {
+            ready.swap (counter->continuations);
+        }
+    }
+    // hit zero: release anything that was waiting on this counter
+    for (size_t i = 0; i < ready.size (); i++) {
+        const JobContinuation& c = ready[i];
+        if (this_worker < 0) {
+            Job job = {c.fn, c.data, c.counter, c.tag};
+            job_execute (job);
+            continue;
+        }
+        Job* job = job_alloc (c.fn, c.data, c.counter);
+        job->tag = c.tag;
+        job_submit (job);
+    }
+}
+
+static void job_submit (Job* job) {
+    if (this_worker < 0 || !deque_push (&workers[this_worker].deque, job)) {
+        job_execute (*job); // not a worker, or deque full: don't block
+        return;
+    }
+    if (sleepers.load (std::memory_order_relaxed) > 0) {
+        wake.notify_one ();
+    }
+}
+
+/* copies the job out of its slot straight away, see job_execute */
+static bool find_job (int self, Job* out) {
+    Worker* w = &workers[self];
+    Job* job = deque_pop (&w->deque);
+    if (job) {
+        *out = *job;
+        return true;
+    }
+    // xorshift for the victim so workers don't all hammer the same deque
+    for (int attempt = 0; attempt < worker_count; attempt++) {
+        w->rng ^= w->rng << 13;
+        w->rng ^= w->rng >> 17;
+        w->rng ^= w->rng << 5;
+        int victim = (int)(w->rng % (unsigned int)worker_count);
+        if (victim == self) {
+            continue;
+        }
+        job = deque_steal (&workers[victim].deque);
+        if (job) {
+            *out = *job;
+            return true;
+        }
+    }
+    return false;
+}
+
+static void worker_main (int index) {
+    this_worker = index;
+    int idle = 0;
+    while (running.load (std::memory_order_acquire)) {
+        Job job;
+        if (find_job (index, &job)) {
+            job_execute (job);
+            idle = 0;
+            continue;
+        }
+        if (++idle < 64) {
+            std::this_thread::yield ();
+            continue;
+        }
+        // nothing for a while: sleep until a push wakes us. the timeout covers
+        // a wake-up that lands between our last look and the wait
+        std::unique_lock<std::mutex> lock (sleep_lock);
+        sleepers++;
+        wake.wait_for (lock, std::chrono::milliseconds (1));
+        sleepers--;
+        idle = 0;
+    }
+}
+
+/*----------------------------------PUBLIC------------------------------------*/
+void job_system_init (int count) {
+    if (workers) {
+        return;
+    }
+    MemoryScope scope (MEMORY_JOBS);
+    if (count <= 0) {
+        count = (int)std::thread::hardware_concurrency ();
+        if (count <= 0) {
+            count = 1;
+        }
+    }
+    worker_count = count;
+    workers = new Worker[count];
+    for (int i = 0; i < count; i++) {
+        deque_init (&workers[i].deque);
+        workers[i].pool_next = 0;
+        workers[i].rng = 0x9E3779B9u * (unsigned int)(i + 1);
+    }
+    this_worker = 0;
+    running.store (true);
+    for (int i = 1; i < count; i++) {
+        workers[i].thread = std::thread (worker_main, i);
+    }
+}
+
+void job_system_shutdown () {
+    if (!workers) {
+        return;
+    }
+    running.store (false);
+    wake.notify_all ();
+    for (int i = 1; i < worker_count; i++) {
+        workers[i].thread.join ();
+    }
+    delete[] workers;
+    workers = NULL;
+    worker_count = 0;
+    this_worker = -1;
+}
+
+int job_system_worker_count () {
+    return workers ? worker_count : 1;
+}
+
+int job_system_worker_index () {
+    return this_worker;
+}
+
+void job_run (JobFunc fn, void* data, JobCounter* counter) {
+    if (counter) {
+        counter->value.fetch_add (1, std::memory_order_relaxed);
+    }
+    if (!workers || this_worker < 0) {
+        Job job = {fn, data, counter, memory_current_tag ()};
+        job_execute (job);
+        return;
+    }
+    job_submit (job_alloc (fn, data, counter));
+}
+
+void job_run_after (JobCounter* dependency, JobFunc fn, void* data, JobCounter* counter) {
+    if (counter) {
+        counter->value.fetch_add (1, std::memory_order_relaxed);
+    }
+    if (!workers || this_worker < 0) {
+        job_wait (dependency);
+        Job job = {fn, data, counter, memory_current_tag ()};
+        job_execute (job);
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> guard (dependency->continuation_lock);
+        if (dependency->value.load (std::memory_order_acquire) != 0) {
+            JobContinuation c = {fn, data, counter, memory_current_tag ()};
+            dependency->continuations.push_back (c);
+            return;
+        }
+    }
+    job_submit (job_alloc (fn, data, counter));
+}
+
+void job_wait (JobCounter* counter) {
+    while (counter->value.load (std::memory_order_acquire) != 0) {
+        if (!workers || this_worker < 0) {
+            std::this_thread::yield ();
+            continue;
+        }
+        Job job;
+        if (find_job (this_worker, &job)) {
+            job_execute (job);
+        } else {
+            std::this_thread::yield ();
+        }
+    }
+    // the last job may still be unlocking the counter
+    std::lock_guard<std::mutex> guard (counter->continuation_lock);
+}
+
+struct RangeChunk {
+    JobRangeFunc fn;
+    void* data;
+    int begin;
+    int end;
+};
+
+static void run_chunk (void* data) {
+    RangeChunk* c = (RangeChunk*)data;
+    c->fn (c->begin, c->end, c->data);
+}
+
+void parallel_for (int count, int grain, JobRangeFunc fn, void* data) {
+    if (count <= 0) {
+        return;
+    }
+    if (grain < 1) {
+        grain = 1;
+    }
+    int workers_now = job_system_worker_count ();
+    if (!workers || this_worker < 0 || workers_now == 1 || count <= grain) {
+        fn (0, count, data);
+        return;
+    }
+    // a few chunks per worker so stealing can even out uneven chunks, but never
+    // smaller than grain
+    int chunks = (count + grain - 1) / grain;
+    if (chunks > workers_now * 4) {
+        chunks = workers_now * 4;
+    }
+    std::vector<RangeChunk> ranges ((size_t)chunks);
+    JobCounter counter;
+    int step = count / chunks, extra = count % chunks, begin = 0;
+    for (int i = 0; i < chunks; i++) {
+        int size = step + (i < extra ? 1 : 0);
+        ranges[i].fn = fn;
+        ranges[i].data = data;
+        ranges[i].begin = begin;
+        ranges[i].end = begin + size;
+        begin += size;
+    }
+    // keep the first chunk for ourselves
+    for (int i = 1; i < chunks; i++) {
+        job_run (run_chunk, &ranges[i], &counter);
+    }
+    run_chunk (&ranges[0]);
+    job_wait (&counter);
+}
@@ -0,0 +1,79 @@
+//
+// Work-stealing job system.
+//
+// One worker per core. Worker 0 is the thread that called job_system_init,
+// normally the main thread, so GL calls stay on it: it only runs other jobs
+// while it is waiting in job_wait. Each worker owns a Chase-Lev deque. It
+// pushes and pops its own jobs at the bottom, while idle workers steal from the
+// top of a random victim.
+//
+// Jobs are a function pointer plus a data pointer. Completion is tracked with
+// JobCounter. Every job launched against a counter increments it and
+// decrements it when the job finishes. job_wait (counter) runs jobs until the
+// counter reaches zero. job_run_after holds a job back until another counter
+// reaches zero, which is how dependencies between frame stages are expressed.
+// A job runs under the memory tag (memory/memory_tracker.h) of the thread
+// that queued it, so what it allocates is charged to the caller.
+//
+// parallel_for splits an index range into chunks and waits for all of them.
+//
+
+#ifndef FPS_STYLE_ROOM_JOB_SYSTEM_H
+#define FPS_STYLE_ROOM_JOB_SYSTEM_H
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <memory/memory_tracker.h>
+
+typedef void (*JobFunc) (void* data);
+typedef void (*JobRangeFunc) (int begin, int end, void* data);
+
+/* a job held back by job_run_after. kept by value: the worker job rings wrap,
+and a continuation may wait any number of jobs */
+struct JobContinuation {
+    JobFunc fn;
+    void* data;
+    struct JobCounter* counter;
+    MemoryTag tag;
+};
+
+struct JobCounter {
+    JobCounter () : value (0) {}
+    std::atomic<int> value;
+    // jobs waiting for value to reach zero, see job_run_after
+    std::mutex continuation_lock;
+    std::vector<JobContinuation> continuations;
+};
+
+/* worker_count includes the calling thread. 0 means one per hardware thread */
+void job_system_init (int worker_count);
+void job_system_shutdown ();
+int job_system_worker_count ();
+/* 0 on the thread that called job_system_init, 1..n-1 on the others. -1 on
+threads the job system doesn't know about */
+int job_system_worker_index ();
+
+/* queue fn (data). counter may be NULL */
+void job_run (JobFunc fn, void* data, JobCounter* counter);
+/* queue fn (data) once dependency reaches zero */
+void job_run_after (JobCounter* dependency, JobFunc fn, void* data, JobCounter* counter);
+/* run jobs on this thread until counter reaches zero */
+void job_wait (JobCounter* counter);
+
+/* fn (begin, end, data) over [0, count) in chunks of at least grain indices.
+returns once every chunk has run. runs inline if the job system isn't up */
+void parallel_for (int count, int grain, JobRangeFunc fn, void* data);
+
+/* the same with any callable taking (int begin, int end) */
+template <typename Fn>
+static void parallel_for_each (int count, int grain, const Fn& fn) {
+    struct Thunk {
+        static void run (int begin, int end, void* data) {
+            (*(const Fn*)data) (begin, end);
+        }
+    };
+    parallel_for (count, grain, Thunk::run, (void*)&fn);
+}
+
+#endif //FPS_STYLE_ROOM_JOB_SYSTEM_H
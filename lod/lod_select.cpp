@@ -0,0 +1,107 @@
+//
+// Screen size driven LOD selection with hysteresis. See lod_select.h.
+//
+
+#include "lod_select.h"
+#include <jobs/job_system.h>
+#include <mutex>
+#include <string.h>
+
+// keep the budget controller from blurring everything or never backing off
+static const float LOD_BIAS_MIN = 1.0f;
+static const float LOD_BIAS_MAX = 64.0f;
+
+LodSelectParams lod_params_from_perspective (float fovy_deg, int viewport_height, float tolerance_px) {
+    LodSelectParams p;
+    float sy = 1.0f / tanf (fovy_deg * MATHS_DEG_TO_RAD * 0.5f);
+    p.pixels_per_unit = sy * (float)viewport_height * 0.5f;
+    p.tolerance_px = tolerance_px;
+    p.hysteresis = 0.15f;
+    p.bias = 1.0f;
+    return p;
+}
+
+LodSelectParams lod_params_from_projection (const mat4& proj, int viewport_height, float tolerance_px) {
+    LodSelectParams p;
+    p.pixels_per_unit = proj.m[5] * (float)viewport_height * 0.5f;
+    p.tolerance_px = tolerance_px;
+    p.hysteresis = 0.15f;
+    p.bias = 1.0f;
+    return p;
+}
+
+int lod_select (LodInstance* inst, const vec3& camera_pos, const LodSelectParams& p) {
+    const LodMesh* mesh = inst->mesh;
+    float radius = mesh->bounds.radius * inst->world_scale;
+    // distance to the sphere, not its centre, so the camera inside an object
+    // always gets full detail
+    float dist = length (inst->world_center - camera_pos) - radius;
+    if (dist <= 0.0f) {
+        inst->current_level = 0;
+        return 0;
+    }
+    // pixels per object space unit of error at this distance
+    float px_per_err = inst->world_scale * p.pixels_per_unit / dist;
+    float tol = p.tolerance_px * p.bias;
+    float coarser_limit = tol * (1.0f - p.hysteresis);
+    float finer_limit = tol * (1.0f + p.hysteresis);
+
+    int level = inst->current_level;
+    if (level >= mesh->level_count) {
+        level = mesh->level_count - 1;
+    }
+    while (level + 1 < mesh->level_count && mesh->levels[level + 1].error * px_per_err <= coarser_limit) {
+        level++;
+    }
+    while (level > 0 && mesh->levels[level].error * px_per_err > finer_limit) {
+        level--;
+    }
+    inst->current_level = level;
+    return level;
+}
+
+void lod_select_all (LodInstance* instances, int count, const vec3& camera_pos, const LodSelectParams& p,
+                     LodFrameStats* stats) {
+    LodFrameStats total;
+    memset (&total, 0, sizeof (total));
+    std::mutex total_lock;
+    // every instance only touches its own current_level, chunks just count
+    // locally and merge once at the end
+    parallel_for_each (count, 512, [&] (int begin, int end) {
+        LodFrameStats local;
+        memset (&local, 0, sizeof (local));
+        for (int i = begin; i < end; i++) {
+            int level = lod_select (&instances[i], camera_pos, p);
+            const LodMesh* mesh = instances[i].mesh;
+            local.objects++;
+            local.triangles += mesh->levels[level].index_count / 3;
+            local.full_detail_triangles += mesh->levels[0].index_count / 3;
+            local.per_level[level]++;
+        }
+        std::lock_guard<std::mutex> guard (total_lock);
+        total.objects += local.objects;
+        total.triangles += local.triangles;
+        total.full_detail_triangles += local.full_detail_triangles;
+        for (int l = 0; l < LOD_MAX_LEVELS; l++) {
+            total.per_level[l] += local.per_level[l];
+        }
+    });
+    if (stats) {
+        *stats = total;
+    }
+}
+
+void lod_budget_update (LodSelectParams* p, const LodFrameStats& stats, unsigned int triangle_budget) {
+    if (triangle_budget == 0) {
+        return;
+    }
+    // proportional step in log space, damped so the bias settles instead of
+    // bouncing between two levels every other frame
+    float ratio = (float)stats.triangles / (float)triangle_budget;
+    if (ratio > 1.0f) {
+        p->bias *= 1.0f + 0.25f * fminf (ratio - 1.0f, 1.0f);
+    } else if (ratio < 0.85f) {
+        p->bias *= 1.0f - 0.1f * (0.85f - ratio);
+    }
+    p->bias = fmaxf (LOD_BIAS_MIN, fminf (LOD_BIAS_MAX, p->bias));
+}
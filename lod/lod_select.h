@@ -0,0 +1,69 @@
+//
+// Runtime LOD selection.
+//
+// An object's projected size comes straight from the projection: with
+// Sy = proj.m[5] = 1 / tan (fovy / 2), a length L at distance d from the camera
+// covers L * Sy * (viewport_height / 2) / d pixels. Each level stores the object
+// space error it was simplified to, so the level's error in pixels follows from
+// the same scale. The coarsest level whose pixel error is under the tolerance
+// is picked.
+//
+// Hysteresis: an object moves to a coarser level only once that level is under
+// tolerance * (1 - hysteresis), and back to a finer one only once its current
+// level is over tolerance * (1 + hysteresis). Objects sitting at a transition
+// distance therefore do not flicker between levels.
+//
+// lod_budget_update keeps the total submitted triangle count under a budget by
+// scaling the tolerance from frame to frame.
+//
+
+#ifndef FPS_STYLE_ROOM_LOD_SELECT_H
+#define FPS_STYLE_ROOM_LOD_SELECT_H
+
+#include <lod/mesh_simplify.h>
+
+struct LodSelectParams {
+    float pixels_per_unit; // Sy * viewport_height / 2: pixels covered by 1 unit at distance 1
+    float tolerance_px;    // allowed screen space error
+    float hysteresis;      // fraction of tolerance, 0.1 - 0.25 works well
+    float bias;            // tolerance multiplier driven by the triangle budget
+};
+
+/* one drawable using a LodMesh. current_level carries the hysteresis state
+between frames, start it at 0 */
+struct LodInstance {
+    const LodMesh* mesh;
+    vec3 world_center;   // world position of mesh->bounds.center
+    float world_scale;   // largest axis scale of the model matrix
+    int current_level;
+};
+
+struct LodFrameStats {
+    unsigned int objects;
+    unsigned int triangles;
+    unsigned int full_detail_triangles; // what level 0 everywhere would have cost
+    unsigned int per_level[LOD_MAX_LEVELS];
+};
+
+/* from the same numbers main.cpp builds its projection with (fovy in degrees) */
+LodSelectParams lod_params_from_perspective (float fovy_deg, int viewport_height, float tolerance_px);
+/* or from the projection matrix itself */
+LodSelectParams lod_params_from_projection (const mat4& proj, int viewport_height, float tolerance_px);
+
+/* projected diameter in pixels of a sphere at camera distance dist */
+inline float lod_screen_size (const LodSelectParams& p, float radius, float dist) {
+    return 2.0f * radius * p.pixels_per_unit / (dist > 1e-4f ? dist : 1e-4f);
+}
+
+/* picks a level for one object, updating current_level */
+int lod_select (LodInstance* inst, const vec3& camera_pos, const LodSelectParams& p);
+
+/* selects every instance in parallel on the job system and fills stats
+(stats may be NULL) */
+void lod_select_all (LodInstance* instances, int count, const vec3& camera_pos, const LodSelectParams& p,
+                     LodFrameStats* stats);
+
+/* nudges p->bias so next frame's triangle count moves towards budget */
+void lod_budget_update (LodSelectParams* p, const LodFrameStats& stats, unsigned int triangle_budget);
+
+#endif //FPS_STYLE_ROOM_LOD_SELECT_H
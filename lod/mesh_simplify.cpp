@@ -0,0 +1,424 @@
+//
+// Quadric error metric simplification. See mesh_simplify.h.
+//
+
+#include "mesh_simplify.h"
+#include <memory/memory_tracker.h>
+#include <queue>
+#include <unordered_map>
+#include <stdio.h>
+#include <string.h>
+
+// boundary edges get a plane perpendicular to their face so the outline of an
+// open mesh (a floor, a doorway) does not shrink away. weighted up against
+// the face planes so border vertices are collapsed last. a constant, like the
+// face planes' 1, so every cost stays a squared distance: moving off the
+// border counts this many times over, and the level error is a bound
+static const double BOUNDARY_WEIGHT = 10.0;
+// reject a collapse if any surviving triangle turns by more than ~78 degrees
+static const float FLIP_COS_LIMIT = 0.2f;
+
+/* symmetric 4x4 matrix, upper triangle: a2 ab ac ad b2 bc bd c2 cd d2 */
+struct Quadric {
+    double q[10];
+};
+
+static void quadric_zero (Quadric* q) {
+    memset (q->q, 0, sizeof (q->q));
+}
+
+static void quadric_add_plane (Quadric* q, double a, double b, double c, double d, double w) {
+    q->q[0] += w * a * a;
+    q->q[1] += w * a * b;
+    q->q[2] += w * a * c;
+    q->q[3] += w * a * d;
+    q->q[4] += w * b * b;
+    q->q[5] += w * b * c;
+    q->q[6] += w * b * d;
+    q->q[7] += w * c * c;
+    q->q[8] += w * c * d;
+    q->q[9] += w * d * d;
+}
+
+static void quadric_add (Quadric* q, const Quadric& r) {
+    for (int i = 0; i < 10; i++) {
+        q->q[i] += r.q[i];
+    }
+}
+
+/* sum of squared distances from p to every plane folded into q */
+static double quadric_eval (const Quadric& q, const Quadric& r, const vec3& p) {
+    double a[10];
+    for (int i = 0; i < 10; i++) {
+        a[i] = q.q[i] + r.q[i];
+    }
+    double x = p.v[0], y = p.v[1], z = p.v[2];
+    double e = a[0] * x * x + 2.0 * a[1] * x * y + 2.0 * a[2] * x * z + 2.0 * a[3] * x +
+               a[4] * y * y + 2.0 * a[5] * y * z + 2.0 * a[6] * y +
+               a[7] * z * z + 2.0 * a[8] * z +
+               a[9];
+    return e > 0.0 ? e : 0.0;
+}
+
+struct Collapse {
+    float cost;
+    unsigned int from;
+    unsigned int to;
+    unsigned int from_version;
+    unsigned int to_version;
+    bool operator< (const Collapse& rhs) const {
+        return cost > rhs.cost; // priority_queue pops the cheapest first
+    }
+};
+
+struct EdgeKey {
+    unsigned long long k;
+    EdgeKey (unsigned int a, unsigned int b) {
+        k = a < b ? ((unsigned long long)a << 32) | b : ((unsigned long long)b << 32) | a;
+    }
+    bool operator== (const EdgeKey& rhs) const {
+        return k == rhs.k;
+    }
+};
+
+struct EdgeKeyHash {
+    size_t operator() (const EdgeKey& e) const {
+        return (size_t)(e.k * 0x9E3779B97F4A7C15ull >> 17);
+    }
+};
+
+struct PositionKey {
+    unsigned int bits[3];
+    bool operator== (const PositionKey& rhs) const {
+        return bits[0] == rhs.bits[0] && bits[1] == rhs.bits[1] && bits[2] == rhs.bits[2];
+    }
+};
+
+struct PositionKeyHash {
+    size_t operator() (const PositionKey& k) const {
+        return (size_t)((k.bits[0] * 73856093u) ^ (k.bits[1] * 19349663u) ^ (k.bits[2] * 83492791u));
+    }
+};
+
+struct Simplifier {
+    const std::vector<vec3>* positions;
+    std::vector<unsigned int> tris;           // 3 per triangle
+    std::vector<bool> tri_alive;
+    std::vector<std::vector<unsigned int> > vertex_tris;
+    std::vector<Quadric> quadrics;
+    std::vector<unsigned int> version;
+    std::vector<bool> vertex_alive;
+    std::priority_queue<Collapse> heap;
+    unsigned int live_tris;
+    float max_error;
+};
+
+static vec3 triangle_normal_raw (const vec3& a, const vec3& b, const vec3& c) {
+    return cross (b - a, c - a);
+}
+
+/* weld vertices with bit-identical positions so the surface is connected.
+the representative is always an original index, so no vertex data moves */
+static void weld (const Mesh& src, std::vector<unsigned int>* rep) {
+    std::unordered_map<PositionKey, unsigned int, PositionKeyHash> seen;
+    seen.reserve (src.positions.size ());
+    rep->resize (src.positions.size ());
+    for (unsigned int i = 0; i < src.positions.size (); i++) {
+        PositionKey key;
+        memcpy (key.bits, src.positions[i].v, sizeof (key.bits));
+        (*rep)[i] = seen.insert (std::make_pair (key, i)).first->second;
+    }
+}
+
+static void collapse_cost (const Simplifier& s, unsigned int a, unsigned int b, Collapse* out) {
+    const std::vector<vec3>& p = *s.positions;
+    double ab = quadric_eval (s.quadrics[a], s.quadrics[b], p[b]); // a moves onto b
+    double ba = quadric_eval (s.quadrics[a], s.quadrics[b], p[a]); // b moves onto a
+    if (ab <= ba) {
+        out->from = a;
+        out->to = b;
+        out->cost = (float)ab;
+    } else {
+        out->from = b;
+        out->to = a;
+        out->cost = (float)ba;
+    }
+    out->from_version = s.version[out->from];
+    out->to_version = s.version[out->to];
+}
+
+/* would moving "from" onto "to" fold any remaining triangle over? */
+static bool collapse_flips (const Simplifier& s, unsigned int from, unsigned int to) {
+    const std::vector<vec3>& p = *s.positions;
+    const std::vector<unsigned int>& around = s.vertex_tris[from];
+    for (size_t i = 0; i < around.size (); i++) {
+        unsigned int t = around[i];
+        if (!s.tri_alive[t]) {
+            continue;
+        }
+        const unsigned int* v = &s.tris[t * 3];
+        if (v[0] == to || v[1] == to || v[2] == to) {
+            continue; // this one disappears
+        }
+        vec3 before = triangle_normal_raw (p[v[0]], p[v[1]], p[v[2]]);
+        vec3 c[3];
+        for (int k = 0; k < 3; k++) {
+            c[k] = p[v[k] == from ? to : v[k]];
+        }
+        vec3 after = triangle_normal_raw (c[0], c[1], c[2]);
+        float lb = length (before), la = length (after);
+        if (la <= 1e-12f || dot (before, after) < FLIP_COS_LIMIT * lb * la) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void push_edges_around (Simplifier* s, unsigned int v) {
+    // drop dead triangles from the list while walking it
+    std::vector<unsigned int>& around = s->vertex_tris[v];
+    size_t keep = 0;
+    for (size_t i = 0; i < around.size (); i++) {
+        unsigned int t = around[i];
+        if (!s->tri_alive[t]) {
+            continue;
+        }
+        around[keep++] = t;
+        for (int k = 0; k < 3; k++) {
+            unsigned int n = s->tris[t * 3 + k];
+            if (n != v) {
+                Collapse c;
+                collapse_cost (*s, v, n, &c);
+                s->heap.push (c);
+            }
+        }
+    }
+    around.resize (keep);
+}
+
+static void do_collapse (Simplifier* s, const Collapse& c) {
+    std::vector<unsigned int>& around = s->vertex_tris[c.from];
+    for (size_t i = 0; i < around.size (); i++) {
+        unsigned int t = around[i];
+        if (!s->tri_alive[t]) {
+            continue;
+        }
+        unsigned int* v = &s->tris[t * 3];
+        if (v[0] == c.to || v[1] == c.to || v[2] == c.to) {
+            s->tri_alive[t] = false;
+            s->live_tris--;
+            continue;
+        }
+        for (int k = 0; k < 3; k++) {
+            if (v[k] == c.from) {
+                v[k] = c.to;
+            }
+        }
+        s->vertex_tris[c.to].push_back (t);
+    }
+    around.clear ();
+    s->vertex_alive[c.from] = false;
+    quadric_add (&s->quadrics[c.to], s->quadrics[c.from]);
+    s->version[c.to]++;
+    if (c.cost > s->max_error) {
+        s->max_error = c.cost;
+    }
+    push_edges_around (s, c.to);
+}
+
+static void emit_level (const Simplifier& s, LodMesh* out, float error) {
+    LodLevel* level = &out->levels[out->level_count++];
+    level->first_index = (unsigned int)out->indices.size ();
+    for (size_t t = 0; t < s.tri_alive.size (); t++) {
+        if (s.tri_alive[t]) {
+            out->indices.push_back (s.tris[t * 3]);
+            out->indices.push_back (s.tris[t * 3 + 1]);
+            out->indices.push_back (s.tris[t * 3 + 2]);
+        }
+    }
+    level->index_count = (unsigned int)out->indices.size () - level->first_index;
+    level->error = error;
+}
+
+bool lod_build (const Mesh& src, const float* ratios, int ratio_count, LodMesh* out) {
+    MemoryScope scope (MEMORY_LOD);
+    if (src.indices.size () % 3 != 0 || ratio_count + 1 > LOD_MAX_LEVELS) {
+        fprintf (stderr, "ERROR: lod_build needs a triangle list and at most %d levels\n", LOD_MAX_LEVELS);
+        return false;
+    }
+    out->positions = src.positions;
+    out->indices.clear ();
+    out->level_count = 0;
+    out->bounds = mesh_bounding_sphere (src);
+
+    // level 0 is the source, untouched
+    LodLevel* base = &out->levels[out->level_count++];
+    base->first_index = 0;
+    base->index_count = (unsigned int)src.indices.size ();
+    base->error = 0.0f;
+    out->indices = src.indices;
+
+    std::vector<unsigned int> rep;
+    weld (src, &rep);
+
+    Simplifier s;
+    s.positions = &src.positions;
+    s.vertex_tris.resize (src.positions.size ());
+    s.quadrics.resize (src.positions.size ());
+    s.version.assign (src.positions.size (), 0);
+    s.vertex_alive.assign (src.positions.size (), true);
+    s.max_error = 0.0f;
+    for (size_t i = 0; i < s.quadrics.size (); i++) {
+        quadric_zero (&s.quadrics[i]);
+    }
+
+    std::unordered_map<EdgeKey, unsigned int, EdgeKeyHash> edge_use;
+    edge_use.reserve (src.indices.size ());
+    for (size_t i = 0; i < src.indices.size (); i += 3) {
+        unsigned int a = rep[src.indices[i]], b = rep[src.indices[i + 1]], c = rep[src.indices[i + 2]];
+        if (a == b || b == c || a == c) {
+            continue;
+        }
+        vec3 n = triangle_normal_raw (src.positions[a], src.positions[b], src.positions[c]);
+        if (length2 (n) <= 0.0f) {
+            continue;
+        }
+        n = normalise (n);
+        double d = -dot (n, src.positions[a]);
+        unsigned int t = (unsigned int)(s.tris.size () / 3);
+        s.tris.push_back (a);
+        s.tris.push_back (b);
+        s.tris.push_back (c);
+        unsigned int corner[3] = {a, b, c};
+        for (int k = 0; k < 3; k++) {
+            quadric_add_plane (&s.quadrics[corner[k]], n.v[0], n.v[1], n.v[2], d, 1.0);
+            s.vertex_tris[corner[k]].push_back (t);
+            edge_use[EdgeKey (corner[k], corner[(k + 1) % 3])]++;
+        }
+    }
+    s.live_tris = (unsigned int)(s.tris.size () / 3);
+    s.tri_alive.assign (s.live_tris, true);
+
+    // boundary constraint planes
+    for (size_t t = 0; t < s.tri_alive.size (); t++) {
+        const unsigned int* v = &s.tris[t * 3];
+        vec3 n = normalise (triangle_normal_raw (src.positions[v[0]], src.positions[v[1]], src.positions[v[2]]));
+        for (int k = 0; k < 3; k++) {
+            unsigned int a = v[k], b = v[(k + 1) % 3];
+            if (edge_use[EdgeKey (a, b)] != 1) {
+                continue;
+            }
+            vec3 e = src.positions[b] - src.positions[a];
+            vec3 pn = normalise (cross (e, n));
+            double d = -dot (pn, src.positions[a]);
+            quadric_add_plane (&s.quadrics[a], pn.v[0], pn.v[1], pn.v[2], d, BOUNDARY_WEIGHT);
+            quadric_add_plane (&s.quadrics[b], pn.v[0], pn.v[1], pn.v[2], d, BOUNDARY_WEIGHT);
+        }
+    }
+
+    for (std::unordered_map<EdgeKey, unsigned int, EdgeKeyHash>::iterator it = edge_use.begin ();
+         it != edge_use.end (); ++it) {
+        Collapse c;
+        collapse_cost (s, (unsigned int)(it->first.k >> 32), (unsigned int)(it->first.k & 0xffffffffu), &c);
+        s.heap.push (c);
+    }
+
+    const unsigned int source_tris = s.live_tris;
+    int next = 0;
+    while (next < ratio_count) {
+        unsigned int target = (unsigned int)(ratios[next] * (float)source_tris);
+        if (s.live_tris <= target) {
+            emit_level (s, out, sqrtf (s.max_error));
+            next++;
+            continue;
+        }
+        if (s.heap.empty ()) {
+            break;
+        }
+        Collapse c = s.heap.top ();
+        s.heap.pop ();
+        if (!s.vertex_alive[c.from] || !s.vertex_alive[c.to] ||
+            c.from_version != s.version[c.from] || c.to_version != s.version[c.to]) {
+            continue; // stale entry, a fresher one is in the heap
+        }
+        if (collapse_flips (s, c.from, c.to)) {
+            continue;
+        }
+        do_collapse (&s, c);
+    }
+    // ran out of legal collapses: keep what we have if it is still a reduction
+    if (next < ratio_count) {
+        const LodLevel& last = out->levels[out->level_count - 1];
+        if (s.live_tris * 3 < last.index_count) {
+            emit_level (s, out, sqrtf (s.max_error));
+        }
+    }
+    return true;
+}
+
+void lod_extract_level (const LodMesh& lod, int level, Mesh* out) {
+    MemoryScope scope (MEMORY_LOD);
+    const LodLevel& l = lod.levels[level];
+    out->positions = lod.positions;
+    out->indices.assign (lod.indices.begin () + l.first_index,
+                         lod.indices.begin () + l.first_index + l.index_count);
+}
+
+/*--------------------------------FILE FORMAT---------------------------------*/
+static const char LOD_MAGIC[4] = {'L', 'O', 'D', '1'};
+
+bool lod_save (const char* path, const LodMesh& lod) {
+    FILE* f = fopen (path, "wb");
+    if (!f) {
+        fprintf (stderr, "ERROR: could not open %s for writing\n", path);
+        return false;
+    }
+    unsigned int header[3] = {(unsigned int)lod.positions.size (), (unsigned int)lod.indices.size (),
+                              (unsigned int)lod.level_count};
+    bool ok = fwrite (LOD_MAGIC, 4, 1, f) == 1 &&
+              fwrite (header, sizeof (header), 1, f) == 1 &&
+              fwrite (&lod.bounds, sizeof (lod.bounds), 1, f) == 1 &&
+              fwrite (lod.levels, sizeof (LodLevel), lod.level_count, f) == (size_t)lod.level_count &&
+              fwrite (lod.positions.data (), sizeof (vec3), lod.positions.size (), f) == lod.positions.size () &&
+              fwrite (lod.indices.data (), sizeof (unsigned int), lod.indices.size (), f) == lod.indices.size ();
+    fclose (f);
+    if (!ok) {
+        fprintf (stderr, "ERROR: short write to %s\n", path);
+    }
+    return ok;
+}
+
+bool lod_load (const char* path, LodMesh* out) {
+    MemoryScope scope (MEMORY_LOD);
+    FILE* f = fopen (path, "rb");
+    if (!f) {
+        fprintf (stderr, "ERROR: could not open %s\n", path);
+        return false;
+    }
+    char magic[4];
+    unsigned int header[3];
+    bool ok = fread (magic, 4, 1, f) == 1 && memcmp (magic, LOD_MAGIC, 4) == 0 &&
+              fread (header, sizeof (header), 1, f) == 1 && header[2] >= 1 && header[2] <= LOD_MAX_LEVELS &&
+              fread (&out->bounds, sizeof (out->bounds), 1, f) == 1;
+    if (ok) {
+        out->level_count = (int)header[2];
+        out->positions.resize (header[0]);
+        out->indices.resize (header[1]);
+        ok = fread (out->levels, sizeof (LodLevel), out->level_count, f) == (size_t)out->level_count &&
+             fread (out->positions.data (), sizeof (vec3), header[0], f) == header[0] &&
+             fread (out->indices.data (), sizeof (unsigned int), header[1], f) == header[1];
+    }
+    fclose (f);
+    // levels and indices are drawn straight from, so none may reach past the arrays
+    for (int i = 0; ok && i < out->level_count; i++) {
+        const LodLevel& l = out->levels[i];
+        ok = l.first_index <= header[1] && l.index_count <= header[1] - l.first_index && l.index_count % 3 == 0;
+    }
+    for (unsigned int i = 0; ok && i < header[1]; i++) {
+        ok = out->indices[i] < header[0];
+    }
+    if (!ok) {
+        fprintf (stderr, "ERROR: %s is not a valid .lod file\n", path);
+    }
+    return ok;
+}
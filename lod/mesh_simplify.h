@@ -0,0 +1,45 @@
+//
+// Offline mesh simplification into a chain of LOD levels.
+//
+// Garland-Heckbert quadric error metrics with half-edge collapses: a vertex is
+// always collapsed onto one of its neighbours, never onto a new position. That
+// way every level indexes the same vertex buffer and a LodMesh is one vertex
+// array plus one index array holding each level's triangles back to back.
+// Drawing level i is glDrawElements over levels[i].first_index/index_count.
+//
+
+#ifndef FPS_STYLE_ROOM_MESH_SIMPLIFY_H
+#define FPS_STYLE_ROOM_MESH_SIMPLIFY_H
+
+#include <geometry/mesh.h>
+
+#define LOD_MAX_LEVELS 8
+
+struct LodLevel {
+    unsigned int first_index; // into LodMesh::indices
+    unsigned int index_count;
+    float error;              // bound on the object space distance the level is off by
+};
+
+struct LodMesh {
+    std::vector<vec3> positions;       // shared by every level
+    std::vector<unsigned int> indices; // all levels, finest first
+    LodLevel levels[LOD_MAX_LEVELS];
+    int level_count;
+    Sphere bounds;
+};
+
+/* simplify src into 1 + ratio_count levels. level 0 is src itself, level i
+keeps about ratios[i - 1] of the original triangles. ratios must be
+decreasing. simplification stops early if no collapse is left that keeps the
+surface from folding over, in which case fewer levels come back */
+bool lod_build (const Mesh& src, const float* ratios, int ratio_count, LodMesh* out);
+
+/* level i as a standalone mesh (shares no storage with lod) */
+void lod_extract_level (const LodMesh& lod, int level, Mesh* out);
+
+/* binary .lod file: header, positions, indices. written by tools/lod_tool */
+bool lod_save (const char* path, const LodMesh& lod);
+bool lod_load (const char* path, LodMesh* out);
+
+#endif //FPS_STYLE_ROOM_MESH_SIMPLIFY_H
@@ -2,8 +2,26 @@
 #include <GLFW/glfw3.h>
 #include <stdio.h>
 #include <math.h>
+#include <string.h>
 #include <utils/maths_funcs.h>
-#include <utils/quat_funcs.h>
+#include <camera/camera_orientation.h>
+#include <camera/player_movement.h>
+#include <jobs/job_system.h>
+#include <memory/memory_tracker.h>
+#include <scene/scene_store.h>
+#include <scene/raycast.h>
+#include <scene/live_scene.h>
+#include <scene/file_watch.h>
+#include <render/vertex_format_gl.h>
+#include <render/draw_batch_gl.h>
+#include <render/light_clusters_gl.h>
+#include <render/shadow_cache_gl.h>
+#include <render/view_ubo_gl.h>
+#include <render/frame_pacing.h>
+#include <render/dynamic_resolution.h>
+#include <render/dynamic_resolution_gl.h>
+#include <render/multi_view_gl.h>
+#include <render/particles_gl.h>
 
 struct Hardware{
 
@@ -13,20 +31,13 @@ struct Hardware{
 struct Camera{
 
     float pos[3]; // don't start at zero, or we will be too close
-    float yaw = 0.0f; // y-rotation in degrees
-    float pitch = 0.0f;
     float signal_amplifier = 0.1f;
-    mat4 T;
-    mat4 Rpitch;
-    mat4 Ryaw;
+    CameraOrientation orientation; // yaw/pitch folded into one rotation
     mat4 viewMatrix;
 
     GLint view_mat_location;
     GLint proj_mat_location;
 
-    float quatYaw[4];
-    float quatPitch[4];
-
     int pushing; //-1 slowing down, +1 accelerating , 0 = idle
     bool moving; //velocity != 0
     double move_angle;
@@ -45,11 +56,48 @@ struct Input{
 static Camera camera;
 static Hardware hardware;
 static Input input;
+static SceneStore scene;
+static RayBvh scene_bvh;
+/* the level, re-read whenever its file or an .obj it names is saved */
+#ifndef ROOM_SCENE_PATH
+#define ROOM_SCENE_PATH "room.scene"
+#endif
+/* memory budgets per subsystem, warned about once a frame */
+#ifndef ROOM_BUDGETS_PATH
+#define ROOM_BUDGETS_PATH "memory.budgets"
+#endif
+static LiveScene level;
+static InputLatency latency;
+/* dust, sparks, and a muzzle flash on every left click */
+static ParticleSystem particles;
+static int flash_emitter = -1;
+
+/* F1: read the mouse just before the view dependent work instead of at the
+end of the frame. F2: also start frames as late before vsync as they allow */
+static bool late_latch = true;
+static bool pre_vsync_wait = false;
+/* F3: render at a scale picked from the frame timings and upscale */
+static bool dynamic_scaling = true;
+/* F4: two security cameras in the top corners, culled and built with the
+player's view */
+static bool security_cameras = false;
 
 static void cursor_position_callback(GLFWwindow *window, double xpos, double ypos);
 static void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods);
+static void mouse_button_callback(GLFWwindow* window, int button, int action, int mods);
 static void calculateViewMatrix(Camera* camera);
 static void updateMovement(Camera* camera);
+static void draw_shadow_casters(const mat4& view, const mat4& proj, bool dynamic, void* data);
+static void draw_view(MultiView* views, int v, MultiViewGl* views_gl, DrawBatchGl* batch_gl, LightClusters* clusters,
+                      LightClustersGl* clusters_gl, const PointLight* lights, ShadowCacheGl* shadows_gl,
+                      const ShadowCache& shadows, ViewUboGl* view_ubo);
+static void builtin_level(const Mesh& room_mesh, SceneDesc* out);
+static void build_picking(const LiveScene& live);
+
+struct ShadowCasters{
+    DrawBatchGl* gl;
+    const DrawBatch* batch;
+};
 
 int main () {
     GLFWwindow* window = NULL;
@@ -80,11 +128,11 @@ int main () {
     /*Shader Stuff*/
     const char* vertex_shader =
             "#version 410\n"
-                    "uniform mat4 view, proj;"
-                    "in vec3 vertex_points;"
+                    VERTEX_FORMAT_GLSL
+                    "uniform mat4 model, view, proj;"
 
                     "void main () {"
-                    "	gl_Position = proj * view * vec4 (vertex_points, 1.0);"
+                    "	gl_Position = proj * view * model * vec4 (decode_position (), 1.0);"
                     "}";
     const char* fragment_shader =
             "#version 410\n"
@@ -120,11 +168,20 @@ int main () {
     glewExperimental = GL_TRUE;
     glewInit ();
 
+    /* workers for the per-frame CPU work. this thread stays worker 0 and
+    keeps the GL context */
+    job_system_init (0);
+    if (!memory_load_budgets(ROOM_BUDGETS_PATH)) {
+        printf("Running without memory budgets\n");
+    }
+
 
     glfwSetCursorPosCallback(window,cursor_position_callback);
     glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
     glfwSetKeyCallback(window, key_callback);
+    glfwSetMouseButtonCallback(window, mouse_button_callback);
     glfwSetInputMode(window,GLFW_STICKY_KEYS, 1);
+    glfwSwapInterval(1);
 
     /* get version info */
     renderer = glGetString (GL_RENDERER); /* get renderer string */
@@ -136,16 +193,16 @@ int main () {
     glDepthFunc (GL_LESS);
 
 
-    glGenBuffers (1, &vbo);
-    glBindBuffer (GL_ARRAY_BUFFER, vbo);
-    glBufferData (GL_ARRAY_BUFFER, 36 * sizeof (GLfloat), points,
-                  GL_STATIC_DRAW);
+    /* the room goes up packed, 16 bytes a vertex (see render/vertex_format.h) */
+    Mesh room_mesh;
+    mesh_from_triangle_soup(points, 12, &room_mesh);
+    PackedVertices room_vertices;
+    vertex_pack_mesh(room_mesh, &room_vertices, NULL);
+    vbo = vertex_format_upload(room_vertices);
 
     glGenVertexArrays (1, &vao);
     glBindVertexArray (vao);
-    glEnableVertexAttribArray (0);
-    glBindBuffer (GL_ARRAY_BUFFER, vbo);
-    glVertexAttribPointer (0, 3, GL_FLOAT, GL_FALSE, 0, NULL);
+    vertex_format_bind_attributes(vbo);
 
 
     vs = glCreateShader (GL_VERTEX_SHADER);
@@ -188,10 +245,156 @@ int main () {
     camera.pos[0] = 0.0f; // don't start at zero, or we will be too close
     camera.pos[1] = 0.0f; // don't start at zero, or we will be too close
     camera.pos[2] = 0.5f; // don't start at zero, or we will be too close
-    camera.T = translate (identity_mat4 (), vec3 (-camera.pos[0], -camera.pos[1], -camera.pos[2]));
-    camera.Rpitch = rotate_y_deg (identity_mat4 (), -camera.yaw);
-    camera.Ryaw = rotate_y_deg (identity_mat4 (), -camera.yaw);
-    camera.viewMatrix = camera.Rpitch * camera.T;
+    camera_orientation_init(&camera.orientation, 0.0f, 0.0f);
+    camera_orientation_view(&camera.orientation, camera.pos, &camera.viewMatrix);
+
+    /* the level's objects are entities in the scene and its meshes go in the
+    batch. without the scene file it is the room above */
+    scene_init(&scene);
+    GLint model_mat_location = glGetUniformLocation(shader_programme, "model");
+    DrawBatch batch;
+    draw_batch_init(&batch);
+    SceneDesc level_desc;
+    if (!scene_file_load(ROOM_SCENE_PATH, &level_desc)) {
+        printf("Using the built in room until %s loads\n", ROOM_SCENE_PATH);
+        builtin_level(room_mesh, &level_desc);
+    }
+    live_scene_init(&level);
+    live_scene_apply(&level, &level_desc, &scene, &batch);
+    build_picking(level);
+    FileWatch level_watch;
+    file_watch_init(&level_watch);
+    file_watch_set(&level_watch, level.desc.files.data(), (int)level.desc.files.size(), frame_pacing_now_ms());
+    std::vector<mat4> level_worlds;
+    std::vector<Aabb> level_bounds;
+
+    /* static meshes go through one multi-draw when the context has GL 4.3,
+    otherwise the built in room is drawn on its own below, and edits to the
+    scene file only move the picking */
+    DrawBatchGl batch_gl;
+    bool use_batch = draw_batch_gl_init(&batch_gl, batch);
+    mat4 proj;
+    memcpy(proj.m, proj_mat, sizeof(proj.m));
+
+    /* the batch path lights the room with clustered forward shading. the
+    clusters follow the projection above */
+    PointLight room_lights[4] = {
+            {vec3(-0.4f, 0.3f, 0.2f), 1.5f, vec3(1.0f, 0.6f, 0.3f), 1.5f},
+            {vec3(0.4f, 0.3f, 0.2f), 1.5f, vec3(0.3f, 0.6f, 1.0f), 1.5f},
+            {vec3(0.0f, 0.4f, 0.9f), 1.5f, vec3(1.0f, 1.0f, 1.0f), 1.0f},
+            {vec3(0.0f, -0.4f, 0.5f), 1.0f, vec3(0.4f, 1.0f, 0.4f), 1.0f},
+    };
+    LightClusters clusters;
+    light_clusters_init(&clusters, 16, 9, 24, proj, near, far);
+    LightClustersGl clusters_gl;
+    if (use_batch) {
+        light_clusters_gl_init(&clusters_gl);
+        light_clusters_gl_set_uniforms(clusters, batch_gl.program, hardware.vmode->width, hardware.vmode->height);
+    }
+
+    /* the first two lights cast cube shadows. nothing in the room moves, so
+    after the first frame the cache has nothing to redraw */
+    ShadowLight shadow_lights[2];
+    for (int i = 0; i < 2; i++) {
+        shadow_lights[i] = {};
+        shadow_lights[i].type = SHADOW_POINT;
+        shadow_lights[i].position = room_lights[i].position;
+        shadow_lights[i].radius = room_lights[i].radius;
+        shadow_lights[i].resolution = 512;
+    }
+    ShadowCache shadows;
+    shadow_cache_init(&shadows, 2048);
+    ShadowCacheGl shadows_gl;
+    ShadowCasters shadow_casters = {&batch_gl, &batch};
+    bool use_shadows = use_batch && shadow_cache_gl_init(&shadows_gl, 2048);
+    if (use_shadows) {
+        for (int i = 0; i < 2; i++) {
+            room_lights[i].shadow_first = i * SHADOW_FACES;
+            room_lights[i].shadow_count = SHADOW_FACES;
+        }
+        glProgramUniform1i(batch_gl.program, glGetUniformLocation(batch_gl.program, "shadow_atlas"), 1);
+    }
+
+    /* the batch path takes the camera from the view UBO, written after the
+    late input read */
+    ViewUboGl view_ubo;
+    if (use_batch) {
+        view_ubo_gl_init(&view_ubo);
+    }
+    input_latency_init(&latency);
+    FramePacer pacer;
+    frame_pacer_init(&pacer, hardware.vmode->refreshRate, 3.0);
+    unsigned int frame = 0;
+
+    /* the scene is drawn offscreen at a scale that keeps the GPU inside the
+    refresh interval. every frame's choice goes to dynamic_resolution.csv */
+    int width = hardware.vmode->width;
+    int height = hardware.vmode->height;
+    DynamicResolution dynres;
+    dynamic_resolution_init(&dynres, dynamic_resolution_default_params(hardware.vmode->refreshRate), width, height);
+    DynamicResolutionGl dynres_gl;
+    bool use_dynres = dynamic_resolution_gl_init(&dynres_gl, width, height);
+    FILE* dynres_log = use_dynres ? fopen("dynamic_resolution.csv", "w") : NULL;
+    if (dynres_log) {
+        dynamic_resolution_log_header(dynres_log);
+    }
+    float cpu_ms = 0.0f;
+
+    /* the player's view and the security cameras share one cull and one
+    draw data upload. the cameras use the player's projection, so the light
+    clusters fit them too, drawn a quarter size into the inset target */
+    MultiView views;
+    multi_view_init(&views);
+    MultiViewGl views_gl;
+    bool use_insets = false;
+    if (use_batch) {
+        use_insets = multi_view_gl_init(&views_gl, width / 4, height / 4);
+    }
+    const vec3 camera_eyes[2] = {vec3(-0.9f, 0.6f, 1.4f), vec3(0.9f, 0.6f, 1.4f)};
+
+    /* blended dust drifting through the room, sorted back to front, then the
+    additive emitters, which are drawn after it */
+    particles_init(&particles);
+    ParticlesGl particles_gl;
+    bool use_particles = use_batch && particles_gl_init(&particles_gl, 65536);
+    if (use_particles) {
+        ParticleEmitterParams dust = {};
+        dust.position = vec3(0.0f, 0.0f, 0.5f);
+        dust.spread = 0.8f;
+        dust.velocity_jitter = 0.02f;
+        dust.gravity = vec3(0.0f, -0.005f, 0.0f);
+        dust.rate = 400.0f;
+        dust.life = 10.0f;
+        dust.size = 0.004f;
+        float dust_colour[4] = {0.8f, 0.75f, 0.7f, 0.5f};
+        memcpy(dust.colour, dust_colour, sizeof(dust.colour));
+        particles_add_emitter(&particles, dust, 8192, 1);
+
+        ParticleEmitterParams sparks = {};
+        sparks.position = room_lights[2].position;
+        sparks.spread = 0.01f;
+        sparks.velocity = vec3(0.0f, 0.3f, 0.0f);
+        sparks.velocity_jitter = 0.4f;
+        sparks.gravity = vec3(0.0f, -2.0f, 0.0f);
+        sparks.drag = 0.5f;
+        sparks.rate = 200.0f;
+        sparks.life = 0.8f;
+        sparks.size = 0.003f;
+        float spark_colour[4] = {1.0f, 0.6f, 0.2f, 1.0f};
+        memcpy(sparks.colour, spark_colour, sizeof(sparks.colour));
+        particles_add_emitter(&particles, sparks, 4096, 2);
+
+        ParticleEmitterParams flash = {};
+        flash.spread = 0.01f;
+        flash.velocity_jitter = 0.3f;
+        flash.drag = 4.0f;
+        flash.life = 0.08f;
+        flash.size = 0.02f;
+        float flash_colour[4] = {1.0f, 0.85f, 0.5f, 1.0f};
+        memcpy(flash.colour, flash_colour, sizeof(flash.colour));
+        flash_emitter = particles_add_emitter(&particles, flash, 1024, 3);
+    }
+    double last_frame_ms = frame_pacing_now_ms();
 
     glUseProgram(shader_programme);
 
@@ -200,30 +403,190 @@ int main () {
 
     glUniformMatrix4fv(camera.view_mat_location, 1, GL_FALSE, camera.viewMatrix.m);
     glUniformMatrix4fv(camera.proj_mat_location, 1, GL_FALSE, proj_mat);
+    vertex_format_set_uniforms(shader_programme, room_vertices.quantization);
 
 
     while (!glfwWindowShouldClose (window)) {
+        if (pre_vsync_wait) {
+            frame_pacer_wait(&pacer);
+        } else {
+            frame_pacer_begin(&pacer, frame_pacing_now_ms());
+        }
+        bool scaled = use_dynres && dynamic_scaling;
+        if (scaled) {
+            int lag = 0;
+            float gpu_ms = dynamic_resolution_gl_gpu_ms(&dynres_gl, &lag);
+            dynamic_resolution_update(&dynres, gpu_ms, lag, cpu_ms);
+            dynamic_resolution_gl_begin_frame(&dynres_gl);
+        }
+        int render_width = scaled ? dynres.render_width : width;
+        int render_height = scaled ? dynres.render_height : height;
         updateMovement(&camera);
+        if (file_watch_poll(&level_watch, frame_pacing_now_ms())) {
+            SceneDesc next;
+            if (scene_file_load(ROOM_SCENE_PATH, &next)) {
+                live_scene_apply(&level, &next, &scene, &batch);
+                size_t bytes = use_batch ? draw_batch_gl_sync(&batch_gl, &batch) : 0;
+                for (size_t i = 0; i < level.changed.size(); i++) {
+                    shadow_cache_invalidate_static(&shadows, level.changed[i]);
+                }
+                build_picking(level);
+                file_watch_set(&level_watch, level.desc.files.data(), (int)level.desc.files.size(),
+                               frame_pacing_now_ms());
+                const LiveSceneStats& ls = level.stats;
+                printf("%s reloaded: meshes %u added, %u changed, %u removed, %u recoloured; objects %u added, "
+                       "%u moved, %u removed; %zu bytes uploaded, %.3f ms\n", ROOM_SCENE_PATH, ls.meshes_added,
+                       ls.meshes_changed, ls.meshes_removed, ls.meshes_recoloured, ls.objects_added,
+                       ls.objects_moved, ls.objects_removed, bytes, ls.ms);
+            }
+        }
+        scene_update(&scene);
+        live_scene_gather(level, scene, &level_worlds, &level_bounds);
+        int level_count = (int)level_worlds.size();
+        double now_ms = frame_pacing_now_ms();
+        // a long stall shouldn't throw every particle across the room
+        float dt = fminf((float)(now_ms - last_frame_ms) * 0.001f, 0.1f);
+        last_frame_ms = now_ms;
+        if (use_particles) {
+            particles_update(&particles, dt);
+        }
 
+        if (use_batch) {
+            // the shadow casters are drawn from the plain batch
+            draw_batch_build(&batch, level.mesh_of.data(), level_worlds.data(), NULL, level_count);
+            draw_batch_gl_upload(&batch_gl, batch);
+        }
+        if (use_shadows) {
+            shadow_cache_update(&shadows, shadow_lights, 2, NULL, 0);
+            shadow_cache_gl_render(&shadows_gl, shadows, draw_shadow_casters, &shadow_casters);
+        }
+
+        /* late latch: everything above is independent of where the camera
+        looks, so the mouse is read as late as it can be */
+        if (late_latch) {
+            glfwPollEvents();
+            calculateViewMatrix(&camera);
+        }
+        if (scaled) {
+            dynamic_resolution_gl_bind(&dynres_gl, render_width, render_height);
+        } else {
+            glViewport(0, 0, width, height);
+        }
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        glViewport(0, 0, hardware.vmode->width, hardware.vmode->height);
-        glUseProgram(shader_programme);
-        glBindVertexArray(vao);
-        glDrawArrays(GL_TRIANGLES, 0, 12);
-        glfwPollEvents();
+        if (use_batch) {
+            multi_view_clear(&views);
+            RenderView player = {camera.viewMatrix, proj, {0, 0, render_width, render_height}};
+            multi_view_add(&views, player);
+            if (use_insets && security_cameras) {
+                for (int i = 0; i < 2; i++) {
+                    multi_view_add(&views, render_view_look_at(camera_eyes[i], vec3(0.0f, 0.0f, 0.5f),
+                                                               vec3(0.0f, 1.0f, 0.0f), 67.0f, aspect, near, far, 0,
+                                                               0, views_gl.inset_width, views_gl.inset_height));
+                }
+            }
+            multi_view_build(&views, batch, level.mesh_of.data(), level_worlds.data(), level_bounds.data(),
+                             level_count);
+            multi_view_gl_upload(&batch_gl, views);
+            draw_view(&views, 0, &views_gl, &batch_gl, &clusters, &clusters_gl, room_lights,
+                      use_shadows ? &shadows_gl : NULL, shadows, &view_ubo);
+            if (use_particles) {
+                particles_sort(&particles, vec3(camera.pos[0], camera.pos[1], camera.pos[2]));
+                view_ubo_gl_write(&view_ubo, camera.viewMatrix, proj);
+                particles_gl_draw(&particles_gl, particles);
+                view_ubo_gl_fence(&view_ubo);
+            }
+        } else {
+            glUseProgram(shader_programme);
+            glUniformMatrix4fv(camera.view_mat_location, 1, GL_FALSE, camera.viewMatrix.m);
+            glUniformMatrix4fv(model_mat_location, 1, GL_FALSE, identity_mat4().m);
+            glBindVertexArray(vao);
+            glDrawArrays(GL_TRIANGLES, 0, 12);
+        }
+        if (scaled) {
+            dynamic_resolution_gl_present(&dynres_gl, render_width, render_height);
+            if (dynres_log) {
+                dynamic_resolution_log_frame(dynres_log, dynres);
+            }
+        }
+        /* the cameras after the upscale, straight into the corners */
+        for (int v = 1; use_batch && v < views.count; v++) {
+            multi_view_gl_bind_inset(&views_gl);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            draw_view(&views, v, &views_gl, &batch_gl, &clusters, &clusters_gl, room_lights,
+                      use_shadows ? &shadows_gl : NULL, shadows, &view_ubo);
+            int x = v == 1 ? 0 : width - views_gl.inset_width;
+            multi_view_gl_blit_inset(&views_gl, x, height - views_gl.inset_height, views_gl.inset_width,
+                                     views_gl.inset_height);
+        }
+        if (use_batch) {
+            multi_view_gl_read_times(&views_gl, &views);
+        }
+        input_latency_submit(&latency, frame_pacing_now_ms());
+        if (!late_latch) {
+            glfwPollEvents();
+        }
         if (GLFW_PRESS == glfwGetKey(window, GLFW_KEY_ESCAPE)) {
             glfwSetWindowShouldClose(window, 1);
         }
+        double swap_ms = frame_pacing_now_ms();
+        cpu_ms = (float)(swap_ms - pacer.frame_start_ms);
         glfwSwapBuffers(window);
+        frame_pacer_swapped(&pacer, swap_ms, frame_pacing_now_ms());
+        memory_frame_end();
+
+        if (++frame % 300 == 0) {
+            InputLatencyStats st;
+            input_latency_stats(latency, &st);
+            printf("input to submit: last %.2f ms, mean %.2f ms, p99 %.2f ms (%s%s), frame work %.2f of %.2f ms, "
+                   "%u missed\n", st.last_ms, st.mean_ms, st.p99_ms, late_latch ? "late latch" : "classic",
+                   pre_vsync_wait ? ", pre-vsync wait" : "", pacer.stats.work_ms, pacer.stats.refresh_ms,
+                   pacer.stats.missed);
+            if (scaled) {
+                printf("render scale %.2f (%dx%d), gpu %.2f ms, cpu %.2f ms%s\n", dynres.scale, render_width,
+                       render_height, dynres.stats.gpu_ms, dynres.stats.cpu_ms,
+                       dynres.stats.cpu_bound ? ", cpu bound" : "");
+            }
+            for (int v = 0; use_batch && v < views.count; v++) {
+                const ViewStats& vs = views.view_stats[v];
+                printf("view %d: %u draws, %u triangles, build %.3f ms, gpu %.2f ms\n", v, vs.visible, vs.triangles,
+                       vs.build_ms, vs.gpu_ms);
+            }
+            if (use_particles) {
+                printf("particles: %u alive, update %.3f ms, sort %.3f ms, %u drawn, %u clipped\n",
+                       particles.stats.alive, particles.stats.update_ms, particles.stats.sort_ms, particles_gl.drawn,
+                       particles_gl.clipped);
+            }
+            memory_print_stats(stdout);
+        }
     }
 
+    if (use_batch) {
+        draw_batch_gl_destroy(&batch_gl);
+        light_clusters_gl_destroy(&clusters_gl);
+        view_ubo_gl_destroy(&view_ubo);
+        multi_view_gl_destroy(&views_gl);
+    }
+    if (use_shadows) {
+        shadow_cache_gl_destroy(&shadows_gl);
+    }
+    if (use_dynres) {
+        dynamic_resolution_gl_destroy(&dynres_gl);
+    }
+    if (use_particles) {
+        particles_gl_destroy(&particles_gl);
+    }
+    if (dynres_log) {
+        fclose(dynres_log);
+    }
+    file_watch_destroy(&level_watch);
+    job_system_shutdown ();
     /* close GL context and any other GLFW resources */
     glfwTerminate();
     return 0;
 }
 
 static void cursor_position_callback(GLFWwindow *window, double xpos, double ypos) {
-
+    input_latency_event(&latency, frame_pacing_now_ms());
 
     //calculate pitch
     static double  previous_ypos = ypos;
@@ -235,19 +598,10 @@ static void cursor_position_callback(GLFWwindow *window, double xpos, double ypo
     double position_x_difference = xpos - previous_xpos;
     previous_xpos = xpos;
 
-    camera.yaw += position_x_difference *camera.signal_amplifier;
-    camera.pitch += position_y_difference *camera.signal_amplifier;
-
-    create_versor(camera.quatPitch, camera.pitch, 1.0f, 0.0f, 0.0f);
-    create_versor(camera.quatYaw, camera.yaw, 0.0f, 1.0f, 0.0f);
-
-    quat_to_mat4(camera.Rpitch.m, camera.quatPitch);
-    quat_to_mat4(camera.Ryaw.m, camera.quatYaw);
-
-//    mult_quat_quat(camera.resultQuat, camera.quatYaw, camera.quatPitch);
-//    mult_quat_quat(camera.resultQuat, camera.quatYaw, camera.quatPitch);
-//    quat_to_mat4(camera.R.m, camera.resultQuat);
-
+    //fold the deltas into the stored rotation, the view matrix is rebuilt once per frame
+    camera_orientation_rotate(&camera.orientation,
+                              (float)(position_x_difference * camera.signal_amplifier),
+                              (float)(position_y_difference * camera.signal_amplifier));
 }
 
 static void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods) {
@@ -283,71 +637,138 @@ static void key_callback(GLFWwindow* window, int key, int scancode, int action,
     if (key == GLFW_KEY_D && action == GLFW_RELEASE) {
         input.dPressed = false;
     }
+    if (key == GLFW_KEY_F1 && action == GLFW_PRESS) {
+        late_latch = !late_latch;
+        printf("Late latch %s\n", late_latch ? "on" : "off");
+    }
+    if (key == GLFW_KEY_F2 && action == GLFW_PRESS) {
+        pre_vsync_wait = !pre_vsync_wait;
+        printf("Pre-vsync wait %s\n", pre_vsync_wait ? "on" : "off");
+    }
+    if (key == GLFW_KEY_F3 && action == GLFW_PRESS) {
+        dynamic_scaling = !dynamic_scaling;
+        printf("Dynamic resolution %s\n", dynamic_scaling ? "on" : "off");
+    }
+    if (key == GLFW_KEY_F4 && action == GLFW_PRESS) {
+        security_cameras = !security_cameras;
+        printf("Security cameras %s\n", security_cameras ? "on" : "off");
+    }
 
 }
 
 
-static void calculateViewMatrix(Camera* camera){
-    camera->T = translate (identity_mat4 (), vec3 (-camera->pos[0], -camera->pos[1], -camera->pos[2]));
-    camera->viewMatrix = camera->Rpitch * camera->Ryaw * camera->T;
-
-//    printf("X:%f Y:%f Z:%f\n",  camera->viewMatrix.m[2], camera->viewMatrix.m[6],camera->viewMatrix.m[10]);
+/* left click picks whatever is under the crosshair. the cursor is captured,
+so that is always the middle of the screen, straight down the view direction.
+it also fires a muzzle flash just in front of the camera */
+static void mouse_button_callback(GLFWwindow* window, int button, int action, int mods) {
+    if (button != GLFW_MOUSE_BUTTON_LEFT || action != GLFW_PRESS) {
+        return;
+    }
+    if (flash_emitter >= 0) {
+        vec3 eye = view_matrix_eye(camera.viewMatrix);
+        vec3 forward = camera_orientation_forward(camera.viewMatrix);
+        ParticleEmitterParams& flash = particles.emitters[flash_emitter].params;
+        flash.position = eye + forward * 0.1f;
+        flash.velocity = forward * 0.5f;
+        particles_burst(&particles, flash_emitter, 48);
+    }
+    RayHit hit;
+    if (raycast_closest(scene_bvh, ray_from_view(camera.viewMatrix, 100.0f), &hit)) {
+        printf("Picked mesh %u triangle %u at distance %f\n", hit.mesh, hit.triangle, hit.t);
+    } else {
+        printf("Picked nothing\n");
+    }
 }
 
-static void updateMovement(Camera* camera) {
-
-
-    if(input.wPressed || input.sPressed || input.aPressed || input.dPressed) {
-        camera->pushing = 1;
+/* the level is the only caster. it only changes on a reload, which
+invalidates the shadows it touched */
+static void draw_shadow_casters(const mat4& view, const mat4& proj, bool dynamic, void* data) {
+    ShadowCasters* casters = (ShadowCasters*)data;
+    if (!dynamic) {
+        draw_batch_gl_draw_depth(casters->gl, *casters->batch, view, proj);
     }
+}
 
-    if (camera->pushing) {
-
-        const double maxVelocity = 0.1 * (camera->pushing> 0);
-        const double acceleration= camera->pushing>0 ? 0.2:0.1;
-
-//        camera->pos[0] += -0.1f * camera->viewMatrix.m[2] * ((camera->move_angle == 180 )? -1:1);
-//        camera->pos[2] += -0.1f * camera->viewMatrix.m[10] * ((camera->move_angle == 180 )? -1:1);
+/* one view of the last multi_view_build into the bound target: its lights
+and shadows in view space, its camera, its slice of the commands */
+static void draw_view(MultiView* views, int v, MultiViewGl* views_gl, DrawBatchGl* batch_gl, LightClusters* clusters,
+                      LightClustersGl* clusters_gl, const PointLight* lights, ShadowCacheGl* shadows_gl,
+                      const ShadowCache& shadows, ViewUboGl* view_ubo) {
+    const RenderView& view = views->views[v];
+    multi_view_gl_begin_view(views_gl, v);
+    light_clusters_gl_set_uniforms(*clusters, batch_gl->program, view.viewport[2], view.viewport[3]);
+    if (shadows_gl) {
+        shadow_cache_gl_upload(shadows_gl, shadows, view.view, 1);
+    }
+    light_clusters_build(clusters, lights, 4, view.view);
+    light_clusters_gl_upload(clusters_gl, *clusters);
+    view_ubo_gl_write(view_ubo, view.view, view.proj);
+    draw_batch_gl_draw_range(batch_gl, views->commands.data(), views->first[v], views->counts[v]);
+    view_ubo_gl_fence(view_ubo);
+    multi_view_gl_end_view(views_gl, v);
+}
 
-        if(camera->move_angle == 90.0f || camera->move_angle == -90.0f) {
-            vec3 left = cross(vec3(camera->viewMatrix.m[2],camera->viewMatrix.m[6],camera->viewMatrix.m[10]),
-                              vec3(camera->viewMatrix.m[1],camera->viewMatrix.m[5],camera->viewMatrix.m[9]));
+/* points[] as a scene: one mesh, one object at the origin. it watches the
+scene file, so creating it replaces the room */
+static void builtin_level(const Mesh& room_mesh, SceneDesc* out) {
+    *out = SceneDesc();
+    SceneMaterialDesc wall = {"wall", {0.5f, 0.0f, 0.5f}};
+    out->materials.push_back(wall);
+    SceneMeshDesc mesh;
+    strcpy(mesh.name, "room");
+    mesh.material = 0;
+    mesh.mesh = room_mesh;
+    mesh.hash = scene_mesh_hash(room_mesh);
+    out->meshes.push_back(mesh);
+    SceneObjectDesc object = {"room", 0, vec3(0.0f, 0.0f, 0.0f), versor(1.0f, 0.0f, 0.0f, 0.0f),
+                              vec3(1.0f, 1.0f, 1.0f)};
+    out->objects.push_back(object);
+    ScenePath path;
+    snprintf(path.path, sizeof(path.path), "%s", ROOM_SCENE_PATH);
+    out->files.push_back(path);
+}
 
-            camera->velocity.v[0] =(float)(camera->velocity.v[0] * (1-acceleration) +
-                                           ( left.v[0]) * ((camera->move_angle == 90 )? 1:-1) * (acceleration *maxVelocity));
-            camera->velocity.v[2] =(float)(camera->velocity.v[2] * (1-acceleration) +
-                                           ( left.v[2]) * ((camera->move_angle == 90 )? 1:-1) * (acceleration *maxVelocity));
-        }else{
-            camera->velocity.v[0] =(float)(camera->velocity.v[0] * (1-acceleration) +
-                    ( camera->viewMatrix.m[2]) * ((camera->move_angle == 180 )? -1:1) * (acceleration *maxVelocity));
-            camera->velocity.v[2] =(float)(camera->velocity.v[2] * (1-acceleration) +
-                    ( camera->viewMatrix.m[10]) * ((camera->move_angle == 180 )? -1:1) * (acceleration *maxVelocity));
-        }
-        camera->moving = true;
+/* the picking BVH is static, so it is rebuilt from the level's transforms
+whenever they are reloaded */
+static void build_picking(const LiveScene& live) {
+    std::vector<Mesh> meshes(live.desc.objects.size());
+    std::vector<mat4> worlds(live.desc.objects.size());
+    for (size_t i = 0; i < meshes.size(); i++) {
+        const SceneObjectDesc& o = live.desc.objects[i];
+        meshes[i] = live.desc.meshes[o.mesh].mesh;
+        worlds[i] = scene_local_matrix(o.position, o.orientation, o.scale);
     }
+    ray_bvh_build(&scene_bvh, meshes.data(), worlds.data(), (int)meshes.size());
+}
 
-    if (camera->moving) {
+static void calculateViewMatrix(Camera* camera){
+    camera_orientation_view(&camera->orientation, camera->pos, &camera->viewMatrix);
 
-        camera->pos[0] += -camera->velocity.v[0] *0.02f;
-        camera->pos[2] += -camera->velocity.v[2] *0.02f;
+//    printf("X:%f Y:%f Z:%f\n",  camera->viewMatrix.m[2], camera->viewMatrix.m[6],camera->viewMatrix.m[10]);
+}
 
-        if(dot(camera->velocity,camera->velocity) < 1e-9) {
-            printf("Stopping\n");
-            camera->velocity.v[0] = camera->velocity.v[2] = camera->velocity.v[1] = 0.0f;
-            camera->pushing = 0;
-            camera->moving = false;
-        }
-    }
-    if(camera->pushing){
-        camera->pushing = -1.0f;
+static void updateMovement(Camera* camera) {
+    PlayerInput in;
+    in.keys = (input.wPressed ? PLAYER_KEY_W : 0) | (input.sPressed ? PLAYER_KEY_S : 0) |
+              (input.aPressed ? PLAYER_KEY_A : 0) | (input.dPressed ? PLAYER_KEY_D : 0);
+    in.move_angle = (int)camera->move_angle;
+    in.orientation = camera->orientation.rotation;
+
+    PlayerState player;
+    player.pos = vec3(camera->pos[0], camera->pos[1], camera->pos[2]);
+    player.velocity = camera->velocity;
+    player.pushing = camera->pushing;
+    player.moving = camera->moving;
+    if (player_movement_step(&player, in)) {
+        printf("Stopping\n");
     }
+    camera->pos[0] = player.pos.v[0];
+    camera->pos[1] = player.pos.v[1];
+    camera->pos[2] = player.pos.v[2];
+    camera->velocity = player.velocity;
+    camera->pushing = player.pushing;
+    camera->moving = player.moving;
 
     calculateViewMatrix(camera);
     glUniformMatrix4fv(camera->view_mat_location, 1, GL_FALSE, camera->viewMatrix.m);
-
 }
-
-
-
-
-
@@ -0,0 +1,300 @@
+//
+// Counting operator new and delete, and the per frame bookkeeping. See
+// memory_tracker.h.
+//
+
+#include "memory_tracker.h"
+#include <atomic>
+#include <new>
+#include <stdlib.h>
+#include <string.h>
+
+/* before every block. 16 bytes keeps the block as aligned as malloc's */
+struct MemoryHeader {
+    uint64_t size;
+    uint32_t tag;
+    uint32_t unused;
+};
+
+/* bytes need one total to have a peak, so they are shared atomics */
+struct alignas (64) MemoryCounters {
+    std::atomic<int64_t> bytes;
+    std::atomic<int64_t> peak;
+    std::atomic<int64_t> gpu_bytes;
+    std::atomic<int64_t> gpu_peak;
+};
+
+/* the counts only need summing when read, so each thread keeps its own and
+bumps them without a locked instruction. a block freed on another thread
+than it was allocated on is counted there; the sums still come out right */
+struct alignas (64) ThreadCounts {
+    std::atomic<uint64_t> allocations[MEMORY_TAGS];
+    std::atomic<uint64_t> frees[MEMORY_TAGS];
+};
+
+// threads past the last slot share it, and bump it atomically
+static const int COUNT_SLOTS = 64;
+
+// zero before any constructor runs, so allocations made during static
+// initialisation count too
+static MemoryCounters counters[MEMORY_TAGS];
+static ThreadCounts thread_counts[COUNT_SLOTS];
+static std::atomic<int> slots_taken;
+static thread_local unsigned char current_tag = MEMORY_UNTAGGED;
+static thread_local int count_slot = -1;
+
+// main thread only: memory_frame_end and the budgets
+static uint64_t last_allocations[MEMORY_TAGS];
+static uint64_t frame_allocations[MEMORY_TAGS];
+static uint64_t frame_peak[MEMORY_TAGS];
+static int64_t budgets[MEMORY_TAGS];
+static int64_t gpu_budgets[MEMORY_TAGS];
+static bool over_budget[MEMORY_TAGS];
+
+static const char* tag_names[MEMORY_TAGS] = {"untagged", "scene", "render", "particles", "animation",
+                                             "nav", "net", "textures", "lod", "jobs"};
+
+static inline void raise_peak (std::atomic<int64_t>* peak, int64_t value) {
+    int64_t p = peak->load (std::memory_order_relaxed);
+    while (value > p && !peak->compare_exchange_weak (p, value, std::memory_order_relaxed)) {
+    }
+}
+
+static inline void bump (std::atomic<uint64_t>* count, int slot) {
+    if (slot == COUNT_SLOTS - 1) {
+        count->fetch_add (1, std::memory_order_relaxed);
+    } else {
+        count->store (count->load (std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+}
+
+static inline int this_slot () {
+    if (count_slot < 0) {
+        int slot = slots_taken.fetch_add (1, std::memory_order_relaxed);
+        count_slot = slot < COUNT_SLOTS - 1 ? slot : COUNT_SLOTS - 1;
+    }
+    return count_slot;
+}
+
+static void count_sums (int tag, uint64_t* allocations, uint64_t* frees) {
+    int slots = slots_taken.load (std::memory_order_relaxed);
+    slots = slots < COUNT_SLOTS ? slots : COUNT_SLOTS;
+    *allocations = 0;
+    *frees = 0;
+    for (int i = 0; i < slots; i++) {
+        *allocations += thread_counts[i].allocations[tag].load (std::memory_order_relaxed);
+        *frees += thread_counts[i].frees[tag].load (std::memory_order_relaxed);
+    }
+}
+
+static void* tracked_alloc (size_t size) {
+    MemoryHeader* h = (MemoryHeader*)malloc (size + sizeof (MemoryHeader));
+    if (!h) {
+        return NULL;
+    }
+    h->size = size;
+    h->tag = current_tag;
+    MemoryCounters& c = counters[h->tag];
+    raise_peak (&c.peak, c.bytes.fetch_add ((int64_t)size, std::memory_order_relaxed) + (int64_t)size);
+    int slot = this_slot ();
+    bump (&thread_counts[slot].allocations[h->tag], slot);
+    return h + 1;
+}
+
+static void tracked_free (void* p) {
+    if (!p) {
+        return;
+    }
+    MemoryHeader* h = (MemoryHeader*)p - 1;
+    counters[h->tag].bytes.fetch_sub ((int64_t)h->size, std::memory_order_relaxed);
+    int slot = this_slot ();
+    bump (&thread_counts[slot].frees[h->tag], slot);
+    free (h);
+}
+
+/*--------------------------------NEW / DELETE--------------------------------*/
+void* operator new (size_t size) {
+    void* p = tracked_alloc (size);
+    if (!p) {
+        throw std::bad_alloc ();
+    }
+    return p;
+}
+
+void* operator new[] (size_t size) {
+    void* p = tracked_alloc (size);
+    if (!p) {
+        throw std::bad_alloc ();
+    }
+    return p;
+}
+
+void* operator new (size_t size, const std::nothrow_t&) noexcept {
+    return tracked_alloc (size);
+}
+
+void* operator new[] (size_t size, const std::nothrow_t&) noexcept {
+    return tracked_alloc (size);
+}
+
+void operator delete (void* p) noexcept {
+    tracked_free (p);
+}
+
+void operator delete[] (void* p) noexcept {
+    tracked_free (p);
+}
+
+void operator delete (void* p, size_t) noexcept {
+    tracked_free (p);
+}
+
+void operator delete[] (void* p, size_t) noexcept {
+    tracked_free (p);
+}
+
+void operator delete (void* p, const std::nothrow_t&) noexcept {
+    tracked_free (p);
+}
+
+void operator delete[] (void* p, const std::nothrow_t&) noexcept {
+    tracked_free (p);
+}
+
+/*------------------------------------TAGS------------------------------------*/
+const char* memory_tag_name (MemoryTag tag) {
+    return tag < MEMORY_TAGS ? tag_names[tag] : "?";
+}
+
+MemoryTag memory_tag_from_name (const char* name) {
+    for (int t = 0; t < MEMORY_TAGS; t++) {
+        if (strcmp (name, tag_names[t]) == 0) {
+            return (MemoryTag)t;
+        }
+    }
+    return MEMORY_TAGS;
+}
+
+MemoryTag memory_set_tag (MemoryTag tag) {
+    MemoryTag previous = (MemoryTag)current_tag;
+    current_tag = (unsigned char)tag;
+    return previous;
+}
+
+MemoryTag memory_current_tag () {
+    return (MemoryTag)current_tag;
+}
+
+void memory_gpu_charge (MemoryTag tag, int64_t bytes) {
+    MemoryCounters& c = counters[tag];
+    raise_peak (&c.gpu_peak, c.gpu_bytes.fetch_add (bytes, std::memory_order_relaxed) + bytes);
+}
+
+/*----------------------------------BUDGETS-----------------------------------*/
+void memory_set_budget (MemoryTag tag, int64_t cpu_bytes, int64_t gpu_bytes) {
+    budgets[tag] = cpu_bytes;
+    gpu_budgets[tag] = gpu_bytes;
+    over_budget[tag] = false;
+}
+
+bool memory_load_budgets (const char* path) {
+    FILE* f = fopen (path, "r");
+    if (!f) {
+        fprintf (stderr, "ERROR: could not open %s\n", path);
+        return false;
+    }
+    char line[256];
+    int number = 0;
+    bool ok = true;
+    while (ok && fgets (line, sizeof (line), f)) {
+        number++;
+        char* hash = strchr (line, '#');
+        if (hash) {
+            *hash = 0;
+        }
+        char name[32];
+        double cpu_mb, gpu_mb;
+        int fields = sscanf (line, "%31s %lf %lf", name, &cpu_mb, &gpu_mb);
+        if (fields <= 0) {
+            continue;
+        }
+        MemoryTag tag = memory_tag_from_name (name);
+        if (fields != 3 || tag == MEMORY_TAGS || cpu_mb < 0.0 || gpu_mb < 0.0) {
+            fprintf (stderr, "ERROR: %s:%d: expected <tag> <cpu MB> <gpu MB>\n", path, number);
+            ok = false;
+            break;
+        }
+        memory_set_budget (tag, (int64_t)(cpu_mb * 1048576.0), (int64_t)(gpu_mb * 1048576.0));
+    }
+    fclose (f);
+    return ok;
+}
+
+/*-----------------------------------FRAMES-----------------------------------*/
+uint64_t memory_frame_end () {
+    uint64_t total = 0;
+    for (int t = 0; t < MEMORY_TAGS; t++) {
+        const MemoryCounters& c = counters[t];
+        uint64_t allocations, frees;
+        count_sums (t, &allocations, &frees);
+        frame_allocations[t] = allocations - last_allocations[t];
+        last_allocations[t] = allocations;
+        if (frame_allocations[t] > frame_peak[t]) {
+            frame_peak[t] = frame_allocations[t];
+        }
+        total += frame_allocations[t];
+
+        int64_t bytes = c.bytes.load (std::memory_order_relaxed);
+        int64_t gpu_bytes = c.gpu_bytes.load (std::memory_order_relaxed);
+        bool over = (budgets[t] && bytes > budgets[t]) || (gpu_budgets[t] && gpu_bytes > gpu_budgets[t]);
+        if (over && !over_budget[t]) {
+            fprintf (stderr, "WARNING: %s is over its memory budget: %.2f of %.2f MB, gpu %.2f of %.2f MB\n",
+                     tag_names[t], bytes / 1048576.0, budgets[t] / 1048576.0, gpu_bytes / 1048576.0,
+                     gpu_budgets[t] / 1048576.0);
+        }
+        over_budget[t] = over;
+    }
+    return total;
+}
+
+void memory_stats (MemoryTag tag, MemoryTagStats* out) {
+    const MemoryCounters& c = counters[tag];
+    uint64_t frees;
+    count_sums (tag, &out->allocations, &frees);
+    out->bytes = c.bytes.load (std::memory_order_relaxed);
+    out->peak = c.peak.load (std::memory_order_relaxed);
+    out->blocks = (int64_t)(out->allocations - frees);
+    out->frame_allocations = frame_allocations[tag];
+    out->frame_peak = frame_peak[tag];
+    out->gpu_bytes = c.gpu_bytes.load (std::memory_order_relaxed);
+    out->gpu_peak = c.gpu_peak.load (std::memory_order_relaxed);
+    out->budget = budgets[tag];
+    out->gpu_budget = gpu_budgets[tag];
+    out->over = over_budget[tag];
+}
+
+void memory_print_stats (FILE* f) {
+    MemoryTagStats total = {};
+    for (int t = 0; t < MEMORY_TAGS; t++) {
+        MemoryTagStats s;
+        memory_stats ((MemoryTag)t, &s);
+        if (s.allocations == 0 && s.gpu_peak == 0) {
+            continue;
+        }
+        fprintf (f, "memory %-9s %9.1f KB (peak %9.1f), %7lld blocks, %5llu allocs/frame (max %5llu), "
+                    "gpu %9.1f KB (peak %9.1f)", tag_names[t], s.bytes / 1024.0, s.peak / 1024.0,
+                 (long long)s.blocks, (unsigned long long)s.frame_allocations, (unsigned long long)s.frame_peak,
+                 s.gpu_bytes / 1024.0, s.gpu_peak / 1024.0);
+        if (s.budget || s.gpu_budget) {
+            fprintf (f, ", budget %.1f / %.1f MB%s", s.budget / 1048576.0, s.gpu_budget / 1048576.0,
+                     s.over ? " OVER" : "");
+        }
+        fprintf (f, "\n");
+        total.bytes += s.bytes;
+        total.blocks += s.blocks;
+        total.frame_allocations += s.frame_allocations;
+        total.gpu_bytes += s.gpu_bytes;
+    }
+    fprintf (f, "memory total     %9.1f KB, %7lld blocks, %5llu allocs/frame, gpu %9.1f KB\n", total.bytes / 1024.0,
+             (long long)total.blocks, (unsigned long long)total.frame_allocations, total.gpu_bytes / 1024.0);
+}
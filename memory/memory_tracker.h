@@ -0,0 +1,97 @@
+//
+// Memory use by subsystem, with budgets.
+//
+// Every allocation through operator new, which is every std container, is
+// charged to the tag current on the allocating thread. A subsystem's entry
+// points open a MemoryScope with its tag, so whatever they allocate, however
+// deep in a container, is counted against it. Scopes nest and the innermost
+// wins: live_scene_apply is SCENE, but the draw batch it grows is RENDER.
+// Jobs run under the tag of the thread that queued them (jobs/job_system.h),
+// so parallel_for bodies are charged to their caller. A thread a subsystem
+// starts itself, like the texture readers, opens its own scope. Anything
+// allocated outside every scope is UNTAGGED.
+//
+// The counting replaces the global operator new and delete. Each block gets
+// a 16 byte header holding its size and tag, so delete knows what to give
+// back. The bytes per tag are one atomic each, on its own cache line, to
+// keep a true peak; the allocation counts are per thread and summed when
+// read. That is one locked add on new and one on delete. malloc and free
+// directly are not seen.
+//
+// GPU memory can't be seen from here, so the GL side charges it by hand:
+// render/gpu_memory_gl.h wraps glBufferData, glBufferStorage and texture
+// storage, and the deletes, with the same tags.
+//
+// memory_frame_end, once a frame, closes the frame's allocation counts and
+// checks the budgets: a tag over its CPU or GPU budget warns once on stderr,
+// and again only after it has come back under.
+//
+
+#ifndef FPS_STYLE_ROOM_MEMORY_TRACKER_H
+#define FPS_STYLE_ROOM_MEMORY_TRACKER_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+enum MemoryTag {
+    MEMORY_UNTAGGED,
+    MEMORY_SCENE,                // entities, level, picking, spatial hash
+    MEMORY_RENDER,               // draw batch, views, lights, shadows, culling
+    MEMORY_PARTICLES,
+    MEMORY_ANIMATION,
+    MEMORY_NAV,
+    MEMORY_NET,
+    MEMORY_TEXTURES,
+    MEMORY_LOD,
+    MEMORY_JOBS,
+    MEMORY_TAGS
+};
+
+struct MemoryTagStats {
+    int64_t bytes;               // live
+    int64_t peak;
+    int64_t blocks;              // live allocations
+    uint64_t allocations;        // ever
+    uint64_t frame_allocations;  // in the last frame
+    uint64_t frame_peak;         // most allocations in one frame
+    int64_t gpu_bytes;
+    int64_t gpu_peak;
+    int64_t budget;              // 0 for none
+    int64_t gpu_budget;
+    bool over;                   // over either budget at the last frame end
+};
+
+/* "scene", "render" and so on */
+const char* memory_tag_name (MemoryTag tag);
+/* MEMORY_TAGS if name is no tag's */
+MemoryTag memory_tag_from_name (const char* name);
+
+/* what this thread's allocations are charged to from now on. returns the
+previous tag */
+MemoryTag memory_set_tag (MemoryTag tag);
+MemoryTag memory_current_tag ();
+
+/* charges tag for a block inside the scope */
+struct MemoryScope {
+    explicit MemoryScope (MemoryTag tag) : previous (memory_set_tag (tag)) {}
+    ~MemoryScope () { memory_set_tag (previous); }
+    MemoryTag previous;
+};
+
+/* GPU memory allocated (bytes > 0) or released (bytes < 0) */
+void memory_gpu_charge (MemoryTag tag, int64_t bytes);
+
+/* 0 removes a budget */
+void memory_set_budget (MemoryTag tag, int64_t cpu_bytes, int64_t gpu_bytes);
+/* "<tag> <cpu MB> <gpu MB>" lines, # comments. false, with a message, if
+the file is missing or a line is malformed */
+bool memory_load_budgets (const char* path);
+
+/* once a frame: closes the frame's allocation counts and warns about
+budgets newly exceeded. returns the frame's allocations over all tags */
+uint64_t memory_frame_end ();
+void memory_stats (MemoryTag tag, MemoryTagStats* out);
+/* one line per tag that has ever allocated, and the totals */
+void memory_print_stats (FILE* f);
+
+#endif //FPS_STYLE_ROOM_MEMORY_TRACKER_H
@@ -0,0 +1,758 @@
+//
+// Voxel navmesh build, point location and the file format. See navmesh.h.
+//
+
+#include "navmesh.h"
+#include <memory/memory_tracker.h>
+#include <jobs/job_system.h>
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#define NAV_FILE_MAGIC 0x56414e52u // "RNAV"
+#define NAV_FILE_VERSION 1
+#define NAV_BAND_ROWS 16
+#define NAV_NO_LINK 0xff
+#define NAV_OPEN_SKY 0xffff        // span height of "nothing above"
+
+static const int NAV_DX[4] = {-1, 0, 1, 0};
+static const int NAV_DZ[4] = {0, 1, 0, -1};
+
+static double ms_since (std::chrono::steady_clock::time_point t0) {
+    return std::chrono::duration<double, std::milli> (std::chrono::steady_clock::now () - t0).count ();
+}
+
+NavBuildParams navmesh_default_params () {
+    NavBuildParams p;
+    p.cell_size = 0.15f;
+    p.cell_height = 0.05f;
+    p.agent_height = 1.8f;
+    p.agent_radius = 0.3f;
+    p.max_climb = 0.4f;
+    p.max_slope = 45.0f;
+    p.max_poly_cells = 24;
+    return p;
+}
+
+/*----------------------------------VOXELIZE----------------------------------*/
+struct NavGrid {
+    vec3 origin;
+    int width, depth;
+    float cs, ch;                // cell size and height
+    int climb;                   // in cell heights
+    int agent_height;
+};
+
+/* solid, in a column's list, lowest first */
+struct NavSpan {
+    uint16_t smin, smax;
+    uint16_t walkable;
+    int next;
+};
+
+/* NAV_BAND_ROWS rows of columns, rasterized and searched for floors on one
+worker */
+struct NavBand {
+    int z0, rows;
+    std::vector<uint32_t> triangles;
+    std::vector<NavSpan> spans;
+    std::vector<int> heads;      // per column, -1 for none
+    int free_spans;
+    uint64_t span_count;
+    std::vector<uint32_t> floor_count; // per column
+    std::vector<uint16_t> floor_y;
+    std::vector<uint16_t> floor_clear; // open space above
+};
+
+/* adds [smin, smax] to a column, merging it with every span it touches. the
+merged span is walkable if whichever top is higher is, or either is when the
+tops are within a climb of each other */
+static void add_span (NavBand* b, int column, int smin, int smax, bool walkable, int climb) {
+    int prev = -1;
+    int cur = b->heads[column];
+    while (cur != -1) {
+        NavSpan& c = b->spans[cur];
+        if (c.smin > smax) {
+            break;
+        }
+        if (c.smax < smin) {
+            prev = cur;
+            cur = c.next;
+            continue;
+        }
+        if (c.smax > smax) {
+            walkable = c.smax - smax <= climb ? walkable || c.walkable : c.walkable != 0;
+            smax = c.smax;
+        } else if (smax - c.smax <= climb) {
+            walkable = walkable || c.walkable;
+        }
+        smin = c.smin < smin ? c.smin : smin;
+        int next = c.next;
+        c.next = b->free_spans;
+        b->free_spans = cur;
+        if (prev == -1) {
+            b->heads[column] = next;
+        } else {
+            b->spans[prev].next = next;
+        }
+        cur = next;
+    }
+    int s;
+    if (b->free_spans != -1) {
+        s = b->free_spans;
+        b->free_spans = b->spans[s].next;
+    } else {
+        s = (int)b->spans.size ();
+        b->spans.push_back (NavSpan ());
+    }
+    NavSpan& n = b->spans[s];
+    n.smin = (uint16_t)smin;
+    n.smax = (uint16_t)smax;
+    n.walkable = walkable;
+    n.next = cur;
+    if (prev == -1) {
+        b->heads[column] = s;
+    } else {
+        b->spans[prev].next = s;
+    }
+}
+
+/* splits the convex polygon in along the plane coord[axis] = line into the
+part at or below it and the part at or above it */
+static void clip_poly (const float* in, int n, float* below, int* nbelow, float* above, int* nabove, float line,
+                       int axis) {
+    float d[12];
+    for (int i = 0; i < n; i++) {
+        d[i] = line - in[i * 3 + axis];
+    }
+    int m = 0, k = 0;
+    for (int i = 0, j = n - 1; i < n; j = i, i++) {
+        bool a = d[j] >= 0.0f, b = d[i] >= 0.0f;
+        if (a != b) {
+            float s = d[j] / (d[j] - d[i]);
+            for (int c = 0; c < 3; c++) {
+                below[m * 3 + c] = above[k * 3 + c] = in[j * 3 + c] + (in[i * 3 + c] - in[j * 3 + c]) * s;
+            }
+            m++;
+            k++;
+            // the crossing is in both already, so only points off the line
+            if (d[i] > 0.0f) {
+                memcpy (below + m++ * 3, in + i * 3, 3 * sizeof (float));
+            } else if (d[i] < 0.0f) {
+                memcpy (above + k++ * 3, in + i * 3, 3 * sizeof (float));
+            }
+        } else {
+            if (d[i] >= 0.0f) {
+                memcpy (below + m++ * 3, in + i * 3, 3 * sizeof (float));
+                if (d[i] != 0.0f) {
+                    continue;
+                }
+            }
+            memcpy (above + k++ * 3, in + i * 3, 3 * sizeof (float));
+        }
+    }
+    *nbelow = m;
+    *nabove = k;
+}
+
+/* the part of a triangle inside band b, cell by cell. each cut leaves the
+part past it in the other buffer of a pair */
+static void rasterize (NavBand* b, const NavGrid& g, const vec3& v0, const vec3& v1, const vec3& v2, bool walkable) {
+    float buf[5][36];
+    float* in = buf[0];
+    float* in_rest = buf[1];
+    float* row = buf[2];
+    float* row_rest = buf[3];
+    float* cell = buf[4];
+    int n = 3;
+    memcpy (in, v0.v, 3 * sizeof (float));
+    memcpy (in + 3, v1.v, 3 * sizeof (float));
+    memcpy (in + 6, v2.v, 3 * sizeof (float));
+    float zmin = fminf (fminf (v0.v[2], v1.v[2]), v2.v[2]);
+    float zmax = fmaxf (fmaxf (v0.v[2], v1.v[2]), v2.v[2]);
+    float ics = 1.0f / g.cs, ich = 1.0f / g.ch;
+    int z0 = (int)floorf ((zmin - g.origin.v[2]) * ics);
+    int z1 = (int)floorf ((zmax - g.origin.v[2]) * ics);
+    int band_end = b->z0 + b->rows - 1;
+    z1 = z1 < band_end ? z1 : band_end;
+    if (z0 < b->z0) {
+        // drop what is before the band
+        int nrow;
+        clip_poly (in, n, row, &nrow, in_rest, &n, g.origin.v[2] + b->z0 * g.cs, 2);
+        std::swap (in, in_rest);
+        z0 = b->z0;
+    }
+    for (int z = z0; z <= z1 && n >= 3; z++) {
+        int nrow;
+        clip_poly (in, n, row, &nrow, in_rest, &n, g.origin.v[2] + (z + 1) * g.cs, 2);
+        std::swap (in, in_rest);
+        if (nrow < 3) {
+            continue;
+        }
+        float xmin = row[0], xmax = row[0];
+        for (int i = 1; i < nrow; i++) {
+            xmin = fminf (xmin, row[i * 3]);
+            xmax = fmaxf (xmax, row[i * 3]);
+        }
+        int x0 = (int)floorf ((xmin - g.origin.v[0]) * ics);
+        int x1 = (int)floorf ((xmax - g.origin.v[0]) * ics);
+        x0 = x0 < 0 ? 0 : x0;
+        x1 = x1 < g.width ? x1 : g.width - 1;
+        for (int x = x0; x <= x1 && nrow >= 3; x++) {
+            int ncell;
+            clip_poly (row, nrow, cell, &ncell, row_rest, &nrow, g.origin.v[0] + (x + 1) * g.cs, 0);
+            std::swap (row, row_rest);
+            if (ncell < 3) {
+                continue;
+            }
+            float ymin = cell[1], ymax = cell[1];
+            for (int i = 1; i < ncell; i++) {
+                ymin = fminf (ymin, cell[i * 3 + 1]);
+                ymax = fmaxf (ymax, cell[i * 3 + 1]);
+            }
+            int smin = (int)floorf ((ymin - g.origin.v[1]) * ich);
+            int smax = (int)ceilf ((ymax - g.origin.v[1]) * ich);
+            smin = smin < 0 ? 0 : smin;
+            smax = smax > smin ? smax : smin + 1;
+            add_span (b, (z - b->z0) * g.width + x, smin, smax, walkable, g.climb);
+        }
+    }
+}
+
+/* the tops of walkable spans with room for an agent above them */
+static void find_floors (NavBand* b, const NavGrid& g) {
+    int columns = b->rows * g.width;
+    b->floor_count.assign (columns, 0);
+    b->floor_y.clear ();
+    b->floor_clear.clear ();
+    b->span_count = 0;
+    for (int c = 0; c < columns; c++) {
+        for (int s = b->heads[c]; s != -1; s = b->spans[s].next) {
+            const NavSpan& span = b->spans[s];
+            b->span_count++;
+            if (!span.walkable) {
+                continue;
+            }
+            int ceiling = span.next != -1 ? b->spans[span.next].smin : NAV_OPEN_SKY;
+            if (ceiling - span.smax >= g.agent_height) {
+                b->floor_count[c]++;
+                b->floor_y.push_back (span.smax);
+                b->floor_clear.push_back ((uint16_t)(ceiling - span.smax));
+            }
+        }
+    }
+    std::vector<NavSpan> ().swap (b->spans);
+    std::vector<int> ().swap (b->heads);
+}
+
+/*-----------------------------------FLOORS-----------------------------------*/
+/* floor k of column (x, z), or -1 */
+static inline int nav_floor (const NavMesh& m, int x, int z, int k) {
+    if (k == NAV_NO_LINK) {
+        return -1;
+    }
+    return (int)m.column_first[z * m.width + x] + k;
+}
+
+/* links every floor to the first floor in each neighbouring column it can
+step to, as a layer number in that column */
+static void link_floors (const NavMesh& m, const NavGrid& g, const std::vector<uint16_t>& clear,
+                         std::vector<uint8_t>* con) {
+    parallel_for_each (m.depth, 4, [&] (int begin, int end) {
+        for (int z = begin; z < end; z++) {
+            for (int x = 0; x < m.width; x++) {
+                int col = z * m.width + x;
+                for (uint32_t f = m.column_first[col]; f < m.column_first[col + 1]; f++) {
+                    int y = m.floor_y[f], top = y + clear[f];
+                    for (int d = 0; d < 4; d++) {
+                        int nx = x + NAV_DX[d], nz = z + NAV_DZ[d];
+                        uint8_t link = NAV_NO_LINK;
+                        if (nx >= 0 && nz >= 0 && nx < m.width && nz < m.depth) {
+                            int ncol = nz * m.width + nx;
+                            uint32_t first = m.column_first[ncol];
+                            for (uint32_t k = first; k < m.column_first[ncol + 1] && k - first < NAV_NO_LINK; k++) {
+                                int ny = m.floor_y[k], ntop = ny + clear[k];
+                                int gap = (top < ntop ? top : ntop) - (y > ny ? y : ny);
+                                if (abs (ny - y) <= g.climb && gap >= g.agent_height) {
+                                    link = (uint8_t)(k - first);
+                                    break;
+                                }
+                            }
+                        }
+                        (*con)[f * 4 + d] = link;
+                    }
+                }
+            }
+        }
+    });
+}
+
+/* one cell of erosion: kills every live floor missing a live neighbour in
+any of the eight directions. returns how many it killed */
+static unsigned int erode (const NavMesh& m, const std::vector<uint8_t>& con, std::vector<uint8_t>* alive,
+                           std::vector<uint8_t>* edge) {
+    parallel_for_each (m.depth, 4, [&] (int begin, int end) {
+        for (int z = begin; z < end; z++) {
+            for (int x = 0; x < m.width; x++) {
+                int col = z * m.width + x;
+                for (uint32_t f = m.column_first[col]; f < m.column_first[col + 1]; f++) {
+                    bool border = false;
+                    for (int d = 0; d < 4 && (*alive)[f] && !border; d++) {
+                        int n = nav_floor (m, x + NAV_DX[d], z + NAV_DZ[d], con[f * 4 + d]);
+                        if (n < 0 || !(*alive)[n]) {
+                            border = true;
+                            break;
+                        }
+                        // the diagonal, one turn on from the neighbour
+                        int e = (d + 1) & 3;
+                        int diag = nav_floor (m, x + NAV_DX[d] + NAV_DX[e], z + NAV_DZ[d] + NAV_DZ[e], con[n * 4 + e]);
+                        border = diag < 0 || !(*alive)[diag];
+                    }
+                    (*edge)[f] = border;
+                }
+            }
+        }
+    });
+    unsigned int killed = 0;
+    for (size_t f = 0; f < alive->size (); f++) {
+        if ((*edge)[f]) {
+            (*alive)[f] = 0;
+            killed++;
+        }
+    }
+    return killed;
+}
+
+/*----------------------------------POLYGONS----------------------------------*/
+/* greedy rectangles: grow along x from the first unclaimed floor, then add
+whole rows along z while every cell of the next row is linked to the one
+below and beside it */
+static void build_polys (NavMesh* m, const NavGrid& g, const std::vector<uint8_t>& con,
+                         const std::vector<uint8_t>& alive) {
+    std::vector<int> row, next;
+    int max_cells = m->params.max_poly_cells > 0 ? m->params.max_poly_cells : 1;
+    for (int z = 0; z < m->depth; z++) {
+        for (int x = 0; x < m->width; x++) {
+            int col = z * m->width + x;
+            for (uint32_t f = m->column_first[col]; f < m->column_first[col + 1]; f++) {
+                if (!alive[f] || m->floor_poly[f] != NAV_NO_POLY) {
+                    continue;
+                }
+                int poly = (int)m->polys.size ();
+                int y0 = m->floor_y[f];
+                double y_sum = y0;
+                row.assign (1, (int)f);
+                m->floor_poly[f] = poly;
+                while ((int)row.size () < max_cells) {
+                    int n = nav_floor (*m, x + (int)row.size (), z, con[row.back () * 4 + 2]);
+                    if (n < 0 || !alive[n] || m->floor_poly[n] != NAV_NO_POLY || abs (m->floor_y[n] - y0) > g.climb) {
+                        break;
+                    }
+                    row.push_back (n);
+                    m->floor_poly[n] = poly;
+                    y_sum += m->floor_y[n];
+                }
+                int len = (int)row.size ();
+                int rows = 1;
+                while (rows < max_cells && z + rows < m->depth) {
+                    next.clear ();
+                    for (int i = 0; i < len; i++) {
+                        int n = nav_floor (*m, x + i, z + rows, con[row[i] * 4 + 1]);
+                        if (n < 0 || !alive[n] || m->floor_poly[n] != NAV_NO_POLY ||
+                            abs (m->floor_y[n] - y0) > g.climb) {
+                            break;
+                        }
+                        if (i > 0 && nav_floor (*m, x + i, z + rows, con[next.back () * 4 + 2]) != n) {
+                            break;
+                        }
+                        next.push_back (n);
+                    }
+                    if ((int)next.size () != len) {
+                        break;
+                    }
+                    for (int i = 0; i < len; i++) {
+                        m->floor_poly[next[i]] = poly;
+                        y_sum += m->floor_y[next[i]];
+                    }
+                    row.swap (next);
+                    rows++;
+                }
+                NavPoly p;
+                p.min[0] = g.origin.v[0] + x * g.cs;
+                p.min[1] = g.origin.v[2] + z * g.cs;
+                p.max[0] = g.origin.v[0] + (x + len) * g.cs;
+                p.max[1] = g.origin.v[2] + (z + rows) * g.cs;
+                p.y = g.origin.v[1] + (float)(y_sum / (len * rows)) * g.ch;
+                p.island = -1;
+                p.first_link = 0;
+                p.link_count = 0;
+                m->polys.push_back (p);
+            }
+        }
+    }
+}
+
+/* the floor of poly in column (x, z) */
+static int poly_floor (const NavMesh& m, int x, int z, int poly) {
+    int col = z * m.width + x;
+    for (uint32_t f = m.column_first[col]; f < m.column_first[col + 1]; f++) {
+        if (m.floor_poly[f] == poly) {
+            return (int)f;
+        }
+    }
+    return -1;
+}
+
+/* walks each side of every polygon and turns each run of cells linked to the
+same neighbour into a portal */
+static void build_links (NavMesh* m, const NavGrid& g, const std::vector<uint8_t>& con) {
+    for (int p = 0; p < (int)m->polys.size (); p++) {
+        NavPoly& poly = m->polys[p];
+        poly.first_link = (int)m->links.size ();
+        int x0 = (int)lroundf ((poly.min[0] - g.origin.v[0]) / g.cs);
+        int z0 = (int)lroundf ((poly.min[1] - g.origin.v[2]) / g.cs);
+        int x1 = (int)lroundf ((poly.max[0] - g.origin.v[0]) / g.cs) - 1;
+        int z1 = (int)lroundf ((poly.max[1] - g.origin.v[2]) / g.cs) - 1;
+        for (int d = 0; d < 4; d++) {
+            // cells along the side, and the boundary line they share
+            bool along_z = NAV_DX[d] != 0;
+            int fixed = NAV_DX[d] < 0 ? x0 : NAV_DX[d] > 0 ? x1 : NAV_DZ[d] < 0 ? z0 : z1;
+            int first = along_z ? z0 : x0, last = along_z ? z1 : x1;
+            float line = along_z ? g.origin.v[0] + (fixed + (NAV_DX[d] > 0)) * g.cs
+                                 : g.origin.v[2] + (fixed + (NAV_DZ[d] > 0)) * g.cs;
+            int run_poly = NAV_NO_POLY, run_start = first;
+            for (int i = first; i <= last + 1; i++) {
+                int q = NAV_NO_POLY;
+                if (i <= last) {
+                    int x = along_z ? fixed : i, z = along_z ? i : fixed;
+                    int f = poly_floor (*m, x, z, p);
+                    int n = f < 0 ? -1 : nav_floor (*m, x + NAV_DX[d], z + NAV_DZ[d], con[f * 4 + d]);
+                    q = n < 0 ? NAV_NO_POLY : m->floor_poly[n];
+                }
+                if (q == run_poly) {
+                    continue;
+                }
+                if (run_poly != NAV_NO_POLY) {
+                    const NavPoly& other = m->polys[run_poly];
+                    float y = (poly.y + other.y) * 0.5f;
+                    float a = g.origin.v[along_z ? 2 : 0] + run_start * g.cs;
+                    float b = g.origin.v[along_z ? 2 : 0] + i * g.cs;
+                    vec3 pa = along_z ? vec3 (line, y, a) : vec3 (a, y, line);
+                    vec3 pb = along_z ? vec3 (line, y, b) : vec3 (b, y, line);
+                    // facing out of the side, x cross z positive is on the right
+                    vec3 along = pb - pa;
+                    bool b_right = NAV_DX[d] * along.v[2] - NAV_DZ[d] * along.v[0] > 0.0f;
+                    NavLink l;
+                    l.poly = run_poly;
+                    l.left = b_right ? pa : pb;
+                    l.right = b_right ? pb : pa;
+                    m->links.push_back (l);
+                }
+                run_poly = q;
+                run_start = i;
+            }
+        }
+        poly.link_count = (int)m->links.size () - poly.first_link;
+    }
+}
+
+static unsigned int number_islands (NavMesh* m) {
+    std::vector<int> stack;
+    int islands = 0;
+    for (size_t start = 0; start < m->polys.size (); start++) {
+        if (m->polys[start].island >= 0) {
+            continue;
+        }
+        m->polys[start].island = islands;
+        stack.assign (1, (int)start);
+        while (!stack.empty ()) {
+            const NavPoly& p = m->polys[stack.back ()];
+            stack.pop_back ();
+            for (int l = p.first_link; l < p.first_link + p.link_count; l++) {
+                NavPoly& q = m->polys[m->links[l].poly];
+                if (q.island < 0) {
+                    q.island = islands;
+                    stack.push_back (m->links[l].poly);
+                }
+            }
+        }
+        islands++;
+    }
+    return (unsigned int)islands;
+}
+
+/*-----------------------------------BUILD------------------------------------*/
+bool navmesh_build (const NavBuildParams& params, const Mesh* meshes, const mat4* transforms, int mesh_count,
+                    NavMesh* out) {
+    MemoryScope scope (MEMORY_NAV);
+    auto t0 = std::chrono::steady_clock::now ();
+    memset (&out->stats, 0, sizeof (out->stats));
+    out->params = params;
+    out->polys.clear ();
+    out->links.clear ();
+
+    // world space triangles and their slope
+    std::vector<vec3> verts;
+    std::vector<uint32_t> tris;
+    Aabb bounds = aabb_empty ();
+    for (int i = 0; i < mesh_count; i++) {
+        uint32_t base = (uint32_t)verts.size ();
+        for (size_t v = 0; v < meshes[i].positions.size (); v++) {
+            vec3 p = meshes[i].positions[v];
+            if (transforms) {
+                p = vec3 (transforms[i] * vec4 (p, 1.0f));
+            }
+            verts.push_back (p);
+            aabb_grow (&bounds, p);
+        }
+        for (size_t k = 0; k < meshes[i].indices.size (); k++) {
+            tris.push_back (base + meshes[i].indices[k]);
+        }
+    }
+    size_t tri_count = tris.size () / 3;
+    out->stats.triangles = tri_count;
+    float slope = cosf (params.max_slope * MATHS_DEG_TO_RAD);
+    std::vector<uint8_t> walkable (tri_count);
+    for (size_t t = 0; t < tri_count; t++) {
+        const vec3& a = verts[tris[t * 3]];
+        vec3 n = cross (verts[tris[t * 3 + 1]] - a, verts[tris[t * 3 + 2]] - a);
+        float len = length (n);
+        walkable[t] = len > 0.0f && n.v[1] >= slope * len;
+        out->stats.walkable_triangles += walkable[t];
+    }
+
+    NavGrid g;
+    g.origin = bounds.min;
+    g.cs = params.cell_size;
+    g.ch = params.cell_height;
+    g.width = tri_count ? (int)ceilf ((bounds.max.v[0] - bounds.min.v[0]) / g.cs) + 1 : 1;
+    g.depth = tri_count ? (int)ceilf ((bounds.max.v[2] - bounds.min.v[2]) / g.cs) + 1 : 1;
+    g.climb = (int)floorf (params.max_climb / g.ch);
+    g.agent_height = (int)ceilf (params.agent_height / g.ch);
+    if (tri_count && (bounds.max.v[1] - bounds.min.v[1]) / g.ch + 2.0f >= (float)NAV_OPEN_SKY) {
+        fprintf (stderr, "ERROR: the level is %.1f units tall, over %d cell heights\n",
+                 bounds.max.v[1] - bounds.min.v[1], NAV_OPEN_SKY - 2);
+        return false;
+    }
+    out->origin = g.origin;
+    out->width = g.width;
+    out->depth = g.depth;
+
+    // each band gets the triangles that reach its rows
+    int band_count = (g.depth + NAV_BAND_ROWS - 1) / NAV_BAND_ROWS;
+    std::vector<NavBand> bands (band_count);
+    for (int b = 0; b < band_count; b++) {
+        bands[b].z0 = b * NAV_BAND_ROWS;
+        bands[b].rows = g.depth - bands[b].z0 < NAV_BAND_ROWS ? g.depth - bands[b].z0 : NAV_BAND_ROWS;
+    }
+    for (size_t t = 0; t < tri_count; t++) {
+        float zmin = fminf (fminf (verts[tris[t * 3]].v[2], verts[tris[t * 3 + 1]].v[2]), verts[tris[t * 3 + 2]].v[2]);
+        float zmax = fmaxf (fmaxf (verts[tris[t * 3]].v[2], verts[tris[t * 3 + 1]].v[2]), verts[tris[t * 3 + 2]].v[2]);
+        int b0 = (int)floorf ((zmin - g.origin.v[2]) / g.cs) / NAV_BAND_ROWS;
+        int b1 = (int)floorf ((zmax - g.origin.v[2]) / g.cs) / NAV_BAND_ROWS;
+        b1 = b1 < band_count ? b1 : band_count - 1;
+        for (int b = b0 < 0 ? 0 : b0; b <= b1; b++) {
+            bands[b].triangles.push_back ((uint32_t)t);
+        }
+    }
+    parallel_for_each (band_count, 1, [&] (int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            NavBand& b = bands[i];
+            b.heads.assign (b.rows * g.width, -1);
+            b.free_spans = -1;
+            for (size_t k = 0; k < b.triangles.size (); k++) {
+                uint32_t t = b.triangles[k];
+                rasterize (&b, g, verts[tris[t * 3]], verts[tris[t * 3 + 1]], verts[tris[t * 3 + 2]], walkable[t] != 0);
+            }
+            std::vector<uint32_t> ().swap (b.triangles);
+            find_floors (&b, g);
+        }
+    });
+    out->stats.voxelize_ms = ms_since (t0);
+
+    // the bands are whole rows in order, so their floors concatenate
+    auto t1 = std::chrono::steady_clock::now ();
+    out->column_first.assign ((size_t)g.width * g.depth + 1, 0);
+    out->floor_y.clear ();
+    std::vector<uint16_t> clear;
+    size_t col = 0;
+    for (int b = 0; b < band_count; b++) {
+        const NavBand& band = bands[b];
+        for (size_t c = 0; c < band.floor_count.size (); c++, col++) {
+            out->column_first[col + 1] = out->column_first[col] + band.floor_count[c];
+        }
+        out->floor_y.insert (out->floor_y.end (), band.floor_y.begin (), band.floor_y.end ());
+        clear.insert (clear.end (), band.floor_clear.begin (), band.floor_clear.end ());
+        out->stats.spans += band.span_count;
+    }
+    bands.clear ();
+    size_t floors = out->floor_y.size ();
+    out->stats.floors = (unsigned int)floors;
+    std::vector<uint8_t> con (floors * 4);
+    link_floors (*out, g, clear, &con);
+    std::vector<uint8_t> alive (floors, 1), edge (floors);
+    int rounds = (int)ceilf (params.agent_radius / g.cs);
+    for (int r = 0; r < rounds; r++) {
+        out->stats.eroded += erode (*out, con, &alive, &edge);
+    }
+    out->stats.floors_ms = ms_since (t1);
+
+    auto t2 = std::chrono::steady_clock::now ();
+    out->floor_poly.assign (floors, NAV_NO_POLY);
+    build_polys (out, g, con, alive);
+    build_links (out, g, con);
+    out->stats.islands = number_islands (out);
+    out->stats.polys = (unsigned int)out->polys.size ();
+    out->stats.links = (unsigned int)out->links.size ();
+    out->stats.polys_ms = ms_since (t2);
+    return true;
+}
+
+/*----------------------------------QUERIES-----------------------------------*/
+int navmesh_find_poly (const NavMesh& m, const vec3& p, vec3* nearest) {
+    float cs = m.params.cell_size;
+    int cx = (int)floorf ((p.v[0] - m.origin.v[0]) / cs);
+    int cz = (int)floorf ((p.v[2] - m.origin.v[2]) / cs);
+    int reach = (int)ceilf (m.params.agent_radius / cs) + 1;
+    int best = NAV_NO_POLY;
+    float best_d = 1e30f;
+    vec3 best_p = p;
+    // the point's own column first, then the square around it
+    for (int r = 0; r <= reach && best == NAV_NO_POLY; r++) {
+        for (int z = cz - r; z <= cz + r; z++) {
+            for (int x = cx - r; x <= cx + r; x++) {
+                if ((abs (x - cx) != r && abs (z - cz) != r) || x < 0 || z < 0 || x >= m.width || z >= m.depth) {
+                    continue;
+                }
+                int col = z * m.width + x;
+                for (uint32_t f = m.column_first[col]; f < m.column_first[col + 1]; f++) {
+                    int poly = m.floor_poly[f];
+                    if (poly == NAV_NO_POLY) {
+                        continue;
+                    }
+                    float dy = m.origin.v[1] + m.floor_y[f] * m.params.cell_height - p.v[1];
+                    if (dy > m.params.max_climb || dy < -m.params.agent_height) {
+                        continue;
+                    }
+                    const NavPoly& q = m.polys[poly];
+                    vec3 on (fminf (fmaxf (p.v[0], q.min[0]), q.max[0]), q.y, fminf (fmaxf (p.v[2], q.min[1]), q.max[1]));
+                    float d = (on.v[0] - p.v[0]) * (on.v[0] - p.v[0]) + (on.v[2] - p.v[2]) * (on.v[2] - p.v[2]) +
+                              dy * dy;
+                    if (d < best_d) {
+                        best_d = d;
+                        best = poly;
+                        best_p = on;
+                    }
+                }
+            }
+        }
+    }
+    if (nearest) {
+        *nearest = best_p;
+    }
+    return best;
+}
+
+/*------------------------------------FILES-----------------------------------*/
+struct NavFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t width, depth;
+    uint32_t floors;
+    uint32_t polys;
+    uint32_t links;
+    uint32_t reserved;
+    NavBuildParams params;
+    float origin[3];
+};
+
+bool navmesh_save (const char* path, const NavMesh& m) {
+    FILE* f = fopen (path, "wb");
+    if (!f) {
+        fprintf (stderr, "ERROR: could not open %s for writing\n", path);
+        return false;
+    }
+    NavFileHeader h;
+    memset (&h, 0, sizeof (h));
+    h.magic = NAV_FILE_MAGIC;
+    h.version = NAV_FILE_VERSION;
+    h.width = (uint32_t)m.width;
+    h.depth = (uint32_t)m.depth;
+    h.floors = (uint32_t)m.floor_y.size ();
+    h.polys = (uint32_t)m.polys.size ();
+    h.links = (uint32_t)m.links.size ();
+    h.params = m.params;
+    memcpy (h.origin, m.origin.v, sizeof (h.origin));
+    fwrite (&h, sizeof (h), 1, f);
+    fwrite (m.column_first.data (), sizeof (uint32_t), m.column_first.size (), f);
+    fwrite (m.floor_y.data (), sizeof (uint16_t), m.floor_y.size (), f);
+    fwrite (m.floor_poly.data (), sizeof (int), m.floor_poly.size (), f);
+    fwrite (m.polys.data (), sizeof (NavPoly), m.polys.size (), f);
+    fwrite (m.links.data (), sizeof (NavLink), m.links.size (), f);
+    bool ok = !ferror (f);
+    fclose (f);
+    if (!ok) {
+        fprintf (stderr, "ERROR: could not write %s\n", path);
+    }
+    return ok;
+}
+
+template <typename T>
+static bool read_array (FILE* f, std::vector<T>* out, size_t count) {
+    out->resize (count);
+    return fread (out->data (), sizeof (T), count, f) == count;
+}
+
+bool navmesh_load (const char* path, NavMesh* m) {
+    MemoryScope scope (MEMORY_NAV);
+    FILE* f = fopen (path, "rb");
+    if (!f) {
+        fprintf (stderr, "ERROR: could not open %s\n", path);
+        return false;
+    }
+    NavFileHeader h;
+    bool ok = fread (&h, sizeof (h), 1, f) == 1;
+    if (ok && (h.magic != NAV_FILE_MAGIC || h.version != NAV_FILE_VERSION)) {
+        fprintf (stderr, "ERROR: %s is not a version %d navmesh\n", path, NAV_FILE_VERSION);
+        fclose (f);
+        return false;
+    }
+    ok = ok && read_array (f, &m->column_first, (size_t)h.width * h.depth + 1) &&
+         read_array (f, &m->floor_y, h.floors) && read_array (f, &m->floor_poly, h.floors) &&
+         read_array (f, &m->polys, h.polys) && read_array (f, &m->links, h.links);
+    fclose (f);
+    if (!ok) {
+        fprintf (stderr, "ERROR: %s is short\n", path);
+        return false;
+    }
+    // everything indexes something that exists
+    ok = m->column_first[0] == 0 && m->column_first.back () == h.floors;
+    for (size_t i = 0; ok && i + 1 < m->column_first.size (); i++) {
+        ok = m->column_first[i] <= m->column_first[i + 1];
+    }
+    for (size_t i = 0; ok && i < m->floor_poly.size (); i++) {
+        ok = m->floor_poly[i] >= NAV_NO_POLY && m->floor_poly[i] < (int)h.polys;
+    }
+    for (size_t i = 0; ok && i < m->polys.size (); i++) {
+        const NavPoly& p = m->polys[i];
+        ok = p.first_link >= 0 && p.link_count >= 0 && (uint32_t)(p.first_link + p.link_count) <= h.links;
+    }
+    for (size_t i = 0; ok && i < m->links.size (); i++) {
+        ok = m->links[i].poly >= 0 && m->links[i].poly < (int)h.polys;
+    }
+    if (!ok) {
+        fprintf (stderr, "ERROR: %s is inconsistent\n", path);
+        return false;
+    }
+    m->params = h.params;
+    m->origin = vec3 (h.origin[0], h.origin[1], h.origin[2]);
+    m->width = (int)h.width;
+    m->depth = (int)h.depth;
+    memset (&m->stats, 0, sizeof (m->stats));
+    m->stats.floors = h.floors;
+    m->stats.polys = h.polys;
+    m->stats.links = h.links;
+    return true;
+}
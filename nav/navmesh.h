@@ -0,0 +1,118 @@
+//
+// Navigation mesh for NPCs, built from the level's triangles.
+//
+// The build is the usual voxel one:
+//  1. rasterize every triangle into a heightfield: columns cell_size on a
+//     side, each a list of solid spans cell_height high. A span is walkable
+//     if the triangle that made its top is no steeper than max_slope
+//  2. the top of a walkable span with agent_height of open space above it is
+//     a floor. Floors link to floors in the four neighbouring columns that
+//     are within max_climb and leave an agent room to pass between them
+//  3. erode the floors by agent_radius, so paths keep that far from walls
+//     and drops
+//  4. merge the floors into convex polygons, greedy axis aligned rectangles
+//     up to max_poly_cells on a side and never more than max_climb from
+//     level. Polygons link to their neighbours through portals, the runs of
+//     shared edge that are linked underfoot
+// Rasterizing and finding floors run in bands of rows on the job system,
+// each band with its own span pool. Linking and erosion run by rows.
+// Rectangles are not as few as the polygons a contour tracing builder
+// makes, but they are convex by construction and need no triangulation.
+//
+// The mesh keeps the floor grid, so the polygon under a point is a column
+// lookup. Polygons reachable from one another share an island number, so a
+// query between islands fails without a search.
+//
+// navmesh_save and navmesh_load are the offline route: tools/nav_tool.cpp
+// builds the mesh once and the game loads it without building.
+//
+
+#ifndef FPS_STYLE_ROOM_NAVMESH_H
+#define FPS_STYLE_ROOM_NAVMESH_H
+
+#include <stdint.h>
+#include <vector>
+#include <geometry/mesh.h>
+
+#define NAV_NO_POLY -1
+
+struct NavBuildParams {
+    float cell_size;             // column width, x and z
+    float cell_height;           // span resolution, y
+    float agent_height;          // open space needed above a floor
+    float agent_radius;          // kept clear of walls and drops
+    float max_climb;             // step between neighbouring floors
+    float max_slope;             // degrees
+    int max_poly_cells;          // longest polygon side, in cells
+};
+
+/* an axis aligned rectangle of floor */
+struct NavPoly {
+    float min[2];                // x, z
+    float max[2];
+    float y;                     // floor height, the mean over its cells
+    int island;                  // polygons with a path between them share it
+    int first_link;
+    int link_count;
+};
+
+/* a portal into a neighbouring polygon. left and right are its ends as seen
+walking from this polygon into that one */
+struct NavLink {
+    int poly;
+    vec3 left;
+    vec3 right;
+};
+
+struct NavBuildStats {
+    uint64_t triangles;
+    uint64_t walkable_triangles;
+    uint64_t spans;              // solid, after merging
+    unsigned int floors;
+    unsigned int eroded;         // floors too close to an edge
+    unsigned int polys;
+    unsigned int links;
+    unsigned int islands;
+    double voxelize_ms;
+    double floors_ms;            // linking and erosion too
+    double polys_ms;
+};
+
+struct NavMesh {
+    NavBuildParams params;
+    vec3 origin;                 // the grid's minimum corner
+    int width, depth;            // columns in x and z
+    std::vector<uint32_t> column_first; // width * depth + 1, into the floor arrays
+    std::vector<uint16_t> floor_y;      // in cell heights above origin
+    std::vector<int> floor_poly;        // NAV_NO_POLY where eroded
+    std::vector<NavPoly> polys;
+    std::vector<NavLink> links;
+    NavBuildStats stats;
+};
+
+/* a 1.8 unit tall, 0.3 unit wide agent on a 0.15 unit grid */
+NavBuildParams navmesh_default_params ();
+/* builds from every triangle of meshes[i] transformed by transforms[i]
+(transforms may be NULL for world space meshes). false, with a message, if
+the level is too tall for the span heights */
+bool navmesh_build (const NavBuildParams& params, const Mesh* meshes, const mat4* transforms, int mesh_count,
+                    NavMesh* out);
+
+/* the polygon under p, or the nearest within agent_radius and a cell of it,
+with nearest set to p moved onto it. NAV_NO_POLY if there is none */
+int navmesh_find_poly (const NavMesh& m, const vec3& p, vec3* nearest);
+
+inline vec3 nav_poly_center (const NavPoly& p) {
+    return vec3 ((p.min[0] + p.max[0]) * 0.5f, p.y, (p.min[1] + p.max[1]) * 0.5f);
+}
+
+inline vec3 nav_link_mid (const NavLink& l) {
+    return (l.left + l.right) * 0.5f;
+}
+
+/* false, with a message, on a write error */
+bool navmesh_save (const char* path, const NavMesh& m);
+/* false, with a message, if the file is missing, short or inconsistent */
+bool navmesh_load (const char* path, NavMesh* m);
+
+#endif //FPS_STYLE_ROOM_NAVMESH_H
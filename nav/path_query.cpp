@@ -0,0 +1,307 @@
+//
+// Batched A* over the navmesh polygons and the funnel. See path_query.h.
+//
+
+#include "path_query.h"
+#include <memory/memory_tracker.h>
+#include <jobs/job_system.h>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <math.h>
+#include <string.h>
+
+static double ms_since (std::chrono::steady_clock::time_point t0) {
+    return std::chrono::duration<double, std::milli> (std::chrono::steady_clock::now () - t0).count ();
+}
+
+static inline uint64_t poly_pair (int start, int goal) {
+    return (uint64_t)(uint32_t)start << 32 | (uint32_t)goal;
+}
+
+static inline size_t cache_slot (const NavQueryService& q, uint64_t key) {
+    return (size_t)((key * 0x9e3779b97f4a7c15ull) >> 32) & (q.cache.size () - 1);
+}
+
+/*-------------------------------------A*-------------------------------------*/
+bool nav_search (const NavMesh& m, NavSearch* s, int start, int goal, std::vector<int>* corridor,
+                 unsigned int* expanded) {
+    corridor->clear ();
+    *expanded = 0;
+    size_t n = m.polys.size ();
+    if (s->stamp.size () != n) {
+        s->stamp.assign (n, 0);
+        s->closed.resize (n);
+        s->cost.resize (n);
+        s->parent.resize (n);
+        s->search = 0;
+    }
+    if (m.polys[start].island != m.polys[goal].island) {
+        return false;
+    }
+    // a new stamp empties both sets. only the wrap around needs a clear
+    if (++s->search == 0) {
+        std::fill (s->stamp.begin (), s->stamp.end (), 0);
+        s->search = 1;
+    }
+    vec3 target = nav_poly_center (m.polys[goal]);
+    s->stamp[start] = s->search;
+    s->closed[start] = 0;
+    s->cost[start] = 0.0f;
+    s->parent[start] = NAV_NO_POLY;
+    s->open.clear ();
+    s->open.push_back (std::make_pair (length (target - nav_poly_center (m.polys[start])), start));
+    std::greater<std::pair<float, int> > later;
+    bool found = false;
+    while (!s->open.empty ()) {
+        std::pop_heap (s->open.begin (), s->open.end (), later);
+        int p = s->open.back ().second;
+        s->open.pop_back ();
+        // a polygon is pushed again whenever its cost drops, so old entries
+        // turn up after it has closed
+        if (s->closed[p]) {
+            continue;
+        }
+        s->closed[p] = 1;
+        (*expanded)++;
+        if (p == goal) {
+            found = true;
+            break;
+        }
+        const NavPoly& poly = m.polys[p];
+        vec3 from = nav_poly_center (poly);
+        for (int l = poly.first_link; l < poly.first_link + poly.link_count; l++) {
+            const NavLink& link = m.links[l];
+            int q = link.poly;
+            vec3 to = nav_poly_center (m.polys[q]);
+            vec3 mid = nav_link_mid (link);
+            float cost = s->cost[p] + length (mid - from) + length (to - mid);
+            if (s->stamp[q] != s->search) {
+                s->stamp[q] = s->search;
+                s->closed[q] = 0;
+            } else if (s->closed[q] || cost >= s->cost[q]) {
+                continue;
+            }
+            s->cost[q] = cost;
+            s->parent[q] = p;
+            s->open.push_back (std::make_pair (cost + length (target - to), q));
+            std::push_heap (s->open.begin (), s->open.end (), later);
+        }
+    }
+    if (!found) {
+        return false;
+    }
+    for (int p = goal; p != NAV_NO_POLY; p = s->parent[p]) {
+        corridor->push_back (p);
+    }
+    std::reverse (corridor->begin (), corridor->end ());
+    return true;
+}
+
+/*-----------------------------------FUNNEL-----------------------------------*/
+/* positive when b is to the right of a, looking down on x and z */
+static inline float right_of (const vec3& a, const vec3& b) {
+    return a.v[0] * b.v[2] - a.v[2] * b.v[0];
+}
+
+static inline bool same_point (const vec3& a, const vec3& b) {
+    return length2 (a - b) < 1e-12f;
+}
+
+/* portal i of the corridor: 1 .. count-1 between its polygons, count the goal.
+polygons that aren't linked, as in a corridor gone stale, get a point portal
+at the centre of the next one */
+static void corridor_portal (const NavMesh& m, const int* corridor, int count, const vec3& goal, int i, vec3* left,
+                             vec3* right) {
+    if (i >= count) {
+        *left = *right = goal;
+        return;
+    }
+    // the link the search would have taken, if there are several
+    const NavPoly& p = m.polys[corridor[i - 1]];
+    vec3 from = nav_poly_center (p), to = nav_poly_center (m.polys[corridor[i]]);
+    *left = *right = to;
+    float best = 1e30f;
+    for (int l = p.first_link; l < p.first_link + p.link_count; l++) {
+        const NavLink& link = m.links[l];
+        if (link.poly != corridor[i]) {
+            continue;
+        }
+        vec3 mid = nav_link_mid (link);
+        float cost = length (mid - from) + length (to - mid);
+        if (cost < best) {
+            best = cost;
+            *left = link.left;
+            *right = link.right;
+        }
+    }
+}
+
+void nav_string_pull (const NavMesh& m, const int* corridor, int count, const vec3& start, const vec3& goal,
+                      std::vector<vec3>* out) {
+    out->clear ();
+    out->push_back (start);
+    vec3 apex = start, left = start, right = start;
+    int apex_index = 0, left_index = 0, right_index = 0;
+    for (int i = 1; i <= count; i++) {
+        vec3 l, r;
+        corridor_portal (m, corridor, count, goal, i, &l, &r);
+        // the right side closes in, unless it crosses the left: then the
+        // left is a corner and the next apex
+        if (right_of (right - apex, r - apex) <= 0.0f) {
+            if (same_point (apex, right) || right_of (left - apex, r - apex) > 0.0f) {
+                right = r;
+                right_index = i;
+            } else {
+                apex = left;
+                apex_index = left_index;
+                out->push_back (apex);
+                left = right = apex;
+                left_index = right_index = apex_index;
+                i = apex_index;
+                continue;
+            }
+        }
+        if (right_of (left - apex, l - apex) >= 0.0f) {
+            if (same_point (apex, left) || right_of (right - apex, l - apex) < 0.0f) {
+                left = l;
+                left_index = i;
+            } else {
+                apex = right;
+                apex_index = right_index;
+                out->push_back (apex);
+                left = right = apex;
+                left_index = right_index = apex_index;
+                i = apex_index;
+                continue;
+            }
+        }
+    }
+    if (!same_point (out->back (), goal)) {
+        out->push_back (goal);
+    }
+}
+
+/*-----------------------------------BATCHES----------------------------------*/
+void nav_query_init (NavQueryService* q, const NavMesh* mesh, int cache_size) {
+    MemoryScope scope (MEMORY_NAV);
+    q->mesh = mesh;
+    q->searches.clear ();
+    size_t slots = 0;
+    if (cache_size > 0) {
+        slots = 1;
+        while (slots < (size_t)cache_size) {
+            slots <<= 1;
+        }
+    }
+    q->cache.assign (slots, NavCacheEntry ());
+    nav_query_clear_cache (q);
+    q->jobs.clear ();
+    q->job_count = 0;
+    memset (&q->stats, 0, sizeof (q->stats));
+}
+
+void nav_query_clear_cache (NavQueryService* q) {
+    for (size_t i = 0; i < q->cache.size (); i++) {
+        q->cache[i].key = ~0ull;
+        q->cache[i].corridor.clear ();
+    }
+}
+
+void nav_query_batch (NavQueryService* q, const NavPathRequest* requests, int count, NavPath* out) {
+    MemoryScope scope (MEMORY_NAV);
+    auto t0 = std::chrono::steady_clock::now ();
+    const NavMesh& m = *q->mesh;
+    memset (&q->stats, 0, sizeof (q->stats));
+    q->stats.queries = (unsigned int)count;
+    q->start_poly.resize (count);
+    q->goal_poly.resize (count);
+    q->start_point.resize (count);
+    q->goal_point.resize (count);
+    q->source.resize (count);
+    parallel_for_each (count, 64, [&] (int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            q->start_poly[i] = navmesh_find_poly (m, requests[i].start, &q->start_point[i]);
+            q->goal_poly[i] = navmesh_find_poly (m, requests[i].goal, &q->goal_point[i]);
+        }
+    });
+
+    // the cache, then one search per polygon pair left
+    q->batch_keys.clear ();
+    q->job_count = 0;
+    for (int i = 0; i < count; i++) {
+        int a = q->start_poly[i], b = q->goal_poly[i];
+        if (a == NAV_NO_POLY || b == NAV_NO_POLY || m.polys[a].island != m.polys[b].island) {
+            q->source[i] = NAV_NO_POLY;
+            continue;
+        }
+        uint64_t key = poly_pair (a, b);
+        if (!q->cache.empty ()) {
+            size_t slot = cache_slot (*q, key);
+            if (q->cache[slot].key == key) {
+                q->source[i] = -2 - (int)slot;
+                q->stats.cache_hits++;
+                continue;
+            }
+        }
+        auto it = q->batch_keys.find (key);
+        if (it != q->batch_keys.end ()) {
+            q->source[i] = it->second;
+            continue;
+        }
+        int job = q->job_count++;
+        if ((int)q->jobs.size () < q->job_count) {
+            q->jobs.push_back (NavSearchJob ());
+        }
+        q->jobs[job].start = a;
+        q->jobs[job].goal = b;
+        q->batch_keys[key] = job;
+        q->source[i] = job;
+    }
+    q->stats.searches = (unsigned int)q->job_count;
+    // sized here, not at init: the job system may have started, or restarted
+    // with more workers, since. the last is for a thread that is no worker
+    int workers = job_system_worker_count ();
+    if ((int)q->searches.size () < workers + 1) {
+        q->searches.resize (workers + 1);
+    }
+    parallel_for_each (q->job_count, 1, [&] (int begin, int end) {
+        int worker = job_system_worker_index ();
+        NavSearch* s = &q->searches[worker >= 0 ? worker : workers];
+        for (int j = begin; j < end; j++) {
+            NavSearchJob& job = q->jobs[j];
+            nav_search (m, s, job.start, job.goal, &job.corridor, &job.expanded);
+        }
+    });
+    for (int j = 0; j < q->job_count; j++) {
+        q->stats.expanded += q->jobs[j].expanded;
+    }
+
+    parallel_for_each (count, 16, [&] (int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            int src = q->source[i];
+            const std::vector<int>* corridor = src >= 0 ? &q->jobs[src].corridor
+                                             : src <= -2 ? &q->cache[-2 - src].corridor : NULL;
+            out[i].found = corridor && !corridor->empty ();
+            if (out[i].found) {
+                nav_string_pull (m, corridor->data (), (int)corridor->size (), q->start_point[i], q->goal_point[i],
+                                 &out[i].points);
+            } else {
+                out[i].points.clear ();
+            }
+        }
+    });
+    for (int i = 0; i < count; i++) {
+        q->stats.failed += !out[i].found;
+    }
+
+    // only now, so no hit above reads a slot a new corridor took over
+    for (int j = 0; j < q->job_count && !q->cache.empty (); j++) {
+        const NavSearchJob& job = q->jobs[j];
+        uint64_t key = poly_pair (job.start, job.goal);
+        NavCacheEntry& e = q->cache[cache_slot (*q, key)];
+        e.key = key;
+        e.corridor = job.corridor;
+    }
+    q->stats.ms = ms_since (t0);
+}
@@ -0,0 +1,103 @@
+//
+// Path queries for many agents at once.
+//
+// Agents don't search on their own. They hand NavPathRequests to
+// nav_query_batch, normally all of a frame's at once, which:
+//  1. finds the polygon under each start and goal, in parallel
+//  2. answers from the cache what it can. The cache is keyed on the start
+//     and goal polygons and holds the corridor, the polygons the path
+//     crosses, so it serves any two points in those polygons. Requests that
+//     repeat within the batch share one search, and requests between two
+//     islands fail without one
+//  3. runs A* over the polygon graph for the rest on the job system. Each
+//     worker has its own NavSearch, whose open and closed sets are arrays
+//     over every polygon stamped with a search number, so they are never
+//     cleared or reallocated between searches
+//  4. string pulls every corridor into a path with the funnel algorithm, in
+//     parallel, then adds the new corridors to the cache
+// Polygon centres stand in for positions in the search, so a corridor is
+// the same whichever points in its end polygons asked for it, and the
+// funnel straightens the path afterwards.
+//
+// The cache is direct mapped: a new corridor takes over whatever its slot
+// held. Clear it whenever the mesh changes.
+//
+
+#ifndef FPS_STYLE_ROOM_PATH_QUERY_H
+#define FPS_STYLE_ROOM_PATH_QUERY_H
+
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+#include <nav/navmesh.h>
+
+struct NavPathRequest {
+    vec3 start;
+    vec3 goal;
+};
+
+struct NavPath {
+    bool found;
+    std::vector<vec3> points;    // start to goal, moved onto the mesh
+};
+
+/* one worker's A* state, over every polygon */
+struct NavSearch {
+    std::vector<uint32_t> stamp; // the search that last touched the polygon
+    std::vector<uint8_t> closed;
+    std::vector<float> cost;
+    std::vector<int> parent;
+    std::vector<std::pair<float, int> > open; // a heap on cost plus estimate
+    uint32_t search;
+};
+
+struct NavCacheEntry {
+    uint64_t key;                // start polygon << 32 | goal polygon
+    std::vector<int> corridor;   // empty: no path
+};
+
+/* a search the batch needs, shared by every request with the same polygons */
+struct NavSearchJob {
+    int start, goal;
+    std::vector<int> corridor;
+    unsigned int expanded;
+};
+
+struct NavQueryStats {
+    unsigned int queries;
+    unsigned int cache_hits;
+    unsigned int searches;       // A* runs
+    unsigned int failed;         // off the mesh or no route
+    unsigned int expanded;       // polygons closed over all searches
+    double ms;
+};
+
+struct NavQueryService {
+    const NavMesh* mesh;
+    std::vector<NavSearch> searches; // one per worker, and one for any other thread
+    std::vector<NavCacheEntry> cache;
+    // batch scratch, kept between batches
+    std::vector<int> start_poly, goal_poly;
+    std::vector<vec3> start_point, goal_point;
+    std::vector<int> source;     // per request: a job, -2 - slot for a cache hit, NAV_NO_POLY if failed
+    std::vector<NavSearchJob> jobs;
+    int job_count;
+    std::unordered_map<uint64_t, int> batch_keys;
+    NavQueryStats stats;
+};
+
+/* cache_size is rounded up to a power of two, 0 turns the cache off */
+void nav_query_init (NavQueryService* q, const NavMesh* mesh, int cache_size);
+void nav_query_clear_cache (NavQueryService* q);
+/* out[i] is the path for requests[i]. stats cover this batch */
+void nav_query_batch (NavQueryService* q, const NavPathRequest* requests, int count, NavPath* out);
+
+/* A* from start to goal polygon. the polygons crossed, start first, into
+corridor; false and an empty corridor if there is no path */
+bool nav_search (const NavMesh& m, NavSearch* s, int start, int goal, std::vector<int>* corridor,
+                 unsigned int* expanded);
+/* the shortest path from start to goal through the corridor's portals */
+void nav_string_pull (const NavMesh& m, const int* corridor, int count, const vec3& start, const vec3& goal,
+                      std::vector<vec3>* out);
+
+#endif //FPS_STYLE_ROOM_PATH_QUERY_H
@@ -0,0 +1,466 @@
+//
+// See replication.h.
+//
+
+#include "replication.h"
+#include <memory/memory_tracker.h>
+#include <chrono>
+#include <math.h>
+#include <string.h>
+
+enum NetPacketType {
+    NET_PACKET_HELLO = 1,
+    NET_PACKET_WELCOME,
+    NET_PACKET_INPUT,
+    NET_PACKET_SNAPSHOT
+};
+
+#define SNAPSHOT_HEADER 13
+#define INPUT_BYTES 9
+
+static double ms_since (std::chrono::steady_clock::time_point t0) {
+    return std::chrono::duration<double, std::milli> (std::chrono::steady_clock::now () - t0).count ();
+}
+
+static void put_u32 (uint8_t* p, uint32_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+static uint32_t get_u32 (const uint8_t* p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+/* keys in the low 4 bits, the move angle's quarter turn in the next 2 */
+static uint8_t pack_keys (const PlayerInput& in) {
+    int quarter = in.move_angle == 90 ? 1 : in.move_angle == 180 ? 2 : in.move_angle == -90 ? 3 : 0;
+    return (uint8_t)((in.keys & 15) | quarter << 4);
+}
+
+static void unpack_keys (uint8_t bits, PlayerInput* in) {
+    static const int angles[4] = {0, 90, 180, -90};
+    in->keys = bits & 15;
+    in->move_angle = angles[(bits >> 4) & 3];
+}
+
+NetParams net_default_params () {
+    NetParams p;
+    p.tick_rate = 60;
+    p.snapshot_interval = 2;
+    p.interp_ticks = 4.0f;
+    p.input_stall_ticks = 2;
+    memset (&p.conditions, 0, sizeof (p.conditions));
+    return p;
+}
+
+/*-----------------------------------SERVER-----------------------------------*/
+bool net_server_init (NetServer* s, const NetParams& params, uint16_t port, uint32_t seed) {
+    MemoryScope scope (MEMORY_NET);
+    s->params = params;
+    s->tick = 0;
+    s->clients.clear ();
+    for (int i = 0; i < NET_HISTORY; i++) {
+        s->history[i].tick = NET_NO_TICK;
+        s->history[i].ids.clear ();
+        s->history[i].players.clear ();
+    }
+    memset (&s->stats, 0, sizeof (s->stats));
+    net_link_init (&s->link, params.conditions, seed);
+    return udp_open (&s->socket, port);
+}
+
+static void server_receive (NetServer* s, double now_ms) {
+    uint8_t packet[NET_MAX_PACKET];
+    uint16_t from;
+    size_t bytes;
+    while ((bytes = udp_recv (s->socket, packet, sizeof (packet), &from)) > 0) {
+        if (packet[0] == NET_PACKET_HELLO) {
+            // a repeated hello gets its id again
+            int id = -1;
+            for (size_t i = 0; i < s->clients.size (); i++) {
+                if (s->clients[i].connected && s->clients[i].port == from) {
+                    id = (int)i;
+                }
+            }
+            if (id < 0 && s->clients.size () < NET_MAX_CLIENTS) {
+                NetServerClient c;
+                memset (&c, 0, sizeof (c));
+                c.connected = true;
+                c.port = from;
+                c.acked = NET_NO_TICK;
+                PlayerState start;
+                memset (&start, 0, sizeof (start));
+                start.pos = vec3 (0.0f, 0.0f, 0.5f);
+                c.player = net_quantize_player (start, versor (1.0f, 0.0f, 0.0f, 0.0f));
+                s->clients.push_back (c);
+                id = (int)s->clients.size () - 1;
+            }
+            if (id >= 0) {
+                uint8_t welcome[6] = {NET_PACKET_WELCOME, (uint8_t)id};
+                put_u32 (welcome + 2, s->tick);
+                net_link_send (&s->link, from, welcome, sizeof (welcome), now_ms);
+            }
+        } else if (packet[0] == NET_PACKET_INPUT && bytes >= 7) {
+            int id = packet[1];
+            if (id >= (int)s->clients.size () || s->clients[id].port != from) {
+                continue;
+            }
+            NetServerClient& c = s->clients[id];
+            uint32_t ack = get_u32 (packet + 2);
+            if (ack != NET_NO_TICK && (c.acked == NET_NO_TICK || (int32_t)(ack - c.acked) > 0)) {
+                c.acked = ack;
+            }
+            int count = packet[6];
+            for (int k = 0; k < count && 7 + (size_t)(k + 1) * INPUT_BYTES <= bytes; k++) {
+                const uint8_t* p = packet + 7 + k * INPUT_BYTES;
+                uint32_t seq = get_u32 (p);
+                if (seq <= c.applied || seq - c.applied > NET_INPUT_WINDOW) {
+                    continue;
+                }
+                PlayerInput& in = c.inputs[seq % NET_INPUT_WINDOW];
+                unpack_keys (p[4], &in);
+                in.orientation = net_dequantize_rotation (get_u32 (p + 5));
+                c.input_seq[seq % NET_INPUT_WINDOW] = seq;
+            }
+        }
+    }
+}
+
+/* applies the client's inputs in order. a missing one is waited for a
+couple of ticks, then skipped */
+static void server_apply_inputs (NetServer* s, NetServerClient* c) {
+    while (true) {
+        uint32_t next = c->applied + 1;
+        if (c->input_seq[next % NET_INPUT_WINDOW] == next) {
+            net_player_step (&c->player, c->inputs[next % NET_INPUT_WINDOW]);
+            c->input_seq[next % NET_INPUT_WINDOW] = 0;
+            c->applied = next;
+            c->stall = 0;
+            s->stats.inputs_applied++;
+            continue;
+        }
+        uint32_t oldest = 0;
+        for (int i = 0; i < NET_INPUT_WINDOW; i++) {
+            uint32_t seq = c->input_seq[i];
+            if (seq > next && (!oldest || seq < oldest)) {
+                oldest = seq;
+            }
+        }
+        if (!oldest) {
+            c->stall = 0;
+            return;
+        }
+        if (++c->stall <= s->params.input_stall_ticks) {
+            return;
+        }
+        s->stats.inputs_skipped += oldest - next;
+        c->applied = oldest - 1;
+    }
+}
+
+void net_server_tick (NetServer* s, double now_ms) {
+    MemoryScope scope (MEMORY_NET);
+    auto t0 = std::chrono::steady_clock::now ();
+    server_receive (s, now_ms);
+    NetSnapshot& snap = s->history[s->tick % NET_HISTORY];
+    snap.tick = s->tick;
+    snap.ids.clear ();
+    snap.players.clear ();
+    for (size_t i = 0; i < s->clients.size (); i++) {
+        NetServerClient& c = s->clients[i];
+        if (!c.connected) {
+            continue;
+        }
+        server_apply_inputs (s, &c);
+        snap.ids.push_back ((uint8_t)i);
+        snap.players.push_back (c.player);
+    }
+
+    s->stats.last_bytes = 0;
+    s->stats.last_snapshots = 0;
+    if (s->tick % (uint32_t)s->params.snapshot_interval == 0) {
+        // one encoding per baseline in use
+        std::vector<uint32_t> bases;
+        std::vector<std::vector<uint8_t> > bodies;
+        BitWriter w;
+        bit_writer_init (&w);
+        net_snapshot_encode (&w, snap, NULL);
+        bit_writer_flush (&w);
+        bases.push_back (NET_NO_TICK);
+        bodies.push_back (w.bytes);
+        s->stats.full_bytes = (unsigned int)(SNAPSHOT_HEADER + w.bytes.size ());
+
+        std::vector<uint8_t> packet;
+        for (size_t i = 0; i < s->clients.size (); i++) {
+            const NetServerClient& c = s->clients[i];
+            if (!c.connected) {
+                continue;
+            }
+            uint32_t base = NET_NO_TICK;
+            if (c.acked != NET_NO_TICK && s->tick - c.acked < NET_HISTORY &&
+                s->history[c.acked % NET_HISTORY].tick == c.acked) {
+                base = c.acked;
+            }
+            size_t b = 0;
+            while (b < bases.size () && bases[b] != base) {
+                b++;
+            }
+            if (b == bases.size ()) {
+                bit_writer_init (&w);
+                net_snapshot_encode (&w, snap, &s->history[base % NET_HISTORY]);
+                bit_writer_flush (&w);
+                bases.push_back (base);
+                bodies.push_back (w.bytes);
+            }
+            packet.resize (SNAPSHOT_HEADER + bodies[b].size ());
+            packet[0] = NET_PACKET_SNAPSHOT;
+            put_u32 (&packet[1], s->tick);
+            put_u32 (&packet[5], base);
+            put_u32 (&packet[9], c.applied);
+            memcpy (&packet[SNAPSHOT_HEADER], bodies[b].data (), bodies[b].size ());
+            net_link_send (&s->link, c.port, packet.data (), packet.size (), now_ms);
+            s->stats.snapshots++;
+            s->stats.deltas += base != NET_NO_TICK;
+            s->stats.over_mtu += packet.size () > NET_MTU;
+            s->stats.snapshot_bytes += packet.size ();
+            s->stats.last_bytes += (unsigned int)packet.size ();
+            s->stats.last_snapshots++;
+        }
+        s->stats.encodings = (unsigned int)bases.size ();
+    }
+    net_link_pump (&s->link, s->socket, now_ms);
+    s->tick++;
+    s->stats.clients = (unsigned int)snap.ids.size ();
+    s->stats.tick_ms = ms_since (t0);
+    s->stats.total_tick_ms += s->stats.tick_ms;
+    s->stats.ticks++;
+}
+
+const NetSnapshot* net_server_snapshot (const NetServer& s, uint32_t tick) {
+    const NetSnapshot& snap = s.history[tick % NET_HISTORY];
+    return snap.tick == tick ? &snap : NULL;
+}
+
+void net_server_destroy (NetServer* s) {
+    udp_close (&s->socket);
+    s->clients.clear ();
+}
+
+/*-----------------------------------CLIENT-----------------------------------*/
+bool net_client_init (NetClient* c, const NetParams& params, uint16_t server_port, uint32_t seed) {
+    MemoryScope scope (MEMORY_NET);
+    c->params = params;
+    c->server_port = server_port;
+    c->id = -1;
+    c->hello_ms = -1e30;
+    c->next_seq = 1;
+    c->applied = 0;
+    PlayerState start;
+    memset (&start, 0, sizeof (start));
+    start.pos = vec3 (0.0f, 0.0f, 0.5f);
+    c->predicted = net_quantize_player (start, versor (1.0f, 0.0f, 0.0f, 0.0f));
+    c->error_offset = vec3 (0.0f, 0.0f, 0.0f);
+    for (int i = 0; i < NET_HISTORY; i++) {
+        c->received[i].tick = NET_NO_TICK;
+    }
+    c->newest = NET_NO_TICK;
+    c->clock_offset_ms = 0.0;
+    c->interp_from = c->interp_to = -1;
+    c->interp_t = 0.0f;
+    memset (&c->stats, 0, sizeof (c->stats));
+    net_link_init (&c->link, params.conditions, seed);
+    return udp_open (&c->socket, 0);
+}
+
+/* the server's player state replayed with every input it hasn't applied */
+static void client_reconcile (NetClient* c, const NetPlayer& server, uint32_t applied) {
+    if (applied < c->applied) {
+        return; // reordered, an older snapshot
+    }
+    c->applied = applied;
+    NetPlayer replay = server;
+    uint32_t first = applied + 1;
+    if (c->next_seq - first > NET_INPUT_WINDOW) {
+        first = c->next_seq - NET_INPUT_WINDOW;
+    }
+    for (uint32_t seq = first; seq < c->next_seq; seq++) {
+        net_player_step (&replay, c->inputs[seq % NET_INPUT_WINDOW]);
+    }
+    if (!net_player_equal (replay, c->predicted)) {
+        vec3 moved = net_player_position (c->predicted) - net_player_position (replay);
+        float distance = length (moved);
+        c->stats.corrections++;
+        c->stats.max_correction = distance > c->stats.max_correction ? distance : c->stats.max_correction;
+        // drawn where it was, easing to the corrected position
+        c->error_offset += moved;
+    }
+    c->predicted = replay;
+}
+
+static void client_receive (NetClient* c, double now_ms) {
+    uint8_t packet[NET_MAX_PACKET];
+    size_t bytes;
+    double tick_ms = 1000.0 / c->params.tick_rate;
+    while ((bytes = udp_recv (c->socket, packet, sizeof (packet), NULL)) > 0) {
+        if (packet[0] == NET_PACKET_WELCOME && bytes >= 6 && c->id < 0) {
+            c->id = packet[1];
+            continue;
+        }
+        if (packet[0] != NET_PACKET_SNAPSHOT || bytes < SNAPSHOT_HEADER || c->id < 0) {
+            continue;
+        }
+        uint32_t tick = get_u32 (packet + 1);
+        uint32_t base = get_u32 (packet + 5);
+        uint32_t applied = get_u32 (packet + 9);
+        c->stats.bytes += bytes;
+        const NetSnapshot* baseline = NULL;
+        if (base != NET_NO_TICK) {
+            baseline = &c->received[base % NET_HISTORY];
+            if (baseline->tick != base) {
+                c->stats.undecodable++;
+                continue;
+            }
+        }
+        NetSnapshot& snap = c->received[tick % NET_HISTORY];
+        if (snap.tick == tick) {
+            continue; // a duplicate
+        }
+        NetSnapshot decoded;
+        BitReader r;
+        bit_reader_init (&r, packet + SNAPSHOT_HEADER, bytes - SNAPSHOT_HEADER);
+        if (!net_snapshot_decode (&r, &decoded, baseline)) {
+            c->stats.undecodable++;
+            continue;
+        }
+        decoded.tick = tick;
+        snap = decoded;
+        c->stats.snapshots++;
+        c->stats.deltas += baseline != NULL;
+
+        double sample = tick * tick_ms - now_ms;
+        if (c->newest == NET_NO_TICK) {
+            c->clock_offset_ms = sample;
+        } else {
+            c->clock_offset_ms += (sample - c->clock_offset_ms) * 0.05;
+        }
+        if (c->newest == NET_NO_TICK || (int32_t)(tick - c->newest) > 0) {
+            c->newest = tick;
+            const NetPlayer* own = net_snapshot_find (snap, (uint8_t)c->id);
+            if (own) {
+                client_reconcile (c, *own, applied);
+            }
+        }
+    }
+}
+
+/* the received snapshots either side of the render tick */
+static void client_pick_interpolation (NetClient* c, double now_ms) {
+    double t = net_client_render_tick (*c, now_ms);
+    int from = -1, to = -1;
+    for (int i = 0; i < NET_HISTORY; i++) {
+        uint32_t tick = c->received[i].tick;
+        if (tick == NET_NO_TICK) {
+            continue;
+        }
+        if (tick <= t && (from < 0 || tick > c->received[from].tick)) {
+            from = i;
+        }
+        if (tick > t && (to < 0 || tick < c->received[to].tick)) {
+            to = i;
+        }
+    }
+    c->interp_t = 0.0f;
+    if (from >= 0 && to >= 0) {
+        double a = c->received[from].tick, b = c->received[to].tick;
+        c->interp_t = (float)((t - a) / (b - a));
+    } else if (from >= 0) {
+        c->stats.held++;
+        to = from;
+    } else {
+        from = to;
+    }
+    c->interp_from = from;
+    c->interp_to = to;
+}
+
+void net_client_update (NetClient* c, const PlayerInput& input, double now_ms) {
+    MemoryScope scope (MEMORY_NET);
+    auto t0 = std::chrono::steady_clock::now ();
+    client_receive (c, now_ms);
+    if (c->id < 0) {
+        // hello again every 100 ms until welcomed
+        if (now_ms - c->hello_ms >= 100.0) {
+            uint8_t hello = NET_PACKET_HELLO;
+            net_link_send (&c->link, c->server_port, &hello, 1, now_ms);
+            c->hello_ms = now_ms;
+        }
+    } else {
+        uint32_t seq = c->next_seq++;
+        // quantizing isn't idempotent where two components tie for largest,
+        // so the bits are kept and sent as is: both ends step with the same
+        // dequantized rotation
+        PlayerInput& in = c->inputs[seq % NET_INPUT_WINDOW];
+        in = input;
+        c->input_rotation[seq % NET_INPUT_WINDOW] = net_quantize_rotation (input.orientation);
+        in.orientation = net_dequantize_rotation (c->input_rotation[seq % NET_INPUT_WINDOW]);
+        net_player_step (&c->predicted, in);
+
+        // everything not yet applied, up to the last NET_INPUT_REDUNDANCY
+        uint32_t first = seq >= NET_INPUT_REDUNDANCY ? seq + 1 - NET_INPUT_REDUNDANCY : 1;
+        first = first > c->applied ? first : c->applied + 1;
+        uint8_t packet[7 + NET_INPUT_REDUNDANCY * INPUT_BYTES];
+        packet[0] = NET_PACKET_INPUT;
+        packet[1] = (uint8_t)c->id;
+        put_u32 (packet + 2, c->newest);
+        int count = 0;
+        for (uint32_t s = first; s <= seq; s++) {
+            const PlayerInput& pending = c->inputs[s % NET_INPUT_WINDOW];
+            uint8_t* p = packet + 7 + count * INPUT_BYTES;
+            put_u32 (p, s);
+            p[4] = pack_keys (pending);
+            put_u32 (p + 5, c->input_rotation[s % NET_INPUT_WINDOW]);
+            count++;
+        }
+        packet[6] = (uint8_t)count;
+        net_link_send (&c->link, c->server_port, packet, 7 + count * INPUT_BYTES, now_ms);
+    }
+    net_link_pump (&c->link, c->socket, now_ms);
+
+    client_pick_interpolation (c, now_ms);
+    c->error_offset = c->error_offset * 0.85f;
+    if (dot (c->error_offset, c->error_offset) < 1e-10f) {
+        c->error_offset = vec3 (0.0f, 0.0f, 0.0f);
+    }
+    c->stats.update_ms = ms_since (t0);
+}
+
+vec3 net_client_position (const NetClient& c) {
+    return net_player_position (c.predicted) + c.error_offset;
+}
+
+bool net_client_remote (const NetClient& c, int id, vec3* position, versor* rotation) {
+    if (c.interp_from < 0) {
+        return false;
+    }
+    const NetPlayer* a = net_snapshot_find (c.received[c.interp_from], (uint8_t)id);
+    const NetPlayer* b = net_snapshot_find (c.received[c.interp_to], (uint8_t)id);
+    if (!a || !b) {
+        return false;
+    }
+    float t = c.interp_t;
+    vec3 pa = net_player_position (*a), pb = net_player_position (*b);
+    *position = pa + (pb - pa) * t;
+    *rotation = slerp (net_dequantize_rotation (a->rotation), net_dequantize_rotation (b->rotation), t);
+    return true;
+}
+
+double net_client_render_tick (const NetClient& c, double now_ms) {
+    double tick_ms = 1000.0 / c.params.tick_rate;
+    return (now_ms + c.clock_offset_ms) / tick_ms - c.params.interp_ticks;
+}
+
+void net_client_destroy (NetClient* c) {
+    udp_close (&c->socket);
+}
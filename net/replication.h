@@ -0,0 +1,161 @@
+//
+// Client/server replication of player movement over UDP.
+//
+// The server owns every player. It runs at a fixed tick and moves each
+// player once per input its client sends, with net_player_step
+// (net/snapshot.h), so players move exactly as in the single player game.
+// Every snapshot_interval ticks it sends each client a snapshot of all
+// players, delta compressed against the newest snapshot that client has
+// acknowledged, or whole if it has none still in the server's history.
+// Clients sharing a baseline share the encoding, so a tick encodes once per
+// distinct baseline, not once per client.
+//
+// A client predicts its own player: every tick it steps its input locally,
+// sends it, and keeps it until a snapshot says the server has applied it.
+// Inputs ride along in the next few packets too, so a lost packet rarely
+// loses an input. When a snapshot comes in the client reconciles: it takes
+// its player's state from the snapshot and replays the inputs the server
+// hasn't applied yet. Prediction and server run the same code on the same
+// grids, so the result only differs from what the client predicted when an
+// input was lost for good. The difference is then a correction, smoothed
+// out over a few ticks in net_client_position.
+//
+// Other players are interpolated interp_ticks behind the client's estimate
+// of the server clock, between the two snapshots either side. Past the
+// newest snapshot they hold still.
+//
+// Packets (first byte the type, then little endian fields):
+//   hello     client -> server
+//   welcome   server -> client: id, server tick
+//   input     client -> server: id, newest snapshot tick received, and the
+//             inputs not yet acknowledged, up to NET_INPUT_REDUNDANCY
+//   snapshot  server -> client: tick, baseline tick, the client's newest
+//             applied input, then the encoded players
+//
+// Both ends send through a NetLink (net/udp_socket.h), so loss, latency and
+// jitter can be simulated on either side.
+//
+
+#ifndef FPS_STYLE_ROOM_REPLICATION_H
+#define FPS_STYLE_ROOM_REPLICATION_H
+
+#include <stdint.h>
+#include <vector>
+#include <net/snapshot.h>
+#include <net/udp_socket.h>
+
+#define NET_MAX_CLIENTS 256
+#define NET_HISTORY 32           // snapshots kept for baselines and interpolation
+#define NET_INPUT_WINDOW 64      // inputs a client keeps until acknowledged
+#define NET_INPUT_REDUNDANCY 8   // inputs per input packet
+#define NET_NO_TICK 0xffffffffu
+
+struct NetParams {
+    int tick_rate;               // server ticks a second, client inputs too
+    int snapshot_interval;       // ticks between snapshots
+    float interp_ticks;          // how far behind remote players are drawn
+    int input_stall_ticks;       // wait this long for a missing input, then skip it
+    NetConditions conditions;    // for this end's sends
+};
+
+/* 60 ticks, snapshots at 30 Hz, remote players 4 ticks behind */
+NetParams net_default_params ();
+
+/*-----------------------------------SERVER-----------------------------------*/
+struct NetServerClient {
+    bool connected;
+    uint16_t port;
+    NetPlayer player;
+    uint32_t applied;            // newest input applied, 0 for none
+    uint32_t acked;              // newest snapshot it has, NET_NO_TICK for none
+    int stall;                   // ticks spent waiting for input applied + 1
+    PlayerInput inputs[NET_INPUT_WINDOW];
+    uint32_t input_seq[NET_INPUT_WINDOW]; // which input each slot holds, 0 empty
+};
+
+struct NetServerStats {
+    unsigned int clients;
+    unsigned int snapshots;      // sent, over every client
+    unsigned int deltas;         // of those, against a baseline
+    unsigned int over_mtu;       // bigger than NET_MTU
+    unsigned long long snapshot_bytes;
+    unsigned int last_bytes;     // the last tick's snapshots
+    unsigned int last_snapshots;
+    unsigned int full_bytes;     // the last snapshot tick's whole encoding
+    unsigned int encodings;      // distinct baselines encoded, last snapshot tick
+    unsigned int inputs_applied;
+    unsigned int inputs_skipped; // lost for good
+    double tick_ms;              // the last net_server_tick
+    double total_tick_ms;
+    unsigned int ticks;
+};
+
+struct NetServer {
+    NetParams params;
+    UdpSocket socket;
+    NetLink link;
+    uint32_t tick;
+    std::vector<NetServerClient> clients;  // index is the player id
+    NetSnapshot history[NET_HISTORY];      // by tick % NET_HISTORY
+    NetServerStats stats;
+};
+
+/* binds port, 0 for any. false if it can't */
+bool net_server_init (NetServer* s, const NetParams& params, uint16_t port, uint32_t seed);
+/* one tick: takes in packets, applies inputs, snapshots */
+void net_server_tick (NetServer* s, double now_ms);
+/* the snapshot taken at tick, or NULL if it is out of the history */
+const NetSnapshot* net_server_snapshot (const NetServer& s, uint32_t tick);
+void net_server_destroy (NetServer* s);
+
+/*-----------------------------------CLIENT-----------------------------------*/
+struct NetClientStats {
+    unsigned int snapshots;
+    unsigned int deltas;
+    unsigned int undecodable;    // baseline no longer held
+    unsigned long long bytes;
+    unsigned int corrections;    // reconciles that moved the prediction
+    float max_correction;        // units
+    unsigned int held;           // updates with no snapshot after render time
+    double update_ms;            // the last net_client_update
+};
+
+struct NetClient {
+    NetParams params;
+    UdpSocket socket;
+    NetLink link;
+    uint16_t server_port;
+    int id;                      // -1 until welcomed
+    double hello_ms;             // last hello sent
+
+    uint32_t next_seq;           // the next input's sequence number, from 1
+    uint32_t applied;            // newest input the server has applied
+    PlayerInput inputs[NET_INPUT_WINDOW]; // by seq % NET_INPUT_WINDOW
+    uint32_t input_rotation[NET_INPUT_WINDOW]; // each input's rotation as sent
+    NetPlayer predicted;
+    vec3 error_offset;           // correction still being smoothed out
+
+    NetSnapshot received[NET_HISTORY];     // by tick % NET_HISTORY
+    uint32_t newest;             // newest tick received, NET_NO_TICK for none
+    double clock_offset_ms;      // server tick time minus local time, smoothed
+    // the pair remote players are drawn between, set by each update
+    int interp_from, interp_to;  // into received, -1 if none
+    float interp_t;
+    NetClientStats stats;
+};
+
+/* opens a socket and starts saying hello to server_port */
+bool net_client_init (NetClient* c, const NetParams& params, uint16_t server_port, uint32_t seed);
+/* one client tick: reconciles to new snapshots, predicts with input and
+sends it */
+void net_client_update (NetClient* c, const PlayerInput& input, double now_ms);
+/* where to draw this client's player */
+vec3 net_client_position (const NetClient& c);
+/* where to draw player id. false if the snapshots around render time don't
+have it */
+bool net_client_remote (const NetClient& c, int id, vec3* position, versor* rotation);
+/* the server tick remote players are drawn at */
+double net_client_render_tick (const NetClient& c, double now_ms);
+void net_client_destroy (NetClient* c);
+
+#endif //FPS_STYLE_ROOM_REPLICATION_H
@@ -0,0 +1,278 @@
+//
+// See snapshot.h.
+//
+
+#include "snapshot.h"
+#include <math.h>
+#include <string.h>
+
+/*---------------------------------BIT STREAM---------------------------------*/
+void bit_writer_init (BitWriter* w) {
+    w->bytes.clear ();
+    w->scratch = 0;
+    w->scratch_bits = 0;
+}
+
+void bit_write (BitWriter* w, uint32_t value, int bits) {
+    if (bits < 32) {
+        value &= (1u << bits) - 1u;
+    }
+    w->scratch |= (uint64_t)value << w->scratch_bits;
+    w->scratch_bits += bits;
+    while (w->scratch_bits >= 8) {
+        w->bytes.push_back ((uint8_t)w->scratch);
+        w->scratch >>= 8;
+        w->scratch_bits -= 8;
+    }
+}
+
+static int bit_length (uint32_t v) {
+    return v ? 32 - __builtin_clz (v) : 0;
+}
+
+void bit_write_varbits (BitWriter* w, uint32_t value) {
+    // 5 bits of length hold up to 31, see snapshot.h
+    int n = bit_length (value);
+    bit_write (w, (uint32_t)n, 5);
+    if (n) {
+        bit_write (w, value, n);
+    }
+}
+
+void bit_writer_flush (BitWriter* w) {
+    if (w->scratch_bits) {
+        w->bytes.push_back ((uint8_t)w->scratch);
+    }
+    w->scratch = 0;
+    w->scratch_bits = 0;
+}
+
+void bit_reader_init (BitReader* r, const uint8_t* bytes, size_t size) {
+    r->bytes = bytes;
+    r->size = size;
+    r->next = 0;
+    r->scratch = 0;
+    r->scratch_bits = 0;
+    r->overrun = false;
+}
+
+uint32_t bit_read (BitReader* r, int bits) {
+    while (r->scratch_bits < bits) {
+        if (r->next >= r->size) {
+            r->overrun = true;
+            return 0;
+        }
+        r->scratch |= (uint64_t)r->bytes[r->next++] << r->scratch_bits;
+        r->scratch_bits += 8;
+    }
+    uint32_t value = (uint32_t)(r->scratch & ((bits < 32 ? (1ull << bits) : (1ull << 32)) - 1ull));
+    r->scratch >>= bits;
+    r->scratch_bits -= bits;
+    return value;
+}
+
+uint32_t bit_read_varbits (BitReader* r) {
+    int n = (int)bit_read (r, 5);
+    return n ? bit_read (r, n) : 0;
+}
+
+static uint32_t zigzag (int32_t v) {
+    return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static int32_t unzigzag (uint32_t v) {
+    return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+}
+
+/*--------------------------------QUANTIZATION--------------------------------*/
+#define ROTATION_BITS 10
+#define ROTATION_RANGE 0.70710678f // 1/sqrt2, the most a non-largest component can be
+
+uint32_t net_quantize_rotation (const versor& q) {
+    int largest = 0;
+    for (int i = 1; i < 4; i++) {
+        if (fabsf (q.q[i]) > fabsf (q.q[largest])) {
+            largest = i;
+        }
+    }
+    // q and -q are the same rotation, make the dropped component positive
+    float sign = q.q[largest] < 0.0f ? -1.0f : 1.0f;
+    const float steps = (float)((1 << ROTATION_BITS) - 1);
+    uint32_t bits = (uint32_t)largest;
+    int shift = 2;
+    for (int i = 0; i < 4; i++) {
+        if (i == largest) {
+            continue;
+        }
+        float v = q.q[i] * sign / ROTATION_RANGE;
+        v = v < -1.0f ? -1.0f : v > 1.0f ? 1.0f : v;
+        bits |= (uint32_t)lroundf ((v * 0.5f + 0.5f) * steps) << shift;
+        shift += ROTATION_BITS;
+    }
+    return bits;
+}
+
+versor net_dequantize_rotation (uint32_t bits) {
+    int largest = (int)(bits & 3);
+    const float steps = (float)((1 << ROTATION_BITS) - 1);
+    versor q (0.0f, 0.0f, 0.0f, 0.0f);
+    float sum = 0.0f;
+    int shift = 2;
+    for (int i = 0; i < 4; i++) {
+        if (i == largest) {
+            continue;
+        }
+        uint32_t u = (bits >> shift) & ((1u << ROTATION_BITS) - 1u);
+        q.q[i] = ((float)u / steps * 2.0f - 1.0f) * ROTATION_RANGE;
+        sum += q.q[i] * q.q[i];
+        shift += ROTATION_BITS;
+    }
+    q.q[largest] = sqrtf (sum < 1.0f ? 1.0f - sum : 0.0f);
+    return normalise (q);
+}
+
+NetPlayer net_quantize_player (const PlayerState& p, const versor& rotation) {
+    NetPlayer n;
+    for (int a = 0; a < 3; a++) {
+        n.pos[a] = (int32_t)lroundf (p.pos.v[a] * NET_POSITION_SCALE);
+        n.velocity[a] = (int32_t)(p.velocity.v[a] * NET_VELOCITY_SCALE);
+    }
+    n.rotation = net_quantize_rotation (rotation);
+    n.flags = (uint8_t)((p.pushing + 1) | (p.moving ? 4 : 0));
+    return n;
+}
+
+PlayerState net_dequantize_player (const NetPlayer& n) {
+    PlayerState p;
+    for (int a = 0; a < 3; a++) {
+        p.pos.v[a] = (float)n.pos[a] / NET_POSITION_SCALE;
+        p.velocity.v[a] = (float)n.velocity[a] / NET_VELOCITY_SCALE;
+    }
+    p.pushing = (int)(n.flags & 3) - 1;
+    p.moving = (n.flags & 4) != 0;
+    return p;
+}
+
+vec3 net_player_position (const NetPlayer& n) {
+    return vec3 ((float)n.pos[0] / NET_POSITION_SCALE, (float)n.pos[1] / NET_POSITION_SCALE,
+                 (float)n.pos[2] / NET_POSITION_SCALE);
+}
+
+void net_player_step (NetPlayer* n, const PlayerInput& input) {
+    PlayerState p = net_dequantize_player (*n);
+    PlayerInput snapped = input;
+    snapped.orientation = net_dequantize_rotation (net_quantize_rotation (input.orientation));
+    player_movement_step (&p, snapped);
+    *n = net_quantize_player (p, snapped.orientation);
+}
+
+bool net_player_equal (const NetPlayer& a, const NetPlayer& b) {
+    return memcmp (a.pos, b.pos, sizeof (a.pos)) == 0 && memcmp (a.velocity, b.velocity, sizeof (a.velocity)) == 0 &&
+           a.rotation == b.rotation && a.flags == b.flags;
+}
+
+/*----------------------------------SNAPSHOTS---------------------------------*/
+const NetPlayer* net_snapshot_find (const NetSnapshot& s, uint8_t id) {
+    // ids are few and ascending
+    size_t lo = 0, hi = s.ids.size ();
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (s.ids[mid] < id) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo < s.ids.size () && s.ids[lo] == id ? &s.players[lo] : NULL;
+}
+
+static NetPlayer zero_player () {
+    NetPlayer n;
+    memset (&n, 0, sizeof (n));
+    n.flags = 1; // pushing 0
+    return n;
+}
+
+static void write_vector (BitWriter* w, const int32_t* v, const int32_t* base) {
+    bool changed = v[0] != base[0] || v[1] != base[1] || v[2] != base[2];
+    bit_write (w, changed, 1);
+    if (changed) {
+        for (int a = 0; a < 3; a++) {
+            bit_write_varbits (w, zigzag (v[a] - base[a]));
+        }
+    }
+}
+
+static void read_vector (BitReader* r, int32_t* v, const int32_t* base) {
+    if (bit_read (r, 1)) {
+        for (int a = 0; a < 3; a++) {
+            v[a] = base[a] + unzigzag (bit_read_varbits (r));
+        }
+    } else {
+        memcpy (v, base, 3 * sizeof (int32_t));
+    }
+}
+
+void net_snapshot_encode (BitWriter* w, const NetSnapshot& s, const NetSnapshot* baseline) {
+    const NetPlayer zero = zero_player ();
+    bit_write (w, (uint32_t)s.ids.size (), 9);
+    int previous = -1;
+    for (size_t i = 0; i < s.ids.size (); i++) {
+        int gap = s.ids[i] - previous - 1;
+        previous = s.ids[i];
+        bit_write (w, gap == 0, 1);
+        if (gap) {
+            bit_write_varbits (w, (uint32_t)gap);
+        }
+        const NetPlayer* base = baseline ? net_snapshot_find (*baseline, s.ids[i]) : NULL;
+        base = base ? base : &zero;
+        const NetPlayer& n = s.players[i];
+        bool changed = !net_player_equal (n, *base);
+        bit_write (w, changed, 1);
+        if (!changed) {
+            continue;
+        }
+        write_vector (w, n.pos, base->pos);
+        write_vector (w, n.velocity, base->velocity);
+        bit_write (w, n.rotation != base->rotation, 1);
+        if (n.rotation != base->rotation) {
+            bit_write (w, n.rotation, 32);
+        }
+        bit_write (w, n.flags != base->flags, 1);
+        if (n.flags != base->flags) {
+            bit_write (w, n.flags, 3);
+        }
+    }
+}
+
+bool net_snapshot_decode (BitReader* r, NetSnapshot* s, const NetSnapshot* baseline) {
+    const NetPlayer zero = zero_player ();
+    uint32_t count = bit_read (r, 9);
+    if (count > 256) {
+        return false;
+    }
+    s->ids.resize (count);
+    s->players.resize (count);
+    int previous = -1;
+    for (uint32_t i = 0; i < count && !r->overrun; i++) {
+        int gap = bit_read (r, 1) ? 0 : (int)bit_read_varbits (r);
+        int id = previous + 1 + gap;
+        if (id > 255) {
+            return false;
+        }
+        previous = id;
+        s->ids[i] = (uint8_t)id;
+        const NetPlayer* base = baseline ? net_snapshot_find (*baseline, (uint8_t)id) : NULL;
+        base = base ? base : &zero;
+        NetPlayer& n = s->players[i];
+        if (!bit_read (r, 1)) {
+            n = *base;
+            continue;
+        }
+        read_vector (r, n.pos, base->pos);
+        read_vector (r, n.velocity, base->velocity);
+        n.rotation = bit_read (r, 1) ? bit_read (r, 32) : base->rotation;
+        n.flags = bit_read (r, 1) ? (uint8_t)bit_read (r, 3) : base->flags;
+    }
+    return !r->overrun;
+}
@@ -0,0 +1,97 @@
+//
+// Quantized player state and delta compressed snapshots.
+//
+// A NetPlayer is a PlayerState (camera/player_movement.h) on fixed grids:
+//  - position in 1/4096 units, rounded
+//  - velocity in 1/2^20 units a step, truncated towards zero so that the
+//    coasting decay always reaches the stop threshold
+//  - the look rotation as "smallest three": the largest component is
+//    dropped and rebuilt from the unit length, the other three take 10 bits
+//    each in [-1/sqrt2, 1/sqrt2], sign fixed by making the dropped one
+//    positive. 32 bits
+// The server snaps its players to these grids after every step and a client
+// predicts with net_player_step, which does the same, so the two get the
+// very same numbers from the same inputs.
+//
+// A snapshot is every player's NetPlayer at a server tick. It is written
+// against a baseline, an earlier snapshot the client has acknowledged, or
+// against nothing. Per player, in id order:
+//  - the gap from the previous id: 1 bit if none, else a varbits number
+//  - 1 bit if anything changed from the baseline's copy (or from zero if
+//    the baseline doesn't have the player), then for position, velocity,
+//    rotation and flags a changed bit each and, if set, the new value:
+//    zigzagged differences as varbits for the vectors, the 32 bit rotation,
+//    3 bits of flags
+// A varbits number is 5 bits of length and then that many bits, so it holds
+// values under 2^31: positions within 262144 units of each other, plenty for
+// a level. A player standing still costs 2 bits.
+//
+
+#ifndef FPS_STYLE_ROOM_SNAPSHOT_H
+#define FPS_STYLE_ROOM_SNAPSHOT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include <camera/player_movement.h>
+
+#define NET_POSITION_SCALE 4096.0f
+#define NET_VELOCITY_SCALE 1048576.0f
+
+struct NetPlayer {
+    int32_t pos[3];
+    int32_t velocity[3];
+    uint32_t rotation;           // smallest three
+    uint8_t flags;               // bits 0-1 pushing + 1, bit 2 moving
+};
+
+struct NetSnapshot {
+    uint32_t tick;
+    std::vector<uint8_t> ids;    // present players, ascending
+    std::vector<NetPlayer> players;
+};
+
+struct BitWriter {
+    std::vector<uint8_t> bytes;
+    uint64_t scratch;
+    int scratch_bits;
+};
+
+struct BitReader {
+    const uint8_t* bytes;
+    size_t size;
+    size_t next;                 // byte
+    uint64_t scratch;
+    int scratch_bits;
+    bool overrun;                // read past the end
+};
+
+void bit_writer_init (BitWriter* w);
+/* up to 32 bits */
+void bit_write (BitWriter* w, uint32_t value, int bits);
+/* value under 2^31 */
+void bit_write_varbits (BitWriter* w, uint32_t value);
+/* pads to a whole byte */
+void bit_writer_flush (BitWriter* w);
+void bit_reader_init (BitReader* r, const uint8_t* bytes, size_t size);
+uint32_t bit_read (BitReader* r, int bits);
+uint32_t bit_read_varbits (BitReader* r);
+
+uint32_t net_quantize_rotation (const versor& q);
+versor net_dequantize_rotation (uint32_t bits);
+NetPlayer net_quantize_player (const PlayerState& p, const versor& rotation);
+PlayerState net_dequantize_player (const NetPlayer& n);
+vec3 net_player_position (const NetPlayer& n);
+/* player_movement_step on the grids. the input's rotation is quantized */
+void net_player_step (NetPlayer* n, const PlayerInput& input);
+bool net_player_equal (const NetPlayer& a, const NetPlayer& b);
+
+/* the player's copy in s, or NULL */
+const NetPlayer* net_snapshot_find (const NetSnapshot& s, uint8_t id);
+/* appends s's players against baseline (NULL for none) to w */
+void net_snapshot_encode (BitWriter* w, const NetSnapshot& s, const NetSnapshot* baseline);
+/* reads what net_snapshot_encode wrote against the same baseline. false if
+the bits run out */
+bool net_snapshot_decode (BitReader* r, NetSnapshot* s, const NetSnapshot* baseline);
+
+#endif //FPS_STYLE_ROOM_SNAPSHOT_H
@@ -0,0 +1,122 @@
+//
+// See udp_socket.h.
+//
+
+#include "udp_socket.h"
+#include <memory/memory_tracker.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static sockaddr_in loopback (uint16_t port) {
+    sockaddr_in a;
+    memset (&a, 0, sizeof (a));
+    a.sin_family = AF_INET;
+    a.sin_port = htons (port);
+    a.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+    return a;
+}
+
+bool udp_open (UdpSocket* s, uint16_t port) {
+    s->fd = socket (AF_INET, SOCK_DGRAM, 0);
+    s->port = 0;
+    if (s->fd < 0) {
+        fprintf (stderr, "ERROR: could not create a UDP socket: %s\n", strerror (errno));
+        return false;
+    }
+    // a tick's worth of snapshots or inputs for a big server queues up here
+    int buffer = 4 << 20;
+    setsockopt (s->fd, SOL_SOCKET, SO_RCVBUF, &buffer, sizeof (buffer));
+    setsockopt (s->fd, SOL_SOCKET, SO_SNDBUF, &buffer, sizeof (buffer));
+    fcntl (s->fd, F_SETFL, fcntl (s->fd, F_GETFL, 0) | O_NONBLOCK);
+    sockaddr_in a = loopback (port);
+    socklen_t length = sizeof (a);
+    if (bind (s->fd, (sockaddr*)&a, sizeof (a)) != 0 || getsockname (s->fd, (sockaddr*)&a, &length) != 0) {
+        fprintf (stderr, "ERROR: could not bind UDP port %u: %s\n", port, strerror (errno));
+        close (s->fd);
+        s->fd = -1;
+        return false;
+    }
+    s->port = ntohs (a.sin_port);
+    return true;
+}
+
+void udp_close (UdpSocket* s) {
+    if (s->fd >= 0) {
+        close (s->fd);
+    }
+    s->fd = -1;
+    s->port = 0;
+}
+
+bool udp_send (const UdpSocket& s, uint16_t port, const void* data, size_t bytes) {
+    sockaddr_in a = loopback (port);
+    return sendto (s.fd, data, bytes, 0, (sockaddr*)&a, sizeof (a)) == (ssize_t)bytes;
+}
+
+size_t udp_recv (const UdpSocket& s, void* data, size_t capacity, uint16_t* from_port) {
+    sockaddr_in a;
+    socklen_t length = sizeof (a);
+    ssize_t got = recvfrom (s.fd, data, capacity, 0, (sockaddr*)&a, &length);
+    if (got <= 0) {
+        return 0;
+    }
+    if (from_port) {
+        *from_port = ntohs (a.sin_port);
+    }
+    return (size_t)got;
+}
+
+/*------------------------------------LINK------------------------------------*/
+static float link_rand (NetLink* link) {
+    link->rng = link->rng * 1664525u + 1013904223u;
+    return (float)(link->rng >> 8) / 16777216.0f;
+}
+
+void net_link_init (NetLink* link, const NetConditions& conditions, uint32_t seed) {
+    link->conditions = conditions;
+    link->rng = seed;
+    link->queue.clear ();
+    memset (&link->stats, 0, sizeof (link->stats));
+}
+
+void net_link_send (NetLink* link, uint16_t port, const void* data, size_t bytes, double now_ms) {
+    MemoryScope scope (MEMORY_NET);
+    if (link_rand (link) < link->conditions.loss) {
+        link->stats.dropped++;
+        return;
+    }
+    NetLinkPacket p;
+    p.due_ms = now_ms + link->conditions.latency_ms + link_rand (link) * link->conditions.jitter_ms;
+    p.port = port;
+    p.data.assign ((const uint8_t*)data, (const uint8_t*)data + bytes);
+    link->queue.push_back (std::move (p));
+}
+
+void net_link_pump (NetLink* link, const UdpSocket& s, double now_ms) {
+    MemoryScope scope (MEMORY_NET);
+    // jitter reorders, as it would on a real network
+    size_t kept = 0;
+    for (size_t i = 0; i < link->queue.size (); i++) {
+        NetLinkPacket& p = link->queue[i];
+        if (p.due_ms > now_ms) {
+            if (kept != i) {
+                link->queue[kept] = std::move (p);
+            }
+            kept++;
+            continue;
+        }
+        if (udp_send (s, p.port, p.data.data (), p.data.size ())) {
+            link->stats.sent++;
+            link->stats.bytes += p.data.size ();
+        } else {
+            link->stats.dropped++;
+        }
+    }
+    link->queue.resize (kept);
+}
@@ -0,0 +1,71 @@
+//
+// Non-blocking UDP on the loopback interface, with simulated network
+// conditions.
+//
+// Everything binds to 127.0.0.1 and addresses are just ports. Sends go
+// through a NetLink, which drops packets at the configured loss rate and
+// holds the rest back for latency_ms plus up to jitter_ms before they reach
+// the socket. net_link_pump hands over what is due. Times are the caller's
+// milliseconds, so a benchmark can run the whole network on a virtual clock
+// and get the same drops and delays every run.
+//
+// Datagrams can be up to NET_MAX_PACKET bytes. Loopback takes them whole;
+// over a real network anything past about 1200 bytes would be fragmented,
+// which the replication stats count.
+//
+
+#ifndef FPS_STYLE_ROOM_UDP_SOCKET_H
+#define FPS_STYLE_ROOM_UDP_SOCKET_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+#define NET_MAX_PACKET 65507
+#define NET_MTU 1200
+
+struct UdpSocket {
+    int fd;
+    uint16_t port;
+};
+
+struct NetConditions {
+    float loss;                  // 0 to 1
+    float latency_ms;            // one way
+    float jitter_ms;             // uniform on top of latency
+};
+
+struct NetLinkPacket {
+    double due_ms;
+    uint16_t port;
+    std::vector<uint8_t> data;
+};
+
+struct NetLinkStats {
+    unsigned int sent;
+    unsigned int dropped;
+    unsigned long long bytes;    // handed to the socket
+};
+
+struct NetLink {
+    NetConditions conditions;
+    uint32_t rng;
+    std::vector<NetLinkPacket> queue;
+    NetLinkStats stats;
+};
+
+/* binds 127.0.0.1:port, or any free port for 0. false on failure */
+bool udp_open (UdpSocket* s, uint16_t port);
+void udp_close (UdpSocket* s);
+/* false if the socket wouldn't take it */
+bool udp_send (const UdpSocket& s, uint16_t port, const void* data, size_t bytes);
+/* bytes received, 0 if nothing is waiting. from_port may be NULL */
+size_t udp_recv (const UdpSocket& s, void* data, size_t capacity, uint16_t* from_port);
+
+void net_link_init (NetLink* link, const NetConditions& conditions, uint32_t seed);
+/* drops the packet or queues it for later */
+void net_link_send (NetLink* link, uint16_t port, const void* data, size_t bytes, double now_ms);
+/* sends every queued packet due by now_ms */
+void net_link_pump (NetLink* link, const UdpSocket& s, double now_ms);
+
+#endif //FPS_STYLE_ROOM_UDP_SOCKET_H
@@ -0,0 +1,161 @@
+//
+// Shared buffer packing and command building. See draw_batch.h.
+//
+
+#include "draw_batch.h"
+#include <memory/memory_tracker.h>
+#include <jobs/job_system.h>
+#include <algorithm>
+#include <chrono>
+#include <string.h>
+
+// objects per build chunk. big enough that the prefix sum over chunks is
+// nothing, small enough to spread 10k objects over a few workers
+#define DRAW_BATCH_CHUNK 2048
+
+void draw_batch_init (DrawBatch* batch) {
+    batch->vertices.clear ();
+    batch->indices.clear ();
+    batch->meshes.clear ();
+    batch->rewritten.clear ();
+    batch->commands.clear ();
+    batch->draws.clear ();
+    memset (&batch->stats, 0, sizeof (batch->stats));
+}
+
+/* packs mesh at the end of the shared arrays into m */
+static void append_mesh (DrawBatch* batch, const Mesh& mesh, DrawBatchMesh* m) {
+    PackedVertices packed;
+    vertex_pack_mesh (mesh, &packed, NULL);
+    m->first_index = (unsigned int)batch->indices.size ();
+    m->index_count = m->index_capacity = (unsigned int)mesh.indices.size ();
+    m->base_vertex = (unsigned int)batch->vertices.size ();
+    m->vertex_count = m->vertex_capacity = (unsigned int)packed.vertices.size ();
+    m->quantization = packed.quantization;
+    m->bounds = mesh_bounds (mesh);
+    // indices stay mesh relative, base_vertex in the command offsets them
+    batch->vertices.insert (batch->vertices.end (), packed.vertices.begin (), packed.vertices.end ());
+    batch->indices.insert (batch->indices.end (), mesh.indices.begin (), mesh.indices.end ());
+}
+
+unsigned int draw_batch_add_mesh (DrawBatch* batch, const Mesh& mesh) {
+    MemoryScope scope (MEMORY_RENDER);
+    DrawBatchMesh m;
+    append_mesh (batch, mesh, &m);
+    const float albedo[4] = {0.5f, 0.0f, 0.5f, 1.0f};
+    memcpy (m.albedo, albedo, sizeof (m.albedo));
+    batch->meshes.push_back (m);
+    batch->stats.meshes = (unsigned int)batch->meshes.size ();
+    return batch->stats.meshes - 1;
+}
+
+void draw_batch_replace_mesh (DrawBatch* batch, unsigned int mesh, const Mesh& geometry) {
+    MemoryScope scope (MEMORY_RENDER);
+    DrawBatchMesh& m = batch->meshes[mesh];
+    PackedVertices packed;
+    vertex_pack_mesh (geometry, &packed, NULL);
+    if (packed.vertices.size () > m.vertex_capacity || geometry.indices.size () > m.index_capacity) {
+        batch->stats.unused_vertices += m.vertex_capacity;
+        append_mesh (batch, geometry, &m);
+        return;
+    }
+    m.index_count = (unsigned int)geometry.indices.size ();
+    m.vertex_count = (unsigned int)packed.vertices.size ();
+    m.quantization = packed.quantization;
+    m.bounds = mesh_bounds (geometry);
+    std::copy (packed.vertices.begin (), packed.vertices.end (), batch->vertices.begin () + m.base_vertex);
+    std::copy (geometry.indices.begin (), geometry.indices.end (), batch->indices.begin () + m.first_index);
+    if (std::find (batch->rewritten.begin (), batch->rewritten.end (), mesh) == batch->rewritten.end ()) {
+        batch->rewritten.push_back (mesh);
+    }
+}
+
+size_t draw_batch_pending_bytes (const DrawBatch& batch, size_t synced_vertices, size_t synced_indices) {
+    size_t bytes = (batch.vertices.size () - std::min (synced_vertices, batch.vertices.size ())) *
+                   sizeof (PackedVertex);
+    bytes += (batch.indices.size () - std::min (synced_indices, batch.indices.size ())) * sizeof (unsigned int);
+    for (size_t i = 0; i < batch.rewritten.size (); i++) {
+        const DrawBatchMesh& m = batch.meshes[batch.rewritten[i]];
+        // past the synced end it goes up with the tail anyway
+        if (m.base_vertex < synced_vertices) {
+            bytes += m.vertex_count * sizeof (PackedVertex);
+        }
+        if (m.first_index < synced_indices) {
+            bytes += m.index_count * sizeof (unsigned int);
+        }
+    }
+    return bytes;
+}
+
+int draw_batch_build (DrawBatch* batch, const unsigned int* mesh_of, const mat4* worlds,
+                      const unsigned char* visible, int count) {
+    MemoryScope scope (MEMORY_RENDER);
+    auto t0 = std::chrono::steady_clock::now ();
+    int chunks = (count + DRAW_BATCH_CHUNK - 1) / DRAW_BATCH_CHUNK;
+    std::vector<unsigned int>& start = batch->chunk_start;
+    start.assign (chunks + 1, 0);
+
+    // count what each chunk keeps, then a prefix sum gives where it writes
+    if (visible) {
+        parallel_for_each (chunks, 1, [&] (int begin, int end) {
+            for (int c = begin; c < end; c++) {
+                int last = std::min (count, (c + 1) * DRAW_BATCH_CHUNK);
+                unsigned int kept = 0;
+                for (int i = c * DRAW_BATCH_CHUNK; i < last; i++) {
+                    kept += visible[i] != 0;
+                }
+                start[c + 1] = kept;
+            }
+        });
+    } else {
+        for (int c = 0; c < chunks; c++) {
+            start[c + 1] = (unsigned int)(std::min (count, (c + 1) * DRAW_BATCH_CHUNK) - c * DRAW_BATCH_CHUNK);
+        }
+    }
+    for (int c = 0; c < chunks; c++) {
+        start[c + 1] += start[c];
+    }
+    unsigned int draws = start[chunks];
+    batch->commands.resize (draws);
+    batch->draws.resize (draws);
+
+    std::vector<unsigned int> chunk_triangles (chunks, 0);
+    parallel_for_each (chunks, 1, [&] (int begin, int end) {
+        for (int c = begin; c < end; c++) {
+            unsigned int out = start[c], triangles = 0;
+            int last = std::min (count, (c + 1) * DRAW_BATCH_CHUNK);
+            for (int i = c * DRAW_BATCH_CHUNK; i < last; i++) {
+                if (visible && !visible[i]) {
+                    continue;
+                }
+                const DrawBatchMesh& m = batch->meshes[mesh_of[i]];
+                DrawElementsIndirectCommand& cmd = batch->commands[out];
+                cmd.count = m.index_count;
+                cmd.instance_count = 1;
+                cmd.first_index = m.first_index;
+                cmd.base_vertex = (int)m.base_vertex;
+                cmd.base_instance = out;
+                DrawData& d = batch->draws[out];
+                memcpy (d.model, worlds[i].m, sizeof (d.model));
+                for (int a = 0; a < 3; a++) {
+                    d.position_offset[a] = m.quantization.offset.v[a];
+                    d.position_extent[a] = m.quantization.extent.v[a];
+                }
+                d.position_offset[3] = d.position_extent[3] = 0.0f;
+                memcpy (d.albedo, m.albedo, sizeof (d.albedo));
+                triangles += m.index_count / 3;
+                out++;
+            }
+            chunk_triangles[c] = triangles;
+        }
+    });
+
+    batch->stats.objects = (unsigned int)count;
+    batch->stats.draws = draws;
+    batch->stats.triangles = 0;
+    for (int c = 0; c < chunks; c++) {
+        batch->stats.triangles += chunk_triangles[c];
+    }
+    batch->stats.ms = std::chrono::duration<double, std::milli> (std::chrono::steady_clock::now () - t0).count ();
+    return (int)draws;
+}
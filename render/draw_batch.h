@@ -0,0 +1,102 @@
+//
+// Static mesh batching for multi-draw indirect.
+//
+// Every mesh added to a DrawBatch is packed (render/vertex_format.h) and
+// appended to one shared vertex array and one shared index array, so the
+// whole room binds a single pair of buffers. Each frame the visible objects
+// become an array of DrawElementsIndirectCommand, one per object, pointing
+// into the shared arrays. A parallel array of DrawData holds what each draw
+// needs in the shader: its model matrix and its mesh's position
+// quantization. The GL side (render/draw_batch_gl.h) uploads both arrays and
+// draws everything with one glMultiDrawElementsIndirect. The shader reads
+// DrawData from an SSBO at the command's base_instance, which here is just
+// the draw's index; render/multi_view.h points several views' commands at
+// one shared DrawData array through it.
+//
+// Building the commands is the only per object CPU work left. It runs on the
+// job system as a count, prefix sum and scatter, so the output order is the
+// input order whatever the worker count.
+//
+// Meshes can be replaced while the game runs (scene/live_scene.h). A mesh
+// that still fits the range it was packed into is rewritten there, one that
+// grew is appended and its old range left unused. The batch remembers what
+// it rewrote, so the GL side sends just those ranges and the appended tail
+// with glBufferSubData instead of uploading the arrays again.
+//
+
+#ifndef FPS_STYLE_ROOM_DRAW_BATCH_H
+#define FPS_STYLE_ROOM_DRAW_BATCH_H
+
+#include <vector>
+#include <geometry/mesh.h>
+#include <render/vertex_format.h>
+
+/* layout fixed by GL for GL_DRAW_INDIRECT_BUFFER */
+struct DrawElementsIndirectCommand {
+    unsigned int count;
+    unsigned int instance_count;
+    unsigned int first_index;
+    int base_vertex;
+    unsigned int base_instance;
+};
+
+/* per draw shader data, std430 layout */
+struct DrawData {
+    float model[16];
+    float position_offset[4];
+    float position_extent[4];
+    float albedo[4];
+};
+
+/* where a mesh lives in the shared arrays */
+struct DrawBatchMesh {
+    unsigned int first_index;
+    unsigned int index_count;
+    unsigned int base_vertex;
+    unsigned int vertex_count;
+    unsigned int index_capacity; // the range it owns, for replacing in place
+    unsigned int vertex_capacity;
+    VertexQuantization quantization;
+    Aabb bounds;
+    float albedo[4];             // rgb, a unused
+};
+
+struct DrawBatchStats {
+    unsigned int meshes;
+    unsigned int objects;        // offered to the last build
+    unsigned int draws;          // visible, one command each
+    unsigned int triangles;
+    unsigned int unused_vertices; // left behind by meshes that grew
+    double ms;                   // last build
+};
+
+struct DrawBatch {
+    std::vector<PackedVertex> vertices;
+    std::vector<unsigned int> indices;
+    std::vector<DrawBatchMesh> meshes;
+    // meshes rewritten in place since the GL side last synced
+    std::vector<unsigned int> rewritten;
+
+    // rebuilt each frame
+    std::vector<DrawElementsIndirectCommand> commands;
+    std::vector<DrawData> draws;
+    std::vector<unsigned int> chunk_start; // build scratch
+
+    DrawBatchStats stats;
+};
+
+void draw_batch_init (DrawBatch* batch);
+/* packs mesh into the shared arrays and returns its mesh number */
+unsigned int draw_batch_add_mesh (DrawBatch* batch, const Mesh& mesh);
+/* new geometry for mesh number mesh, in place if it fits, else appended */
+void draw_batch_replace_mesh (DrawBatch* batch, unsigned int mesh, const Mesh& geometry);
+/* bytes changed since the arrays were uploaded up to synced_vertices and
+synced_indices: the rewritten meshes and everything after */
+size_t draw_batch_pending_bytes (const DrawBatch& batch, size_t synced_vertices, size_t synced_indices);
+
+/* one command per object i with visible[i] set (visible may be NULL for all),
+drawing meshes[mesh_of[i]] with worlds[i]. returns the draw count */
+int draw_batch_build (DrawBatch* batch, const unsigned int* mesh_of, const mat4* worlds,
+                      const unsigned char* visible, int count);
+
+#endif //FPS_STYLE_ROOM_DRAW_BATCH_H
@@ -0,0 +1,257 @@
+//
+// See draw_batch_gl.h.
+//
+
+#include "draw_batch_gl.h"
+#include <render/vertex_format_gl.h>
+#include <render/view_ubo_gl.h>
+#include <render/light_clusters.h>
+#include <render/gl_utils.h>
+#include <render/gpu_memory_gl.h>
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+
+static const char* draw_id_multi =
+        "#version 430\n"
+        "#extension GL_ARB_shader_draw_parameters : require\n"
+        "#define DRAW_ID gl_BaseInstanceARB\n";
+static const char* draw_id_uniform =
+        "#version 430\n"
+        "uniform int draw_id;\n"
+        "#define DRAW_ID draw_id\n";
+
+// the lit pass reads the camera from the view UBO, the depth pass is given
+// each shadow view as uniforms
+static const char* camera_ubo =
+        VIEW_UBO_GLSL
+        "#define VIEW camera_view\n"
+        "#define PROJ camera_proj\n";
+static const char* camera_uniforms =
+        "uniform mat4 view, proj;\n"
+        "#define VIEW view\n"
+        "#define PROJ proj\n";
+
+static const char* vertex_body =
+        VERTEX_FORMAT_GLSL_INPUTS
+        "struct DrawData { mat4 model; vec4 position_offset; vec4 position_extent; vec4 albedo; };\n"
+        "layout (std430, binding = 0) readonly buffer Draws { DrawData draws[]; };\n"
+        "out vec3 view_position;\n"
+        "out vec3 view_normal;\n"
+        "flat out vec3 albedo;\n"
+        "void main () {\n"
+        "    DrawData d = draws[DRAW_ID];\n"
+        "    vec3 p = d.position_offset.xyz + packed_position.xyz * d.position_extent.xyz;\n"
+        "    mat4 model_view = VIEW * d.model;\n"
+        "    vec4 vp = model_view * vec4 (p, 1.0);\n"
+        "    view_position = vp.xyz;\n"
+        "    view_normal = mat3 (model_view) * decode_normal ();\n"
+        "    albedo = d.albedo.rgb;\n"
+        "    gl_Position = PROJ * vp;\n"
+        "}\n";
+
+static const char* fragment_shader =
+        "#version 430\n"
+        LIGHT_CLUSTERS_GLSL
+        "in vec3 view_position;\n"
+        "in vec3 view_normal;\n"
+        "flat in vec3 albedo;\n"
+        "out vec4 fragment_colour;\n"
+        "void main () {\n"
+        "    vec3 n = normalize (gl_FrontFacing ? view_normal : -view_normal);\n"
+        "    fragment_colour = vec4 (cluster_lighting (view_position, n, albedo), 1.0);\n"
+        "}\n";
+
+static const char* depth_fragment_shader =
+        "#version 430\n"
+        "void main () {}\n";
+
+bool draw_batch_gl_init (DrawBatchGl* gl, const DrawBatch& batch) {
+    memset (gl, 0, sizeof (*gl));
+    if (!GLEW_VERSION_4_3) {
+        fprintf (stderr, "ERROR: draw batching needs GL 4.3\n");
+        return false;
+    }
+    gl->multi_draw = GLEW_ARB_shader_draw_parameters != 0;
+
+    glGenVertexArrays (1, &gl->vao);
+    glBindVertexArray (gl->vao);
+    glGenBuffers (1, &gl->vbo);
+    glBindBuffer (GL_ARRAY_BUFFER, gl->vbo);
+    gpu_memory_buffer_data (GL_ARRAY_BUFFER, gl->vbo, batch.vertices.size () * sizeof (PackedVertex),
+                            batch.vertices.empty () ? NULL : &batch.vertices[0], GL_STATIC_DRAW, MEMORY_RENDER);
+    vertex_format_bind_attributes (gl->vbo);
+    glGenBuffers (1, &gl->ibo);
+    glBindBuffer (GL_ELEMENT_ARRAY_BUFFER, gl->ibo);
+    gpu_memory_buffer_data (GL_ELEMENT_ARRAY_BUFFER, gl->ibo, batch.indices.size () * sizeof (unsigned int),
+                            batch.indices.empty () ? NULL : &batch.indices[0], GL_STATIC_DRAW, MEMORY_RENDER);
+    glBindVertexArray (0);
+    gl->vertex_count = gl->vertex_capacity = batch.vertices.size ();
+    gl->index_count = gl->index_capacity = batch.indices.size ();
+    glGenBuffers (1, &gl->indirect);
+    glGenBuffers (1, &gl->ssbo);
+
+    const char* vs_sources[3] = {gl->multi_draw ? draw_id_multi : draw_id_uniform, camera_ubo, vertex_body};
+    GLuint vs = gl_compile_shader (GL_VERTEX_SHADER, vs_sources, 3);
+    GLuint fs = gl_compile_shader (GL_FRAGMENT_SHADER, &fragment_shader, 1);
+    gl->program = gl_link_program (vs, fs);
+    if (!gl->program) {
+        draw_batch_gl_destroy (gl);
+        return false;
+    }
+    gl->draw_id_location = glGetUniformLocation (gl->program, "draw_id");
+
+    vs_sources[1] = camera_uniforms;
+    vs = gl_compile_shader (GL_VERTEX_SHADER, vs_sources, 3);
+    fs = gl_compile_shader (GL_FRAGMENT_SHADER, &depth_fragment_shader, 1);
+    gl->depth_program = gl_link_program (vs, fs);
+    if (!gl->depth_program) {
+        draw_batch_gl_destroy (gl);
+        return false;
+    }
+    gl->depth_view_location = glGetUniformLocation (gl->depth_program, "view");
+    gl->depth_proj_location = glGetUniformLocation (gl->depth_program, "proj");
+    gl->depth_draw_id_location = glGetUniformLocation (gl->depth_program, "draw_id");
+    return true;
+}
+
+/* makes buffer hold at least needed elements, copying the first kept over
+on the GPU. true if it is a new buffer */
+static bool grow_buffer (GLuint* buffer, size_t* capacity, size_t needed, size_t kept, size_t stride) {
+    if (needed <= *capacity) {
+        return false;
+    }
+    size_t grown = std::max (needed, *capacity * 2);
+    GLuint b;
+    glGenBuffers (1, &b);
+    glBindBuffer (GL_COPY_WRITE_BUFFER, b);
+    gpu_memory_buffer_data (GL_COPY_WRITE_BUFFER, b, grown * stride, NULL, GL_STATIC_DRAW, MEMORY_RENDER);
+    if (kept) {
+        glBindBuffer (GL_COPY_READ_BUFFER, *buffer);
+        glCopyBufferSubData (GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, kept * stride);
+    }
+    gpu_memory_delete (GL_BUFFER, 1, buffer);
+    *buffer = b;
+    *capacity = grown;
+    return true;
+}
+
+/* the copy write binding, so no VAO's element buffer changes underneath */
+static size_t sub_upload (GLuint buffer, size_t first, size_t count, size_t stride, const void* data) {
+    if (count == 0) {
+        return 0;
+    }
+    glBindBuffer (GL_COPY_WRITE_BUFFER, buffer);
+    glBufferSubData (GL_COPY_WRITE_BUFFER, first * stride, count * stride, (const char*)data + first * stride);
+    return count * stride;
+}
+
+size_t draw_batch_gl_sync (DrawBatchGl* gl, DrawBatch* batch) {
+    size_t vertices = batch->vertices.size (), indices = batch->indices.size ();
+    bool moved = grow_buffer (&gl->vbo, &gl->vertex_capacity, vertices, gl->vertex_count, sizeof (PackedVertex));
+    moved |= grow_buffer (&gl->ibo, &gl->index_capacity, indices, gl->index_count, sizeof (unsigned int));
+    if (moved) {
+        glBindVertexArray (gl->vao);
+        vertex_format_bind_attributes (gl->vbo);
+        glBindBuffer (GL_ELEMENT_ARRAY_BUFFER, gl->ibo);
+        glBindVertexArray (0);
+    }
+    const PackedVertex* vertex_data = batch->vertices.data ();
+    const unsigned int* index_data = batch->indices.data ();
+    size_t bytes = sub_upload (gl->vbo, gl->vertex_count, vertices - gl->vertex_count, sizeof (PackedVertex),
+                               vertex_data);
+    bytes += sub_upload (gl->ibo, gl->index_count, indices - gl->index_count, sizeof (unsigned int), index_data);
+    for (size_t i = 0; i < batch->rewritten.size (); i++) {
+        const DrawBatchMesh& m = batch->meshes[batch->rewritten[i]];
+        // past the old end it went up with the tail
+        if (m.base_vertex < gl->vertex_count) {
+            bytes += sub_upload (gl->vbo, m.base_vertex, m.vertex_count, sizeof (PackedVertex), vertex_data);
+        }
+        if (m.first_index < gl->index_count) {
+            bytes += sub_upload (gl->ibo, m.first_index, m.index_count, sizeof (unsigned int), index_data);
+        }
+    }
+    batch->rewritten.clear ();
+    gl->vertex_count = vertices;
+    gl->index_count = indices;
+    return bytes;
+}
+
+void draw_batch_gl_upload_arrays (DrawBatchGl* gl, const DrawData* draws, size_t draw_count,
+                                  const DrawElementsIndirectCommand* commands, size_t command_count) {
+    if (draw_count == 0 || command_count == 0) {
+        return;
+    }
+    gl_stream_upload (GL_SHADER_STORAGE_BUFFER, gl->ssbo, &gl->ssbo_capacity, draws, draw_count * sizeof (DrawData),
+                      MEMORY_RENDER);
+    if (gl->multi_draw) {
+        gl_stream_upload (GL_DRAW_INDIRECT_BUFFER, gl->indirect, &gl->indirect_capacity, commands,
+                          command_count * sizeof (DrawElementsIndirectCommand), MEMORY_RENDER);
+    }
+}
+
+void draw_batch_gl_upload (DrawBatchGl* gl, const DrawBatch& batch) {
+    if (batch.commands.empty ()) {
+        return;
+    }
+    draw_batch_gl_upload_arrays (gl, &batch.draws[0], batch.draws.size (), &batch.commands[0],
+                                 batch.commands.size ());
+}
+
+static void draw_with (DrawBatchGl* gl, const DrawElementsIndirectCommand* commands, size_t first, size_t count,
+                       GLuint program, GLint draw_id_location) {
+    if (count == 0) {
+        return;
+    }
+    glBindBufferBase (GL_SHADER_STORAGE_BUFFER, 0, gl->ssbo);
+    glUseProgram (program);
+    glBindVertexArray (gl->vao);
+    if (gl->multi_draw) {
+        glBindBuffer (GL_DRAW_INDIRECT_BUFFER, gl->indirect);
+        glMultiDrawElementsIndirect (GL_TRIANGLES, GL_UNSIGNED_INT,
+                                     (const void*)(first * sizeof (DrawElementsIndirectCommand)), (GLsizei)count, 0);
+    } else {
+        for (size_t i = first; i < first + count; i++) {
+            const DrawElementsIndirectCommand& cmd = commands[i];
+            glUniform1i (draw_id_location, (GLint)cmd.base_instance);
+            glDrawElementsBaseVertex (GL_TRIANGLES, cmd.count, GL_UNSIGNED_INT,
+                                      (const void*)(cmd.first_index * sizeof (unsigned int)), cmd.base_vertex);
+        }
+    }
+    glBindVertexArray (0);
+}
+
+void draw_batch_gl_draw (DrawBatchGl* gl, const DrawBatch& batch) {
+    if (batch.commands.empty ()) {
+        return;
+    }
+    draw_with (gl, &batch.commands[0], 0, batch.commands.size (), gl->program, gl->draw_id_location);
+}
+
+void draw_batch_gl_draw_range (DrawBatchGl* gl, const DrawElementsIndirectCommand* commands, size_t first,
+                               size_t count) {
+    draw_with (gl, commands, first, count, gl->program, gl->draw_id_location);
+}
+
+void draw_batch_gl_draw_depth (DrawBatchGl* gl, const DrawBatch& batch, const mat4& view, const mat4& proj) {
+    glUseProgram (gl->depth_program);
+    glUniformMatrix4fv (gl->depth_view_location, 1, GL_FALSE, view.m);
+    glUniformMatrix4fv (gl->depth_proj_location, 1, GL_FALSE, proj.m);
+    if (batch.commands.empty ()) {
+        return;
+    }
+    draw_with (gl, &batch.commands[0], 0, batch.commands.size (), gl->depth_program, gl->depth_draw_id_location);
+}
+
+void draw_batch_gl_destroy (DrawBatchGl* gl) {
+    GLuint buffers[4] = {gl->vbo, gl->ibo, gl->indirect, gl->ssbo};
+    gpu_memory_delete (GL_BUFFER, 4, buffers);
+    glDeleteVertexArrays (1, &gl->vao);
+    if (gl->program) {
+        glDeleteProgram (gl->program);
+    }
+    if (gl->depth_program) {
+        glDeleteProgram (gl->depth_program);
+    }
+    memset (gl, 0, sizeof (*gl));
+}
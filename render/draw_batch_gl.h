@@ -0,0 +1,81 @@
+//
+// GL side of DrawBatch: the merged buffers, the per frame command and draw
+// data uploads, and the draw itself.
+//
+// With GL 4.3 and ARB_shader_draw_parameters the whole batch is one
+// glMultiDrawElementsIndirect, and the shader indexes the DrawData SSBO with
+// gl_BaseInstanceARB, the command's base_instance. Without the extension,
+// the same shader reads the index from a uniform and the commands are walked
+// one glDrawElementsBaseVertex at a time. That path is slower, but it draws
+// the same thing.
+//
+// Meshes replaced after init (draw_batch_replace_mesh) reach the GPU through
+// draw_batch_gl_sync, which sends only the changed ranges. The buffers grow
+// by copying on the GPU when appended meshes no longer fit.
+//
+// draw_batch_gl_upload_arrays and draw_batch_gl_draw_range take the arrays
+// directly, for command lists built elsewhere: render/multi_view.h uploads
+// every view's commands at once and draws each view's slice.
+//
+// Fragments are lit with clustered forward shading (render/light_clusters.h),
+// so the cluster buffers must be uploaded and the cluster uniforms set on
+// program before the first draw.
+//
+// The lit program reads the camera from the view UBO (render/view_ubo_gl.h),
+// so it can be written as late as just before the draw. depth_program is the
+// same vertex shader with no colour output and the camera in uniforms, for
+// rendering the batch into shadow maps.
+//
+
+#ifndef FPS_STYLE_ROOM_DRAW_BATCH_GL_H
+#define FPS_STYLE_ROOM_DRAW_BATCH_GL_H
+
+#include <GL/glew.h>
+#include <render/draw_batch.h>
+
+struct DrawBatchGl {
+    GLuint vao;
+    GLuint vbo;
+    GLuint ibo;
+    size_t vertex_count;         // uploaded so far
+    size_t index_count;
+    size_t vertex_capacity;      // room in vbo and ibo
+    size_t index_capacity;
+    GLuint indirect;             // GL_DRAW_INDIRECT_BUFFER of commands
+    GLuint ssbo;                 // DrawData, binding 0
+    size_t indirect_capacity;    // bytes
+    size_t ssbo_capacity;
+    GLuint program;
+    GLint draw_id_location;      // only without multi draw
+    GLuint depth_program;
+    GLint depth_view_location;
+    GLint depth_proj_location;
+    GLint depth_draw_id_location;
+    bool multi_draw;
+};
+
+/* uploads the shared vertex and index arrays and builds the program. false
+if the context has no SSBOs (GL 4.3) */
+bool draw_batch_gl_init (DrawBatchGl* gl, const DrawBatch& batch);
+/* uploads what changed in batch's shared arrays since init or the last
+sync. returns the bytes sent */
+size_t draw_batch_gl_sync (DrawBatchGl* gl, DrawBatch* batch);
+/* uploads the commands and draw data from the last draw_batch_build. once
+per build, however many times it is drawn */
+void draw_batch_gl_upload (DrawBatchGl* gl, const DrawBatch& batch);
+/* uploads draw_count DrawData and command_count commands, whose
+base_instance indexes draws */
+void draw_batch_gl_upload_arrays (DrawBatchGl* gl, const DrawData* draws, size_t draw_count,
+                                  const DrawElementsIndirectCommand* commands, size_t command_count);
+/* draws the uploaded batch, lit, with the camera in the view UBO
+(render/view_ubo_gl.h) */
+void draw_batch_gl_draw (DrawBatchGl* gl, const DrawBatch& batch);
+/* draws uploaded commands first to first + count - 1, lit. commands is the
+CPU copy of what was uploaded, read without multi draw */
+void draw_batch_gl_draw_range (DrawBatchGl* gl, const DrawElementsIndirectCommand* commands, size_t first,
+                               size_t count);
+/* draws the uploaded batch into the bound depth buffer only */
+void draw_batch_gl_draw_depth (DrawBatchGl* gl, const DrawBatch& batch, const mat4& view, const mat4& proj);
+void draw_batch_gl_destroy (DrawBatchGl* gl);
+
+#endif //FPS_STYLE_ROOM_DRAW_BATCH_GL_H
@@ -0,0 +1,93 @@
+//
+// See dynamic_resolution.h.
+//
+
+#include "dynamic_resolution.h"
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+
+DynamicResolutionParams dynamic_resolution_default_params (int refresh_hz) {
+    DynamicResolutionParams p;
+    p.target_ms = 1000.0f / (float)(refresh_hz > 0 ? refresh_hz : 60);
+    p.headroom = 0.9f;
+    p.min_scale = 0.5f;
+    p.max_scale = 1.0f;
+    p.gain = 0.25f;
+    p.max_step_down = 0.25f;
+    p.max_step_up = 0.05f;
+    p.deadband = 0.02f;
+    p.settle_frames = 8;
+    p.align = 8;
+    return p;
+}
+
+static void render_size (DynamicResolution* d) {
+    int align = std::max (1, d->params.align);
+    int w = (int)(d->width * d->scale + 0.5f);
+    int h = (int)(d->height * d->scale + 0.5f);
+    w = std::min (d->width, std::max (align, (w + align / 2) / align * align));
+    h = std::min (d->height, std::max (align, (h + align / 2) / align * align));
+    if (w != d->render_width || h != d->render_height) {
+        d->stats.changes++;
+    }
+    d->render_width = w;
+    d->render_height = h;
+    d->drawn[d->stats.frames % DYNAMIC_RESOLUTION_HISTORY] =
+            (float)w * (float)h / ((float)d->width * (float)d->height);
+}
+
+void dynamic_resolution_init (DynamicResolution* d, const DynamicResolutionParams& params, int width, int height) {
+    memset (d, 0, sizeof (*d));
+    d->params = params;
+    d->scale = params.max_scale;
+    d->full_ms = -1.0f;
+    d->width = width;
+    d->height = height;
+    render_size (d);
+    d->stats.changes = 0;
+    d->stats.scale = d->scale;
+}
+
+void dynamic_resolution_update (DynamicResolution* d, float gpu_ms, int gpu_lag, float cpu_ms) {
+    const DynamicResolutionParams& p = d->params;
+    float goal = p.target_ms * p.headroom;
+    d->stats.frames++;
+    d->stats.gpu_ms = gpu_ms;
+    d->stats.cpu_ms = cpu_ms;
+    d->stats.cpu_bound = false;
+    if (gpu_ms <= 0.0f || gpu_lag < 1 || gpu_lag >= DYNAMIC_RESOLUTION_HISTORY || gpu_lag > (int)d->stats.frames) {
+        render_size (d);
+        return;
+    }
+    float full = gpu_ms / d->drawn[(d->stats.frames - gpu_lag) % DYNAMIC_RESOLUTION_HISTORY];
+    d->full_ms = d->full_ms < 0.0f || full > d->full_ms ? full : d->full_ms * 0.8f + full * 0.2f;
+
+    if (cpu_ms > goal && cpu_ms > gpu_ms) {
+        // fewer pixels won't make this frame any faster
+        d->stats.cpu_bound = true;
+        d->under = 0;
+    } else {
+        float ideal = sqrtf (goal / d->full_ms);
+        if (d->full_ms * d->scale * d->scale > goal) {
+            d->under = 0;
+            d->scale = std::max (ideal, d->scale - p.max_step_down);
+        } else if (ideal <= d->scale + p.deadband) {
+            d->under = 0;
+        } else if (++d->under >= p.settle_frames) {
+            d->scale = std::min (d->scale + (ideal - d->scale) * p.gain, d->scale + p.max_step_up);
+        }
+    }
+    d->scale = std::min (p.max_scale, std::max (p.min_scale, d->scale));
+    d->stats.scale = d->scale;
+    render_size (d);
+}
+
+void dynamic_resolution_log_header (FILE* f) {
+    fprintf (f, "frame,cpu_ms,gpu_ms,scale,width,height,cpu_bound\n");
+}
+
+void dynamic_resolution_log_frame (FILE* f, const DynamicResolution& d) {
+    fprintf (f, "%u,%.3f,%.3f,%.4f,%d,%d,%d\n", d.stats.frames, d.stats.cpu_ms, d.stats.gpu_ms, d.scale,
+             d.render_width, d.render_height, d.stats.cpu_bound ? 1 : 0);
+}
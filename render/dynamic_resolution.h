@@ -0,0 +1,78 @@
+//
+// Dynamic resolution: picks the render scale each frame from frame timings.
+//
+// The scene is drawn into an offscreen target at scale x the output size on
+// each axis and upscaled to the backbuffer (render/dynamic_resolution_gl.h).
+// GPU time is taken to grow with the pixel count: a frame that took gpu_ms at
+// scale s costs about gpu_ms / s^2 at full size, and would take goal_ms at
+// sqrt (goal_ms / full). GPU timings arrive a few frames late, so the caller
+// says how late, and the full size cost is worked out from the scale that
+// frame was really drawn at. Otherwise every stale over budget reading would
+// cut the scale again. The controller moves towards the ideal scale:
+//  - down at once, by up to max_step_down, when the GPU is over the goal
+//  - up slowly, gain of the way and by up to max_step_up, after settle_frames
+//    in a row with more than deadband to spare, so noise in the timings
+//    doesn't make the size flicker
+// The goal is target_ms * headroom, leaving room for the frames the estimate
+// gets wrong.
+//
+// Scaling only helps GPU bound frames. When the CPU's frame time is the
+// larger of the two and over the goal, the frame is CPU bound: the scale is
+// held where it is and stats.cpu_bound says so.
+//
+// Timings are whatever the caller measured, GPU ones usually come from a
+// timer query a couple of frames old. Nothing here touches GL.
+//
+
+#ifndef FPS_STYLE_ROOM_DYNAMIC_RESOLUTION_H
+#define FPS_STYLE_ROOM_DYNAMIC_RESOLUTION_H
+
+#include <stdio.h>
+
+#define DYNAMIC_RESOLUTION_HISTORY 8
+
+struct DynamicResolutionParams {
+    float target_ms;             // the refresh interval
+    float headroom;              // aim for target_ms * headroom
+    float min_scale, max_scale;  // per axis
+    float gain;                  // fraction of the way up per frame
+    float max_step_down;
+    float max_step_up;
+    float deadband;              // ideal must be this far above to grow
+    int settle_frames;           // under the goal before growing
+    int align;                   // render sizes are multiples of this
+};
+
+struct DynamicResolutionStats {
+    unsigned int frames;
+    unsigned int changes;        // frames the render size changed
+    float cpu_ms, gpu_ms;        // the last timings given
+    float scale;
+    bool cpu_bound;
+};
+
+struct DynamicResolution {
+    DynamicResolutionParams params;
+    float scale;
+    float full_ms;               // GPU time at scale 1, filtered: rises at
+                                 // once, falls slowly
+    float drawn[DYNAMIC_RESOLUTION_HISTORY]; // render area fraction of recent frames
+    int under;                   // frames in a row under the goal
+    int width, height;           // output size
+    int render_width, render_height;
+    DynamicResolutionStats stats;
+};
+
+/* for a refresh_hz display: 90% of the interval, scale 0.5 to 1 */
+DynamicResolutionParams dynamic_resolution_default_params (int refresh_hz);
+void dynamic_resolution_init (DynamicResolution* d, const DynamicResolutionParams& params, int width, int height);
+/* folds in the latest timings and picks this frame's render size. gpu_ms is
+for the frame gpu_lag updates ago (1 is the last one), cpu_ms for the last
+frame. gpu_ms < 0 means no GPU timing, and the scale stays put */
+void dynamic_resolution_update (DynamicResolution* d, float gpu_ms, int gpu_lag, float cpu_ms);
+
+/* one CSV line per frame: frame, cpu_ms, gpu_ms, scale, render size */
+void dynamic_resolution_log_header (FILE* f);
+void dynamic_resolution_log_frame (FILE* f, const DynamicResolution& d);
+
+#endif //FPS_STYLE_ROOM_DYNAMIC_RESOLUTION_H
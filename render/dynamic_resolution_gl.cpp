@@ -0,0 +1,161 @@
+//
+// See dynamic_resolution_gl.h.
+//
+
+#include "dynamic_resolution_gl.h"
+#include <render/gpu_memory_gl.h>
+#include <render/gl_utils.h>
+#include <stdio.h>
+#include <string.h>
+
+static const char* upscale_vs =
+        "#version 410\n"
+        "void main () {\n"
+        "    vec2 p = vec2 ((gl_VertexID << 1) & 2, gl_VertexID & 2);\n"
+        "    gl_Position = vec4 (p * 2.0 - 1.0, 0.0, 1.0);\n"
+        "}\n";
+
+static const char* upscale_fs =
+        "#version 410\n"
+        "uniform sampler2D source;\n"
+        "uniform vec2 source_size;\n"  // the rendered corner, in pixels
+        "uniform vec2 texture_size;\n"
+        "uniform vec2 output_size;\n"
+        "uniform float sharpness;\n"
+        "out vec4 fragment_colour;\n"
+        "vec3 fetch (vec2 p) {\n"
+        "    return texture (source, clamp (p, vec2 (0.5), source_size - 0.5) / texture_size).rgb;\n"
+        "}\n"
+        "void main () {\n"
+        "    vec2 p = gl_FragCoord.xy * source_size / output_size;\n"
+        "    vec3 c = fetch (p);\n"
+        "    vec3 n = fetch (p + vec2 (0.0, 1.0));\n"
+        "    vec3 s = fetch (p - vec2 (0.0, 1.0));\n"
+        "    vec3 e = fetch (p + vec2 (1.0, 0.0));\n"
+        "    vec3 w = fetch (p - vec2 (1.0, 0.0));\n"
+        "    vec3 lo = min (c, min (min (n, s), min (e, w)));\n"
+        "    vec3 hi = max (c, max (max (n, s), max (e, w)));\n"
+        "    vec3 sharp = c + sharpness * (4.0 * c - n - s - e - w) * 0.25;\n"
+        "    fragment_colour = vec4 (clamp (sharp, lo, hi), 1.0);\n"
+        "}\n";
+
+bool dynamic_resolution_gl_init (DynamicResolutionGl* gl, int width, int height) {
+    memset (gl, 0, sizeof (*gl));
+    gl->width = width;
+    gl->height = height;
+    gl->sharpness = 0.5f;
+
+    glGenTextures (1, &gl->colour);
+    glBindTexture (GL_TEXTURE_2D, gl->colour);
+    glTexStorage2D (GL_TEXTURE_2D, 1, GL_RGBA8, width, height);
+    gpu_memory_image (GL_TEXTURE, gl->colour, (size_t)width * height * 4, MEMORY_RENDER);
+    glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture (GL_TEXTURE_2D, 0);
+    glGenRenderbuffers (1, &gl->depth);
+    glBindRenderbuffer (GL_RENDERBUFFER, gl->depth);
+    glRenderbufferStorage (GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+    gpu_memory_image (GL_RENDERBUFFER, gl->depth, (size_t)width * height * 4, MEMORY_RENDER);
+    glBindRenderbuffer (GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers (1, &gl->fbo);
+    glBindFramebuffer (GL_FRAMEBUFFER, gl->fbo);
+    glFramebufferTexture2D (GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, gl->colour, 0);
+    glFramebufferRenderbuffer (GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, gl->depth);
+    bool complete = glCheckFramebufferStatus (GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    glBindFramebuffer (GL_FRAMEBUFFER, 0);
+    if (!complete) {
+        fprintf (stderr, "ERROR: dynamic resolution framebuffer is incomplete\n");
+        dynamic_resolution_gl_destroy (gl);
+        return false;
+    }
+
+    GLuint vs = gl_compile_shader (GL_VERTEX_SHADER, &upscale_vs, 1);
+    GLuint fs = gl_compile_shader (GL_FRAGMENT_SHADER, &upscale_fs, 1);
+    gl->program = gl_link_program (vs, fs);
+    if (!gl->program) {
+        dynamic_resolution_gl_destroy (gl);
+        return false;
+    }
+    glProgramUniform1i (gl->program, glGetUniformLocation (gl->program, "source"), 0);
+    gl->source_size_location = glGetUniformLocation (gl->program, "source_size");
+    gl->texture_size_location = glGetUniformLocation (gl->program, "texture_size");
+    gl->output_size_location = glGetUniformLocation (gl->program, "output_size");
+    gl->sharpness_location = glGetUniformLocation (gl->program, "sharpness");
+    glGenVertexArrays (1, &gl->vao);
+    glGenQueries (DYNAMIC_RESOLUTION_GL_QUERIES, gl->queries);
+    return true;
+}
+
+void dynamic_resolution_gl_begin_frame (DynamicResolutionGl* gl) {
+    if (gl->issued - gl->read == DYNAMIC_RESOLUTION_GL_QUERIES) {
+        // the GPU is a whole ring behind. drop the oldest result rather
+        // than wait for it
+        gl->read++;
+    }
+    glBeginQuery (GL_TIME_ELAPSED, gl->queries[gl->issued % DYNAMIC_RESOLUTION_GL_QUERIES]);
+}
+
+void dynamic_resolution_gl_bind (DynamicResolutionGl* gl, int render_width, int render_height) {
+    glBindFramebuffer (GL_FRAMEBUFFER, gl->fbo);
+    glViewport (0, 0, render_width, render_height);
+}
+
+void dynamic_resolution_gl_present (DynamicResolutionGl* gl, int render_width, int render_height) {
+    glBindFramebuffer (GL_FRAMEBUFFER, 0);
+    glViewport (0, 0, gl->width, gl->height);
+    GLboolean depth_test = glIsEnabled (GL_DEPTH_TEST);
+    glDisable (GL_DEPTH_TEST);
+
+    // no sharpening at 1:1, full strength from 2:1
+    float stretch = (float)gl->width / (float)render_width - 1.0f;
+    stretch = stretch < 0.0f ? 0.0f : stretch > 1.0f ? 1.0f : stretch;
+    glUseProgram (gl->program);
+    glUniform2f (gl->source_size_location, (float)render_width, (float)render_height);
+    glUniform2f (gl->texture_size_location, (float)gl->width, (float)gl->height);
+    glUniform2f (gl->output_size_location, (float)gl->width, (float)gl->height);
+    glUniform1f (gl->sharpness_location, gl->sharpness * stretch);
+    glActiveTexture (GL_TEXTURE0);
+    glBindTexture (GL_TEXTURE_2D, gl->colour);
+    glBindVertexArray (gl->vao);
+    glDrawArrays (GL_TRIANGLES, 0, 3);
+    glBindVertexArray (0);
+
+    if (depth_test) {
+        glEnable (GL_DEPTH_TEST);
+    }
+    glEndQuery (GL_TIME_ELAPSED);
+    gl->issued++;
+}
+
+float dynamic_resolution_gl_gpu_ms (DynamicResolutionGl* gl, int* lag) {
+    float ms = -1.0f;
+    while (gl->read < gl->issued) {
+        GLuint query = gl->queries[gl->read % DYNAMIC_RESOLUTION_GL_QUERIES];
+        GLint available = 0;
+        glGetQueryObjectiv (query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) {
+            break;
+        }
+        GLuint64 ns = 0;
+        glGetQueryObjectui64v (query, GL_QUERY_RESULT, &ns);
+        ms = (float)(ns * 1e-6);
+        *lag = (int)(gl->issued - gl->read);
+        gl->read++;
+    }
+    return ms;
+}
+
+void dynamic_resolution_gl_destroy (DynamicResolutionGl* gl) {
+    if (gl->queries[0]) {
+        glDeleteQueries (DYNAMIC_RESOLUTION_GL_QUERIES, gl->queries);
+    }
+    glDeleteVertexArrays (1, &gl->vao);
+    glDeleteProgram (gl->program);
+    glDeleteFramebuffers (1, &gl->fbo);
+    gpu_memory_delete (GL_RENDERBUFFER, 1, &gl->depth);
+    gpu_memory_delete (GL_TEXTURE, 1, &gl->colour);
+    memset (gl, 0, sizeof (*gl));
+}
@@ -0,0 +1,56 @@
+//
+// GL side of dynamic resolution: the offscreen target, the GPU frame timer
+// and the sharpening upscale to the backbuffer.
+//
+// The target is allocated once at the output size and a frame draws into
+// its bottom left render_width x render_height, so changing the scale never
+// reallocates anything. The upscale samples that corner bilinearly and
+// sharpens by the sum of the four neighbours against the centre (a
+// Laplacian), clamped to the neighbourhood's range so edges don't ring. The
+// more the image is stretched the more it is sharpened, none at all at 1:1.
+//
+// The frame timer is a ring of GL_TIME_ELAPSED queries, from
+// dynamic_resolution_gl_begin_frame to the end of the upscale. Results are
+// read when the GPU has them, without waiting, and come with how many frames
+// ago they were issued for dynamic_resolution_update.
+//
+
+#ifndef FPS_STYLE_ROOM_DYNAMIC_RESOLUTION_GL_H
+#define FPS_STYLE_ROOM_DYNAMIC_RESOLUTION_GL_H
+
+#include <GL/glew.h>
+
+#define DYNAMIC_RESOLUTION_GL_QUERIES 4
+
+struct DynamicResolutionGl {
+    GLuint fbo;
+    GLuint colour;               // RGBA8 texture
+    GLuint depth;                // renderbuffer
+    int width, height;           // allocated, the output size
+    GLuint program;
+    GLuint vao;                  // empty, the triangle comes from gl_VertexID
+    GLint source_size_location;
+    GLint texture_size_location;
+    GLint output_size_location;
+    GLint sharpness_location;
+    GLuint queries[DYNAMIC_RESOLUTION_GL_QUERIES];
+    unsigned int issued;         // frames timed
+    unsigned int read;           // of those, results read
+    float sharpness;             // at 2:1 and beyond, 0 to 1
+};
+
+/* false if the framebuffer or the upscale program can't be made */
+bool dynamic_resolution_gl_init (DynamicResolutionGl* gl, int width, int height);
+/* starts timing the frame. call before its first GPU work */
+void dynamic_resolution_gl_begin_frame (DynamicResolutionGl* gl);
+/* binds the target with a render_width x render_height viewport */
+void dynamic_resolution_gl_bind (DynamicResolutionGl* gl, int render_width, int render_height);
+/* upscales to the default framebuffer's full output size and stops the
+timer. leaves depth test as it found it */
+void dynamic_resolution_gl_present (DynamicResolutionGl* gl, int render_width, int render_height);
+/* the newest frame time the GPU has finished, in ms, and how many frames
+ago it was begun (1 is the last). -1 if none is ready */
+float dynamic_resolution_gl_gpu_ms (DynamicResolutionGl* gl, int* lag);
+void dynamic_resolution_gl_destroy (DynamicResolutionGl* gl);
+
+#endif //FPS_STYLE_ROOM_DYNAMIC_RESOLUTION_GL_H
@@ -0,0 +1,119 @@
+//
+// See frame_pacing.h.
+//
+
+#include "frame_pacing.h"
+#include <algorithm>
+#include <chrono>
+#include <string.h>
+#include <thread>
+
+double frame_pacing_now_ms () {
+    using namespace std::chrono;
+    return duration<double, std::milli> (steady_clock::now ().time_since_epoch ()).count ();
+}
+
+void frame_pacing_sleep_until (double ms) {
+    double left = ms - frame_pacing_now_ms ();
+    if (left > 2.0) {
+        std::this_thread::sleep_for (std::chrono::microseconds ((long long)((left - 1.5) * 1000.0)));
+    }
+    while (frame_pacing_now_ms () < ms) {
+        std::this_thread::yield ();
+    }
+}
+
+/*-----------------------------------LATENCY----------------------------------*/
+void input_latency_init (InputLatency* l) {
+    memset (l, 0, sizeof (*l));
+    l->pending_ms = -1.0;
+}
+
+void input_latency_event (InputLatency* l, double now_ms) {
+    if (l->pending_ms < 0.0) {
+        l->pending_ms = now_ms;
+    }
+}
+
+void input_latency_submit (InputLatency* l, double now_ms) {
+    l->frames++;
+    if (l->pending_ms < 0.0) {
+        return;
+    }
+    l->last_ms = (float)(now_ms - l->pending_ms);
+    l->pending_ms = -1.0;
+    l->history[l->next] = l->last_ms;
+    l->next = (l->next + 1) % INPUT_LATENCY_HISTORY;
+    l->count = std::min (l->count + 1, INPUT_LATENCY_HISTORY);
+    l->samples++;
+}
+
+void input_latency_stats (const InputLatency& l, InputLatencyStats* out) {
+    memset (out, 0, sizeof (*out));
+    out->frames = l.frames;
+    out->samples = l.samples;
+    out->last_ms = l.last_ms;
+    if (l.count == 0) {
+        return;
+    }
+    float sorted[INPUT_LATENCY_HISTORY];
+    memcpy (sorted, l.history, l.count * sizeof (float));
+    std::sort (sorted, sorted + l.count);
+    double sum = 0.0;
+    for (int i = 0; i < l.count; i++) {
+        sum += sorted[i];
+    }
+    out->mean_ms = (float)(sum / l.count);
+    out->p99_ms = sorted[std::max (0, (l.count * 99 + 99) / 100 - 1)];
+    out->max_ms = sorted[l.count - 1];
+}
+
+/*-----------------------------------PACER------------------------------------*/
+void frame_pacer_init (FramePacer* p, int refresh_hz, double margin_ms) {
+    memset (p, 0, sizeof (*p));
+    p->nominal_ms = 1000.0 / (refresh_hz > 0 ? refresh_hz : 60);
+    p->refresh_ms = p->nominal_ms;
+    p->margin_ms = margin_ms;
+    p->last_swap_ms = -1.0;
+    p->stats.refresh_ms = p->refresh_ms;
+}
+
+double frame_pacer_wake_ms (const FramePacer& p, double now_ms) {
+    if (p.last_swap_ms < 0.0) {
+        return now_ms;
+    }
+    // a late frame starts at once rather than giving up a whole interval
+    return std::max (now_ms, p.last_swap_ms + p.refresh_ms - p.work_ms - p.margin_ms);
+}
+
+void frame_pacer_wait (FramePacer* p) {
+    double now = frame_pacing_now_ms ();
+    double wake = frame_pacer_wake_ms (*p, now);
+    if (wake > now) {
+        frame_pacing_sleep_until (wake);
+    }
+    p->stats.slept_ms = wake - now;
+    frame_pacer_begin (p, frame_pacing_now_ms ());
+}
+
+void frame_pacer_begin (FramePacer* p, double now_ms) {
+    p->frame_start_ms = now_ms;
+}
+
+void frame_pacer_swapped (FramePacer* p, double swap_ms, double now_ms) {
+    double work = swap_ms - p->frame_start_ms;
+    p->work_ms = work > p->work_ms ? work : p->work_ms * 0.95 + work * 0.05;
+    if (p->last_swap_ms >= 0.0) {
+        double interval = now_ms - p->last_swap_ms;
+        // only intervals near the nominal rate say anything about it. a
+        // missed vblank shows up as about two
+        if (interval > 0.5 * p->nominal_ms && interval < 1.5 * p->nominal_ms) {
+            p->refresh_ms = p->refresh_ms * 0.95 + interval * 0.05;
+        } else if (interval >= 1.5 * p->refresh_ms) {
+            p->stats.missed++;
+        }
+    }
+    p->last_swap_ms = now_ms;
+    p->stats.refresh_ms = p->refresh_ms;
+    p->stats.work_ms = p->work_ms;
+}
@@ -0,0 +1,85 @@
+//
+// Input latency measurement and pre-vsync frame starts.
+//
+// InputLatency times how long input waits before a frame that uses it is
+// submitted. An input callback calls input_latency_event with the current
+// time, which remembers the earliest event not yet used. The frame calls
+// input_latency_submit once its draws are issued, and that gap is one
+// sample. With GLFW the event time is when glfwPollEvents delivers it, so
+// this measures how stale the input is by submission, the part the frame
+// loop controls.
+//
+// FramePacer starts frames late. With vsync on, a frame that starts right
+// after the swap finishes early and then waits for the next vblank with its
+// input already read. The pacer learns the refresh interval from swap times
+// and how long the CPU takes from frame start to swap (a decaying maximum,
+// so one slow frame raises it at once and it comes down slowly). It wakes
+// the frame that long before the next vblank, plus margin_ms, which has to
+// cover the GPU's share and the scheduler's wake up jitter.
+//
+// All times are milliseconds on one clock, frame_pacing_now_ms unless a
+// simulation passes its own. Nothing here touches GL.
+//
+
+#ifndef FPS_STYLE_ROOM_FRAME_PACING_H
+#define FPS_STYLE_ROOM_FRAME_PACING_H
+
+#define INPUT_LATENCY_HISTORY 256
+
+struct InputLatencyStats {
+    unsigned int frames;         // submits seen
+    unsigned int samples;        // submits that had input waiting
+    float last_ms;
+    float mean_ms;               // over the last INPUT_LATENCY_HISTORY samples
+    float p99_ms;
+    float max_ms;
+};
+
+struct InputLatency {
+    double pending_ms;           // earliest unused event, < 0 if none
+    float history[INPUT_LATENCY_HISTORY];
+    int next;
+    int count;
+    unsigned int frames;
+    unsigned int samples;
+    float last_ms;
+};
+
+struct FramePacerStats {
+    double refresh_ms;           // estimated vblank interval
+    double work_ms;              // estimated frame start to swap
+    double slept_ms;             // by the last wait
+    unsigned int missed;         // frames that took more than one interval
+};
+
+struct FramePacer {
+    double nominal_ms;           // from the monitor's refresh rate
+    double refresh_ms;
+    double work_ms;
+    double margin_ms;
+    double last_swap_ms;         // < 0 until the first swap
+    double frame_start_ms;
+    FramePacerStats stats;
+};
+
+double frame_pacing_now_ms ();
+/* sleeps until the clock reaches ms. sleeps coarsely, then yields for the
+last stretch, which the OS scheduler can't hit exactly */
+void frame_pacing_sleep_until (double ms);
+
+void input_latency_init (InputLatency* l);
+void input_latency_event (InputLatency* l, double now_ms);
+void input_latency_submit (InputLatency* l, double now_ms);
+void input_latency_stats (const InputLatency& l, InputLatencyStats* out);
+
+void frame_pacer_init (FramePacer* p, int refresh_hz, double margin_ms);
+/* when the next frame should start to make the vblank after now_ms */
+double frame_pacer_wake_ms (const FramePacer& p, double now_ms);
+/* sleeps until frame_pacer_wake_ms and starts the frame */
+void frame_pacer_wait (FramePacer* p);
+/* start the frame without waiting */
+void frame_pacer_begin (FramePacer* p, double now_ms);
+/* the frame called swap at swap_ms and it returned at now_ms */
+void frame_pacer_swapped (FramePacer* p, double swap_ms, double now_ms);
+
+#endif //FPS_STYLE_ROOM_FRAME_PACING_H
@@ -0,0 +1,52 @@
+//
+// See gl_utils.h.
+//
+
+#include "gl_utils.h"
+#include <render/gpu_memory_gl.h>
+#include <stdio.h>
+
+GLuint gl_compile_shader (GLenum type, const char** sources, int count) {
+    GLuint s = glCreateShader (type);
+    glShaderSource (s, count, sources, NULL);
+    glCompileShader (s);
+    GLint ok = 0;
+    glGetShaderiv (s, GL_COMPILE_STATUS, &ok);
+    if (!ok) {
+        char log[2048];
+        glGetShaderInfoLog (s, sizeof (log), NULL, log);
+        fprintf (stderr, "ERROR: shader did not compile\n%s\n", log);
+    }
+    return s;
+}
+
+GLuint gl_link_program (GLuint vs, GLuint fs) {
+    GLuint program = glCreateProgram ();
+    glAttachShader (program, vs);
+    glAttachShader (program, fs);
+    glLinkProgram (program);
+    glDeleteShader (vs);
+    glDeleteShader (fs);
+    GLint ok = 0;
+    glGetProgramiv (program, GL_LINK_STATUS, &ok);
+    if (!ok) {
+        char log[2048];
+        glGetProgramInfoLog (program, sizeof (log), NULL, log);
+        fprintf (stderr, "ERROR: program did not link\n%s\n", log);
+        glDeleteProgram (program);
+        return 0;
+    }
+    return program;
+}
+
+void gl_stream_upload (GLenum target, GLuint buffer, size_t* capacity, const void* data, size_t bytes,
+                       MemoryTag tag) {
+    glBindBuffer (target, buffer);
+    if (bytes > *capacity) {
+        *capacity = bytes + bytes / 2;
+    }
+    gpu_memory_buffer_data (target, buffer, *capacity, NULL, GL_STREAM_DRAW, tag);
+    if (bytes) {
+        glBufferSubData (target, 0, bytes, data);
+    }
+}
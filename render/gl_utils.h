@@ -0,0 +1,22 @@
+//
+// Small GL helpers shared by the render modules.
+//
+
+#ifndef FPS_STYLE_ROOM_GL_UTILS_H
+#define FPS_STYLE_ROOM_GL_UTILS_H
+
+#include <GL/glew.h>
+#include <stddef.h>
+#include <memory/memory_tracker.h>
+
+/* compiles the concatenation of sources, printing the log on failure */
+GLuint gl_compile_shader (GLenum type, const char** sources, int count);
+/* links vs and fs into a program and deletes them. 0 on failure */
+GLuint gl_link_program (GLuint vs, GLuint fs);
+/* grows buffer to hold bytes, then replaces its contents. orphaning the old
+storage keeps us from waiting on last frame's draw. the storage is charged
+to tag (render/gpu_memory_gl.h) */
+void gl_stream_upload (GLenum target, GLuint buffer, size_t* capacity, const void* data, size_t bytes,
+                       MemoryTag tag);
+
+#endif //FPS_STYLE_ROOM_GL_UTILS_H
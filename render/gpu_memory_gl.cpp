@@ -0,0 +1,63 @@
+//
+// See gpu_memory_gl.h.
+//
+
+#include "gpu_memory_gl.h"
+#include <stdint.h>
+#include <unordered_map>
+
+struct GpuAllocation {
+    size_t bytes;
+    MemoryTag tag;
+};
+
+// kind << 32 | name
+static std::unordered_map<uint64_t, GpuAllocation> allocations;
+
+static inline uint64_t object_key (GLenum kind, GLuint name) {
+    return (uint64_t)kind << 32 | name;
+}
+
+/* name now takes bytes, whatever it took before */
+static void charge (GLenum kind, GLuint name, size_t bytes, MemoryTag tag) {
+    GpuAllocation& a = allocations[object_key (kind, name)];
+    if (a.bytes) {
+        memory_gpu_charge (a.tag, -(int64_t)a.bytes);
+    }
+    a.bytes = bytes;
+    a.tag = tag;
+    memory_gpu_charge (tag, (int64_t)bytes);
+}
+
+void gpu_memory_buffer_data (GLenum target, GLuint buffer, size_t bytes, const void* data, GLenum usage,
+                             MemoryTag tag) {
+    glBufferData (target, (GLsizeiptr)bytes, data, usage);
+    charge (GL_BUFFER, buffer, bytes, tag);
+}
+
+void gpu_memory_buffer_storage (GLenum target, GLuint buffer, size_t bytes, const void* data, GLbitfield flags,
+                                MemoryTag tag) {
+    glBufferStorage (target, (GLsizeiptr)bytes, data, flags);
+    charge (GL_BUFFER, buffer, bytes, tag);
+}
+
+void gpu_memory_image (GLenum kind, GLuint name, size_t bytes, MemoryTag tag) {
+    charge (kind, name, bytes, tag);
+}
+
+void gpu_memory_delete (GLenum kind, GLsizei count, const GLuint* names) {
+    for (GLsizei i = 0; i < count; i++) {
+        auto it = allocations.find (object_key (kind, names[i]));
+        if (it != allocations.end ()) {
+            memory_gpu_charge (it->second.tag, -(int64_t)it->second.bytes);
+            allocations.erase (it);
+        }
+    }
+    if (kind == GL_BUFFER) {
+        glDeleteBuffers (count, names);
+    } else if (kind == GL_TEXTURE) {
+        glDeleteTextures (count, names);
+    } else if (kind == GL_RENDERBUFFER) {
+        glDeleteRenderbuffers (count, names);
+    }
+}
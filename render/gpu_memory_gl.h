@@ -0,0 +1,35 @@
+//
+// GPU memory accounting for memory/memory_tracker.h.
+//
+// GL can't say portably how much memory an object takes, so what is asked
+// for is what is counted: the size given to glBufferData or glBufferStorage,
+// and for textures and renderbuffers the bytes the caller works out from
+// format and size. Drivers pad and compress behind our back, so treat the
+// totals as a floor.
+//
+// Every object's size and tag is kept by name, so specifying a buffer again
+// (gl_stream_upload does it every frame to orphan) charges only the change
+// in size, and deleting an object through gpu_memory_delete gives its bytes
+// back. GL thread only.
+//
+
+#ifndef FPS_STYLE_ROOM_GPU_MEMORY_GL_H
+#define FPS_STYLE_ROOM_GPU_MEMORY_GL_H
+
+#include <GL/glew.h>
+#include <memory/memory_tracker.h>
+
+/* glBufferData on buffer, which must be bound to target */
+void gpu_memory_buffer_data (GLenum target, GLuint buffer, size_t bytes, const void* data, GLenum usage,
+                             MemoryTag tag);
+/* glBufferStorage on buffer, which must be bound to target */
+void gpu_memory_buffer_storage (GLenum target, GLuint buffer, size_t bytes, const void* data, GLbitfield flags,
+                                MemoryTag tag);
+/* after allocating storage for a texture or renderbuffer. kind is
+GL_TEXTURE or GL_RENDERBUFFER */
+void gpu_memory_image (GLenum kind, GLuint name, size_t bytes, MemoryTag tag);
+/* gives back what the objects were charged and deletes them. kind is
+GL_BUFFER, GL_TEXTURE or GL_RENDERBUFFER */
+void gpu_memory_delete (GLenum kind, GLsizei count, const GLuint* names);
+
+#endif //FPS_STYLE_ROOM_GPU_MEMORY_GL_H
@@ -0,0 +1,219 @@
+//
+// Froxel bounds and per slice light binning. See light_clusters.h.
+//
+
+#include "light_clusters.h"
+#include <memory/memory_tracker.h>
+#include <jobs/job_system.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <math.h>
+#include <string.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+void light_clusters_init (LightClusters* c, int tiles_x, int tiles_y, int slices, const mat4& proj, float near_plane,
+                          float far_plane) {
+    MemoryScope scope (MEMORY_RENDER);
+    c->tiles_x = tiles_x;
+    c->tiles_y = tiles_y;
+    c->slices = slices;
+    c->near_plane = near_plane;
+    c->far_plane = far_plane;
+    c->proj_x = proj.m[0];
+    c->proj_y = proj.m[5];
+    c->slice_scale = (float)slices / logf (far_plane / near_plane);
+
+    // view space x at depth d for ndc x is ndc * d / proj_x. a tile's x range
+    // over a slice is the widest of its two depths
+    int n = light_cluster_count (*c);
+    c->min_x.resize (n);
+    c->max_x.resize (n);
+    c->min_y.resize (n);
+    c->max_y.resize (n);
+    c->min_z.resize (n);
+    c->max_z.resize (n);
+    for (int s = 0; s < slices; s++) {
+        float d0 = near_plane * expf ((float)s / c->slice_scale);
+        float d1 = near_plane * expf ((float)(s + 1) / c->slice_scale);
+        for (int ty = 0; ty < tiles_y; ty++) {
+            float y0 = -1.0f + 2.0f * (float)ty / tiles_y, y1 = -1.0f + 2.0f * (float)(ty + 1) / tiles_y;
+            for (int tx = 0; tx < tiles_x; tx++) {
+                float x0 = -1.0f + 2.0f * (float)tx / tiles_x, x1 = -1.0f + 2.0f * (float)(tx + 1) / tiles_x;
+                int i = (s * tiles_y + ty) * tiles_x + tx;
+                c->min_x[i] = fminf (x0 * d0, x0 * d1) / c->proj_x;
+                c->max_x[i] = fmaxf (x1 * d0, x1 * d1) / c->proj_x;
+                c->min_y[i] = fminf (y0 * d0, y0 * d1) / c->proj_y;
+                c->max_y[i] = fmaxf (y1 * d0, y1 * d1) / c->proj_y;
+                c->min_z[i] = -d1;
+                c->max_z[i] = -d0;
+            }
+        }
+    }
+    c->counts.assign (n, 0);
+    c->lists.assign ((size_t)n * LIGHT_CLUSTER_MAX_LIGHTS, 0);
+    c->cluster_ranges.assign ((size_t)n * 2, 0);
+    memset (&c->stats, 0, sizeof (c->stats));
+}
+
+static inline int clamp_int (int v, int lo, int hi) {
+    return v < lo ? lo : (v > hi ? hi : v);
+}
+
+/* conservative cluster rectangle of one view space sphere. false if the
+sphere misses the frustum's depth range */
+static bool light_rect (const LightClusters& c, const vec3& p, float r, int* rect) {
+    float d_lo = -p.v[2] - r, d_hi = -p.v[2] + r;
+    if (d_hi < c.near_plane || d_lo > c.far_plane) {
+        return false;
+    }
+    d_lo = fmaxf (d_lo, c.near_plane);
+    d_hi = fminf (d_hi, c.far_plane);
+    rect[0] = clamp_int ((int)(logf (d_lo / c.near_plane) * c.slice_scale), 0, c.slices - 1);
+    rect[1] = clamp_int ((int)(logf (d_hi / c.near_plane) * c.slice_scale), 0, c.slices - 1);
+    // ndc of a fixed view x is monotonic in depth, so the extremes are at
+    // the two ends of the depth range
+    float lo[2] = {p.v[0] - r, p.v[1] - r}, hi[2] = {p.v[0] + r, p.v[1] + r};
+    float scale[2] = {c.proj_x, c.proj_y};
+    int tiles[2] = {c.tiles_x, c.tiles_y};
+    for (int a = 0; a < 2; a++) {
+        float n0 = fminf (lo[a] / d_lo, lo[a] / d_hi) * scale[a];
+        float n1 = fmaxf (hi[a] / d_lo, hi[a] / d_hi) * scale[a];
+        if (n1 < -1.0f || n0 > 1.0f) {
+            return false;
+        }
+        rect[2 + a * 2] = clamp_int ((int)floorf ((n0 + 1.0f) * 0.5f * tiles[a]), 0, tiles[a] - 1);
+        rect[3 + a * 2] = clamp_int ((int)floorf ((n1 + 1.0f) * 0.5f * tiles[a]), 0, tiles[a] - 1);
+    }
+    return true;
+}
+
+/* adds light to every cluster in [first, first + count) its sphere touches */
+static void bin_row (LightClusters* c, int first, int count, unsigned int light, const float* s) {
+    int i = 0;
+#if defined(__SSE2__)
+    const __m128 px = _mm_set1_ps (s[0]), py = _mm_set1_ps (s[1]), pz = _mm_set1_ps (s[2]);
+    const __m128 r2 = _mm_set1_ps (s[3] * s[3]);
+    const __m128 zero = _mm_setzero_ps ();
+    for (; i + 4 <= count; i += 4) {
+        int k = first + i;
+        // distance from the centre to the box, per axis: how far outside
+        // the [min, max] range the centre is, or 0 inside it
+        __m128 dx = _mm_max_ps (_mm_max_ps (_mm_sub_ps (_mm_loadu_ps (&c->min_x[k]), px),
+                                            _mm_sub_ps (px, _mm_loadu_ps (&c->max_x[k]))), zero);
+        __m128 dy = _mm_max_ps (_mm_max_ps (_mm_sub_ps (_mm_loadu_ps (&c->min_y[k]), py),
+                                            _mm_sub_ps (py, _mm_loadu_ps (&c->max_y[k]))), zero);
+        __m128 dz = _mm_max_ps (_mm_max_ps (_mm_sub_ps (_mm_loadu_ps (&c->min_z[k]), pz),
+                                            _mm_sub_ps (pz, _mm_loadu_ps (&c->max_z[k]))), zero);
+        __m128 d2 = _mm_add_ps (_mm_add_ps (_mm_mul_ps (dx, dx), _mm_mul_ps (dy, dy)), _mm_mul_ps (dz, dz));
+        int mask = _mm_movemask_ps (_mm_cmple_ps (d2, r2));
+        for (int lane = 0; mask; lane++, mask >>= 1) {
+            if (mask & 1) {
+                unsigned int& n = c->counts[k + lane];
+                if (n < LIGHT_CLUSTER_MAX_LIGHTS) {
+                    c->lists[(size_t)(k + lane) * LIGHT_CLUSTER_MAX_LIGHTS + n] = light;
+                }
+                n++;
+            }
+        }
+    }
+#endif
+    for (; i < count; i++) {
+        int k = first + i;
+        float dx = fmaxf (fmaxf (c->min_x[k] - s[0], s[0] - c->max_x[k]), 0.0f);
+        float dy = fmaxf (fmaxf (c->min_y[k] - s[1], s[1] - c->max_y[k]), 0.0f);
+        float dz = fmaxf (fmaxf (c->min_z[k] - s[2], s[2] - c->max_z[k]), 0.0f);
+        if (dx * dx + dy * dy + dz * dz <= s[3] * s[3]) {
+            unsigned int& n = c->counts[k];
+            if (n < LIGHT_CLUSTER_MAX_LIGHTS) {
+                c->lists[(size_t)k * LIGHT_CLUSTER_MAX_LIGHTS + n] = light;
+            }
+            n++;
+        }
+    }
+}
+
+void light_clusters_build (LightClusters* c, const PointLight* lights, int count, const mat4& view) {
+    MemoryScope scope (MEMORY_RENDER);
+    auto t0 = std::chrono::steady_clock::now ();
+    c->lights.resize (count);
+    c->light_rect.resize ((size_t)count * 6);
+    std::atomic<unsigned int> visible (0);
+
+    // lights to view space and their cluster rectangles
+    parallel_for_each (count, 256, [&] (int begin, int end) {
+        unsigned int seen = 0;
+        for (int i = begin; i < end; i++) {
+            vec4 p = view * vec4 (lights[i].position, 1.0f);
+            GpuLight& g = c->lights[i];
+            g.position_radius[0] = p.v[0];
+            g.position_radius[1] = p.v[1];
+            g.position_radius[2] = p.v[2];
+            g.position_radius[3] = lights[i].radius;
+            g.colour_intensity[0] = lights[i].colour.v[0];
+            g.colour_intensity[1] = lights[i].colour.v[1];
+            g.colour_intensity[2] = lights[i].colour.v[2];
+            g.colour_intensity[3] = lights[i].intensity;
+            g.shadow[0] = lights[i].shadow_first;
+            g.shadow[1] = lights[i].shadow_count;
+            g.shadow[2] = g.shadow[3] = 0;
+            int* rect = &c->light_rect[(size_t)i * 6];
+            if (light_rect (*c, vec3 (p.v[0], p.v[1], p.v[2]), lights[i].radius, rect)) {
+                seen++;
+            } else {
+                rect[0] = 1; // empty slice range
+                rect[1] = 0;
+            }
+        }
+        visible += seen;
+    });
+
+    // one job per slice, each owns its clusters
+    int per_slice = c->tiles_x * c->tiles_y;
+    parallel_for_each (c->slices, 1, [&] (int begin, int end) {
+        for (int s = begin; s < end; s++) {
+            memset (&c->counts[(size_t)s * per_slice], 0, per_slice * sizeof (unsigned int));
+            for (int i = 0; i < count; i++) {
+                const int* rect = &c->light_rect[(size_t)i * 6];
+                if (s < rect[0] || s > rect[1]) {
+                    continue;
+                }
+                const float* sphere = c->lights[i].position_radius;
+                for (int ty = rect[4]; ty <= rect[5]; ty++) {
+                    bin_row (c, (s * c->tiles_y + ty) * c->tiles_x + rect[2], rect[3] - rect[2] + 1,
+                             (unsigned int)i, sphere);
+                }
+            }
+        }
+    });
+
+    // offsets, then each slice copies its lists into place
+    int n = light_cluster_count (*c);
+    unsigned int offset = 0, dropped = 0, most = 0;
+    for (int k = 0; k < n; k++) {
+        unsigned int kept = std::min (c->counts[k], (unsigned int)LIGHT_CLUSTER_MAX_LIGHTS);
+        dropped += c->counts[k] - kept;
+        most = std::max (most, c->counts[k]);
+        c->cluster_ranges[k * 2] = offset;
+        c->cluster_ranges[k * 2 + 1] = kept;
+        offset += kept;
+    }
+    c->light_indices.resize (offset);
+    parallel_for_each (c->slices, 1, [&] (int begin, int end) {
+        for (int k = begin * per_slice; k < end * per_slice; k++) {
+            if (c->cluster_ranges[k * 2 + 1]) {
+                memcpy (&c->light_indices[c->cluster_ranges[k * 2]], &c->lists[(size_t)k * LIGHT_CLUSTER_MAX_LIGHTS],
+                        c->cluster_ranges[k * 2 + 1] * sizeof (unsigned int));
+            }
+        }
+    });
+
+    c->stats.lights = (unsigned int)count;
+    c->stats.lights_visible = visible.load ();
+    c->stats.references = offset;
+    c->stats.max_per_cluster = most;
+    c->stats.dropped = dropped;
+    c->stats.ms = std::chrono::duration<double, std::milli> (std::chrono::steady_clock::now () - t0).count ();
+}
@@ -0,0 +1,125 @@
+//
+// Clustered forward lighting, CPU half.
+//
+// The view frustum is cut into tiles_x x tiles_y screen tiles and `slices`
+// depth slices. The slices are spaced exponentially from near to far, so a
+// cluster (froxel) is roughly as deep as it is wide. Each frame every point
+// light is moved to view space and filed under each cluster its sphere
+// touches. The result is three flat arrays for the fragment shader:
+//  - lights: view space position and radius, colour and intensity
+//  - cluster_ranges: an (offset, count) pair per cluster into light_indices
+//  - light_indices: the lights of every cluster, back to back
+// A fragment finds its cluster from gl_FragCoord and its view depth, then
+// loops over at most LIGHT_CLUSTER_MAX_LIGHTS lights.
+//
+// Binning is one job per depth slice. A slice only writes its own clusters,
+// so there are no locks, and lights are visited in index order, so the lists
+// don't depend on the worker count. Inside a slice, a light is tested
+// against its screen rectangle of clusters four at a time, with SSE on the
+// cluster bounds stored as structure of arrays.
+//
+// A cluster that would get more than LIGHT_CLUSTER_MAX_LIGHTS keeps the
+// first ones by light index, and the rest are counted in stats.dropped.
+//
+// A light can cast shadows through the shadow cache (render/shadow_cache.h):
+// shadow_first and shadow_count name its views there, count 0 is unshadowed.
+//
+
+#ifndef FPS_STYLE_ROOM_LIGHT_CLUSTERS_H
+#define FPS_STYLE_ROOM_LIGHT_CLUSTERS_H
+
+#include <vector>
+#include <utils/maths_funcs.h>
+#include <render/shadow_cache.h>
+
+#define LIGHT_CLUSTER_MAX_LIGHTS 32
+
+struct PointLight {
+    vec3 position;               // world space
+    float radius;                // no light past this distance
+    vec3 colour;
+    float intensity;
+    int shadow_first;            // first ShadowCache view, see shadow_count
+    int shadow_count;            // 0 without shadows
+};
+
+/* std430 layout for the shader */
+struct GpuLight {
+    float position_radius[4];    // view space xyz, radius
+    float colour_intensity[4];
+    int shadow[4];               // first view, view count, unused
+};
+
+struct LightClusterStats {
+    unsigned int lights;
+    unsigned int lights_visible; // inside the frustum's cluster rectangle
+    unsigned int references;     // entries in light_indices
+    unsigned int max_per_cluster;
+    unsigned int dropped;        // over LIGHT_CLUSTER_MAX_LIGHTS
+    double ms;
+};
+
+struct LightClusters {
+    int tiles_x, tiles_y, slices;
+    float near_plane, far_plane;
+    float proj_x, proj_y;        // proj.m[0] and proj.m[5]
+    float slice_scale;           // slices / log (far / near)
+
+    // view space bounds of every cluster, x fastest, then y, then slice
+    std::vector<float> min_x, max_x, min_y, max_y, min_z, max_z;
+
+    std::vector<GpuLight> lights;
+    std::vector<unsigned int> cluster_ranges; // offset, count per cluster
+    std::vector<unsigned int> light_indices;
+
+    // scratch: per light rectangle and the per cluster lists before compaction
+    std::vector<int> light_rect;             // slice lo/hi, x lo/hi, y lo/hi
+    std::vector<unsigned int> counts;
+    std::vector<unsigned int> lists;         // LIGHT_CLUSTER_MAX_LIGHTS per cluster
+
+    LightClusterStats stats;
+};
+
+/* proj is the perspective matrix main () builds, near and far its planes */
+void light_clusters_init (LightClusters* c, int tiles_x, int tiles_y, int slices, const mat4& proj, float near_plane,
+                          float far_plane);
+/* bins count lights for a camera with this view matrix */
+void light_clusters_build (LightClusters* c, const PointLight* lights, int count, const mat4& view);
+
+inline int light_cluster_count (const LightClusters& c) {
+    return c.tiles_x * c.tiles_y * c.slices;
+}
+
+/* cluster lookup and lighting for the fragment shader. needs the three
+buffers at bindings 1 (lights), 2 (ranges) and 3 (indices), the uniforms
+light_clusters_gl_set_uniforms sets and what SHADOW_GLSL reads. call
+cluster_lighting (view_position, view_normal, albedo) */
+#define LIGHT_CLUSTERS_GLSL \
+    SHADOW_GLSL \
+    "struct Light { vec4 position_radius; vec4 colour_intensity; ivec4 shadow; };\n" \
+    "layout (std430, binding = 1) readonly buffer Lights { Light lights[]; };\n" \
+    "layout (std430, binding = 2) readonly buffer ClusterRanges { uvec2 cluster_ranges[]; };\n" \
+    "layout (std430, binding = 3) readonly buffer LightIndices { uint light_indices[]; };\n" \
+    "uniform ivec3 cluster_dims;\n" \
+    "uniform vec2 cluster_viewport;\n" \
+    "uniform float cluster_near, cluster_slice_scale;\n" \
+    "vec3 cluster_lighting (vec3 p, vec3 n, vec3 albedo) {\n" \
+    "    ivec2 tile = clamp (ivec2 (gl_FragCoord.xy / cluster_viewport * vec2 (cluster_dims.xy)),\n" \
+    "                        ivec2 (0), cluster_dims.xy - 1);\n" \
+    "    int slice = clamp (int (log (-p.z / cluster_near) * cluster_slice_scale), 0, cluster_dims.z - 1);\n" \
+    "    uvec2 range = cluster_ranges[(slice * cluster_dims.y + tile.y) * cluster_dims.x + tile.x];\n" \
+    "    vec3 result = albedo * 0.05;\n" \
+    "    for (uint i = 0u; i < range.y; i++) {\n" \
+    "        Light l = lights[light_indices[range.x + i]];\n" \
+    "        vec3 to_light = l.position_radius.xyz - p;\n" \
+    "        float d2 = dot (to_light, to_light);\n" \
+    "        float r2 = l.position_radius.w * l.position_radius.w;\n" \
+    "        float falloff = clamp (1.0 - d2 / r2, 0.0, 1.0);\n" \
+    "        float lambert = max (dot (n, to_light * inversesqrt (max (d2, 1e-8))), 0.0);\n" \
+    "        if (l.shadow.y > 0 && lambert * falloff > 0.0) lambert *= shadow_factor (l.shadow.x, l.shadow.y, p);\n" \
+    "        result += albedo * l.colour_intensity.rgb * (l.colour_intensity.a * lambert * falloff * falloff);\n" \
+    "    }\n" \
+    "    return result;\n" \
+    "}\n"
+
+#endif //FPS_STYLE_ROOM_LIGHT_CLUSTERS_H
@@ -0,0 +1,41 @@
+//
+// See light_clusters_gl.h.
+//
+
+#include "light_clusters_gl.h"
+#include <render/gl_utils.h>
+#include <render/gpu_memory_gl.h>
+#include <algorithm>
+#include <string.h>
+
+void light_clusters_gl_init (LightClustersGl* gl) {
+    memset (gl, 0, sizeof (*gl));
+    glGenBuffers (3, gl->buffers);
+}
+
+void light_clusters_gl_upload (LightClustersGl* gl, const LightClusters& c) {
+    // never zero sized, the shader indexes ranges whatever the light count
+    static const unsigned int none[1] = {0};
+    const void* data[3] = {c.lights.empty () ? (const void*)none : (const void*)&c.lights[0], &c.cluster_ranges[0],
+                           c.light_indices.empty () ? (const void*)none : (const void*)&c.light_indices[0]};
+    size_t bytes[3] = {std::max (c.lights.size () * sizeof (GpuLight), sizeof (none)),
+                       c.cluster_ranges.size () * sizeof (unsigned int),
+                       std::max (c.light_indices.size () * sizeof (unsigned int), sizeof (none))};
+    for (int i = 0; i < 3; i++) {
+        gl_stream_upload (GL_SHADER_STORAGE_BUFFER, gl->buffers[i], &gl->capacity[i], data[i], bytes[i],
+                          MEMORY_RENDER);
+        glBindBufferBase (GL_SHADER_STORAGE_BUFFER, 1 + i, gl->buffers[i]);
+    }
+}
+
+void light_clusters_gl_set_uniforms (const LightClusters& c, GLuint program, int width, int height) {
+    glProgramUniform3i (program, glGetUniformLocation (program, "cluster_dims"), c.tiles_x, c.tiles_y, c.slices);
+    glProgramUniform2f (program, glGetUniformLocation (program, "cluster_viewport"), (float)width, (float)height);
+    glProgramUniform1f (program, glGetUniformLocation (program, "cluster_near"), c.near_plane);
+    glProgramUniform1f (program, glGetUniformLocation (program, "cluster_slice_scale"), c.slice_scale);
+}
+
+void light_clusters_gl_destroy (LightClustersGl* gl) {
+    gpu_memory_delete (GL_BUFFER, 3, gl->buffers);
+    memset (gl, 0, sizeof (*gl));
+}
@@ -0,0 +1,24 @@
+//
+// GL side of the clustered lighting: the three shader storage buffers and
+// the uniforms LIGHT_CLUSTERS_GLSL reads.
+//
+
+#ifndef FPS_STYLE_ROOM_LIGHT_CLUSTERS_GL_H
+#define FPS_STYLE_ROOM_LIGHT_CLUSTERS_GL_H
+
+#include <GL/glew.h>
+#include <render/light_clusters.h>
+
+struct LightClustersGl {
+    GLuint buffers[3];           // lights, ranges, indices at bindings 1, 2, 3
+    size_t capacity[3];
+};
+
+void light_clusters_gl_init (LightClustersGl* gl);
+/* uploads the last light_clusters_build and binds the buffers */
+void light_clusters_gl_upload (LightClustersGl* gl, const LightClusters& c);
+/* sets the cluster uniforms on program, for a viewport of width x height */
+void light_clusters_gl_set_uniforms (const LightClusters& c, GLuint program, int width, int height);
+void light_clusters_gl_destroy (LightClustersGl* gl);
+
+#endif //FPS_STYLE_ROOM_LIGHT_CLUSTERS_GL_H
@@ -0,0 +1,238 @@
+//
+// See multi_view.h.
+//
+
+#include "multi_view.h"
+#include <memory/memory_tracker.h>
+#include <jobs/job_system.h>
+#include <algorithm>
+#include <chrono>
+#include <string.h>
+
+// touched chunks per command job, 1024 objects
+#define MULTI_VIEW_PIECE 16
+
+/* aabb_merge with compares. fminf is a libm call without -ffast-math, and
+this runs on every object every frame */
+static inline void merge_box (Aabb* b, const Aabb& other) {
+    for (int a = 0; a < 3; a++) {
+        b->min.v[a] = other.min.v[a] < b->min.v[a] ? other.min.v[a] : b->min.v[a];
+        b->max.v[a] = other.max.v[a] > b->max.v[a] ? other.max.v[a] : b->max.v[a];
+    }
+}
+
+static double ms_since (std::chrono::steady_clock::time_point t0) {
+    return std::chrono::duration<double, std::milli> (std::chrono::steady_clock::now () - t0).count ();
+}
+
+RenderView render_view_look_at (const vec3& eye, const vec3& target, const vec3& up, float fovy_deg, float aspect,
+                                float near_plane, float far_plane, int x, int y, int width, int height) {
+    RenderView v;
+    v.view = look_at (eye, target, up);
+    v.proj = perspective (fovy_deg, aspect, near_plane, far_plane);
+    v.viewport[0] = x;
+    v.viewport[1] = y;
+    v.viewport[2] = width;
+    v.viewport[3] = height;
+    return v;
+}
+
+void multi_view_init (MultiView* mv) {
+    mv->masks.clear ();
+    mv->draws.clear ();
+    mv->commands.clear ();
+    multi_view_clear (mv);
+}
+
+void multi_view_clear (MultiView* mv) {
+    mv->count = 0;
+    memset (mv->first, 0, sizeof (mv->first));
+    memset (mv->counts, 0, sizeof (mv->counts));
+    memset (mv->view_stats, 0, sizeof (mv->view_stats));
+    memset (&mv->stats, 0, sizeof (mv->stats));
+}
+
+int multi_view_add (MultiView* mv, const RenderView& view) {
+    MemoryScope scope (MEMORY_RENDER);
+    if (mv->count == MULTI_VIEW_MAX) {
+        return -1;
+    }
+    mv->views[mv->count] = view;
+    mv->frusta[mv->count] = frustum_from_matrix (view.proj * view.view);
+    return mv->count++;
+}
+
+void multi_view_build (MultiView* mv, const DrawBatch& batch, const unsigned int* mesh_of, const mat4* worlds,
+                       const Aabb* bounds, int count) {
+    MemoryScope scope (MEMORY_RENDER);
+    auto t0 = std::chrono::steady_clock::now ();
+    const int views = mv->count;
+    const int chunks = (count + MULTI_VIEW_CHUNK - 1) / MULTI_VIEW_CHUNK;
+    const int stride = chunks + 1;
+    mv->masks.resize (count);
+    mv->draw_start.assign (stride, 0);
+    mv->view_start.assign ((size_t)views * stride, 0);
+    mv->chunk_views.assign (chunks, 0);
+    std::vector<unsigned int> tests ((size_t)chunks * views, 0);
+
+    // cull: chunk bounds against every view, then each object against the
+    // views its chunk straddles, all at once
+    parallel_for_each (chunks, 1, [&] (int begin, int end) {
+        for (int c = begin; c < end; c++) {
+            int lo = c * MULTI_VIEW_CHUNK, hi = std::min (count, lo + MULTI_VIEW_CHUNK);
+            Aabb box = aabb_empty ();
+            for (int i = lo; i < hi; i++) {
+                merge_box (&box, bounds[i]);
+            }
+            uint32_t inside = 0, crossing = 0;
+            for (int v = 0; v < views; v++) {
+                FrustumSide side = frustum_classify_aabb (mv->frusta[v], box);
+                inside |= (uint32_t)(side == FRUSTUM_INSIDE) << v;
+                crossing |= (uint32_t)(side == FRUSTUM_CROSSING) << v;
+            }
+            mv->chunk_views[c] = inside | crossing;
+
+            unsigned int seen = 0;
+            unsigned int per_view[MULTI_VIEW_MAX] = {0};
+            for (int i = lo; i < hi; i++) {
+                uint32_t mask = inside;
+                for (uint32_t left = crossing; left; left &= left - 1) {
+                    int v = __builtin_ctz (left);
+                    mask |= (uint32_t)frustum_test_aabb (mv->frusta[v], bounds[i]) << v;
+                }
+                mv->masks[i] = mask;
+                seen += mask != 0;
+                for (uint32_t left = mask; left; left &= left - 1) {
+                    per_view[__builtin_ctz (left)]++;
+                }
+            }
+            mv->draw_start[c + 1] = seen;
+            for (int v = 0; v < views; v++) {
+                mv->view_start[(size_t)v * stride + c + 1] = per_view[v];
+                tests[(size_t)c * views + v] = (crossing >> v & 1) ? (unsigned int)(hi - lo) : 0;
+            }
+        }
+    });
+    mv->stats.cull_ms = ms_since (t0);
+
+    for (int c = 0; c < chunks; c++) {
+        mv->draw_start[c + 1] += mv->draw_start[c];
+    }
+    unsigned int total = 0;
+    for (int v = 0; v < views; v++) {
+        unsigned int* start = &mv->view_start[(size_t)v * stride];
+        for (int c = 0; c < chunks; c++) {
+            start[c + 1] += start[c];
+        }
+        mv->first[v] = total;
+        mv->counts[v] = start[chunks];
+        total += start[chunks];
+    }
+    mv->draws.resize (mv->draw_start[chunks]);
+    mv->commands.resize (total);
+
+    // draw data, once for every object any view sees
+    auto t1 = std::chrono::steady_clock::now ();
+    parallel_for_each (chunks, 1, [&] (int begin, int end) {
+        for (int c = begin; c < end; c++) {
+            unsigned int out = mv->draw_start[c];
+            int lo = c * MULTI_VIEW_CHUNK, hi = std::min (count, lo + MULTI_VIEW_CHUNK);
+            for (int i = lo; i < hi; i++) {
+                if (!mv->masks[i]) {
+                    continue;
+                }
+                const DrawBatchMesh& m = batch.meshes[mesh_of[i]];
+                DrawData& d = mv->draws[out++];
+                memcpy (d.model, worlds[i].m, sizeof (d.model));
+                for (int a = 0; a < 3; a++) {
+                    d.position_offset[a] = m.quantization.offset.v[a];
+                    d.position_extent[a] = m.quantization.extent.v[a];
+                }
+                d.position_offset[3] = d.position_extent[3] = 0.0f;
+                memcpy (d.albedo, m.albedo, sizeof (d.albedo));
+            }
+        }
+    });
+    mv->stats.data_ms = ms_since (t1);
+
+    // commands: each view's touched chunks, cut into jobs
+    auto t2 = std::chrono::steady_clock::now ();
+    std::vector<int> touched;
+    std::vector<int> task_view, task_begin, task_end;
+    for (int v = 0; v < views; v++) {
+        int from = (int)touched.size ();
+        for (int c = 0; c < chunks; c++) {
+            if (mv->chunk_views[c] >> v & 1) {
+                touched.push_back (c);
+            }
+        }
+        int to = (int)touched.size ();
+        mv->view_stats[v].chunks = (unsigned int)(to - from);
+        for (int k = from; k < to; k += MULTI_VIEW_PIECE) {
+            task_view.push_back (v);
+            task_begin.push_back (k);
+            task_end.push_back (std::min (to, k + MULTI_VIEW_PIECE));
+        }
+    }
+    int tasks = (int)task_view.size ();
+    std::vector<double> task_ms (tasks, 0.0);
+    std::vector<unsigned int> task_triangles (tasks, 0);
+    parallel_for_each (tasks, 1, [&] (int begin, int end) {
+        for (int t = begin; t < end; t++) {
+            auto start = std::chrono::steady_clock::now ();
+            int v = task_view[t];
+            const unsigned int* view_start = &mv->view_start[(size_t)v * stride];
+            unsigned int triangles = 0;
+            for (int k = task_begin[t]; k < task_end[t]; k++) {
+                int c = touched[k];
+                unsigned int out = mv->first[v] + view_start[c];
+                unsigned int shared = mv->draw_start[c];
+                int lo = c * MULTI_VIEW_CHUNK, hi = std::min (count, lo + MULTI_VIEW_CHUNK);
+                for (int i = lo; i < hi; i++) {
+                    uint32_t mask = mv->masks[i];
+                    if (!mask) {
+                        continue;
+                    }
+                    if (mask >> v & 1) {
+                        const DrawBatchMesh& m = batch.meshes[mesh_of[i]];
+                        DrawElementsIndirectCommand& cmd = mv->commands[out++];
+                        cmd.count = m.index_count;
+                        cmd.instance_count = 1;
+                        cmd.first_index = m.first_index;
+                        cmd.base_vertex = (int)m.base_vertex;
+                        cmd.base_instance = shared;
+                        triangles += m.index_count / 3;
+                    }
+                    shared++;
+                }
+            }
+            task_triangles[t] = triangles;
+            task_ms[t] = ms_since (start);
+        }
+    });
+    mv->stats.commands_ms = ms_since (t2);
+
+    unsigned long long object_tests = 0;
+    for (int v = 0; v < views; v++) {
+        ViewStats& vs = mv->view_stats[v];
+        vs.visible = mv->counts[v];
+        vs.triangles = 0;
+        vs.tests = 0;
+        vs.build_ms = 0.0;
+        for (int c = 0; c < chunks; c++) {
+            vs.tests += tests[(size_t)c * views + v];
+        }
+        object_tests += vs.tests;
+    }
+    for (int t = 0; t < tasks; t++) {
+        mv->view_stats[task_view[t]].triangles += task_triangles[t];
+        mv->view_stats[task_view[t]].build_ms += task_ms[t];
+    }
+    mv->stats.views = views;
+    mv->stats.objects = (unsigned int)count;
+    mv->stats.shared_draws = (unsigned int)mv->draws.size ();
+    mv->stats.commands = total;
+    mv->stats.tests = (unsigned long long)chunks * views + object_tests;
+    mv->stats.naive_tests = (unsigned long long)count * views;
+    mv->stats.ms = ms_since (t0);
+}
@@ -0,0 +1,105 @@
+//
+// Several views a frame (split screen, mirrors, security cameras) sharing
+// their culling and draw data.
+//
+// A view is a view and projection matrix (render_view_look_at builds them
+// with look_at and perspective) and a viewport in whatever target the
+// caller draws it into. multi_view_build culls every object against every
+// view and turns the result into draw commands:
+//
+//  - cull, over chunks of MULTI_VIEW_CHUNK objects in parallel. A chunk's
+//    bounds are tested against every view first. Views that miss it skip its
+//    objects, views that hold all of it take them without a test, and only
+//    views it straddles test objects one by one. Each object's bounds are
+//    read once and tested against all those views together, leaving a bit
+//    mask of the views that see it. Where frusta overlap, the chunk test, the
+//    memory traffic and the mask are shared
+//  - draw data, one DrawData per object seen by any view, written once and
+//    shared: the views' commands find it through base_instance
+//  - commands, one list per view, back to back in `commands`. Jobs split
+//    each view's chunks, and only visit the chunks its cull touched, so a view
+//    costs what it sees. Each job times itself, which gives the per view
+//    build times
+//
+// Both the draw data and each view's commands come out in object order,
+// whatever the worker count. The GL side (render/multi_view_gl.h) uploads
+// them together and draws a view's slice with draw_batch_gl_draw_range.
+//
+
+#ifndef FPS_STYLE_ROOM_MULTI_VIEW_H
+#define FPS_STYLE_ROOM_MULTI_VIEW_H
+
+#include <stdint.h>
+#include <vector>
+#include <culling/frustum.h>
+#include <render/draw_batch.h>
+
+#define MULTI_VIEW_MAX 32
+// objects per cull chunk. small enough that a chunk's bounds stay tight when
+// objects are stored roughly in space order, a room's props or so
+#define MULTI_VIEW_CHUNK 64
+
+struct RenderView {
+    mat4 view;
+    mat4 proj;
+    int viewport[4];             // x, y, width, height
+};
+
+struct ViewStats {
+    unsigned int visible;
+    unsigned int triangles;
+    unsigned int chunks;         // chunks inside or crossing the frustum
+    unsigned int tests;          // object tests in crossing chunks
+    double build_ms;             // its command jobs, summed
+    double gpu_ms;               // for the caller to fill in
+};
+
+struct MultiViewStats {
+    int views;
+    unsigned int objects;
+    unsigned int shared_draws;   // objects seen by at least one view
+    unsigned int commands;       // over every view
+    unsigned long long tests;    // chunk and object tests
+    unsigned long long naive_tests; // objects x views, testing each view alone
+    double cull_ms;
+    double data_ms;
+    double commands_ms;
+    double ms;                   // the whole build
+};
+
+struct MultiView {
+    int count;
+    RenderView views[MULTI_VIEW_MAX];
+    Frustum frusta[MULTI_VIEW_MAX];
+
+    std::vector<uint32_t> masks;                       // per object
+    std::vector<DrawData> draws;                       // shared by every view
+    std::vector<DrawElementsIndirectCommand> commands; // view after view
+    unsigned int first[MULTI_VIEW_MAX];                // into commands
+    unsigned int counts[MULTI_VIEW_MAX];
+
+    // build scratch, per chunk
+    std::vector<unsigned int> draw_start;              // prefix sum of shared draws
+    std::vector<unsigned int> view_start;              // chunk x view prefix sums
+    std::vector<uint32_t> chunk_views;                 // views touching the chunk
+
+    ViewStats view_stats[MULTI_VIEW_MAX];
+    MultiViewStats stats;
+};
+
+/* look_at and perspective (fovy in degrees) in one */
+RenderView render_view_look_at (const vec3& eye, const vec3& target, const vec3& up, float fovy_deg, float aspect,
+                                float near_plane, float far_plane, int x, int y, int width, int height);
+
+void multi_view_init (MultiView* mv);
+/* drops every view */
+void multi_view_clear (MultiView* mv);
+/* the view's index, or -1 past MULTI_VIEW_MAX */
+int multi_view_add (MultiView* mv, const RenderView& view);
+/* culls count objects, meshes[mesh_of[i]] of batch at worlds[i] with world
+bounds[i], against every view and builds the shared draw data and each
+view's commands */
+void multi_view_build (MultiView* mv, const DrawBatch& batch, const unsigned int* mesh_of, const mat4* worlds,
+                       const Aabb* bounds, int count);
+
+#endif //FPS_STYLE_ROOM_MULTI_VIEW_H
@@ -0,0 +1,118 @@
+//
+// See multi_view_gl.h.
+//
+
+#include "multi_view_gl.h"
+#include <render/gpu_memory_gl.h>
+#include <stdio.h>
+#include <string.h>
+
+bool multi_view_gl_init (MultiViewGl* gl, int inset_width, int inset_height) {
+    memset (gl, 0, sizeof (*gl));
+    gl->inset_width = inset_width;
+    gl->inset_height = inset_height;
+    for (int v = 0; v < MULTI_VIEW_GL_TIMED; v++) {
+        glGenQueries (MULTI_VIEW_GL_QUERIES * 2, gl->queries[v]);
+        gl->gpu_ms[v] = -1.0f;
+    }
+
+    glGenRenderbuffers (1, &gl->colour);
+    glBindRenderbuffer (GL_RENDERBUFFER, gl->colour);
+    glRenderbufferStorage (GL_RENDERBUFFER, GL_RGBA8, inset_width, inset_height);
+    gpu_memory_image (GL_RENDERBUFFER, gl->colour, (size_t)inset_width * inset_height * 4, MEMORY_RENDER);
+    glGenRenderbuffers (1, &gl->depth);
+    glBindRenderbuffer (GL_RENDERBUFFER, gl->depth);
+    glRenderbufferStorage (GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, inset_width, inset_height);
+    gpu_memory_image (GL_RENDERBUFFER, gl->depth, (size_t)inset_width * inset_height * 4, MEMORY_RENDER);
+    glBindRenderbuffer (GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers (1, &gl->fbo);
+    glBindFramebuffer (GL_FRAMEBUFFER, gl->fbo);
+    glFramebufferRenderbuffer (GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, gl->colour);
+    glFramebufferRenderbuffer (GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, gl->depth);
+    bool complete = glCheckFramebufferStatus (GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    glBindFramebuffer (GL_FRAMEBUFFER, 0);
+    if (!complete) {
+        // the timers still work, only the insets are off
+        fprintf (stderr, "ERROR: multi view inset framebuffer is incomplete\n");
+        glDeleteFramebuffers (1, &gl->fbo);
+        GLuint renderbuffers[2] = {gl->colour, gl->depth};
+        gpu_memory_delete (GL_RENDERBUFFER, 2, renderbuffers);
+        gl->fbo = gl->colour = gl->depth = 0;
+        return false;
+    }
+    return true;
+}
+
+void multi_view_gl_upload (DrawBatchGl* batch_gl, const MultiView& mv) {
+    if (mv.commands.empty ()) {
+        return;
+    }
+    draw_batch_gl_upload_arrays (batch_gl, &mv.draws[0], mv.draws.size (), &mv.commands[0], mv.commands.size ());
+}
+
+void multi_view_gl_begin_view (MultiViewGl* gl, int view) {
+    if (view >= MULTI_VIEW_GL_TIMED) {
+        return;
+    }
+    if (gl->issued[view] - gl->read[view] == MULTI_VIEW_GL_QUERIES) {
+        // a whole ring behind, drop the oldest rather than wait for it
+        gl->read[view]++;
+    }
+    glQueryCounter (gl->queries[view][(gl->issued[view] % MULTI_VIEW_GL_QUERIES) * 2], GL_TIMESTAMP);
+}
+
+void multi_view_gl_end_view (MultiViewGl* gl, int view) {
+    if (view >= MULTI_VIEW_GL_TIMED) {
+        return;
+    }
+    glQueryCounter (gl->queries[view][(gl->issued[view] % MULTI_VIEW_GL_QUERIES) * 2 + 1], GL_TIMESTAMP);
+    gl->issued[view]++;
+}
+
+void multi_view_gl_read_times (MultiViewGl* gl, MultiView* mv) {
+    for (int v = 0; v < MULTI_VIEW_GL_TIMED; v++) {
+        while (gl->read[v] < gl->issued[v]) {
+            const GLuint* pair = &gl->queries[v][(gl->read[v] % MULTI_VIEW_GL_QUERIES) * 2];
+            GLint available = 0;
+            // the end stamp lands after the start
+            glGetQueryObjectiv (pair[1], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available) {
+                break;
+            }
+            GLuint64 start = 0, end = 0;
+            glGetQueryObjectui64v (pair[0], GL_QUERY_RESULT, &start);
+            glGetQueryObjectui64v (pair[1], GL_QUERY_RESULT, &end);
+            gl->gpu_ms[v] = (float)((double)(end - start) / 1.0e6);
+            gl->read[v]++;
+        }
+        if (v < mv->count) {
+            mv->view_stats[v].gpu_ms = gl->gpu_ms[v];
+        }
+    }
+}
+
+void multi_view_gl_bind_inset (MultiViewGl* gl) {
+    glBindFramebuffer (GL_FRAMEBUFFER, gl->fbo);
+    glViewport (0, 0, gl->inset_width, gl->inset_height);
+}
+
+void multi_view_gl_blit_inset (MultiViewGl* gl, int x, int y, int width, int height) {
+    glBindFramebuffer (GL_READ_FRAMEBUFFER, gl->fbo);
+    glBindFramebuffer (GL_DRAW_FRAMEBUFFER, 0);
+    glBlitFramebuffer (0, 0, gl->inset_width, gl->inset_height, x, y, x + width, y + height, GL_COLOR_BUFFER_BIT,
+                       GL_LINEAR);
+    glBindFramebuffer (GL_FRAMEBUFFER, 0);
+}
+
+void multi_view_gl_destroy (MultiViewGl* gl) {
+    for (int v = 0; v < MULTI_VIEW_GL_TIMED; v++) {
+        glDeleteQueries (MULTI_VIEW_GL_QUERIES * 2, gl->queries[v]);
+    }
+    if (gl->fbo) {
+        glDeleteFramebuffers (1, &gl->fbo);
+    }
+    GLuint renderbuffers[2] = {gl->colour, gl->depth};
+    gpu_memory_delete (GL_RENDERBUFFER, 2, renderbuffers);
+    memset (gl, 0, sizeof (*gl));
+}
@@ -0,0 +1,55 @@
+//
+// GL side of multi view rendering: the shared upload, a small offscreen
+// target for views drawn into a corner of the screen, and per view GPU
+// timings.
+//
+// multi_view_gl_upload sends a build's shared draw data and every view's
+// commands in one go, then each view is drawn with draw_batch_gl_draw_range
+// over its slice. Inset views (security cameras, mirrors) draw into the
+// inset target at its full size, so the light clusters and anything else
+// keyed on gl_FragCoord see a viewport at the origin, and are blitted to
+// their place on screen after.
+//
+// Views are timed with GL_TIMESTAMP pairs, which, unlike GL_TIME_ELAPSED,
+// can sit inside the dynamic resolution frame query. Each view has a ring of
+// pairs, read when the GPU has them without waiting.
+//
+
+#ifndef FPS_STYLE_ROOM_MULTI_VIEW_GL_H
+#define FPS_STYLE_ROOM_MULTI_VIEW_GL_H
+
+#include <GL/glew.h>
+#include <render/draw_batch_gl.h>
+#include <render/multi_view.h>
+
+#define MULTI_VIEW_GL_TIMED 8      // views with timers
+#define MULTI_VIEW_GL_QUERIES 4    // timestamp pairs per view
+
+struct MultiViewGl {
+    GLuint fbo;
+    GLuint colour;               // renderbuffers
+    GLuint depth;
+    int inset_width, inset_height;
+    GLuint queries[MULTI_VIEW_GL_TIMED][MULTI_VIEW_GL_QUERIES * 2];
+    unsigned int issued[MULTI_VIEW_GL_TIMED];
+    unsigned int read[MULTI_VIEW_GL_TIMED];
+    float gpu_ms[MULTI_VIEW_GL_TIMED]; // newest result, -1 before the first
+};
+
+/* false if the inset target can't be made. the timers work either way, and
+multi_view_gl_destroy is still due */
+bool multi_view_gl_init (MultiViewGl* gl, int inset_width, int inset_height);
+/* the last multi_view_build's draw data and commands */
+void multi_view_gl_upload (DrawBatchGl* batch_gl, const MultiView& mv);
+/* starts and stops view's GPU timer around its draws */
+void multi_view_gl_begin_view (MultiViewGl* gl, int view);
+void multi_view_gl_end_view (MultiViewGl* gl, int view);
+/* reads finished timers into gpu_ms and mv's view_stats */
+void multi_view_gl_read_times (MultiViewGl* gl, MultiView* mv);
+/* binds the inset target with a viewport over all of it */
+void multi_view_gl_bind_inset (MultiViewGl* gl);
+/* copies the inset target to x, y, width, height of the default framebuffer */
+void multi_view_gl_blit_inset (MultiViewGl* gl, int x, int y, int width, int height);
+void multi_view_gl_destroy (MultiViewGl* gl);
+
+#endif //FPS_STYLE_ROOM_MULTI_VIEW_GL_H
@@ -0,0 +1,289 @@
+//
+// SoA particle update, swap removal and the back to front radix sort. See
+// particles.h.
+//
+
+#include "particles.h"
+#include <memory/memory_tracker.h>
+#include <jobs/job_system.h>
+#include <chrono>
+#include <math.h>
+#include <string.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+static double ms_since (std::chrono::steady_clock::time_point t0) {
+    return std::chrono::duration<double, std::milli> (std::chrono::steady_clock::now () - t0).count ();
+}
+
+static float next_random (uint32_t* rng) {
+    *rng = *rng * 1664525u + 1013904223u;
+    return (float)(*rng >> 8) / 16777216.0f;
+}
+
+void particles_init (ParticleSystem* s) {
+    MemoryScope scope (MEMORY_PARTICLES);
+    s->emitters.clear ();
+    s->dead.clear ();
+    memset (&s->stats, 0, sizeof (s->stats));
+}
+
+int particles_add_emitter (ParticleSystem* s, const ParticleEmitterParams& params, int capacity, uint32_t seed) {
+    MemoryScope scope (MEMORY_PARTICLES);
+    s->emitters.push_back (ParticleEmitter ());
+    ParticleEmitter& e = s->emitters.back ();
+    e.params = params;
+    e.count = 0;
+    e.capacity = capacity;
+    int padded = (capacity + 3) & ~3;
+    for (int a = 0; a < 3; a++) {
+        e.pos[a].assign (padded, 0.0f);
+        e.vel[a].assign (padded, 0.0f);
+    }
+    e.age.assign (padded, 0.0f);
+    e.age_rate.assign (padded, 0.0f);
+    e.order.assign (capacity, 0);
+    e.keys.assign (capacity, 0);
+    e.swap.assign (capacity, 0);
+    e.spawn_debt = 0.0f;
+    e.rng = seed;
+    return (int)s->emitters.size () - 1;
+}
+
+static void spawn (ParticleEmitter* e, int n, ParticleStats* stats) {
+    int room = e->capacity - e->count;
+    if (n > room) {
+        stats->dropped += n - room;
+        n = room;
+    }
+    const ParticleEmitterParams& p = e->params;
+    for (int k = 0; k < n; k++) {
+        int i = e->count++;
+        for (int a = 0; a < 3; a++) {
+            e->pos[a][i] = p.position.v[a] + (next_random (&e->rng) * 2.0f - 1.0f) * p.spread;
+            e->vel[a][i] = p.velocity.v[a] + (next_random (&e->rng) * 2.0f - 1.0f) * p.velocity_jitter;
+        }
+        e->age[i] = 0.0f;
+        e->age_rate[i] = 1.0f / (p.life * (0.5f + 0.5f * next_random (&e->rng)));
+    }
+    stats->spawned += n;
+}
+
+void particles_burst (ParticleSystem* s, int emitter, int count) {
+    spawn (&s->emitters[emitter], count, &s->stats);
+}
+
+/* moves and ages [begin, end), noting the dead. begin is a multiple of 4 and
+the arrays are padded, so the last group of four may run past end */
+static void integrate (ParticleEmitter* e, int begin, int end, float dt, float damp, std::vector<uint32_t>* dead) {
+    const vec3& g = e->params.gravity;
+    int i = begin;
+#if defined(__SSE2__)
+    const __m128 fdt = _mm_set1_ps (dt);
+    const __m128 fdamp = _mm_set1_ps (damp);
+    const __m128 one = _mm_set1_ps (1.0f);
+    __m128 gdt[3];
+    for (int a = 0; a < 3; a++) {
+        gdt[a] = _mm_set1_ps (g.v[a] * dt);
+    }
+    for (; i < end; i += 4) {
+        for (int a = 0; a < 3; a++) {
+            __m128 v = _mm_mul_ps (_mm_add_ps (_mm_loadu_ps (&e->vel[a][i]), gdt[a]), fdamp);
+            _mm_storeu_ps (&e->vel[a][i], v);
+            _mm_storeu_ps (&e->pos[a][i], _mm_add_ps (_mm_loadu_ps (&e->pos[a][i]), _mm_mul_ps (v, fdt)));
+        }
+        __m128 age = _mm_add_ps (_mm_loadu_ps (&e->age[i]), _mm_mul_ps (_mm_loadu_ps (&e->age_rate[i]), fdt));
+        _mm_storeu_ps (&e->age[i], age);
+        int mask = _mm_movemask_ps (_mm_cmpge_ps (age, one));
+        for (int lane = 0; mask && i + lane < end; lane++, mask >>= 1) {
+            if (mask & 1) {
+                dead->push_back ((uint32_t)(i + lane));
+            }
+        }
+    }
+#endif
+    for (; i < end; i++) {
+        for (int a = 0; a < 3; a++) {
+            e->vel[a][i] = (e->vel[a][i] + g.v[a] * dt) * damp;
+            e->pos[a][i] += e->vel[a][i] * dt;
+        }
+        e->age[i] += e->age_rate[i] * dt;
+        if (e->age[i] >= 1.0f) {
+            dead->push_back ((uint32_t)i);
+        }
+    }
+}
+
+/* the last particle into i's place */
+static void swap_remove (ParticleEmitter* e, int i) {
+    int last = --e->count;
+    if (i == last) {
+        return;
+    }
+    for (int a = 0; a < 3; a++) {
+        e->pos[a][i] = e->pos[a][last];
+        e->vel[a][i] = e->vel[a][last];
+    }
+    e->age[i] = e->age[last];
+    e->age_rate[i] = e->age_rate[last];
+}
+
+void particles_update (ParticleSystem* s, float dt) {
+    MemoryScope scope (MEMORY_PARTICLES);
+    auto t0 = std::chrono::steady_clock::now ();
+    s->stats.spawned = 0;
+    s->stats.killed = 0;
+    s->stats.dropped = 0;
+    for (size_t k = 0; k < s->emitters.size (); k++) {
+        ParticleEmitter* e = &s->emitters[k];
+        if (e->params.rate > 0.0f) {
+            e->spawn_debt += e->params.rate * dt;
+            int n = (int)e->spawn_debt;
+            e->spawn_debt -= (float)n;
+            spawn (e, n, &s->stats);
+        }
+        if (!e->count) {
+            continue;
+        }
+        int count = e->count;
+        int chunks = (count + PARTICLE_CHUNK - 1) / PARTICLE_CHUNK;
+        if ((int)s->dead.size () < chunks) {
+            s->dead.resize (chunks);
+        }
+        float damp = 1.0f - e->params.drag * dt;
+        damp = damp < 0.0f ? 0.0f : damp;
+        parallel_for_each (chunks, 1, [&] (int begin, int end) {
+            for (int c = begin; c < end; c++) {
+                int last = (c + 1) * PARTICLE_CHUNK;
+                s->dead[c].clear ();
+                integrate (e, c * PARTICLE_CHUNK, last < count ? last : count, dt, damp, &s->dead[c]);
+            }
+        });
+        // highest index first: everything above the one being removed is
+        // already alive, so the particle moved into the hole always is
+        for (int c = chunks - 1; c >= 0; c--) {
+            const std::vector<uint32_t>& dead = s->dead[c];
+            for (int d = (int)dead.size () - 1; d >= 0; d--) {
+                swap_remove (e, (int)dead[d]);
+            }
+            s->stats.killed += (unsigned int)dead.size ();
+        }
+    }
+    s->stats.alive = particles_alive (*s);
+    s->stats.update_ms = ms_since (t0);
+}
+
+/*-----------------------------------SORTING----------------------------------*/
+/* distance from eye of particles [i, i + 4) */
+#if defined(__SSE2__)
+static inline __m128 distance4 (const ParticleEmitter& e, int i, const __m128* eye) {
+    __m128 dx = _mm_sub_ps (_mm_loadu_ps (&e.pos[0][i]), eye[0]);
+    __m128 dy = _mm_sub_ps (_mm_loadu_ps (&e.pos[1][i]), eye[1]);
+    __m128 dz = _mm_sub_ps (_mm_loadu_ps (&e.pos[2][i]), eye[2]);
+    return _mm_sqrt_ps (_mm_add_ps (_mm_add_ps (_mm_mul_ps (dx, dx), _mm_mul_ps (dy, dy)), _mm_mul_ps (dz, dz)));
+}
+#endif
+
+static inline float distance1 (const ParticleEmitter& e, int i, const vec3& eye) {
+    float dx = e.pos[0][i] - eye.v[0], dy = e.pos[1][i] - eye.v[1], dz = e.pos[2][i] - eye.v[2];
+    return sqrtf (dx * dx + dy * dy + dz * dz);
+}
+
+/* 16 bit keys, farthest 0, so an ascending sort is back to front */
+static void make_keys (ParticleEmitter* e, const vec3& eye) {
+    int n = e->count;
+    float far = 0.0f;
+    int i = 0;
+#if defined(__SSE2__)
+    __m128 eye4[3] = {_mm_set1_ps (eye.v[0]), _mm_set1_ps (eye.v[1]), _mm_set1_ps (eye.v[2])};
+    __m128 far4 = _mm_setzero_ps ();
+    for (; i + 4 <= n; i += 4) {
+        far4 = _mm_max_ps (far4, distance4 (*e, i, eye4));
+    }
+    float lanes[4];
+    _mm_storeu_ps (lanes, far4);
+    far = fmaxf (fmaxf (lanes[0], lanes[1]), fmaxf (lanes[2], lanes[3]));
+#endif
+    for (; i < n; i++) {
+        far = fmaxf (far, distance1 (*e, i, eye));
+    }
+    float scale = far > 0.0f ? 65535.0f / far : 0.0f;
+    i = 0;
+#if defined(__SSE2__)
+    const __m128 scale4 = _mm_set1_ps (scale);
+    const __m128i top = _mm_set1_epi32 (65535);
+    for (; i + 4 <= n; i += 4) {
+        __m128i q = _mm_sub_epi32 (top, _mm_cvttps_epi32 (_mm_mul_ps (distance4 (*e, i, eye4), scale4)));
+        int k[4];
+        _mm_storeu_si128 ((__m128i*)k, q);
+        for (int lane = 0; lane < 4; lane++) {
+            e->keys[i + lane] = (uint16_t)k[lane];
+        }
+    }
+#endif
+    for (; i < n; i++) {
+        e->keys[i] = (uint16_t)(65535 - (int)(distance1 (*e, i, eye) * scale));
+    }
+}
+
+/* LSD radix sort of the indices by key, low byte then high byte */
+static void radix_sort (ParticleEmitter* e) {
+    int n = e->count;
+    unsigned int low[256] = {0}, high[256] = {0};
+    for (int i = 0; i < n; i++) {
+        low[e->keys[i] & 255]++;
+        high[e->keys[i] >> 8]++;
+    }
+    unsigned int sum_low = 0, sum_high = 0;
+    for (int b = 0; b < 256; b++) {
+        unsigned int l = low[b], h = high[b];
+        low[b] = sum_low;
+        high[b] = sum_high;
+        sum_low += l;
+        sum_high += h;
+    }
+    for (int i = 0; i < n; i++) {
+        e->swap[low[e->keys[i] & 255]++] = (uint32_t)i;
+    }
+    for (int i = 0; i < n; i++) {
+        uint32_t index = e->swap[i];
+        e->order[high[e->keys[index] >> 8]++] = index;
+    }
+}
+
+void particles_sort (ParticleSystem* s, const vec3& eye) {
+    MemoryScope scope (MEMORY_PARTICLES);
+    auto t0 = std::chrono::steady_clock::now ();
+    parallel_for_each ((int)s->emitters.size (), 1, [&] (int begin, int end) {
+        for (int k = begin; k < end; k++) {
+            ParticleEmitter* e = &s->emitters[k];
+            if (e->params.additive || !e->count) {
+                continue;
+            }
+            make_keys (e, eye);
+            radix_sort (e);
+        }
+    });
+    s->stats.sort_ms = ms_since (t0);
+}
+
+void particles_write_instances (const ParticleEmitter& e, ParticleInstance* out) {
+    MemoryScope scope (MEMORY_PARTICLES);
+    bool sorted = !e.params.additive;
+    for (int i = 0; i < e.count; i++) {
+        int k = sorted ? (int)e.order[i] : i;
+        out[i].position[0] = e.pos[0][k];
+        out[i].position[1] = e.pos[1][k];
+        out[i].position[2] = e.pos[2][k];
+        out[i].age = e.age[k];
+    }
+}
+
+unsigned int particles_alive (const ParticleSystem& s) {
+    unsigned int n = 0;
+    for (size_t k = 0; k < s.emitters.size (); k++) {
+        n += (unsigned int)s.emitters[k].count;
+    }
+    return n;
+}
@@ -0,0 +1,99 @@
+//
+// Particles: muzzle flashes, dust, sparks.
+//
+// Each emitter owns its particles as structure of arrays, one float array
+// per position and velocity component plus age, so the update streams
+// through memory and runs four particles at a time with SSE:
+//  - integrate: gravity, drag, position
+//  - age, kept as a fraction of the particle's life so the shader can fade
+//    it without knowing the life. A particle past 1 is dead
+// The update runs over chunks of PARTICLE_CHUNK particles on the job
+// system. Each chunk only notes its dead, and afterwards they are swap
+// removed, highest index first: the last particle moves into the hole, so
+// the arrays stay dense with no second pass over the live ones.
+//
+// Alpha blended emitters are drawn back to front. particles_sort keys each
+// particle on its distance from the camera, quantized to 16 bits over the
+// emitter's own depth range, and radix sorts the indices in two 8 bit
+// passes. Additive emitters (sparks, flashes) look the same in any order and
+// are not sorted.
+//
+// particles_write_instances gathers an emitter's particles in draw order as
+// ParticleInstance, which render/particles_gl.h writes straight into a
+// streaming instance buffer and draws with one instanced draw per emitter.
+//
+
+#ifndef FPS_STYLE_ROOM_PARTICLES_H
+#define FPS_STYLE_ROOM_PARTICLES_H
+
+#include <stdint.h>
+#include <vector>
+#include <utils/maths_funcs.h>
+
+#define PARTICLE_CHUNK 16384
+
+struct ParticleEmitterParams {
+    vec3 position;
+    float spread;                // spawns within this of position, per axis
+    vec3 velocity;               // at spawn, on average
+    float velocity_jitter;       // plus or minus this, per axis
+    vec3 gravity;
+    float drag;                  // share of velocity lost a second
+    float rate;                  // spawned a second, 0 for bursts only
+    float life;                  // seconds, each particle between half and all of it
+    float size;                  // half width of the quad, world units
+    float colour[4];
+    bool additive;               // blended additively, drawn unsorted
+};
+
+struct ParticleEmitter {
+    ParticleEmitterParams params;
+    int count;
+    int capacity;
+    std::vector<float> pos[3];   // capacity rounded up to 4
+    std::vector<float> vel[3];
+    std::vector<float> age;      // 0 at spawn, dead at 1
+    std::vector<float> age_rate; // 1 / life
+    std::vector<uint32_t> order; // draw order after particles_sort, back to front
+    std::vector<uint16_t> keys;  // sort scratch
+    std::vector<uint32_t> swap;
+    float spawn_debt;            // particles owed by rate
+    uint32_t rng;
+};
+
+/* the layout of the instance buffer */
+struct ParticleInstance {
+    float position[3];
+    float age;
+};
+
+struct ParticleStats {
+    unsigned int alive;
+    unsigned int spawned;        // in the last update
+    unsigned int killed;
+    unsigned int dropped;        // emitters full
+    double update_ms;
+    double sort_ms;
+};
+
+struct ParticleSystem {
+    std::vector<ParticleEmitter> emitters;
+    std::vector<std::vector<uint32_t> > dead; // per chunk, update scratch
+    ParticleStats stats;
+};
+
+void particles_init (ParticleSystem* s);
+/* returns the emitter's index */
+int particles_add_emitter (ParticleSystem* s, const ParticleEmitterParams& params, int capacity, uint32_t seed);
+/* spawns count particles now, as far as the emitter has room */
+void particles_burst (ParticleSystem* s, int emitter, int count);
+/* spawns by rate, then moves, ages and kills every particle */
+void particles_update (ParticleSystem* s, float dt);
+/* the draw order of every blended emitter, back to front from eye */
+void particles_sort (ParticleSystem* s, const vec3& eye);
+/* the emitter's particles in draw order, sorted by the last particles_sort
+if blended. out holds e.count */
+void particles_write_instances (const ParticleEmitter& e, ParticleInstance* out);
+unsigned int particles_alive (const ParticleSystem& s);
+
+#endif //FPS_STYLE_ROOM_PARTICLES_H
@@ -0,0 +1,180 @@
+//
+// See particles_gl.h.
+//
+
+#include "particles_gl.h"
+#include <render/gl_utils.h>
+#include <render/gpu_memory_gl.h>
+#include <render/view_ubo_gl.h>
+#include <stddef.h>
+#include <string.h>
+
+static const char* particle_vs_head =
+        "#version 430\n";
+
+static const char* particle_vs =
+        "layout (location = 0) in vec4 instance;\n" // position, age
+        "uniform float size;\n"
+        "out vec2 corner;\n"
+        "out float age;\n"
+        "void main () {\n"
+        "    corner = vec2 (gl_VertexID & 1, gl_VertexID >> 1) * 2.0 - 1.0;\n"
+        // the view matrix's rows are the camera axes in world space
+        "    vec3 right = vec3 (camera_view[0][0], camera_view[1][0], camera_view[2][0]);\n"
+        "    vec3 up = vec3 (camera_view[0][1], camera_view[1][1], camera_view[2][1]);\n"
+        "    float s = size * (0.5 + instance.w);\n"
+        "    vec3 p = instance.xyz + (right * corner.x + up * corner.y) * s;\n"
+        "    age = instance.w;\n"
+        "    gl_Position = camera_proj * camera_view * vec4 (p, 1.0);\n"
+        "}\n";
+
+static const char* particle_fs =
+        "#version 430\n"
+        "uniform vec4 colour;\n"
+        "uniform bool additive;\n"
+        "in vec2 corner;\n"
+        "in float age;\n"
+        "out vec4 fragment_colour;\n"
+        "void main () {\n"
+        "    float fade = (1.0 - age) * (1.0 - smoothstep (0.5, 1.0, length (corner)));\n"
+        "    if (additive) {\n"
+        "        fragment_colour = vec4 (colour.rgb * colour.a * fade, 1.0);\n"
+        "    } else {\n"
+        "        fragment_colour = vec4 (colour.rgb, colour.a * fade);\n"
+        "    }\n"
+        "}\n";
+
+bool particles_gl_init (ParticlesGl* gl, size_t capacity) {
+    memset (gl->fences, 0, sizeof (gl->fences));
+    gl->capacity = capacity;
+    gl->mapped = NULL;
+    gl->region = PARTICLES_GL_REGIONS - 1;
+    gl->drawn = 0;
+    gl->clipped = 0;
+    gl->vao = 0;
+    gl->buffer = 0;
+
+    const char* vs_sources[3] = {particle_vs_head, VIEW_UBO_GLSL, particle_vs};
+    GLuint vs = gl_compile_shader (GL_VERTEX_SHADER, vs_sources, 3);
+    GLuint fs = gl_compile_shader (GL_FRAGMENT_SHADER, &particle_fs, 1);
+    gl->program = gl_link_program (vs, fs);
+    if (!gl->program) {
+        return false;
+    }
+    gl->colour_location = glGetUniformLocation (gl->program, "colour");
+    gl->size_location = glGetUniformLocation (gl->program, "size");
+    gl->additive_location = glGetUniformLocation (gl->program, "additive");
+
+    GLsizeiptr bytes = (GLsizeiptr)(capacity * PARTICLES_GL_REGIONS * sizeof (ParticleInstance));
+    glGenVertexArrays (1, &gl->vao);
+    glGenBuffers (1, &gl->buffer);
+    glBindVertexArray (gl->vao);
+    glBindBuffer (GL_ARRAY_BUFFER, gl->buffer);
+    if (GLEW_ARB_buffer_storage) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        gpu_memory_buffer_storage (GL_ARRAY_BUFFER, gl->buffer, bytes, NULL, flags, MEMORY_PARTICLES);
+        gl->mapped = (unsigned char*)glMapBufferRange (GL_ARRAY_BUFFER, 0, bytes, flags);
+    } else {
+        gpu_memory_buffer_data (GL_ARRAY_BUFFER, gl->buffer, bytes, NULL, GL_STREAM_DRAW, MEMORY_PARTICLES);
+        gl->staging.resize (capacity);
+    }
+    glEnableVertexAttribArray (0);
+    glVertexAttribPointer (0, 4, GL_FLOAT, GL_FALSE, sizeof (ParticleInstance), NULL);
+    glVertexAttribDivisor (0, 1);
+    glBindVertexArray (0);
+    glBindBuffer (GL_ARRAY_BUFFER, 0);
+    return true;
+}
+
+void particles_gl_draw (ParticlesGl* gl, const ParticleSystem& s) {
+    gl->region = (gl->region + 1) % PARTICLES_GL_REGIONS;
+    GLsync& fence = gl->fences[gl->region];
+    if (fence) {
+        // three frames back, so this returns at once unless the GPU is that
+        // far behind
+        glClientWaitSync (fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+        glDeleteSync (fence);
+        fence = 0;
+    }
+
+    // every emitter's instances back to back, as many as fit
+    size_t region_first = (size_t)gl->region * gl->capacity;
+    ParticleInstance* out = gl->mapped ? (ParticleInstance*)gl->mapped + region_first : gl->staging.data ();
+    std::vector<size_t> first (s.emitters.size ()), count (s.emitters.size ());
+    size_t used = 0;
+    gl->clipped = 0;
+    for (size_t k = 0; k < s.emitters.size (); k++) {
+        const ParticleEmitter& e = s.emitters[k];
+        size_t n = (size_t)e.count;
+        if (used + n > gl->capacity) {
+            gl->clipped += (unsigned int)(n - (gl->capacity - used));
+            n = gl->capacity - used;
+        }
+        first[k] = used;
+        count[k] = n;
+        if (n == (size_t)e.count) {
+            particles_write_instances (e, out + used);
+        } else if (n) {
+            // a partial emitter still goes back to front, just without its
+            // nearest particles
+            std::vector<ParticleInstance> all (e.count);
+            particles_write_instances (e, all.data ());
+            memcpy (out + used, all.data (), n * sizeof (ParticleInstance));
+        }
+        used += n;
+    }
+    gl->drawn = (unsigned int)used;
+    if (!gl->mapped && used) {
+        glBindBuffer (GL_ARRAY_BUFFER, gl->buffer);
+        glBufferSubData (GL_ARRAY_BUFFER, (GLintptr)(region_first * sizeof (ParticleInstance)),
+                         (GLsizeiptr)(used * sizeof (ParticleInstance)), gl->staging.data ());
+        glBindBuffer (GL_ARRAY_BUFFER, 0);
+    }
+
+    GLboolean blend = glIsEnabled (GL_BLEND);
+    glEnable (GL_BLEND);
+    glDepthMask (GL_FALSE);
+    glUseProgram (gl->program);
+    glBindVertexArray (gl->vao);
+    for (size_t k = 0; k < s.emitters.size (); k++) {
+        if (!count[k]) {
+            continue;
+        }
+        const ParticleEmitterParams& p = s.emitters[k].params;
+        if (p.additive) {
+            glBlendFunc (GL_ONE, GL_ONE);
+        } else {
+            glBlendFunc (GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        }
+        glUniform4fv (gl->colour_location, 1, p.colour);
+        glUniform1f (gl->size_location, p.size);
+        glUniform1i (gl->additive_location, p.additive);
+        glDrawArraysInstancedBaseInstance (GL_TRIANGLE_STRIP, 0, 4, (GLsizei)count[k],
+                                           (GLuint)(region_first + first[k]));
+    }
+    glBindVertexArray (0);
+    glDepthMask (GL_TRUE);
+    if (!blend) {
+        glDisable (GL_BLEND);
+    }
+    fence = glFenceSync (GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void particles_gl_destroy (ParticlesGl* gl) {
+    for (int i = 0; i < PARTICLES_GL_REGIONS; i++) {
+        if (gl->fences[i]) {
+            glDeleteSync (gl->fences[i]);
+        }
+    }
+    if (gl->mapped) {
+        glBindBuffer (GL_ARRAY_BUFFER, gl->buffer);
+        glUnmapBuffer (GL_ARRAY_BUFFER);
+        glBindBuffer (GL_ARRAY_BUFFER, 0);
+    }
+    gpu_memory_delete (GL_BUFFER, 1, &gl->buffer);
+    glDeleteVertexArrays (1, &gl->vao);
+    glDeleteProgram (gl->program);
+    gl->mapped = NULL;
+    gl->staging.clear ();
+    memset (gl->fences, 0, sizeof (gl->fences));
+}
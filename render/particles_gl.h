@@ -0,0 +1,55 @@
+//
+// GL side of the particles: a streaming instance buffer and one instanced
+// draw per emitter.
+//
+// Every particle is a camera facing quad, four vertices of a strip made up
+// in the vertex shader from gl_VertexID, placed by one ParticleInstance
+// (render/particles.h). The buffer is split into PARTICLES_GL_REGIONS
+// regions of `capacity` instances and each frame writes the next one, all
+// emitters back to back, so the CPU never touches instances the GPU may
+// still be drawing. A region is fenced after its draws and waited on before
+// it is written again. With ARB_buffer_storage the regions are mapped once,
+// persistent and coherent, and particles_write_instances gathers straight
+// into them. Without it the instances go through a CPU copy and
+// glBufferSubData.
+//
+// Emitters are drawn in the order they were added, depth tested but not
+// writing depth. Add the additive ones last, so they brighten the blended
+// particles behind them.
+//
+// The camera comes from the view UBO (render/view_ubo_gl.h), so the caller
+// writes it first.
+//
+
+#ifndef FPS_STYLE_ROOM_PARTICLES_GL_H
+#define FPS_STYLE_ROOM_PARTICLES_GL_H
+
+#include <GL/glew.h>
+#include <vector>
+#include <render/particles.h>
+
+#define PARTICLES_GL_REGIONS 3
+
+struct ParticlesGl {
+    GLuint vao;
+    GLuint buffer;
+    GLuint program;
+    GLint colour_location;
+    GLint size_location;
+    GLint additive_location;
+    size_t capacity;             // instances a region
+    unsigned char* mapped;       // NULL without buffer storage
+    std::vector<ParticleInstance> staging; // without buffer storage
+    GLsync fences[PARTICLES_GL_REGIONS];
+    int region;                  // the region last written
+    unsigned int drawn;          // instances in the last draw
+    unsigned int clipped;        // over capacity in the last draw, not drawn
+};
+
+/* a region holds capacity instances. false if the shaders don't build */
+bool particles_gl_init (ParticlesGl* gl, size_t capacity);
+/* writes every emitter into the next region and draws them */
+void particles_gl_draw (ParticlesGl* gl, const ParticleSystem& s);
+void particles_gl_destroy (ParticlesGl* gl);
+
+#endif //FPS_STYLE_ROOM_PARTICLES_GL_H
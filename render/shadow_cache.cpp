@@ -0,0 +1,304 @@
+//
+// Atlas allocator and per frame shadow planning. See shadow_cache.h.
+//
+
+#include "shadow_cache.h"
+#include <memory/memory_tracker.h>
+#include <culling/frustum.h>
+#include <algorithm>
+#include <chrono>
+#include <string.h>
+
+enum {
+    NODE_FREE,
+    NODE_SPLIT,
+    NODE_USED
+};
+
+/*-----------------------------------ATLAS------------------------------------*/
+void shadow_atlas_init (ShadowAtlas* atlas, int size) {
+    MemoryScope scope (MEMORY_RENDER);
+    atlas->size = size;
+    atlas->levels = 1;
+    while ((size >> atlas->levels) >= SHADOW_MIN_TILE) {
+        atlas->levels++;
+    }
+    atlas->level_offset.resize (atlas->levels + 1);
+    int offset = 0;
+    for (int l = 0; l <= atlas->levels; l++) {
+        atlas->level_offset[l] = offset;
+        offset += 1 << (2 * l);
+    }
+    atlas->state.assign (atlas->level_offset[atlas->levels], NODE_FREE);
+}
+
+static inline int node_index (const ShadowAtlas* atlas, int level, int x, int y) {
+    return atlas->level_offset[level] + y * (1 << level) + x;
+}
+
+/* depth first: the first free tile of the target level, splitting free
+tiles on the way down */
+static int alloc_at (ShadowAtlas* atlas, int level, int x, int y, int target) {
+    int node = node_index (atlas, level, x, y);
+    unsigned char& s = atlas->state[node];
+    if (level == target) {
+        if (s != NODE_FREE) {
+            return -1;
+        }
+        s = NODE_USED;
+        return node;
+    }
+    if (s == NODE_USED) {
+        return -1;
+    }
+    if (s == NODE_FREE) {
+        s = NODE_SPLIT;
+    }
+    for (int c = 0; c < 4; c++) {
+        int found = alloc_at (atlas, level + 1, x * 2 + (c & 1), y * 2 + (c >> 1), target);
+        if (found >= 0) {
+            return found;
+        }
+    }
+    // nothing below fits. if every child is still free, undo the split
+    bool all_free = true;
+    for (int c = 0; c < 4; c++) {
+        all_free &= atlas->state[node_index (atlas, level + 1, x * 2 + (c & 1), y * 2 + (c >> 1))] == NODE_FREE;
+    }
+    if (all_free) {
+        s = NODE_FREE;
+    }
+    return -1;
+}
+
+static void node_position (const ShadowAtlas* atlas, int node, int* level, int* x, int* y) {
+    int l = 0;
+    while (l + 1 <= atlas->levels && atlas->level_offset[l + 1] <= node) {
+        l++;
+    }
+    int i = node - atlas->level_offset[l];
+    *level = l;
+    *x = i % (1 << l);
+    *y = i / (1 << l);
+}
+
+int shadow_atlas_alloc (ShadowAtlas* atlas, int size, int* x, int* y) {
+    MemoryScope scope (MEMORY_RENDER);
+    int level = 0;
+    while (level < atlas->levels - 1 && (atlas->size >> (level + 1)) >= size) {
+        level++;
+    }
+    int node = alloc_at (atlas, 0, 0, 0, level);
+    if (node >= 0) {
+        int l, nx, ny;
+        node_position (atlas, node, &l, &nx, &ny);
+        int tile = atlas->size >> l;
+        *x = nx * tile;
+        *y = ny * tile;
+    }
+    return node;
+}
+
+void shadow_atlas_free (ShadowAtlas* atlas, int node) {
+    int level, x, y;
+    node_position (atlas, node, &level, &x, &y);
+    atlas->state[node] = NODE_FREE;
+    // merge upwards while all four quarters are free
+    while (level > 0) {
+        int px = x / 2, py = y / 2;
+        for (int c = 0; c < 4; c++) {
+            if (atlas->state[node_index (atlas, level, px * 2 + (c & 1), py * 2 + (c >> 1))] != NODE_FREE) {
+                return;
+            }
+        }
+        level--;
+        x = px;
+        y = py;
+        atlas->state[node_index (atlas, level, x, y)] = NODE_FREE;
+    }
+}
+
+/*-----------------------------------CACHE------------------------------------*/
+void shadow_cache_init (ShadowCache* cache, int atlas_size) {
+    MemoryScope scope (MEMORY_RENDER);
+    shadow_atlas_init (&cache->atlas, atlas_size);
+    cache->lights.clear ();
+    cache->light_views.clear ();
+    cache->views.clear ();
+    cache->passes.clear ();
+    cache->shift = 0;
+    memset (&cache->stats, 0, sizeof (cache->stats));
+}
+
+static bool same_vec3 (const vec3& a, const vec3& b) {
+    return a.v[0] == b.v[0] && a.v[1] == b.v[1] && a.v[2] == b.v[2];
+}
+
+static bool same_light (const ShadowLight& a, const ShadowLight& b) {
+    return a.type == b.type && same_vec3 (a.position, b.position) && a.radius == b.radius &&
+           a.resolution == b.resolution &&
+           (a.type != SHADOW_SPOT || (same_vec3 (a.direction, b.direction) && a.angle_deg == b.angle_deg));
+}
+
+static void release_views (ShadowCache* cache, int light) {
+    for (int f = 0; f < SHADOW_FACES; f++) {
+        ShadowView& v = cache->views[light * SHADOW_FACES + f];
+        if (v.node >= 0) {
+            shadow_atlas_free (&cache->atlas, v.node);
+        }
+        v.node = -1;
+        v.size = 0;
+        v.static_valid = false;
+        v.composited = false;
+    }
+    cache->light_views[light] = 0;
+}
+
+/* view and projection of every face, and atlas tiles for them */
+static void setup_views (ShadowCache* cache, int light, const ShadowLight& l, int resolution) {
+    static const vec3 axis[6] = {vec3 (1, 0, 0), vec3 (-1, 0, 0), vec3 (0, 1, 0),
+                                 vec3 (0, -1, 0), vec3 (0, 0, 1), vec3 (0, 0, -1)};
+    static const vec3 up[6] = {vec3 (0, -1, 0), vec3 (0, -1, 0), vec3 (0, 0, 1),
+                               vec3 (0, 0, -1), vec3 (0, -1, 0), vec3 (0, -1, 0)};
+    int faces = l.type == SHADOW_POINT ? 6 : 1;
+    cache->light_views[light] = faces;
+    // whole light or nothing: halve the tile until every face fits
+    for (int size = resolution; size >= SHADOW_MIN_TILE; size /= 2) {
+        int f = 0;
+        for (; f < faces; f++) {
+            ShadowView& v = cache->views[light * SHADOW_FACES + f];
+            v.node = shadow_atlas_alloc (&cache->atlas, size, &v.x, &v.y);
+            if (v.node < 0) {
+                break;
+            }
+            v.size = size;
+        }
+        if (f == faces) {
+            break;
+        }
+        for (int k = 0; k < f; k++) {
+            ShadowView& v = cache->views[light * SHADOW_FACES + k];
+            shadow_atlas_free (&cache->atlas, v.node);
+            v.node = -1;
+            v.size = 0;
+        }
+    }
+    for (int f = 0; f < faces; f++) {
+        ShadowView& v = cache->views[light * SHADOW_FACES + f];
+        if (l.type == SHADOW_POINT) {
+            v.view = look_at (l.position, l.position + axis[f], up[f]);
+            v.proj = perspective (90.0f, 1.0f, SHADOW_NEAR, l.radius);
+        } else {
+            vec3 d = normalise (l.direction);
+            vec3 u = fabsf (d.v[1]) > 0.99f ? vec3 (1.0f, 0.0f, 0.0f) : vec3 (0.0f, 1.0f, 0.0f);
+            v.view = look_at (l.position, l.position + d, u);
+            v.proj = perspective (l.angle_deg, 1.0f, SHADOW_NEAR, l.radius);
+        }
+        v.view_proj = v.proj * v.view;
+        v.static_valid = false;
+        v.composited = false;
+    }
+}
+
+void shadow_cache_invalidate_static (ShadowCache* cache, const Aabb& bounds) {
+    for (size_t i = 0; i < cache->views.size (); i++) {
+        ShadowView& v = cache->views[i];
+        if (v.size > 0 && v.static_valid && frustum_test_aabb (frustum_from_matrix (v.view_proj), bounds)) {
+            v.static_valid = false;
+        }
+    }
+}
+
+void shadow_cache_update (ShadowCache* cache, const ShadowLight* lights, int count, const Aabb* dynamic_bounds,
+                          int dynamic_count) {
+    MemoryScope scope (MEMORY_RENDER);
+    auto t0 = std::chrono::steady_clock::now ();
+    ShadowCacheStats& st = cache->stats;
+
+    // lights that went away give their tiles back first, so new ones can use them
+    int old_count = (int)cache->lights.size ();
+    for (int i = count; i < old_count; i++) {
+        release_views (cache, i);
+    }
+    cache->lights.resize (count);
+    cache->light_views.resize (count, 0);
+    ShadowView empty;
+    memset (&empty, 0, sizeof (empty));
+    empty.node = -1;
+    cache->views.resize ((size_t)count * SHADOW_FACES, empty);
+
+    // halve everyone until the total fits. when that changes, all the
+    // lights are placed again
+    double area = 0.0, atlas_area = (double)cache->atlas.size * cache->atlas.size;
+    for (int i = 0; i < count; i++) {
+        area += (lights[i].type == SHADOW_POINT ? 6.0 : 1.0) * lights[i].resolution * lights[i].resolution;
+    }
+    int shift = 0;
+    while (area > atlas_area && (1 << shift) < cache->atlas.size) {
+        area *= 0.25;
+        shift++;
+    }
+    bool replace_all = shift != cache->shift;
+    cache->shift = shift;
+
+    std::vector<int> changed;
+    for (int i = 0; i < count; i++) {
+        // unchanged and holding tiles: keep everything. a light that got no
+        // tile last time tries again
+        if (!replace_all && i < old_count && cache->views[i * SHADOW_FACES].size > 0 &&
+            same_light (cache->lights[i], lights[i])) {
+            continue;
+        }
+        if (i < old_count) {
+            release_views (cache, i);
+        }
+        cache->lights[i] = lights[i];
+        changed.push_back (i);
+    }
+    // largest tiles first, so small ones fill the gaps
+    std::stable_sort (changed.begin (), changed.end (),
+                      [&] (int a, int b) { return lights[a].resolution > lights[b].resolution; });
+    for (size_t k = 0; k < changed.size (); k++) {
+        int i = changed[k];
+        setup_views (cache, i, lights[i], std::max (lights[i].resolution >> shift, SHADOW_MIN_TILE));
+    }
+
+    cache->passes.clear ();
+    st.lights = (unsigned int)count;
+    st.views = st.static_rendered = st.dynamic_rendered = st.copies = st.cached = st.atlas_used = st.downsized = 0;
+    for (int i = 0; i < count; i++) {
+        st.downsized += cache->views[i * SHADOW_FACES].size < lights[i].resolution;
+        for (int f = 0; f < cache->light_views[i]; f++) {
+            int index = i * SHADOW_FACES + f;
+            ShadowView& v = cache->views[index];
+            if (v.size == 0) {
+                continue;
+            }
+            st.views++;
+            st.atlas_used += (unsigned int)(v.size * v.size);
+            Frustum frustum = frustum_from_matrix (v.view_proj);
+            bool dynamic = false;
+            for (int k = 0; k < dynamic_count && !dynamic; k++) {
+                dynamic = frustum_test_aabb (frustum, dynamic_bounds[k]);
+            }
+            ShadowPass pass;
+            pass.view = index;
+            pass.render_static = !v.static_valid;
+            // the composite needs refreshing if the static part changed, if
+            // dynamic casters are drawn this frame, or to wipe last frame's
+            pass.copy = pass.render_static || dynamic || v.composited;
+            pass.render_dynamic = dynamic;
+            v.static_valid = true;
+            v.composited = dynamic;
+            if (!pass.copy) {
+                st.cached++;
+                continue;
+            }
+            st.static_rendered += pass.render_static;
+            st.dynamic_rendered += pass.render_dynamic;
+            st.copies++;
+            cache->passes.push_back (pass);
+        }
+    }
+    st.ms = std::chrono::duration<double, std::milli> (std::chrono::steady_clock::now () - t0).count ();
+}
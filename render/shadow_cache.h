@@ -0,0 +1,131 @@
+//
+// Cached shadow maps for spot and point lights.
+//
+// Every shadow view lives in a tile of one square depth atlas. A spot light
+// has one view, a point light has six (a cube, one face per axis direction).
+// Tiles come from a quadtree allocator: power of two sizes, split on demand
+// and merged back when all four quarters are free. When all the lights ask
+// for more than the atlas holds, every light's tile is halved until they fit
+// (cache->shift), and they are placed largest first. If a light still finds
+// no room it halves its own tile further rather than going without.
+//
+// There are two atlases of the same layout:
+//  - static: shadows of static geometry. A view is re-rendered only when
+//    its light changes, it gets a new tile, or static geometry inside its
+//    frustum changes (shadow_cache_invalidate_static).
+//  - composite: what lighting samples. A view with dynamic casters in its
+//    frustum gets its static tile copied over, then the dynamic casters
+//    drawn on top. A view with none is just the static tile, copied once
+//    when it changes.
+// shadow_cache_update works out this plan as a list of ShadowPass, and the
+// GL side (render/shadow_cache_gl.h) carries it out. stats count what was
+// redrawn, so a frame with nothing moving should show zero.
+//
+
+#ifndef FPS_STYLE_ROOM_SHADOW_CACHE_H
+#define FPS_STYLE_ROOM_SHADOW_CACHE_H
+
+#include <vector>
+#include <geometry/mesh.h>
+
+#define SHADOW_MIN_TILE 64
+#define SHADOW_FACES 6         // view slots per light
+#define SHADOW_NEAR 0.05f
+
+enum ShadowLightType {
+    SHADOW_SPOT,
+    SHADOW_POINT
+};
+
+struct ShadowLight {
+    int type;                  // ShadowLightType
+    vec3 position;
+    vec3 direction;            // spot only
+    float angle_deg;           // spot only, full cone angle
+    float radius;              // far plane
+    int resolution;            // wanted tile size, a power of two
+};
+
+/* one depth rendering into one atlas tile */
+struct ShadowView {
+    mat4 view;
+    mat4 proj;
+    mat4 view_proj;
+    int x, y, size;            // atlas tile, size 0 if unallocated
+    int node;                  // allocator node, -1 if none
+    bool static_valid;         // the static atlas tile is up to date
+    bool composited;           // the composite tile holds static + dynamic
+};
+
+/* what to do for one view this frame, in this order */
+struct ShadowPass {
+    int view;
+    bool render_static;        // static casters into the static atlas
+    bool copy;                 // static tile into the composite atlas
+    bool render_dynamic;       // dynamic casters on top, in the composite
+};
+
+struct ShadowCacheStats {
+    unsigned int lights;
+    unsigned int views;
+    unsigned int static_rendered;
+    unsigned int dynamic_rendered;
+    unsigned int copies;
+    unsigned int cached;       // views that needed no work at all
+    unsigned int downsized;    // lights given a smaller tile than asked
+    unsigned int atlas_used;   // texels allocated
+    double ms;
+};
+
+/* quadtree of tiles. level 0 is the whole atlas, level l has 4^l tiles */
+struct ShadowAtlas {
+    int size;
+    int levels;
+    std::vector<int> level_offset;
+    std::vector<unsigned char> state;   // per node: free, split or used
+};
+
+struct ShadowCache {
+    ShadowAtlas atlas;
+    std::vector<ShadowLight> lights;    // as of the last update
+    std::vector<int> light_views;       // views in use per light, 0, 1 or 6
+    std::vector<ShadowView> views;      // SHADOW_FACES per light
+    std::vector<ShadowPass> passes;
+    int shift;                          // resolutions are divided by 1 << shift
+    ShadowCacheStats stats;
+};
+
+void shadow_atlas_init (ShadowAtlas* atlas, int size);
+/* a size x size tile, size a power of two. returns the node or -1 */
+int shadow_atlas_alloc (ShadowAtlas* atlas, int size, int* x, int* y);
+void shadow_atlas_free (ShadowAtlas* atlas, int node);
+
+void shadow_cache_init (ShadowCache* cache, int atlas_size);
+/* static geometry inside bounds changed. views that can see it re-render */
+void shadow_cache_invalidate_static (ShadowCache* cache, const Aabb& bounds);
+/* plans this frame's shadow work into cache->passes. lights are matched to
+last frame's by index */
+void shadow_cache_update (ShadowCache* cache, const ShadowLight* lights, int count, const Aabb* dynamic_bounds,
+                          int dynamic_count);
+
+/* shadow lookup for the fragment shader: the views at binding 4, the
+composite atlas as a sampler2DShadow. p is view space, views [first,
+first + count) are one light's. 1 is lit, 0 in shadow */
+#define SHADOW_GLSL \
+    "struct ShadowView { mat4 from_view; vec4 rect; };\n" \
+    "layout (std430, binding = 4) readonly buffer ShadowViews { ShadowView shadow_views[]; };\n" \
+    "uniform sampler2DShadow shadow_atlas;\n" \
+    "float shadow_factor (int first, int count, vec3 p) {\n" \
+    "    for (int i = 0; i < count; i++) {\n" \
+    "        ShadowView s = shadow_views[first + i];\n" \
+    "        vec4 c = s.from_view * vec4 (p, 1.0);\n" \
+    "        if (c.w <= 0.0) continue;\n" \
+    "        vec3 ndc = c.xyz / c.w;\n" \
+    "        if (any (greaterThan (abs (ndc.xy), vec2 (1.0)))) continue;\n" \
+    "        vec2 uv = s.rect.xy + (ndc.xy * 0.5 + 0.5) * s.rect.zw;\n" \
+    "        return texture (shadow_atlas, vec3 (uv, ndc.z * 0.5 + 0.5 - 0.0005));\n" \
+    "    }\n" \
+    "    return 1.0;\n" \
+    "}\n"
+
+#endif //FPS_STYLE_ROOM_SHADOW_CACHE_H
@@ -0,0 +1,144 @@
+//
+// See shadow_cache_gl.h.
+//
+
+#include "shadow_cache_gl.h"
+#include <render/gl_utils.h>
+#include <render/gpu_memory_gl.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+/* std430 layout of SHADOW_GLSL's ShadowView */
+struct GpuShadowView {
+    float from_view[16];
+    float rect[4];               // atlas uv of the tile: offset, scale
+};
+
+static GLuint depth_atlas (int size, bool compare) {
+    GLuint tex;
+    glGenTextures (1, &tex);
+    glBindTexture (GL_TEXTURE_2D, tex);
+    glTexStorage2D (GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT32F, size, size);
+    gpu_memory_image (GL_TEXTURE, tex, (size_t)size * size * 4, MEMORY_RENDER);
+    glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, compare ? GL_LINEAR : GL_NEAREST);
+    glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, compare ? GL_LINEAR : GL_NEAREST);
+    glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    if (compare) {
+        glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+        glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+    }
+    glBindTexture (GL_TEXTURE_2D, 0);
+    return tex;
+}
+
+static GLuint depth_fbo (GLuint tex) {
+    GLuint fbo;
+    glGenFramebuffers (1, &fbo);
+    glBindFramebuffer (GL_FRAMEBUFFER, fbo);
+    glFramebufferTexture2D (GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, tex, 0);
+    glDrawBuffer (GL_NONE);
+    glReadBuffer (GL_NONE);
+    if (glCheckFramebufferStatus (GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        fprintf (stderr, "ERROR: shadow atlas framebuffer is incomplete\n");
+    }
+    // start out far everywhere, so an unrendered tile shadows nothing
+    glClearDepth (1.0);
+    glClear (GL_DEPTH_BUFFER_BIT);
+    return fbo;
+}
+
+bool shadow_cache_gl_init (ShadowCacheGl* gl, int size) {
+    memset (gl, 0, sizeof (*gl));
+    if (!GLEW_VERSION_4_3) {
+        fprintf (stderr, "ERROR: the shadow cache needs GL 4.3\n");
+        return false;
+    }
+    gl->size = size;
+    gl->static_atlas = depth_atlas (size, false);
+    gl->atlas = depth_atlas (size, true);
+    gl->static_fbo = depth_fbo (gl->static_atlas);
+    gl->atlas_fbo = depth_fbo (gl->atlas);
+    glBindFramebuffer (GL_FRAMEBUFFER, 0);
+    glGenBuffers (1, &gl->views);
+    return true;
+}
+
+static void bind_tile (GLuint fbo, const ShadowView& v) {
+    glBindFramebuffer (GL_FRAMEBUFFER, fbo);
+    glViewport (v.x, v.y, v.size, v.size);
+    glScissor (v.x, v.y, v.size, v.size);
+}
+
+void shadow_cache_gl_render (ShadowCacheGl* gl, const ShadowCache& cache, ShadowDrawFunc draw, void* data) {
+    if (cache.passes.empty ()) {
+        return;
+    }
+    // three sweeps rather than one per pass, to switch framebuffers less
+    glEnable (GL_SCISSOR_TEST);
+    glDepthMask (GL_TRUE);
+    for (size_t i = 0; i < cache.passes.size (); i++) {
+        const ShadowPass& p = cache.passes[i];
+        if (p.render_static) {
+            const ShadowView& v = cache.views[p.view];
+            bind_tile (gl->static_fbo, v);
+            glClear (GL_DEPTH_BUFFER_BIT);
+            draw (v.view, v.proj, false, data);
+        }
+    }
+    for (size_t i = 0; i < cache.passes.size (); i++) {
+        const ShadowPass& p = cache.passes[i];
+        if (p.copy) {
+            const ShadowView& v = cache.views[p.view];
+            glCopyImageSubData (gl->static_atlas, GL_TEXTURE_2D, 0, v.x, v.y, 0, gl->atlas, GL_TEXTURE_2D, 0, v.x,
+                                v.y, 0, v.size, v.size, 1);
+        }
+    }
+    for (size_t i = 0; i < cache.passes.size (); i++) {
+        const ShadowPass& p = cache.passes[i];
+        if (p.render_dynamic) {
+            const ShadowView& v = cache.views[p.view];
+            bind_tile (gl->atlas_fbo, v);
+            draw (v.view, v.proj, true, data);
+        }
+    }
+    glDisable (GL_SCISSOR_TEST);
+    glBindFramebuffer (GL_FRAMEBUFFER, 0);
+}
+
+void shadow_cache_gl_upload (ShadowCacheGl* gl, const ShadowCache& cache, const mat4& camera_view, int unit) {
+    // never zero sized, the shader declares the buffer whatever the light count
+    std::vector<GpuShadowView> views (cache.views.empty () ? 1 : cache.views.size ());
+    memset (&views[0], 0, views.size () * sizeof (GpuShadowView));
+    mat4 to_world = inverse (camera_view);
+    float texel = 1.0f / (float)gl->size;
+    for (size_t i = 0; i < cache.views.size (); i++) {
+        const ShadowView& v = cache.views[i];
+        if (v.size == 0) {
+            continue;
+        }
+        mat4 from_view = v.view_proj * to_world;
+        memcpy (views[i].from_view, from_view.m, sizeof (views[i].from_view));
+        // half a texel in from the edges, so filtering never reads the next tile
+        views[i].rect[0] = ((float)v.x + 0.5f) * texel;
+        views[i].rect[1] = ((float)v.y + 0.5f) * texel;
+        views[i].rect[2] = ((float)v.size - 1.0f) * texel;
+        views[i].rect[3] = ((float)v.size - 1.0f) * texel;
+    }
+    gl_stream_upload (GL_SHADER_STORAGE_BUFFER, gl->views, &gl->views_capacity, &views[0],
+                      views.size () * sizeof (GpuShadowView), MEMORY_RENDER);
+    glBindBufferBase (GL_SHADER_STORAGE_BUFFER, 4, gl->views);
+    glActiveTexture (GL_TEXTURE0 + unit);
+    glBindTexture (GL_TEXTURE_2D, gl->atlas);
+    glActiveTexture (GL_TEXTURE0);
+}
+
+void shadow_cache_gl_destroy (ShadowCacheGl* gl) {
+    GLuint fbos[2] = {gl->static_fbo, gl->atlas_fbo};
+    glDeleteFramebuffers (2, fbos);
+    GLuint textures[2] = {gl->static_atlas, gl->atlas};
+    gpu_memory_delete (GL_TEXTURE, 2, textures);
+    gpu_memory_delete (GL_BUFFER, 1, &gl->views);
+    memset (gl, 0, sizeof (*gl));
+}
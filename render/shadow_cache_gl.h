@@ -0,0 +1,41 @@
+//
+// GL side of the shadow cache: the static and composite depth atlases, the
+// passes shadow_cache_update planned, and the view buffer SHADOW_GLSL reads.
+//
+// Casters are drawn by a callback, so the cache doesn't care how the scene
+// is stored. It is called with dynamic false for static casters (into the
+// static atlas) and true for dynamic ones (into the composite, over the
+// copied static tile). The callback draws depth only, with the viewport and
+// framebuffer as it finds them.
+//
+
+#ifndef FPS_STYLE_ROOM_SHADOW_CACHE_GL_H
+#define FPS_STYLE_ROOM_SHADOW_CACHE_GL_H
+
+#include <GL/glew.h>
+#include <render/shadow_cache.h>
+
+typedef void (*ShadowDrawFunc) (const mat4& view, const mat4& proj, bool dynamic, void* data);
+
+struct ShadowCacheGl {
+    GLuint static_atlas;         // depth textures, both size x size
+    GLuint atlas;                // the composite, sampled with compare mode
+    GLuint static_fbo;
+    GLuint atlas_fbo;
+    GLuint views;                // SSBO, binding 4
+    size_t views_capacity;
+    int size;
+};
+
+/* size must match the ShadowCache's atlas. false if the context has no
+glCopyImageSubData (GL 4.3) */
+bool shadow_cache_gl_init (ShadowCacheGl* gl, int size);
+/* carries out cache.passes. leaves the default framebuffer bound, the
+caller sets its viewport again */
+void shadow_cache_gl_render (ShadowCacheGl* gl, const ShadowCache& cache, ShadowDrawFunc draw, void* data);
+/* the views as seen from a camera with this view matrix, at binding 4, and
+the composite atlas on texture unit `unit` */
+void shadow_cache_gl_upload (ShadowCacheGl* gl, const ShadowCache& cache, const mat4& camera_view, int unit);
+void shadow_cache_gl_destroy (ShadowCacheGl* gl);
+
+#endif //FPS_STYLE_ROOM_SHADOW_CACHE_GL_H
@@ -0,0 +1,95 @@
+//
+// See texture_streamer_gl.h.
+//
+
+#include "texture_streamer_gl.h"
+#include <render/gpu_memory_gl.h>
+#include <stdio.h>
+
+static GLenum internal_format (uint32_t format) {
+    switch (format) {
+        case TEXTURE_BC1:
+            return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+        case TEXTURE_BC3:
+            return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        default:
+            return GL_COMPRESSED_RGBA_BPTC_UNORM;
+    }
+}
+
+bool texture_streamer_gl_init (TextureStreamerGl* gl) {
+    gl->textures.clear ();
+    gl->tops.clear ();
+    if (!GLEW_VERSION_4_3 || !GLEW_EXT_texture_compression_s3tc) {
+        fprintf (stderr, "ERROR: texture streaming needs GL 4.3 and S3TC\n");
+        return false;
+    }
+    return true;
+}
+
+/* a texture holding file levels top and coarser, level 0 being top */
+static GLuint make_texture (const TextureFileHeader& h, int top) {
+    int w = texture_level_dim (h.width, top), ht = texture_level_dim (h.height, top);
+    GLuint tex;
+    glGenTextures (1, &tex);
+    glBindTexture (GL_TEXTURE_2D, tex);
+    glTexStorage2D (GL_TEXTURE_2D, (GLsizei)h.levels - top, internal_format (h.format), w, ht);
+    glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    return tex;
+}
+
+static void upload_level (const TextureFileHeader& h, int top, int level, const void* data, size_t bytes) {
+    glCompressedTexSubImage2D (GL_TEXTURE_2D, level - top, 0, 0, texture_level_dim (h.width, level),
+                               texture_level_dim (h.height, level), internal_format (h.format), (GLsizei)bytes, data);
+}
+
+void texture_streamer_gl_apply (TextureStreamerGl* gl, const TextureStreamer& s) {
+    if (gl->textures.size () < s.textures.size ()) {
+        gl->textures.resize (s.textures.size (), 0);
+        gl->tops.resize (s.textures.size (), 0);
+    }
+    for (size_t i = 0; i < s.changes.size (); i++) {
+        const TextureChange& c = s.changes[i];
+        const TextureFile& file = s.textures[c.texture].file;
+        const TextureFileHeader& h = *file.header;
+        GLuint old = gl->textures[c.texture];
+        int old_top = gl->tops[c.texture];
+        GLuint tex = make_texture (h, c.top);
+        size_t bytes = 0;
+        for (int l = c.top; l < (int)h.levels; l++) {
+            bytes += (size_t)file.levels[l].bytes;
+        }
+        gpu_memory_image (GL_TEXTURE, tex, bytes, MEMORY_TEXTURES);
+        if (!old) {
+            // a new texture: its tail, straight from the mapping
+            for (int l = c.top; l < (int)h.levels; l++) {
+                upload_level (h, c.top, l, texture_file_level (file, l), (size_t)file.levels[l].bytes);
+            }
+        } else {
+            for (int l = c.top > old_top ? c.top : old_top; l < (int)h.levels; l++) {
+                glCopyImageSubData (old, GL_TEXTURE_2D, l - old_top, 0, 0, 0, tex, GL_TEXTURE_2D, l - c.top, 0, 0, 0,
+                                    texture_level_dim (h.width, l), texture_level_dim (h.height, l), 1);
+            }
+            if (c.level >= 0) {
+                upload_level (h, c.top, c.level, c.data, c.bytes);
+            }
+            gpu_memory_delete (GL_TEXTURE, 1, &old);
+        }
+        gl->textures[c.texture] = tex;
+        gl->tops[c.texture] = c.top;
+    }
+    glBindTexture (GL_TEXTURE_2D, 0);
+}
+
+void texture_streamer_gl_destroy (TextureStreamerGl* gl) {
+    for (size_t i = 0; i < gl->textures.size (); i++) {
+        if (gl->textures[i]) {
+            gpu_memory_delete (GL_TEXTURE, 1, &gl->textures[i]);
+        }
+    }
+    gl->textures.clear ();
+    gl->tops.clear ();
+}
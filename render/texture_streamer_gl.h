@@ -0,0 +1,34 @@
+//
+// GL side of texture streaming: one texture per streamed texture, holding
+// exactly its resident levels.
+//
+// Immutable storage can't grow or shrink, so a residency change makes a new
+// texture whose level 0 is the new top, copies the levels the old one had
+// across on the GPU (glCopyImageSubData) and uploads the level just loaded,
+// if any. Evicting really gives the memory back that way, which setting
+// GL_TEXTURE_BASE_LEVEL on a full chain would not. A new texture's mip tail
+// is uploaded straight from the file's mapping.
+//
+// Needs GL 4.3 for the copies, and EXT_texture_compression_s3tc for BC1 and
+// BC3.
+//
+
+#ifndef FPS_STYLE_ROOM_TEXTURE_STREAMER_GL_H
+#define FPS_STYLE_ROOM_TEXTURE_STREAMER_GL_H
+
+#include <GL/glew.h>
+#include <vector>
+#include <textures/texture_streamer.h>
+
+struct TextureStreamerGl {
+    std::vector<GLuint> textures;   // by streamer index, 0 until its tail is in
+    std::vector<int> tops;          // the file level each texture's level 0 is
+};
+
+/* false if the context can't copy images or sample BC textures */
+bool texture_streamer_gl_init (TextureStreamerGl* gl);
+/* carries out s.changes. call after each texture_streamer_update */
+void texture_streamer_gl_apply (TextureStreamerGl* gl, const TextureStreamer& s);
+void texture_streamer_gl_destroy (TextureStreamerGl* gl);
+
+#endif //FPS_STYLE_ROOM_TEXTURE_STREAMER_GL_H
@@ -0,0 +1,196 @@
+//
+// Packing, unpacking and error measurement for PackedVertex. See
+// vertex_format.h.
+//
+
+#include "vertex_format.h"
+#include <math.h>
+#include <string.h>
+
+/*----------------------------------SCALARS-----------------------------------*/
+unsigned short half_from_float (float f) {
+    unsigned int x;
+    memcpy (&x, &f, sizeof (x));
+    unsigned int sign = (x >> 16) & 0x8000u;
+    unsigned int exponent = (x >> 23) & 0xFFu;
+    unsigned int mantissa = x & 0x7FFFFFu;
+    if (exponent == 0xFFu) {
+        return (unsigned short)(sign | 0x7C00u | (mantissa ? 0x200u : 0u)); // inf, NaN stays NaN
+    }
+    int e = (int)exponent - 127 + 15;
+    if (e >= 31) {
+        return (unsigned short)(sign | 0x7C00u); // too big, inf
+    }
+    if (e <= 0) {
+        // half subnormal: the 24 bit significand shifted down to units of 2^-24
+        if (e < -10) {
+            return (unsigned short)sign;
+        }
+        mantissa |= 0x800000u;
+        int shift = 14 - e;
+        unsigned int h = mantissa >> shift;
+        unsigned int rest = mantissa & ((1u << shift) - 1u), halfway = 1u << (shift - 1);
+        h += rest > halfway || (rest == halfway && (h & 1u));
+        return (unsigned short)(sign | h);
+    }
+    // round to nearest even. a carry out of the mantissa bumps the exponent,
+    // which is the right answer, up to inf
+    unsigned int h = ((unsigned int)e << 10) | (mantissa >> 13);
+    unsigned int rest = mantissa & 0x1FFFu;
+    h += rest > 0x1000u || (rest == 0x1000u && (h & 1u));
+    return (unsigned short)(sign | h);
+}
+
+float float_from_half (unsigned short h) {
+    unsigned int sign = (unsigned int)(h & 0x8000u) << 16;
+    unsigned int exponent = (h >> 10) & 0x1Fu;
+    unsigned int mantissa = h & 0x3FFu;
+    if (exponent == 0) {
+        float f = ldexpf ((float)mantissa, -24);
+        return sign ? -f : f;
+    }
+    unsigned int x = sign | (exponent == 31 ? 0x7F800000u : (exponent + 112u) << 23) | (mantissa << 13);
+    float f;
+    memcpy (&f, &x, sizeof (f));
+    return f;
+}
+
+static inline float sign_not_zero (float f) {
+    return f >= 0.0f ? 1.0f : -1.0f;
+}
+
+static inline short snorm16 (float f) {
+    f = f < -1.0f ? -1.0f : (f > 1.0f ? 1.0f : f);
+    return (short)lrintf (f * 32767.0f);
+}
+
+/* what GL does with a normalised GL_SHORT */
+static inline float from_snorm16 (short s) {
+    float f = (float)s / 32767.0f;
+    return f < -1.0f ? -1.0f : f;
+}
+
+vec3 octahedral_decode (const short* in) {
+    float x = from_snorm16 (in[0]), y = from_snorm16 (in[1]);
+    vec3 n (x, y, 1.0f - fabsf (x) - fabsf (y));
+    if (n.v[2] < 0.0f) {
+        n.v[0] = (1.0f - fabsf (y)) * sign_not_zero (x);
+        n.v[1] = (1.0f - fabsf (x)) * sign_not_zero (y);
+    }
+    return normalise (n);
+}
+
+void octahedral_encode (const vec3& n, short* out) {
+    float l1 = fabsf (n.v[0]) + fabsf (n.v[1]) + fabsf (n.v[2]);
+    if (l1 <= 0.0f) {
+        out[0] = 0;
+        out[1] = 0;
+        return;
+    }
+    float x = n.v[0] / l1, y = n.v[1] / l1;
+    if (n.v[2] < 0.0f) {
+        float fx = (1.0f - fabsf (y)) * sign_not_zero (x);
+        float fy = (1.0f - fabsf (x)) * sign_not_zero (y);
+        x = fx;
+        y = fy;
+    }
+    // plain rounding can land on the wrong side of the fold, so try each
+    // floor/ceil pair and keep the one that decodes closest
+    float sx = floorf (x * 32767.0f), sy = floorf (y * 32767.0f);
+    float best = -2.0f;
+    for (int i = 0; i < 4; i++) {
+        float cx = (sx + (float)(i & 1)) / 32767.0f, cy = (sy + (float)(i >> 1)) / 32767.0f;
+        short c[2] = {snorm16 (cx), snorm16 (cy)};
+        float d = dot (octahedral_decode (c), n);
+        if (d > best) {
+            best = d;
+            out[0] = c[0];
+            out[1] = c[1];
+        }
+    }
+}
+
+/*----------------------------------VERTICES----------------------------------*/
+vec3 vertex_unpack_position (const PackedVertex& v, const VertexQuantization& q) {
+    vec3 p;
+    for (int a = 0; a < 3; a++) {
+        p.v[a] = q.offset.v[a] + (float)v.position[a] / 65535.0f * q.extent.v[a];
+    }
+    return p;
+}
+
+vec3 vertex_unpack_normal (const PackedVertex& v) {
+    return octahedral_decode (v.normal);
+}
+
+void vertex_unpack_uv (const PackedVertex& v, float* uv) {
+    uv[0] = float_from_half (v.uv[0]);
+    uv[1] = float_from_half (v.uv[1]);
+}
+
+void vertex_pack (const vec3* positions, const vec3* normals, const float* uvs, int count, PackedVertices* out,
+                  VertexFormatReport* report) {
+    Aabb bounds = aabb_empty ();
+    for (int i = 0; i < count; i++) {
+        aabb_grow (&bounds, positions[i]);
+    }
+    VertexQuantization& q = out->quantization;
+    q.offset = count > 0 ? bounds.min : vec3 (0.0f, 0.0f, 0.0f);
+    q.extent = count > 0 ? bounds.max - bounds.min : vec3 (0.0f, 0.0f, 0.0f);
+    out->vertices.resize (count);
+    for (int i = 0; i < count; i++) {
+        PackedVertex& v = out->vertices[i];
+        for (int a = 0; a < 3; a++) {
+            // a flat axis has zero extent, everything on it packs to 0
+            float f = q.extent.v[a] > 0.0f ? (positions[i].v[a] - q.offset.v[a]) / q.extent.v[a] : 0.0f;
+            f = f < 0.0f ? 0.0f : (f > 1.0f ? 1.0f : f);
+            v.position[a] = (unsigned short)lrintf (f * 65535.0f);
+        }
+        v.position[3] = 0;
+        if (normals) {
+            octahedral_encode (normals[i], v.normal);
+        } else {
+            v.normal[0] = v.normal[1] = 0;
+        }
+        v.uv[0] = uvs ? half_from_float (uvs[i * 2]) : 0;
+        v.uv[1] = uvs ? half_from_float (uvs[i * 2 + 1]) : 0;
+    }
+    if (!report) {
+        return;
+    }
+
+    memset (report, 0, sizeof (*report));
+    report->vertices = (unsigned int)count;
+    report->float_bytes = (size_t)count * sizeof (float) * (3 + (normals ? 3 : 0) + (uvs ? 2 : 0));
+    report->packed_bytes = (size_t)count * sizeof (PackedVertex);
+    float worst_angle = 0.0f;
+    for (int i = 0; i < count; i++) {
+        const PackedVertex& v = out->vertices[i];
+        float e = length (vertex_unpack_position (v, q) - positions[i]);
+        report->position_error = e > report->position_error ? e : report->position_error;
+        if (normals && length2 (normals[i]) > 0.0f) {
+            // atan2 of |cross| and dot, acos of a dot this close to 1 is all rounding
+            vec3 a = vertex_unpack_normal (v), b = normalise (normals[i]);
+            float angle = atan2f (length (cross (a, b)), dot (a, b));
+            worst_angle = angle > worst_angle ? angle : worst_angle;
+        }
+        if (uvs) {
+            float uv[2];
+            vertex_unpack_uv (v, uv);
+            for (int k = 0; k < 2; k++) {
+                float ue = fabsf (uv[k] - uvs[i * 2 + k]);
+                report->uv_error = ue > report->uv_error ? ue : report->uv_error;
+            }
+        }
+    }
+    float largest = fmaxf (fmaxf (q.extent.v[0], q.extent.v[1]), q.extent.v[2]);
+    report->position_error_rel = largest > 0.0f ? report->position_error / largest : 0.0f;
+    report->normal_error_deg = worst_angle * (180.0f / 3.14159265f);
+}
+
+void vertex_pack_mesh (const Mesh& mesh, PackedVertices* out, VertexFormatReport* report) {
+    std::vector<vec3> normals;
+    mesh_vertex_normals (mesh, &normals);
+    vertex_pack (mesh.positions.empty () ? NULL : &mesh.positions[0], normals.empty () ? NULL : &normals[0], NULL,
+                 (int)mesh.positions.size (), out, report);
+}
@@ -0,0 +1,96 @@
+//
+// Compressed vertex format.
+//
+// A float vertex with position, normal and uv is 32 bytes. PackedVertex is
+// 16:
+//  - position: three unorm16 values across the mesh bounds. The shader gets
+//    them normalised to [0, 1] and adds the bounds back with two uniforms.
+//    The error is at most half a step, extent / 131070 per axis.
+//  - normal: octahedral mapping onto two snorm16 values. The sphere is folded
+//    onto the |x| + |y| + |z| = 1 octahedron, then the lower half is unfolded
+//    over the corners of the square. The encoder tries the four rounding
+//    choices and keeps the one that decodes closest.
+//  - uv: two half floats. Precision is relative, so tiling coordinates far
+//    from 0 lose the most.
+//
+// The CPU side here packs and measures. render/vertex_format_gl.h sets up
+// the attributes, and VERTEX_FORMAT_GLSL is the matching shader decode.
+//
+
+#ifndef FPS_STYLE_ROOM_VERTEX_FORMAT_H
+#define FPS_STYLE_ROOM_VERTEX_FORMAT_H
+
+#include <stddef.h>
+#include <vector>
+#include <geometry/mesh.h>
+
+/* attribute locations used by VERTEX_FORMAT_GLSL and the GL setup */
+#define VERTEX_FORMAT_POSITION 0
+#define VERTEX_FORMAT_NORMAL 1
+#define VERTEX_FORMAT_UV 2
+
+struct PackedVertex {
+    unsigned short position[4];  // xyz unorm16 across the bounds, w unused (keeps 8 byte alignment)
+    short normal[2];             // octahedral snorm16
+    unsigned short uv[2];        // half floats
+};
+
+/* decode: position = offset + unorm * extent */
+struct VertexQuantization {
+    vec3 offset;
+    vec3 extent;
+};
+
+struct PackedVertices {
+    std::vector<PackedVertex> vertices;
+    VertexQuantization quantization;
+};
+
+/* what packing cost, measured by decoding every vertex again */
+struct VertexFormatReport {
+    unsigned int vertices;
+    size_t float_bytes;          // the same attributes as plain floats
+    size_t packed_bytes;
+    float position_error;        // largest per vertex distance, world units
+    float position_error_rel;    // position_error over the largest bounds extent
+    float normal_error_deg;      // largest angle between normal and its decode
+    float uv_error;              // largest per component difference
+};
+
+/* normals and uvs (2 floats per vertex) may be NULL, those attributes are
+then zero. report may be NULL */
+void vertex_pack (const vec3* positions, const vec3* normals, const float* uvs, int count, PackedVertices* out,
+                  VertexFormatReport* report);
+/* a Mesh's positions with smooth normals and no uvs */
+void vertex_pack_mesh (const Mesh& mesh, PackedVertices* out, VertexFormatReport* report);
+
+unsigned short half_from_float (float f);
+float float_from_half (unsigned short h);
+void octahedral_encode (const vec3& n, short* out);
+vec3 octahedral_decode (const short* in);
+
+vec3 vertex_unpack_position (const PackedVertex& v, const VertexQuantization& q);
+vec3 vertex_unpack_normal (const PackedVertex& v);
+void vertex_unpack_uv (const PackedVertex& v, float* uv);
+
+/* the attributes and the normal and uv decode, for shaders that find the
+position quantization somewhere other than uniforms */
+#define VERTEX_FORMAT_GLSL_INPUTS \
+    "layout (location = 0) in vec4 packed_position;\n" \
+    "layout (location = 1) in vec2 packed_normal;\n" \
+    "layout (location = 2) in vec2 packed_uv;\n" \
+    "vec3 decode_normal () {\n" \
+    "    vec3 n = vec3 (packed_normal, 1.0 - abs (packed_normal.x) - abs (packed_normal.y));\n" \
+    "    if (n.z < 0.0) n.xy = (1.0 - abs (n.yx)) * (step (0.0, n.xy) * 2.0 - 1.0);\n" \
+    "    return normalize (n);\n" \
+    "}\n" \
+    "vec2 decode_uv () { return packed_uv; }\n"
+
+/* shader decode for PackedVertex. goes straight after the #version line,
+then call decode_position (), decode_normal () and decode_uv () */
+#define VERTEX_FORMAT_GLSL \
+    "uniform vec3 position_offset, position_extent;\n" \
+    VERTEX_FORMAT_GLSL_INPUTS \
+    "vec3 decode_position () { return position_offset + packed_position.xyz * position_extent; }\n"
+
+#endif //FPS_STYLE_ROOM_VERTEX_FORMAT_H
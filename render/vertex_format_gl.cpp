@@ -0,0 +1,34 @@
+//
+// See vertex_format_gl.h.
+//
+
+#include "vertex_format_gl.h"
+#include <render/gpu_memory_gl.h>
+
+GLuint vertex_format_upload (const PackedVertices& packed) {
+    GLuint vbo;
+    glGenBuffers (1, &vbo);
+    glBindBuffer (GL_ARRAY_BUFFER, vbo);
+    gpu_memory_buffer_data (GL_ARRAY_BUFFER, vbo, packed.vertices.size () * sizeof (PackedVertex),
+                            packed.vertices.empty () ? NULL : &packed.vertices[0], GL_STATIC_DRAW, MEMORY_RENDER);
+    return vbo;
+}
+
+void vertex_format_bind_attributes (GLuint vbo) {
+    const GLsizei stride = sizeof (PackedVertex);
+    glBindBuffer (GL_ARRAY_BUFFER, vbo);
+    glEnableVertexAttribArray (VERTEX_FORMAT_POSITION);
+    glVertexAttribPointer (VERTEX_FORMAT_POSITION, 4, GL_UNSIGNED_SHORT, GL_TRUE, stride,
+                           (const void*)offsetof (PackedVertex, position));
+    glEnableVertexAttribArray (VERTEX_FORMAT_NORMAL);
+    glVertexAttribPointer (VERTEX_FORMAT_NORMAL, 2, GL_SHORT, GL_TRUE, stride,
+                           (const void*)offsetof (PackedVertex, normal));
+    glEnableVertexAttribArray (VERTEX_FORMAT_UV);
+    glVertexAttribPointer (VERTEX_FORMAT_UV, 2, GL_HALF_FLOAT, GL_FALSE, stride,
+                           (const void*)offsetof (PackedVertex, uv));
+}
+
+void vertex_format_set_uniforms (GLuint program, const VertexQuantization& q) {
+    glUniform3fv (glGetUniformLocation (program, "position_offset"), 1, q.offset.v);
+    glUniform3fv (glGetUniformLocation (program, "position_extent"), 1, q.extent.v);
+}
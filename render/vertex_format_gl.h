@@ -0,0 +1,20 @@
+//
+// GL side of the compressed vertex format: attribute setup and the decode
+// uniforms for VERTEX_FORMAT_GLSL. Kept out of vertex_format.h so the tools
+// and benchmarks don't need GL.
+//
+
+#ifndef FPS_STYLE_ROOM_VERTEX_FORMAT_GL_H
+#define FPS_STYLE_ROOM_VERTEX_FORMAT_GL_H
+
+#include <GL/glew.h>
+#include <render/vertex_format.h>
+
+/* uploads the vertices to a new GL_STATIC_DRAW buffer and returns it */
+GLuint vertex_format_upload (const PackedVertices& packed);
+/* points the three attributes of the bound vertex array at vbo */
+void vertex_format_bind_attributes (GLuint vbo);
+/* sets position_offset and position_extent on the program in use */
+void vertex_format_set_uniforms (GLuint program, const VertexQuantization& q);
+
+#endif //FPS_STYLE_ROOM_VERTEX_FORMAT_GL_H
@@ -0,0 +1,72 @@
+//
+// See view_ubo_gl.h.
+//
+
+#include "view_ubo_gl.h"
+#include <render/gpu_memory_gl.h>
+#include <string.h>
+
+void view_ubo_gl_init (ViewUboGl* ubo) {
+    memset (ubo, 0, sizeof (*ubo));
+    GLint align = 256;
+    glGetIntegerv (GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &align);
+    ubo->slot_size = ((2 * sizeof (mat4) + align - 1) / align) * align;
+    ubo->slot = VIEW_UBO_SLOTS - 1;
+    GLsizeiptr bytes = ubo->slot_size * VIEW_UBO_SLOTS;
+    glGenBuffers (1, &ubo->buffer);
+    glBindBuffer (GL_UNIFORM_BUFFER, ubo->buffer);
+    if (GLEW_ARB_buffer_storage) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        gpu_memory_buffer_storage (GL_UNIFORM_BUFFER, ubo->buffer, bytes, NULL, flags, MEMORY_RENDER);
+        ubo->mapped = (unsigned char*)glMapBufferRange (GL_UNIFORM_BUFFER, 0, bytes, flags);
+    } else {
+        gpu_memory_buffer_data (GL_UNIFORM_BUFFER, ubo->buffer, bytes, NULL, GL_DYNAMIC_DRAW, MEMORY_RENDER);
+    }
+    glBindBuffer (GL_UNIFORM_BUFFER, 0);
+}
+
+void view_ubo_gl_write (ViewUboGl* ubo, const mat4& view, const mat4& proj) {
+    ubo->slot = (ubo->slot + 1) % VIEW_UBO_SLOTS;
+    GLsync& fence = ubo->fences[ubo->slot];
+    if (fence) {
+        // a second at most. returning early just means writing a slot the
+        // GPU is done with anyway
+        glClientWaitSync (fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+        glDeleteSync (fence);
+        fence = 0;
+    }
+    GLintptr offset = ubo->slot * ubo->slot_size;
+    if (ubo->mapped) {
+        memcpy (ubo->mapped + offset, view.m, sizeof (view.m));
+        memcpy (ubo->mapped + offset + sizeof (view.m), proj.m, sizeof (proj.m));
+    } else {
+        glBindBuffer (GL_UNIFORM_BUFFER, ubo->buffer);
+        glBufferSubData (GL_UNIFORM_BUFFER, offset, sizeof (view.m), view.m);
+        glBufferSubData (GL_UNIFORM_BUFFER, offset + sizeof (view.m), sizeof (proj.m), proj.m);
+        glBindBuffer (GL_UNIFORM_BUFFER, 0);
+    }
+    glBindBufferRange (GL_UNIFORM_BUFFER, VIEW_UBO_BINDING, ubo->buffer, offset, 2 * sizeof (mat4));
+}
+
+void view_ubo_gl_fence (ViewUboGl* ubo) {
+    GLsync& fence = ubo->fences[ubo->slot];
+    if (fence) {
+        glDeleteSync (fence);
+    }
+    fence = glFenceSync (GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void view_ubo_gl_destroy (ViewUboGl* ubo) {
+    for (int i = 0; i < VIEW_UBO_SLOTS; i++) {
+        if (ubo->fences[i]) {
+            glDeleteSync (ubo->fences[i]);
+        }
+    }
+    if (ubo->mapped) {
+        glBindBuffer (GL_UNIFORM_BUFFER, ubo->buffer);
+        glUnmapBuffer (GL_UNIFORM_BUFFER);
+        glBindBuffer (GL_UNIFORM_BUFFER, 0);
+    }
+    gpu_memory_delete (GL_BUFFER, 1, &ubo->buffer);
+    memset (ubo, 0, sizeof (*ubo));
+}
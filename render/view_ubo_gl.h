@@ -0,0 +1,44 @@
+//
+// Camera matrices in a persistently mapped uniform buffer.
+//
+// The buffer has VIEW_UBO_SLOTS slots and every view drawn writes the next
+// one, so the CPU never writes a slot the GPU may still be reading. Each slot
+// is fenced after the draws that use it, and writing it again waits on that
+// fence, which with three frames of up to four views and a swap every frame
+// returns at once.
+// With GL 4.4 (ARB_buffer_storage) the slots are written through a pointer
+// mapped once at init, coherent, so a write just before the draw costs a
+// 128 byte memcpy and no GL call but the bind. Without it the same slot
+// scheme falls back to glBufferSubData.
+//
+// Shaders read the block with VIEW_UBO_GLSL.
+//
+
+#ifndef FPS_STYLE_ROOM_VIEW_UBO_GL_H
+#define FPS_STYLE_ROOM_VIEW_UBO_GL_H
+
+#include <GL/glew.h>
+#include <utils/maths_funcs.h>
+
+#define VIEW_UBO_SLOTS 12
+#define VIEW_UBO_BINDING 0
+
+struct ViewUboGl {
+    GLuint buffer;
+    unsigned char* mapped;       // NULL without buffer storage
+    GLsync fences[VIEW_UBO_SLOTS];
+    GLsizeiptr slot_size;        // 128 bytes rounded up to the offset alignment
+    int slot;                    // the slot last written
+};
+
+void view_ubo_gl_init (ViewUboGl* ubo);
+/* writes view and proj into the next slot and binds it at VIEW_UBO_BINDING */
+void view_ubo_gl_write (ViewUboGl* ubo, const mat4& view, const mat4& proj);
+/* after the last draw that reads the slot */
+void view_ubo_gl_fence (ViewUboGl* ubo);
+void view_ubo_gl_destroy (ViewUboGl* ubo);
+
+#define VIEW_UBO_GLSL \
+    "layout (std140, binding = 0) uniform Camera { mat4 camera_view; mat4 camera_proj; };\n"
+
+#endif //FPS_STYLE_ROOM_VIEW_UBO_GL_H
@@ -0,0 +1,116 @@
+//
+// inotify, or modification times. See file_watch.h.
+//
+
+#include "file_watch.h"
+#include <memory/memory_tracker.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#if defined(__linux__)
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+static const char* base_name (const char* path) {
+    const char* slash = strrchr (path, '/');
+    return slash ? slash + 1 : path;
+}
+
+static long long modified (const char* path) {
+    struct stat st;
+    return stat (path, &st) == 0 ? (long long)st.st_mtime : -1;
+}
+
+bool file_watch_init (FileWatch* w) {
+    w->files.clear ();
+    w->changed_ms = -1.0;
+    w->checked_ms = 0.0;
+#if defined(__linux__)
+    w->fd = inotify_init1 (IN_NONBLOCK | IN_CLOEXEC);
+    if (w->fd < 0) {
+        fprintf (stderr, "ERROR: no inotify, polling file times instead\n");
+    }
+#else
+    w->fd = -1;
+#endif
+    return w->fd >= 0;
+}
+
+void file_watch_set (FileWatch* w, const ScenePath* files, int count, double now_ms) {
+    MemoryScope scope (MEMORY_SCENE);
+#if defined(__linux__)
+    // one directory may have several files, so a descriptor repeats. removing
+    // it twice only fails the second time
+    for (size_t i = 0; w->fd >= 0 && i < w->files.size (); i++) {
+        if (w->files[i].dir_watch >= 0) {
+            inotify_rm_watch (w->fd, w->files[i].dir_watch);
+        }
+    }
+#endif
+    w->files.resize (count);
+    for (int i = 0; i < count; i++) {
+        FileWatchEntry& e = w->files[i];
+        memcpy (e.path, files[i].path, sizeof (e.path));
+        e.mtime = modified (e.path);
+        e.dir_watch = -1;
+#if defined(__linux__)
+        if (w->fd >= 0) {
+            char dir[SCENE_PATH_MAX];
+            int length = (int)(base_name (e.path) - e.path);
+            snprintf (dir, sizeof (dir), "%.*s", length, length ? e.path : ".");
+            e.dir_watch = inotify_add_watch (w->fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+            if (e.dir_watch < 0) {
+                fprintf (stderr, "ERROR: could not watch %s\n", dir);
+            }
+        }
+#endif
+    }
+    w->checked_ms = now_ms;
+}
+
+bool file_watch_poll (FileWatch* w, double now_ms) {
+#if defined(__linux__)
+    if (w->fd >= 0) {
+        alignas (struct inotify_event) char buffer[4096];
+        ssize_t bytes;
+        while ((bytes = read (w->fd, buffer, sizeof (buffer))) > 0) {
+            for (char* p = buffer; p < buffer + bytes;) {
+                const struct inotify_event* ev = (const struct inotify_event*)p;
+                p += sizeof (struct inotify_event) + ev->len;
+                for (size_t i = 0; ev->len && i < w->files.size (); i++) {
+                    if (w->files[i].dir_watch == ev->wd && strcmp (base_name (w->files[i].path), ev->name) == 0) {
+                        w->changed_ms = now_ms;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+#endif
+    if (w->fd < 0 && now_ms - w->checked_ms >= FILE_WATCH_POLL_MS) {
+        w->checked_ms = now_ms;
+        for (size_t i = 0; i < w->files.size (); i++) {
+            long long t = modified (w->files[i].path);
+            if (t != w->files[i].mtime) {
+                w->files[i].mtime = t;
+                w->changed_ms = now_ms;
+            }
+        }
+    }
+    if (w->changed_ms < 0.0 || now_ms - w->changed_ms < FILE_WATCH_SETTLE_MS) {
+        return false;
+    }
+    w->changed_ms = -1.0;
+    return true;
+}
+
+void file_watch_destroy (FileWatch* w) {
+#if defined(__linux__)
+    if (w->fd >= 0) {
+        close (w->fd);
+    }
+#endif
+    w->fd = -1;
+    w->files.clear ();
+}
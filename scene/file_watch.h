@@ -0,0 +1,47 @@
+//
+// Tells the game when files it loaded have changed on disk.
+//
+// On Linux this is inotify: a watch on each directory holding a watched file,
+// for files written and closed and for files moved or created in, since many
+// editors save by writing a temporary and renaming it over the original.
+// Events for other files in those directories are ignored. Elsewhere it
+// compares modification times, at most every FILE_WATCH_POLL_MS.
+//
+// One save is often several events (truncate, write, rename) a few
+// milliseconds apart, so a change is reported once the files have been
+// quiet for FILE_WATCH_SETTLE_MS, never in the middle of a write.
+// file_watch_poll never blocks, so it can run every frame.
+//
+
+#ifndef FPS_STYLE_ROOM_FILE_WATCH_H
+#define FPS_STYLE_ROOM_FILE_WATCH_H
+
+#include <vector>
+#include <scene/scene_file.h>
+
+#define FILE_WATCH_SETTLE_MS 50.0
+#define FILE_WATCH_POLL_MS 250.0
+
+struct FileWatchEntry {
+    char path[SCENE_PATH_MAX];
+    int dir_watch;               // inotify watch descriptor of its directory
+    long long mtime;             // without inotify
+};
+
+struct FileWatch {
+    int fd;                      // inotify, -1 without
+    std::vector<FileWatchEntry> files;
+    double changed_ms;           // last unreported change, < 0 if none
+    double checked_ms;           // last mtime check
+};
+
+/* false if there is no inotify. the watch still works, by polling */
+bool file_watch_init (FileWatch* w);
+/* watches exactly these files from now on */
+void file_watch_set (FileWatch* w, const ScenePath* files, int count, double now_ms);
+/* true, once, when a watched file changed and has settled. now_ms is any
+steady clock in milliseconds */
+bool file_watch_poll (FileWatch* w, double now_ms);
+void file_watch_destroy (FileWatch* w);
+
+#endif //FPS_STYLE_ROOM_FILE_WATCH_H
@@ -0,0 +1,160 @@
+//
+// Scene description diffing. See live_scene.h.
+//
+
+#include "live_scene.h"
+#include <memory/memory_tracker.h>
+#include <algorithm>
+#include <chrono>
+#include <string.h>
+#include <string>
+#include <unordered_map>
+
+static bool same_transform (const SceneObjectDesc& a, const SceneObjectDesc& b) {
+    return memcmp (a.position.v, b.position.v, sizeof (a.position.v)) == 0 &&
+           memcmp (a.orientation.q, b.orientation.q, sizeof (a.orientation.q)) == 0 &&
+           memcmp (a.scale.v, b.scale.v, sizeof (a.scale.v)) == 0;
+}
+
+/* where name was in old. an edit rarely reorders the file, so the same
+position is tried before the index, which is only built if that misses */
+template <typename T>
+static int find_old (const std::vector<T>& old, size_t i, const char* name,
+                     std::unordered_map<std::string, int>* index) {
+    if (i < old.size () && strcmp (old[i].name, name) == 0) {
+        return (int)i;
+    }
+    if (index->empty ()) {
+        for (size_t j = 0; j < old.size (); j++) {
+            (*index)[old[j].name] = (int)j;
+        }
+    }
+    auto it = index->find (name);
+    return it == index->end () ? -1 : it->second;
+}
+
+void live_scene_init (LiveScene* live) {
+    live->desc = SceneDesc ();
+    live->mesh_slot.clear ();
+    live->free_slots.clear ();
+    live->entity.clear ();
+    live->mesh_of.clear ();
+    live->bounds.clear ();
+    live->changed.clear ();
+    memset (&live->stats, 0, sizeof (live->stats));
+}
+
+void live_scene_apply (LiveScene* live, SceneDesc* next, SceneStore* scene, DrawBatch* batch) {
+    MemoryScope scope (MEMORY_SCENE);
+    auto t0 = std::chrono::steady_clock::now ();
+    const SceneDesc& old = live->desc;
+    LiveSceneStats& st = live->stats;
+    memset (&st, 0, sizeof (st));
+    live->changed.clear ();
+
+    // meshes. removed ones go first, so their slots are free for new ones
+    std::unordered_map<std::string, int> index;
+    size_t mesh_count = next->meshes.size ();
+    std::vector<int> match (mesh_count, -1);
+    std::vector<unsigned char> kept (old.meshes.size (), 0);
+    for (size_t i = 0; i < mesh_count; i++) {
+        match[i] = find_old (old.meshes, i, next->meshes[i].name, &index);
+        if (match[i] >= 0) {
+            kept[match[i]] = 1;
+        }
+    }
+    for (size_t j = 0; j < old.meshes.size (); j++) {
+        if (!kept[j]) {
+            live->free_slots.push_back (live->mesh_slot[j]);
+            st.meshes_removed++;
+        }
+    }
+    std::vector<unsigned int> slot (mesh_count);
+    std::vector<unsigned char> reshaped (mesh_count, 0);
+    for (size_t i = 0; i < mesh_count; i++) {
+        const SceneMeshDesc& m = next->meshes[i];
+        if (match[i] >= 0) {
+            slot[i] = live->mesh_slot[match[i]];
+            if (old.meshes[match[i]].hash != m.hash) {
+                draw_batch_replace_mesh (batch, slot[i], m.mesh);
+                reshaped[i] = 1;
+                st.meshes_changed++;
+            }
+        } else if (!live->free_slots.empty ()) {
+            slot[i] = live->free_slots.back ();
+            live->free_slots.pop_back ();
+            draw_batch_replace_mesh (batch, slot[i], m.mesh);
+            st.meshes_added++;
+        } else {
+            slot[i] = draw_batch_add_mesh (batch, m.mesh);
+            st.meshes_added++;
+        }
+        float* albedo = batch->meshes[slot[i]].albedo;
+        const float* colour = next->materials[m.material].albedo;
+        if (memcmp (albedo, colour, 3 * sizeof (float)) != 0) {
+            memcpy (albedo, colour, 3 * sizeof (float));
+            st.meshes_recoloured += match[i] >= 0;
+        }
+    }
+
+    // objects, each matched by name and compared
+    index.clear ();
+    size_t object_count = next->objects.size ();
+    std::vector<Entity> entity (object_count);
+    std::vector<unsigned int> mesh_of (object_count);
+    std::vector<Aabb> bounds (object_count);
+    kept.assign (old.objects.size (), 0);
+    for (size_t i = 0; i < object_count; i++) {
+        const SceneObjectDesc& o = next->objects[i];
+        const Aabb& local = batch->meshes[slot[o.mesh]].bounds;
+        mesh_of[i] = slot[o.mesh];
+        bounds[i] = aabb_transform (local, scene_local_matrix (o.position, o.orientation, o.scale));
+        int j = find_old (old.objects, i, o.name, &index);
+        if (j < 0) {
+            entity[i] = scene_create (scene, ENTITY_NONE, o.position, o.orientation, o.scale, local);
+            live->changed.push_back (bounds[i]);
+            st.objects_added++;
+            continue;
+        }
+        const SceneObjectDesc& was = old.objects[j];
+        entity[i] = live->entity[j];
+        kept[j] = 1;
+        bool new_mesh = strcmp (old.meshes[was.mesh].name, next->meshes[o.mesh].name) != 0 || reshaped[o.mesh];
+        if (!new_mesh && same_transform (was, o)) {
+            continue;
+        }
+        scene_set_position (scene, entity[i], o.position);
+        scene_set_orientation (scene, entity[i], o.orientation);
+        scene_set_scale (scene, entity[i], o.scale);
+        scene_set_bounds (scene, entity[i], local);
+        live->changed.push_back (live->bounds[j]);
+        live->changed.push_back (bounds[i]);
+        st.objects_moved++;
+    }
+    for (size_t j = 0; j < old.objects.size (); j++) {
+        if (!kept[j]) {
+            scene_destroy (scene, live->entity[j]);
+            live->changed.push_back (live->bounds[j]);
+            st.objects_removed++;
+        }
+    }
+
+    std::swap (live->desc, *next);
+    live->mesh_slot.swap (slot);
+    live->entity.swap (entity);
+    live->mesh_of.swap (mesh_of);
+    live->bounds.swap (bounds);
+    st.ms = std::chrono::duration<double, std::milli> (std::chrono::steady_clock::now () - t0).count ();
+}
+
+void live_scene_gather (const LiveScene& live, const SceneStore& scene, std::vector<mat4>* worlds,
+                        std::vector<Aabb>* bounds) {
+    MemoryScope scope (MEMORY_SCENE);
+    size_t count = live.entity.size ();
+    worlds->resize (count);
+    bounds->resize (count);
+    for (size_t i = 0; i < count; i++) {
+        (*worlds)[i] = scene_world (scene, live.entity[i]);
+        (*bounds)[i] = scene_world_bounds (scene, live.entity[i]);
+    }
+}
@@ -0,0 +1,67 @@
+//
+// A scene description (scene/scene_file.h) applied to the running game, and
+// re-applied whenever the file changes.
+//
+// live_scene_apply compares the description just loaded with the one it
+// applied last, matching materials, meshes and objects by name, and touches
+// only what differs:
+//  - a mesh whose geometry hash changed is repacked into its own range of
+//    the draw batch's shared arrays (draw_batch_replace_mesh), so
+//    draw_batch_gl_sync uploads just that range. New meshes take the batch
+//    slots of removed ones before new slots are added
+//  - a material colour is copied to the batch meshes using it. It reaches
+//    the GPU in the per frame draw data, which is uploaded anyway
+//  - new objects are created in the SceneStore and removed ones destroyed.
+//    A moved object gets its new transform through the store, which marks
+//    it dirty, so scene_update recomputes it and nothing else
+// Unchanged things cost a name lookup and a compare, so a small edit to a
+// big scene applies in well under a millisecond and the frame doesn't hitch.
+//
+// The world bounds of everything that changed shape or place, before and
+// after, are left in changed, for the caller to invalidate cached shadows.
+//
+// Objects keep the order of the file, so mesh_of and the entities line up
+// with the description's objects after every apply.
+//
+
+#ifndef FPS_STYLE_ROOM_LIVE_SCENE_H
+#define FPS_STYLE_ROOM_LIVE_SCENE_H
+
+#include <vector>
+#include <scene/scene_file.h>
+#include <scene/scene_store.h>
+#include <render/draw_batch.h>
+
+struct LiveSceneStats {
+    unsigned int meshes_added;
+    unsigned int meshes_changed; // new geometry
+    unsigned int meshes_removed;
+    unsigned int meshes_recoloured;
+    unsigned int objects_added;
+    unsigned int objects_moved;  // new transform or mesh
+    unsigned int objects_removed;
+    double ms;                   // last apply
+};
+
+struct LiveScene {
+    SceneDesc desc;                        // as last applied
+    std::vector<unsigned int> mesh_slot;   // batch mesh per desc mesh
+    std::vector<unsigned int> free_slots;  // batch meshes of removed meshes
+    std::vector<Entity> entity;            // per desc object
+    std::vector<unsigned int> mesh_of;     // batch mesh per desc object
+    std::vector<Aabb> bounds;              // world, per desc object, as applied
+    std::vector<Aabb> changed;             // world bounds touched by the last apply
+    LiveSceneStats stats;
+};
+
+void live_scene_init (LiveScene* live);
+/* makes scene and batch match next. the first apply adds everything. next
+is swapped into live->desc rather than copied, and holds the previous
+description afterwards */
+void live_scene_apply (LiveScene* live, SceneDesc* next, SceneStore* scene, DrawBatch* batch);
+/* every object's world matrix and bounds, in desc order. only up to date
+after scene_update */
+void live_scene_gather (const LiveScene& live, const SceneStore& scene, std::vector<mat4>* worlds,
+                        std::vector<Aabb>* bounds);
+
+#endif //FPS_STYLE_ROOM_LIVE_SCENE_H
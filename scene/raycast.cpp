@@ -0,0 +1,577 @@
+//
+// Binned SAH BVH, SIMD Moller-Trumbore and the three traversals. See
+// raycast.h.
+//
+
+#include "raycast.h"
+#include <memory/memory_tracker.h>
+#include <jobs/job_system.h>
+#include <camera/camera_orientation.h>
+#include <culling/frustum.h>
+#include <algorithm>
+#include <chrono>
+#include <string.h>
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define RAY_BVH_BINS 12
+#define RAY_STACK_SIZE 64
+// stands in for 1 / 0 so a box test never computes 0 * inf
+static const float RAY_INV_DIR_HUGE = 1e30f;
+// hits closer than this are the surface the ray started on
+static const float RAY_T_MIN = 1e-5f;
+
+/*-----------------------------------SIMD-------------------------------------*/
+// just enough of a vector type for the two kernels below. lanes compare to
+// all-ones or all-zero masks, as the hardware does
+#if defined(__AVX__)
+typedef __m256 simd_f;
+static inline simd_f simd_set1 (float x) { return _mm256_set1_ps (x); }
+static inline simd_f simd_load (const float* p) { return _mm256_loadu_ps (p); }
+static inline void simd_store (float* p, simd_f a) { _mm256_storeu_ps (p, a); }
+static inline simd_f simd_add (simd_f a, simd_f b) { return _mm256_add_ps (a, b); }
+static inline simd_f simd_sub (simd_f a, simd_f b) { return _mm256_sub_ps (a, b); }
+static inline simd_f simd_mul (simd_f a, simd_f b) { return _mm256_mul_ps (a, b); }
+static inline simd_f simd_div (simd_f a, simd_f b) { return _mm256_div_ps (a, b); }
+static inline simd_f simd_min (simd_f a, simd_f b) { return _mm256_min_ps (a, b); }
+static inline simd_f simd_max (simd_f a, simd_f b) { return _mm256_max_ps (a, b); }
+static inline simd_f simd_ge (simd_f a, simd_f b) { return _mm256_cmp_ps (a, b, _CMP_GE_OQ); }
+static inline simd_f simd_gt (simd_f a, simd_f b) { return _mm256_cmp_ps (a, b, _CMP_GT_OQ); }
+static inline simd_f simd_le (simd_f a, simd_f b) { return _mm256_cmp_ps (a, b, _CMP_LE_OQ); }
+static inline simd_f simd_lt (simd_f a, simd_f b) { return _mm256_cmp_ps (a, b, _CMP_LT_OQ); }
+static inline simd_f simd_and (simd_f a, simd_f b) { return _mm256_and_ps (a, b); }
+static inline int simd_mask (simd_f a) { return _mm256_movemask_ps (a); }
+#elif defined(__SSE2__)
+typedef __m128 simd_f;
+static inline simd_f simd_set1 (float x) { return _mm_set1_ps (x); }
+static inline simd_f simd_load (const float* p) { return _mm_loadu_ps (p); }
+static inline void simd_store (float* p, simd_f a) { _mm_storeu_ps (p, a); }
+static inline simd_f simd_add (simd_f a, simd_f b) { return _mm_add_ps (a, b); }
+static inline simd_f simd_sub (simd_f a, simd_f b) { return _mm_sub_ps (a, b); }
+static inline simd_f simd_mul (simd_f a, simd_f b) { return _mm_mul_ps (a, b); }
+static inline simd_f simd_div (simd_f a, simd_f b) { return _mm_div_ps (a, b); }
+static inline simd_f simd_min (simd_f a, simd_f b) { return _mm_min_ps (a, b); }
+static inline simd_f simd_max (simd_f a, simd_f b) { return _mm_max_ps (a, b); }
+static inline simd_f simd_ge (simd_f a, simd_f b) { return _mm_cmpge_ps (a, b); }
+static inline simd_f simd_gt (simd_f a, simd_f b) { return _mm_cmpgt_ps (a, b); }
+static inline simd_f simd_le (simd_f a, simd_f b) { return _mm_cmple_ps (a, b); }
+static inline simd_f simd_lt (simd_f a, simd_f b) { return _mm_cmplt_ps (a, b); }
+static inline simd_f simd_and (simd_f a, simd_f b) { return _mm_and_ps (a, b); }
+static inline int simd_mask (simd_f a) { return _mm_movemask_ps (a); }
+#else
+struct simd_f {
+    float f[RAY_SIMD_WIDTH];
+};
+#define SIMD_LANES(expr) simd_f r; for (int i = 0; i < RAY_SIMD_WIDTH; i++) { r.f[i] = (expr); } return r
+#define SIMD_TRUE 1.0f
+static inline simd_f simd_set1 (float x) { SIMD_LANES (x); }
+static inline simd_f simd_load (const float* p) { SIMD_LANES (p[i]); }
+static inline void simd_store (float* p, simd_f a) { memcpy (p, a.f, sizeof (a.f)); }
+static inline simd_f simd_add (simd_f a, simd_f b) { SIMD_LANES (a.f[i] + b.f[i]); }
+static inline simd_f simd_sub (simd_f a, simd_f b) { SIMD_LANES (a.f[i] - b.f[i]); }
+static inline simd_f simd_mul (simd_f a, simd_f b) { SIMD_LANES (a.f[i] * b.f[i]); }
+static inline simd_f simd_div (simd_f a, simd_f b) { SIMD_LANES (a.f[i] / b.f[i]); }
+static inline simd_f simd_min (simd_f a, simd_f b) { SIMD_LANES (a.f[i] < b.f[i] ? a.f[i] : b.f[i]); }
+static inline simd_f simd_max (simd_f a, simd_f b) { SIMD_LANES (a.f[i] > b.f[i] ? a.f[i] : b.f[i]); }
+static inline simd_f simd_ge (simd_f a, simd_f b) { SIMD_LANES (a.f[i] >= b.f[i] ? SIMD_TRUE : 0.0f); }
+static inline simd_f simd_gt (simd_f a, simd_f b) { SIMD_LANES (a.f[i] > b.f[i] ? SIMD_TRUE : 0.0f); }
+static inline simd_f simd_le (simd_f a, simd_f b) { SIMD_LANES (a.f[i] <= b.f[i] ? SIMD_TRUE : 0.0f); }
+static inline simd_f simd_lt (simd_f a, simd_f b) { SIMD_LANES (a.f[i] < b.f[i] ? SIMD_TRUE : 0.0f); }
+static inline simd_f simd_and (simd_f a, simd_f b) { SIMD_LANES (a.f[i] != 0.0f && b.f[i] != 0.0f ? SIMD_TRUE : 0.0f); }
+static inline int simd_mask (simd_f a) {
+    int m = 0;
+    for (int i = 0; i < RAY_SIMD_WIDTH; i++) {
+        m |= (a.f[i] != 0.0f) << i;
+    }
+    return m;
+}
+#endif
+
+/*----------------------------------KERNELS-----------------------------------*/
+/* one ray broadcast to every lane */
+struct RayLanes {
+    simd_f o[3];
+    simd_f d[3];
+};
+
+static RayLanes ray_lanes (const Ray& ray) {
+    RayLanes r;
+    for (int a = 0; a < 3; a++) {
+        r.o[a] = simd_set1 (ray.origin.v[a]);
+        r.d[a] = simd_set1 (ray.dir.v[a]);
+    }
+    return r;
+}
+
+/* Moller-Trumbore against every lane of the pack. returns the lane mask of
+hits in (RAY_T_MIN, t_best) and writes t, u, v for all lanes. a degenerate
+lane (det == 0) turns into inf or NaN, which every comparison rejects, so
+there's no separate det test. this relies on IEEE maths, no -ffast-math */
+static int intersect_pack (const RayTrianglePack& p, const RayLanes& r, float t_best, float* t, float* u, float* v) {
+    simd_f e1x = simd_load (p.e1[0]), e1y = simd_load (p.e1[1]), e1z = simd_load (p.e1[2]);
+    simd_f e2x = simd_load (p.e2[0]), e2y = simd_load (p.e2[1]), e2z = simd_load (p.e2[2]);
+    // p = d x e2
+    simd_f px = simd_sub (simd_mul (r.d[1], e2z), simd_mul (r.d[2], e2y));
+    simd_f py = simd_sub (simd_mul (r.d[2], e2x), simd_mul (r.d[0], e2z));
+    simd_f pz = simd_sub (simd_mul (r.d[0], e2y), simd_mul (r.d[1], e2x));
+    simd_f det = simd_add (simd_add (simd_mul (e1x, px), simd_mul (e1y, py)), simd_mul (e1z, pz));
+    simd_f inv_det = simd_div (simd_set1 (1.0f), det);
+    simd_f tx = simd_sub (r.o[0], simd_load (p.v0[0]));
+    simd_f ty = simd_sub (r.o[1], simd_load (p.v0[1]));
+    simd_f tz = simd_sub (r.o[2], simd_load (p.v0[2]));
+    simd_f lu = simd_mul (simd_add (simd_add (simd_mul (tx, px), simd_mul (ty, py)), simd_mul (tz, pz)), inv_det);
+    // q = tvec x e1
+    simd_f qx = simd_sub (simd_mul (ty, e1z), simd_mul (tz, e1y));
+    simd_f qy = simd_sub (simd_mul (tz, e1x), simd_mul (tx, e1z));
+    simd_f qz = simd_sub (simd_mul (tx, e1y), simd_mul (ty, e1x));
+    simd_f lv = simd_mul (simd_add (simd_add (simd_mul (r.d[0], qx), simd_mul (r.d[1], qy)), simd_mul (r.d[2], qz)), inv_det);
+    simd_f lt = simd_mul (simd_add (simd_add (simd_mul (e2x, qx), simd_mul (e2y, qy)), simd_mul (e2z, qz)), inv_det);
+    simd_f zero = simd_set1 (0.0f);
+    simd_f hit = simd_and (simd_ge (lu, zero), simd_ge (lv, zero));
+    hit = simd_and (hit, simd_le (simd_add (lu, lv), simd_set1 (1.0f)));
+    hit = simd_and (hit, simd_gt (lt, simd_set1 (RAY_T_MIN)));
+    hit = simd_and (hit, simd_lt (lt, simd_set1 (t_best)));
+    int mask = simd_mask (hit);
+    if (mask) {
+        simd_store (t, lt);
+        simd_store (u, lu);
+        simd_store (v, lv);
+    }
+    return mask;
+}
+
+/* a ray prepared for slab tests */
+struct SlabRay {
+    float o[3];
+    float inv_d[3];
+};
+
+static SlabRay slab_ray (const Ray& ray) {
+    SlabRay s;
+    for (int a = 0; a < 3; a++) {
+        s.o[a] = ray.origin.v[a];
+        float d = ray.dir.v[a];
+        s.inv_d[a] = d != 0.0f ? 1.0f / d : (d < 0.0f ? -RAY_INV_DIR_HUGE : RAY_INV_DIR_HUGE);
+    }
+    return s;
+}
+
+/* entry distance into box, or a huge value for a miss or an entry past t_max */
+static float slab_entry (const Aabb& b, const SlabRay& r, float t_max) {
+    float t0 = 0.0f, t1 = t_max;
+    for (int a = 0; a < 3; a++) {
+        float tn = (b.min.v[a] - r.o[a]) * r.inv_d[a];
+        float tf = (b.max.v[a] - r.o[a]) * r.inv_d[a];
+        if (tn > tf) {
+            std::swap (tn, tf);
+        }
+        t0 = tn > t0 ? tn : t0;
+        t1 = tf < t1 ? tf : t1;
+    }
+    return t0 <= t1 ? t0 : 3e38f;
+}
+
+/*-----------------------------------BUILD------------------------------------*/
+struct BuildTri {
+    vec3 v[3];
+    vec3 centroid;
+    Aabb bounds;
+    unsigned int index;
+};
+
+struct Builder {
+    RayBvh* bvh;
+    std::vector<BuildTri> tris;
+};
+
+static float aabb_area (const Aabb& b) {
+    vec3 e = b.max - b.min;
+    return 2.0f * (e.v[0] * e.v[1] + e.v[1] * e.v[2] + e.v[2] * e.v[0]);
+}
+
+static void make_leaf (Builder* b, unsigned int node, int begin, int end) {
+    RayBvh* bvh = b->bvh;
+    bvh->nodes[node].first = (unsigned int)bvh->packs.size ();
+    bvh->nodes[node].pack_count = (unsigned int)((end - begin + RAY_SIMD_WIDTH - 1) / RAY_SIMD_WIDTH);
+    for (int first = begin; first < end; first += RAY_SIMD_WIDTH) {
+        RayTrianglePack p;
+        memset (&p, 0, sizeof (p));
+        for (int lane = 0; lane < RAY_SIMD_WIDTH; lane++) {
+            p.triangle[lane] = RAY_NO_HIT;
+            if (first + lane >= end) {
+                continue; // zero edges, det == 0, never hit
+            }
+            const BuildTri& t = b->tris[first + lane];
+            vec3 e1 = t.v[1] - t.v[0], e2 = t.v[2] - t.v[0];
+            for (int a = 0; a < 3; a++) {
+                p.v0[a][lane] = t.v[0].v[a];
+                p.e1[a][lane] = e1.v[a];
+                p.e2[a][lane] = e2.v[a];
+            }
+            p.triangle[lane] = t.index;
+        }
+        bvh->packs.push_back (p);
+    }
+}
+
+static void build_node (Builder* b, unsigned int node, int begin, int end, unsigned int depth) {
+    RayBvh* bvh = b->bvh;
+    if (depth > bvh->depth) {
+        bvh->depth = depth;
+    }
+    Aabb bounds = aabb_empty (), centroids = aabb_empty ();
+    for (int i = begin; i < end; i++) {
+        aabb_merge (&bounds, b->tris[i].bounds);
+        aabb_grow (&centroids, b->tris[i].centroid);
+    }
+    bvh->nodes[node].bounds = bounds;
+    int n = end - begin;
+    if (n <= RAY_LEAF_TRIANGLES || depth + 1 >= RAY_STACK_SIZE) {
+        make_leaf (b, node, begin, end);
+        return;
+    }
+
+    // binned SAH over all three axes
+    int best_axis = -1, best_split = 0;
+    float best_cost = 1e30f;
+    for (int axis = 0; axis < 3; axis++) {
+        float lo = centroids.min.v[axis], extent = centroids.max.v[axis] - lo;
+        if (extent <= 0.0f) {
+            continue;
+        }
+        float to_bin = (float)RAY_BVH_BINS / extent;
+        int count[RAY_BVH_BINS] = {0};
+        Aabb bin_bounds[RAY_BVH_BINS];
+        for (int k = 0; k < RAY_BVH_BINS; k++) {
+            bin_bounds[k] = aabb_empty ();
+        }
+        for (int i = begin; i < end; i++) {
+            int k = std::min (RAY_BVH_BINS - 1, (int)((b->tris[i].centroid.v[axis] - lo) * to_bin));
+            count[k]++;
+            aabb_merge (&bin_bounds[k], b->tris[i].bounds);
+        }
+        // sweep from the right to get the right side areas, then from the left
+        float right_area[RAY_BVH_BINS];
+        int right_count[RAY_BVH_BINS];
+        Aabb acc = aabb_empty ();
+        int acc_count = 0;
+        for (int k = RAY_BVH_BINS - 1; k > 0; k--) {
+            aabb_merge (&acc, bin_bounds[k]);
+            acc_count += count[k];
+            right_area[k] = acc_count ? aabb_area (acc) : 0.0f;
+            right_count[k] = acc_count;
+        }
+        acc = aabb_empty ();
+        acc_count = 0;
+        for (int k = 0; k < RAY_BVH_BINS - 1; k++) {
+            aabb_merge (&acc, bin_bounds[k]);
+            acc_count += count[k];
+            if (acc_count == 0 || right_count[k + 1] == 0) {
+                continue;
+            }
+            // leaves are tested a pack at a time, so cost by packs, not triangles
+            float cost = aabb_area (acc) * (float)((acc_count + RAY_SIMD_WIDTH - 1) / RAY_SIMD_WIDTH) +
+                         right_area[k + 1] * (float)((right_count[k + 1] + RAY_SIMD_WIDTH - 1) / RAY_SIMD_WIDTH);
+            if (cost < best_cost) {
+                best_cost = cost;
+                best_axis = axis;
+                best_split = k;
+            }
+        }
+    }
+
+    int mid;
+    if (best_axis < 0) {
+        mid = begin + n / 2; // every centroid in one spot, any split will do
+    } else {
+        float lo = centroids.min.v[best_axis];
+        float to_bin = (float)RAY_BVH_BINS / (centroids.max.v[best_axis] - lo);
+        BuildTri* split = std::partition (&b->tris[begin], &b->tris[0] + end, [=] (const BuildTri& t) {
+            return std::min (RAY_BVH_BINS - 1, (int)((t.centroid.v[best_axis] - lo) * to_bin)) <= best_split;
+        });
+        mid = (int)(split - &b->tris[0]);
+        if (mid == begin || mid == end) {
+            mid = begin + n / 2;
+        }
+    }
+    unsigned int left = (unsigned int)bvh->nodes.size ();
+    bvh->nodes.resize (bvh->nodes.size () + 2);
+    bvh->nodes[node].first = left;
+    bvh->nodes[node].pack_count = 0;
+    build_node (b, left, begin, mid, depth + 1);
+    build_node (b, left + 1, mid, end, depth + 1);
+}
+
+void ray_bvh_build (RayBvh* bvh, const Mesh* meshes, const mat4* transforms, int mesh_count) {
+    MemoryScope scope (MEMORY_SCENE);
+    auto t0 = std::chrono::steady_clock::now ();
+    bvh->nodes.clear ();
+    bvh->packs.clear ();
+    bvh->triangle_mesh.clear ();
+    bvh->triangle_first.clear ();
+    bvh->depth = 0;
+    Builder b;
+    b.bvh = bvh;
+    for (int mi = 0; mi < mesh_count; mi++) {
+        const Mesh& m = meshes[mi];
+        bvh->triangle_first.push_back ((unsigned int)b.tris.size ());
+        for (size_t i = 0; i + 2 < m.indices.size (); i += 3) {
+            BuildTri t;
+            t.bounds = aabb_empty ();
+            for (int k = 0; k < 3; k++) {
+                vec3 p = m.positions[m.indices[i + k]];
+                if (transforms) {
+                    vec4 w = transforms[mi] * vec4 (p, 1.0f);
+                    p = vec3 (w.v[0], w.v[1], w.v[2]);
+                }
+                t.v[k] = p;
+                aabb_grow (&t.bounds, p);
+            }
+            t.centroid = (t.v[0] + t.v[1] + t.v[2]) * (1.0f / 3.0f);
+            t.index = (unsigned int)b.tris.size ();
+            b.tris.push_back (t);
+            bvh->triangle_mesh.push_back ((unsigned int)mi);
+        }
+    }
+    bvh->triangle_count = (unsigned int)b.tris.size ();
+    bvh->nodes.reserve (b.tris.size () / 2 + 1);
+    bvh->nodes.resize (1);
+    if (b.tris.empty ()) {
+        bvh->nodes[0].bounds = aabb_empty ();
+        bvh->nodes[0].first = 0;
+        bvh->nodes[0].pack_count = 0;
+    } else {
+        build_node (&b, 0, 0, (int)b.tris.size (), 0);
+    }
+    bvh->build_ms = std::chrono::duration<double, std::milli> (std::chrono::steady_clock::now () - t0).count ();
+}
+
+/*---------------------------------TRAVERSAL----------------------------------*/
+static void set_hit (const RayBvh& bvh, unsigned int triangle, float t, float u, float v, RayHit* hit) {
+    hit->t = t;
+    hit->u = u;
+    hit->v = v;
+    hit->triangle = triangle;
+    hit->mesh = triangle == RAY_NO_HIT ? 0 : bvh.triangle_mesh[triangle];
+}
+
+/* tests a leaf's packs, updates best and hit. returns true on any hit */
+static bool test_leaf (const RayBvh& bvh, const RayBvhNode& node, const RayLanes& lanes, float* best,
+                       RayHit* hit) {
+    bool any = false;
+    float t[RAY_SIMD_WIDTH], u[RAY_SIMD_WIDTH], v[RAY_SIMD_WIDTH];
+    for (unsigned int p = 0; p < node.pack_count; p++) {
+        const RayTrianglePack& pack = bvh.packs[node.first + p];
+        int mask = intersect_pack (pack, lanes, *best, t, u, v);
+        for (int lane = 0; mask; lane++, mask >>= 1) {
+            if ((mask & 1) && t[lane] < *best) {
+                *best = t[lane];
+                set_hit (bvh, pack.triangle[lane], t[lane], u[lane], v[lane], hit);
+                any = true;
+            }
+        }
+    }
+    return any;
+}
+
+bool raycast_closest (const RayBvh& bvh, const Ray& ray, RayHit* hit) {
+    set_hit (bvh, RAY_NO_HIT, ray.t_max, 0.0f, 0.0f, hit);
+    if (bvh.nodes.empty ()) {
+        return false;
+    }
+    RayLanes lanes = ray_lanes (ray);
+    SlabRay slab = slab_ray (ray);
+    float best = ray.t_max;
+    if (slab_entry (bvh.nodes[0].bounds, slab, best) > best) {
+        return false;
+    }
+    // stack entries remember how far away the box was, so boxes that a later
+    // hit moved out of range are skipped without a second test
+    unsigned int stack[RAY_STACK_SIZE];
+    float stack_t[RAY_STACK_SIZE];
+    int sp = 0;
+    unsigned int index = 0;
+    while (true) {
+        const RayBvhNode& node = bvh.nodes[index];
+        if (node.pack_count > 0) {
+            test_leaf (bvh, node, lanes, &best, hit);
+        } else {
+            unsigned int a = node.first, b = node.first + 1;
+            float ta = slab_entry (bvh.nodes[a].bounds, slab, best);
+            float tb = slab_entry (bvh.nodes[b].bounds, slab, best);
+            if (tb < ta) {
+                std::swap (a, b);
+                std::swap (ta, tb);
+            }
+            if (ta <= best) {
+                if (tb <= best) {
+                    stack[sp] = b;
+                    stack_t[sp++] = tb;
+                }
+                index = a;
+                continue;
+            }
+        }
+        // pop the next box still in range
+        while (sp > 0 && stack_t[sp - 1] > best) {
+            sp--;
+        }
+        if (sp == 0) {
+            break;
+        }
+        index = stack[--sp];
+    }
+    return hit->triangle != RAY_NO_HIT;
+}
+
+bool raycast_any (const RayBvh& bvh, const Ray& ray) {
+    if (bvh.nodes.empty ()) {
+        return false;
+    }
+    RayLanes lanes = ray_lanes (ray);
+    SlabRay slab = slab_ray (ray);
+    float t[RAY_SIMD_WIDTH], u[RAY_SIMD_WIDTH], v[RAY_SIMD_WIDTH];
+    unsigned int stack[RAY_STACK_SIZE];
+    int sp = 0;
+    stack[sp++] = 0;
+    while (sp > 0) {
+        const RayBvhNode& node = bvh.nodes[stack[--sp]];
+        if (slab_entry (node.bounds, slab, ray.t_max) > ray.t_max) {
+            continue;
+        }
+        if (node.pack_count > 0) {
+            for (unsigned int p = 0; p < node.pack_count; p++) {
+                if (intersect_pack (bvh.packs[node.first + p], lanes, ray.t_max, t, u, v)) {
+                    return true;
+                }
+            }
+        } else {
+            stack[sp++] = node.first;
+            stack[sp++] = node.first + 1;
+        }
+    }
+    return false;
+}
+
+/* packet rays in SoA form, padded to whole SIMD groups */
+struct RayPacket {
+    float o[3][RAY_PACKET_MAX];
+    float inv_d[3][RAY_PACKET_MAX];
+    float best[RAY_PACKET_MAX];
+    int count;
+    int groups;
+};
+
+/* bit i set if ray i of the packet may hit box before its best hit */
+static unsigned long long packet_box_mask (const RayPacket& p, const Aabb& b) {
+    unsigned long long mask = 0;
+    simd_f bmin[3], bmax[3];
+    for (int a = 0; a < 3; a++) {
+        bmin[a] = simd_set1 (b.min.v[a]);
+        bmax[a] = simd_set1 (b.max.v[a]);
+    }
+    for (int g = 0; g < p.groups; g++) {
+        int first = g * RAY_SIMD_WIDTH;
+        simd_f t0 = simd_set1 (0.0f), t1 = simd_load (p.best + first);
+        for (int a = 0; a < 3; a++) {
+            simd_f o = simd_load (p.o[a] + first), inv = simd_load (p.inv_d[a] + first);
+            simd_f tn = simd_mul (simd_sub (bmin[a], o), inv);
+            simd_f tf = simd_mul (simd_sub (bmax[a], o), inv);
+            t0 = simd_max (t0, simd_min (tn, tf));
+            t1 = simd_min (t1, simd_max (tn, tf));
+        }
+        mask |= (unsigned long long)simd_mask (simd_le (t0, t1)) << first;
+    }
+    return p.count == 64 ? mask : mask & ((1ull << p.count) - 1ull);
+}
+
+void raycast_packet (const RayBvh& bvh, const Ray* rays, int count, RayHit* hits) {
+    count = std::min (count, RAY_PACKET_MAX);
+    RayPacket p;
+    p.count = count;
+    p.groups = (count + RAY_SIMD_WIDTH - 1) / RAY_SIMD_WIDTH;
+    for (int i = 0; i < p.groups * RAY_SIMD_WIDTH; i++) {
+        // padding lanes get a negative range, which no box passes
+        SlabRay s = slab_ray (rays[i < count ? i : 0]);
+        for (int a = 0; a < 3; a++) {
+            p.o[a][i] = s.o[a];
+            p.inv_d[a][i] = s.inv_d[a];
+        }
+        p.best[i] = i < count ? rays[i].t_max : -1.0f;
+        if (i < count) {
+            set_hit (bvh, RAY_NO_HIT, rays[i].t_max, 0.0f, 0.0f, &hits[i]);
+        }
+    }
+    if (bvh.nodes.empty () || count == 0) {
+        return;
+    }
+    RayLanes lanes[RAY_PACKET_MAX];
+    for (int i = 0; i < count; i++) {
+        lanes[i] = ray_lanes (rays[i]);
+    }
+    // front to back along the first ray is good enough for a coherent packet
+    const vec3& dir = rays[0].dir;
+    unsigned int stack[RAY_STACK_SIZE];
+    int sp = 0;
+    stack[sp++] = 0;
+    while (sp > 0) {
+        const RayBvhNode& node = bvh.nodes[stack[--sp]];
+        unsigned long long active = packet_box_mask (p, node.bounds);
+        if (!active) {
+            continue;
+        }
+        if (node.pack_count > 0) {
+            for (int i = 0; active; i++, active >>= 1) {
+                if (active & 1) {
+                    test_leaf (bvh, node, lanes[i], &p.best[i], &hits[i]);
+                }
+            }
+            continue;
+        }
+        unsigned int a = node.first, b = node.first + 1;
+        vec3 between = aabb_center (bvh.nodes[b].bounds) - aabb_center (bvh.nodes[a].bounds);
+        if (dot (between, dir) < 0.0f) {
+            std::swap (a, b);
+        }
+        stack[sp++] = b;
+        stack[sp++] = a;
+    }
+}
+
+void raycast_batch (const RayBvh& bvh, const Ray* rays, int count, RayHit* hits, int packet_size) {
+    packet_size = std::max (1, std::min (packet_size, RAY_PACKET_MAX));
+    int packets = (count + packet_size - 1) / packet_size;
+    parallel_for_each (packets, 4, [&bvh, rays, count, hits, packet_size] (int begin, int end) {
+        for (int k = begin; k < end; k++) {
+            int first = k * packet_size;
+            raycast_packet (bvh, rays + first, std::min (packet_size, count - first), hits + first);
+        }
+    });
+}
+
+/*----------------------------------CAMERA------------------------------------*/
+Ray ray_from_screen (const mat4& view, const mat4& proj, float x, float y, int width, int height) {
+    mat4 inv = inverse (proj * view);
+    float nx = 2.0f * x / (float)width - 1.0f;
+    float ny = 1.0f - 2.0f * y / (float)height;
+    vec4 near_p = inv * vec4 (nx, ny, -1.0f, 1.0f);
+    vec4 far_p = inv * vec4 (nx, ny, 1.0f, 1.0f);
+    vec3 a (near_p.v[0] / near_p.v[3], near_p.v[1] / near_p.v[3], near_p.v[2] / near_p.v[3]);
+    vec3 b (far_p.v[0] / far_p.v[3], far_p.v[1] / far_p.v[3], far_p.v[2] / far_p.v[3]);
+    Ray r;
+    r.origin = a;
+    r.t_max = length (b - a);
+    r.dir = (b - a) * (1.0f / r.t_max);
+    return r;
+}
+
+Ray ray_from_view (const mat4& view, float t_max) {
+    Ray r;
+    r.origin = view_matrix_eye (view);
+    r.dir = camera_orientation_forward (view);
+    r.t_max = t_max;
+    return r;
+}
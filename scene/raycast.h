@@ -0,0 +1,95 @@
+//
+// Ray queries against scene triangles.
+//
+// Triangles go into a bounding volume hierarchy built with binned SAH. Each
+// leaf holds up to RAY_LEAF_TRIANGLES triangles, stored as packs of
+// RAY_SIMD_WIDTH in structure of arrays form: vertex 0 and the two edges,
+// one lane per triangle. The Moller-Trumbore test then runs on a whole pack
+// at once, 8 wide with AVX, 4 wide with SSE, and one at a time otherwise.
+//
+// Three kinds of query:
+//  - closest hit, visiting the nearer child first and skipping boxes
+//    beyond the best hit so far
+//  - any hit, stopping at the first triangle in range (line of sight,
+//    shadow rays)
+//  - packets of up to RAY_PACKET_MAX closest-hit rays that walk the tree
+//    together. Box tests run across rays with SIMD. This is the fast path
+//    for coherent rays such as a tile of screen pixels.
+// raycast_batch splits any number of rays into packets on the job system.
+//
+
+#ifndef FPS_STYLE_ROOM_RAYCAST_H
+#define FPS_STYLE_ROOM_RAYCAST_H
+
+#include <vector>
+#include <geometry/mesh.h>
+
+#if defined(__AVX__)
+#define RAY_SIMD_WIDTH 8
+#else
+#define RAY_SIMD_WIDTH 4
+#endif
+#define RAY_LEAF_TRIANGLES 8
+#define RAY_PACKET_MAX 64
+#define RAY_NO_HIT 0xFFFFFFFFu
+
+struct Ray {
+    vec3 origin;
+    vec3 dir;      // need not be normalised, t is in units of dir
+    float t_max;
+};
+
+struct RayHit {
+    float t;
+    float u, v;             // barycentrics of vertices 1 and 2
+    unsigned int triangle;  // index in build order, RAY_NO_HIT if nothing was hit
+    unsigned int mesh;      // which of the meshes passed to ray_bvh_build
+};
+
+/* RAY_SIMD_WIDTH triangles, one per lane. unused lanes are degenerate */
+struct RayTrianglePack {
+    float v0[3][RAY_SIMD_WIDTH];
+    float e1[3][RAY_SIMD_WIDTH];
+    float e2[3][RAY_SIMD_WIDTH];
+    unsigned int triangle[RAY_SIMD_WIDTH];
+};
+
+/* leaf if pack_count > 0, otherwise children are first and first + 1 */
+struct RayBvhNode {
+    Aabb bounds;
+    unsigned int first;
+    unsigned int pack_count;
+};
+
+struct RayBvh {
+    std::vector<RayBvhNode> nodes;
+    std::vector<RayTrianglePack> packs;
+    std::vector<unsigned int> triangle_mesh;   // triangle -> mesh
+    std::vector<unsigned int> triangle_first;  // first triangle of each mesh
+    unsigned int triangle_count;
+    unsigned int depth;
+    double build_ms;
+};
+
+/* builds over every triangle of meshes[i] transformed by transforms[i]
+(transforms may be NULL for world space meshes). triangle numbers run through
+the meshes in order */
+void ray_bvh_build (RayBvh* bvh, const Mesh* meshes, const mat4* transforms, int mesh_count);
+
+/* closest hit in (0, ray.t_max]. false and hit->triangle = RAY_NO_HIT on a miss */
+bool raycast_closest (const RayBvh& bvh, const Ray& ray, RayHit* hit);
+/* true if anything is hit in (0, ray.t_max] */
+bool raycast_any (const RayBvh& bvh, const Ray& ray);
+/* closest hit for each of count <= RAY_PACKET_MAX rays, walking the tree once */
+void raycast_packet (const RayBvh& bvh, const Ray* rays, int count, RayHit* hits);
+/* closest hits for any number of rays, packet_size rays to a packet, packets
+spread over the job system */
+void raycast_batch (const RayBvh& bvh, const Ray* rays, int count, RayHit* hits, int packet_size);
+
+/* ray through pixel (x, y) of a width x height viewport, y down as GLFW
+reports the cursor. starts on the near plane and ends on the far plane */
+Ray ray_from_screen (const mat4& view, const mat4& proj, float x, float y, int width, int height);
+/* ray from the eye along the view direction */
+Ray ray_from_view (const mat4& view, float t_max);
+
+#endif //FPS_STYLE_ROOM_RAYCAST_H
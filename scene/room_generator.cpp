@@ -0,0 +1,537 @@
+//
+// Level layout, surface tessellation and prop meshes. See room_generator.h.
+//
+
+#include "room_generator.h"
+#include <memory/memory_tracker.h>
+#include <scene/scene_store.h>
+#include <jobs/job_system.h>
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include <string.h>
+
+/*-----------------------------------RANDOM-----------------------------------*/
+static inline uint32_t hash32 (uint32_t x) {
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+/* one independent stream per room or library mesh. stream 0 is the layout */
+struct RoomRng {
+    uint32_t state;
+};
+
+static RoomRng rng_stream (uint32_t seed, uint32_t stream) {
+    RoomRng r;
+    r.state = hash32 (seed ^ hash32 (stream * 0x9e3779b9u + 0x632be5abu));
+    return r;
+}
+
+static inline uint32_t rng_next (RoomRng* r) {
+    r->state += 0x9e3779b9u;
+    return hash32 (r->state);
+}
+
+static inline float rng_float (RoomRng* r, float lo, float hi) {
+    return lo + (hi - lo) * (float)(rng_next (r) >> 8) * (1.0f / 16777216.0f);
+}
+
+static inline int rng_int (RoomRng* r, int n) {
+    return (int)(rng_next (r) % (uint32_t)n);
+}
+
+/*-----------------------------------SURFACES---------------------------------*/
+static const vec3 up_axis (0.0f, 1.0f, 0.0f);
+
+static inline int tiles (float length, float tile_size) {
+    return std::max (1, (int)(length / tile_size + 0.5f));
+}
+
+/* a parallelogram from origin spanned by u and v, nu x nv quads. faces
+along cross (u, v) */
+static void add_grid (Mesh* m, const vec3& origin, const vec3& u, const vec3& v, int nu, int nv) {
+    unsigned int base = (unsigned int)m->positions.size ();
+    for (int j = 0; j <= nv; j++) {
+        for (int i = 0; i <= nu; i++) {
+            m->positions.push_back (origin + u * ((float)i / nu) + v * ((float)j / nv));
+        }
+    }
+    unsigned int row = (unsigned int)nu + 1;
+    for (int j = 0; j < nv; j++) {
+        for (int i = 0; i < nu; i++) {
+            unsigned int a = base + j * row + i;
+            unsigned int idx[6] = {a, a + 1, a + row, a + 1, a + row + 1, a + row};
+            m->indices.insert (m->indices.end (), idx, idx + 6);
+        }
+    }
+}
+
+/* vertical strip of wall on the floor line through centre, facing n, from
+along = lo to hi and y0 to y1 */
+static void add_wall (Mesh* m, const vec3& centre, const vec3& n, float lo, float hi, float y0, float y1,
+                      float tile_size) {
+    if (hi - lo <= 1e-4f || y1 - y0 <= 1e-4f) {
+        return;
+    }
+    vec3 d = cross (up_axis, n);
+    add_grid (m, centre + d * lo + up_axis * y0, d * (hi - lo), up_axis * (y1 - y0), tiles (hi - lo, tile_size),
+              tiles (y1 - y0, tile_size));
+}
+
+/* floor (facing up) or ceiling (facing down) over the rectangle from corner
+spanned by a and b, which must be horizontal */
+static void add_slab (Mesh* m, const vec3& corner, const vec3& a, const vec3& b, bool facing_up, float tile_size) {
+    int na = tiles (length (a), tile_size), nb = tiles (length (b), tile_size);
+    bool a_first = (cross (a, b).v[1] > 0.0f) == facing_up;
+    if (a_first) {
+        add_grid (m, corner, a, b, na, nb);
+    } else {
+        add_grid (m, corner, b, a, nb, na);
+    }
+}
+
+/*-----------------------------------PROPS------------------------------------*/
+/* closed surface of revolution about y, outward facing. radius (t, angle)
+gives the radius at height t * height */
+template <typename Fn>
+static void add_lathe (Mesh* m, int segments, int rings, float height, const Fn& radius) {
+    unsigned int base = (unsigned int)m->positions.size ();
+    for (int r = 0; r <= rings; r++) {
+        float t = (float)r / rings;
+        for (int s = 0; s < segments; s++) {
+            float a = 6.2831853f * (float)s / segments;
+            float rad = radius (t, a);
+            m->positions.push_back (vec3 (rad * cosf (a), t * height, rad * sinf (a)));
+        }
+    }
+    for (int r = 0; r < rings; r++) {
+        for (int s = 0; s < segments; s++) {
+            unsigned int a = base + r * segments + s;
+            unsigned int b = base + r * segments + (s + 1) % segments;
+            unsigned int idx[6] = {a, a + segments, b, b, a + segments, b + segments};
+            m->indices.insert (m->indices.end (), idx, idx + 6);
+        }
+    }
+    // caps: a centre vertex fanned to the first and last rings
+    unsigned int bottom = (unsigned int)m->positions.size ();
+    m->positions.push_back (vec3 (0.0f, 0.0f, 0.0f));
+    m->positions.push_back (vec3 (0.0f, height, 0.0f));
+    unsigned int top_ring = base + rings * segments;
+    for (int s = 0; s < segments; s++) {
+        unsigned int s1 = (s + 1) % segments;
+        unsigned int idx[6] = {bottom, base + s, base + s1, bottom + 1, top_ring + s1, top_ring + s};
+        m->indices.insert (m->indices.end (), idx, idx + 6);
+    }
+}
+
+static void make_crate (Mesh* m, RoomRng* rng, int detail) {
+    vec3 h (rng_float (rng, 0.3f, 0.6f), rng_float (rng, 0.3f, 0.6f), rng_float (rng, 0.3f, 0.6f));
+    int n = 2 * detail;
+    vec3 x (2.0f * h.v[0], 0.0f, 0.0f), y (0.0f, 2.0f * h.v[1], 0.0f), z (0.0f, 0.0f, 2.0f * h.v[2]);
+    vec3 lo (-h.v[0], 0.0f, -h.v[2]), hi (h.v[0], 2.0f * h.v[1], h.v[2]);
+    add_grid (m, lo, x, z, n, n);                    // bottom, -y
+    add_grid (m, hi, -z, -x, n, n);                  // top, +y
+    add_grid (m, lo, y, x, n, n);                    // -z
+    add_grid (m, hi, -x, -y, n, n);                  // +z
+    add_grid (m, lo, z, y, n, n);                    // -x
+    add_grid (m, hi, -y, -z, n, n);                  // +x
+}
+
+static void make_barrel (Mesh* m, RoomRng* rng, int detail) {
+    float r = rng_float (rng, 0.3f, 0.45f), h = rng_float (rng, 0.8f, 1.2f), bulge = rng_float (rng, 0.05f, 0.15f);
+    add_lathe (m, 8 * detail, 2 * detail, h, [&] (float t, float) { return r * (1.0f + bulge * sinf (3.14159265f * t)); });
+}
+
+static void make_pillar (Mesh* m, RoomRng* rng, int detail, float height) {
+    float r = rng_float (rng, 0.25f, 0.4f), flutes = (float)(6 + 2 * rng_int (rng, 4));
+    add_lathe (m, 6 * detail, 4 * detail, height, [&] (float t, float a) {
+        // wider at the foot and the capital, fluted in between
+        float end = fmaxf (0.0f, fmaxf (0.08f - t, t - 0.92f)) * 3.0f;
+        return r * (1.0f + end + 0.04f * cosf (flutes * a));
+    });
+}
+
+/* a lumpy ellipsoid standing on y = 0 */
+static void make_rock (Mesh* m, RoomRng* rng, int detail) {
+    int segments = 8 * detail, rings = 4 * detail;
+    float radius = rng_float (rng, 0.3f, 0.8f), squash = rng_float (rng, 0.5f, 0.8f);
+    float fa[3], fb[3], phase[3];
+    for (int k = 0; k < 3; k++) {
+        fa[k] = (float)(2 + rng_int (rng, 4));
+        fb[k] = (float)(1 + rng_int (rng, 4));
+        phase[k] = rng_float (rng, 0.0f, 6.2831853f);
+    }
+    unsigned int base = (unsigned int)m->positions.size ();
+    m->positions.push_back (vec3 (0.0f, -radius, 0.0f));
+    for (int r = 1; r < rings; r++) {
+        float polar = 3.14159265f * (float)r / rings;
+        for (int s = 0; s < segments; s++) {
+            float a = 6.2831853f * (float)s / segments;
+            float bump = 1.0f;
+            for (int k = 0; k < 3; k++) {
+                bump += 0.08f * sinf (fa[k] * a + phase[k]) * sinf (fb[k] * polar);
+            }
+            float rad = radius * bump;
+            m->positions.push_back (vec3 (rad * sinf (polar) * cosf (a), -rad * cosf (polar), rad * sinf (polar) * sinf (a)));
+        }
+    }
+    m->positions.push_back (vec3 (0.0f, radius, 0.0f));
+    unsigned int top = (unsigned int)m->positions.size () - 1;
+    for (int s = 0; s < segments; s++) {
+        unsigned int s1 = (s + 1) % segments;
+        unsigned int idx[3] = {base, base + 1 + s, base + 1 + s1};
+        m->indices.insert (m->indices.end (), idx, idx + 3);
+    }
+    for (int r = 0; r < rings - 2; r++) {
+        for (int s = 0; s < segments; s++) {
+            unsigned int a = base + 1 + r * segments + s;
+            unsigned int b = base + 1 + r * segments + (s + 1) % segments;
+            unsigned int idx[6] = {a, a + segments, b, b, a + segments, b + segments};
+            m->indices.insert (m->indices.end (), idx, idx + 6);
+        }
+    }
+    unsigned int last = base + 1 + (rings - 2) * segments;
+    for (int s = 0; s < segments; s++) {
+        unsigned int s1 = (s + 1) % segments;
+        unsigned int idx[3] = {top, last + s1, last + s};
+        m->indices.insert (m->indices.end (), idx, idx + 3);
+    }
+    // squash and stand on the floor
+    float min_y = 1e30f;
+    for (size_t i = base; i < m->positions.size (); i++) {
+        min_y = fminf (min_y, m->positions[i].v[1] * squash);
+    }
+    for (size_t i = base; i < m->positions.size (); i++) {
+        m->positions[i].v[1] = m->positions[i].v[1] * squash - min_y;
+    }
+}
+
+/*-----------------------------------LAYOUT-----------------------------------*/
+RoomGenParams room_gen_default_params (uint32_t seed) {
+    RoomGenParams p;
+    p.seed = seed;
+    p.rooms_x = 8;
+    p.rooms_z = 8;
+    p.room_size = 12.0f;
+    p.corridor_length = 4.0f;
+    p.corridor_width = 2.0f;
+    p.wall_height = 4.0f;
+    p.door_height = 2.5f;
+    p.tile_size = 0.5f;
+    p.extra_links = 8;
+    p.props_per_room = 60;
+    p.variants_per_kind = 4;
+    p.detail = 4;
+    return p;
+}
+
+static int find_root (std::vector<int>& parent, int i) {
+    while (parent[i] != i) {
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+    }
+    return i;
+}
+
+/* which rooms are joined: link_east[r] / link_south[r] for room r and its
++x / +z neighbour. a random spanning tree plus extra_links */
+static void plan_links (const RoomGenParams& p, std::vector<unsigned char>* link_east,
+                        std::vector<unsigned char>* link_south) {
+    int rooms = p.rooms_x * p.rooms_z;
+    link_east->assign (rooms, 0);
+    link_south->assign (rooms, 0);
+    // edge e: room e / 2, east if even, south if odd
+    std::vector<int> edges;
+    for (int r = 0; r < rooms; r++) {
+        if (r % p.rooms_x + 1 < p.rooms_x) {
+            edges.push_back (r * 2);
+        }
+        if (r / p.rooms_x + 1 < p.rooms_z) {
+            edges.push_back (r * 2 + 1);
+        }
+    }
+    RoomRng rng = rng_stream (p.seed, 0);
+    for (int i = (int)edges.size () - 1; i > 0; i--) {
+        std::swap (edges[i], edges[rng_int (&rng, i + 1)]);
+    }
+    std::vector<int> parent (rooms);
+    for (int r = 0; r < rooms; r++) {
+        parent[r] = r;
+    }
+    int extra = p.extra_links;
+    for (size_t i = 0; i < edges.size (); i++) {
+        int r = edges[i] / 2;
+        bool east = (edges[i] & 1) == 0;
+        int other = east ? r + 1 : r + p.rooms_x;
+        int a = find_root (parent, r), b = find_root (parent, other);
+        if (a == b) {
+            if (extra <= 0) {
+                continue;
+            }
+            extra--;
+        }
+        parent[a] = b;
+        (east ? *link_east : *link_south)[r] = 1;
+    }
+}
+
+static inline vec3 room_centre (const RoomGenParams& p, int r) {
+    float pitch = p.room_size + p.corridor_length;
+    return vec3 ((float)(r % p.rooms_x) * pitch, 0.0f, (float)(r / p.rooms_x) * pitch);
+}
+
+/* directions out of a room: +x, -x, +z, -z */
+static const vec3 side_dir[4] = {vec3 (1.0f, 0.0f, 0.0f), vec3 (-1.0f, 0.0f, 0.0f), vec3 (0.0f, 0.0f, 1.0f),
+                                 vec3 (0.0f, 0.0f, -1.0f)};
+
+static void room_doors (const RoomGenParams& p, const std::vector<unsigned char>& east,
+                        const std::vector<unsigned char>& south, int r, bool* door) {
+    int x = r % p.rooms_x;
+    door[0] = east[r] != 0;
+    door[1] = x > 0 && east[r - 1] != 0;
+    door[2] = south[r] != 0;
+    door[3] = r >= p.rooms_x && south[r - p.rooms_x] != 0;
+}
+
+/* a room and the corridors leaving it east and south, in world space */
+static void build_architecture (const RoomGenParams& p, const bool* door, bool corridor_east, bool corridor_south,
+                                const vec3& c, Mesh* m) {
+    float h = p.room_size * 0.5f, w = p.corridor_width, ts = p.tile_size;
+    vec3 corner = c - vec3 (h, 0.0f, h);
+    vec3 ax (p.room_size, 0.0f, 0.0f), az (0.0f, 0.0f, p.room_size);
+    add_slab (m, corner, ax, az, true, ts);
+    add_slab (m, corner + up_axis * p.wall_height, ax, az, false, ts);
+    for (int s = 0; s < 4; s++) {
+        vec3 centre = c + side_dir[s] * h, n = -side_dir[s];
+        if (!door[s]) {
+            add_wall (m, centre, n, -h, h, 0.0f, p.wall_height, ts);
+            continue;
+        }
+        add_wall (m, centre, n, -h, -0.5f * w, 0.0f, p.wall_height, ts);
+        add_wall (m, centre, n, 0.5f * w, h, 0.0f, p.wall_height, ts);
+        add_wall (m, centre, n, -0.5f * w, 0.5f * w, p.door_height, p.wall_height, ts);
+    }
+    for (int k = 0; k < 2; k++) {
+        if (!(k == 0 ? corridor_east : corridor_south)) {
+            continue;
+        }
+        vec3 e = side_dir[k == 0 ? 0 : 2];
+        vec3 side = cross (e, up_axis);
+        vec3 start = c + e * h;
+        vec3 along = e * p.corridor_length, across = side * w;
+        vec3 corridor_corner = start - side * (0.5f * w);
+        add_slab (m, corridor_corner, along, across, true, ts);
+        add_slab (m, corridor_corner + up_axis * p.door_height, along, across, false, ts);
+        vec3 mid = start + e * (0.5f * p.corridor_length);
+        float half_len = 0.5f * p.corridor_length;
+        add_wall (m, mid - side * (0.5f * w), side, -half_len, half_len, 0.0f, p.door_height, ts);
+        add_wall (m, mid + side * (0.5f * w), -side, -half_len, half_len, 0.0f, p.door_height, ts);
+    }
+}
+
+/* the doorway polygon in the plane through centre facing along e */
+static void add_doorway (PortalWorld* world, const RoomGenParams& p, const vec3& centre, const vec3& e, int a, int b) {
+    vec3 side = cross (e, up_axis) * (0.5f * p.corridor_width);
+    vec3 v[4] = {centre - side, centre + side, centre + side + up_axis * p.door_height,
+                 centre - side + up_axis * p.door_height};
+    portal_world_add_portal (world, a, b, v, 4);
+}
+
+static void place_props (const RoomGenParams& p, const GeneratedLevel& level, const std::vector<Aabb>& library_bounds,
+                         const bool* door, const vec3& c, int room, RoomRng* rng, std::vector<RoomInstance>* out) {
+    float h = p.room_size * 0.5f, lane = 0.5f * p.corridor_width + 0.5f;
+    for (int i = 0; i < p.props_per_room; i++) {
+        float x = 0.0f, z = 0.0f;
+        // keep doorways clear: a few tries, then whatever came last
+        for (int attempt = 0; attempt < 4; attempt++) {
+            x = rng_float (rng, -h + 1.0f, h - 1.0f);
+            z = rng_float (rng, -h + 1.0f, h - 1.0f);
+            bool blocked = (door[0] && x > h - 2.0f && fabsf (z) < lane) ||
+                           (door[1] && x < -h + 2.0f && fabsf (z) < lane) ||
+                           (door[2] && z > h - 2.0f && fabsf (x) < lane) ||
+                           (door[3] && z < -h + 2.0f && fabsf (x) < lane);
+            if (!blocked) {
+                break;
+            }
+        }
+        RoomInstance inst;
+        inst.mesh = (unsigned int)rng_int (rng, (int)level.library_meshes);
+        float s = rng_float (rng, 0.8f, 1.2f);
+        // pillars are as tall as the room, don't scale them through the ceiling
+        if ((int)inst.mesh / p.variants_per_kind == ROOM_PROP_PILLAR) {
+            s = 1.0f;
+        }
+        versor q = quat_from_axis_deg (rng_float (rng, 0.0f, 360.0f), 0.0f, 1.0f, 0.0f);
+        inst.world = scene_local_matrix (c + vec3 (x, 0.0f, z), q, vec3 (s, s, s));
+        inst.world_bounds = aabb_transform (library_bounds[inst.mesh], inst.world);
+        inst.cell = room;
+        out->push_back (inst);
+    }
+}
+
+void room_generate (const RoomGenParams& p, GeneratedLevel* out) {
+    MemoryScope scope (MEMORY_SCENE);
+    auto t0 = std::chrono::steady_clock::now ();
+    int rooms = p.rooms_x * p.rooms_z;
+    int library = ROOM_PROP_KINDS * p.variants_per_kind;
+    out->meshes.clear ();
+    out->meshes.resize (library + rooms);
+    out->library_meshes = (unsigned int)library;
+    out->instances.clear ();
+    out->portals.cells.clear ();
+    out->portals.portals.clear ();
+
+    // the prop library, one job per mesh. streams 1 .. library
+    std::vector<Aabb> library_bounds (library);
+    parallel_for_each (library, 1, [&] (int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            RoomRng rng = rng_stream (p.seed, 1u + (uint32_t)i);
+            Mesh* m = &out->meshes[i];
+            switch (i / p.variants_per_kind) {
+                case ROOM_PROP_CRATE: make_crate (m, &rng, p.detail); break;
+                case ROOM_PROP_BARREL: make_barrel (m, &rng, p.detail); break;
+                case ROOM_PROP_PILLAR: make_pillar (m, &rng, p.detail, p.wall_height); break;
+                default: make_rock (m, &rng, p.detail); break;
+            }
+            library_bounds[i] = mesh_bounds (*m);
+        }
+    });
+
+    std::vector<unsigned char> east, south;
+    plan_links (p, &east, &south);
+
+    // rooms, one job each. streams after the library's
+    std::vector<std::vector<RoomInstance> > room_instances (rooms);
+    parallel_for_each (rooms, 1, [&] (int begin, int end) {
+        for (int r = begin; r < end; r++) {
+            RoomRng rng = rng_stream (p.seed, 1u + (uint32_t)library + (uint32_t)r);
+            bool door[4];
+            room_doors (p, east, south, r, door);
+            vec3 c = room_centre (p, r);
+            build_architecture (p, door, east[r] != 0, south[r] != 0, c, &out->meshes[library + r]);
+            place_props (p, *out, library_bounds, door, c, r, &rng, &room_instances[r]);
+        }
+    });
+    for (int r = 0; r < rooms; r++) {
+        out->instances.insert (out->instances.end (), room_instances[r].begin (), room_instances[r].end ());
+    }
+
+    // cells: rooms first, then corridors in room order, east before south
+    float h = p.room_size * 0.5f, w = p.corridor_width;
+    for (int r = 0; r < rooms; r++) {
+        vec3 c = room_centre (p, r);
+        Aabb b = {c - vec3 (h, 0.0f, h), c + vec3 (h, p.wall_height, h)};
+        portal_world_add_cell (&out->portals, b);
+    }
+    unsigned int corridors = 0;
+    for (int r = 0; r < rooms; r++) {
+        for (int k = 0; k < 2; k++) {
+            if (!(k == 0 ? east[r] : south[r])) {
+                continue;
+            }
+            vec3 e = side_dir[k == 0 ? 0 : 2];
+            vec3 side = cross (e, up_axis) * (0.5f * w);
+            vec3 start = room_centre (p, r) + e * h, end = start + e * p.corridor_length;
+            Aabb b = aabb_empty ();
+            aabb_grow (&b, start - side);
+            aabb_grow (&b, end + side + up_axis * p.door_height);
+            int cell = portal_world_add_cell (&out->portals, b);
+            add_doorway (&out->portals, p, start, e, r, cell);
+            add_doorway (&out->portals, p, end, e, cell, k == 0 ? r + 1 : r + p.rooms_x);
+            corridors++;
+        }
+    }
+
+    RoomGenStats& st = out->stats;
+    st.rooms = (unsigned int)rooms;
+    st.corridors = corridors;
+    st.meshes = (unsigned int)out->meshes.size ();
+    st.instances = (unsigned int)out->instances.size ();
+    st.unique_triangles = 0;
+    st.scene_triangles = 0;
+    for (size_t i = 0; i < out->meshes.size (); i++) {
+        st.unique_triangles += mesh_triangle_count (out->meshes[i]);
+        if ((int)i >= library) {
+            st.scene_triangles += mesh_triangle_count (out->meshes[i]);
+        }
+    }
+    for (size_t i = 0; i < out->instances.size (); i++) {
+        st.scene_triangles += mesh_triangle_count (out->meshes[out->instances[i].mesh]);
+    }
+    st.ms = std::chrono::duration<double, std::milli> (std::chrono::steady_clock::now () - t0).count ();
+}
+
+/*-----------------------------------OUTPUT-----------------------------------*/
+static inline void fnv (uint64_t* h, const void* data, size_t bytes) {
+    const unsigned char* p = (const unsigned char*)data;
+    for (size_t i = 0; i < bytes; i++) {
+        *h = (*h ^ p[i]) * 0x100000001b3ull;
+    }
+}
+
+uint64_t room_generator_hash (const GeneratedLevel& level) {
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < level.meshes.size (); i++) {
+        const Mesh& m = level.meshes[i];
+        if (!m.positions.empty ()) {
+            fnv (&h, &m.positions[0], m.positions.size () * sizeof (vec3));
+        }
+        if (!m.indices.empty ()) {
+            fnv (&h, &m.indices[0], m.indices.size () * sizeof (unsigned int));
+        }
+    }
+    for (size_t i = 0; i < level.instances.size (); i++) {
+        const RoomInstance& inst = level.instances[i];
+        fnv (&h, &inst.mesh, sizeof (inst.mesh));
+        fnv (&h, inst.world.m, sizeof (inst.world.m));
+        fnv (&h, &inst.cell, sizeof (inst.cell));
+    }
+    for (size_t i = 0; i < level.portals.portals.size (); i++) {
+        const Portal& portal = level.portals.portals[i];
+        fnv (&h, portal.vertices, portal.vertex_count * sizeof (vec3));
+        fnv (&h, portal.cells, sizeof (portal.cells));
+    }
+    return h;
+}
+
+void room_generator_flatten (const GeneratedLevel& level, Mesh* out) {
+    // architecture as is, then every instance, each at its own offset
+    int arch = (int)(level.meshes.size () - level.library_meshes);
+    int parts = arch + (int)level.instances.size ();
+    std::vector<size_t> vertex_start (parts + 1, 0), index_start (parts + 1, 0);
+    for (int i = 0; i < parts; i++) {
+        const Mesh& m = level.meshes[i < arch ? level.library_meshes + i : level.instances[i - arch].mesh];
+        vertex_start[i + 1] = vertex_start[i] + m.positions.size ();
+        index_start[i + 1] = index_start[i] + m.indices.size ();
+    }
+    out->positions.resize (vertex_start[parts]);
+    out->indices.resize (index_start[parts]);
+    if (out->positions.empty () || out->indices.empty ()) {
+        return;
+    }
+    parallel_for_each (parts, 64, [&] (int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            const Mesh& m = level.meshes[i < arch ? level.library_meshes + i : level.instances[i - arch].mesh];
+            vec3* dst = &out->positions[0] + vertex_start[i];
+            if (i < arch) {
+                std::copy (m.positions.begin (), m.positions.end (), dst);
+            } else {
+                const mat4& world = level.instances[i - arch].world;
+                for (size_t k = 0; k < m.positions.size (); k++) {
+                    vec4 p = world * vec4 (m.positions[k], 1.0f);
+                    dst[k] = vec3 (p.v[0], p.v[1], p.v[2]);
+                }
+            }
+            unsigned int offset = (unsigned int)vertex_start[i];
+            unsigned int* idx = &out->indices[0] + index_start[i];
+            for (size_t k = 0; k < m.indices.size (); k++) {
+                idx[k] = m.indices[k] + offset;
+            }
+        }
+    });
+}
@@ -0,0 +1,99 @@
+//
+// Seeded procedural level generator for stress testing.
+//
+// The level is a rooms_x x rooms_z grid of rooms joined by corridors. A
+// spanning tree over the grid (randomised from the seed) decides which
+// neighbours are connected, and extra_links more corridors make loops. Every
+// room has a floor, a ceiling and four inward facing walls with doorways
+// where corridors meet it. All surfaces are tessellated into tiles of about
+// tile_size, the way real levels are split for lightmaps and culling. Each
+// room and the corridors leading east and south from it are one mesh, in
+// world space.
+//
+// Props are instances of a library of prop meshes: crates, barrels, pillars
+// and rocks, variants_per_kind of each with seeded proportions, detail sets
+// their tessellation. Instancing is how scenes reach millions of triangles
+// without millions of unique vertices.
+//
+// The generator also fills a PortalWorld (culling/portals.h): every room and
+// every corridor is a cell, every doorway a portal.
+//
+// Determinism: every room and every library mesh draws from its own random
+// stream, seeded from the level seed and its index. They are generated in
+// parallel on the job system and gathered in index order, so the result is
+// bit for bit the same for any worker count. room_generator_hash checks that.
+//
+
+#ifndef FPS_STYLE_ROOM_ROOM_GENERATOR_H
+#define FPS_STYLE_ROOM_ROOM_GENERATOR_H
+
+#include <stdint.h>
+#include <vector>
+#include <geometry/mesh.h>
+#include <culling/portals.h>
+
+enum RoomPropKind {
+    ROOM_PROP_CRATE,
+    ROOM_PROP_BARREL,
+    ROOM_PROP_PILLAR,
+    ROOM_PROP_ROCK,
+    ROOM_PROP_KINDS
+};
+
+struct RoomGenParams {
+    uint32_t seed;
+    int rooms_x, rooms_z;
+    float room_size;             // rooms are square, wall to wall
+    float corridor_length;       // gap between neighbouring rooms
+    float corridor_width;        // also the doorway width
+    float wall_height;
+    float door_height;
+    float tile_size;             // surface tessellation
+    int extra_links;             // corridors on top of the spanning tree
+    int props_per_room;
+    int variants_per_kind;
+    int detail;                  // prop tessellation, 1 is coarse, 8 is heavy
+};
+
+/* a prop placed in the level */
+struct RoomInstance {
+    unsigned int mesh;           // into GeneratedLevel::meshes
+    mat4 world;
+    Aabb world_bounds;
+    int cell;                    // the portal cell it stands in
+};
+
+struct RoomGenStats {
+    unsigned int rooms;
+    unsigned int corridors;
+    unsigned int meshes;
+    unsigned int instances;
+    uint64_t unique_triangles;   // over all meshes
+    uint64_t scene_triangles;    // architecture plus every instance
+    double ms;
+};
+
+struct GeneratedLevel {
+    // the prop library first (library_meshes of them), then one
+    // architecture mesh per room, in world space
+    std::vector<Mesh> meshes;
+    unsigned int library_meshes;
+    std::vector<RoomInstance> instances;
+    PortalWorld portals;
+    RoomGenStats stats;
+};
+
+/* sensible defaults: 8 x 8 rooms of 12 units, about 3.3M scene triangles */
+RoomGenParams room_gen_default_params (uint32_t seed);
+void room_generate (const RoomGenParams& params, GeneratedLevel* out);
+/* the mesh number of room (x, z)'s architecture */
+inline unsigned int room_architecture_mesh (const GeneratedLevel& level, const RoomGenParams& params, int x, int z) {
+    return level.library_meshes + (unsigned int)(z * params.rooms_x + x);
+}
+/* FNV-1a over every mesh, instance and portal, for determinism checks */
+uint64_t room_generator_hash (const GeneratedLevel& level);
+/* every mesh and instance flattened into one world space mesh, e.g. to write
+out with mesh_save_obj. big levels make big meshes */
+void room_generator_flatten (const GeneratedLevel& level, Mesh* out);
+
+#endif //FPS_STYLE_ROOM_ROOM_GENERATOR_H
@@ -0,0 +1,208 @@
+//
+// Scene description parser. See scene_file.h.
+//
+
+#include "scene_file.h"
+#include <memory/memory_tracker.h>
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <unordered_map>
+
+static bool fail (const char* path, int line, const char* what, const char* name) {
+    fprintf (stderr, "ERROR: %s:%d: %s%s%s\n", path, line, what, name ? " " : "", name ? name : "");
+    return false;
+}
+
+static bool copy_name (char* out, const char* name) {
+    if (strlen (name) >= SCENE_NAME_MAX) {
+        return false;
+    }
+    strcpy (out, name);
+    return true;
+}
+
+/* the index declared under name, -1 if none was */
+static int find_name (const std::unordered_map<std::string, int>& names, const char* name) {
+    auto it = names.find (name);
+    return it == names.end () ? -1 : it->second;
+}
+
+/* file relative to the directory scene_path is in, unless it is absolute */
+static bool relative_path (const char* scene_path, const char* file, char* out) {
+    const char* slash = strrchr (scene_path, '/');
+    int dir = file[0] == '/' || !slash ? 0 : (int)(slash - scene_path) + 1;
+    return snprintf (out, SCENE_PATH_MAX, "%.*s%s", dir, scene_path, file) < SCENE_PATH_MAX;
+}
+
+uint64_t scene_mesh_hash (const Mesh& mesh) {
+    // FNV-1a
+    uint64_t h = 0xcbf29ce484222325ull;
+    const unsigned char* bytes[2] = {(const unsigned char*)mesh.positions.data (),
+                                     (const unsigned char*)mesh.indices.data ()};
+    size_t sizes[2] = {mesh.positions.size () * sizeof (vec3), mesh.indices.size () * sizeof (unsigned int)};
+    for (int a = 0; a < 2; a++) {
+        for (size_t i = 0; i < sizes[a]; i++) {
+            h = (h ^ bytes[a][i]) * 0x100000001b3ull;
+        }
+        h = (h ^ sizes[a]) * 0x100000001b3ull;
+    }
+    return h;
+}
+
+/* the mesh being declared has taken its tri lines. false if it has none */
+static bool finish_inline_mesh (SceneMeshDesc* m, std::vector<float>* soup) {
+    if (soup->empty ()) {
+        return false;
+    }
+    mesh_from_triangle_soup (soup->data (), (unsigned int)(soup->size () / 3), &m->mesh);
+    soup->clear ();
+    return true;
+}
+
+bool scene_file_load (const char* path, SceneDesc* out) {
+    MemoryScope scope (MEMORY_SCENE);
+    FILE* f = fopen (path, "r");
+    if (!f) {
+        fprintf (stderr, "ERROR: could not open %s\n", path);
+        return false;
+    }
+    SceneDesc desc;
+    ScenePath self;
+    snprintf (self.path, sizeof (self.path), "%s", path);
+    desc.files.push_back (self);
+    std::unordered_map<std::string, int> materials, meshes, objects;
+    // tri lines of the last mesh, if it has no .obj
+    std::vector<float> soup;
+    bool inline_mesh = false;
+    int inline_line = 0;
+
+    char line[1024];
+    int number = 0;
+    bool ok = true;
+    while (ok && fgets (line, sizeof (line), f)) {
+        number++;
+        char* hash = strchr (line, '#');
+        if (hash) {
+            *hash = 0;
+        }
+        // empty, so a name a short line didn't reach is never stale
+        char keyword[16], a[256] = "", b[256] = "", c[256] = "";
+        int used = 0;
+        if (sscanf (line, "%15s%n", keyword, &used) != 1) {
+            continue;
+        }
+        const char* rest = line + used;
+
+        if (strcmp (keyword, "tri") == 0) {
+            float v[9];
+            if (!inline_mesh) {
+                ok = fail (path, number, "tri outside an inline mesh", NULL);
+            } else if (sscanf (rest, "%f %f %f %f %f %f %f %f %f", &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6],
+                               &v[7], &v[8]) != 9) {
+                ok = fail (path, number, "tri needs nine coordinates", NULL);
+            } else {
+                soup.insert (soup.end (), v, v + 9);
+            }
+            continue;
+        }
+        if (inline_mesh && !finish_inline_mesh (&desc.meshes.back (), &soup)) {
+            ok = fail (path, inline_line, "mesh has no file and no tri lines:", desc.meshes.back ().name);
+            break;
+        }
+        inline_mesh = false;
+
+        if (strcmp (keyword, "material") == 0) {
+            SceneMaterialDesc m;
+            float* rgb = m.albedo;
+            if (sscanf (rest, "%255s %f %f %f", a, &rgb[0], &rgb[1], &rgb[2]) != 4) {
+                ok = fail (path, number, "expected material <name> <r> <g> <b>", NULL);
+            } else if (!copy_name (m.name, a)) {
+                ok = fail (path, number, "name too long:", a);
+            } else if (!materials.insert (std::make_pair (std::string (a), (int)desc.materials.size ())).second) {
+                ok = fail (path, number, "duplicate material", a);
+            } else {
+                desc.materials.push_back (m);
+            }
+        } else if (strcmp (keyword, "mesh") == 0) {
+            int fields = sscanf (rest, "%255s %255s %255s", a, b, c);
+            SceneMeshDesc m;
+            int material;
+            char file[SCENE_PATH_MAX];
+            if (fields < 2) {
+                ok = fail (path, number, "expected mesh <name> <material> [<file.obj>]", NULL);
+            } else if (!copy_name (m.name, a)) {
+                ok = fail (path, number, "name too long:", a);
+            } else if ((material = find_name (materials, b)) < 0) {
+                ok = fail (path, number, "unknown material", b);
+            } else if (!meshes.insert (std::make_pair (std::string (a), (int)desc.meshes.size ())).second) {
+                ok = fail (path, number, "duplicate mesh", a);
+            } else if (fields == 3 && !relative_path (path, c, file)) {
+                ok = fail (path, number, "path too long:", c);
+            } else if (fields == 3 && !mesh_load_obj (file, &m.mesh)) {
+                ok = fail (path, number, "could not load", file);
+            } else {
+                m.material = material;
+                desc.meshes.push_back (m);
+                if (fields == 3) {
+                    ScenePath p;
+                    memcpy (p.path, file, sizeof (p.path));
+                    desc.files.push_back (p);
+                } else {
+                    inline_mesh = true;
+                    inline_line = number;
+                }
+            }
+        } else if (strcmp (keyword, "object") == 0) {
+            SceneObjectDesc o;
+            float v[9] = {0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f};
+            int fields = sscanf (rest, "%255s %255s %f %f %f %f %f %f %f %f %f", a, b, &o.position.v[0],
+                                 &o.position.v[1], &o.position.v[2], &v[0], &v[1], &v[2], &v[3], &v[4], &v[5]);
+            int mesh;
+            if (fields != 5 && fields != 8 && fields != 11) {
+                ok = fail (path, number, "expected object <name> <mesh> <x y z> [<yaw pitch roll> [<sx sy sz>]]",
+                           NULL);
+            } else if (!copy_name (o.name, a)) {
+                ok = fail (path, number, "name too long:", a);
+            } else if ((mesh = find_name (meshes, b)) < 0) {
+                ok = fail (path, number, "unknown mesh", b);
+            } else if (!objects.insert (std::make_pair (std::string (a), (int)desc.objects.size ())).second) {
+                ok = fail (path, number, "duplicate object", a);
+            } else {
+                o.mesh = mesh;
+                o.orientation = quat_from_axis_deg (v[0], 0.0f, 1.0f, 0.0f) *
+                                quat_from_axis_deg (v[1], 1.0f, 0.0f, 0.0f) *
+                                quat_from_axis_deg (v[2], 0.0f, 0.0f, 1.0f);
+                o.scale = vec3 (v[3], v[4], v[5]);
+                desc.objects.push_back (o);
+            }
+        } else {
+            ok = fail (path, number, "unknown statement", keyword);
+        }
+    }
+    fclose (f);
+    if (ok && inline_mesh && !finish_inline_mesh (&desc.meshes.back (), &soup)) {
+        ok = fail (path, inline_line, "mesh has no file and no tri lines:", desc.meshes.back ().name);
+    }
+    if (!ok) {
+        return false;
+    }
+
+    for (size_t i = 0; i < desc.meshes.size (); i++) {
+        SceneMeshDesc& m = desc.meshes[i];
+        for (size_t k = 0; k < m.mesh.indices.size (); k++) {
+            if (m.mesh.indices[k] >= m.mesh.positions.size ()) {
+                fprintf (stderr, "ERROR: %s: mesh %s has an index past its vertices\n", path, m.name);
+                return false;
+            }
+        }
+        if (m.mesh.indices.empty ()) {
+            fprintf (stderr, "ERROR: %s: mesh %s has no triangles\n", path, m.name);
+            return false;
+        }
+        m.hash = scene_mesh_hash (m.mesh);
+    }
+    std::swap (*out, desc);
+    return true;
+}
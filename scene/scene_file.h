@@ -0,0 +1,73 @@
+//
+// Text scene description, for editing the level while the game runs.
+//
+// One statement per line, # to the end of the line is a comment:
+//
+//   material <name> <r> <g> <b>
+//   mesh <name> <material> [<file.obj>]
+//   tri <x y z> <x y z> <x y z>
+//   object <name> <mesh> <x y z> [<yaw pitch roll> [<sx sy sz>]]
+//
+// A mesh is either loaded from an .obj (the path is relative to the scene
+// file) or built from the tri lines that follow it. Angles are degrees,
+// applied roll, then pitch, then yaw. Names are at most SCENE_NAME_MAX - 1
+// characters and unique within their kind, and everything must be declared
+// before it is used.
+//
+// scene_file_load reads the whole description or nothing: on any error it
+// prints file and line and leaves out untouched, so a half saved edit keeps
+// the last good scene on screen. Each mesh gets a hash of its geometry, so a
+// reload can tell which meshes actually changed without comparing them.
+//
+// See scene/live_scene.h for applying a description to the running game.
+//
+
+#ifndef FPS_STYLE_ROOM_SCENE_FILE_H
+#define FPS_STYLE_ROOM_SCENE_FILE_H
+
+#include <stdint.h>
+#include <vector>
+#include <geometry/mesh.h>
+
+#define SCENE_NAME_MAX 32
+#define SCENE_PATH_MAX 256
+
+struct SceneMaterialDesc {
+    char name[SCENE_NAME_MAX];
+    float albedo[3];
+};
+
+struct SceneMeshDesc {
+    char name[SCENE_NAME_MAX];
+    int material;                // into SceneDesc::materials
+    Mesh mesh;
+    uint64_t hash;               // of positions and indices
+};
+
+struct SceneObjectDesc {
+    char name[SCENE_NAME_MAX];
+    int mesh;                    // into SceneDesc::meshes
+    vec3 position;
+    versor orientation;
+    vec3 scale;
+};
+
+struct ScenePath {
+    char path[SCENE_PATH_MAX];
+};
+
+struct SceneDesc {
+    std::vector<SceneMaterialDesc> materials;
+    std::vector<SceneMeshDesc> meshes;
+    std::vector<SceneObjectDesc> objects;
+    // the scene file and every .obj it read, to watch for edits
+    std::vector<ScenePath> files;
+};
+
+/* false, with a message, if the file or an .obj it names is missing or
+malformed. out is only written on success */
+bool scene_file_load (const char* path, SceneDesc* out);
+/* the hash scene_file_load gives a mesh */
+uint64_t scene_mesh_hash (const Mesh& mesh);
+
+#endif //FPS_STYLE_ROOM_SCENE_FILE_H
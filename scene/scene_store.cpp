@@ -0,0 +1,329 @@
+//
+// SoA scene store and the level by level transform pass. See scene_store.h.
+//
+
+#include "scene_store.h"
+#include <memory/memory_tracker.h>
+#include <jobs/job_system.h>
+#include <atomic>
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+
+// rows per job in the transform pass
+static const int SCENE_UPDATE_GRAIN = 1024;
+
+static unsigned int entity_index (Entity e) {
+    return e & ENTITY_INDEX_MASK;
+}
+
+static unsigned int entity_generation (Entity e) {
+    return e >> ENTITY_INDEX_BITS;
+}
+
+void scene_init (SceneStore* s) {
+    MemoryScope scope (MEMORY_SCENE);
+    *s = SceneStore ();
+    s->order_dirty = false;
+    memset (&s->stats, 0, sizeof (s->stats));
+}
+
+bool scene_valid (const SceneStore& s, Entity e) {
+    unsigned int index = entity_index (e);
+    return e != ENTITY_NONE && index < s.row_of.size () && s.row_of[index] >= 0 &&
+           s.generation[index] == entity_generation (e);
+}
+
+int scene_row (const SceneStore& s, Entity e) {
+    return scene_valid (s, e) ? s.row_of[entity_index (e)] : -1;
+}
+
+mat4 scene_local_matrix (const vec3& position, const versor& orientation, const vec3& scale) {
+    mat4 m = quat_to_mat4 (orientation);
+    for (int col = 0; col < 3; col++) {
+        m.m[col * 4] *= scale.v[col];
+        m.m[col * 4 + 1] *= scale.v[col];
+        m.m[col * 4 + 2] *= scale.v[col];
+    }
+    m.m[12] = position.v[0];
+    m.m[13] = position.v[1];
+    m.m[14] = position.v[2];
+    return m;
+}
+
+/* a * b for two matrices whose bottom row is 0 0 0 1, 36 multiplies
+instead of 64 */
+static mat4 affine_mul (const mat4& a, const mat4& b) {
+    mat4 r;
+    for (int col = 0; col < 4; col++) {
+        float x = b.m[col * 4], y = b.m[col * 4 + 1], z = b.m[col * 4 + 2];
+        for (int row = 0; row < 3; row++) {
+            r.m[col * 4 + row] = a.m[row] * x + a.m[4 + row] * y + a.m[8 + row] * z;
+        }
+        r.m[col * 4 + 3] = 0.0f;
+    }
+    r.m[12] += a.m[12];
+    r.m[13] += a.m[13];
+    r.m[14] += a.m[14];
+    r.m[15] = 1.0f;
+    return r;
+}
+
+/*---------------------------------HIERARCHY----------------------------------*/
+Entity scene_create (SceneStore* s, Entity parent, const vec3& position, const versor& orientation,
+                     const vec3& scale, const Aabb& bounds) {
+    MemoryScope scope (MEMORY_SCENE);
+    if (parent != ENTITY_NONE && !scene_valid (*s, parent)) {
+        fprintf (stderr, "ERROR: scene_create with a stale parent handle\n");
+        parent = ENTITY_NONE;
+    }
+    unsigned int index;
+    if (!s->free_indices.empty ()) {
+        index = s->free_indices.back ();
+        s->free_indices.pop_back ();
+    } else {
+        index = (unsigned int)s->row_of.size ();
+        if (index >= ENTITY_INDEX_MASK) {
+            fprintf (stderr, "ERROR: scene store is full\n");
+            return ENTITY_NONE;
+        }
+        s->row_of.push_back (-1);
+        s->generation.push_back (0);
+    }
+    Entity e = ((unsigned int)s->generation[index] << ENTITY_INDEX_BITS) | index;
+    s->row_of[index] = (int)s->position.size ();
+    s->position.push_back (position);
+    s->orientation.push_back (orientation);
+    s->scale.push_back (scale);
+    s->parent.push_back (parent);
+    s->parent_row.push_back (-1);
+    s->world.push_back (identity_mat4 ());
+    s->local_bounds.push_back (bounds);
+    s->world_bounds.push_back (bounds);
+    s->dirty.push_back (1);
+    s->entity.push_back (e);
+    s->order_dirty = true;
+    return e;
+}
+
+/* stable reorder of one array: row i moves to new_row[i] */
+template <typename T>
+static void permute (std::vector<T>* v, const std::vector<int>& new_row, std::vector<T>* scratch) {
+    scratch->resize (v->size ());
+    for (size_t i = 0; i < v->size (); i++) {
+        (*scratch)[new_row[i]] = (*v)[i];
+    }
+    v->swap (*scratch);
+}
+
+/* parent rows, depths, then a counting sort on depth */
+static void scene_reorder (SceneStore* s) {
+    int n = (int)s->position.size ();
+    for (int i = 0; i < n; i++) {
+        s->parent_row[i] = s->parent[i] == ENTITY_NONE ? -1 : s->row_of[entity_index (s->parent[i])];
+    }
+    std::vector<int> depth ((size_t)n, -1);
+    std::vector<int> path;
+    int max_depth = -1;
+    for (int i = 0; i < n; i++) {
+        int j = i;
+        path.clear ();
+        while (j >= 0 && depth[j] < 0) {
+            path.push_back (j);
+            j = s->parent_row[j];
+        }
+        int d = j < 0 ? -1 : depth[j];
+        for (size_t k = path.size (); k-- > 0;) {
+            depth[path[k]] = ++d;
+        }
+        max_depth = depth[i] > max_depth ? depth[i] : max_depth;
+    }
+
+    s->level_start.assign ((size_t)(max_depth + 2), 0);
+    for (int i = 0; i < n; i++) {
+        s->level_start[depth[i] + 1]++;
+    }
+    for (int d = 0; d <= max_depth; d++) {
+        s->level_start[d + 1] += s->level_start[d];
+    }
+    std::vector<int> cursor (s->level_start.begin (), s->level_start.end () - 1);
+    std::vector<int> new_row ((size_t)n);
+    for (int i = 0; i < n; i++) {
+        new_row[i] = cursor[depth[i]]++;
+    }
+
+    std::vector<vec3> v3;
+    permute (&s->position, new_row, &v3);
+    permute (&s->scale, new_row, &v3);
+    std::vector<versor> q;
+    permute (&s->orientation, new_row, &q);
+    std::vector<Entity> ent;
+    permute (&s->parent, new_row, &ent);
+    permute (&s->entity, new_row, &ent);
+    std::vector<mat4> m;
+    permute (&s->world, new_row, &m);
+    std::vector<Aabb> b;
+    permute (&s->local_bounds, new_row, &b);
+    permute (&s->world_bounds, new_row, &b);
+    std::vector<unsigned char> flags;
+    permute (&s->dirty, new_row, &flags);
+    std::vector<int> parent_row ((size_t)n);
+    for (int i = 0; i < n; i++) {
+        parent_row[new_row[i]] = s->parent_row[i] < 0 ? -1 : new_row[s->parent_row[i]];
+    }
+    s->parent_row.swap (parent_row);
+    for (int i = 0; i < n; i++) {
+        s->row_of[entity_index (s->entity[i])] = i;
+    }
+    s->order_dirty = false;
+    s->stats.reorders++;
+}
+
+void scene_destroy (SceneStore* s, Entity e) {
+    MemoryScope scope (MEMORY_SCENE);
+    if (!scene_valid (*s, e)) {
+        return;
+    }
+    if (s->order_dirty) {
+        scene_reorder (s);
+    }
+    // parents come first, so one pass finds the whole subtree
+    int n = (int)s->position.size ();
+    std::vector<unsigned char> removed ((size_t)n, 0);
+    removed[s->row_of[entity_index (e)]] = 1;
+    for (int i = 0; i < n; i++) {
+        int p = s->parent_row[i];
+        if (p >= 0 && removed[p]) {
+            removed[i] = 1;
+        }
+    }
+    // stable compaction keeps parents before children
+    int out = 0;
+    for (int i = 0; i < n; i++) {
+        unsigned int index = entity_index (s->entity[i]);
+        if (removed[i]) {
+            s->row_of[index] = -1;
+            s->generation[index]++;
+            s->free_indices.push_back (index);
+            continue;
+        }
+        if (out != i) {
+            s->position[out] = s->position[i];
+            s->orientation[out] = s->orientation[i];
+            s->scale[out] = s->scale[i];
+            s->parent[out] = s->parent[i];
+            s->world[out] = s->world[i];
+            s->local_bounds[out] = s->local_bounds[i];
+            s->world_bounds[out] = s->world_bounds[i];
+            s->dirty[out] = s->dirty[i];
+            s->entity[out] = s->entity[i];
+        }
+        s->row_of[index] = out++;
+    }
+    s->position.resize (out);
+    s->orientation.resize (out);
+    s->scale.resize (out);
+    s->parent.resize (out);
+    s->parent_row.resize (out);
+    s->world.resize (out);
+    s->local_bounds.resize (out);
+    s->world_bounds.resize (out);
+    s->dirty.resize (out);
+    s->entity.resize (out);
+    // parent rows and level boundaries have shifted
+    s->order_dirty = true;
+}
+
+bool scene_set_parent (SceneStore* s, Entity e, Entity parent) {
+    MemoryScope scope (MEMORY_SCENE);
+    int row = scene_row (*s, e);
+    if (row < 0 || (parent != ENTITY_NONE && !scene_valid (*s, parent))) {
+        return false;
+    }
+    for (Entity a = parent; a != ENTITY_NONE; a = s->parent[s->row_of[entity_index (a)]]) {
+        if (a == e) {
+            return false;
+        }
+    }
+    s->parent[row] = parent;
+    s->dirty[row] = 1;
+    s->order_dirty = true;
+    return true;
+}
+
+/*--------------------------------TRANSFORMS----------------------------------*/
+void scene_set_position (SceneStore* s, Entity e, const vec3& position) {
+    int row = scene_row (*s, e);
+    if (row >= 0) {
+        s->position[row] = position;
+        s->dirty[row] = 1;
+    }
+}
+
+void scene_set_orientation (SceneStore* s, Entity e, const versor& orientation) {
+    int row = scene_row (*s, e);
+    if (row >= 0) {
+        s->orientation[row] = orientation;
+        s->dirty[row] = 1;
+    }
+}
+
+void scene_set_scale (SceneStore* s, Entity e, const vec3& scale) {
+    int row = scene_row (*s, e);
+    if (row >= 0) {
+        s->scale[row] = scale;
+        s->dirty[row] = 1;
+    }
+}
+
+void scene_set_bounds (SceneStore* s, Entity e, const Aabb& bounds) {
+    int row = scene_row (*s, e);
+    if (row >= 0) {
+        s->local_bounds[row] = bounds;
+        s->dirty[row] = 1;
+    }
+}
+
+void scene_update (SceneStore* s) {
+    MemoryScope scope (MEMORY_SCENE);
+    auto t0 = std::chrono::steady_clock::now ();
+    if (s->order_dirty) {
+        scene_reorder (s);
+    }
+    std::atomic<unsigned int> updated (0);
+    int levels = (int)s->level_start.size () - 1;
+    for (int d = 0; d < levels; d++) {
+        int first = s->level_start[d];
+        // a row only reads its parent, which belongs to the level before
+        parallel_for_each (s->level_start[d + 1] - first, SCENE_UPDATE_GRAIN, [s, first, &updated] (int begin, int end) {
+            unsigned int count = 0;
+            for (int i = first + begin; i < first + end; i++) {
+                int p = s->parent_row[i];
+                if (!s->dirty[i] && (p < 0 || !s->dirty[p])) {
+                    continue;
+                }
+                s->dirty[i] = 1; // so our children see it
+                mat4 local = scene_local_matrix (s->position[i], s->orientation[i], s->scale[i]);
+                s->world[i] = p < 0 ? local : affine_mul (s->world[p], local);
+                s->world_bounds[i] = aabb_transform (s->local_bounds[i], s->world[i]);
+                count++;
+            }
+            updated += count;
+        });
+    }
+    if (!s->dirty.empty ()) {
+        memset (&s->dirty[0], 0, s->dirty.size ());
+    }
+    s->stats.entities = (unsigned int)s->position.size ();
+    s->stats.levels = levels > 0 ? (unsigned int)levels : 0;
+    s->stats.updated = updated.load ();
+    s->stats.ms = std::chrono::duration<double, std::milli> (std::chrono::steady_clock::now () - t0).count ();
+}
+
+const mat4& scene_world (const SceneStore& s, Entity e) {
+    return s.world[s.row_of[entity_index (e)]];
+}
+
+const Aabb& scene_world_bounds (const SceneStore& s, Entity e) {
+    return s.world_bounds[s.row_of[entity_index (e)]];
+}
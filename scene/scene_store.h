@@ -0,0 +1,95 @@
+//
+// Entity scene store.
+//
+// Every entity is a row in a set of parallel arrays (structure of arrays):
+// local position, orientation and scale, parent, world matrix, and local and
+// world bounds. Entities are referred to by a handle that survives the rows
+// being moved around. A handle is an index plus a generation, so a stale
+// handle to a destroyed entity is detected instead of aliasing a new one.
+//
+// The rows are kept in topological order, grouped by depth in the hierarchy
+// (all roots, then all children of roots, and so on). scene_update walks the
+// depth levels in order. Within one level no row depends on another, so each
+// level is a parallel_for on the job system. Setting a transform marks the
+// row dirty. A row is recomputed only if it or its parent changed this update,
+// so a moving subtree costs its own size and nothing else.
+//
+// Changing the hierarchy (create, destroy, reparent) only flags the order as
+// stale. The next scene_update re-sorts once, with a counting sort on depth.
+//
+
+#ifndef FPS_STYLE_ROOM_SCENE_STORE_H
+#define FPS_STYLE_ROOM_SCENE_STORE_H
+
+#include <vector>
+#include <geometry/mesh.h>
+
+typedef unsigned int Entity;
+
+#define ENTITY_NONE 0xFFFFFFFFu
+#define ENTITY_INDEX_BITS 24
+#define ENTITY_INDEX_MASK ((1u << ENTITY_INDEX_BITS) - 1u)
+
+struct SceneStats {
+    unsigned int entities;
+    unsigned int levels;      // depth of the deepest entity + 1
+    unsigned int updated;     // world matrices recomputed by the last update
+    unsigned int reorders;    // topological re-sorts so far
+    double ms;                // last scene_update, re-sort included
+};
+
+struct SceneStore {
+    // rows, parents before children after scene_update
+    std::vector<vec3> position;
+    std::vector<versor> orientation;
+    std::vector<vec3> scale;
+    std::vector<Entity> parent;           // ENTITY_NONE for roots
+    std::vector<int> parent_row;          // row of parent, -1 for roots. valid when !order_dirty
+    std::vector<mat4> world;
+    std::vector<Aabb> local_bounds;
+    std::vector<Aabb> world_bounds;
+    std::vector<unsigned char> dirty;
+    std::vector<Entity> entity;           // row -> handle
+
+    // handles
+    std::vector<int> row_of;              // handle index -> row, -1 if free
+    std::vector<unsigned char> generation;
+    std::vector<unsigned int> free_indices;
+
+    // rows [level_start[d], level_start[d + 1]) are at depth d
+    std::vector<int> level_start;
+    bool order_dirty;
+
+    SceneStats stats;
+};
+
+void scene_init (SceneStore* s);
+
+/* new entity under parent (ENTITY_NONE for a root). bounds are local space */
+Entity scene_create (SceneStore* s, Entity parent, const vec3& position, const versor& orientation,
+                     const vec3& scale, const Aabb& bounds);
+/* destroys e and everything below it */
+void scene_destroy (SceneStore* s, Entity e);
+bool scene_valid (const SceneStore& s, Entity e);
+/* row of e in the arrays, -1 if e is stale. rows move when the order changes */
+int scene_row (const SceneStore& s, Entity e);
+
+/* returns false (and changes nothing) if it would make a cycle */
+bool scene_set_parent (SceneStore* s, Entity e, Entity parent);
+void scene_set_position (SceneStore* s, Entity e, const vec3& position);
+void scene_set_orientation (SceneStore* s, Entity e, const versor& orientation);
+void scene_set_scale (SceneStore* s, Entity e, const vec3& scale);
+void scene_set_bounds (SceneStore* s, Entity e, const Aabb& bounds);
+
+/* re-sorts if the hierarchy changed, then recomputes the world matrix and
+world bounds of every dirty row and everything below it */
+void scene_update (SceneStore* s);
+
+/* only up to date after scene_update */
+const mat4& scene_world (const SceneStore& s, Entity e);
+const Aabb& scene_world_bounds (const SceneStore& s, Entity e);
+
+/* translation * rotation * scale */
+mat4 scene_local_matrix (const vec3& position, const versor& orientation, const vec3& scale);
+
+#endif //FPS_STYLE_ROOM_SCENE_STORE_H
@@ -0,0 +1,384 @@
+//
+// Open addressing cell table and cell-sorted object storage. See
+// spatial_hash.h.
+//
+
+#include "spatial_hash.h"
+#include <memory/memory_tracker.h>
+#include <jobs/job_system.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string.h>
+
+static const unsigned long long SPATIAL_HASH_EMPTY = ~0ull;
+// cell coordinates are packed 21 bits per axis, biased to be unsigned
+static const int CELL_BIAS = 1 << 20;
+static const int CELL_LIMIT = (1 << 20) - 1;
+static const int SPATIAL_HASH_GRAIN = 2048;
+// a cell lookup costs about this many object distance tests
+static const long long SPATIAL_HASH_PROBE_COST = 8;
+
+static int cell_coord (float x, float inv_cell_size) {
+    float f = std::max (-(float)CELL_LIMIT, std::min ((float)CELL_LIMIT, x * inv_cell_size));
+    // floor without the libm call: truncate, then step down for negatives
+    int c = (int)f;
+    return c - (f < (float)c ? 1 : 0);
+}
+
+static unsigned long long cell_key (int x, int y, int z) {
+    return ((unsigned long long)(x + CELL_BIAS) << 42) | ((unsigned long long)(y + CELL_BIAS) << 21) |
+           (unsigned long long)(z + CELL_BIAS);
+}
+
+static unsigned long long box_key (const Aabb& b, float inv_cell_size) {
+    vec3 c = aabb_center (b);
+    return cell_key (cell_coord (c.v[0], inv_cell_size), cell_coord (c.v[1], inv_cell_size),
+                     cell_coord (c.v[2], inv_cell_size));
+}
+
+static unsigned int slot_hash (unsigned long long key, unsigned int mask) {
+    // fibonacci hashing, the high bits are the well mixed ones
+    return (unsigned int)((key * 0x9E3779B97F4A7C15ull) >> 32) & mask;
+}
+
+/* slot holding key, or -1 */
+static int find_slot (const SpatialHash& h, unsigned long long key) {
+    if (h.slot_key.empty ()) {
+        return -1;
+    }
+    unsigned int i = slot_hash (key, h.slot_mask);
+    while (true) {
+        unsigned long long k = h.slot_key[i];
+        if (k == key) {
+            return (int)i;
+        }
+        if (k == SPATIAL_HASH_EMPTY) {
+            return -1;
+        }
+        i = (i + 1) & h.slot_mask;
+    }
+}
+
+void spatial_hash_init (SpatialHash* h, float cell_size) {
+    MemoryScope scope (MEMORY_SCENE);
+    *h = SpatialHash ();
+    h->cell_size = cell_size;
+    h->inv_cell_size = 1.0f / cell_size;
+    h->pad = vec3 (0.0f, 0.0f, 0.0f);
+    h->slot_mask = 0;
+    memset (&h->stats, 0, sizeof (h->stats));
+}
+
+/* largest half extent and occupied cell range */
+static void measure (SpatialHash* h, const Aabb* boxes, int count) {
+    vec3 pad (0.0f, 0.0f, 0.0f);
+    int lo[3] = {CELL_LIMIT, CELL_LIMIT, CELL_LIMIT}, hi[3] = {-CELL_LIMIT, -CELL_LIMIT, -CELL_LIMIT};
+    for (int i = 0; i < count; i++) {
+        vec3 e = aabb_extent (boxes[i]);
+        vec3 c = aabb_center (boxes[i]);
+        for (int a = 0; a < 3; a++) {
+            pad.v[a] = fmaxf (pad.v[a], e.v[a]);
+            int cc = cell_coord (c.v[a], h->inv_cell_size);
+            lo[a] = std::min (lo[a], cc);
+            hi[a] = std::max (hi[a], cc);
+        }
+    }
+    h->pad = pad;
+    memcpy (h->cell_min, lo, sizeof (lo));
+    memcpy (h->cell_max, hi, sizeof (hi));
+}
+
+static void rebuild (SpatialHash* h, const Aabb* boxes, int count) {
+    // size the table from the last build's cell count rather than the object
+    // count: there are usually far fewer cells than objects, and clearing
+    // and prefix summing a table sized for every object dominated the build
+    unsigned int size = 16;
+    while (size < h->stats.cells * 2 + h->stats.cells / 2) {
+        size *= 2;
+    }
+    std::vector<unsigned int> object_slot ((size_t)count);
+    unsigned int cells = 0;
+    bool fits = false;
+    while (!fits) {
+        h->slot_mask = size - 1;
+        h->slot_key.assign (size, SPATIAL_HASH_EMPTY);
+        h->slot_count.assign (size, 0);
+        h->slot_start.resize (size);
+        // count objects per cell. past half full, double and start over
+        cells = 0;
+        fits = true;
+        for (int i = 0; i < count; i++) {
+            unsigned long long key = h->object_key[i];
+            unsigned int s = slot_hash (key, h->slot_mask);
+            while (h->slot_key[s] != key && h->slot_key[s] != SPATIAL_HASH_EMPTY) {
+                s = (s + 1) & h->slot_mask;
+            }
+            if (h->slot_key[s] == SPATIAL_HASH_EMPTY) {
+                if (++cells * 2 > size) {
+                    fits = false;
+                    size *= 2;
+                    break;
+                }
+                h->slot_key[s] = key;
+            }
+            h->slot_count[s]++;
+            object_slot[i] = s;
+        }
+    }
+    // prefix sum, then scatter. cells end up in slot order, which is as good
+    // as any other since a query looks them up one at a time
+    unsigned int start = 0;
+    for (unsigned int s = 0; s < size; s++) {
+        h->slot_start[s] = start;
+        start += h->slot_count[s];
+    }
+    std::vector<unsigned int> cursor (h->slot_start);
+    h->ids.resize (count);
+    h->boxes.resize (count);
+    h->sorted_of.resize (count);
+    for (int i = 0; i < count; i++) {
+        unsigned int at = cursor[object_slot[i]]++;
+        h->ids[at] = (unsigned int)i;
+        h->boxes[at] = boxes[i];
+        h->sorted_of[i] = at;
+    }
+    h->stats.cells = cells;
+    h->stats.rebuilds++;
+}
+
+void spatial_hash_build (SpatialHash* h, const Aabb* boxes, int count) {
+    MemoryScope scope (MEMORY_SCENE);
+    auto t0 = std::chrono::steady_clock::now ();
+    h->object_key.resize (count);
+    float inv = h->inv_cell_size;
+    unsigned long long* keys = count > 0 ? &h->object_key[0] : NULL;
+    parallel_for_each (count, SPATIAL_HASH_GRAIN, [boxes, keys, inv] (int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            keys[i] = box_key (boxes[i], inv);
+        }
+    });
+    measure (h, boxes, count);
+    rebuild (h, boxes, count);
+    h->stats.objects = (unsigned int)count;
+    h->stats.moved = (unsigned int)count;
+    h->stats.ms = std::chrono::duration<double, std::milli> (std::chrono::steady_clock::now () - t0).count ();
+}
+
+void spatial_hash_update (SpatialHash* h, const Aabb* boxes, int count) {
+    MemoryScope scope (MEMORY_SCENE);
+    if (count != (int)h->object_key.size ()) {
+        spatial_hash_build (h, boxes, count);
+        return;
+    }
+    auto t0 = std::chrono::steady_clock::now ();
+    std::atomic<unsigned int> moved (0);
+    std::mutex pad_lock;
+    vec3 pad (0.0f, 0.0f, 0.0f);
+    float inv = h->inv_cell_size;
+    parallel_for_each (count, SPATIAL_HASH_GRAIN, [h, boxes, inv, &moved, &pad_lock, &pad] (int begin, int end) {
+        unsigned int n = 0;
+        vec3 local_pad (0.0f, 0.0f, 0.0f);
+        for (int i = begin; i < end; i++) {
+            unsigned long long key = box_key (boxes[i], inv);
+            if (key != h->object_key[i]) {
+                h->object_key[i] = key;
+                n++;
+            } else {
+                h->boxes[h->sorted_of[i]] = boxes[i];
+            }
+            vec3 e = aabb_extent (boxes[i]);
+            for (int a = 0; a < 3; a++) {
+                local_pad.v[a] = fmaxf (local_pad.v[a], e.v[a]);
+            }
+        }
+        moved += n;
+        std::lock_guard<std::mutex> guard (pad_lock);
+        for (int a = 0; a < 3; a++) {
+            pad.v[a] = fmaxf (pad.v[a], local_pad.v[a]);
+        }
+    });
+    if (moved.load () > 0) {
+        measure (h, boxes, count);
+        rebuild (h, boxes, count);
+    } else {
+        h->pad = pad; // same cells, so the occupied range can't have changed
+    }
+    h->stats.moved = moved.load ();
+    h->stats.ms = std::chrono::duration<double, std::milli> (std::chrono::steady_clock::now () - t0).count ();
+}
+
+/*----------------------------------QUERIES-----------------------------------*/
+/* fn (box, id) for every object filed in a cell of [lo, hi] */
+template <typename Fn>
+static void for_each_in_cells (const SpatialHash& h, const int* lo, const int* hi, const Fn& fn) {
+    int x0 = std::max (lo[0], h.cell_min[0]), x1 = std::min (hi[0], h.cell_max[0]);
+    int y0 = std::max (lo[1], h.cell_min[1]), y1 = std::min (hi[1], h.cell_max[1]);
+    int z0 = std::max (lo[2], h.cell_min[2]), z1 = std::min (hi[2], h.cell_max[2]);
+    for (int x = x0; x <= x1; x++) {
+        for (int y = y0; y <= y1; y++) {
+            for (int z = z0; z <= z1; z++) {
+                int s = find_slot (h, cell_key (x, y, z));
+                if (s < 0) {
+                    continue;
+                }
+                unsigned int begin = h.slot_start[s], end = begin + h.slot_count[s];
+                for (unsigned int i = begin; i < end; i++) {
+                    fn (h.boxes[i], h.ids[i]);
+                }
+            }
+        }
+    }
+}
+
+int spatial_hash_query_aabb (const SpatialHash& h, const Aabb& box, std::vector<unsigned int>* out) {
+    out->clear ();
+    int lo[3], hi[3];
+    for (int a = 0; a < 3; a++) {
+        lo[a] = cell_coord (box.min.v[a] - h.pad.v[a], h.inv_cell_size);
+        hi[a] = cell_coord (box.max.v[a] + h.pad.v[a], h.inv_cell_size);
+    }
+    for_each_in_cells (h, lo, hi, [&box, out] (const Aabb& b, unsigned int id) {
+        if (aabb_overlap (b, box)) {
+            out->push_back (id);
+        }
+    });
+    return (int)out->size ();
+}
+
+static float box_point_dist2 (const Aabb& b, const vec3& p) {
+    float d2 = 0.0f;
+    for (int a = 0; a < 3; a++) {
+        float d = fmaxf (fmaxf (b.min.v[a] - p.v[a], p.v[a] - b.max.v[a]), 0.0f);
+        d2 += d * d;
+    }
+    return d2;
+}
+
+int spatial_hash_query_radius (const SpatialHash& h, const vec3& center, float radius,
+                               std::vector<unsigned int>* out) {
+    out->clear ();
+    int lo[3], hi[3];
+    for (int a = 0; a < 3; a++) {
+        lo[a] = cell_coord (center.v[a] - radius - h.pad.v[a], h.inv_cell_size);
+        hi[a] = cell_coord (center.v[a] + radius + h.pad.v[a], h.inv_cell_size);
+    }
+    float r2 = radius * radius;
+    for_each_in_cells (h, lo, hi, [&center, r2, out] (const Aabb& b, unsigned int id) {
+        if (box_point_dist2 (b, center) <= r2) {
+            out->push_back (id);
+        }
+    });
+    return (int)out->size ();
+}
+
+typedef std::vector<std::pair<float, unsigned int> > NearestHeap;
+
+/* keeps the k smallest in a max-heap */
+static void consider (NearestHeap* best, int k, float d2, unsigned int id) {
+    if ((int)best->size () < k) {
+        best->push_back (std::make_pair (d2, id));
+        std::push_heap (best->begin (), best->end ());
+    } else if (d2 < best->front ().first) {
+        std::pop_heap (best->begin (), best->end ());
+        best->back () = std::make_pair (d2, id);
+        std::push_heap (best->begin (), best->end ());
+    }
+}
+
+int spatial_hash_query_nearest (const SpatialHash& h, const vec3& center, int k, std::vector<unsigned int>* out,
+                                std::vector<float>* distances) {
+    out->clear ();
+    if (distances) {
+        distances->clear ();
+    }
+    if (k <= 0 || h.ids.empty ()) {
+        return 0;
+    }
+    // max-heap of the best k so far, on squared centre distance
+    NearestHeap best;
+    float worst = 1e30f; // k-th best so far, kept out of the heap for the tight loops
+    best.reserve ((size_t)k + 1);
+    int c[3];
+    for (int a = 0; a < 3; a++) {
+        c[a] = cell_coord (center.v[a], h.inv_cell_size);
+    }
+    // the cube that holds about k objects at the average density. when the
+    // grid is sparse, probing that many mostly empty cells costs more than
+    // looking at every object once
+    double range_cells = 1.0;
+    for (int a = 0; a < 3; a++) {
+        range_cells *= (double)(h.cell_max[a] - h.cell_min[a] + 1);
+    }
+    double expected_probes = 8.0 * (double)k * range_cells / (double)h.ids.size ();
+    bool scan = expected_probes * SPATIAL_HASH_PROBE_COST > (double)h.ids.size ();
+    // otherwise grow a cube of cells one shell at a time until nothing outside
+    // it can beat the k-th best
+    for (int r = 0;; r++) {
+        long long side = 2 * r + 1;
+        if (scan || side * side * side * SPATIAL_HASH_PROBE_COST > (long long)h.ids.size ()) {
+            best.clear ();
+            worst = 1e30f;
+            for (size_t i = 0; i < h.ids.size (); i++) {
+                float d2 = get_squared_dist (aabb_center (h.boxes[i]), center);
+                if (d2 < worst) {
+                    consider (&best, k, d2, h.ids[i]);
+                    worst = (int)best.size () == k ? best.front ().first : 1e30f;
+                }
+            }
+            break;
+        }
+        for (int dx = -r; dx <= r; dx++) {
+            for (int dy = -r; dy <= r; dy++) {
+                bool face = dx == -r || dx == r || dy == -r || dy == r;
+                for (int dz = -r; dz <= r; dz += (face || r == 0) ? 1 : 2 * r) {
+                    int x = c[0] + dx, y = c[1] + dy, z = c[2] + dz;
+                    if (x < h.cell_min[0] || x > h.cell_max[0] || y < h.cell_min[1] || y > h.cell_max[1] ||
+                        z < h.cell_min[2] || z > h.cell_max[2]) {
+                        continue;
+                    }
+                    int s = find_slot (h, cell_key (x, y, z));
+                    if (s < 0) {
+                        continue;
+                    }
+                    unsigned int begin = h.slot_start[s], end = begin + h.slot_count[s];
+                    for (unsigned int i = begin; i < end; i++) {
+                        float d2 = get_squared_dist (aabb_center (h.boxes[i]), center);
+                        if (d2 < worst) {
+                            consider (&best, k, d2, h.ids[i]);
+                            worst = (int)best.size () == k ? best.front ().first : 1e30f;
+                        }
+                    }
+                }
+            }
+        }
+        // everything occupied has been visited
+        bool covers = true;
+        for (int a = 0; a < 3; a++) {
+            covers = covers && c[a] - r <= h.cell_min[a] && c[a] + r >= h.cell_max[a];
+        }
+        if (covers) {
+            break;
+        }
+        if ((int)best.size () == k) {
+            // nearest point outside the cube
+            float bound = 1e30f;
+            for (int a = 0; a < 3; a++) {
+                float lo = (float)(c[a] - r) * h.cell_size, hi = (float)(c[a] + r + 1) * h.cell_size;
+                bound = fminf (bound, fminf (center.v[a] - lo, hi - center.v[a]));
+            }
+            if (best.front ().first <= bound * bound) {
+                break;
+            }
+        }
+    }
+    std::sort_heap (best.begin (), best.end ());
+    for (size_t i = 0; i < best.size (); i++) {
+        out->push_back (best[i].second);
+        if (distances) {
+            distances->push_back (sqrtf (best[i].first));
+        }
+    }
+    return (int)out->size ();
+}
@@ -0,0 +1,75 @@
+//
+// Uniform spatial hash grid for moving objects.
+//
+// Objects are boxes filed under the cell holding their centre. Cells live in
+// an open addressing table keyed by packed integer cell coordinates, so an
+// unbounded world costs only the cells that are occupied. The objects
+// themselves are stored compactly sorted by cell. A cell's entry is just a
+// start and a count into one array, so a query walks memory linearly
+// instead of chasing per-cell lists.
+//
+// Objects can be larger than a cell: queries pad their search range by the
+// largest half extent seen, and then test the boxes exactly.
+//
+// spatial_hash_update is the per-tick call. If no object changed cell, only
+// the stored boxes are rewritten in place. Otherwise the grid is rebuilt,
+// which is a counting sort on the cell and O(n).
+//
+
+#ifndef FPS_STYLE_ROOM_SPATIAL_HASH_H
+#define FPS_STYLE_ROOM_SPATIAL_HASH_H
+
+#include <vector>
+#include <geometry/mesh.h>
+
+struct SpatialHashStats {
+    unsigned int objects;
+    unsigned int cells;          // occupied
+    unsigned int moved;          // objects that changed cell in the last update
+    unsigned int rebuilds;
+    double ms;                   // last build or update
+};
+
+struct SpatialHash {
+    float cell_size;
+    float inv_cell_size;
+    vec3 pad;                    // largest object half extent
+    int cell_min[3];             // occupied cell range
+    int cell_max[3];
+
+    // open addressing with linear probing over a power of two table
+    std::vector<unsigned long long> slot_key;
+    std::vector<unsigned int> slot_start;
+    std::vector<unsigned int> slot_count;
+    unsigned int slot_mask;
+
+    // objects grouped by cell, a cell's objects are [start, start + count)
+    std::vector<unsigned int> ids;
+    std::vector<Aabb> boxes;
+
+    // per object id
+    std::vector<unsigned long long> object_key;
+    std::vector<unsigned int> sorted_of; // position in ids/boxes
+
+    SpatialHashStats stats;
+};
+
+void spatial_hash_init (SpatialHash* h, float cell_size);
+
+/* files boxes[0..count) under ids 0..count-1 */
+void spatial_hash_build (SpatialHash* h, const Aabb* boxes, int count);
+/* same objects, new boxes. rebuilds only if something changed cell or the
+count changed */
+void spatial_hash_update (SpatialHash* h, const Aabb* boxes, int count);
+
+/* ids of boxes overlapping box. out is cleared first, returns out->size () */
+int spatial_hash_query_aabb (const SpatialHash& h, const Aabb& box, std::vector<unsigned int>* out);
+/* ids of boxes within radius of center (box to point distance) */
+int spatial_hash_query_radius (const SpatialHash& h, const vec3& center, float radius,
+                               std::vector<unsigned int>* out);
+/* the k objects whose box centres are nearest center, nearest first.
+distances (may be NULL) gets the matching centre distances */
+int spatial_hash_query_nearest (const SpatialHash& h, const vec3& center, int k, std::vector<unsigned int>* out,
+                                std::vector<float>* distances);
+
+#endif //FPS_STYLE_ROOM_SPATIAL_HASH_H
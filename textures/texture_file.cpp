@@ -0,0 +1,256 @@
+//
+// See texture_file.h.
+//
+
+#include "texture_file.h"
+#include <algorithm>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static size_t block_bytes (TextureFormat format) {
+    return format == TEXTURE_BC1 ? 8 : 16;
+}
+
+size_t texture_level_bytes (TextureFormat format, int width, int height) {
+    return (size_t)((width + 3) / 4) * (size_t)((height + 3) / 4) * block_bytes (format);
+}
+
+int texture_full_levels (int width, int height) {
+    int levels = 1;
+    while ((width > 1 || height > 1) && levels < TEXTURE_MAX_LEVELS) {
+        width = std::max (1, width / 2);
+        height = std::max (1, height / 2);
+        levels++;
+    }
+    return levels;
+}
+
+/*-----------------------------------FILE-------------------------------------*/
+bool texture_file_open (const char* path, TextureFile* f) {
+    memset (f, 0, sizeof (*f));
+    int fd = open (path, O_RDONLY);
+    if (fd < 0) {
+        fprintf (stderr, "ERROR: could not open %s\n", path);
+        return false;
+    }
+    struct stat st;
+    void* map = MAP_FAILED;
+    if (fstat (fd, &st) == 0 && st.st_size >= (off_t)sizeof (TextureFileHeader)) {
+        map = mmap (NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    // the mapping keeps the file alive
+    close (fd);
+    if (map == MAP_FAILED) {
+        fprintf (stderr, "ERROR: could not map %s\n", path);
+        return false;
+    }
+    f->data = (const unsigned char*)map;
+    f->size = (size_t)st.st_size;
+    f->header = (const TextureFileHeader*)f->data;
+    f->levels = (const TextureFileLevel*)(f->data + sizeof (TextureFileHeader));
+
+    const TextureFileHeader& h = *f->header;
+    bool ok = h.magic == TEXTURE_FILE_MAGIC && h.version == TEXTURE_FILE_VERSION &&
+              (h.format == TEXTURE_BC1 || h.format == TEXTURE_BC3 || h.format == TEXTURE_BC7) && h.width > 0 &&
+              h.height > 0 && h.levels > 0 && h.levels <= (uint32_t)texture_full_levels (h.width, h.height) &&
+              f->size >= sizeof (TextureFileHeader) + h.levels * sizeof (TextureFileLevel);
+    for (uint32_t i = 0; ok && i < h.levels; i++) {
+        size_t expected = texture_level_bytes ((TextureFormat)h.format, texture_level_dim (h.width, i),
+                                               texture_level_dim (h.height, i));
+        ok = f->levels[i].bytes == expected && f->levels[i].offset <= f->size &&
+             f->levels[i].bytes <= f->size - f->levels[i].offset;
+    }
+    if (!ok) {
+        fprintf (stderr, "ERROR: %s is not a valid texture file\n", path);
+        texture_file_close (f);
+        return false;
+    }
+    return true;
+}
+
+void texture_file_close (TextureFile* f) {
+    if (f->data) {
+        munmap ((void*)f->data, f->size);
+    }
+    memset (f, 0, sizeof (*f));
+}
+
+bool texture_file_write (const char* path, TextureFormat format, int width, int height,
+                         const std::vector<TextureLevelData>& levels) {
+    TextureFileHeader h;
+    memset (&h, 0, sizeof (h));
+    h.magic = TEXTURE_FILE_MAGIC;
+    h.version = TEXTURE_FILE_VERSION;
+    h.format = format;
+    h.width = width;
+    h.height = height;
+    h.levels = (uint32_t)levels.size ();
+
+    // smallest level first, each aligned to 16
+    std::vector<TextureFileLevel> index (levels.size ());
+    uint64_t offset = sizeof (h) + index.size () * sizeof (TextureFileLevel);
+    for (size_t i = levels.size (); i-- > 0;) {
+        offset = (offset + 15) & ~(uint64_t)15;
+        index[i].offset = offset;
+        index[i].bytes = levels[i].size ();
+        offset += levels[i].size ();
+    }
+
+    FILE* f = fopen (path, "wb");
+    if (!f) {
+        fprintf (stderr, "ERROR: could not open %s for writing\n", path);
+        return false;
+    }
+    fwrite (&h, sizeof (h), 1, f);
+    fwrite (index.data (), sizeof (TextureFileLevel), index.size (), f);
+    static const unsigned char zeros[16] = {0};
+    for (size_t i = levels.size (); i-- > 0;) {
+        long at = ftell (f);
+        fwrite (zeros, 1, (size_t)(index[i].offset - (uint64_t)at), f);
+        fwrite (levels[i].data (), 1, levels[i].size (), f);
+    }
+    bool ok = !ferror (f);
+    fclose (f);
+    if (!ok) {
+        fprintf (stderr, "ERROR: could not write %s\n", path);
+    }
+    return ok;
+}
+
+/*-----------------------------------BC1--------------------------------------*/
+static unsigned short pack_565 (const int* c) {
+    return (unsigned short)(((c[0] * 31 + 127) / 255) << 11 | ((c[1] * 63 + 127) / 255) << 5 | ((c[2] * 31 + 127) / 255));
+}
+
+static void unpack_565 (unsigned short p, int* c) {
+    c[0] = ((p >> 11) & 31) * 255 / 31;
+    c[1] = ((p >> 5) & 63) * 255 / 63;
+    c[2] = (p & 31) * 255 / 31;
+}
+
+/* texels is 16 RGBA texels, row by row */
+static void encode_block (const unsigned char* texels, unsigned char* out) {
+    int lo[3] = {255, 255, 255}, hi[3] = {0, 0, 0};
+    for (int i = 0; i < 16; i++) {
+        for (int c = 0; c < 3; c++) {
+            lo[c] = std::min (lo[c], (int)texels[i * 4 + c]);
+            hi[c] = std::max (hi[c], (int)texels[i * 4 + c]);
+        }
+    }
+    // the bounding box diagonal runs the wrong way for channels that fall as
+    // others rise. flip those by the sign of their covariance with luma
+    int mean[3] = {0, 0, 0};
+    for (int i = 0; i < 16; i++) {
+        for (int c = 0; c < 3; c++) {
+            mean[c] += texels[i * 4 + c];
+        }
+    }
+    int cov[3] = {0, 0, 0};
+    for (int i = 0; i < 16; i++) {
+        int luma = 0;
+        for (int c = 0; c < 3; c++) {
+            luma += texels[i * 4 + c] * 16 - mean[c];
+        }
+        for (int c = 0; c < 3; c++) {
+            cov[c] += (texels[i * 4 + c] * 16 - mean[c]) * luma;
+        }
+    }
+    for (int c = 0; c < 3; c++) {
+        if (cov[c] < 0) {
+            std::swap (lo[c], hi[c]);
+        }
+        // inset by 1/16 of the range, which lowers the error for most blocks
+        int inset = (hi[c] - lo[c]) / 16;
+        lo[c] += inset;
+        hi[c] -= inset;
+    }
+
+    unsigned short c0 = pack_565 (hi), c1 = pack_565 (lo);
+    if (c0 < c1) {
+        std::swap (c0, c1);
+    }
+    int palette[4][3];
+    unpack_565 (c0, palette[0]);
+    unpack_565 (c1, palette[1]);
+    for (int c = 0; c < 3; c++) {
+        palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+        palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+    }
+    uint32_t indices = 0;
+    if (c0 != c1) {
+        for (int i = 0; i < 16; i++) {
+            int best = 0, best_error = 1 << 30;
+            for (int p = 0; p < 4; p++) {
+                int error = 0;
+                for (int c = 0; c < 3; c++) {
+                    int d = texels[i * 4 + c] - palette[p][c];
+                    error += d * d;
+                }
+                if (error < best_error) {
+                    best_error = error;
+                    best = p;
+                }
+            }
+            indices |= (uint32_t)best << (2 * i);
+        }
+    }
+    out[0] = (unsigned char)(c0 & 255);
+    out[1] = (unsigned char)(c0 >> 8);
+    out[2] = (unsigned char)(c1 & 255);
+    out[3] = (unsigned char)(c1 >> 8);
+    for (int i = 0; i < 4; i++) {
+        out[4 + i] = (unsigned char)(indices >> (8 * i));
+    }
+}
+
+static void encode_level (const unsigned char* rgba, int width, int height, TextureLevelData* out) {
+    int bx = (width + 3) / 4, by = (height + 3) / 4;
+    out->resize ((size_t)bx * by * 8);
+    unsigned char texels[64];
+    for (int y = 0; y < by; y++) {
+        for (int x = 0; x < bx; x++) {
+            // edge blocks repeat the last row and column
+            for (int j = 0; j < 4; j++) {
+                for (int i = 0; i < 4; i++) {
+                    int sx = std::min (x * 4 + i, width - 1), sy = std::min (y * 4 + j, height - 1);
+                    memcpy (texels + (j * 4 + i) * 4, rgba + ((size_t)sy * width + sx) * 4, 4);
+                }
+            }
+            encode_block (texels, out->data () + ((size_t)y * bx + x) * 8);
+        }
+    }
+}
+
+void texture_encode_bc1 (const unsigned char* rgba, int width, int height, std::vector<TextureLevelData>* levels) {
+    int count = texture_full_levels (width, height);
+    levels->assign (count, TextureLevelData ());
+    std::vector<unsigned char> level (rgba, rgba + (size_t)width * height * 4), next;
+    int w = width, h = height;
+    for (int l = 0; l < count; l++) {
+        encode_level (level.data (), w, h, &(*levels)[l]);
+        if (l + 1 == count) {
+            break;
+        }
+        // 2x2 box filter, odd edges fold in the last texel twice
+        int nw = std::max (1, w / 2), nh = std::max (1, h / 2);
+        next.resize ((size_t)nw * nh * 4);
+        for (int y = 0; y < nh; y++) {
+            for (int x = 0; x < nw; x++) {
+                int x0 = std::min (2 * x, w - 1), x1 = std::min (2 * x + 1, w - 1);
+                int y0 = std::min (2 * y, h - 1), y1 = std::min (2 * y + 1, h - 1);
+                for (int c = 0; c < 4; c++) {
+                    int sum = level[((size_t)y0 * w + x0) * 4 + c] + level[((size_t)y0 * w + x1) * 4 + c] +
+                              level[((size_t)y1 * w + x0) * 4 + c] + level[((size_t)y1 * w + x1) * 4 + c];
+                    next[((size_t)y * nw + x) * 4 + c] = (unsigned char)((sum + 2) / 4);
+                }
+            }
+        }
+        level.swap (next);
+        w = nw;
+        h = nh;
+    }
+}
@@ -0,0 +1,86 @@
+//
+// Block compressed texture container, laid out to be mapped and read in
+// place (the same idea as KTX2).
+//
+//   header        TextureFileHeader
+//   level index   levels x TextureFileLevel, level 0 the full size
+//   level data    smallest level first, each 16 byte aligned
+//
+// Storing the small levels first puts the whole mip tail in the first few
+// pages, so it is one short read, and a streamer reading finer levels later
+// walks the file forwards. Level data is the raw blocks in the order
+// glCompressedTexSubImage2D takes them, with no per level header.
+//
+// texture_file_open maps the file read only and checks that every level is
+// inside it and the size its format and dimensions say. Nothing is read until
+// a level's pages are touched.
+//
+// The writer only encodes BC1 (texture_encode_bc1): a 4x4 block is two 565
+// end points and 2 bit indices, 8 bytes for 16 texels, fit along the block's
+// bounding box diagonal. That is quick and good enough for test content.
+// BC3 and BC7 files from other tools read the same way.
+//
+
+#ifndef FPS_STYLE_ROOM_TEXTURE_FILE_H
+#define FPS_STYLE_ROOM_TEXTURE_FILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#define TEXTURE_FILE_MAGIC 0x58455452u // "RTEX"
+#define TEXTURE_FILE_VERSION 1
+#define TEXTURE_MAX_LEVELS 16
+
+enum TextureFormat {
+    TEXTURE_BC1 = 1,             // RGB, 8 bytes a block
+    TEXTURE_BC3 = 3,             // RGBA, 16 bytes a block
+    TEXTURE_BC7 = 7,             // RGBA, 16 bytes a block
+};
+
+struct TextureFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t format;             // TextureFormat
+    uint32_t width, height;
+    uint32_t levels;
+    uint32_t reserved[2];
+};
+
+struct TextureFileLevel {
+    uint64_t offset;             // from the start of the file
+    uint64_t bytes;
+};
+
+struct TextureFile {
+    const unsigned char* data;   // the mapping
+    size_t size;
+    const TextureFileHeader* header;
+    const TextureFileLevel* levels;
+};
+
+/* one level's blocks */
+typedef std::vector<unsigned char> TextureLevelData;
+
+inline int texture_level_dim (int size, int level) {
+    return size >> level > 0 ? size >> level : 1;
+}
+/* bytes of blocks in a width x height level */
+size_t texture_level_bytes (TextureFormat format, int width, int height);
+/* levels in a full chain down to 1x1 */
+int texture_full_levels (int width, int height);
+
+/* false, with a message, if the file is missing, short or inconsistent */
+bool texture_file_open (const char* path, TextureFile* f);
+void texture_file_close (TextureFile* f);
+inline const unsigned char* texture_file_level (const TextureFile& f, int level) {
+    return f.data + f.levels[level].offset;
+}
+
+/* width x height RGBA8 in, BC1 mip chain out, level 0 first */
+void texture_encode_bc1 (const unsigned char* rgba, int width, int height, std::vector<TextureLevelData>* levels);
+/* levels is level 0 first, as texture_encode_bc1 makes them */
+bool texture_file_write (const char* path, TextureFormat format, int width, int height,
+                         const std::vector<TextureLevelData>& levels);
+
+#endif //FPS_STYLE_ROOM_TEXTURE_FILE_H
@@ -0,0 +1,306 @@
+//
+// See texture_streamer.h.
+//
+
+#include "texture_streamer.h"
+#include <memory/memory_tracker.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <math.h>
+#include <mutex>
+#include <string.h>
+#include <thread>
+
+struct TextureLoad {
+    int texture;
+    int level;
+    const unsigned char* source; // in the mapping
+    size_t bytes;
+    std::vector<unsigned char> data;
+};
+
+struct TextureStreamQueue {
+    std::vector<std::thread> threads;
+    std::mutex lock;
+    std::condition_variable wake;
+    std::deque<TextureLoad*> requests;
+    std::vector<TextureLoad*> done;
+    bool stop;
+    std::vector<TextureLoad*> delivered; // their data is in the last changes
+    int in_flight;
+    double window_start_ms;
+    unsigned long long window_bytes;
+};
+
+static double now_ms () {
+    using namespace std::chrono;
+    return duration<double, std::milli> (steady_clock::now ().time_since_epoch ()).count ();
+}
+
+/* copying the level out of the mapping is what faults its pages in */
+static void run_load (TextureLoad* load) {
+    load->data.assign (load->source, load->source + load->bytes);
+}
+
+static void reader_main (TextureStreamQueue* q) {
+    // a thread of our own, so no caller's tag to inherit: the levels it reads are ours
+    MemoryScope scope (MEMORY_TEXTURES);
+    std::unique_lock<std::mutex> lock (q->lock);
+    while (true) {
+        q->wake.wait (lock, [q] { return q->stop || !q->requests.empty (); });
+        if (q->stop) {
+            return;
+        }
+        TextureLoad* load = q->requests.front ();
+        q->requests.pop_front ();
+        lock.unlock ();
+        run_load (load);
+        lock.lock ();
+        q->done.push_back (load);
+    }
+}
+
+static size_t level_bytes (const StreamedTexture& t, int level) {
+    return (size_t)t.file.levels[level].bytes;
+}
+
+void texture_streamer_init (TextureStreamer* s, size_t budget_bytes, int threads, int tail_size) {
+    MemoryScope scope (MEMORY_TEXTURES);
+    s->budget_bytes = budget_bytes;
+    s->tail_size = tail_size > 0 ? tail_size : 64;
+    s->max_in_flight = 8;
+    s->frame = 0;
+    s->announced = 0;
+    s->textures.clear ();
+    s->changes.clear ();
+    memset (&s->stats, 0, sizeof (s->stats));
+    s->stats.budget_bytes = budget_bytes;
+    s->queue = new TextureStreamQueue ();
+    s->queue->stop = false;
+    s->queue->in_flight = 0;
+    s->queue->window_start_ms = now_ms ();
+    s->queue->window_bytes = 0;
+    for (int i = 0; i < threads; i++) {
+        s->queue->threads.push_back (std::thread (reader_main, s->queue));
+    }
+}
+
+int texture_streamer_add (TextureStreamer* s, const char* path) {
+    MemoryScope scope (MEMORY_TEXTURES);
+    StreamedTexture t;
+    memset (&t, 0, sizeof (t));
+    if (!texture_file_open (path, &t.file)) {
+        return -1;
+    }
+    const TextureFileHeader& h = *t.file.header;
+    int levels = (int)h.levels;
+    t.tail = levels - 1;
+    while (t.tail > 0 && std::max (texture_level_dim (h.width, t.tail - 1), texture_level_dim (h.height, t.tail - 1)) <=
+                                 s->tail_size) {
+        t.tail--;
+    }
+    t.top = t.wanted = t.request = t.tail;
+    t.loading = -1;
+    t.last_used = s->frame;
+    for (int l = t.tail; l < levels; l++) {
+        t.resident_bytes += level_bytes (t, l);
+    }
+    s->stats.resident_bytes += t.resident_bytes;
+    s->stats.peak_resident_bytes = std::max (s->stats.peak_resident_bytes, s->stats.resident_bytes);
+    s->textures.push_back (t);
+    return (int)s->textures.size () - 1;
+}
+
+void texture_streamer_request (TextureStreamer* s, int texture, int level) {
+    MemoryScope scope (MEMORY_TEXTURES);
+    StreamedTexture& t = s->textures[texture];
+    level = std::min (std::max (level, 0), t.tail);
+    t.request = std::min (t.request, level);
+    t.last_used = s->frame;
+}
+
+/*-----------------------------------BUDGET-----------------------------------*/
+/* the best texture to drop a level from: one holding more than it was asked
+for, else the least recently used one not used this frame */
+static int pick_victim (const TextureStreamer& s, int except) {
+    int best = -1;
+    for (size_t i = 0; i < s.textures.size (); i++) {
+        const StreamedTexture& t = s.textures[i];
+        if ((int)i == except || t.top >= t.tail || t.loading >= 0) {
+            continue;
+        }
+        bool over = t.top < t.wanted;
+        if (!over && t.last_used == s.frame) {
+            continue;
+        }
+        if (best < 0) {
+            best = (int)i;
+            continue;
+        }
+        const StreamedTexture& b = s.textures[best];
+        bool best_over = b.top < b.wanted;
+        if (over != best_over ? over : t.last_used < b.last_used) {
+            best = (int)i;
+        }
+    }
+    return best;
+}
+
+static bool make_room (TextureStreamer* s, size_t bytes, int except) {
+    while (s->stats.resident_bytes + s->stats.in_flight_bytes + bytes > s->budget_bytes) {
+        int victim = pick_victim (*s, except);
+        if (victim < 0) {
+            return false;
+        }
+        StreamedTexture& t = s->textures[victim];
+        size_t freed = level_bytes (t, t.top);
+        t.top++;
+        t.resident_bytes -= freed;
+        s->stats.resident_bytes -= freed;
+        s->stats.evictions++;
+        TextureChange c = {victim, t.top, -1, NULL, 0};
+        s->changes.push_back (c);
+    }
+    return true;
+}
+
+/*-----------------------------------UPDATE-----------------------------------*/
+void texture_streamer_update (TextureStreamer* s) {
+    MemoryScope scope (MEMORY_TEXTURES);
+    TextureStreamQueue* q = s->queue;
+    for (size_t i = 0; i < q->delivered.size (); i++) {
+        delete q->delivered[i];
+    }
+    q->delivered.clear ();
+    s->changes.clear ();
+    for (; s->announced < s->textures.size (); s->announced++) {
+        TextureChange c = {(int)s->announced, s->textures[s->announced].top, -1, NULL, 0};
+        s->changes.push_back (c);
+    }
+
+    for (size_t i = 0; i < s->textures.size (); i++) {
+        StreamedTexture& t = s->textures[i];
+        t.wanted = t.last_used == s->frame ? t.request : t.tail;
+        t.request = t.tail;
+    }
+
+    std::vector<TextureLoad*> done;
+    {
+        std::lock_guard<std::mutex> guard (q->lock);
+        done.swap (q->done);
+    }
+    for (size_t i = 0; i < done.size (); i++) {
+        TextureLoad* load = done[i];
+        StreamedTexture& t = s->textures[load->texture];
+        // the texture is never evicted while it loads, so this is always the
+        // level above top
+        t.loading = -1;
+        t.top = load->level;
+        t.resident_bytes += load->bytes;
+        q->in_flight--;
+        s->stats.in_flight_bytes -= load->bytes;
+        s->stats.resident_bytes += load->bytes;
+        s->stats.loads++;
+        s->stats.streamed_bytes += load->bytes;
+        q->window_bytes += load->bytes;
+        TextureChange c = {load->texture, t.top, load->level, load->data.data (), load->bytes};
+        s->changes.push_back (c);
+        q->delivered.push_back (load);
+    }
+
+    // furthest short of their request first
+    std::vector<int> order;
+    for (size_t i = 0; i < s->textures.size (); i++) {
+        const StreamedTexture& t = s->textures[i];
+        if (t.loading < 0 && t.wanted < t.top) {
+            order.push_back ((int)i);
+        }
+    }
+    std::stable_sort (order.begin (), order.end (), [s] (int a, int b) {
+        const StreamedTexture& ta = s->textures[a];
+        const StreamedTexture& tb = s->textures[b];
+        return ta.top - ta.wanted > tb.top - tb.wanted;
+    });
+    s->stats.deferred = 0;
+    std::vector<TextureLoad*> start;
+    for (size_t i = 0; i < order.size () && q->in_flight < s->max_in_flight; i++) {
+        StreamedTexture& t = s->textures[order[i]];
+        int level = t.top - 1;
+        size_t bytes = level_bytes (t, level);
+        if (!make_room (s, bytes, order[i])) {
+            s->stats.deferred++;
+            continue;
+        }
+        TextureLoad* load = new TextureLoad ();
+        load->texture = order[i];
+        load->level = level;
+        load->source = texture_file_level (t.file, level);
+        load->bytes = bytes;
+        t.loading = level;
+        q->in_flight++;
+        s->stats.in_flight_bytes += bytes;
+        start.push_back (load);
+    }
+    if (q->threads.empty ()) {
+        // no readers: load inline, collected by the next update
+        for (size_t i = 0; i < start.size (); i++) {
+            run_load (start[i]);
+        }
+        q->done.insert (q->done.end (), start.begin (), start.end ());
+    } else if (!start.empty ()) {
+        std::lock_guard<std::mutex> guard (q->lock);
+        q->requests.insert (q->requests.end (), start.begin (), start.end ());
+        q->wake.notify_all ();
+    }
+
+    s->stats.short_textures = 0;
+    for (size_t i = 0; i < s->textures.size (); i++) {
+        s->stats.short_textures += s->textures[i].wanted < s->textures[i].top;
+    }
+    s->stats.peak_resident_bytes = std::max (s->stats.peak_resident_bytes, s->stats.resident_bytes);
+    double now = now_ms ();
+    if (now - q->window_start_ms >= 1000.0) {
+        s->stats.bandwidth_mb_s = (double)q->window_bytes / ((now - q->window_start_ms) * 1000.0);
+        q->window_start_ms = now;
+        q->window_bytes = 0;
+    }
+    s->frame++;
+}
+
+void texture_streamer_destroy (TextureStreamer* s) {
+    TextureStreamQueue* q = s->queue;
+    {
+        std::lock_guard<std::mutex> guard (q->lock);
+        q->stop = true;
+        q->wake.notify_all ();
+    }
+    for (size_t i = 0; i < q->threads.size (); i++) {
+        q->threads[i].join ();
+    }
+    for (size_t i = 0; i < q->requests.size (); i++) {
+        delete q->requests[i];
+    }
+    for (size_t i = 0; i < q->done.size (); i++) {
+        delete q->done[i];
+    }
+    for (size_t i = 0; i < q->delivered.size (); i++) {
+        delete q->delivered[i];
+    }
+    delete q;
+    for (size_t i = 0; i < s->textures.size (); i++) {
+        texture_file_close (&s->textures[i].file);
+    }
+    s->textures.clear ();
+    s->changes.clear ();
+    s->queue = NULL;
+}
+
+int texture_mip_for_distance (int width, float world_size, float distance, float focal_px) {
+    float pixels = world_size * focal_px / std::max (distance, 1e-3f);
+    if (pixels >= (float)width) {
+        return 0;
+    }
+    return (int)floorf (log2f ((float)width / std::max (pixels, 1.0f)));
+}
@@ -0,0 +1,105 @@
+//
+// Texture streaming: which mip levels of which textures are resident, under
+// a memory budget.
+//
+// texture_streamer_add maps a texture file (textures/texture_file.h) and
+// reads its mip tail, every level no bigger than tail_size on a side, there
+// and then. That is a few KB from the start of the file, so everything has
+// something to draw with from the first frame. The finer levels are streamed:
+//  - each frame the renderer calls texture_streamer_request with the level
+//    a texture needs, usually from texture_mip_for_distance
+//  - texture_streamer_update asks background threads for the next finer
+//    level of textures short of their request, furthest short first. Levels
+//    come in one at a time, coarse to fine, so a texture sharpens as it
+//    streams instead of waiting for its biggest level
+//  - the threads copy the level out of the mapping, which is where the disk
+//    reads happen, and hand it back to the next update
+//  - a load that would go over budget_bytes first evicts the finest level of
+//    the least recently used texture, starting with textures holding more
+//    than they were asked for. The mip tail is never evicted. If nothing
+//    can go, the load waits for a later frame
+// The budget counts what is resident plus what is in flight.
+//
+// Residency changes come out of texture_streamer_update as a list, for the
+// GL side (render/texture_streamer_gl.h) to apply: a texture's finest
+// resident level (top) moved, and when it moved down a level was loaded
+// whose blocks are in `data` until the next update.
+//
+// Streaming threads are the streamer's own, not the job system's. A disk
+// read can block for milliseconds and must not hold up a frame's jobs.
+//
+
+#ifndef FPS_STYLE_ROOM_TEXTURE_STREAMER_H
+#define FPS_STYLE_ROOM_TEXTURE_STREAMER_H
+
+#include <stddef.h>
+#include <vector>
+#include <textures/texture_file.h>
+
+struct StreamedTexture {
+    TextureFile file;
+    int tail;                    // finest level of the always resident mip tail
+    int top;                     // finest resident level
+    int wanted;                  // last update's request
+    int request;                 // finest asked for since the last update
+    int loading;                 // level in flight, -1 if none
+    unsigned int last_used;      // frame of the last request
+    size_t resident_bytes;
+};
+
+/* a texture's resident levels are now top and coarser. level is the one just
+loaded, its blocks in data, or -1 if levels were evicted or this is a new
+texture's tail */
+struct TextureChange {
+    int texture;
+    int top;
+    int level;
+    const unsigned char* data;
+    size_t bytes;
+};
+
+struct TextureStreamerStats {
+    size_t resident_bytes;
+    size_t peak_resident_bytes;
+    size_t in_flight_bytes;
+    size_t budget_bytes;
+    unsigned long long streamed_bytes;
+    unsigned int loads;
+    unsigned int evictions;
+    unsigned int deferred;       // loads put off last update for lack of room
+    unsigned int short_textures; // textures below their request
+    double bandwidth_mb_s;       // streamed, over the last second or so
+};
+
+struct TextureStreamQueue;
+
+struct TextureStreamer {
+    size_t budget_bytes;
+    int tail_size;
+    int max_in_flight;
+    unsigned int frame;
+    std::vector<StreamedTexture> textures;
+    size_t announced;                      // textures whose tail was in changes
+    std::vector<TextureChange> changes;    // from the last update
+    TextureStreamQueue* queue;             // threads and their queues
+    TextureStreamerStats stats;
+};
+
+/* threads background readers. tail_size 0 means 64 */
+void texture_streamer_init (TextureStreamer* s, size_t budget_bytes, int threads, int tail_size);
+/* the texture's index, or -1 if the file wouldn't open. its tail is read
+now and goes out in the next update's changes */
+int texture_streamer_add (TextureStreamer* s, const char* path);
+/* the texture should have this level resident, 0 the finest */
+void texture_streamer_request (TextureStreamer* s, int texture, int level);
+/* collects finished loads, evicts and starts loads. once a frame */
+void texture_streamer_update (TextureStreamer* s);
+/* waits for the loads in flight, stops the threads and unmaps every file */
+void texture_streamer_destroy (TextureStreamer* s);
+
+/* the level that gives about one texel per pixel for a texture width texels
+across that covers world_size units at distance, with focal_px the
+projection's pixels per unit at distance 1 (proj.m[5] * screen_height / 2) */
+int texture_mip_for_distance (int width, float world_size, float distance, float focal_px);
+
+#endif //FPS_STYLE_ROOM_TEXTURE_STREAMER_H
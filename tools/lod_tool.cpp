@@ -0,0 +1,46 @@
+//
+// Offline LOD builder: simplifies an .obj into a chain of levels and writes
+// them together as one .lod file (see lod/mesh_simplify.h).
+//
+// usage: lod_tool input.obj output.lod [ratio ...]
+//        default ratios 0.5 0.25 0.125 0.0625
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <geometry/mesh.h>
+#include <lod/mesh_simplify.h>
+
+int main (int argc, char** argv) {
+    if (argc < 3) {
+        fprintf (stderr, "usage: %s input.obj output.lod [ratio ...]\n", argv[0]);
+        return 1;
+    }
+    float ratios[LOD_MAX_LEVELS - 1] = {0.5f, 0.25f, 0.125f, 0.0625f};
+    int ratio_count = 4;
+    if (argc > 3) {
+        ratio_count = 0;
+        for (int i = 3; i < argc && ratio_count < LOD_MAX_LEVELS - 1; i++) {
+            ratios[ratio_count++] = (float)atof (argv[i]);
+        }
+    }
+
+    Mesh mesh;
+    if (!mesh_load_obj (argv[1], &mesh)) {
+        return 1;
+    }
+    LodMesh lod;
+    auto t0 = std::chrono::steady_clock::now ();
+    if (!lod_build (mesh, ratios, ratio_count, &lod)) {
+        return 1;
+    }
+    double ms = std::chrono::duration<double, std::milli> (std::chrono::steady_clock::now () - t0).count ();
+
+    printf ("%s: %u vertices, %u triangles, simplified in %.1f ms\n", argv[1],
+            (unsigned int)mesh.positions.size (), mesh_triangle_count (mesh), ms);
+    for (int i = 0; i < lod.level_count; i++) {
+        printf ("  level %d: %8u triangles  error %.5f\n", i, lod.levels[i].index_count / 3, lod.levels[i].error);
+    }
+    return lod_save (argv[2], lod) ? 0 : 1;
+}
@@ -0,0 +1,54 @@
+//
+// Builds a navmesh offline from an .obj, e.g. one room_gen_tool wrote, and
+// saves it for navmesh_load. Prints what the build made and how long it
+// took.
+//
+// usage: nav_tool input.obj output.nav [cell_size] [agent_radius] [agent_height]
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <geometry/mesh.h>
+#include <jobs/job_system.h>
+#include <nav/navmesh.h>
+
+int main (int argc, char** argv) {
+    if (argc < 3) {
+        fprintf (stderr, "usage: %s input.obj output.nav [cell_size] [agent_radius] [agent_height]\n", argv[0]);
+        return 1;
+    }
+    NavBuildParams p = navmesh_default_params ();
+    if (argc > 3) {
+        p.cell_size = (float)atof (argv[3]);
+    }
+    if (argc > 4) {
+        p.agent_radius = (float)atof (argv[4]);
+    }
+    if (argc > 5) {
+        p.agent_height = (float)atof (argv[5]);
+    }
+    if (p.cell_size <= 0.0f || p.agent_radius < 0.0f || p.agent_height <= 0.0f) {
+        fprintf (stderr, "ERROR: cell size and agent height must be positive\n");
+        return 1;
+    }
+    Mesh level;
+    if (!mesh_load_obj (argv[1], &level)) {
+        return 1;
+    }
+
+    job_system_init (0);
+    NavMesh nav;
+    bool built = navmesh_build (p, &level, NULL, 1, &nav);
+    job_system_shutdown ();
+    if (!built) {
+        return 1;
+    }
+
+    const NavBuildStats& st = nav.stats;
+    printf ("%llu triangles, %llu walkable, %d x %d columns\n", (unsigned long long)st.triangles,
+            (unsigned long long)st.walkable_triangles, nav.width, nav.depth);
+    printf ("%u floors, %u eroded, %u polygons, %u links, %u islands\n", st.floors, st.eroded, st.polys, st.links,
+            st.islands);
+    printf ("voxelize %.1f ms, floors %.1f ms, polygons %.1f ms\n", st.voxelize_ms, st.floors_ms, st.polys_ms);
+    return navmesh_save (argv[2], nav) ? 0 : 1;
+}
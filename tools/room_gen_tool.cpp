@@ -0,0 +1,49 @@
+//
+// Generates a procedural level and writes it out as one .obj: architecture
+// and every prop instance, in world space. Prints the level's size and its
+// hash, which is the same for the same arguments on any machine.
+//
+// usage: room_gen_tool output.obj [seed] [rooms_per_side] [props_per_room] [detail]
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <geometry/mesh.h>
+#include <jobs/job_system.h>
+#include <scene/room_generator.h>
+
+int main (int argc, char** argv) {
+    if (argc < 2) {
+        fprintf (stderr, "usage: %s output.obj [seed] [rooms_per_side] [props_per_room] [detail]\n", argv[0]);
+        return 1;
+    }
+    RoomGenParams p = room_gen_default_params (argc > 2 ? (uint32_t)strtoul (argv[2], NULL, 10) : 1u);
+    if (argc > 3) {
+        p.rooms_x = p.rooms_z = atoi (argv[3]);
+    }
+    if (argc > 4) {
+        p.props_per_room = atoi (argv[4]);
+    }
+    if (argc > 5) {
+        p.detail = atoi (argv[5]);
+    }
+    if (p.rooms_x < 1 || p.props_per_room < 0 || p.detail < 1) {
+        fprintf (stderr, "ERROR: rooms and detail must be at least 1\n");
+        return 1;
+    }
+
+    job_system_init (0);
+    GeneratedLevel level;
+    room_generate (p, &level);
+    Mesh flat;
+    room_generator_flatten (level, &flat);
+    job_system_shutdown ();
+
+    const RoomGenStats& st = level.stats;
+    printf ("%u rooms, %u corridors, %u prop instances of %u meshes\n", st.rooms, st.corridors, st.instances,
+            level.library_meshes);
+    printf ("%llu unique triangles, %llu in the scene, generated in %.1f ms\n", (unsigned long long)st.unique_triangles,
+            (unsigned long long)st.scene_triangles, st.ms);
+    printf ("hash %016llx\n", (unsigned long long)room_generator_hash (level));
+    return mesh_save_obj (argv[1], flat) ? 0 : 1;
+}
@@ -0,0 +1,93 @@
+//
+// Packs an image into a texture file (textures/texture_file.h): BC1, with a
+// full mip chain. The input is a binary PPM, or checker:SIZE for a generated
+// SIZE x SIZE test pattern. Prints each level's size and where it went.
+//
+// usage: texture_pack_tool (input.ppm | checker:SIZE) output.rtex
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <textures/texture_file.h>
+
+static bool load_ppm (const char* path, std::vector<unsigned char>* rgba, int* width, int* height) {
+    FILE* f = fopen (path, "rb");
+    if (!f) {
+        fprintf (stderr, "ERROR: could not open %s\n", path);
+        return false;
+    }
+    int max = 0;
+    bool ok = fscanf (f, "P6 %d %d %d", width, height, &max) == 3 && *width > 0 && *height > 0 && max == 255 &&
+              fgetc (f) != EOF;
+    std::vector<unsigned char> rgb;
+    if (ok) {
+        rgb.resize ((size_t)*width * *height * 3);
+        ok = fread (rgb.data (), 1, rgb.size (), f) == rgb.size ();
+    }
+    fclose (f);
+    if (!ok) {
+        fprintf (stderr, "ERROR: %s is not an 8 bit binary PPM\n", path);
+        return false;
+    }
+    rgba->resize ((size_t)*width * *height * 4);
+    for (size_t i = 0; i < (size_t)*width * *height; i++) {
+        memcpy (&(*rgba)[i * 4], &rgb[i * 3], 3);
+        (*rgba)[i * 4 + 3] = 255;
+    }
+    return true;
+}
+
+/* 8 x 8 checks in two colours, with a gradient so every mip level differs */
+static void make_checker (int size, std::vector<unsigned char>* rgba) {
+    rgba->resize ((size_t)size * size * 4);
+    int check = size / 8 > 0 ? size / 8 : 1;
+    for (int y = 0; y < size; y++) {
+        for (int x = 0; x < size; x++) {
+            unsigned char* p = &(*rgba)[((size_t)y * size + x) * 4];
+            bool light = ((x / check) ^ (y / check)) & 1;
+            p[0] = (unsigned char)(light ? 220 : 40);
+            p[1] = (unsigned char)(x * 255 / size);
+            p[2] = (unsigned char)(light ? 60 : 200);
+            p[3] = 255;
+        }
+    }
+}
+
+int main (int argc, char** argv) {
+    if (argc < 3) {
+        fprintf (stderr, "usage: %s (input.ppm | checker:SIZE) output.rtex\n", argv[0]);
+        return 1;
+    }
+    std::vector<unsigned char> rgba;
+    int width = 0, height = 0;
+    if (strncmp (argv[1], "checker:", 8) == 0) {
+        width = height = atoi (argv[1] + 8);
+        if (width < 1) {
+            fprintf (stderr, "ERROR: checker size must be at least 1\n");
+            return 1;
+        }
+        make_checker (width, &rgba);
+    } else if (!load_ppm (argv[1], &rgba, &width, &height)) {
+        return 1;
+    }
+
+    std::vector<TextureLevelData> levels;
+    texture_encode_bc1 (rgba.data (), width, height, &levels);
+    if (!texture_file_write (argv[2], TEXTURE_BC1, width, height, levels)) {
+        return 1;
+    }
+    TextureFile f;
+    if (!texture_file_open (argv[2], &f)) {
+        return 1;
+    }
+    printf ("%s: %dx%d BC1, %u levels, %zu bytes\n", argv[2], width, height, f.header->levels, f.size);
+    for (uint32_t l = 0; l < f.header->levels; l++) {
+        printf ("  level %2u  %5dx%-5d  %9llu bytes at %llu\n", l, texture_level_dim (width, l),
+                texture_level_dim (height, l), (unsigned long long)f.levels[l].bytes,
+                (unsigned long long)f.levels[l].offset);
+    }
+    texture_file_close (&f);
+    return 0;
+}
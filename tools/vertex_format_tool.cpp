@@ -0,0 +1,59 @@
+//
+// Reports what the compressed vertex format (render/vertex_format.h) saves
+// and loses on a mesh: bytes before and after, and the worst error of each
+// attribute. Normals are the smooth vertex normals, uvs a planar projection
+// onto xz at "tiling" repeats per unit, like world aligned level textures.
+//
+// usage: vertex_format_tool input.obj [tiling]
+//        default tiling 1
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <geometry/mesh.h>
+#include <render/vertex_format.h>
+
+int main (int argc, char** argv) {
+    if (argc < 2) {
+        fprintf (stderr, "usage: %s input.obj [tiling]\n", argv[0]);
+        return 1;
+    }
+    float tiling = argc > 2 ? (float)atof (argv[2]) : 1.0f;
+    Mesh mesh;
+    if (!mesh_load_obj (argv[1], &mesh)) {
+        return 1;
+    }
+    if (mesh.positions.empty ()) {
+        fprintf (stderr, "ERROR: %s has no vertices\n", argv[1]);
+        return 1;
+    }
+    int count = (int)mesh.positions.size ();
+    std::vector<vec3> normals;
+    mesh_vertex_normals (mesh, &normals);
+    std::vector<float> uvs (count * 2);
+    float largest_uv = 0.0f;
+    for (int i = 0; i < count; i++) {
+        uvs[i * 2] = mesh.positions[i].v[0] * tiling;
+        uvs[i * 2 + 1] = mesh.positions[i].v[2] * tiling;
+        largest_uv = fmaxf (largest_uv, fmaxf (fabsf (uvs[i * 2]), fabsf (uvs[i * 2 + 1])));
+    }
+
+    PackedVertices packed;
+    VertexFormatReport r;
+    vertex_pack (&mesh.positions[0], &normals[0], &uvs[0], count, &packed, &r);
+    const VertexQuantization& q = packed.quantization;
+    printf ("%s: %u vertices, bounds %.3f x %.3f x %.3f\n", argv[1], r.vertices, q.extent.v[0], q.extent.v[1],
+            q.extent.v[2]);
+    printf ("  format     float     packed\n");
+    printf ("  position   %2d bytes  %2d bytes  unorm16 in bounds   max error %.6f (%.2e of extent)\n",
+            (int)(3 * sizeof (float)), (int)sizeof (((PackedVertex*)0)->position), r.position_error,
+            r.position_error_rel);
+    printf ("  normal     %2d bytes  %2d bytes  octahedral snorm16  max error %.5f degrees\n",
+            (int)(3 * sizeof (float)), (int)sizeof (((PackedVertex*)0)->normal), r.normal_error_deg);
+    printf ("  uv         %2d bytes  %2d bytes  half float          max error %.6f (|uv| up to %.1f)\n",
+            (int)(2 * sizeof (float)), (int)sizeof (((PackedVertex*)0)->uv), r.uv_error, largest_uv);
+    printf ("  total %zu -> %zu bytes, %.1f%% saved\n", r.float_bytes, r.packed_bytes,
+            100.0 * (1.0 - (double)r.packed_bytes / (double)r.float_bytes));
+    return 0;
+}
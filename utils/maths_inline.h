@@ -0,0 +1,522 @@
+/******************************************************************************\
+| Header-only maths types                                                      |
+|******************************************************************************|
+| Same structs as maths_funcs.h (vec2, vec3, vec4, mat3, mat4, versor) holding |
+| plain float arrays "v", "m", "q", but every function lives here so that the  |
+| compiler can inline it without LTO. Constructors and the arithmetic that     |
+| does not need libm are constexpr (C++14). Operators are const-correct, so    |
+| they work on temporaries and const references.                               |
+| maths_funcs.h includes this file and keeps the old print() helpers, so old   |
+| code keeps compiling unchanged.                                              |
+\******************************************************************************/
+#ifndef _MATHS_INLINE_H_
+#define _MATHS_INLINE_H_
+
+#define _USE_MATH_DEFINES
+#include <math.h>
+#include <stdio.h>
+
+static constexpr float MATHS_PI = 3.14159265358979323846f;
+static constexpr float MATHS_DEG_TO_RAD = MATHS_PI / 180.0f;
+static constexpr float MATHS_RAD_TO_DEG = 180.0f / MATHS_PI;
+
+struct vec2;
+struct vec3;
+struct vec4;
+struct versor;
+
+struct vec2 {
+    vec2 () = default;
+    constexpr vec2 (float x, float y) : v{x, y} {}
+    float v[2];
+};
+
+struct vec3 {
+    vec3 () = default;
+    // create from 3 scalars
+    constexpr vec3 (float x, float y, float z) : v{x, y, z} {}
+    // create from vec2 and a scalar
+    constexpr vec3 (const vec2& vv, float z) : v{vv.v[0], vv.v[1], z} {}
+    // create from truncated vec4
+    constexpr vec3 (const vec4& vv);
+
+    constexpr vec3 operator+ (const vec3& rhs) const {
+        return vec3 (v[0] + rhs.v[0], v[1] + rhs.v[1], v[2] + rhs.v[2]);
+    }
+    constexpr vec3 operator+ (float rhs) const {
+        return vec3 (v[0] + rhs, v[1] + rhs, v[2] + rhs);
+    }
+    constexpr vec3 operator- (const vec3& rhs) const {
+        return vec3 (v[0] - rhs.v[0], v[1] - rhs.v[1], v[2] - rhs.v[2]);
+    }
+    constexpr vec3 operator- (float rhs) const {
+        return vec3 (v[0] - rhs, v[1] - rhs, v[2] - rhs);
+    }
+    constexpr vec3 operator- () const {
+        return vec3 (-v[0], -v[1], -v[2]);
+    }
+    constexpr vec3 operator* (float rhs) const {
+        return vec3 (v[0] * rhs, v[1] * rhs, v[2] * rhs);
+    }
+    constexpr vec3 operator/ (float rhs) const {
+        return vec3 (v[0] / rhs, v[1] / rhs, v[2] / rhs);
+    }
+    constexpr vec3& operator+= (const vec3& rhs) {
+        v[0] += rhs.v[0];
+        v[1] += rhs.v[1];
+        v[2] += rhs.v[2];
+        return *this;
+    }
+    constexpr vec3& operator-= (const vec3& rhs) {
+        v[0] -= rhs.v[0];
+        v[1] -= rhs.v[1];
+        v[2] -= rhs.v[2];
+        return *this;
+    }
+    constexpr vec3& operator*= (float rhs) {
+        v[0] *= rhs;
+        v[1] *= rhs;
+        v[2] *= rhs;
+        return *this;
+    }
+
+    // internal data
+    float v[3];
+};
+
+struct vec4 {
+    vec4 () = default;
+    constexpr vec4 (float x, float y, float z, float w) : v{x, y, z, w} {}
+    constexpr vec4 (const vec2& vv, float z, float w) : v{vv.v[0], vv.v[1], z, w} {}
+    constexpr vec4 (const vec3& vv, float w) : v{vv.v[0], vv.v[1], vv.v[2], w} {}
+    float v[4];
+};
+
+constexpr vec3::vec3 (const vec4& vv) : v{vv.v[0], vv.v[1], vv.v[2]} {}
+
+/* stored like this:
+0 3 6
+1 4 7
+2 5 8 */
+struct mat3 {
+    mat3 () = default;
+    // note! this is entering components in COLUMN order
+    constexpr mat3 (float a, float b, float c,
+                    float d, float e, float f,
+                    float g, float h, float i) : m{a, b, c, d, e, f, g, h, i} {}
+    float m[9];
+};
+
+/* stored like this:
+0 4 8  12
+1 5 9  13
+2 6 10 14
+3 7 11 15*/
+struct mat4 {
+    mat4 () = default;
+    // note! this is entering components in COLUMN order
+    constexpr mat4 (float a, float b, float c, float d,
+                    float e, float f, float g, float h,
+                    float i, float j, float k, float l,
+                    float mm, float n, float o, float p)
+            : m{a, b, c, d, e, f, g, h, i, j, k, l, mm, n, o, p} {}
+
+    constexpr vec4 operator* (const vec4& rhs) const {
+        return vec4 (
+                m[0] * rhs.v[0] + m[4] * rhs.v[1] + m[8] * rhs.v[2] + m[12] * rhs.v[3],
+                m[1] * rhs.v[0] + m[5] * rhs.v[1] + m[9] * rhs.v[2] + m[13] * rhs.v[3],
+                m[2] * rhs.v[0] + m[6] * rhs.v[1] + m[10] * rhs.v[2] + m[14] * rhs.v[3],
+                m[3] * rhs.v[0] + m[7] * rhs.v[1] + m[11] * rhs.v[2] + m[15] * rhs.v[3]
+        );
+    }
+
+    constexpr mat4 operator* (const mat4& rhs) const {
+        mat4 r (0.0f, 0.0f, 0.0f, 0.0f,
+                0.0f, 0.0f, 0.0f, 0.0f,
+                0.0f, 0.0f, 0.0f, 0.0f,
+                0.0f, 0.0f, 0.0f, 0.0f);
+        // column of the result = this * column of rhs
+        for (int col = 0; col < 4; col++) {
+            for (int row = 0; row < 4; row++) {
+                r.m[col * 4 + row] =
+                        m[row] * rhs.m[col * 4] +
+                        m[row + 4] * rhs.m[col * 4 + 1] +
+                        m[row + 8] * rhs.m[col * 4 + 2] +
+                        m[row + 12] * rhs.m[col * 4 + 3];
+            }
+        }
+        return r;
+    }
+
+    float m[16];
+};
+
+struct versor {
+    versor () = default;
+    // w first, like the rest of the quaternion code
+    constexpr versor (float w, float x, float y, float z) : q{w, x, y, z} {}
+
+    constexpr versor operator/ (float rhs) const {
+        return versor (q[0] / rhs, q[1] / rhs, q[2] / rhs, q[3] / rhs);
+    }
+    constexpr versor operator* (float rhs) const {
+        return versor (q[0] * rhs, q[1] * rhs, q[2] * rhs, q[3] * rhs);
+    }
+    // Hamilton product this * rhs, NOT re-normalised (operator* below is)
+    constexpr versor mul_raw (const versor& rhs) const {
+        return versor (
+                rhs.q[0] * q[0] - rhs.q[1] * q[1] - rhs.q[2] * q[2] - rhs.q[3] * q[3],
+                rhs.q[0] * q[1] + rhs.q[1] * q[0] - rhs.q[2] * q[3] + rhs.q[3] * q[2],
+                rhs.q[0] * q[2] + rhs.q[1] * q[3] + rhs.q[2] * q[0] - rhs.q[3] * q[1],
+                rhs.q[0] * q[3] - rhs.q[1] * q[2] + rhs.q[2] * q[1] + rhs.q[3] * q[0]
+        );
+    }
+    constexpr versor add_raw (const versor& rhs) const {
+        return versor (q[0] + rhs.q[0], q[1] + rhs.q[1], q[2] + rhs.q[2], q[3] + rhs.q[3]);
+    }
+    // these two re-normalise in case of mangling, as they always did
+    inline versor operator* (const versor& rhs) const;
+    inline versor operator+ (const versor& rhs) const;
+
+    float q[4];
+};
+
+/*------------------------------VECTOR FUNCTIONS------------------------------*/
+constexpr float dot (const vec3& a, const vec3& b) {
+    return a.v[0] * b.v[0] + a.v[1] * b.v[1] + a.v[2] * b.v[2];
+}
+
+constexpr vec3 cross (const vec3& a, const vec3& b) {
+    return vec3 (
+            a.v[1] * b.v[2] - a.v[2] * b.v[1],
+            a.v[2] * b.v[0] - a.v[0] * b.v[2],
+            a.v[0] * b.v[1] - a.v[1] * b.v[0]
+    );
+}
+
+// squared length
+constexpr float length2 (const vec3& v) {
+    return dot (v, v);
+}
+
+inline float length (const vec3& v) {
+    return sqrtf (length2 (v));
+}
+
+// note: proper spelling (hehe)
+inline vec3 normalise (const vec3& v) {
+    float l = length (v);
+    if (0.0f == l) {
+        return vec3 (0.0f, 0.0f, 0.0f);
+    }
+    return v * (1.0f / l);
+}
+
+constexpr float get_squared_dist (const vec3& from, const vec3& to) {
+    return length2 (to - from);
+}
+
+/* converts an un-normalised direction into a heading in degrees
+NB i suspect that the z is backwards here but i've used in in
+several places like this. d'oh! */
+inline float direction_to_heading (const vec3& d) {
+    return atan2f (-d.v[0], -d.v[2]) * MATHS_RAD_TO_DEG;
+}
+
+inline vec3 heading_to_direction (float degrees) {
+    float rad = degrees * MATHS_DEG_TO_RAD;
+    return vec3 (-sinf (rad), 0.0f, -cosf (rad));
+}
+
+/*-----------------------------MATRIX FUNCTIONS-------------------------------*/
+constexpr mat3 zero_mat3 () {
+    return mat3 (
+            0.0f, 0.0f, 0.0f,
+            0.0f, 0.0f, 0.0f,
+            0.0f, 0.0f, 0.0f
+    );
+}
+
+constexpr mat3 identity_mat3 () {
+    return mat3 (
+            1.0f, 0.0f, 0.0f,
+            0.0f, 1.0f, 0.0f,
+            0.0f, 0.0f, 1.0f
+    );
+}
+
+constexpr mat4 zero_mat4 () {
+    return mat4 (
+            0.0f, 0.0f, 0.0f, 0.0f,
+            0.0f, 0.0f, 0.0f, 0.0f,
+            0.0f, 0.0f, 0.0f, 0.0f,
+            0.0f, 0.0f, 0.0f, 0.0f
+    );
+}
+
+constexpr mat4 identity_mat4 () {
+    return mat4 (
+            1.0f, 0.0f, 0.0f, 0.0f,
+            0.0f, 1.0f, 0.0f, 0.0f,
+            0.0f, 0.0f, 1.0f, 0.0f,
+            0.0f, 0.0f, 0.0f, 1.0f
+    );
+}
+
+// returns a 16-element array flipped on the main diagonal
+constexpr mat4 transpose (const mat4& mm) {
+    return mat4 (
+            mm.m[0], mm.m[4], mm.m[8], mm.m[12],
+            mm.m[1], mm.m[5], mm.m[9], mm.m[13],
+            mm.m[2], mm.m[6], mm.m[10], mm.m[14],
+            mm.m[3], mm.m[7], mm.m[11], mm.m[15]
+    );
+}
+
+// returns a scalar value with the determinant for a 4x4 matrix, expanded
+// through the 2x2 sub-determinants of the bottom two rows
+constexpr float determinant (const mat4& mm) {
+    const float* m = mm.m;
+    float s0 = m[2] * m[7] - m[6] * m[3];
+    float s1 = m[2] * m[11] - m[10] * m[3];
+    float s2 = m[2] * m[15] - m[14] * m[3];
+    float s3 = m[6] * m[11] - m[10] * m[7];
+    float s4 = m[6] * m[15] - m[14] * m[7];
+    float s5 = m[10] * m[15] - m[14] * m[11];
+    return m[0] * (m[5] * s5 - m[9] * s4 + m[13] * s3) -
+           m[4] * (m[1] * s5 - m[9] * s2 + m[13] * s1) +
+           m[8] * (m[1] * s4 - m[5] * s2 + m[13] * s0) -
+           m[12] * (m[1] * s3 - m[5] * s1 + m[9] * s0);
+}
+
+/* returns the inverse of a 4x4 matrix by cofactors. shares the 2x2
+sub-determinants between the cofactors instead of expanding each one in full */
+inline mat4 inverse (const mat4& mm) {
+    const float* m = mm.m;
+    float a0 = m[0] * m[5] - m[4] * m[1];
+    float a1 = m[0] * m[9] - m[8] * m[1];
+    float a2 = m[0] * m[13] - m[12] * m[1];
+    float a3 = m[4] * m[9] - m[8] * m[5];
+    float a4 = m[4] * m[13] - m[12] * m[5];
+    float a5 = m[8] * m[13] - m[12] * m[9];
+    float b0 = m[2] * m[7] - m[6] * m[3];
+    float b1 = m[2] * m[11] - m[10] * m[3];
+    float b2 = m[2] * m[15] - m[14] * m[3];
+    float b3 = m[6] * m[11] - m[10] * m[7];
+    float b4 = m[6] * m[15] - m[14] * m[7];
+    float b5 = m[10] * m[15] - m[14] * m[11];
+    float det = a0 * b5 - a1 * b4 + a2 * b3 + a3 * b2 - a4 * b1 + a5 * b0;
+    /* there is no inverse if determinant is zero (not likely unless scale is
+    broken) */
+    if (0.0f == det) {
+        fprintf (stderr, "WARNING. matrix has no determinant. can not invert\n");
+        return mm;
+    }
+    float inv_det = 1.0f / det;
+    return mat4 (
+            (m[5] * b5 - m[9] * b4 + m[13] * b3) * inv_det,
+            (-m[1] * b5 + m[9] * b2 - m[13] * b1) * inv_det,
+            (m[1] * b4 - m[5] * b2 + m[13] * b0) * inv_det,
+            (-m[1] * b3 + m[5] * b1 - m[9] * b0) * inv_det,
+            (-m[4] * b5 + m[8] * b4 - m[12] * b3) * inv_det,
+            (m[0] * b5 - m[8] * b2 + m[12] * b1) * inv_det,
+            (-m[0] * b4 + m[4] * b2 - m[12] * b0) * inv_det,
+            (m[0] * b3 - m[4] * b1 + m[8] * b0) * inv_det,
+            (m[7] * a5 - m[11] * a4 + m[15] * a3) * inv_det,
+            (-m[3] * a5 + m[11] * a2 - m[15] * a1) * inv_det,
+            (m[3] * a4 - m[7] * a2 + m[15] * a0) * inv_det,
+            (-m[3] * a3 + m[7] * a1 - m[11] * a0) * inv_det,
+            (-m[6] * a5 + m[10] * a4 - m[14] * a3) * inv_det,
+            (m[2] * a5 - m[10] * a2 + m[14] * a1) * inv_det,
+            (-m[2] * a4 + m[6] * a2 - m[14] * a0) * inv_det,
+            (m[2] * a3 - m[6] * a1 + m[10] * a0) * inv_det
+    );
+}
+
+/*--------------------------AFFINE MATRIX FUNCTIONS---------------------------*/
+// translate a 4d matrix with xyz array. only the bottom row of m takes part in
+// the product with a pure translation, so this is 12 madds instead of 64
+constexpr mat4 translate (const mat4& m, const vec3& v) {
+    mat4 r = m;
+    for (int col = 0; col < 4; col++) {
+        float w = m.m[col * 4 + 3];
+        r.m[col * 4] += v.v[0] * w;
+        r.m[col * 4 + 1] += v.v[1] * w;
+        r.m[col * 4 + 2] += v.v[2] * w;
+    }
+    return r;
+}
+
+// rotate around x axis by an angle in degrees
+inline mat4 rotate_x_deg (const mat4& m, float deg) {
+    // convert to radians
+    float rad = deg * MATHS_DEG_TO_RAD;
+    float c = cosf (rad);
+    float s = sinf (rad);
+    mat4 m_r = identity_mat4 ();
+    m_r.m[5] = c;
+    m_r.m[9] = -s;
+    m_r.m[6] = s;
+    m_r.m[10] = c;
+    return m_r * m;
+}
+
+// rotate around y axis by an angle in degrees
+inline mat4 rotate_y_deg (const mat4& m, float deg) {
+    // convert to radians
+    float rad = deg * MATHS_DEG_TO_RAD;
+    float c = cosf (rad);
+    float s = sinf (rad);
+    mat4 m_r = identity_mat4 ();
+    m_r.m[0] = c;
+    m_r.m[8] = s;
+    m_r.m[2] = -s;
+    m_r.m[10] = c;
+    return m_r * m;
+}
+
+// rotate around z axis by an angle in degrees
+inline mat4 rotate_z_deg (const mat4& m, float deg) {
+    // convert to radians
+    float rad = deg * MATHS_DEG_TO_RAD;
+    float c = cosf (rad);
+    float s = sinf (rad);
+    mat4 m_r = identity_mat4 ();
+    m_r.m[0] = c;
+    m_r.m[4] = -s;
+    m_r.m[1] = s;
+    m_r.m[5] = c;
+    return m_r * m;
+}
+
+// scale a matrix by [x, y, z]
+constexpr mat4 scale (const mat4& m, const vec3& v) {
+    mat4 r = m;
+    for (int col = 0; col < 4; col++) {
+        r.m[col * 4] *= v.v[0];
+        r.m[col * 4 + 1] *= v.v[1];
+        r.m[col * 4 + 2] *= v.v[2];
+    }
+    return r;
+}
+
+/*-----------------------VIRTUAL CAMERA MATRIX FUNCTIONS----------------------*/
+// returns a view matrix using the opengl lookAt style. COLUMN ORDER.
+inline mat4 look_at (const vec3& cam_pos, const vec3& targ_pos, const vec3& up) {
+    // forward vector
+    vec3 f = normalise (targ_pos - cam_pos);
+    // right vector
+    vec3 r = normalise (cross (f, up));
+    // real up vector
+    vec3 u = normalise (cross (r, f));
+    // rotation rows, then the inverse translation folded into the last column
+    return mat4 (
+            r.v[0], u.v[0], -f.v[0], 0.0f,
+            r.v[1], u.v[1], -f.v[1], 0.0f,
+            r.v[2], u.v[2], -f.v[2], 0.0f,
+            -dot (r, cam_pos), -dot (u, cam_pos), dot (f, cam_pos), 1.0f
+    );
+}
+
+// returns a perspective function mimicking the opengl projection style.
+inline mat4 perspective (float fovy, float aspect, float near, float far) {
+    float fov_rad = fovy * MATHS_DEG_TO_RAD;
+    float range = tanf (fov_rad / 2.0f) * near;
+    float sx = (2.0f * near) / (range * aspect + range * aspect);
+    float sy = near / range;
+    float sz = -(far + near) / (far - near);
+    float pz = -(2.0f * far * near) / (far - near);
+    mat4 m = zero_mat4 (); // make sure bottom-right corner is zero
+    m.m[0] = sx;
+    m.m[5] = sy;
+    m.m[10] = sz;
+    m.m[14] = pz;
+    m.m[11] = -1.0f;
+    return m;
+}
+
+/*----------------------------HAMILTON IN DA HOUSE!---------------------------*/
+constexpr float dot (const versor& q, const versor& r) {
+    return q.q[0] * r.q[0] + q.q[1] * r.q[1] + q.q[2] * r.q[2] + q.q[3] * r.q[3];
+}
+
+inline versor normalise (const versor& q) {
+    // norm(q) = q / magnitude (q)
+    // magnitude (q) = sqrt (w*w + x*x...)
+    // only compute sqrt if interior sum != 1.0
+    float sum = dot (q, q);
+    // NB: floats have min 6 digits of precision
+    const float thresh = 0.0001f;
+    if (fabsf (1.0f - sum) < thresh) {
+        return q;
+    }
+    return q * (1.0f / sqrtf (sum));
+}
+
+inline versor versor::operator* (const versor& rhs) const {
+    return normalise (mul_raw (rhs));
+}
+
+inline versor versor::operator+ (const versor& rhs) const {
+    return normalise (add_raw (rhs));
+}
+
+inline versor quat_from_axis_rad (float radians, float x, float y, float z) {
+    float s = sinf (radians * 0.5f);
+    return versor (cosf (radians * 0.5f), s * x, s * y, s * z);
+}
+
+inline versor quat_from_axis_deg (float degrees, float x, float y, float z) {
+    return quat_from_axis_rad (MATHS_DEG_TO_RAD * degrees, x, y, z);
+}
+
+constexpr mat4 quat_to_mat4 (const versor& q) {
+    return mat4 (
+            1.0f - 2.0f * q.q[2] * q.q[2] - 2.0f * q.q[3] * q.q[3],
+            2.0f * q.q[1] * q.q[2] + 2.0f * q.q[0] * q.q[3],
+            2.0f * q.q[1] * q.q[3] - 2.0f * q.q[0] * q.q[2],
+            0.0f,
+            2.0f * q.q[1] * q.q[2] - 2.0f * q.q[0] * q.q[3],
+            1.0f - 2.0f * q.q[1] * q.q[1] - 2.0f * q.q[3] * q.q[3],
+            2.0f * q.q[2] * q.q[3] + 2.0f * q.q[0] * q.q[1],
+            0.0f,
+            2.0f * q.q[1] * q.q[3] + 2.0f * q.q[0] * q.q[2],
+            2.0f * q.q[2] * q.q[3] - 2.0f * q.q[0] * q.q[1],
+            1.0f - 2.0f * q.q[1] * q.q[1] - 2.0f * q.q[2] * q.q[2],
+            0.0f,
+            0.0f,
+            0.0f,
+            0.0f,
+            1.0f
+    );
+}
+
+// q and r are taken by value: the short-way-around flip no longer writes back
+// into the caller's versor
+inline versor slerp (versor q, const versor& r, float t) {
+    // angle between q0-q1
+    float cos_half_theta = dot (q, r);
+    // if dot product is negative then one quaternion should be negated, to make
+    // it take the short way around, rather than the long way
+    if (cos_half_theta < 0.0f) {
+        q = q * -1.0f;
+        cos_half_theta = -cos_half_theta;
+    }
+    // if qa=qb or qa=-qb then theta = 0 and we can return qa
+    if (cos_half_theta >= 1.0f) {
+        return q;
+    }
+    // Calculate temporary values
+    float sin_half_theta = sqrtf (1.0f - cos_half_theta * cos_half_theta);
+    // if theta = 180 degrees then result is not fully defined
+    // we could rotate around any axis normal to qa or qb
+    if (fabsf (sin_half_theta) < 0.001f) {
+        return (q * (1.0f - t)).add_raw (r * t);
+    }
+    float half_theta = acosf (cos_half_theta);
+    float a = sinf ((1.0f - t) * half_theta) / sin_half_theta;
+    float b = sinf (t * half_theta) / sin_half_theta;
+    return (q * a).add_raw (r * b);
+}
+
+#endif